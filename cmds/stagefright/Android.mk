@@ -187,3 +187,159 @@ LOCAL_MODULE_TAGS := optional
 LOCAL_MODULE:= muxer
 
 include $(BUILD_EXECUTABLE)
+
+################################################################################
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:=               \
+        looperbench.cpp         \
+
+LOCAL_SHARED_LIBRARIES := \
+	liblog libutils libstagefright_foundation
+
+LOCAL_C_INCLUDES:= \
+	frameworks/av/media/libstagefright \
+
+LOCAL_CFLAGS += -Wno-multichar
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_MODULE:= looperbench
+
+include $(BUILD_EXECUTABLE)
+
+################################################################################
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:=               \
+        messagebench.cpp        \
+
+LOCAL_SHARED_LIBRARIES := \
+	liblog libutils libstagefright_foundation
+
+LOCAL_C_INCLUDES:= \
+	frameworks/av/media/libstagefright \
+
+LOCAL_CFLAGS += -Wno-multichar
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_MODULE:= messagebench
+
+include $(BUILD_EXECUTABLE)
+
+################################################################################
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:=               \
+        hlsbench.cpp            \
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright libstagefright_httplive liblog libutils libbinder \
+        libstagefright_foundation libcutils
+
+LOCAL_C_INCLUDES:= \
+	frameworks/av/media/libstagefright \
+	$(TOP)/frameworks/native/include/media/openmax
+
+LOCAL_CFLAGS += -Wno-multichar
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_MODULE:= hlsbench
+
+include $(BUILD_EXECUTABLE)
+
+################################################################################
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:=               \
+        abrsim.cpp              \
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright_httplive liblog libutils libstagefright_foundation
+
+LOCAL_C_INCLUDES:= \
+	frameworks/av/media/libstagefright \
+
+LOCAL_CFLAGS += -Wno-multichar
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_MODULE:= abrsim
+
+include $(BUILD_EXECUTABLE)
+
+################################################################################
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:=               \
+        avcencbench.cpp         \
+
+LOCAL_STATIC_LIBRARIES := \
+	libstagefright_avcenc
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright_avc_common libstagefright_foundation liblog libutils
+
+LOCAL_C_INCLUDES:= \
+	frameworks/av/media/libstagefright/codecs/avc/enc/src \
+	frameworks/av/media/libstagefright/codecs/avc/common/include \
+
+LOCAL_CFLAGS += \
+	-DOSCL_IMPORT_REF= -DOSCL_UNUSED_ARG= -DOSCL_EXPORT_REF=
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_MODULE:= avcencbench
+
+include $(BUILD_EXECUTABLE)
+
+################################################################################
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:=               \
+        colorconvbench.cpp      \
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright libstagefright_foundation liblog libutils
+
+LOCAL_C_INCLUDES:= \
+	frameworks/av/media/libstagefright \
+	$(TOP)/frameworks/native/include/media/openmax
+
+LOCAL_CFLAGS += -Wno-multichar
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_MODULE:= colorconvbench
+
+include $(BUILD_EXECUTABLE)
+
+################################################################################
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:=               \
+        tsparsebench.cpp        \
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright libstagefright_foundation liblog libutils
+
+LOCAL_C_INCLUDES:= \
+	frameworks/av/media/libstagefright \
+	$(TOP)/frameworks/native/include/media/openmax
+
+LOCAL_CFLAGS += -Wno-multichar
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_MODULE:= tsparsebench
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "abrsim"
+#include <utils/Log.h>
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/AString.h>
+#include <media/stagefright/MediaErrors.h>
+
+#include "httplive/ABRPolicy.h"
+#include "httplive/M3UParser.h"
+
+using namespace android;
+
+// Replays a recorded bandwidth trace against the variants of a local
+// HTTP live streaming playlist tree and reports how each adaptive bitrate
+// policy fares: average bitrate, rebuffer ratio and number of switches.
+// The player model mirrors PlaylistFetcher, which keeps fetching while
+// less than kMaxBufferedDurationUs are buffered.
+
+static const int64_t kMaxBufferedDurationUs = 10000000ll;
+
+struct Segment {
+    int64_t mDurationUs;
+    size_t mSize;
+};
+
+struct Variant {
+    unsigned long mBandwidth;
+    Vector<Segment> mSegments;
+};
+
+struct TracePoint {
+    int64_t mDurationUs;
+    int64_t mBandwidthBps;
+};
+
+static sp<M3UParser> parsePlaylist(const char *url) {
+    CHECK(!strncasecmp(url, "file://", 7));
+
+    FILE *file = fopen(url + 7, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "unable to open '%s'\n", url + 7);
+        return NULL;
+    }
+
+    AString data;
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.append(buffer, n);
+    }
+    fclose(file);
+
+    sp<M3UParser> playlist = new M3UParser(url, data.c_str(), data.size());
+    if (playlist->initCheck() != OK) {
+        fprintf(stderr, "failed to parse '%s'\n", url + 7);
+        return NULL;
+    }
+
+    return playlist;
+}
+
+static bool loadVariant(
+        const char *url, unsigned long bandwidth, Variant *variant) {
+    sp<M3UParser> playlist = parsePlaylist(url);
+    if (playlist == NULL) {
+        return false;
+    }
+
+    variant->mBandwidth = bandwidth;
+
+    for (size_t i = 0; i < playlist->size(); ++i) {
+        AString uri;
+        sp<AMessage> meta;
+        CHECK(playlist->itemAt(i, &uri, &meta));
+
+        Segment segment;
+        CHECK(meta->findInt64("durationUs", &segment.mDurationUs));
+
+        int64_t rangeLength;
+        struct stat st;
+        if (meta->findInt64("range-length", &rangeLength)) {
+            segment.mSize = rangeLength;
+        } else if (!strncasecmp(uri.c_str(), "file://", 7)
+                && stat(uri.c_str() + 7, &st) == 0) {
+            segment.mSize = st.st_size;
+        } else {
+            // Segment missing from the tree, assume it matches the
+            // advertised bandwidth.
+            segment.mSize = bandwidth / 8 * segment.mDurationUs / 1000000ll;
+        }
+
+        variant->mSegments.push(segment);
+    }
+
+    return true;
+}
+
+static bool loadVariants(const char *path, Vector<Variant> *variants) {
+    char absPath[PATH_MAX];
+    if (realpath(path, absPath) == NULL) {
+        fprintf(stderr, "unable to resolve '%s'\n", path);
+        return false;
+    }
+
+    AString url = "file://";
+    url.append(absPath);
+
+    sp<M3UParser> master = parsePlaylist(url.c_str());
+    if (master == NULL) {
+        return false;
+    }
+
+    if (!master->isVariantPlaylist()) {
+        Variant variant;
+        if (!loadVariant(url.c_str(), 0, &variant)) {
+            return false;
+        }
+        variants->push(variant);
+        return true;
+    }
+
+    for (size_t i = 0; i < master->size(); ++i) {
+        AString uri;
+        sp<AMessage> meta;
+        CHECK(master->itemAt(i, &uri, &meta));
+
+        int32_t bandwidth;
+        CHECK(meta->findInt32("bandwidth", &bandwidth));
+
+        Variant variant;
+        if (!loadVariant(uri.c_str(), bandwidth, &variant)) {
+            return false;
+        }
+
+        // Keep them sorted by bandwidth, like LiveSession does.
+        size_t j = 0;
+        while (j < variants->size()
+                && variants->itemAt(j).mBandwidth <= variant.mBandwidth) {
+            ++j;
+        }
+        variants->insertAt(variant, j);
+    }
+
+    return true;
+}
+
+// Trace files list one "<duration in ms> <bandwidth in kbps>" pair per line.
+static bool loadTrace(const char *path, Vector<TracePoint> *trace) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "unable to open '%s'\n", path);
+        return false;
+    }
+
+    bool anyBandwidth = false;
+
+    long long durationMs;
+    double kbps;
+    while (fscanf(file, "%lld %lf", &durationMs, &kbps) == 2) {
+        if (durationMs <= 0 || kbps < 0.0) {
+            continue;
+        }
+
+        if (kbps > 0.0) {
+            anyBandwidth = true;
+        }
+
+        TracePoint point;
+        point.mDurationUs = durationMs * 1000ll;
+        point.mBandwidthBps = (int64_t)(kbps * 1000.0);
+        trace->push(point);
+    }
+
+    fclose(file);
+
+    // An all zero trace would never complete a transfer.
+    return anyBandwidth;
+}
+
+// Plays back the trace (looping) starting at "*nowUs" and returns the time
+// it takes to transfer "numBytes".
+static int64_t transfer(
+        const Vector<TracePoint> &trace, int64_t traceDurationUs,
+        int64_t *nowUs, size_t numBytes) {
+    int64_t startUs = *nowUs;
+    double bitsLeft = numBytes * 8.0;
+
+    while (bitsLeft > 0.0) {
+        // Locate the trace point covering the current time.
+        int64_t offsetUs = *nowUs % traceDurationUs;
+        size_t i = 0;
+        while (offsetUs >= trace.itemAt(i).mDurationUs) {
+            offsetUs -= trace.itemAt(i).mDurationUs;
+            ++i;
+        }
+
+        const TracePoint &point = trace.itemAt(i);
+        int64_t remainingUs = point.mDurationUs - offsetUs;
+
+        double bits = point.mBandwidthBps * (remainingUs / 1E6);
+        if (bits >= bitsLeft) {
+            *nowUs += (int64_t)(bitsLeft * 1E6 / point.mBandwidthBps) + 1;
+            break;
+        }
+
+        bitsLeft -= bits;
+        *nowUs += remainingUs;
+    }
+
+    return *nowUs - startUs;
+}
+
+static void simulate(
+        const char *policyName,
+        const Vector<Variant> &variants,
+        const Vector<TracePoint> &trace,
+        int64_t requestLatencyUs) {
+    sp<ABRPolicy> policy = ABRPolicy::Create(policyName);
+
+    Vector<unsigned long> bandwidths;
+    size_t numSegments = variants.itemAt(0).mSegments.size();
+    for (size_t i = 0; i < variants.size(); ++i) {
+        bandwidths.push(variants.itemAt(i).mBandwidth);
+        if (variants.itemAt(i).mSegments.size() < numSegments) {
+            numSegments = variants.itemAt(i).mSegments.size();
+        }
+    }
+
+    int64_t traceDurationUs = 0;
+    for (size_t i = 0; i < trace.size(); ++i) {
+        traceDurationUs += trace.itemAt(i).mDurationUs;
+    }
+
+    int64_t nowUs = 0;
+    int64_t bufferedUs = 0;
+    int64_t startupUs = -1;
+    int64_t stallUs = 0;
+    int64_t playedUs = 0;
+    double bitrateTimesDuration = 0.0;
+    size_t numSwitches = 0;
+    ssize_t index = -1;
+
+    for (size_t i = 0; i < numSegments; ++i) {
+        size_t newIndex =
+            policy->pickVariant(bandwidths, index, bufferedUs, nowUs);
+
+        if (index >= 0 && newIndex != (size_t)index) {
+            ++numSwitches;
+        }
+        index = newIndex;
+
+        const Segment &segment =
+            variants.itemAt(index).mSegments.itemAt(i);
+
+        nowUs += requestLatencyUs;
+        int64_t downloadUs = requestLatencyUs
+            + transfer(trace, traceDurationUs, &nowUs, segment.mSize);
+
+        policy->addSegmentDownload(segment.mSize, downloadUs);
+
+        if (startupUs < 0) {
+            startupUs = downloadUs;
+        } else if (downloadUs > bufferedUs) {
+            stallUs += downloadUs - bufferedUs;
+            bufferedUs = 0;
+        } else {
+            bufferedUs -= downloadUs;
+        }
+
+        bufferedUs += segment.mDurationUs;
+        playedUs += segment.mDurationUs;
+        bitrateTimesDuration +=
+            (double)variants.itemAt(index).mBandwidth * segment.mDurationUs;
+
+        if (bufferedUs > kMaxBufferedDurationUs) {
+            // The fetcher idles until the buffer drops below the limit.
+            nowUs += bufferedUs - kMaxBufferedDurationUs;
+            bufferedUs = kMaxBufferedDurationUs;
+        }
+    }
+
+    printf("%-10s avg bitrate %8.1f kbps  rebuffer ratio %6.2f%%  "
+           "switches %4d  startup %6.1f ms\n",
+           policy->name(),
+           playedUs > 0 ? bitrateTimesDuration / playedUs / 1E3 : 0.0,
+           playedUs > 0 ? stallUs * 100.0 / playedUs : 0.0,
+           numSwitches,
+           startupUs / 1E3);
+}
+
+static void usage(const char *me) {
+    fprintf(stderr,
+            "usage: %s [-a policy] [-l request_latency_ms] "
+            "playlist.m3u8 trace\n"
+            "\n"
+            "trace lists \"<duration in ms> <bandwidth in kbps>\" per line "
+            "and is looped.\nWithout -a all policies are simulated.\n",
+            me);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+
+    const char *policyName = NULL;
+    int64_t requestLatencyUs = 0ll;
+
+    int res;
+    while ((res = getopt(argc, argv, "a:l:h")) >= 0) {
+        switch (res) {
+            case 'a':
+                policyName = optarg;
+                break;
+
+            case 'l':
+                requestLatencyUs = strtol(optarg, NULL, 10) * 1000ll;
+                break;
+
+            case '?':
+            case 'h':
+            default:
+                usage(me);
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc != 2) {
+        usage(me);
+    }
+
+    Vector<Variant> variants;
+    Vector<TracePoint> trace;
+    if (!loadVariants(argv[0], &variants) || !loadTrace(argv[1], &trace)) {
+        return 1;
+    }
+
+    printf("%d variants, %d segments\n",
+           variants.size(), variants.itemAt(0).mSegments.size());
+
+    if (policyName != NULL) {
+        simulate(policyName, variants, trace, requestLatencyUs);
+    } else {
+        simulate("throughput", variants, trace, requestLatencyUs);
+        simulate("buffer", variants, trace, requestLatencyUs);
+    }
+
+    return 0;
+}
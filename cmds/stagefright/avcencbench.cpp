@@ -0,0 +1,485 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "avcencbench"
+#include <utils/Log.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <utils/Vector.h>
+
+#include "avcenc_api.h"
+
+using namespace android;
+
+// Encodes the same input with the software AVC encoder for a number of
+// motion estimation thread counts, with the SIMD and the C SAD kernels,
+// and reports speed and quality of each configuration. The bitstreams
+// of all the configurations are expected to be identical.
+
+struct Config {
+    int mWidth;
+    int mHeight;
+    int mNumFrames;
+    int mFrameRate;
+    int mBitRate;
+    bool mSubPel;
+    const char *mInputPath;
+    const char *mOutputPath;
+};
+
+struct Result {
+    double mFps;
+    double mPsnrY;
+    double mPsnrYUV;
+    size_t mBytes;
+    uint32_t mHash;
+};
+
+// Frame store of the encoder, allocated through the DPB callbacks.
+struct FrameStore {
+    Vector<uint8_t *> mFrames;
+
+    ~FrameStore() {
+        clear();
+    }
+
+    void clear() {
+        for (size_t i = 0; i < mFrames.size(); ++i) {
+            free(mFrames[i]);
+        }
+        mFrames.clear();
+    }
+};
+
+static void *MallocWrapper(void * /* userData */, int32_t size, int32_t /* attrs */) {
+    void *ptr = malloc(size);
+    if (ptr) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+static void FreeWrapper(void * /* userData */, void *ptr) {
+    free(ptr);
+}
+
+static int32_t DpbAllocWrapper(void *userData, unsigned int sizeInMbs, unsigned int numBuffers) {
+    FrameStore *store = static_cast<FrameStore *>(userData);
+    store->clear();
+    for (unsigned int i = 0; i < numBuffers; ++i) {
+        uint8_t *frame = (uint8_t *)malloc((sizeInMbs << 7) * 3);
+        if (frame == NULL) {
+            return 0;
+        }
+        store->mFrames.push(frame);
+    }
+    return 1;
+}
+
+static int32_t BindFrameWrapper(void *userData, int32_t index, uint8_t **yuv) {
+    FrameStore *store = static_cast<FrameStore *>(userData);
+    CHECK(index >= 0 && index < (int32_t)store->mFrames.size());
+    *yuv = store->mFrames[index];
+    return 1;
+}
+
+static void UnbindFrameWrapper(void * /* userData */, int32_t /* index */) {
+}
+
+// Moving test pattern: a panning texture with a block moving against it
+// and some noise, so that the motion search has real work to do.
+static void makeFrame(uint8_t *yuv, int width, int height, int index) {
+    uint8_t *y = yuv;
+    uint8_t *u = yuv + width * height;
+    uint8_t *v = u + (width * height >> 2);
+
+    for (int j = 0; j < height; ++j) {
+        for (int i = 0; i < width; ++i) {
+            int x = i + 3 * index;
+            int yy = j + index;
+            double value = 128 + 50 * sin(x * 0.09) * cos(yy * 0.07)
+                    + 30 * sin((x + 2 * yy) * 0.021);
+            if (abs(i - (width / 2 + 40 * sin(index * 0.1))) < width / 8
+                    && abs(j - height / 2) < height / 8) {
+                value = 255 - value;
+            }
+            value += (rand() % 7) - 3;
+            y[j * width + i] = value < 0 ? 0 : value > 255 ? 255 : (uint8_t)value;
+        }
+    }
+
+    for (int j = 0; j < height / 2; ++j) {
+        for (int i = 0; i < width / 2; ++i) {
+            u[j * (width / 2) + i] = (uint8_t)(128 + 40 * sin((i + index) * 0.05));
+            v[j * (width / 2) + i] = (uint8_t)(128 + 40 * cos((j - index) * 0.04));
+        }
+    }
+}
+
+static double sumSquaredError(
+        const uint8_t *a, int aPitch, const uint8_t *b, int bPitch,
+        int width, int height) {
+    double sse = 0;
+    for (int j = 0; j < height; ++j) {
+        for (int i = 0; i < width; ++i) {
+            int d = (int)a[j * aPitch + i] - (int)b[j * bPitch + i];
+            sse += d * d;
+        }
+    }
+    return sse;
+}
+
+static double psnr(double sse, double numSamples) {
+    if (sse == 0) {
+        return 99.0;
+    }
+    return 10.0 * log10(255.0 * 255.0 * numSamples / sse);
+}
+
+static uint32_t hashBytes(uint32_t hash, const uint8_t *data, size_t size) {
+    // FNV-1a
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool runOne(
+        const Config &config, const Vector<uint8_t *> &input,
+        int numThreads, bool scalarOnly, FILE *out, Result *result) {
+    FrameStore store;
+    AVCHandle handle;
+    memset(&handle, 0, sizeof(handle));
+    handle.userData = &store;
+    handle.CBAVC_DPBAlloc = DpbAllocWrapper;
+    handle.CBAVC_FrameBind = BindFrameWrapper;
+    handle.CBAVC_FrameUnbind = UnbindFrameWrapper;
+    handle.CBAVC_Malloc = MallocWrapper;
+    handle.CBAVC_Free = FreeWrapper;
+
+    // Same settings as SoftAVCEncoder, apart from the sub-pel search.
+    AVCEncParams params;
+    memset(&params, 0, sizeof(params));
+    params.rate_control = AVC_ON;
+    params.init_CBP_removal_delay = 1600;
+    params.auto_scd = AVC_ON;
+    params.out_of_band_param_set = AVC_ON;
+    params.poc_type = 2;
+    params.log2_max_poc_lsb_minus_4 = 12;
+    params.num_ref_frame = 1;
+    params.num_slice_group = 1;
+    params.db_filter = AVC_ON;
+    params.constrained_intra_pred = AVC_OFF;
+    params.fullsearch = AVC_OFF;
+    params.search_range = 16;
+    params.sub_pel = config.mSubPel ? AVC_ON : AVC_OFF;
+    params.width = config.mWidth;
+    params.height = config.mHeight;
+    params.bitrate = config.mBitRate;
+    params.frame_rate = 1000 * config.mFrameRate;  // In frames/ms!
+    params.CPB_size = (uint32_t)(config.mBitRate >> 1);
+    params.idr_period = config.mFrameRate;
+    params.profile = AVC_BASELINE;
+    params.level = AVC_LEVEL5_1;  // no limit on the picture size
+    params.me_threads = numThreads;
+    params.scalar_only = scalarOnly ? AVC_ON : AVC_OFF;
+
+    if (PVAVCEncInitialize(&handle, &params, NULL, NULL) != AVCENC_SUCCESS) {
+        fprintf(stderr, "failed to initialize the encoder\n");
+        return false;
+    }
+
+    static uint8_t nal[1 << 21];
+    static const uint8_t kStartCode[4] = { 0x00, 0x00, 0x00, 0x01 };
+    uint32_t nalSize;
+    int nalType;
+    uint32_t hash = 2166136261u;
+    size_t bytes = 0;
+    double sseY = 0, sseUV = 0;
+    int numEncoded = 0;
+    int64_t encodeUs = 0;
+
+    // SPS and PPS
+    for (;;) {
+        nalSize = sizeof(nal);
+        if (PVAVCEncodeNAL(&handle, nal, &nalSize, &nalType) != AVCENC_SUCCESS) {
+            break;
+        }
+        hash = hashBytes(hash, nal, nalSize);
+        bytes += nalSize;
+        if (out != NULL) {
+            fwrite(kStartCode, 1, sizeof(kStartCode), out);
+            fwrite(nal, 1, nalSize, out);
+        }
+    }
+
+    int width = config.mWidth;
+    int height = config.mHeight;
+    for (int i = 0; i < config.mNumFrames; ++i) {
+        uint8_t *yuv = input[i % input.size()];
+
+        AVCFrameIO frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.height = height;
+        frame.pitch = width;
+        frame.coding_timestamp = (uint32_t)(i * 1000ll / config.mFrameRate);
+        frame.disp_order = i;
+        frame.YCbCr[0] = yuv;
+        frame.YCbCr[1] = yuv + width * height;
+        frame.YCbCr[2] = frame.YCbCr[1] + (width * height >> 2);
+
+        int64_t startUs = ALooper::GetNowUs();
+        AVCEnc_Status status = PVAVCEncSetInput(&handle, &frame);
+        if (status != AVCENC_SUCCESS && status != AVCENC_NEW_IDR) {
+            encodeUs += ALooper::GetNowUs() - startUs;
+            continue;  // skipped by the rate control
+        }
+
+        for (;;) {
+            nalSize = sizeof(nal);
+            status = PVAVCEncodeNAL(&handle, nal, &nalSize, &nalType);
+            if (status != AVCENC_SUCCESS && status != AVCENC_PICTURE_READY) {
+                break;
+            }
+            hash = hashBytes(hash, nal, nalSize);
+            bytes += nalSize;
+            if (out != NULL) {
+                fwrite(kStartCode, 1, sizeof(kStartCode), out);
+                fwrite(nal, 1, nalSize, out);
+            }
+            if (status == AVCENC_PICTURE_READY) {
+                break;
+            }
+        }
+        encodeUs += ALooper::GetNowUs() - startUs;
+
+        AVCFrameIO recon;
+        if (status == AVCENC_PICTURE_READY
+                && PVAVCEncGetRecon(&handle, &recon) == AVCENC_SUCCESS) {
+            sseY += sumSquaredError(
+                    frame.YCbCr[0], width, recon.YCbCr[0], recon.pitch, width, height);
+            sseUV += sumSquaredError(
+                    frame.YCbCr[1], width / 2, recon.YCbCr[1], recon.pitch / 2,
+                    width / 2, height / 2);
+            sseUV += sumSquaredError(
+                    frame.YCbCr[2], width / 2, recon.YCbCr[2], recon.pitch / 2,
+                    width / 2, height / 2);
+            PVAVCEncReleaseRecon(&handle, &recon);
+            ++numEncoded;
+        }
+    }
+
+    PVAVCCleanUpEncoder(&handle);
+
+    double numSamples = (double)width * height * numEncoded;
+    result->mFps = encodeUs > 0 ? config.mNumFrames * 1E6 / encodeUs : 0;
+    result->mPsnrY = psnr(sseY, numSamples);
+    result->mPsnrYUV = psnr(sseY + sseUV, numSamples * 1.5);
+    result->mBytes = bytes;
+    result->mHash = hash;
+    return true;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr,
+            "usage: %s [-w width] [-h height] [-n num_frames] [-r fps] "
+            "[-b bitrate] [-t threads] [-c] [-p] [-o out.h264] [input.yuv]\n"
+            "\n"
+            "Encodes input.yuv (I420, default a synthetic moving pattern) "
+            "with 1, 2 and 4\nmotion estimation threads, or only with "
+            "-t threads, using the SIMD and the C\nSAD kernels, or only the "
+            "C ones with -c. -p enables the sub-pel search.\nWidth and "
+            "height must be multiples of 16.\n",
+            me);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+
+    Config config;
+    config.mWidth = 640;
+    config.mHeight = 352;
+    config.mNumFrames = 60;
+    config.mFrameRate = 30;
+    config.mBitRate = 2000000;
+    config.mSubPel = false;
+    config.mInputPath = NULL;
+    config.mOutputPath = NULL;
+
+    int onlyThreads = 0;
+    bool onlyScalar = false;
+
+    int res;
+    while ((res = getopt(argc, argv, "w:h:n:r:b:t:cpo:")) >= 0) {
+        switch (res) {
+            case 'w':
+                config.mWidth = atoi(optarg);
+                break;
+
+            case 'h':
+                config.mHeight = atoi(optarg);
+                break;
+
+            case 'n':
+                config.mNumFrames = atoi(optarg);
+                break;
+
+            case 'r':
+                config.mFrameRate = atoi(optarg);
+                break;
+
+            case 'b':
+                config.mBitRate = atoi(optarg);
+                break;
+
+            case 't':
+                onlyThreads = atoi(optarg);
+                break;
+
+            case 'c':
+                onlyScalar = true;
+                break;
+
+            case 'p':
+                config.mSubPel = true;
+                break;
+
+            case 'o':
+                config.mOutputPath = optarg;
+                break;
+
+            case '?':
+            default:
+                usage(me);
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc > 1 || config.mWidth <= 0 || config.mHeight <= 0
+            || (config.mWidth & 15) || (config.mHeight & 15)
+            || config.mNumFrames <= 0 || config.mFrameRate <= 0) {
+        usage(me);
+    }
+    config.mInputPath = argc == 1 ? argv[0] : NULL;
+
+    // Load or generate all the input up front, so that only the encoder
+    // is timed.
+    size_t frameSize = config.mWidth * config.mHeight * 3 / 2;
+    Vector<uint8_t *> input;
+    FILE *in = NULL;
+    if (config.mInputPath != NULL) {
+        in = fopen(config.mInputPath, "rb");
+        if (in == NULL) {
+            fprintf(stderr, "unable to open %s\n", config.mInputPath);
+            return 1;
+        }
+    }
+    srand(0x1234);
+    for (int i = 0; i < config.mNumFrames; ++i) {
+        uint8_t *frame = (uint8_t *)malloc(frameSize);
+        CHECK(frame != NULL);
+        if (in != NULL) {
+            if (fread(frame, 1, frameSize, in) != frameSize) {
+                free(frame);
+                break;
+            }
+        } else {
+            makeFrame(frame, config.mWidth, config.mHeight, i);
+        }
+        input.push(frame);
+    }
+    if (in != NULL) {
+        fclose(in);
+    }
+    if (input.isEmpty()) {
+        fprintf(stderr, "no complete frame in %s\n", config.mInputPath);
+        return 1;
+    }
+
+    printf("%dx%d, %d frames at %d fps, %d bps, sub-pel %s\n",
+           config.mWidth, config.mHeight, config.mNumFrames, config.mFrameRate,
+           config.mBitRate, config.mSubPel ? "on" : "off");
+
+    static const int kThreadCounts[] = { 1, 2, 4 };
+    Vector<int> threadCounts;
+    if (onlyThreads > 0) {
+        threadCounts.push(onlyThreads);
+    } else {
+        for (size_t i = 0; i < sizeof(kThreadCounts) / sizeof(kThreadCounts[0]); ++i) {
+            threadCounts.push(kThreadCounts[i]);
+        }
+    }
+
+    bool haveReference = false;
+    Result reference;
+    memset(&reference, 0, sizeof(reference));
+    bool allIdentical = true;
+
+    for (int scalar = onlyScalar ? 1 : 0; scalar < 2; ++scalar) {
+        for (size_t i = 0; i < threadCounts.size(); ++i) {
+            FILE *out = NULL;
+            if (config.mOutputPath != NULL && !haveReference) {
+                out = fopen(config.mOutputPath, "wb");
+                if (out == NULL) {
+                    fprintf(stderr, "unable to open %s\n", config.mOutputPath);
+                    return 1;
+                }
+            }
+
+            Result result;
+            bool ok = runOne(config, input, threadCounts[i], scalar, out, &result);
+            if (out != NULL) {
+                fclose(out);
+            }
+            if (!ok) {
+                return 1;
+            }
+
+            if (!haveReference) {
+                reference = result;
+                haveReference = true;
+            }
+            bool identical = result.mHash == reference.mHash
+                    && result.mBytes == reference.mBytes;
+            allIdentical = allIdentical && identical;
+
+            printf("%-4s threads %d: %7.2f fps (%5.2fx)  PSNR Y %6.3f dB  "
+                   "YUV %6.3f dB  %8.1f kbps  %s\n",
+                   scalar ? "C" : "SIMD", threadCounts[i],
+                   result.mFps, result.mFps / reference.mFps,
+                   result.mPsnrY, result.mPsnrYUV,
+                   result.mBytes * 8.0 * config.mFrameRate / config.mNumFrames / 1000,
+                   identical ? "identical" : "DIFFERENT");
+        }
+    }
+
+    for (size_t i = 0; i < input.size(); ++i) {
+        free(input[i]);
+    }
+
+    return allIdentical ? 0 : 1;
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "colorconvbench"
+#include <utils/Log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <media/stagefright/ColorConverter.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/MediaErrors.h>
+#include <utils/Vector.h>
+
+using namespace android;
+
+// Times ColorConverter for every source format, to RGB565 and RGBA, on 1, 2
+// and 4 threads, both at the source size and scaled down to a thumbnail.
+
+struct SrcFormat {
+    OMX_COLOR_FORMATTYPE mFormat;
+    const char *mName;
+};
+
+static const SrcFormat kSrcFormats[] = {
+    { OMX_COLOR_FormatYUV420Planar, "I420" },
+    { OMX_COLOR_FormatCbYCrY, "UYVY" },
+    { OMX_QCOM_COLOR_FormatYVU420SemiPlanar, "NV21" },
+    { OMX_COLOR_FormatYUV420SemiPlanar, "NV12" },
+    { OMX_TI_COLOR_FormatYUV420PackedSemiPlanar, "NV12 (TI)" },
+};
+
+static const size_t kNumSrcFormats = sizeof(kSrcFormats) / sizeof(kSrcFormats[0]);
+
+static size_t bufferSize(OMX_COLOR_FORMATTYPE format, size_t width, size_t height) {
+    return format == OMX_COLOR_FormatCbYCrY
+        ? width * height * 2 : width * height + 2 * (width / 2) * ((height + 1) / 2);
+}
+
+// Returns the time per frame in ms, or a negative value if the conversion
+// failed.
+static double timeConversion(
+        ColorConverter *converter, const Vector<uint8_t> &src,
+        size_t width, size_t height,
+        Vector<uint8_t> *dst, size_t dstWidth, size_t dstHeight,
+        int numRuns) {
+    int64_t startUs = ALooper::GetNowUs();
+    for (int i = 0; i < numRuns; ++i) {
+        status_t err = converter->convert(
+                src.array(), width, height, 0, 0, width - 1, height - 1,
+                dst->editArray(), dstWidth, dstHeight,
+                0, 0, dstWidth - 1, dstHeight - 1);
+        if (err != OK) {
+            return -1.0;
+        }
+    }
+    return (ALooper::GetNowUs() - startUs) / 1E3 / numRuns;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr,
+            "usage: %s [-w width] [-h height] [-n runs] [-t threads] "
+            "[-s thumbnail_size]\n"
+            "\n"
+            "Converts a random width x height frame (default 1920x1080) "
+            "runs times (default\n20) from every supported source format, "
+            "with 1, 2 and 4 threads or only\nwith -t threads. Each frame "
+            "is also scaled down to fit thumbnail_size\n(default 512).\n",
+            me);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+
+    int width = 1920;
+    int height = 1080;
+    int numRuns = 20;
+    int numThreads = 0;
+    int thumbnailSize = 512;
+
+    int res;
+    while ((res = getopt(argc, argv, "w:h:n:t:s:")) >= 0) {
+        switch (res) {
+            case 'w':
+                width = atoi(optarg);
+                break;
+
+            case 'h':
+                height = atoi(optarg);
+                break;
+
+            case 'n':
+                numRuns = atoi(optarg);
+                break;
+
+            case 't':
+                numThreads = atoi(optarg);
+                break;
+
+            case 's':
+                thumbnailSize = atoi(optarg);
+                break;
+
+            case '?':
+            default:
+                usage(me);
+        }
+    }
+
+    if (width < 2 || height < 2 || (width & 1) || numRuns < 1
+            || numThreads < 0 || thumbnailSize < 1) {
+        usage(me);
+    }
+
+    // Keeps the aspect ratio, like the thumbnails of the metadata retriever.
+    int thumbWidth = width;
+    int thumbHeight = height;
+    if (width >= height && width > thumbnailSize) {
+        thumbHeight = (height * thumbnailSize + width / 2) / width;
+        thumbWidth = thumbnailSize;
+    } else if (height > width && height > thumbnailSize) {
+        thumbWidth = (width * thumbnailSize + height / 2) / height;
+        thumbHeight = thumbnailSize;
+    }
+    thumbWidth = thumbWidth < 2 ? 2 : thumbWidth & ~1;
+    thumbHeight = thumbHeight < 1 ? 1 : thumbHeight;
+
+    static const size_t kThreads[] = { 1, 2, 4 };
+    const size_t numConfigs =
+        numThreads > 0 ? 1 : sizeof(kThreads) / sizeof(kThreads[0]);
+
+    static const OMX_COLOR_FORMATTYPE kDstFormats[] = {
+        OMX_COLOR_Format16bitRGB565, kColorFormatRGBA8888,
+    };
+    static const char *kDstNames[] = { "RGB565", "RGBA" };
+
+    Vector<uint8_t> dst;
+    dst.insertAt(0, 0, width * height * 4);
+
+    printf("%dx%d, thumbnail %dx%d, %d runs\n",
+            width, height, thumbWidth, thumbHeight, numRuns);
+
+    for (size_t f = 0; f < kNumSrcFormats; ++f) {
+        Vector<uint8_t> src;
+        src.insertAt(0, 0, bufferSize(kSrcFormats[f].mFormat, width, height));
+        unsigned seed = f;
+        for (size_t i = 0; i < src.size(); ++i) {
+            src.editItemAt(i) = rand_r(&seed) & 0xff;
+        }
+
+        for (size_t d = 0; d < 2; ++d) {
+            for (size_t t = 0; t < numConfigs; ++t) {
+                size_t threads = numThreads > 0 ? numThreads : kThreads[t];
+
+                ColorConverter converter(kSrcFormats[f].mFormat, kDstFormats[d]);
+                if (!converter.isValid()) {
+                    break;
+                }
+                converter.setNumThreads(threads);
+
+                double fullMs = timeConversion(
+                        &converter, src, width, height,
+                        &dst, width, height, numRuns);
+                double thumbMs = timeConversion(
+                        &converter, src, width, height,
+                        &dst, thumbWidth, thumbHeight, numRuns);
+                if (fullMs < 0 || thumbMs < 0) {
+                    fprintf(stderr, "%s to %s failed\n",
+                            kSrcFormats[f].mName, kDstNames[d]);
+                    return 1;
+                }
+
+                printf("%-9s to %-6s threads %zu: %7.2f ms  thumbnail %7.2f ms\n",
+                        kSrcFormats[f].mName, kDstNames[d], threads,
+                        fullMs, thumbMs);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,541 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "hlsbench"
+#include <utils/Log.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <binder/ProcessState.h>
+#include <cutils/properties.h>
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/AString.h>
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaErrors.h>
+
+#include "httplive/LiveSession.h"
+#include "httplive/M3UParser.h"
+
+using namespace android;
+
+// Serves the files below a directory over HTTP on the loopback interface,
+// adding a fixed per-request latency and throttling the transfer rate, so
+// HTTP live streaming can be timed against a reproducible "network".
+struct LocalHTTPServer {
+    LocalHTTPServer(const char *root, int64_t latencyUs, int32_t rateKBps)
+        : mRoot(root),
+          mLatencyUs(latencyUs),
+          mRateKBps(rateKBps),
+          mSocket(-1),
+          mPort(0) {
+    }
+
+    status_t start() {
+        mSocket = socket(AF_INET, SOCK_STREAM, 0);
+        if (mSocket < 0) {
+            return -errno;
+        }
+
+        int yes = 1;
+        setsockopt(mSocket, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+
+        socklen_t addrLen = sizeof(addr);
+        if (bind(mSocket, (const struct sockaddr *)&addr, sizeof(addr)) < 0
+                || listen(mSocket, 16) < 0
+                || getsockname(
+                    mSocket, (struct sockaddr *)&addr, &addrLen) < 0) {
+            close(mSocket);
+            mSocket = -1;
+            return -errno;
+        }
+
+        mPort = ntohs(addr.sin_port);
+
+        pthread_t thread;
+        pthread_create(&thread, NULL, AcceptThread, this);
+        pthread_detach(thread);
+
+        return OK;
+    }
+
+    unsigned port() const { return mPort; }
+
+private:
+    struct Connection {
+        LocalHTTPServer *mServer;
+        int mSocket;
+    };
+
+    AString mRoot;
+    int64_t mLatencyUs;
+    int32_t mRateKBps;
+    int mSocket;
+    unsigned mPort;
+
+    static void *AcceptThread(void *me) {
+        LocalHTTPServer *server = static_cast<LocalHTTPServer *>(me);
+
+        for (;;) {
+            int s = accept(server->mSocket, NULL, NULL);
+            if (s < 0) {
+                continue;
+            }
+
+            Connection *connection = new Connection;
+            connection->mServer = server;
+            connection->mSocket = s;
+
+            pthread_t thread;
+            pthread_create(&thread, NULL, ConnectionThread, connection);
+            pthread_detach(thread);
+        }
+
+        return NULL;
+    }
+
+    static void *ConnectionThread(void *me) {
+        Connection *connection = static_cast<Connection *>(me);
+
+        while (connection->mServer->serveRequest(connection->mSocket)) {
+        }
+
+        close(connection->mSocket);
+        delete connection;
+
+        return NULL;
+    }
+
+    static bool sendAll(int s, const char *data, size_t size) {
+        while (size > 0) {
+            ssize_t n = send(s, data, size, 0);
+            if (n <= 0) {
+                return false;
+            }
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    // Returns true if the connection can be kept alive.
+    bool serveRequest(int s) {
+        AString request;
+        char c;
+        while (!request.endsWith("\r\n\r\n")) {
+            if (recv(s, &c, 1, 0) != 1) {
+                return false;
+            }
+            request.append(&c, 1);
+        }
+
+        usleep(mLatencyUs);
+
+        char path[1024];
+        if (sscanf(request.c_str(), "GET %1023s", path) != 1) {
+            return false;
+        }
+
+        AString filename = mRoot;
+        filename.append(path);
+
+        int fd = open(filename.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) < 0) {
+            static const char kNotFound[] =
+                "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+            if (fd >= 0) {
+                close(fd);
+            }
+            return sendAll(s, kNotFound, strlen(kNotFound));
+        }
+
+        off64_t size = st.st_size;
+        off64_t first = 0;
+        off64_t last = size - 1;
+        bool partial = false;
+
+        ssize_t rangeIndex = request.find("Range: bytes=");
+        if (rangeIndex >= 0) {
+            long long a, b;
+            int n = sscanf(
+                    request.c_str() + rangeIndex, "Range: bytes=%lld-%lld",
+                    &a, &b);
+            if (n >= 1) {
+                first = a;
+                if (n == 2 && b < last) {
+                    last = b;
+                }
+                partial = true;
+            }
+        }
+
+        off64_t length = (first <= last) ? last - first + 1 : 0;
+
+        AString header = partial
+            ? "HTTP/1.1 206 Partial Content\r\n" : "HTTP/1.1 200 OK\r\n";
+        header.append(
+                StringPrintf(
+                    "Content-Length: %lld\r\n", (long long)length).c_str());
+        if (partial) {
+            header.append(
+                    StringPrintf(
+                        "Content-Range: bytes %lld-%lld/%lld\r\n",
+                        (long long)first, (long long)last,
+                        (long long)size).c_str());
+        }
+        header.append("\r\n");
+
+        bool ok = sendAll(s, header.c_str(), header.size());
+
+        static const size_t kChunkSize = 16384;
+        char buffer[kChunkSize];
+        int64_t startUs = ALooper::GetNowUs();
+        off64_t sent = 0;
+
+        lseek64(fd, first, SEEK_SET);
+        while (ok && sent < length) {
+            size_t n = (length - sent < (off64_t)kChunkSize)
+                ? length - sent : kChunkSize;
+
+            ssize_t m = read(fd, buffer, n);
+            if (m <= 0) {
+                ok = false;
+                break;
+            }
+
+            ok = sendAll(s, buffer, m);
+            sent += m;
+
+            if (mRateKBps > 0) {
+                int64_t dueUs = startUs + sent * 1000ll / mRateKBps;
+                int64_t nowUs = ALooper::GetNowUs();
+                if (dueUs > nowUs) {
+                    usleep(dueUs - nowUs);
+                }
+            }
+        }
+
+        close(fd);
+
+        return ok;
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct SessionObserver : public AHandler {
+    SessionObserver()
+        : mPrepared(false),
+          mErr(OK) {
+    }
+
+    status_t waitForPrepared() {
+        Mutex::Autolock autoLock(mLock);
+        while (!mPrepared) {
+            mCondition.wait(mLock);
+        }
+        return mErr;
+    }
+
+protected:
+    virtual void onMessageReceived(const sp<AMessage> &msg) {
+        int32_t what;
+        CHECK(msg->findInt32("what", &what));
+
+        Mutex::Autolock autoLock(mLock);
+
+        if (what == LiveSession::kWhatPrepared) {
+            mPrepared = true;
+            mCondition.signal();
+        } else if (what == LiveSession::kWhatPreparationFailed) {
+            CHECK(msg->findInt32("err", &mErr));
+            mPrepared = true;
+            mCondition.signal();
+        }
+    }
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+    bool mPrepared;
+    status_t mErr;
+
+    DISALLOW_EVIL_CONSTRUCTORS(SessionObserver);
+};
+
+// Returns the time it took until an access unit was available from the
+// session, or -1 if none arrived within "timeoutUs".
+static int64_t waitForAccessUnit(
+        const sp<LiveSession> &session, int64_t startUs, int64_t timeoutUs) {
+    for (;;) {
+        int64_t nowUs = ALooper::GetNowUs();
+        if (nowUs - startUs > timeoutUs) {
+            return -1;
+        }
+
+        static const LiveSession::StreamType kStreamTypes[] = {
+            LiveSession::STREAMTYPE_VIDEO,
+            LiveSession::STREAMTYPE_AUDIO,
+        };
+
+        for (size_t i = 0; i < 2; ++i) {
+            sp<ABuffer> accessUnit;
+            status_t err;
+            do {
+                err = session->dequeueAccessUnit(kStreamTypes[i], &accessUnit);
+            } while (err == INFO_DISCONTINUITY);
+
+            if (err == OK) {
+                return nowUs - startUs;
+            }
+        }
+
+        usleep(1000);
+    }
+}
+
+static void runSession(const char *url, size_t numSeeks) {
+    sp<ALooper> looper = new ALooper;
+    looper->setName("hlsbench");
+    looper->start();
+
+    sp<SessionObserver> observer = new SessionObserver;
+    looper->registerHandler(observer);
+
+    sp<LiveSession> session = new LiveSession(
+            new AMessage(0, observer->id()));
+    looper->registerHandler(session);
+
+    static const int64_t kTimeoutUs = 30000000ll;
+
+    int64_t startUs = ALooper::GetNowUs();
+    session->connectAsync(url);
+
+    status_t err = observer->waitForPrepared();
+    if (err != OK) {
+        fprintf(stderr, "failed to prepare '%s' (err %d)\n", url, err);
+        return;
+    }
+
+    int64_t preparedUs = ALooper::GetNowUs() - startUs;
+    int64_t firstUnitUs = waitForAccessUnit(session, startUs, kTimeoutUs);
+
+    printf("prepare %.1f ms, first access unit %.1f ms\n",
+           preparedUs / 1E3, firstUnitUs / 1E3);
+
+    int64_t durationUs;
+    if (numSeeks > 0 && session->getDuration(&durationUs) == OK
+            && durationUs > 0) {
+        int64_t totalUs = 0;
+        size_t numTimed = 0;
+
+        for (size_t i = 0; i < numSeeks; ++i) {
+            // Alternate between both halves of the stream so that every
+            // seek actually has to switch segments.
+            int64_t timeUs = (i & 1)
+                ? durationUs / 2 + (durationUs / 2) * i / (numSeeks + 1)
+                : (durationUs / 2) * i / (numSeeks + 1);
+
+            startUs = ALooper::GetNowUs();
+            session->seekTo(timeUs);
+
+            int64_t latencyUs =
+                waitForAccessUnit(session, startUs, kTimeoutUs);
+            if (latencyUs < 0) {
+                printf("seek to %.2f s timed out\n", timeUs / 1E6);
+                continue;
+            }
+
+            totalUs += latencyUs;
+            ++numTimed;
+        }
+
+        if (numTimed > 0) {
+            printf("seek to first access unit: %.1f ms average over %d\n",
+                   totalUs / 1E3 / numTimed, numTimed);
+        }
+    }
+
+    session->disconnect();
+
+    looper->unregisterHandler(session->id());
+    looper->unregisterHandler(observer->id());
+    looper->stop();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static AString makeLivePlaylist(int32_t firstSeqNumber, size_t numSegments) {
+    AString playlist =
+        "#EXTM3U\n"
+        "#EXT-X-VERSION:3\n"
+        "#EXT-X-TARGETDURATION:2\n";
+
+    playlist.append(
+            StringPrintf(
+                "#EXT-X-MEDIA-SEQUENCE:%d\n", firstSeqNumber).c_str());
+
+    for (size_t i = 0; i < numSegments; ++i) {
+        playlist.append(
+                StringPrintf(
+                    "#EXTINF:2.000,\nsegment-%d.ts\n",
+                    firstSeqNumber + (int32_t)i).c_str());
+    }
+
+    return playlist;
+}
+
+// Times refreshing a long DVR window playlist that slid by one segment,
+// parsing it from scratch and incrementally.
+static void runPlaylistRefresh(size_t numSegments) {
+    static const size_t kNumRefreshes = 50;
+    static const char *kBaseURI = "http://127.0.0.1/live/index.m3u8";
+
+    AString initial = makeLivePlaylist(0, numSegments);
+    sp<M3UParser> previous =
+        new M3UParser(kBaseURI, initial.c_str(), initial.size());
+    CHECK_EQ(previous->initCheck(), (status_t)OK);
+
+    int64_t fullUs = 0;
+    int64_t incrementalUs = 0;
+
+    for (size_t i = 1; i <= kNumRefreshes; ++i) {
+        AString refreshed = makeLivePlaylist(i, numSegments);
+
+        int64_t startUs = ALooper::GetNowUs();
+        sp<M3UParser> full =
+            new M3UParser(kBaseURI, refreshed.c_str(), refreshed.size());
+        fullUs += ALooper::GetNowUs() - startUs;
+
+        startUs = ALooper::GetNowUs();
+        sp<M3UParser> incremental = new M3UParser(
+                kBaseURI, refreshed.c_str(), refreshed.size(), previous);
+        incrementalUs += ALooper::GetNowUs() - startUs;
+
+        CHECK_EQ(full->size(), incremental->size());
+
+        previous = incremental;
+    }
+
+    printf("refresh of %d segment playlist: full %.2f ms, "
+           "incremental %.2f ms\n",
+           numSegments,
+           fullUs / 1E3 / kNumRefreshes,
+           incrementalUs / 1E3 / kNumRefreshes);
+}
+
+static void usage(const char *me) {
+    fprintf(stderr,
+            "usage: %s [-l latency_ms] [-r rate_KBps] [-s num_seeks] "
+            "root_dir playlist_path\n"
+            "       %s -p num_segments\n"
+            "\n"
+            "Serves root_dir over HTTP on 127.0.0.1 and times session "
+            "startup and seeking\non root_dir/playlist_path, or times "
+            "playlist refresh parsing.\nThe number of segments fetched in "
+            "parallel is taken from the property\n"
+            "media.httplive.prefetch-segments.\n",
+            me, me);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+
+    int64_t latencyUs = 50000ll;
+    int32_t rateKBps = 0;
+    size_t numSeeks = 10;
+    size_t numPlaylistSegments = 0;
+
+    int res;
+    while ((res = getopt(argc, argv, "l:r:s:p:h")) >= 0) {
+        switch (res) {
+            case 'l':
+                latencyUs = strtol(optarg, NULL, 10) * 1000ll;
+                break;
+
+            case 'r':
+                rateKBps = strtol(optarg, NULL, 10);
+                break;
+
+            case 's':
+                numSeeks = strtoul(optarg, NULL, 10);
+                break;
+
+            case 'p':
+                numPlaylistSegments = strtoul(optarg, NULL, 10);
+                break;
+
+            case '?':
+            case 'h':
+            default:
+                usage(me);
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (numPlaylistSegments > 0) {
+        runPlaylistRefresh(numPlaylistSegments);
+        return 0;
+    }
+
+    if (argc != 2) {
+        usage(me);
+    }
+
+    ProcessState::self()->startThreadPool();
+    DataSource::RegisterDefaultSniffers();
+
+    LocalHTTPServer server(argv[0], latencyUs, rateKBps);
+    CHECK_EQ(server.start(), (status_t)OK);
+
+    char value[PROPERTY_VALUE_MAX];
+    property_get("media.httplive.prefetch-segments", value, "default");
+    printf("prefetch segments: %s, latency %lld ms, rate %d KB/s\n",
+           value, latencyUs / 1000, rateKBps);
+
+    AString url = StringPrintf(
+            "http://127.0.0.1:%u/%s",
+            server.port(),
+            argv[1][0] == '/' ? argv[1] + 1 : argv[1]);
+
+    runSession(url.c_str(), numSeeks);
+
+    return 0;
+}
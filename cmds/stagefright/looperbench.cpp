@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "looperbench"
+#include <utils/Log.h>
+
+#include <stdlib.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+
+using namespace android;
+
+// Measures ALooper post and delivery throughput while the looper already
+// holds a given number of pending (far future) events.
+
+struct CountingHandler : public AHandler {
+    CountingHandler()
+        : mCount(0),
+          mTarget(0) {
+    }
+
+    void expect(size_t target) {
+        Mutex::Autolock autoLock(mLock);
+        mCount = 0;
+        mTarget = target;
+    }
+
+    void waitForAll() {
+        Mutex::Autolock autoLock(mLock);
+        while (mCount < mTarget) {
+            mCondition.wait(mLock);
+        }
+    }
+
+protected:
+    virtual void onMessageReceived(const sp<AMessage> &msg) {
+        Mutex::Autolock autoLock(mLock);
+        if (++mCount == mTarget) {
+            mCondition.signal();
+        }
+    }
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+    size_t mCount;
+    size_t mTarget;
+
+    DISALLOW_EVIL_CONSTRUCTORS(CountingHandler);
+};
+
+enum {
+    kWhatParked    = 'park',
+    kWhatPosted    = 'post',
+    kWhatDelivered = 'dlvr',
+};
+
+static const size_t kNumPosts = 10000;
+static const int64_t kParkDelayUs = 3600ll * 1000000ll;
+
+static void runOne(size_t numQueued, bool batch) {
+    sp<ALooper> looper = new ALooper;
+    looper->setName("looperbench");
+    looper->setBatchDelivery(batch);
+
+    sp<CountingHandler> handler = new CountingHandler;
+    looper->registerHandler(handler);
+
+    CHECK_EQ(looper->start(), (status_t)OK);
+
+    for (size_t i = 0; i < numQueued; ++i) {
+        (new AMessage(kWhatParked, handler->id()))->post(
+                kParkDelayUs + (rand() % 1000000));
+    }
+
+    // Post cost: far future messages with random delays, none of which
+    // will be delivered during the run.
+    int64_t startUs = ALooper::GetNowUs();
+    for (size_t i = 0; i < kNumPosts; ++i) {
+        (new AMessage(kWhatPosted, handler->id()))->post(
+                kParkDelayUs + (rand() % 1000000));
+    }
+    int64_t postUs = ALooper::GetNowUs() - startUs;
+
+    // Delivery cost: immediately due messages, measured from the first
+    // post until the handler has seen all of them.
+    handler->expect(kNumPosts);
+    startUs = ALooper::GetNowUs();
+    for (size_t i = 0; i < kNumPosts; ++i) {
+        (new AMessage(kWhatDelivered, handler->id()))->post();
+    }
+    handler->waitForAll();
+    int64_t deliverUs = ALooper::GetNowUs() - startUs;
+
+    printf("queued %7zu %-7s post %8.1f ns/msg  deliver %8.1f ns/msg\n",
+           numQueued,
+           batch ? "batch" : "single",
+           postUs * 1E3 / kNumPosts,
+           deliverUs * 1E3 / kNumPosts);
+
+    looper->clearMessage();
+    looper->stop();
+    looper->unregisterHandler(handler->id());
+}
+
+int main(int argc, char **argv) {
+    static const size_t kQueueSizes[] = { 10, 1000, 100000 };
+
+    srand(0x1234);
+
+    for (size_t i = 0; i < sizeof(kQueueSizes) / sizeof(kQueueSizes[0]); ++i) {
+        runOne(kQueueSizes[i], false /* batch */);
+        runOne(kQueueSizes[i], true /* batch */);
+    }
+
+    return 0;
+}
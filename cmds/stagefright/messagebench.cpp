@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "messagebench"
+#include <utils/Log.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+
+using namespace android;
+
+// Times the AMessage traffic pattern of an ACodec buffer round-trip
+// (notify -> MediaCodec -> reply) both in isolation and through a looper.
+
+enum {
+    kWhatDrainThisBuffer = 'drai',
+    kWhatOutputBufferDrained = 'outD',
+    kWhatCodecNotify = 'codc',
+};
+
+static const size_t kNumIterations = 100000;
+
+static const AMessage::Key kKeyWhat("what");
+static const AMessage::Key kKeyBufferID("buffer-id");
+static const AMessage::Key kKeyBuffer("buffer");
+static const AMessage::Key kKeyFlags("flags");
+static const AMessage::Key kKeyTimeUs("timeUs");
+static const AMessage::Key kKeyReply("reply");
+static const AMessage::Key kKeyMime("mime");
+
+struct EchoHandler : public AHandler {
+    EchoHandler() {}
+
+protected:
+    virtual void onMessageReceived(const sp<AMessage> &msg) {
+        uint32_t replyID;
+        CHECK(msg->senderAwaitsResponse(&replyID));
+
+        int32_t bufferID;
+        CHECK(msg->findInt32("buffer-id", &bufferID));
+
+        sp<AMessage> response = new AMessage;
+        response->setInt32("buffer-id", bufferID);
+        response->postReply(replyID);
+    }
+
+private:
+    DISALLOW_EVIL_CONSTRUCTORS(EchoHandler);
+};
+
+static sp<AMessage> makeNotify(
+        const sp<ABuffer> &buffer, int32_t bufferID, bool useKeys) {
+    sp<AMessage> reply = new AMessage(kWhatOutputBufferDrained);
+    sp<AMessage> notify = new AMessage(kWhatCodecNotify);
+
+    if (useKeys) {
+        reply->setInt32(kKeyBufferID, bufferID);
+
+        notify->setInt32(kKeyWhat, kWhatDrainThisBuffer);
+        notify->setInt32(kKeyBufferID, bufferID);
+        notify->setBuffer(kKeyBuffer, buffer);
+        notify->setInt32(kKeyFlags, 0);
+        notify->setInt64(kKeyTimeUs, bufferID * 33333ll);
+        notify->setString(kKeyMime, "video/avc");
+        notify->setMessage(kKeyReply, reply);
+    } else {
+        reply->setInt32("buffer-id", bufferID);
+
+        notify->setInt32("what", kWhatDrainThisBuffer);
+        notify->setInt32("buffer-id", bufferID);
+        notify->setBuffer("buffer", buffer);
+        notify->setInt32("flags", 0);
+        notify->setInt64("timeUs", bufferID * 33333ll);
+        notify->setString("mime", "video/avc");
+        notify->setMessage("reply", reply);
+    }
+
+    return notify;
+}
+
+static void consumeNotify(const sp<AMessage> &notify, bool useKeys) {
+    int32_t what, bufferID, flags;
+    int64_t timeUs;
+    sp<ABuffer> buffer;
+    sp<AMessage> reply;
+
+    if (useKeys) {
+        CHECK(notify->findInt32(kKeyWhat, &what));
+        CHECK(notify->findInt32(kKeyBufferID, &bufferID));
+        CHECK(notify->findBuffer(kKeyBuffer, &buffer));
+        CHECK(notify->findInt32(kKeyFlags, &flags));
+        CHECK(notify->findInt64(kKeyTimeUs, &timeUs));
+        CHECK(notify->findMessage(kKeyReply, &reply));
+    } else {
+        CHECK(notify->findInt32("what", &what));
+        CHECK(notify->findInt32("buffer-id", &bufferID));
+        CHECK(notify->findBuffer("buffer", &buffer));
+        CHECK(notify->findInt32("flags", &flags));
+        CHECK(notify->findInt64("timeUs", &timeUs));
+        CHECK(notify->findMessage("reply", &reply));
+    }
+}
+
+static void runLocal(bool useKeys) {
+    sp<ABuffer> buffer = new ABuffer(4096);
+
+    int64_t startUs = ALooper::GetNowUs();
+    for (size_t i = 0; i < kNumIterations; ++i) {
+        sp<AMessage> notify = makeNotify(buffer, i, useKeys);
+        sp<AMessage> copy = notify->dup();
+        consumeNotify(copy, useKeys);
+    }
+    int64_t elapsedUs = ALooper::GetNowUs() - startUs;
+
+    printf("build/dup/find (%s keys): %.1f ns/round-trip\n",
+           useKeys ? "pre-atomized" : "string",
+           elapsedUs * 1E3 / kNumIterations);
+}
+
+static void runLooper() {
+    sp<ALooper> looper = new ALooper;
+    looper->setName("messagebench");
+
+    sp<EchoHandler> handler = new EchoHandler;
+    looper->registerHandler(handler);
+
+    CHECK_EQ(looper->start(), (status_t)OK);
+
+    int64_t startUs = ALooper::GetNowUs();
+    for (size_t i = 0; i < kNumIterations / 10; ++i) {
+        sp<AMessage> msg = new AMessage(kWhatDrainThisBuffer, handler->id());
+        msg->setInt32("buffer-id", i);
+
+        sp<AMessage> response;
+        CHECK_EQ(msg->postAndAwaitResponse(&response), (status_t)OK);
+    }
+    int64_t elapsedUs = ALooper::GetNowUs() - startUs;
+
+    printf("postAndAwaitResponse: %.1f us/round-trip\n",
+           elapsedUs * 10.0 / kNumIterations);
+
+    looper->stop();
+    looper->unregisterHandler(handler->id());
+}
+
+int main(int argc, char **argv) {
+    runLocal(false /* useKeys */);
+    runLocal(true /* useKeys */);
+    runLooper();
+
+    return 0;
+}
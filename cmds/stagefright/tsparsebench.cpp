@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "tsparsebench"
+#include <utils/Log.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/MediaErrors.h>
+#include <utils/Vector.h>
+
+#include "mpeg2ts/ATSParser.h"
+
+using namespace android;
+
+// Feeds a transport stream through ATSParser one packet at a time and in
+// batches, and reports the parsing throughput of both.
+
+static const size_t kTSPacketSize = 188;
+
+// Returns the time the parse took in us, or a negative value on error.
+static int64_t feed(const Vector<uint8_t> &stream, bool batched) {
+    sp<ATSParser> parser = new ATSParser;
+    size_t numPackets = stream.size() / kTSPacketSize;
+
+    int64_t startUs = ALooper::GetNowUs();
+    if (batched) {
+        if (parser->feedTSPackets(stream.array(), numPackets) != OK) {
+            return -1;
+        }
+    } else {
+        for (size_t i = 0; i < numPackets; ++i) {
+            if (parser->feedTSPacket(
+                        stream.array() + i * kTSPacketSize,
+                        kTSPacketSize) != OK) {
+                return -1;
+            }
+        }
+    }
+    int64_t elapsedUs = ALooper::GetNowUs() - startUs;
+
+    parser->signalEOS(ERROR_END_OF_STREAM);
+
+    return elapsedUs;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr,
+            "usage: %s [-n runs] input.ts\n"
+            "\n"
+            "Parses input.ts, which must consist of 188 byte packets, runs "
+            "times (default 5)\nwith feedTSPacket() and with "
+            "feedTSPackets().\n",
+            me);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+
+    int numRuns = 5;
+
+    int res;
+    while ((res = getopt(argc, argv, "n:")) >= 0) {
+        switch (res) {
+            case 'n':
+                numRuns = atoi(optarg);
+                break;
+
+            case '?':
+            default:
+                usage(me);
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc != 1 || numRuns < 1) {
+        usage(me);
+    }
+
+    int fd = open(argv[0], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "unable to open %s\n", argv[0]);
+        return 1;
+    }
+
+    Vector<uint8_t> stream;
+    stream.insertAt((size_t)0, st.st_size - st.st_size % kTSPacketSize);
+    ssize_t n = read(fd, stream.editArray(), stream.size());
+    close(fd);
+
+    if (n != (ssize_t)stream.size() || stream.isEmpty()) {
+        fprintf(stderr, "unable to read %s\n", argv[0]);
+        return 1;
+    }
+
+    int64_t singleUs = 0;
+    int64_t batchedUs = 0;
+
+    for (int run = 0; run < numRuns; ++run) {
+        int64_t single = feed(stream, false /* batched */);
+        int64_t batched = feed(stream, true /* batched */);
+        if (single < 0 || batched < 0) {
+            fprintf(stderr, "%s is not a valid transport stream\n", argv[0]);
+            return 1;
+        }
+
+        singleUs += single;
+        batchedUs += batched;
+    }
+
+    printf("%zu packets, %d runs\n", stream.size() / kTSPacketSize, numRuns);
+    printf("feedTSPacket:  %.1f MB/s\n",
+           stream.size() * numRuns / (singleUs / 1E6) / 1E6);
+    printf("feedTSPackets: %.1f MB/s\n",
+           stream.size() * numRuns / (batchedUs / 1E6) / 1E6);
+
+    return 0;
+}
@@ -30,6 +30,7 @@ typedef SingleStateQueue<AudioTimestamp> AudioTimestampSingleStateQueue;
 //  - supports only a single reader, called MonoPipeReader
 //  - write() cannot overrun; instead it will return a short actual count if insufficient space
 //  - write() can optionally block if the pipe is full
+//  - in adaptive mode, the fill setpoint follows the jitter of the reader
 // Like Pipe, it is not multi-thread safe for either writer or reader
 // but writer and reader can be different threads.
 class MonoPipe : public NBAIO_Sink {
@@ -76,10 +77,18 @@ public:
 
             // average number of frames present in the pipe under normal conditions.
             // See throttling mechanism in MonoPipe::write()
+            // In adaptive mode, setAvgFrames() sets the lowest setpoint that adaptation may choose.
             size_t  getAvgFrames() const { return mSetpoint; }
             void    setAvgFrames(size_t setpoint);
             size_t  maxFrames() const { return mMaxFrames; }
 
+            // In adaptive mode, the reader measures the jitter of its read intervals and the
+            // lowest pipe depth at each read over a window of kAdaptWindowNs, then raises the
+            // setpoint quickly after an underrun or lowers it slowly while the margin exceeds the
+            // jitter.  Must be called before the reader starts.
+            void    setAdaptive(bool adaptive);
+            bool    isAdaptive() const { return mAdaptive; }
+
             // Set the shutdown state for the write side of a pipe.
             // This may be called by an unrelated thread.  When shutdown state is 'true',
             // a write that would otherwise block instead returns a short transfer count.
@@ -94,6 +103,11 @@ public:
             // Return NO_ERROR if there is a timestamp available
             status_t getTimestamp(AudioTimestamp& timestamp);
 
+            // Return the latency added by the pipe in frames: the current depth, and the peak
+            // depth seen by the reader over the last window.  Unlike getTimestamp() this has no
+            // side effects, so it may be called from any thread, e.g. for dumpsys.
+            void    getDepth(size_t *frames, size_t *peakFrames) const;
+
 private:
     // A pair of methods and a helper variable which allows the reader and the
     // writer to update and observe the values of mFront and mNextRdPTS in an
@@ -112,6 +126,10 @@ private:
     void observeFrontAndNRPTS(int32_t *outFront, int64_t *outNextRdPTS);
     volatile int32_t mUpdateSeq;
 
+    // Called by the reader on each read() in adaptive mode, with the number of frames that were
+    // available and the number of frames requested.
+    void adaptSetpoint(ssize_t avail, size_t count);
+
     const size_t    mReqFrames;     // as requested in constructor, unrounded
     const size_t    mMaxFrames;     // always a power of 2
     void * const    mBuffer;
@@ -126,9 +144,24 @@ private:
                                     // the writer with observeFrontAndNRPTS
     bool            mWriteTsValid;  // whether mWriteTs is valid
     struct timespec mWriteTs;       // time that the previous write() completed
-    size_t          mSetpoint;      // target value for pipe fill depth
+    size_t          mSetpoint;      // target value for pipe fill depth, word-sized so that
+                                    // it can be changed by the reader without barriers
     const bool      mWriteCanBlock; // whether write() should block if the pipe is full
 
+    // adaptive mode
+    static const int64_t kAdaptWindowNs = 500000000;
+    bool            mAdaptive;      // whether the reader retargets mSetpoint
+    size_t          mMinSetpoint;   // lowest setpoint, see setAvgFrames()
+    size_t          mPeakFrames;    // peak depth over the last window, published by the reader
+    // accessed only by the reader
+    int64_t         mWindowStartNs; // start of the current window, or -1 if none
+    int64_t         mLastReadNs;    // time of the previous read(), or -1 if none
+    size_t          mLastReadFrames; // count requested by the previous read()
+    int64_t         mWindowJitterNs; // largest deviation of a read interval from nominal
+    ssize_t         mWindowMinMargin; // smallest depth left after a read, < 0 after underrun
+    size_t          mWindowPeakFrames; // largest depth before a read
+    size_t          mWindowMaxCount; // largest count requested
+
     int64_t offsetTimestampByAudioFrames(int64_t ts, size_t audFrames);
     LinearTransform mSamplesToLocalTime;
 
@@ -38,6 +38,9 @@ enum Event {
     EVENT_RESERVED,
     EVENT_STRING,               // ASCII string, not NUL-terminated
     EVENT_TIMESTAMP,            // clock_gettime(CLOCK_MONOTONIC)
+    EVENT_FORMAT,               // uint16_t format ID followed by the raw arguments
+    EVENT_HISTOGRAM,            // uint16_t label ID, uint32_t bin width in ns, uint8_t bin count,
+                                // then uint16_t counts; the last bin counts all larger values
 };
 
 // ---------------------------------------------------------------------------
@@ -48,7 +51,8 @@ struct Entry {
         : mEvent(event), mLength(length), mData(data) { }
     /*virtual*/ ~Entry() { }
 
-    int     readAt(size_t offset) const;
+    // copies the shared memory representation to dst, and returns its size in bytes
+    size_t  copyTo(uint8_t *dst) const;
 
 private:
     friend class Writer;
@@ -68,13 +72,30 @@ private:
 //  byte[2+mLength]     duplicate copy of mLength to permit reverse scan
 //  byte[3+mLength]     start of next log entry
 
+// Format strings of EVENT_FORMAT and labels of EVENT_HISTOGRAM are stored once per Timeline in a
+// table of kMaxFormats slots following the circular buffer, and referred to by their index.
+static const size_t kMaxFormats = 32;
+static const size_t kMaxFormatLength = 92;  // including the NUL terminator
+static const size_t kMaxFormatArgs = 15;
+static const size_t kMaxHistogramBins = 64;
+
+// located in shared memory
+struct FormatSlot {
+    volatile int32_t mReady;    // non-zero once mFormat is valid
+    char    mFormat[kMaxFormatLength];
+};
+
 // located in shared memory
+// Each Entry is reserved by advancing mRear, and counted in mCommitted once it is fully written.
+// When the two are equal, all entries before mRear are complete.
 struct Shared {
-    Shared() : mRear(0) { }
+    Shared() : mRear(0), mCommitted(0), mFormats(0) { }
     /*virtual*/ ~Shared() { }
 
-    volatile int32_t mRear;     // index one byte past the end of most recent Entry
-    char    mBuffer[0];         // circular buffer for entries
+    volatile int32_t mRear;     // index one byte past the end of most recently reserved Entry
+    volatile int32_t mCommitted; // number of bytes of completely written entries
+    volatile int32_t mFormats;  // number of claimed format slots, may exceed kMaxFormats
+    char    mBuffer[0];         // circular buffer for entries, followed by kMaxFormats FormatSlot
 };
 
 public:
@@ -91,7 +112,8 @@ public:
 #endif
 
     // Input parameter 'size' is the desired size of the timeline in byte units.
-    // Returns the size rounded up to a power-of-2, plus the constant size overhead for indices.
+    // Returns the size rounded up to a power-of-2, plus the constant size overhead for indices
+    // and the format table.
     static size_t sharedSize(size_t size);
 
 #if 0
@@ -107,8 +129,8 @@ private:
 
 // ---------------------------------------------------------------------------
 
-// Writer is thread-safe with respect to Reader, but not with respect to multiple threads
-// calling Writer methods.  If you need multi-thread safety for writing, use LockedWriter.
+// Writer is thread-safe with respect to Reader, and wait-free with respect to multiple threads
+// calling Writer methods: each entry costs one atomic add to reserve it and one to commit it.
 class Writer : public RefBase {
 public:
     Writer();                   // dummy nop implementation without shared memory
@@ -126,6 +148,18 @@ public:
     virtual void    logTimestamp();
     virtual void    logTimestamp(const struct timespec& ts);
 
+    // Logs the format ID and the raw arguments; the text is only formatted by Reader::dump().
+    // 'fmt' must be a string literal, as it is identified by its address.  Supports the
+    // conversions of printf except %n and long double; falls back to logvf() for formats that
+    // are unsupported, too long, or don't fit in the format table.
+    virtual void    logFormat(const char *fmt, ...) __attribute__ ((format (printf, 2, 3)));
+    virtual void    logvFormat(const char *fmt, va_list ap);
+
+    // Logs a histogram of numBins counts of width binWidthNs starting at 0, where the last bin
+    // counts all larger values.  'label' must be a string literal, as for logFormat().
+    virtual void    logHistogram(const char *label, uint32_t binWidthNs, const uint16_t *counts,
+                            size_t numBins);
+
     virtual bool    isEnabled() const;
 
     // return value for all of these is the previous isEnabled()
@@ -139,32 +173,29 @@ private:
     void    log(Event event, const void *data, size_t length);
     void    log(const Entry *entry, bool trusted = false);
 
+    // Returns the slot of 'fmt' in the format table, claiming one if needed, or -1 if the
+    // format is not supported or the table is full.  The argument types are returned in *sig.
+    int     formatId(const char *fmt, const char **sig);
+
     const size_t    mSize;      // circular buffer size in bytes, must be a power of 2
     Shared* const   mShared;    // raw pointer to shared memory
     const sp<IMemory> mIMemory; // ref-counted version
-    int32_t         mRear;      // my private copy of mShared->mRear
     bool            mEnabled;   // whether to actually log
+
+    // private cache of the format slots claimed by this writer, indexed by slot
+    volatile int32_t mFormatReady[kMaxFormats];     // non-zero once the slot below is valid
+    const char*     mFormatPtrs[kMaxFormats];       // address of the format string literal
+    char            mFormatSigs[kMaxFormats][kMaxFormatArgs + 1];   // argument types
 };
 
 // ---------------------------------------------------------------------------
 
-// Similar to Writer, but safe for multiple threads to call concurrently
+// Writer is now safe for multiple threads to call concurrently; LockedWriter is kept so that
+// existing users still build.
 class LockedWriter : public Writer {
 public:
     LockedWriter();
     LockedWriter(size_t size, void *shared);
-
-    virtual void    log(const char *string);
-    virtual void    logf(const char *fmt, ...) __attribute__ ((format (printf, 2, 3)));
-    virtual void    logvf(const char *fmt, va_list ap);
-    virtual void    logTimestamp();
-    virtual void    logTimestamp(const struct timespec& ts);
-
-    virtual bool    isEnabled() const;
-    virtual bool    setEnabled(bool enabled);
-
-private:
-    mutable Mutex   mLock;
 };
 
 // ---------------------------------------------------------------------------
@@ -183,12 +214,23 @@ public:
     bool    isIMemory(const sp<IMemory>& iMemory) const;
 
 private:
+    // copies format string 'id' from the format table into 'format', returns false if not valid
+    bool    getFormat(uint16_t id, char *format) const;
+
+    // format the payload of EVENT_FORMAT and EVENT_HISTOGRAM into 'line' of size 'size'
+    void    formatEvent(const uint8_t *data, size_t length, char *line, size_t size) const;
+    void    formatHistogram(const uint8_t *data, size_t length, char *line, size_t size) const;
+
     const size_t    mSize;      // circular buffer size in bytes, must be a power of 2
     const Shared* const mShared; // raw pointer to shared memory
     const sp<IMemory> mIMemory; // ref-counted version
     int32_t     mFront;         // index of oldest acknowledged Entry
 
     static const size_t kSquashTimestamp = 5; // squash this many or more adjacent timestamps
+
+    // how long to wait for writers to commit the entries they have reserved
+    static const int kCommitRetries = 10;
+    static const int kCommitRetryUs = 1000;
 };
 
 };  // class NBLog
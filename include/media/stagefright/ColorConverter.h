@@ -27,12 +27,25 @@
 
 namespace android {
 
+// R, G, B and A bytes in that order in memory, as HAL_PIXEL_FORMAT_RGBA_8888.
+// Newer OMX_IVCommon.h headers have this value as OMX_COLOR_Format32BitRGBA8888.
+static const OMX_COLOR_FORMATTYPE kColorFormatRGBA8888 =
+        (OMX_COLOR_FORMATTYPE)0x7F00A000;
+
+// Converts to OMX_COLOR_Format16bitRGB565 or kColorFormatRGBA8888.
 struct ColorConverter {
     ColorConverter(OMX_COLOR_FORMATTYPE from, OMX_COLOR_FORMATTYPE to);
     ~ColorConverter();
 
     bool isValid() const;
 
+    // Large frames are converted in bands of rows on this many threads, the
+    // calling one included. Defaults to the number of CPUs, up to 4. Not to
+    // be called during a conversion.
+    void setNumThreads(size_t numThreads);
+
+    // If the crop rectangles differ in size, the source is scaled: every
+    // destination pixel is the average of the source pixels it covers.
     status_t convert(
             const void *srcBits,
             size_t srcWidth, size_t srcHeight,
@@ -59,25 +72,25 @@ private:
         size_t mCropLeft, mCropTop, mCropRight, mCropBottom;
     };
 
-    OMX_COLOR_FORMATTYPE mSrcFormat, mDstFormat;
-    uint8_t *mClip;
-
-    uint8_t *initClip();
+    struct Source;
+    struct Job;
+    struct Workers;
 
-    status_t convertCbYCrY(
-            const BitmapParams &src, const BitmapParams &dst);
-
-    status_t convertYUV420Planar(
-            const BitmapParams &src, const BitmapParams &dst);
+    enum {
+        kMaxDefaultThreads = 4,
+        kMaxThreads = 16,
+        // Smaller frames are converted on the calling thread only.
+        kMinPixelsForThreads = 640 * 480,
+    };
 
-    status_t convertQCOMYUV420SemiPlanar(
-            const BitmapParams &src, const BitmapParams &dst);
+    OMX_COLOR_FORMATTYPE mSrcFormat, mDstFormat;
+    size_t mNumThreads;
+    Workers *mWorkers;
 
-    status_t convertYUV420SemiPlanar(
-            const BitmapParams &src, const BitmapParams &dst);
+    status_t initSource(const BitmapParams &src, Source *source) const;
 
-    status_t convertTIYUV420PackedSemiPlanar(
-            const BitmapParams &src, const BitmapParams &dst);
+    static void ConvertRows(void *cookie, size_t band, size_t numBands);
+    static void ScaleRows(void *cookie, size_t band, size_t numBands);
 
     ColorConverter(const ColorConverter &);
     ColorConverter &operator=(const ColorConverter &);
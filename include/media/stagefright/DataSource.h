@@ -89,6 +89,35 @@ public:
         return ERROR_UNSUPPORTED;
     }
 
+    // Returns a pointer to "size" bytes of content at "offset" that stays
+    // valid for as long as this source is alive, or NULL if the source
+    // cannot provide direct access to that range. The memory must not be
+    // written to. Callers fall back to readAt() if NULL is returned.
+    virtual const void *getDirectPointer(off64_t offset, size_t size) {
+        return NULL;
+    }
+
+    enum AccessPattern {
+        kAccessNormal,
+        kAccessSequential,
+        kAccessRandom,
+    };
+
+    // Hints at how the content is going to be read, sources may use this
+    // to tune their readahead.
+    virtual void setAccessPattern(AccessPattern pattern) {}
+
+    // Hints that the given range is going to be read soon.
+    virtual void prefetch(off64_t offset, size_t size) {}
+
+    // Identifies the local file backing this source so that data derived
+    // from it can be cached across sessions. "size" and "mtime" describe
+    // the file's current state and let caches detect stale entries.
+    // Returns false if the source is not backed by a local file.
+    virtual bool getFileIdentity(String8 *key, int64_t *size, int64_t *mtime) {
+        return false;
+    }
+
     ////////////////////////////////////////////////////////////////////////////
 
     bool sniff(String8 *mimeType, float *confidence, sp<AMessage> *meta);
@@ -38,6 +38,11 @@ public:
 
     virtual status_t getSize(off64_t *size);
 
+    virtual const void *getDirectPointer(off64_t offset, size_t size);
+    virtual void setAccessPattern(AccessPattern pattern);
+    virtual void prefetch(off64_t offset, size_t size);
+    virtual bool getFileIdentity(String8 *key, int64_t *size, int64_t *mtime);
+
     virtual sp<DecryptHandle> DrmInitialization(const char *mime);
 
     virtual void getDrmInfo(sp<DecryptHandle> &handle, DrmManagerClient **client);
@@ -52,6 +57,17 @@ private:
     int64_t mLength;
     Mutex mLock;
 
+    // Read-only mapping of [mOffset, mOffset + mLength), established on
+    // first use. mMapBase is page aligned, mMapData points at mOffset.
+    // Only files we opened ourselves are mapped: a client could truncate
+    // the file behind an fd it handed us, and touching the mapping would
+    // then raise SIGBUS.
+    void *mMapBase;
+    size_t mMapSize;
+    const uint8_t *mMapData;
+    bool mMapAttempted;
+    bool mMapAllowed;
+
     /*for DRM*/
     sp<DecryptHandle> mDecryptHandle;
     DrmManagerClient *mDrmManagerClient;
@@ -64,6 +80,10 @@ private:
     char mPathBuffer[1024];
     ssize_t readAtDRM(off64_t offset, void *data, size_t size);
 
+    bool isDRMContainerBased() const;
+    bool mapFile_l();
+    void unmapFile_l();
+
     FileSource(const FileSource &);
     FileSource &operator=(const FileSource &);
 };
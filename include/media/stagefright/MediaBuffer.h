@@ -98,6 +98,7 @@ private:
 
     MediaBufferObserver *mObserver;
     MediaBuffer *mNextBuffer;
+    int32_t mGroupIndex;  // Slot in the owning MediaBufferGroup, or -1.
     int mRefCount;
 
     void *mData;
@@ -20,6 +20,7 @@
 
 #include <media/stagefright/MediaBuffer.h>
 #include <utils/Errors.h>
+#include <utils/String8.h>
 #include <utils/threads.h>
 
 namespace android {
@@ -36,7 +37,16 @@ public:
 
     // Blocks until a buffer is available and returns it to the caller,
     // the returned buffer will have a reference count of 1.
-    status_t acquire_buffer(MediaBuffer **buffer);
+    // If nonBlocking is true, returns WOULD_BLOCK instead of waiting when
+    // all buffers are in use.
+    status_t acquire_buffer(MediaBuffer **buffer, bool nonBlocking = false);
+
+    // Like acquire_buffer(), but gives up and returns TIMED_OUT if no
+    // buffer becomes available within timeoutUs.
+    status_t acquire_buffer_timed(MediaBuffer **buffer, int64_t timeoutUs);
+
+    // Appends buffer usage and acquire wait time statistics to result.
+    void dump(String8 &result) const;
 
 protected:
     virtual void signalBufferReturned(MediaBuffer *buffer);
@@ -44,10 +54,50 @@ protected:
 private:
     friend class MediaBuffer;
 
-    Mutex mLock;
+    enum {
+        // Buffers live in fixed size chunks of slots that never move, so
+        // the free list can be walked without holding mLock. Slot indices
+        // fit in 16 bits, the upper 16 bits of mFreeHead are an ABA tag.
+        kChunkShift     = 8,
+        kChunkSize      = 1 << kChunkShift,
+        kMaxChunks      = 255,
+        kNoSlot         = 0xffff,
+
+        // Bucket i counts waits shorter than 2^i ms, the last bucket
+        // everything longer.
+        kNumWaitBuckets = 12,
+    };
+
+    struct Slot {
+        MediaBuffer *mBuffer;
+        volatile int32_t mNextFree;
+    };
+
+    mutable Mutex mLock;
     Condition mCondition;
 
-    MediaBuffer *mFirstBuffer, *mLastBuffer;
+    Slot *mChunks[kMaxChunks];
+    size_t mNumBuffers;
+
+    volatile int32_t mFreeHead;
+    volatile int32_t mNumWaiters;
+
+    volatile int32_t mNumInUse;
+    volatile int32_t mPeakInUse;
+    volatile int32_t mNumAcquires;
+
+    // Protected by mLock.
+    uint32_t mNumWaits;
+    uint32_t mNumTimeouts;
+    int64_t mMaxWaitUs;
+    uint32_t mWaitHistogram[kNumWaitBuckets];
+
+    Slot *slotAt(int32_t index) const;
+    void pushFree(int32_t index);
+    MediaBuffer *popFree();
+
+    status_t acquire(MediaBuffer **buffer, int64_t timeoutUs);
+    void recordWait_l(int64_t waitUs, bool timedOut);
 
     MediaBufferGroup(const MediaBufferGroup &);
     MediaBufferGroup &operator=(const MediaBufferGroup &);
@@ -28,6 +28,7 @@ namespace android {
 
 class MediaBuffer;
 class MetaData;
+class String8;
 
 struct MediaSource : public virtual RefBase {
     MediaSource();
@@ -109,6 +110,10 @@ struct MediaSource : public virtual RefBase {
         return ERROR_UNSUPPORTED;
     }
 
+    // Appends the statistics of the buffers this source hands out, if it
+    // keeps any, for dumpsys.
+    virtual void dumpBufferStats(String8 &result) {}
+
 protected:
     virtual ~MediaSource();
 
@@ -25,6 +25,7 @@
 #include <utils/List.h>
 #include <utils/RefBase.h>
 #include <utils/threads.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -51,6 +52,12 @@ struct ALooper : public RefBase {
 
     status_t stop();
 
+    // If enabled, every wakeup of the looper thread dequeues all messages
+    // that are due at that time and delivers them back to back, instead of
+    // re-acquiring the queue lock for each one. Messages are still delivered
+    // in (time, post order) order. Takes effect on the next wakeup.
+    void setBatchDelivery(bool enabled);
+
     static int64_t GetNowUs();
 	void clearMessage();
 
@@ -62,6 +69,7 @@ private:
 
     struct Event {
         int64_t mWhenUs;
+        uint64_t mSeq;
         sp<AMessage> mMessage;
     };
 
@@ -70,7 +78,12 @@ private:
 
     AString mName;
 
-    List<Event> mEventQueue;
+    // Binary min-heap ordered by (mWhenUs, mSeq). mSeq is a monotonically
+    // increasing post counter, so events sharing a timestamp are delivered
+    // in the order they were posted.
+    Vector<Event> mEventQueue;
+    uint64_t mNextSeq;
+    bool mBatchDelivery;
 
     struct LooperThread;
     sp<LooperThread> mThread;
@@ -79,6 +92,10 @@ private:
     void post(const sp<AMessage> &msg, int64_t delayUs);
     bool loop();
 
+    static bool EventBefore(const Event &a, const Event &b);
+    void pushEvent_l(const Event &event);
+    void popEvent_l(Event *event);
+
     DISALLOW_EVIL_CONSTRUCTORS(ALooper);
 };
 
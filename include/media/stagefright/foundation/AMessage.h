@@ -32,6 +32,28 @@ struct Parcel;
 struct AMessage : public RefBase {
     AMessage(uint32_t what = 0, ALooper::handler_id target = 0);
 
+    // A field name that is atomized once, on first use, instead of on every
+    // set/find. Intended to be declared as a static constant next to the
+    // code that uses it, i.e.
+    //   static const AMessage::Key kKeyFlags("flags");
+    //   msg->setInt32(kKeyFlags, flags);
+    struct Key {
+        explicit Key(const char *name)
+            : mName(name),
+              mAtom(NULL) {
+        }
+
+        const char *atom() const;
+
+    private:
+        const char *mName;
+        mutable const char *mAtom;
+    };
+
+    // Message objects are recycled through a small per-thread free list.
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr, size_t size);
+
     static sp<AMessage> FromParcel(const Parcel &parcel);
     void writeToParcel(Parcel *parcel) const;
 
@@ -73,6 +95,28 @@ struct AMessage : public RefBase {
             const char *name,
             int32_t *left, int32_t *top, int32_t *right, int32_t *bottom) const;
 
+    void setInt32(const Key &key, int32_t value);
+    void setInt64(const Key &key, int64_t value);
+    void setSize(const Key &key, size_t value);
+    void setFloat(const Key &key, float value);
+    void setDouble(const Key &key, double value);
+    void setPointer(const Key &key, void *value);
+    void setString(const Key &key, const char *s, ssize_t len = -1);
+    void setObject(const Key &key, const sp<RefBase> &obj);
+    void setBuffer(const Key &key, const sp<ABuffer> &buffer);
+    void setMessage(const Key &key, const sp<AMessage> &obj);
+
+    bool findInt32(const Key &key, int32_t *value) const;
+    bool findInt64(const Key &key, int64_t *value) const;
+    bool findSize(const Key &key, size_t *value) const;
+    bool findFloat(const Key &key, float *value) const;
+    bool findDouble(const Key &key, double *value) const;
+    bool findPointer(const Key &key, void **value) const;
+    bool findString(const Key &key, AString *value) const;
+    bool findObject(const Key &key, sp<RefBase> *obj) const;
+    bool findBuffer(const Key &key, sp<ABuffer> *buffer) const;
+    bool findMessage(const Key &key, sp<AMessage> *obj) const;
+
     void post(int64_t delayUs = 0);
 
     // Posts the message to its target and waits for a response (or error)
@@ -88,7 +132,8 @@ struct AMessage : public RefBase {
 
     // Performs a deep-copy of "this", contained messages are in turn "dup'ed".
     // Warning: RefBase items, i.e. "objects" are _not_ copied but only have
-    // their refcount incremented.
+    // their refcount incremented. String values are immutable and shared
+    // between the original and the copy.
     sp<AMessage> dup() const;
 
     AString debugString(int32_t indent = 0) const;
@@ -121,6 +166,8 @@ private:
         int32_t mLeft, mTop, mRight, mBottom;
     };
 
+    struct SharedString;
+
     struct Item {
         union {
             int32_t int32Value;
@@ -130,7 +177,7 @@ private:
             double doubleValue;
             void *ptrValue;
             RefBase *refValue;
-            AString *stringValue;
+            SharedString *stringValue;
             Rect rectValue;
         } u;
         const char *mName;
@@ -138,17 +185,28 @@ private:
     };
 
     enum {
-        kMaxNumItems = 64
+        kMaxNumItems = 64,
+
+        // Open-addressed index from atomized name to item, must be a power
+        // of two and comfortably larger than kMaxNumItems.
+        kIndexSize   = 128,
     };
     Item mItems[kMaxNumItems];
     size_t mNumItems;
 
-    Item *allocateItem(const char *name);
+    // 0 marks an empty slot, otherwise the item's index plus one.
+    uint8_t mIndex[kIndexSize];
+
+    Item *allocateItemAtom(const char *atom);
     void freeItem(Item *item);
-    const Item *findItem(const char *name, Type type) const;
+    const Item *findItemAtom(const char *atom, Type type) const;
+
+    static size_t IndexSlot(const char *atom);
+    void addToIndex(size_t itemIndex);
+    ssize_t findItemIndex(const char *atom) const;
 
     void setObjectInternal(
-            const char *name, const sp<RefBase> &obj, Type type);
+            const Key &key, const sp<RefBase> &obj, Type type);
 
     DISALLOW_EVIL_CONSTRUCTORS(AMessage);
 };
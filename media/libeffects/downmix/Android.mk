@@ -28,3 +28,5 @@ LOCAL_PRELINK_MODULE := false
 LOCAL_CFLAGS += -fvisibility=hidden
 
 include $(BUILD_SHARED_LIBRARY)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
@@ -22,12 +22,38 @@
 #include <stdbool.h>
 #include "EffectDownmix.h"
 
+// the fold kernels use NEON or SSE2 when the build targets them
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#define DOWNMIX_USE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define DOWNMIX_USE_SSE2 1
+#endif
+#if defined(DOWNMIX_USE_NEON) || defined(DOWNMIX_USE_SSE2)
+// without vector kernels the per-layout loops below are faster than the scalar matrix fold
+#define DOWNMIX_USE_VECTOR 1
+#endif
+
 // Do not submit with DOWNMIX_TEST_CHANNEL_INDEX defined, strictly for testing
 //#define DOWNMIX_TEST_CHANNEL_INDEX 0
 // Do not submit with DOWNMIX_ALWAYS_USE_GENERIC_DOWNMIXER defined, strictly for testing
 //#define DOWNMIX_ALWAYS_USE_GENERIC_DOWNMIXER 0
 
 #define MINUS_3_DB_IN_Q19_12 2896 // -3dB = 0.707 * 2^12 = 2896
+#define UNITY_IN_Q19_12 4096      // 0dB = 2^12
+
+// most channels a fold supports: FL FR FC LFE BL BR BC SL SR
+#define DOWNMIX_MAX_FOLD_CHANNELS 9
+// frames with at most this many channels are processed as one vector by the NEON and SSE2 kernels
+#define DOWNMIX_VECTOR_CHANNELS 8
+
+// Q19.12 gain of each input channel into the left and right outputs, in input sample order.
+// The gains of channels beyond the input channel count are 0.
+typedef struct {
+    int16_t left[DOWNMIX_MAX_FOLD_CHANNELS];
+    int16_t right[DOWNMIX_MAX_FOLD_CHANNELS];
+} downmix_matrix_t;
 
 typedef enum {
     CHANNEL_MASK_SURROUND = AUDIO_CHANNEL_OUT_SURROUND,
@@ -299,12 +325,33 @@ static int Downmix_Process(effect_handle_t self,
 
     const bool accumulate =
             (pDwmModule->config.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE);
+    const bool isFloat = (pDwmModule->config.inputCfg.format == AUDIO_FORMAT_PCM_FLOAT);
     const uint32_t downmixInputChannelMask = pDwmModule->config.inputCfg.channels;
 
     switch(pDownmixer->type) {
 
       case DOWNMIX_TYPE_STRIP:
-          if (accumulate) {
+          if (isFloat) {
+              float *pSrcFloat = (float *) inBuffer->raw;
+              float *pDstFloat = (float *) outBuffer->raw;
+              if (accumulate) {
+                  while (numFrames) {
+                      pDstFloat[0] += pSrcFloat[0];
+                      pDstFloat[1] += pSrcFloat[1];
+                      pSrcFloat += pDownmixer->input_channel_count;
+                      pDstFloat += 2;
+                      numFrames--;
+                  }
+              } else {
+                  while (numFrames) {
+                      pDstFloat[0] = pSrcFloat[0];
+                      pDstFloat[1] = pSrcFloat[1];
+                      pSrcFloat += pDownmixer->input_channel_count;
+                      pDstFloat += 2;
+                      numFrames--;
+                  }
+              }
+          } else if (accumulate) {
               while (numFrames) {
                   pDst[0] = clamp16(pDst[0] + pSrc[0]);
                   pDst[1] = clamp16(pDst[1] + pSrc[1]);
@@ -324,38 +371,12 @@ static int Downmix_Process(effect_handle_t self,
           break;
 
       case DOWNMIX_TYPE_FOLD:
-#ifdef DOWNMIX_ALWAYS_USE_GENERIC_DOWNMIXER
-          // bypass the optimized downmix routines for the common formats
-          if (!Downmix_foldGeneric(
-                  downmixInputChannelMask, pSrc, pDst, numFrames, accumulate)) {
-              ALOGE("Multichannel configuration 0x%x is not supported", downmixInputChannelMask);
-              return -EINVAL;
-          }
-          break;
-#endif
-        // optimize for the common formats
-        switch((downmix_input_channel_mask_t)downmixInputChannelMask) {
-        case CHANNEL_MASK_QUAD_BACK:
-        case CHANNEL_MASK_QUAD_SIDE:
-            Downmix_foldFromQuad(pSrc, pDst, numFrames, accumulate);
-            break;
-        case CHANNEL_MASK_SURROUND:
-            Downmix_foldFromSurround(pSrc, pDst, numFrames, accumulate);
-            break;
-        case CHANNEL_MASK_5POINT1_BACK:
-        case CHANNEL_MASK_5POINT1_SIDE:
-            Downmix_foldFrom5Point1(pSrc, pDst, numFrames, accumulate);
-            break;
-        case CHANNEL_MASK_7POINT1_SIDE_BACK:
-            Downmix_foldFrom7Point1(pSrc, pDst, numFrames, accumulate);
-            break;
-        default:
-            if (!Downmix_foldGeneric(
-                    downmixInputChannelMask, pSrc, pDst, numFrames, accumulate)) {
-                ALOGE("Multichannel configuration 0x%x is not supported", downmixInputChannelMask);
-                return -EINVAL;
-            }
-            break;
+        if (!(isFloat ?
+                Downmix_foldFloat(downmixInputChannelMask, (float *) inBuffer->raw,
+                        (float *) outBuffer->raw, numFrames, accumulate) :
+                Downmix_fold16(downmixInputChannelMask, pSrc, pDst, numFrames, accumulate))) {
+            ALOGE("Multichannel configuration 0x%x is not supported", downmixInputChannelMask);
+            return -EINVAL;
         }
         break;
 
@@ -623,8 +644,9 @@ int Downmix_Configure(downmix_module_t *pDwmModule, effect_config_t *pConfig, bo
     // Check configuration compatibility with build options, and effect capabilities
     if (pConfig->inputCfg.samplingRate != pConfig->outputCfg.samplingRate
         || pConfig->outputCfg.channels != DOWNMIX_OUTPUT_CHANNELS
-        || pConfig->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT
-        || pConfig->outputCfg.format != AUDIO_FORMAT_PCM_16_BIT) {
+        || pConfig->inputCfg.format != pConfig->outputCfg.format
+        || (pConfig->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT
+                && pConfig->inputCfg.format != AUDIO_FORMAT_PCM_FLOAT)) {
         ALOGE("Downmix_Configure error: invalid config");
         return -EINVAL;
     }
@@ -779,7 +801,452 @@ int Downmix_getParameter(downmix_object_t *pDownmixer, int32_t param, size_t *pS
 
 
 /*----------------------------------------------------------------------------
- * Downmix_foldFromQuad()
+ * Fold kernels
+ *----------------------------------------------------------------------------
+ * Every fold applies a downmix_matrix_t to each frame: lt and rt are the sums of the input
+ * samples weighted by their Q19.12 gains, and the downmixed samples are lt >> 13 and rt >> 13
+ * clamped to 16 bits, added to pDst first when accumulating.  The sums are exact in 32 bits, so
+ * the vector kernels are bit-exact with the scalar loop.  The float kernels apply the same gains
+ * divided by 2^13 and do not clamp.
+ *
+ * The kernels are inlined with constant accumulate, so that each fold routine gets one loop
+ * without a test per frame for each value of accumulate.
+ *
+ * The NEON and SSE2 loops fold 4 frames per iteration, loading a whole vector at each frame:
+ * one multiply-add of the frame by each gain vector, then pairwise sums down to lt and rt.  With
+ * fewer than DOWNMIX_VECTOR_CHANNELS channels a vector extends into the next frame (its gains are
+ * 0), so the vector loop stops before the last vector would read past the end of pSrc.  The
+ * input of a block is read before its output is written and the output never overtakes the
+ * input, so pSrc and pDst may be the same buffer.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+#if defined(DOWNMIX_USE_NEON)
+
+// returns lt and rt of frames f0 and f1: {lt0, rt0, lt1, rt1}
+static inline int32x4_t Downmix_fold2Frames16(const int16_t *f0, const int16_t *f1,
+        int16x8_t left, int16x8_t right) {
+    const int16x8_t x0 = vld1q_s16(f0);
+    const int16x8_t x1 = vld1q_s16(f1);
+    int32x4_t l0 = vmull_s16(vget_low_s16(x0), vget_low_s16(left));
+    int32x4_t r0 = vmull_s16(vget_low_s16(x0), vget_low_s16(right));
+    int32x4_t l1 = vmull_s16(vget_low_s16(x1), vget_low_s16(left));
+    int32x4_t r1 = vmull_s16(vget_low_s16(x1), vget_low_s16(right));
+    l0 = vmlal_s16(l0, vget_high_s16(x0), vget_high_s16(left));
+    r0 = vmlal_s16(r0, vget_high_s16(x0), vget_high_s16(right));
+    l1 = vmlal_s16(l1, vget_high_s16(x1), vget_high_s16(left));
+    r1 = vmlal_s16(r1, vget_high_s16(x1), vget_high_s16(right));
+    const int32x2_t lr0 = vpadd_s32(vpadd_s32(vget_low_s32(l0), vget_high_s32(l0)),
+            vpadd_s32(vget_low_s32(r0), vget_high_s32(r0)));
+    const int32x2_t lr1 = vpadd_s32(vpadd_s32(vget_low_s32(l1), vget_high_s32(l1)),
+            vpadd_s32(vget_low_s32(r1), vget_high_s32(r1)));
+    return vcombine_s32(lr0, lr1);
+}
+
+// float version of Downmix_fold2Frames16(), the gains are in two vectors each
+static inline float32x4_t Downmix_fold2FramesFloat(const float *f0, const float *f1,
+        float32x4_t left0, float32x4_t left1, float32x4_t right0, float32x4_t right1) {
+    const float32x4_t x00 = vld1q_f32(f0);
+    const float32x4_t x01 = vld1q_f32(f0 + 4);
+    const float32x4_t x10 = vld1q_f32(f1);
+    const float32x4_t x11 = vld1q_f32(f1 + 4);
+    const float32x4_t l0 = vmlaq_f32(vmulq_f32(x00, left0), x01, left1);
+    const float32x4_t r0 = vmlaq_f32(vmulq_f32(x00, right0), x01, right1);
+    const float32x4_t l1 = vmlaq_f32(vmulq_f32(x10, left0), x11, left1);
+    const float32x4_t r1 = vmlaq_f32(vmulq_f32(x10, right0), x11, right1);
+    const float32x2_t lr0 = vpadd_f32(vpadd_f32(vget_low_f32(l0), vget_high_f32(l0)),
+            vpadd_f32(vget_low_f32(r0), vget_high_f32(r0)));
+    const float32x2_t lr1 = vpadd_f32(vpadd_f32(vget_low_f32(l1), vget_high_f32(l1)),
+            vpadd_f32(vget_low_f32(r1), vget_high_f32(r1)));
+    return vcombine_f32(lr0, lr1);
+}
+
+#elif defined(DOWNMIX_USE_SSE2)
+
+// returns lt and rt of frames f0 and f1: {lt0, rt0, lt1, rt1}
+static inline __m128i Downmix_fold2Frames16(const int16_t *f0, const int16_t *f1,
+        __m128i left, __m128i right) {
+    const __m128i x0 = _mm_loadu_si128((const __m128i *) f0);
+    const __m128i x1 = _mm_loadu_si128((const __m128i *) f1);
+    // sums of pairs of channels
+    const __m128i l0 = _mm_madd_epi16(x0, left);
+    const __m128i r0 = _mm_madd_epi16(x0, right);
+    const __m128i l1 = _mm_madd_epi16(x1, left);
+    const __m128i r1 = _mm_madd_epi16(x1, right);
+    // {l0[0] + l0[2], r0[0] + r0[2], l0[1] + l0[3], r0[1] + r0[3]}
+    const __m128i s0 = _mm_add_epi32(_mm_unpacklo_epi32(l0, r0), _mm_unpackhi_epi32(l0, r0));
+    const __m128i s1 = _mm_add_epi32(_mm_unpacklo_epi32(l1, r1), _mm_unpackhi_epi32(l1, r1));
+    return _mm_add_epi32(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1));
+}
+
+// float version of Downmix_fold2Frames16(), the gains are in two vectors each
+static inline __m128 Downmix_fold2FramesFloat(const float *f0, const float *f1,
+        __m128 left0, __m128 left1, __m128 right0, __m128 right1) {
+    const __m128 x00 = _mm_loadu_ps(f0);
+    const __m128 x01 = _mm_loadu_ps(f0 + 4);
+    const __m128 x10 = _mm_loadu_ps(f1);
+    const __m128 x11 = _mm_loadu_ps(f1 + 4);
+    const __m128 l0 = _mm_add_ps(_mm_mul_ps(x00, left0), _mm_mul_ps(x01, left1));
+    const __m128 r0 = _mm_add_ps(_mm_mul_ps(x00, right0), _mm_mul_ps(x01, right1));
+    const __m128 l1 = _mm_add_ps(_mm_mul_ps(x10, left0), _mm_mul_ps(x11, left1));
+    const __m128 r1 = _mm_add_ps(_mm_mul_ps(x10, right0), _mm_mul_ps(x11, right1));
+    const __m128 s0 = _mm_add_ps(_mm_unpacklo_ps(l0, r0), _mm_unpackhi_ps(l0, r0));
+    const __m128 s1 = _mm_add_ps(_mm_unpacklo_ps(l1, r1), _mm_unpackhi_ps(l1, r1));
+    return _mm_add_ps(_mm_movelh_ps(s0, s1), _mm_movehl_ps(s1, s0));
+}
+
+#endif
+
+// true while 4 frames can be folded by the vector loop without reading past the end of pSrc
+static inline bool Downmix_canFoldVector(size_t numFrames, int numChan) {
+    return numChan <= DOWNMIX_VECTOR_CHANNELS &&
+            numFrames * numChan >= (size_t) (3 * numChan + DOWNMIX_VECTOR_CHANNELS);
+}
+
+static inline __attribute__((always_inline))
+void Downmix_foldMatrix16(const downmix_matrix_t *pMatrix, const int numChan,
+        const int16_t *pSrc, int16_t *pDst, size_t numFrames, const bool accumulate) {
+#if defined(DOWNMIX_USE_NEON)
+    const int16x8_t left = vld1q_s16(pMatrix->left);
+    const int16x8_t right = vld1q_s16(pMatrix->right);
+    while (Downmix_canFoldVector(numFrames, numChan)) {
+        int32x4_t lr01 = Downmix_fold2Frames16(pSrc, pSrc + numChan, left, right);
+        int32x4_t lr23 = Downmix_fold2Frames16(pSrc + 2 * numChan, pSrc + 3 * numChan,
+                left, right);
+        lr01 = vshrq_n_s32(lr01, 13);
+        lr23 = vshrq_n_s32(lr23, 13);
+        if (accumulate) {
+            const int16x8_t dst = vld1q_s16(pDst);
+            lr01 = vaddw_s16(lr01, vget_low_s16(dst));
+            lr23 = vaddw_s16(lr23, vget_high_s16(dst));
+        }
+        // saturating narrow, same as clamp16()
+        vst1q_s16(pDst, vcombine_s16(vqmovn_s32(lr01), vqmovn_s32(lr23)));
+        pSrc += 4 * numChan;
+        pDst += 8;
+        numFrames -= 4;
+    }
+#elif defined(DOWNMIX_USE_SSE2)
+    const __m128i left = _mm_loadu_si128((const __m128i *) pMatrix->left);
+    const __m128i right = _mm_loadu_si128((const __m128i *) pMatrix->right);
+    while (Downmix_canFoldVector(numFrames, numChan)) {
+        __m128i lr01 = Downmix_fold2Frames16(pSrc, pSrc + numChan, left, right);
+        __m128i lr23 = Downmix_fold2Frames16(pSrc + 2 * numChan, pSrc + 3 * numChan,
+                left, right);
+        lr01 = _mm_srai_epi32(lr01, 13);
+        lr23 = _mm_srai_epi32(lr23, 13);
+        if (accumulate) {
+            const __m128i dst = _mm_loadu_si128((const __m128i *) pDst);
+            lr01 = _mm_add_epi32(lr01, _mm_srai_epi32(_mm_unpacklo_epi16(dst, dst), 16));
+            lr23 = _mm_add_epi32(lr23, _mm_srai_epi32(_mm_unpackhi_epi16(dst, dst), 16));
+        }
+        // saturating pack, same as clamp16()
+        _mm_storeu_si128((__m128i *) pDst, _mm_packs_epi32(lr01, lr23));
+        pSrc += 4 * numChan;
+        pDst += 8;
+        numFrames -= 4;
+    }
+#endif
+    while (numFrames) {
+        int32_t lt = 0, rt = 0; // samples in Q19.12 format
+        int i;
+        for (i = 0; i < numChan; i++) {
+            lt += pSrc[i] * pMatrix->left[i];
+            rt += pSrc[i] * pMatrix->right[i];
+        }
+        if (accumulate) {
+            pDst[0] = clamp16(pDst[0] + (lt >> 13));
+            pDst[1] = clamp16(pDst[1] + (rt >> 13));
+        } else {
+            pDst[0] = clamp16(lt >> 13);
+            pDst[1] = clamp16(rt >> 13);
+        }
+        pSrc += numChan;
+        pDst += 2;
+        numFrames--;
+    }
+}
+
+static inline __attribute__((always_inline))
+void Downmix_foldMatrixFloat(const downmix_matrix_t *pMatrix, const int numChan,
+        const float *pSrc, float *pDst, size_t numFrames, const bool accumulate) {
+    // the 16-bit gains including their final >> 13
+    float left[DOWNMIX_MAX_FOLD_CHANNELS], right[DOWNMIX_MAX_FOLD_CHANNELS];
+    int i;
+    for (i = 0; i < DOWNMIX_MAX_FOLD_CHANNELS; i++) {
+        left[i] = pMatrix->left[i] * (1.0f / (1 << 13));
+        right[i] = pMatrix->right[i] * (1.0f / (1 << 13));
+    }
+#if defined(DOWNMIX_USE_NEON)
+    const float32x4_t left0 = vld1q_f32(left);
+    const float32x4_t left1 = vld1q_f32(left + 4);
+    const float32x4_t right0 = vld1q_f32(right);
+    const float32x4_t right1 = vld1q_f32(right + 4);
+    while (Downmix_canFoldVector(numFrames, numChan)) {
+        float32x4_t lr01 = Downmix_fold2FramesFloat(pSrc, pSrc + numChan,
+                left0, left1, right0, right1);
+        float32x4_t lr23 = Downmix_fold2FramesFloat(pSrc + 2 * numChan, pSrc + 3 * numChan,
+                left0, left1, right0, right1);
+        if (accumulate) {
+            lr01 = vaddq_f32(lr01, vld1q_f32(pDst));
+            lr23 = vaddq_f32(lr23, vld1q_f32(pDst + 4));
+        }
+        vst1q_f32(pDst, lr01);
+        vst1q_f32(pDst + 4, lr23);
+        pSrc += 4 * numChan;
+        pDst += 8;
+        numFrames -= 4;
+    }
+#elif defined(DOWNMIX_USE_SSE2)
+    const __m128 left0 = _mm_loadu_ps(left);
+    const __m128 left1 = _mm_loadu_ps(left + 4);
+    const __m128 right0 = _mm_loadu_ps(right);
+    const __m128 right1 = _mm_loadu_ps(right + 4);
+    while (Downmix_canFoldVector(numFrames, numChan)) {
+        __m128 lr01 = Downmix_fold2FramesFloat(pSrc, pSrc + numChan,
+                left0, left1, right0, right1);
+        __m128 lr23 = Downmix_fold2FramesFloat(pSrc + 2 * numChan, pSrc + 3 * numChan,
+                left0, left1, right0, right1);
+        if (accumulate) {
+            lr01 = _mm_add_ps(lr01, _mm_loadu_ps(pDst));
+            lr23 = _mm_add_ps(lr23, _mm_loadu_ps(pDst + 4));
+        }
+        _mm_storeu_ps(pDst, lr01);
+        _mm_storeu_ps(pDst + 4, lr23);
+        pSrc += 4 * numChan;
+        pDst += 8;
+        numFrames -= 4;
+    }
+#endif
+    while (numFrames) {
+        float lt = 0, rt = 0;
+        for (i = 0; i < numChan; i++) {
+            lt += pSrc[i] * left[i];
+            rt += pSrc[i] * right[i];
+        }
+        if (accumulate) {
+            pDst[0] += lt;
+            pDst[1] += rt;
+        } else {
+            pDst[0] = lt;
+            pDst[1] = rt;
+        }
+        pSrc += numChan;
+        pDst += 2;
+        numFrames--;
+    }
+}
+
+
+/*----------------------------------------------------------------------------
+ * Downmix_buildMatrix()
+ *----------------------------------------------------------------------------
+ * Purpose:
+ * compute the gains of Downmix_foldGeneric() for a multichannel format that:
+ *  - has FL/FR
+ *  - if using AUDIO_CHANNEL_OUT_SIDE*, it contains both left and right
+ *  - if using AUDIO_CHANNEL_OUT_BACK*, it contains both left and right
+ *  - doesn't use any of the AUDIO_CHANNEL_OUT_TOP* channels
+ *  - doesn't use any of the AUDIO_CHANNEL_OUT_FRONT_*_OF_CENTER channels
+ * FL, BL and SL go to the left output, FR, BR and SR to the right output, and FC, LFE and BC
+ * to both at -3dB.
+ *
+ * Inputs:
+ *  mask       the channel mask of the multichannel format
+ *
+ * Outputs:
+ *  pMatrix    the gains of the fold
+ *
+ * Returns: the number of channels in mask, 0 if the multichannel format is not supported
+ *
+ *----------------------------------------------------------------------------
+ */
+static int Downmix_buildMatrix(uint32_t mask, downmix_matrix_t *pMatrix) {
+    // check against unsupported channels
+    if (mask & kUnsupported) {
+        ALOGE("Unsupported channels (top or front left/right of center)");
+        return 0;
+    }
+    // verify has FL/FR
+    if ((mask & AUDIO_CHANNEL_OUT_STEREO) != AUDIO_CHANNEL_OUT_STEREO) {
+        ALOGE("Front channels must be present");
+        return 0;
+    }
+    // verify uses SIDE as a pair (ok if not using SIDE at all)
+    if ((mask & kSides) != 0 && (mask & kSides) != kSides) {
+        ALOGE("Side channels must be used as a pair");
+        return 0;
+    }
+    // verify uses BACK as a pair (ok if not using BACK at all)
+    if ((mask & kBacks) != 0 && (mask & kBacks) != kBacks) {
+        ALOGE("Back channels must be used as a pair");
+        return 0;
+    }
+    const int numChan = popcount(mask);
+    if (numChan > DOWNMIX_MAX_FOLD_CHANNELS) {
+        ALOGE("Unsupported channels (unknown channel in 0x%x)", mask);
+        return 0;
+    }
+
+    // samples are in the order of the channel bits: FL FR FC LFE BL BR BC SL SR
+    memset(pMatrix, 0, sizeof(downmix_matrix_t));
+    uint32_t channels = mask;
+    int i;
+    for (i = 0; i < numChan; i++) {
+        const uint32_t channel = channels & -channels;
+        channels &= ~channel;
+        switch (channel) {
+        case AUDIO_CHANNEL_OUT_FRONT_LEFT:
+        case AUDIO_CHANNEL_OUT_BACK_LEFT:
+        case AUDIO_CHANNEL_OUT_SIDE_LEFT:
+            pMatrix->left[i] = UNITY_IN_Q19_12;
+            break;
+        case AUDIO_CHANNEL_OUT_FRONT_RIGHT:
+        case AUDIO_CHANNEL_OUT_BACK_RIGHT:
+        case AUDIO_CHANNEL_OUT_SIDE_RIGHT:
+            pMatrix->right[i] = UNITY_IN_Q19_12;
+            break;
+        case AUDIO_CHANNEL_OUT_FRONT_CENTER:
+        case AUDIO_CHANNEL_OUT_LOW_FREQUENCY:
+        case AUDIO_CHANNEL_OUT_BACK_CENTER:
+            pMatrix->left[i] = MINUS_3_DB_IN_Q19_12;
+            pMatrix->right[i] = MINUS_3_DB_IN_Q19_12;
+            break;
+        default:
+            // a channel unknown to the downmixer is dropped
+            break;
+        }
+    }
+    return numChan;
+}
+
+
+// sample at index 0 is FL
+// sample at index 1 is FR
+// sample at index 2 is RL
+// sample at index 3 is RR
+static const downmix_matrix_t kQuadMatrix = {
+    { UNITY_IN_Q19_12, 0, UNITY_IN_Q19_12, 0 },
+    { 0, UNITY_IN_Q19_12, 0, UNITY_IN_Q19_12 },
+};
+
+// sample at index 0 is FL
+// sample at index 1 is FR
+// sample at index 2 is FC
+// sample at index 3 is RC
+static const downmix_matrix_t kSurroundMatrix = {
+    { UNITY_IN_Q19_12, 0, MINUS_3_DB_IN_Q19_12, MINUS_3_DB_IN_Q19_12 },
+    { 0, UNITY_IN_Q19_12, MINUS_3_DB_IN_Q19_12, MINUS_3_DB_IN_Q19_12 },
+};
+
+// sample at index 0 is FL
+// sample at index 1 is FR
+// sample at index 2 is FC
+// sample at index 3 is LFE
+// sample at index 4 is RL
+// sample at index 5 is RR
+static const downmix_matrix_t k5Point1Matrix = {
+    { UNITY_IN_Q19_12, 0, MINUS_3_DB_IN_Q19_12, MINUS_3_DB_IN_Q19_12, UNITY_IN_Q19_12, 0 },
+    { 0, UNITY_IN_Q19_12, MINUS_3_DB_IN_Q19_12, MINUS_3_DB_IN_Q19_12, 0, UNITY_IN_Q19_12 },
+};
+
+// sample at index 0 is FL
+// sample at index 1 is FR
+// sample at index 2 is FC
+// sample at index 3 is LFE
+// sample at index 4 is RL
+// sample at index 5 is RR
+// sample at index 6 is SL
+// sample at index 7 is SR
+static const downmix_matrix_t k7Point1Matrix = {
+    { UNITY_IN_Q19_12, 0, MINUS_3_DB_IN_Q19_12, MINUS_3_DB_IN_Q19_12,
+            UNITY_IN_Q19_12, 0, UNITY_IN_Q19_12, 0 },
+    { 0, UNITY_IN_Q19_12, MINUS_3_DB_IN_Q19_12, MINUS_3_DB_IN_Q19_12,
+            0, UNITY_IN_Q19_12, 0, UNITY_IN_Q19_12 },
+};
+
+
+/*----------------------------------------------------------------------------
+ * Downmix_fold16(), Downmix_foldFloat()
+ *----------------------------------------------------------------------------
+ * Purpose:
+ * downmix a multichannel signal to stereo, with the optimized routine of the common formats
+ * or the generic one
+ *
+ * Inputs:
+ *  mask       the channel mask of pSrc
+ *  pSrc       multichannel audio buffer to downmix
+ *  numFrames  the number of multichannel frames to downmix
+ *  accumulate whether to mix (when true) the result of the downmix with the contents of pDst,
+ *               or overwrite pDst (when false)
+ *
+ * Outputs:
+ *  pDst       downmixed stereo audio samples
+ *
+ * Returns: false if multichannel format is not supported
+ *
+ *----------------------------------------------------------------------------
+ */
+bool Downmix_fold16(uint32_t mask, int16_t *pSrc, int16_t *pDst, size_t numFrames,
+        bool accumulate) {
+#ifdef DOWNMIX_ALWAYS_USE_GENERIC_DOWNMIXER
+    // bypass the optimized downmix routines for the common formats
+    return Downmix_foldGeneric(mask, pSrc, pDst, numFrames, accumulate);
+#endif
+    // optimize for the common formats
+    switch((downmix_input_channel_mask_t)mask) {
+    case CHANNEL_MASK_QUAD_BACK:
+    case CHANNEL_MASK_QUAD_SIDE:
+        Downmix_foldFromQuad(pSrc, pDst, numFrames, accumulate);
+        break;
+    case CHANNEL_MASK_SURROUND:
+        Downmix_foldFromSurround(pSrc, pDst, numFrames, accumulate);
+        break;
+    case CHANNEL_MASK_5POINT1_BACK:
+    case CHANNEL_MASK_5POINT1_SIDE:
+        Downmix_foldFrom5Point1(pSrc, pDst, numFrames, accumulate);
+        break;
+    case CHANNEL_MASK_7POINT1_SIDE_BACK:
+        Downmix_foldFrom7Point1(pSrc, pDst, numFrames, accumulate);
+        break;
+    default:
+        return Downmix_foldGeneric(mask, pSrc, pDst, numFrames, accumulate);
+    }
+    return true;
+}
+
+bool Downmix_foldFloat(uint32_t mask, float *pSrc, float *pDst, size_t numFrames,
+        bool accumulate) {
+#ifdef DOWNMIX_ALWAYS_USE_GENERIC_DOWNMIXER
+    // bypass the optimized downmix routines for the common formats
+    return Downmix_foldGenericFloat(mask, pSrc, pDst, numFrames, accumulate);
+#endif
+    // optimize for the common formats
+    switch((downmix_input_channel_mask_t)mask) {
+    case CHANNEL_MASK_QUAD_BACK:
+    case CHANNEL_MASK_QUAD_SIDE:
+        Downmix_foldFromQuadFloat(pSrc, pDst, numFrames, accumulate);
+        break;
+    case CHANNEL_MASK_SURROUND:
+        Downmix_foldFromSurroundFloat(pSrc, pDst, numFrames, accumulate);
+        break;
+    case CHANNEL_MASK_5POINT1_BACK:
+    case CHANNEL_MASK_5POINT1_SIDE:
+        Downmix_foldFrom5Point1Float(pSrc, pDst, numFrames, accumulate);
+        break;
+    case CHANNEL_MASK_7POINT1_SIDE_BACK:
+        Downmix_foldFrom7Point1Float(pSrc, pDst, numFrames, accumulate);
+        break;
+    default:
+        return Downmix_foldGenericFloat(mask, pSrc, pDst, numFrames, accumulate);
+    }
+    return true;
+}
+
+
+/*----------------------------------------------------------------------------
+ * Downmix_foldFromQuad(), Downmix_foldFromQuadFloat()
  *----------------------------------------------------------------------------
  * Purpose:
  * downmix a quad signal to stereo
@@ -796,6 +1263,14 @@ int Downmix_getParameter(downmix_object_t *pDownmixer, int32_t param, size_t *pS
  *----------------------------------------------------------------------------
  */
 void Downmix_foldFromQuad(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
+#if defined(DOWNMIX_USE_VECTOR)
+    // FL + RL, FR + RR
+    if (accumulate) {
+        Downmix_foldMatrix16(&kQuadMatrix, 4, pSrc, pDst, numFrames, true);
+    } else {
+        Downmix_foldMatrix16(&kQuadMatrix, 4, pSrc, pDst, numFrames, false);
+    }
+#else
     // sample at index 0 is FL
     // sample at index 1 is FR
     // sample at index 2 is RL
@@ -821,11 +1296,20 @@ void Downmix_foldFromQuad(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool ac
             numFrames--;
         }
     }
+#endif
+}
+
+void Downmix_foldFromQuadFloat(float *pSrc, float *pDst, size_t numFrames, bool accumulate) {
+    if (accumulate) {
+        Downmix_foldMatrixFloat(&kQuadMatrix, 4, pSrc, pDst, numFrames, true);
+    } else {
+        Downmix_foldMatrixFloat(&kQuadMatrix, 4, pSrc, pDst, numFrames, false);
+    }
 }
 
 
 /*----------------------------------------------------------------------------
- * Downmix_foldFromSurround()
+ * Downmix_foldFromSurround(), Downmix_foldFromSurroundFloat()
  *----------------------------------------------------------------------------
  * Purpose:
  * downmix a "surround sound" (mono rear) signal to stereo
@@ -842,6 +1326,14 @@ void Downmix_foldFromQuad(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool ac
  *----------------------------------------------------------------------------
  */
 void Downmix_foldFromSurround(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
+#if defined(DOWNMIX_USE_VECTOR)
+    // FL + FC(-3dB) + RC(-3dB), FR + FC(-3dB) + RC(-3dB)
+    if (accumulate) {
+        Downmix_foldMatrix16(&kSurroundMatrix, 4, pSrc, pDst, numFrames, true);
+    } else {
+        Downmix_foldMatrix16(&kSurroundMatrix, 4, pSrc, pDst, numFrames, false);
+    }
+#else
     int32_t lt, rt, centerPlusRearContrib; // samples in Q19.12 format
     // sample at index 0 is FL
     // sample at index 1 is FR
@@ -880,11 +1372,21 @@ void Downmix_foldFromSurround(int16_t *pSrc, int16_t*pDst, size_t numFrames, boo
             numFrames--;
         }
     }
+#endif
+}
+
+void Downmix_foldFromSurroundFloat(float *pSrc, float *pDst, size_t numFrames,
+        bool accumulate) {
+    if (accumulate) {
+        Downmix_foldMatrixFloat(&kSurroundMatrix, 4, pSrc, pDst, numFrames, true);
+    } else {
+        Downmix_foldMatrixFloat(&kSurroundMatrix, 4, pSrc, pDst, numFrames, false);
+    }
 }
 
 
 /*----------------------------------------------------------------------------
- * Downmix_foldFrom5Point1()
+ * Downmix_foldFrom5Point1(), Downmix_foldFrom5Point1Float()
  *----------------------------------------------------------------------------
  * Purpose:
  * downmix a 5.1 signal to stereo
@@ -901,6 +1403,14 @@ void Downmix_foldFromSurround(int16_t *pSrc, int16_t*pDst, size_t numFrames, boo
  *----------------------------------------------------------------------------
  */
 void Downmix_foldFrom5Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
+#if defined(DOWNMIX_USE_VECTOR)
+    // FL + FC(-3dB) + LFE(-3dB) + RL, FR + FC(-3dB) + LFE(-3dB) + RR
+    if (accumulate) {
+        Downmix_foldMatrix16(&k5Point1Matrix, 6, pSrc, pDst, numFrames, true);
+    } else {
+        Downmix_foldMatrix16(&k5Point1Matrix, 6, pSrc, pDst, numFrames, false);
+    }
+#else
     int32_t lt, rt, centerPlusLfeContrib; // samples in Q19.12 format
     // sample at index 0 is FL
     // sample at index 1 is FR
@@ -943,11 +1453,21 @@ void Downmix_foldFrom5Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool
             numFrames--;
         }
     }
+#endif
+}
+
+void Downmix_foldFrom5Point1Float(float *pSrc, float *pDst, size_t numFrames,
+        bool accumulate) {
+    if (accumulate) {
+        Downmix_foldMatrixFloat(&k5Point1Matrix, 6, pSrc, pDst, numFrames, true);
+    } else {
+        Downmix_foldMatrixFloat(&k5Point1Matrix, 6, pSrc, pDst, numFrames, false);
+    }
 }
 
 
 /*----------------------------------------------------------------------------
- * Downmix_foldFrom7Point1()
+ * Downmix_foldFrom7Point1(), Downmix_foldFrom7Point1Float()
  *----------------------------------------------------------------------------
  * Purpose:
  * downmix a 7.1 signal to stereo
@@ -964,6 +1484,14 @@ void Downmix_foldFrom5Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool
  *----------------------------------------------------------------------------
  */
 void Downmix_foldFrom7Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
+#if defined(DOWNMIX_USE_VECTOR)
+    // FL + FC(-3dB) + LFE(-3dB) + RL + SL, FR + FC(-3dB) + LFE(-3dB) + RR + SR
+    if (accumulate) {
+        Downmix_foldMatrix16(&k7Point1Matrix, 8, pSrc, pDst, numFrames, true);
+    } else {
+        Downmix_foldMatrix16(&k7Point1Matrix, 8, pSrc, pDst, numFrames, false);
+    }
+#else
     int32_t lt, rt, centerPlusLfeContrib; // samples in Q19.12 format
     // sample at index 0 is FL
     // sample at index 1 is FR
@@ -1008,36 +1536,21 @@ void Downmix_foldFrom7Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool
             numFrames--;
         }
     }
+#endif
+}
+
+void Downmix_foldFrom7Point1Float(float *pSrc, float *pDst, size_t numFrames,
+        bool accumulate) {
+    if (accumulate) {
+        Downmix_foldMatrixFloat(&k7Point1Matrix, 8, pSrc, pDst, numFrames, true);
+    } else {
+        Downmix_foldMatrixFloat(&k7Point1Matrix, 8, pSrc, pDst, numFrames, false);
+    }
 }
 
 
-/*----------------------------------------------------------------------------
- * Downmix_foldGeneric()
- *----------------------------------------------------------------------------
- * Purpose:
- * downmix to stereo a multichannel signal whose format is:
- *  - has FL/FR
- *  - if using AUDIO_CHANNEL_OUT_SIDE*, it contains both left and right
- *  - if using AUDIO_CHANNEL_OUT_BACK*, it contains both left and right
- *  - doesn't use any of the AUDIO_CHANNEL_OUT_TOP* channels
- *  - doesn't use any of the AUDIO_CHANNEL_OUT_FRONT_*_OF_CENTER channels
- * Only handles channel masks not enumerated in downmix_input_channel_mask_t
- *
- * Inputs:
- *  mask       the channel mask of pSrc
- *  pSrc       multichannel audio buffer to downmix
- *  numFrames  the number of multichannel frames to downmix
- *  accumulate whether to mix (when true) the result of the downmix with the contents of pDst,
- *               or overwrite pDst (when false)
- *
- * Outputs:
- *  pDst       downmixed stereo audio samples
- *
- * Returns: false if multichannel format is not supported
- *
- *----------------------------------------------------------------------------
- */
-bool Downmix_foldGeneric(
+// the per-channel loop of Downmix_foldGeneric(), for builds and masks without a vector kernel
+static bool Downmix_foldGenericScalar(
         uint32_t mask, int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
     // check against unsupported channels
     if (mask & kUnsupported) {
@@ -1149,3 +1662,60 @@ bool Downmix_foldGeneric(
     }
     return true;
 }
+
+
+/*----------------------------------------------------------------------------
+ * Downmix_foldGeneric(), Downmix_foldGenericFloat()
+ *----------------------------------------------------------------------------
+ * Purpose:
+ * downmix to stereo a multichannel signal whose format is supported by Downmix_buildMatrix().
+ * Only handles channel masks not enumerated in downmix_input_channel_mask_t
+ *
+ * Inputs:
+ *  mask       the channel mask of pSrc
+ *  pSrc       multichannel audio buffer to downmix
+ *  numFrames  the number of multichannel frames to downmix
+ *  accumulate whether to mix (when true) the result of the downmix with the contents of pDst,
+ *               or overwrite pDst (when false)
+ *
+ * Outputs:
+ *  pDst       downmixed stereo audio samples
+ *
+ * Returns: false if multichannel format is not supported
+ *
+ *----------------------------------------------------------------------------
+ */
+bool Downmix_foldGeneric(
+        uint32_t mask, int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
+#if defined(DOWNMIX_USE_VECTOR)
+    downmix_matrix_t matrix;
+    const int numChan = Downmix_buildMatrix(mask, &matrix);
+    if (numChan == 0) {
+        return false;
+    }
+    if (numChan <= DOWNMIX_VECTOR_CHANNELS) {
+        if (accumulate) {
+            Downmix_foldMatrix16(&matrix, numChan, pSrc, pDst, numFrames, true);
+        } else {
+            Downmix_foldMatrix16(&matrix, numChan, pSrc, pDst, numFrames, false);
+        }
+        return true;
+    }
+#endif
+    return Downmix_foldGenericScalar(mask, pSrc, pDst, numFrames, accumulate);
+}
+
+bool Downmix_foldGenericFloat(
+        uint32_t mask, float *pSrc, float *pDst, size_t numFrames, bool accumulate) {
+    downmix_matrix_t matrix;
+    const int numChan = Downmix_buildMatrix(mask, &matrix);
+    if (numChan == 0) {
+        return false;
+    }
+    if (accumulate) {
+        Downmix_foldMatrixFloat(&matrix, numChan, pSrc, pDst, numFrames, true);
+    } else {
+        Downmix_foldMatrixFloat(&matrix, numChan, pSrc, pDst, numFrames, false);
+    }
+    return true;
+}
@@ -96,6 +96,8 @@ int Downmix_Reset(downmix_object_t *pDownmixer, bool init);
 int Downmix_setParameter(downmix_object_t *pDownmixer, int32_t param, size_t size, void *pValue);
 int Downmix_getParameter(downmix_object_t *pDownmixer, int32_t param, size_t *pSize, void *pValue);
 
+bool Downmix_fold16(uint32_t mask, int16_t *pSrc, int16_t *pDst, size_t numFrames,
+        bool accumulate);
 void Downmix_foldFromQuad(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate);
 void Downmix_foldFromSurround(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate);
 void Downmix_foldFrom5Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate);
@@ -103,4 +105,14 @@ void Downmix_foldFrom7Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool
 bool Downmix_foldGeneric(
         uint32_t mask, int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate);
 
+// float versions of the above, the output is not clamped
+bool Downmix_foldFloat(uint32_t mask, float *pSrc, float *pDst, size_t numFrames,
+        bool accumulate);
+void Downmix_foldFromQuadFloat(float *pSrc, float *pDst, size_t numFrames, bool accumulate);
+void Downmix_foldFromSurroundFloat(float *pSrc, float *pDst, size_t numFrames, bool accumulate);
+void Downmix_foldFrom5Point1Float(float *pSrc, float *pDst, size_t numFrames, bool accumulate);
+void Downmix_foldFrom7Point1Float(float *pSrc, float *pDst, size_t numFrames, bool accumulate);
+bool Downmix_foldGenericFloat(
+        uint32_t mask, float *pSrc, float *pDst, size_t numFrames, bool accumulate);
+
 #endif /*ANDROID_EFFECTDOWNMIX_H_*/
@@ -0,0 +1,56 @@
+# Build the unit tests.
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := EffectDownmix_test
+
+LOCAL_MODULE_TAGS := tests
+
+# the fold routines are not exported by libdownmix
+LOCAL_SRC_FILES := \
+    EffectDownmix_test.cpp \
+    ../EffectDownmix.c
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+	libstlport \
+	libutils \
+	liblog
+
+LOCAL_STATIC_LIBRARIES := \
+	libgtest \
+	libgtest_main \
+
+LOCAL_C_INCLUDES := \
+    bionic \
+    bionic/libstdc++/include \
+    external/gtest/include \
+    external/stlport/stlport \
+    $(call include-path-for, audio-effects) \
+    $(call include-path-for, audio-utils) \
+	frameworks/av/media/libeffects/downmix \
+
+include $(BUILD_EXECUTABLE)
+
+# Build the benchmark, which compares the fold routines with the scalar reference.
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := downmixbench
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_SRC_FILES := \
+    downmixbench.cpp \
+    ../EffectDownmix.c
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+	libutils \
+	liblog
+
+LOCAL_C_INCLUDES := \
+    $(call include-path-for, audio-effects) \
+    $(call include-path-for, audio-utils) \
+	frameworks/av/media/libeffects/downmix \
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_DOWNMIX_REFERENCE_H
+#define ANDROID_DOWNMIX_REFERENCE_H
+
+// Shared by EffectDownmix_test and downmixbench, include EffectDownmix.h first.
+
+namespace android {
+
+static const int32_t kMinus3dB = 2896; // Q19.12
+
+// The scalar fold of Downmix_foldGeneric() before it was vectorized, which also computes
+// the optimized formats exactly like their own routines did.
+static inline void referenceFold16(uint32_t mask, const int16_t *pSrc, int16_t *pDst,
+        size_t numFrames, bool accumulate) {
+    const bool hasSides = (mask & kSides) != 0;
+    const bool hasBacks = (mask & kBacks) != 0;
+    const int numChan = popcount(mask);
+    const bool hasFC = (mask & AUDIO_CHANNEL_OUT_FRONT_CENTER) != 0;
+    const bool hasLFE = (mask & AUDIO_CHANNEL_OUT_LOW_FREQUENCY) != 0;
+    const bool hasBC = (mask & AUDIO_CHANNEL_OUT_BACK_CENTER) != 0;
+    const int indexFC  = hasFC    ? 2            : 1;
+    const int indexLFE = hasLFE   ? indexFC + 1  : indexFC;
+    const int indexBL  = hasBacks ? indexLFE + 1 : indexLFE;
+    const int indexBR  = hasBacks ? indexBL + 1  : indexBL;
+    const int indexBC  = hasBC    ? indexBR + 1  : indexBR;
+    const int indexSL  = hasSides ? indexBC + 1  : indexBC;
+    const int indexSR  = hasSides ? indexSL + 1  : indexSL;
+
+    while (numFrames) {
+        int32_t centersLfeContrib = 0;
+        if (hasFC)  { centersLfeContrib += pSrc[indexFC]; }
+        if (hasLFE) { centersLfeContrib += pSrc[indexLFE]; }
+        if (hasBC)  { centersLfeContrib += pSrc[indexBC]; }
+        centersLfeContrib *= kMinus3dB;
+        int32_t lt = pSrc[0] << 12;
+        int32_t rt = pSrc[1] << 12;
+        if (hasSides) {
+            lt += pSrc[indexSL] << 12;
+            rt += pSrc[indexSR] << 12;
+        }
+        if (hasBacks) {
+            lt += pSrc[indexBL] << 12;
+            rt += pSrc[indexBR] << 12;
+        }
+        lt += centersLfeContrib;
+        rt += centersLfeContrib;
+        if (accumulate) {
+            pDst[0] = clamp16(pDst[0] + (lt >> 13));
+            pDst[1] = clamp16(pDst[1] + (rt >> 13));
+        } else {
+            pDst[0] = clamp16(lt >> 13);
+            pDst[1] = clamp16(rt >> 13);
+        }
+        pSrc += numChan;
+        pDst += 2;
+        numFrames--;
+    }
+}
+
+} // namespace android
+
+#endif // ANDROID_DOWNMIX_REFERENCE_H
@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "EffectDownmix_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern "C" {
+#include "EffectDownmix.h"
+}
+
+#include "DownmixReference.h"
+
+namespace android {
+
+// Checks the fold routines against the per-frame scalar loops they replaced: bit for bit for
+// 16-bit samples, within float rounding for float samples.  downmixbench compares their speed.
+
+static const size_t kMaxFrames = 1031;
+// odd sizes exercise the scalar tails after the last full vector
+static const size_t kFrameCounts[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 16, 17, 64, 257, kMaxFrames };
+static const int kMaxChannels = 9;
+
+// channel masks of Downmix_fold16(), the optimized ones first
+static const uint32_t kMasks[] = {
+    AUDIO_CHANNEL_OUT_QUAD,
+    AUDIO_CHANNEL_OUT_FRONT_LEFT | AUDIO_CHANNEL_OUT_FRONT_RIGHT |
+            AUDIO_CHANNEL_OUT_SIDE_LEFT | AUDIO_CHANNEL_OUT_SIDE_RIGHT,
+    AUDIO_CHANNEL_OUT_SURROUND,
+    AUDIO_CHANNEL_OUT_5POINT1,
+    AUDIO_CHANNEL_OUT_7POINT1,
+    // generic
+    AUDIO_CHANNEL_OUT_STEREO | AUDIO_CHANNEL_OUT_FRONT_CENTER,
+    AUDIO_CHANNEL_OUT_STEREO | AUDIO_CHANNEL_OUT_LOW_FREQUENCY | AUDIO_CHANNEL_OUT_BACK_CENTER,
+    AUDIO_CHANNEL_OUT_QUAD | AUDIO_CHANNEL_OUT_SIDE_LEFT | AUDIO_CHANNEL_OUT_SIDE_RIGHT,
+    AUDIO_CHANNEL_OUT_5POINT1 | AUDIO_CHANNEL_OUT_BACK_CENTER,
+    AUDIO_CHANNEL_OUT_7POINT1 | AUDIO_CHANNEL_OUT_BACK_CENTER,
+};
+
+// random value in [lo, hi]
+static int32_t randomIn(int32_t lo, int32_t hi) {
+    return lo + (int32_t) (lrand48() % ((int64_t) hi - lo + 1));
+}
+
+class EffectDownmixTest : public testing::Test {
+protected:
+    virtual void SetUp() {
+        srand48(0x5eed);
+        for (size_t i = 0; i < kMaxFrames * kMaxChannels; ++i) {
+            // full scale, so that the clamping is exercised
+            mIn16[i] = randomIn(INT16_MIN, INT16_MAX);
+            mInFloat[i] = mIn16[i] / 32768.0f;
+        }
+        for (size_t i = 0; i < kMaxFrames * 2; ++i) {
+            mOutInit16[i] = randomIn(INT16_MIN, INT16_MAX);
+            mOutInitFloat[i] = mOutInit16[i] / 32768.0f;
+        }
+    }
+
+    int16_t mIn16[kMaxFrames * kMaxChannels];
+    float mInFloat[kMaxFrames * kMaxChannels];
+    int16_t mOutInit16[kMaxFrames * 2];
+    float mOutInitFloat[kMaxFrames * 2];
+    int16_t mOutRef16[kMaxFrames * 2];
+    int16_t mOut16[kMaxFrames * 2];
+    float mOutFloat[kMaxFrames * 2];
+};
+
+TEST_F(EffectDownmixTest, Fold16IsBitExact) {
+    for (size_t m = 0; m < sizeof(kMasks) / sizeof(kMasks[0]); ++m) {
+        for (int accumulate = 0; accumulate <= 1; ++accumulate) {
+            for (size_t f = 0; f < sizeof(kFrameCounts) / sizeof(kFrameCounts[0]); ++f) {
+                const size_t frames = kFrameCounts[f];
+                memcpy(mOutRef16, mOutInit16, sizeof(mOutInit16));
+                memcpy(mOut16, mOutInit16, sizeof(mOutInit16));
+                referenceFold16(kMasks[m], mIn16, mOutRef16, frames, accumulate);
+                ASSERT_TRUE(Downmix_fold16(kMasks[m], mIn16, mOut16, frames, accumulate));
+                // also checks that nothing is written past the last frame
+                ASSERT_EQ(0, memcmp(mOutRef16, mOut16, sizeof(mOut16)))
+                        << "mask " << std::hex << kMasks[m] << std::dec
+                        << " accumulate " << accumulate << " frames " << frames;
+            }
+        }
+    }
+}
+
+TEST_F(EffectDownmixTest, Fold16InPlace) {
+    for (size_t m = 0; m < sizeof(kMasks) / sizeof(kMasks[0]); ++m) {
+        const int numChan = popcount(kMasks[m]);
+        int16_t buffer[kMaxFrames * kMaxChannels];
+        memcpy(buffer, mIn16, kMaxFrames * numChan * sizeof(int16_t));
+        referenceFold16(kMasks[m], mIn16, mOutRef16, kMaxFrames, false);
+        ASSERT_TRUE(Downmix_fold16(kMasks[m], buffer, buffer, kMaxFrames, false));
+        ASSERT_EQ(0, memcmp(mOutRef16, buffer, kMaxFrames * 2 * sizeof(int16_t)))
+                << "mask " << std::hex << kMasks[m];
+    }
+}
+
+TEST_F(EffectDownmixTest, FoldFloat) {
+    for (size_t m = 0; m < sizeof(kMasks) / sizeof(kMasks[0]); ++m) {
+        // the gains of referenceFold16(), including its final >> 13
+        const uint32_t mask = kMasks[m];
+        const int numChan = popcount(mask);
+        double left[kMaxChannels], right[kMaxChannels];
+        int i = 0;
+        for (uint32_t channel = 1; channel <= mask; channel <<= 1) {
+            if ((mask & channel) == 0) {
+                continue;
+            }
+            const bool isLeft = channel == AUDIO_CHANNEL_OUT_FRONT_LEFT ||
+                    channel == AUDIO_CHANNEL_OUT_BACK_LEFT ||
+                    channel == AUDIO_CHANNEL_OUT_SIDE_LEFT;
+            const bool isRight = channel == AUDIO_CHANNEL_OUT_FRONT_RIGHT ||
+                    channel == AUDIO_CHANNEL_OUT_BACK_RIGHT ||
+                    channel == AUDIO_CHANNEL_OUT_SIDE_RIGHT;
+            left[i] = isLeft ? 0.5 : isRight ? 0. : kMinus3dB / 8192.;
+            right[i] = isRight ? 0.5 : isLeft ? 0. : kMinus3dB / 8192.;
+            i++;
+        }
+        ASSERT_EQ(numChan, i);
+
+        for (int accumulate = 0; accumulate <= 1; ++accumulate) {
+            for (size_t f = 0; f < sizeof(kFrameCounts) / sizeof(kFrameCounts[0]); ++f) {
+                const size_t frames = kFrameCounts[f];
+                memcpy(mOutFloat, mOutInitFloat, sizeof(mOutInitFloat));
+                ASSERT_TRUE(Downmix_foldFloat(mask, mInFloat, mOutFloat, frames, accumulate));
+                for (size_t j = 0; j < kMaxFrames; ++j) {
+                    double lt = 0, rt = 0;
+                    for (i = 0; i < numChan; ++i) {
+                        lt += mInFloat[j * numChan + i] * left[i];
+                        rt += mInFloat[j * numChan + i] * right[i];
+                    }
+                    // not clamped, and exact but for float rounding
+                    const float initL = accumulate ? mOutInitFloat[2 * j] : 0;
+                    const float initR = accumulate ? mOutInitFloat[2 * j + 1] : 0;
+                    if (j >= frames) {
+                        ASSERT_EQ(mOutInitFloat[2 * j], mOutFloat[2 * j]);
+                        ASSERT_EQ(mOutInitFloat[2 * j + 1], mOutFloat[2 * j + 1]);
+                        continue;
+                    }
+                    ASSERT_NEAR(initL + lt, mOutFloat[2 * j], 1e-6)
+                            << "mask " << std::hex << mask << std::dec << " frame " << j;
+                    ASSERT_NEAR(initR + rt, mOutFloat[2 * j + 1], 1e-6)
+                            << "mask " << std::hex << mask << std::dec << " frame " << j;
+                }
+            }
+        }
+    }
+}
+
+TEST_F(EffectDownmixTest, UnsupportedMasks) {
+    static const uint32_t kUnsupportedMasks[] = {
+        AUDIO_CHANNEL_OUT_FRONT_LEFT | AUDIO_CHANNEL_OUT_FRONT_CENTER,
+        AUDIO_CHANNEL_OUT_STEREO | AUDIO_CHANNEL_OUT_BACK_LEFT,
+        AUDIO_CHANNEL_OUT_STEREO | AUDIO_CHANNEL_OUT_SIDE_RIGHT,
+        AUDIO_CHANNEL_OUT_STEREO | AUDIO_CHANNEL_OUT_TOP_CENTER,
+        AUDIO_CHANNEL_OUT_STEREO | AUDIO_CHANNEL_OUT_FRONT_LEFT_OF_CENTER,
+    };
+    for (size_t m = 0; m < sizeof(kUnsupportedMasks) / sizeof(kUnsupportedMasks[0]); ++m) {
+        EXPECT_FALSE(Downmix_fold16(kUnsupportedMasks[m], mIn16, mOut16, 16, false));
+        EXPECT_FALSE(Downmix_foldFloat(kUnsupportedMasks[m], mInFloat, mOutFloat, 16, false));
+    }
+}
+
+// configures the effect and runs one buffer through its process()
+static int processWithEffect(uint32_t mask, audio_format_t format, void *in, void *out,
+        size_t frames) {
+    effect_handle_t handle;
+    static const effect_uuid_t kUuid =
+            {0x93f04452, 0xe4fe, 0x41cc, 0x91f9, {0xe4, 0x75, 0xb6, 0xd1, 0xd6, 0x9f}};
+    int status = DownmixLib_Create(&kUuid, 0, 0, &handle);
+    if (status != 0) {
+        return status;
+    }
+    effect_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.inputCfg.samplingRate = config.outputCfg.samplingRate = 48000;
+    config.inputCfg.channels = mask;
+    config.outputCfg.channels = AUDIO_CHANNEL_OUT_STEREO;
+    config.inputCfg.format = config.outputCfg.format = format;
+    config.inputCfg.accessMode = EFFECT_BUFFER_ACCESS_READ;
+    config.outputCfg.accessMode = EFFECT_BUFFER_ACCESS_WRITE;
+    config.inputCfg.mask = config.outputCfg.mask = EFFECT_CONFIG_ALL;
+    int reply = 0;
+    uint32_t replySize = sizeof(reply);
+    status = (*handle)->command(handle, EFFECT_CMD_SET_CONFIG, sizeof(config), &config,
+            &replySize, &reply);
+    if (status == 0) {
+        status = reply;
+    }
+    if (status == 0) {
+        replySize = sizeof(reply);
+        status = (*handle)->command(handle, EFFECT_CMD_ENABLE, 0, NULL, &replySize, &reply);
+    }
+    if (status == 0) {
+        audio_buffer_t inBuffer, outBuffer;
+        inBuffer.frameCount = outBuffer.frameCount = frames;
+        inBuffer.raw = in;
+        outBuffer.raw = out;
+        status = (*handle)->process(handle, &inBuffer, &outBuffer);
+    }
+    DownmixLib_Release(handle);
+    return status;
+}
+
+TEST_F(EffectDownmixTest, EffectProcess) {
+    const uint32_t mask = AUDIO_CHANNEL_OUT_5POINT1;
+    referenceFold16(mask, mIn16, mOutRef16, kMaxFrames, false);
+    ASSERT_EQ(0, processWithEffect(mask, AUDIO_FORMAT_PCM_16_BIT, mIn16, mOut16, kMaxFrames));
+    EXPECT_EQ(0, memcmp(mOutRef16, mOut16, kMaxFrames * 2 * sizeof(int16_t)));
+
+    ASSERT_EQ(0, processWithEffect(mask, AUDIO_FORMAT_PCM_FLOAT, mInFloat, mOutFloat,
+            kMaxFrames));
+    for (size_t i = 0; i < kMaxFrames * 2; ++i) {
+        // the 16-bit fold truncates and clamps
+        const float expected = mOutRef16[i] / 32768.0f;
+        if (fabsf(mOutFloat[i]) < 1.0f) {
+            ASSERT_NEAR(expected, mOutFloat[i], 1.0f / 32768) << "sample " << i;
+        } else {
+            ASSERT_GE(fabsf(mOutFloat[i]), fabsf(expected)) << "sample " << i;
+        }
+    }
+
+    // other formats are refused
+    EXPECT_NE(0, processWithEffect(mask, AUDIO_FORMAT_PCM_32_BIT, mIn16, mOut16, kMaxFrames));
+}
+
+} // namespace android
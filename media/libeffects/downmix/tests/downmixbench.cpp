@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "downmixbench"
+#include <utils/Log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+extern "C" {
+#include "EffectDownmix.h"
+}
+
+#include "DownmixReference.h"
+
+using namespace android;
+
+// Prints the cost per frame of the scalar reference fold, Downmix_fold16() and
+// Downmix_foldFloat() for each optimized channel mask.
+
+static const size_t kNumFrames = 1031;
+static const int kMaxChannels = 8;
+
+static double nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr,
+            "usage: %s [-n iterations]\n"
+            "\n"
+            "Folds %zu random frames iterations times (default 2000) with each "
+            "routine.\n",
+            me, kNumFrames);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+
+    int numIterations = 2000;
+
+    int res;
+    while ((res = getopt(argc, argv, "n:")) >= 0) {
+        switch (res) {
+            case 'n':
+                numIterations = atoi(optarg);
+                break;
+
+            case '?':
+            default:
+                usage(me);
+        }
+    }
+
+    if (numIterations < 1) {
+        usage(me);
+    }
+
+    static int16_t in16[kNumFrames * kMaxChannels];
+    static float inFloat[kNumFrames * kMaxChannels];
+    static int16_t out16[kNumFrames * 2];
+    static float outFloat[kNumFrames * 2];
+    srand48(0x5eed);
+    for (size_t i = 0; i < kNumFrames * kMaxChannels; ++i) {
+        in16[i] = (int16_t) lrand48();
+        inFloat[i] = in16[i] / 32768.0f;
+    }
+
+    static const uint32_t kMasks[] = {
+        AUDIO_CHANNEL_OUT_QUAD,
+        AUDIO_CHANNEL_OUT_FRONT_LEFT | AUDIO_CHANNEL_OUT_FRONT_RIGHT |
+                AUDIO_CHANNEL_OUT_SIDE_LEFT | AUDIO_CHANNEL_OUT_SIDE_RIGHT,
+        AUDIO_CHANNEL_OUT_SURROUND,
+        AUDIO_CHANNEL_OUT_5POINT1,
+        AUDIO_CHANNEL_OUT_7POINT1,
+    };
+    static const char * const kNames[] = { "quad", "quad side", "surround", "5.1", "7.1" };
+
+    printf("%zu frames, %d iterations\n", kNumFrames, numIterations);
+    for (size_t m = 0; m < sizeof(kMasks) / sizeof(kMasks[0]); ++m) {
+        double ns[3];
+        for (int k = 0; k < 3; ++k) {
+            const double start = nowNs();
+            for (int i = 0; i < numIterations; ++i) {
+                switch (k) {
+                case 0:
+                    referenceFold16(kMasks[m], in16, out16, kNumFrames, true);
+                    break;
+                case 1:
+                    Downmix_fold16(kMasks[m], in16, out16, kNumFrames, true);
+                    break;
+                case 2:
+                    Downmix_foldFloat(kMasks[m], inFloat, outFloat, kNumFrames, true);
+                    break;
+                }
+            }
+            ns[k] = (nowNs() - start) / ((double) numIterations * kNumFrames);
+        }
+        printf("%-9s scalar %6.3f ns/frame, 16-bit %6.3f ns/frame (x%.1f), float %6.3f ns/frame\n",
+                kNames[m], ns[0], ns[1], ns[0] / ns[1], ns[2]);
+    }
+
+    return 0;
+}
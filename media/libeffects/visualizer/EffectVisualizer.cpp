@@ -78,6 +78,9 @@ struct VisualizerContext {
     uint32_t mLatency;
     struct timespec mBufferUpdateTime;
     uint8_t mCaptureBuf[CAPTURE_BUF_SIZE];
+    // 16-bit copy of float input, the capture and measurements work on 16-bit samples
+    int16_t *mConvertBuf;
+    uint32_t mConvertBufSamples;
     // for measurements
     uint8_t mChannelCount; // to avoid recomputing it every time a buffer is processed
     uint32_t mMeasurementMode;
@@ -140,7 +143,19 @@ int Visualizer_setConfig(VisualizerContext *pContext, effect_config_t *pConfig)
     if (pConfig->inputCfg.channels != AUDIO_CHANNEL_OUT_STEREO) return -EINVAL;
     if (pConfig->outputCfg.accessMode != EFFECT_BUFFER_ACCESS_WRITE &&
             pConfig->outputCfg.accessMode != EFFECT_BUFFER_ACCESS_ACCUMULATE) return -EINVAL;
-    if (pConfig->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT) return -EINVAL;
+    if (pConfig->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT &&
+            pConfig->inputCfg.format != AUDIO_FORMAT_PCM_FLOAT) return -EINVAL;
+
+    // float input is converted to 16 bit before the measurements, the buffer
+    // for it is allocated here rather than on the audio thread in process()
+    if (pConfig->inputCfg.format == AUDIO_FORMAT_PCM_FLOAT) {
+        uint32_t sampleCount = pConfig->inputCfg.buffer.frameCount * 2;
+        if (pContext->mConvertBufSamples < sampleCount) {
+            delete[] pContext->mConvertBuf;
+            pContext->mConvertBuf = new int16_t[sampleCount];
+            pContext->mConvertBufSamples = sampleCount;
+        }
+    }
 
     pContext->mConfig = *pConfig;
 
@@ -244,6 +259,8 @@ int VisualizerLib_Create(const effect_uuid_t *uuid,
 
     pContext->mItfe = &gVisualizerInterface;
     pContext->mState = VISUALIZER_STATE_UNINITIALIZED;
+    pContext->mConvertBuf = NULL;
+    pContext->mConvertBufSamples = 0;
 
     ret = Visualizer_init(pContext);
     if (ret < 0) {
@@ -270,6 +287,7 @@ int VisualizerLib_Release(effect_handle_t handle) {
         return -EINVAL;
     }
     pContext->mState = VISUALIZER_STATE_UNINITIALIZED;
+    delete[] pContext->mConvertBuf;
     delete pContext;
 
     return 0;
@@ -302,6 +320,17 @@ static inline int16_t clamp16(int32_t sample)
     return sample;
 }
 
+static inline int16_t clamp16_from_float(float f)
+{
+    f *= 1 << 15;
+    if (f <= -0x8000) {
+        return -0x8000;
+    } else if (f >= 0x7fff) {
+        return 0x7fff;
+    }
+    return (int16_t) (f + (f >= 0 ? 0.5f : -0.5f));
+}
+
 int Visualizer_process(
         effect_handle_t self,audio_buffer_t *inBuffer, audio_buffer_t *outBuffer)
 {
@@ -318,6 +347,22 @@ int Visualizer_process(
         return -EINVAL;
     }
 
+    const bool isFloat = pContext->mConfig.inputCfg.format == AUDIO_FORMAT_PCM_FLOAT;
+    const uint32_t sampleCount = inBuffer->frameCount * 2;
+    const int16_t *in = inBuffer->s16;
+    if (isFloat) {
+        if (pContext->mConvertBufSamples < sampleCount) {
+            ALOGW("Visualizer_process() %zu frames exceed the configured buffer",
+                    inBuffer->frameCount);
+            return -EINVAL;
+        }
+        const float *inFloat = (const float *) inBuffer->raw;
+        for (uint32_t i = 0; i < sampleCount; i++) {
+            pContext->mConvertBuf[i] = clamp16_from_float(inFloat[i]);
+        }
+        in = pContext->mConvertBuf;
+    }
+
     // perform measurements if needed
     if (pContext->mMeasurementMode & MEASUREMENT_MODE_PEAK_RMS) {
         // find the peak and RMS squared for the new buffer
@@ -325,12 +370,12 @@ int Visualizer_process(
         int16_t maxSample = 0;
         float rmsSqAcc = 0;
         for (inIdx = 0 ; inIdx < inBuffer->frameCount * pContext->mChannelCount ; inIdx++) {
-            if (inBuffer->s16[inIdx] > maxSample) {
-                maxSample = inBuffer->s16[inIdx];
-            } else if (-inBuffer->s16[inIdx] > maxSample) {
-                maxSample = -inBuffer->s16[inIdx];
+            if (in[inIdx] > maxSample) {
+                maxSample = in[inIdx];
+            } else if (-in[inIdx] > maxSample) {
+                maxSample = -in[inIdx];
             }
-            rmsSqAcc += (inBuffer->s16[inIdx] * inBuffer->s16[inIdx]);
+            rmsSqAcc += (in[inIdx] * in[inIdx]);
         }
         // store the measurement
         pContext->mPastMeasurements[pContext->mMeasurementBufferIdx].mPeakU16 = (uint16_t)maxSample;
@@ -351,7 +396,7 @@ int Visualizer_process(
         shift = 32;
         int len = inBuffer->frameCount * 2;
         for (int i = 0; i < len; i++) {
-            int32_t smp = inBuffer->s16[i];
+            int32_t smp = in[i];
             if (smp < 0) smp = -smp - 1; // take care to keep the max negative in range
             int32_t clz = __builtin_clz(smp);
             if (shift > clz) shift = clz;
@@ -380,7 +425,7 @@ int Visualizer_process(
             // wrap around
             captIdx = 0;
         }
-        int32_t smp = inBuffer->s16[2 * inIdx] + inBuffer->s16[2 * inIdx + 1];
+        int32_t smp = in[2 * inIdx] + in[2 * inIdx + 1];
         smp = smp >> shift;
         buf[captIdx] = ((uint8_t)smp)^0x80;
     }
@@ -393,7 +438,17 @@ int Visualizer_process(
         pContext->mBufferUpdateTime.tv_sec = 0;
     }
 
-    if (inBuffer->raw != outBuffer->raw) {
+    if (inBuffer->raw != outBuffer->raw && isFloat) {
+        if (pContext->mConfig.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE) {
+            const float *inFloat = (const float *) inBuffer->raw;
+            float *outFloat = (float *) outBuffer->raw;
+            for (size_t i = 0; i < sampleCount; i++) {
+                outFloat[i] += inFloat[i];
+            }
+        } else {
+            memcpy(outBuffer->raw, inBuffer->raw, sampleCount * sizeof(float));
+        }
+    } else if (inBuffer->raw != outBuffer->raw) {
         if (pContext->mConfig.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE) {
             for (size_t i = 0; i < outBuffer->frameCount*2; i++) {
                 outBuffer->s16[i] = clamp16(outBuffer->s16[i] + inBuffer->s16[i]);
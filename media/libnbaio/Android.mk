@@ -37,3 +37,5 @@ LOCAL_SHARED_LIBRARIES := \
 # Consider a separate a library for SingleStateQueueInstantiations.
 
 include $(BUILD_SHARED_LIBRARY)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
@@ -42,6 +42,16 @@ MonoPipe::MonoPipe(size_t reqFrames, NBAIO_Format format, bool writeCanBlock) :
         // mWriteTs
         mSetpoint((reqFrames * 11) / 16),
         mWriteCanBlock(writeCanBlock),
+        mAdaptive(false),
+        mMinSetpoint(mSetpoint),
+        mPeakFrames(0),
+        mWindowStartNs(-1),
+        mLastReadNs(-1),
+        mLastReadFrames(0),
+        mWindowJitterNs(0),
+        mWindowMinMargin(0),
+        mWindowPeakFrames(0),
+        mWindowMaxCount(0),
         mIsShutdown(false),
         // mTimestampShared
         mTimestampMutator(&mTimestampShared),
@@ -135,20 +145,22 @@ ssize_t MonoPipe::write(const void *buffer, size_t count)
         uint32_t ns;
         if (written > 0) {
             size_t filled = (mMaxFrames - avail) + written;
+            // read once, as the reader may change it in adaptive mode
+            size_t setpoint = mSetpoint;
             // FIXME cache these values to avoid re-computation
-            if (filled <= mSetpoint / 2) {
+            if (filled <= setpoint / 2) {
                 // pipe is (nearly) empty, fill quickly
                 ns = written * ( 500000000 / Format_sampleRate(mFormat));
-            } else if (filled <= (mSetpoint * 3) / 4) {
+            } else if (filled <= (setpoint * 3) / 4) {
                 // pipe is below setpoint, fill at slightly faster rate
                 ns = written * ( 750000000 / Format_sampleRate(mFormat));
-            } else if (filled <= (mSetpoint * 5) / 4) {
+            } else if (filled <= (setpoint * 5) / 4) {
                 // pipe is at setpoint, fill at nominal rate
                 ns = written * (1000000000 / Format_sampleRate(mFormat));
-            } else if (filled <= (mSetpoint * 3) / 2) {
+            } else if (filled <= (setpoint * 3) / 2) {
                 // pipe is above setpoint, fill at slightly slower rate
                 ns = written * (1150000000 / Format_sampleRate(mFormat));
-            } else if (filled <= (mSetpoint * 7) / 4) {
+            } else if (filled <= (setpoint * 7) / 4) {
                 // pipe is overflowing, fill slowly
                 ns = written * (1350000000 / Format_sampleRate(mFormat));
             } else {
@@ -202,7 +214,99 @@ ssize_t MonoPipe::write(const void *buffer, size_t count)
 
 void MonoPipe::setAvgFrames(size_t setpoint)
 {
+    if (mAdaptive) {
+        // the reader raises mSetpoint to the new minimum at the end of its window
+        mMinSetpoint = setpoint;
+    } else {
+        mSetpoint = setpoint;
+    }
+}
+
+void MonoPipe::setAdaptive(bool adaptive)
+{
+    mAdaptive = adaptive;
+    mMinSetpoint = mSetpoint;
+}
+
+void MonoPipe::adaptSetpoint(ssize_t avail, size_t count)
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+        return;
+    }
+    int64_t nowNs = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    uint32_t sampleRate = Format_sampleRate(mFormat);
+
+    // the jitter of a read is how far its interval is from the duration of the previous read
+    if (mLastReadNs >= 0) {
+        int64_t nominalNs = (int64_t) mLastReadFrames * 1000000000LL / sampleRate;
+        int64_t jitterNs = nowNs - mLastReadNs - nominalNs;
+        if (jitterNs < 0) {
+            jitterNs = -jitterNs;
+        }
+        if (jitterNs > mWindowJitterNs) {
+            mWindowJitterNs = jitterNs;
+        }
+    }
+    mLastReadNs = nowNs;
+    mLastReadFrames = count;
+
+    if (mWindowStartNs < 0) {
+        mWindowStartNs = nowNs;
+        mWindowMinMargin = avail - (ssize_t) count;
+        mWindowPeakFrames = avail;
+        mWindowMaxCount = count;
+        return;
+    }
+    if (avail - (ssize_t) count < mWindowMinMargin) {
+        mWindowMinMargin = avail - (ssize_t) count;
+    }
+    if ((size_t) avail > mWindowPeakFrames) {
+        mWindowPeakFrames = avail;
+    }
+    if (count > mWindowMaxCount) {
+        mWindowMaxCount = count;
+    }
+    if (nowNs - mWindowStartNs < kAdaptWindowNs) {
+        return;
+    }
+
+    // keep a margin of one jitter's worth of frames, but at least a quarter of a read
+    size_t jitterFrames = (size_t) ((mWindowJitterNs * sampleRate) / 1000000000LL);
+    size_t safety = jitterFrames;
+    if (safety < mWindowMaxCount / 4) {
+        safety = mWindowMaxCount / 4;
+    }
+    size_t setpoint = mSetpoint;
+    if (mWindowMinMargin < 0) {
+        // underrun: raise quickly by the shortfall plus the margin
+        setpoint += (size_t) -mWindowMinMargin + safety;
+    } else if ((size_t) mWindowMinMargin > safety) {
+        // more margin than the jitter needs: lower slowly to trade latency for safety
+        size_t decrease = ((size_t) mWindowMinMargin - safety) / 4;
+        setpoint = decrease < setpoint ? setpoint - decrease : 0;
+    }
+    size_t maxSetpoint = (mMaxFrames * 7) / 8;
+    size_t minSetpoint = mMinSetpoint;
+    if (minSetpoint > maxSetpoint) {
+        minSetpoint = maxSetpoint;
+    }
+    if (setpoint < minSetpoint) {
+        setpoint = minSetpoint;
+    } else if (setpoint > maxSetpoint) {
+        setpoint = maxSetpoint;
+    }
+    ALOGV_IF(setpoint != mSetpoint, "setpoint %zu -> %zu, jitter %zu frames, margin %zd, peak %zu",
+            mSetpoint, setpoint, jitterFrames, mWindowMinMargin, mWindowPeakFrames);
     mSetpoint = setpoint;
+    mPeakFrames = mWindowPeakFrames;
+
+    // start a new window
+    mWindowStartNs = nowNs;
+    mWindowJitterNs = 0;
+    mWindowMinMargin = avail - (ssize_t) count;
+    mWindowPeakFrames = avail;
+    mWindowMaxCount = count;
 }
 
 status_t MonoPipe::getNextWriteTimestamp(int64_t *timestamp)
@@ -321,4 +425,23 @@ status_t MonoPipe::getTimestamp(AudioTimestamp& timestamp)
     return INVALID_OPERATION;
 }
 
+void MonoPipe::getDepth(size_t *frames, size_t *peakFrames) const
+{
+    int32_t front = android_atomic_acquire_load(&mFront);
+    int32_t rear = android_atomic_acquire_load(&mRear);
+    size_t depth = (size_t) (rear - front);
+    // the two loads are not atomic together
+    if (depth > mMaxFrames) {
+        depth = mMaxFrames;
+    }
+    if (frames != NULL) {
+        *frames = depth;
+    }
+    if (peakFrames != NULL) {
+        // mPeakFrames is 0 until the reader completes its first window in adaptive mode
+        size_t peak = mPeakFrames;
+        *peakFrames = peak > depth ? peak : depth;
+    }
+}
+
 }   // namespace android
@@ -58,6 +58,9 @@ ssize_t MonoPipeReader::read(void *buffer, size_t count, int64_t readPTS)
 
     // count == 0 is unlikely and not worth checking for explicitly; will be handled automatically
     ssize_t red = availableToRead();
+    if (mPipe->mAdaptive && red >= 0) {
+        mPipe->adaptSetpoint(red, count);
+    }
     if (CC_UNLIKELY(red <= 0)) {
         // Uh-oh, looks like we are underflowing.  Update the next read PTS and
         // get out.
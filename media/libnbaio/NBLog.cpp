@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 #include <new>
 #include <cutils/atomic.h>
 #include <media/nbaio/NBLog.h>
@@ -29,19 +30,140 @@
 
 namespace android {
 
-int NBLog::Entry::readAt(size_t offset) const
+size_t NBLog::Entry::copyTo(uint8_t *dst) const
 {
-    // FIXME This is too slow, despite the name it is used during writing
-    if (offset == 0)
-        return mEvent;
-    else if (offset == 1)
-        return mLength;
-    else if (offset < (size_t) (mLength + 2))
-        return ((char *) mData)[offset - 2];
-    else if (offset == (size_t) (mLength + 2))
-        return mLength;
-    else
-        return 0;
+    dst[0] = mEvent;
+    dst[1] = mLength;
+    memcpy(&dst[2], mData, mLength);
+    dst[mLength + 2] = mLength;
+    return mLength + 3;
+}
+
+// ---------------------------------------------------------------------------
+
+// Scans the conversion specification following a '%', at 'p'.  Returns the position after the
+// conversion character, or NULL if the conversion is not supported.  On return *type is the
+// type of the value as stored in an EVENT_FORMAT, or '\0' for "%%", and *stars is the number
+// of '*' width and precision int arguments, which precede the value.
+//  'i'     int
+//  'l'     long, as int64_t
+//  'L'     long long and intmax_t, as int64_t
+//  'f'     double
+//  'p'     pointer, as uint64_t
+//  's'     string, as uint8_t length followed by the characters
+static const char *scanConversion(const char *p, char *type, int *stars)
+{
+    *stars = 0;
+    if (*p == '%') {
+        *type = '\0';
+        return p + 1;
+    }
+    while (*p != '\0' && strchr("-+ #0'", *p) != NULL) {
+        ++p;
+    }
+    for (int field = 0; field < 2; ++field) {
+        if (*p == '*') {
+            ++*stars;
+            ++p;
+        } else {
+            while (*p >= '0' && *p <= '9') {
+                ++p;
+            }
+        }
+        if (field == 0) {
+            if (*p != '.') {
+                break;
+            }
+            ++p;
+        }
+    }
+    char size = 'i';
+    switch (*p) {
+    case 'h':
+        p += p[1] == 'h' ? 2 : 1;
+        break;
+    case 'l':
+        if (p[1] == 'l') {
+            size = 'L';
+            p += 2;
+        } else {
+            size = 'l';
+            ++p;
+        }
+        break;
+    case 'q':
+    case 'j':
+        size = 'L';
+        ++p;
+        break;
+    case 'z':
+    case 't':
+        size = 'l';
+        ++p;
+        break;
+    default:
+        break;
+    }
+    switch (*p) {
+    case 'd':
+    case 'i':
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'c':
+        *type = size;
+        break;
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        *type = 'f';
+        break;
+    case 's':
+        *type = 's';
+        break;
+    case 'p':
+        *type = 'p';
+        break;
+    default:
+        // %n, long double, and anything unknown
+        return NULL;
+    }
+    return p + 1;
+}
+
+// Returns the argument types of 'fmt' in 'sig', or false if not supported.
+static bool parseFormat(const char *fmt, char *sig, size_t size)
+{
+    size_t n = 0;
+    for (const char *p = fmt; *p != '\0'; ) {
+        if (*p++ != '%') {
+            continue;
+        }
+        char type;
+        int stars;
+        p = scanConversion(p, &type, &stars);
+        if (p == NULL) {
+            return false;
+        }
+        size_t count = stars + (type != '\0' ? 1 : 0);
+        if (n + count >= size) {
+            return false;
+        }
+        while (stars-- > 0) {
+            sig[n++] = 'i';
+        }
+        if (type != '\0') {
+            sig[n++] = type;
+        }
+    }
+    sig[n] = '\0';
+    return true;
 }
 
 // ---------------------------------------------------------------------------
@@ -66,25 +188,28 @@ NBLog::Timeline::~Timeline()
 /*static*/
 size_t NBLog::Timeline::sharedSize(size_t size)
 {
-    return sizeof(Shared) + roundup(size);
+    return sizeof(Shared) + roundup(size) + kMaxFormats * sizeof(FormatSlot);
 }
 
 // ---------------------------------------------------------------------------
 
 NBLog::Writer::Writer()
-    : mSize(0), mShared(NULL), mRear(0), mEnabled(false)
+    : mSize(0), mShared(NULL), mEnabled(false)
 {
+    memset((void *) mFormatReady, 0, sizeof(mFormatReady));
 }
 
 NBLog::Writer::Writer(size_t size, void *shared)
-    : mSize(roundup(size)), mShared((Shared *) shared), mRear(0), mEnabled(mShared != NULL)
+    : mSize(roundup(size)), mShared((Shared *) shared), mEnabled(mShared != NULL)
 {
+    memset((void *) mFormatReady, 0, sizeof(mFormatReady));
 }
 
 NBLog::Writer::Writer(size_t size, const sp<IMemory>& iMemory)
     : mSize(roundup(size)), mShared(iMemory != 0 ? (Shared *) iMemory->pointer() : NULL),
-      mIMemory(iMemory), mRear(0), mEnabled(mShared != NULL)
+      mIMemory(iMemory), mEnabled(mShared != NULL)
 {
+    memset((void *) mFormatReady, 0, sizeof(mFormatReady));
 }
 
 void NBLog::Writer::log(const char *string)
@@ -106,7 +231,7 @@ void NBLog::Writer::logf(const char *fmt, ...)
     }
     va_list ap;
     va_start(ap, fmt);
-    Writer::logvf(fmt, ap);     // the Writer:: is needed to avoid virtual dispatch for LockedWriter
+    Writer::logvf(fmt, ap);
     va_end(ap);
 }
 
@@ -146,6 +271,149 @@ void NBLog::Writer::logTimestamp(const struct timespec& ts)
     log(EVENT_TIMESTAMP, &ts, sizeof(struct timespec));
 }
 
+void NBLog::Writer::logFormat(const char *fmt, ...)
+{
+    if (!mEnabled) {
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    Writer::logvFormat(fmt, ap);
+    va_end(ap);
+}
+
+void NBLog::Writer::logvFormat(const char *fmt, va_list ap)
+{
+    if (!mEnabled) {
+        return;
+    }
+    const char *sig;
+    int id = formatId(fmt, &sig);
+    if (id < 0) {
+        Writer::logvf(fmt, ap);
+        return;
+    }
+    uint8_t buffer[255];
+    uint16_t id16 = id;
+    memcpy(buffer, &id16, sizeof(id16));
+    size_t length = sizeof(id16);
+    // arguments that don't fit are dropped, and shown as missing by the reader
+    for (; *sig != '\0'; ++sig) {
+        union {
+            int32_t i;
+            int64_t l;
+            double f;
+            uint64_t p;
+        } value;
+        size_t size;
+        switch (*sig) {
+        case 'i':
+            value.i = va_arg(ap, int);
+            size = sizeof(value.i);
+            break;
+        case 'l':
+            value.l = va_arg(ap, long);
+            size = sizeof(value.l);
+            break;
+        case 'L':
+            value.l = va_arg(ap, long long);
+            size = sizeof(value.l);
+            break;
+        case 'f':
+            value.f = va_arg(ap, double);
+            size = sizeof(value.f);
+            break;
+        case 'p':
+            value.p = (uintptr_t) va_arg(ap, void *);
+            size = sizeof(value.p);
+            break;
+        case 's': {
+            const char *string = va_arg(ap, const char *);
+            if (string == NULL) {
+                string = "(null)";
+            }
+            if (length >= sizeof(buffer)) {
+                goto done;
+            }
+            size_t n = strnlen(string, sizeof(buffer) - length - 1);
+            buffer[length++] = n;
+            memcpy(&buffer[length], string, n);
+            length += n;
+            } continue;
+        default:
+            goto done;
+        }
+        if (length + size > sizeof(buffer)) {
+            break;
+        }
+        memcpy(&buffer[length], &value, size);
+        length += size;
+    }
+done:
+    log(EVENT_FORMAT, buffer, length);
+}
+
+void NBLog::Writer::logHistogram(const char *label, uint32_t binWidthNs, const uint16_t *counts,
+        size_t numBins)
+{
+    if (!mEnabled) {
+        return;
+    }
+    const char *sig;
+    int id = formatId(label, &sig);
+    if (id < 0 || numBins == 0) {
+        return;
+    }
+    if (numBins > kMaxHistogramBins) {
+        numBins = kMaxHistogramBins;
+    }
+    uint8_t buffer[sizeof(uint16_t) + sizeof(uint32_t) + 1 + kMaxHistogramBins * sizeof(uint16_t)];
+    uint16_t id16 = id;
+    memcpy(buffer, &id16, sizeof(id16));
+    memcpy(&buffer[sizeof(id16)], &binWidthNs, sizeof(binWidthNs));
+    size_t length = sizeof(id16) + sizeof(binWidthNs);
+    buffer[length++] = numBins;
+    memcpy(&buffer[length], counts, numBins * sizeof(uint16_t));
+    length += numBins * sizeof(uint16_t);
+    log(EVENT_HISTOGRAM, buffer, length);
+}
+
+int NBLog::Writer::formatId(const char *fmt, const char **sig)
+{
+    // fast path: a slot already claimed by this writer
+    size_t count = android_atomic_acquire_load(&mShared->mFormats);
+    if (count > kMaxFormats) {
+        count = kMaxFormats;
+    }
+    for (size_t id = 0; id < count; ++id) {
+        if (android_atomic_acquire_load(&mFormatReady[id]) && mFormatPtrs[id] == fmt) {
+            *sig = mFormatSigs[id];
+            return id;
+        }
+    }
+    if (count == kMaxFormats || fmt == NULL) {
+        return -1;
+    }
+    // Claim a new slot.  Threads racing on the same format each get their own slot,
+    // which wastes a slot but is otherwise harmless.
+    char newSig[kMaxFormatArgs + 1];
+    if (strlen(fmt) >= kMaxFormatLength || !parseFormat(fmt, newSig, sizeof(newSig))) {
+        return -1;
+    }
+    int32_t id = android_atomic_inc(&mShared->mFormats);
+    if (id < 0 || (size_t) id >= kMaxFormats) {
+        return -1;
+    }
+    FormatSlot *slot = &((FormatSlot *) &mShared->mBuffer[mSize])[id];
+    strcpy(slot->mFormat, fmt);
+    android_atomic_release_store(1, &slot->mReady);
+    mFormatPtrs[id] = fmt;
+    memcpy(mFormatSigs[id], newSig, sizeof(newSig));
+    android_atomic_release_store(1, &mFormatReady[id]);
+    *sig = mFormatSigs[id];
+    return id;
+}
+
 void NBLog::Writer::log(Event event, const void *data, size_t length)
 {
     if (!mEnabled) {
@@ -157,6 +425,8 @@ void NBLog::Writer::log(Event event, const void *data, size_t length)
     switch (event) {
     case EVENT_STRING:
     case EVENT_TIMESTAMP:
+    case EVENT_FORMAT:
+    case EVENT_HISTOGRAM:
         break;
     case EVENT_RESERVED:
     default:
@@ -175,26 +445,20 @@ void NBLog::Writer::log(const NBLog::Entry *entry, bool trusted)
         log(entry->mEvent, entry->mData, entry->mLength);
         return;
     }
-    size_t rear = mRear & (mSize - 1);
-    size_t written = mSize - rear;      // written = number of bytes that have been written so far
-    size_t need = entry->mLength + 3;   // mEvent, mLength, data[length], mLength
-                                        // need = number of bytes remaining to write
+    uint8_t copy[255 + 3];
+    size_t need = entry->copyTo(copy);
+    // reserve, copy, then commit; no thread ever waits for another
+    size_t rear = android_atomic_add(need, &mShared->mRear) & (mSize - 1);
+    size_t written = mSize - rear;      // written = number of bytes to write before wraparound
     if (written > need) {
         written = need;
     }
-    size_t i;
-    // FIXME optimize this using memcpy for the data part of the Entry.
-    // The Entry could have a method copyTo(ptr, offset, size) to optimize the copy.
-    for (i = 0; i < written; ++i) {
-        mShared->mBuffer[rear + i] = entry->readAt(i);
-    }
-    if (rear + written == mSize && (need -= written) > 0)  {
-        for (i = 0; i < need; ++i) {
-            mShared->mBuffer[i] = entry->readAt(written + i);
-        }
-        written += need;
+    memcpy(&mShared->mBuffer[rear], copy, written);
+    if (written < need) {
+        memcpy(mShared->mBuffer, &copy[written], need - written);
     }
-    android_atomic_release_store(mRear += written, &mShared->mRear);
+    // android_atomic_add() is a full barrier, so the entry is visible before the commit
+    android_atomic_add(need, &mShared->mCommitted);
 }
 
 bool NBLog::Writer::isEnabled() const
@@ -221,54 +485,6 @@ NBLog::LockedWriter::LockedWriter(size_t size, void *shared)
 {
 }
 
-void NBLog::LockedWriter::log(const char *string)
-{
-    Mutex::Autolock _l(mLock);
-    Writer::log(string);
-}
-
-void NBLog::LockedWriter::logf(const char *fmt, ...)
-{
-    // FIXME should not take the lock until after formatting is done
-    Mutex::Autolock _l(mLock);
-    va_list ap;
-    va_start(ap, fmt);
-    Writer::logvf(fmt, ap);
-    va_end(ap);
-}
-
-void NBLog::LockedWriter::logvf(const char *fmt, va_list ap)
-{
-    // FIXME should not take the lock until after formatting is done
-    Mutex::Autolock _l(mLock);
-    Writer::logvf(fmt, ap);
-}
-
-void NBLog::LockedWriter::logTimestamp()
-{
-    // FIXME should not take the lock until after the clock_gettime() syscall
-    Mutex::Autolock _l(mLock);
-    Writer::logTimestamp();
-}
-
-void NBLog::LockedWriter::logTimestamp(const struct timespec& ts)
-{
-    Mutex::Autolock _l(mLock);
-    Writer::logTimestamp(ts);
-}
-
-bool NBLog::LockedWriter::isEnabled() const
-{
-    Mutex::Autolock _l(mLock);
-    return Writer::isEnabled();
-}
-
-bool NBLog::LockedWriter::setEnabled(bool enabled)
-{
-    Mutex::Autolock _l(mLock);
-    return Writer::setEnabled(enabled);
-}
-
 // ---------------------------------------------------------------------------
 
 NBLog::Reader::Reader(size_t size, const void *shared)
@@ -284,7 +500,25 @@ NBLog::Reader::Reader(size_t size, const sp<IMemory>& iMemory)
 
 void NBLog::Reader::dump(int fd, size_t indent)
 {
-    int32_t rear = android_atomic_acquire_load(&mShared->mRear);
+    // Wait until every reserved entry has been committed.  The committed count is loaded first:
+    // if the reservation index then matches, no entry before it can still be in progress.
+    int32_t rear;
+    for (int retries = 0; ; ++retries) {
+        int32_t committed = android_atomic_acquire_load(&mShared->mCommitted);
+        rear = android_atomic_acquire_load(&mShared->mRear);
+        if (committed == rear) {
+            break;
+        }
+        if (retries >= kCommitRetries) {
+            if (fd >= 0) {
+                fdprintf(fd, "%*swarning: writer busy, try again\n", indent, "");
+            } else {
+                ALOGI("%*swarning: writer busy, try again", indent, "");
+            }
+            return;
+        }
+        usleep(kCommitRetryUs);
+    }
     size_t avail = rear - mFront;
     if (avail == 0) {
         return;
@@ -368,6 +602,20 @@ void NBLog::Reader::dump(int fd, size_t indent)
             } else {
                 ALOGI("%*s%s%.*s", indent, "", prefix, length, (const char *) data);
             } break;
+        case EVENT_FORMAT:
+        case EVENT_HISTOGRAM: {
+            char line[1024];
+            if (event == EVENT_FORMAT) {
+                formatEvent((const uint8_t *) data, length, line, sizeof(line));
+            } else {
+                formatHistogram((const uint8_t *) data, length, line, sizeof(line));
+            }
+            if (fd >= 0) {
+                fdprintf(fd, "%*s%s%s\n", indent, "", prefix, line);
+            } else {
+                ALOGI("%*s%s%s", indent, "", prefix, line);
+            }
+            } break;
         case EVENT_TIMESTAMP: {
             // already checked that length == sizeof(struct timespec);
             memcpy(&ts, data, sizeof(struct timespec));
@@ -444,4 +692,160 @@ bool NBLog::Reader::isIMemory(const sp<IMemory>& iMemory) const
     return iMemory.get() == mIMemory.get();
 }
 
+bool NBLog::Reader::getFormat(uint16_t id, char *format) const
+{
+    if (id >= kMaxFormats) {
+        return false;
+    }
+    const FormatSlot *slot = &((const FormatSlot *) &mShared->mBuffer[mSize])[id];
+    if (!android_atomic_acquire_load(&slot->mReady)) {
+        return false;
+    }
+    memcpy(format, slot->mFormat, kMaxFormatLength);
+    format[kMaxFormatLength - 1] = '\0';
+    return true;
+}
+
+void NBLog::Reader::formatEvent(const uint8_t *data, size_t length, char *line,
+        size_t size) const
+{
+    uint16_t id;
+    char fmt[kMaxFormatLength];
+    if (length < sizeof(id) || (memcpy(&id, data, sizeof(id)), !getFormat(id, fmt))) {
+        snprintf(line, size, "warning: unknown format");
+        return;
+    }
+    const uint8_t *arg = data + sizeof(id);
+    const uint8_t *end = data + length;
+    size_t n = 0;   // characters in line
+    for (const char *p = fmt; *p != '\0' && n + 1 < size; ) {
+        if (*p != '%') {
+            line[n++] = *p++;
+            continue;
+        }
+        const char *start = p++;
+        char type;
+        int stars;
+        p = scanConversion(p, &type, &stars);
+        if (p == NULL) {
+            // the writer would have logged this as a string
+            break;
+        }
+        if (type == '\0') {
+            line[n++] = '%';
+            continue;
+        }
+        // rebuild the conversion specification with the '*' arguments inlined
+        char spec[64];
+        size_t k = 0;
+        bool missing = false;
+        const char *q;
+        for (q = start; q < p && k + 12 < sizeof(spec); ++q) {
+            if (*q != '*') {
+                spec[k++] = *q;
+                continue;
+            }
+            int32_t value = 0;
+            if (arg + sizeof(value) <= end) {
+                memcpy(&value, arg, sizeof(value));
+                arg += sizeof(value);
+            } else {
+                missing = true;
+            }
+            k += snprintf(&spec[k], sizeof(spec) - k, "%d", value);
+        }
+        if (q < p) {
+            // unreasonably long specification
+            break;
+        }
+        spec[k] = '\0';
+        int written = 0;
+        union {
+            int32_t i;
+            int64_t l;
+            double f;
+            uint64_t p;
+        } value;
+        size_t valueSize = type == 'i' ? sizeof(value.i) : type == 's' ? 1 : sizeof(value.l);
+        if (missing || arg + valueSize > end) {
+            written = snprintf(&line[n], size - n, "?");
+        } else if (type == 's') {
+            char string[256];
+            size_t len = *arg++;
+            if (arg + len > end) {
+                len = end - arg;
+            }
+            memcpy(string, arg, len);
+            string[len] = '\0';
+            arg += len;
+            written = snprintf(&line[n], size - n, spec, string);
+        } else {
+            memcpy(&value, arg, valueSize);
+            arg += valueSize;
+            switch (type) {
+            case 'i':
+                written = snprintf(&line[n], size - n, spec, (int) value.i);
+                break;
+            case 'l':
+                written = snprintf(&line[n], size - n, spec, (long) value.l);
+                break;
+            case 'L':
+                written = snprintf(&line[n], size - n, spec, (long long) value.l);
+                break;
+            case 'f':
+                written = snprintf(&line[n], size - n, spec, value.f);
+                break;
+            case 'p':
+                written = snprintf(&line[n], size - n, spec, (void *) (uintptr_t) value.p);
+                break;
+            }
+        }
+        if (written > 0) {
+            n += written;
+            if (n >= size) {
+                n = size - 1;
+            }
+        }
+    }
+    line[n] = '\0';
+}
+
+void NBLog::Reader::formatHistogram(const uint8_t *data, size_t length, char *line,
+        size_t size) const
+{
+    uint16_t id;
+    uint32_t binWidthNs;
+    char label[kMaxFormatLength];
+    size_t header = sizeof(id) + sizeof(binWidthNs) + 1;
+    if (length < header || (memcpy(&id, data, sizeof(id)), !getFormat(id, label))) {
+        snprintf(line, size, "warning: unknown histogram");
+        return;
+    }
+    memcpy(&binWidthNs, &data[sizeof(id)], sizeof(binWidthNs));
+    size_t numBins = data[header - 1];
+    if (header + numBins * sizeof(uint16_t) > length) {
+        numBins = (length - header) / sizeof(uint16_t);
+    }
+    uint32_t total = 0;
+    for (size_t bin = 0; bin < numBins; ++bin) {
+        uint16_t count;
+        memcpy(&count, &data[header + bin * sizeof(count)], sizeof(count));
+        total += count;
+    }
+    // only the non-empty bins, in ms
+    int n = snprintf(line, size, "%s: %u in bins of %.3f ms:", label, total, binWidthNs * 1e-6);
+    for (size_t bin = 0; bin < numBins && n >= 0 && (size_t) n < size; ++bin) {
+        uint16_t count;
+        memcpy(&count, &data[header + bin * sizeof(count)], sizeof(count));
+        if (count == 0) {
+            continue;
+        }
+        if (bin + 1 == numBins) {
+            n += snprintf(&line[n], size - n, " >=%.3f %u", bin * binWidthNs * 1e-6, count);
+        } else {
+            n += snprintf(&line[n], size - n, " %.3f %u", bin * binWidthNs * 1e-6, count);
+        }
+    }
+}
+
 }   // namespace android
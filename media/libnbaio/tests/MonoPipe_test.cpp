@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "MonoPipe_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <media/AudioBufferProvider.h>
+#include <media/nbaio/MonoPipe.h>
+#include <media/nbaio/MonoPipeReader.h>
+
+namespace android {
+
+// Drives a blocking MonoPipe the way MixerThread and FastMixer do: the writer writes large
+// buffers and is throttled by the pipe, the reader reads small buffers on its own period,
+// here with a synthetic jitter.
+
+static const unsigned kSampleRate = 48000;
+static const size_t kWriteFrames = 960;     // 20 ms, the normal mixer
+static const size_t kReadFrames = 240;      // 5 ms, the fast mixer
+static const int64_t kRunNs = 3000000000LL;
+// the minimum setpoint MixerThread uses with the screen on
+static const size_t kMinSetpoint = kWriteFrames * 2;
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleepNs(int64_t ns) {
+    if (ns > 0) {
+        const struct timespec req = {(time_t) (ns / 1000000000), (long) (ns % 1000000000)};
+        nanosleep(&req, NULL);
+    }
+}
+
+struct PipeRun {
+    MonoPipe *pipe;
+    MonoPipeReader *reader;
+    int jitterPercent;          // largest deviation of a read period, in percent of the period
+    volatile bool done;
+    // results
+    size_t underruns;           // reads that got fewer frames than requested
+    size_t readsAfterWarmup;
+    size_t sumDepth;            // depth before each read, after warmup
+};
+
+static void *writerLoop(void *arg) {
+    PipeRun *run = (PipeRun *) arg;
+    int16_t buffer[kWriteFrames * 2];
+    memset(buffer, 0, sizeof(buffer));
+    while (!run->done) {
+        run->pipe->write(buffer, kWriteFrames);
+    }
+    return NULL;
+}
+
+static void *readerLoop(void *arg) {
+    PipeRun *run = (PipeRun *) arg;
+    int16_t buffer[kReadFrames * 2];
+    const int64_t periodNs = (int64_t) kReadFrames * 1000000000LL / kSampleRate;
+    const int64_t startNs = nowNs();
+    int64_t nextNs = startNs;
+    for (;;) {
+        int64_t now = nowNs();
+        if (now - startNs >= kRunNs) {
+            break;
+        }
+        // the first second lets the writer fill the pipe and adaptation settle
+        bool warm = now - startNs >= kRunNs / 3;
+        ssize_t avail = run->reader->availableToRead();
+        ssize_t red = run->reader->read(buffer, kReadFrames, AudioBufferProvider::kInvalidPTS);
+        if (warm) {
+            run->readsAfterWarmup++;
+            run->sumDepth += avail > 0 ? avail : 0;
+            if (red < (ssize_t) kReadFrames) {
+                run->underruns++;
+            }
+        }
+        // a late wakeup is followed by reads back to back, as a fast mixer catches up
+        int64_t jitterNs = run->jitterPercent == 0 ? 0 :
+                (periodNs * (lrand48() % (run->jitterPercent + 1))) / 100;
+        nextNs += periodNs;
+        sleepNs(nextNs + jitterNs - nowNs());
+    }
+    run->done = true;
+    return NULL;
+}
+
+static void runPipe(PipeRun *run, bool adaptive, size_t setpoint, int jitterPercent) {
+    NBAIO_Format format = Format_from_SR_C(kSampleRate, 2);
+    run->pipe = new MonoPipe(kWriteFrames * 4, format, true /*writeCanBlock*/);
+    const NBAIO_Format offers[1] = {format};
+    size_t numCounterOffers = 0;
+    ASSERT_EQ(0, run->pipe->negotiate(offers, 1, NULL, numCounterOffers));
+    run->pipe->setAdaptive(adaptive);
+    run->pipe->setAvgFrames(setpoint);
+    run->reader = new MonoPipeReader(run->pipe);
+    numCounterOffers = 0;
+    ASSERT_EQ(0, run->reader->negotiate(offers, 1, NULL, numCounterOffers));
+    run->jitterPercent = jitterPercent;
+    run->done = false;
+    run->underruns = 0;
+    run->readsAfterWarmup = 0;
+    run->sumDepth = 0;
+
+    pthread_t writer, reader;
+    ASSERT_EQ(0, pthread_create(&writer, NULL, writerLoop, run));
+    ASSERT_EQ(0, pthread_create(&reader, NULL, readerLoop, run));
+    pthread_join(reader, NULL);
+    pthread_join(writer, NULL);
+    ALOGI("adaptive=%d jitter=%d%%: setpoint %u, underruns %u of %u reads, mean depth %u",
+            adaptive, jitterPercent, run->pipe->getAvgFrames(), run->underruns,
+            run->readsAfterWarmup, run->sumDepth / (run->readsAfterWarmup + 1));
+}
+
+static void deletePipe(PipeRun *run) {
+    delete run->reader;
+    delete run->pipe;
+}
+
+TEST(MonoPipeTest, AdaptiveSteadyReaderStaysAtMinimum) {
+    PipeRun run;
+    runPipe(&run, true /*adaptive*/, kMinSetpoint, 0);
+    // no jitter needs no more than the minimum, give or take scheduling noise
+    EXPECT_LE(run.pipe->getAvgFrames(), kMinSetpoint + kReadFrames);
+    EXPECT_EQ(0u, run.underruns);
+    deletePipe(&run);
+}
+
+TEST(MonoPipeTest, AdaptiveJitteryReaderRaisesSetpoint) {
+    PipeRun run;
+    runPipe(&run, true /*adaptive*/, kMinSetpoint, 800);
+    EXPECT_GT(run.pipe->getAvgFrames(), kMinSetpoint);
+    EXPECT_LE(run.pipe->getAvgFrames(), (run.pipe->maxFrames() * 7) / 8);
+    deletePipe(&run);
+}
+
+TEST(MonoPipeTest, AdaptiveUnderrunsNoWorseThanFixed) {
+    PipeRun fixed, adaptive;
+    // a setpoint that is too small for the writer bursts and the jitter
+    runPipe(&fixed, false /*adaptive*/, kReadFrames * 2, 200);
+    runPipe(&adaptive, true /*adaptive*/, kReadFrames * 2, 200);
+    // allow some slack for a loaded machine
+    EXPECT_LE(adaptive.underruns, fixed.underruns + adaptive.readsAfterWarmup / 50);
+    deletePipe(&fixed);
+    deletePipe(&adaptive);
+}
+
+TEST(MonoPipeTest, DepthReportsLatency) {
+    PipeRun run;
+    runPipe(&run, true /*adaptive*/, kMinSetpoint, 100);
+    size_t latencyFrames = 0, peakLatencyFrames = 0;
+    run.pipe->getDepth(&latencyFrames, &peakLatencyFrames);
+    EXPECT_LE(latencyFrames, run.pipe->maxFrames());
+    EXPECT_GE(peakLatencyFrames, latencyFrames);
+    EXPECT_LE(peakLatencyFrames, run.pipe->maxFrames());
+    EXPECT_GT(peakLatencyFrames, 0u);
+    deletePipe(&run);
+}
+
+}   // namespace android
@@ -577,9 +577,18 @@ status_t ACodec::configureOutputBuffersFromNativeWindow(
     crop.top = 0;
     crop.right = def.format.video.nFrameWidth & (~3); //if no 4 aglin crop csy
     crop.bottom = def.format.video.nFrameHeight;
+
     int rga_fd = -1;
-    rga_fd  = open("/dev/rga",O_RDWR,0);
-    if (rga_fd > 0) {
+    if (!strncmp("OMX.google.", mComponentName.c_str(), 11)) {
+        // Software decoders fill the buffers the way SoftwareRenderer does
+        // for them, so they get its YV12 geometry and crop.
+        crop.right = def.format.video.nFrameWidth - 64;
+        err = native_window_set_buffers_geometry(
+                mNativeWindow.get(),
+                (def.format.video.nFrameWidth + 15)&(~15),
+                (def.format.video.nFrameHeight + 15)&(~15),
+                HAL_PIXEL_FORMAT_YV12);
+    } else if ((rga_fd = open("/dev/rga",O_RDWR,0)) > 0) {
     err = native_window_set_buffers_geometry(
              mNativeWindow.get(),
              (def.format.video.nFrameWidth + 31)&(~31),
@@ -3867,8 +3876,7 @@ bool ACodec::LoadedState::onConfigureComponent(
     }
 
     sp<RefBase> obj;
-    if (msg->findObject("native-window", &obj)
-            && strncmp("OMX.google.", mCodec->mComponentName.c_str(), 11)) {
+    if (msg->findObject("native-window", &obj)) {
         sp<NativeWindowWrapper> nativeWindow(
                 static_cast<NativeWindowWrapper *>(obj.get()));
         CHECK(nativeWindow != NULL);
@@ -3878,11 +3886,36 @@ bool ACodec::LoadedState::onConfigureComponent(
                 mCodec->mNativeWindow.get(),
                 NATIVE_WINDOW_SCALING_MODE_SCALE_TO_WINDOW);
     }
-    CHECK_EQ((status_t)OK, mCodec->initNativeWindow());
+
+    bool softwareCodec =
+        !strncmp("OMX.google.", mCodec->mComponentName.c_str(), 11);
+
+    if (softwareCodec && mCodec->mNativeWindow != NULL) {
+        // Software decoders that cannot write into the native window
+        // buffers leave the rendering to the client. Most do not have the
+        // extension at all, so it is looked up before it is enabled.
+        OMX_INDEXTYPE index;
+        if (mCodec->mOMX->getExtensionIndex(
+                    mCodec->mNode,
+                    "OMX.google.android.index.enableAndroidNativeBuffers",
+                    &index) != OK
+                || mCodec->initNativeWindow() != OK) {
+            ALOGV("[%s] does not support native buffers",
+                  mCodec->mComponentName.c_str());
+
+            mCodec->mNativeWindow.clear();
+        }
+    }
+
+    if (!softwareCodec || mCodec->mNativeWindow == NULL) {
+        CHECK_EQ((status_t)OK, mCodec->initNativeWindow());
+    }
 
     {
         sp<AMessage> notify = mCodec->mNotify->dup();
         notify->setInt32("what", ACodec::kWhatComponentConfigured);
+        notify->setInt32(
+                "native-window-output", mCodec->mNativeWindow != NULL);
         notify->post();
     }
 
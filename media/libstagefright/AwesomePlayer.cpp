@@ -507,6 +507,7 @@ status_t AwesomePlayer::setDataSource_l(const sp<MediaExtractor> &extractor) {
                 TrackStat *stat =
                     &mStats.mTracks.editItemAt(mStats.mVideoTrackIndex);
                 stat->mMIME = mime.string();
+                stat->mSource = mVideoTrack;
             }
         } else if (!haveAudio && !strncasecmp(mime.string(), "audio/", 6)) {
             /*
@@ -537,6 +538,7 @@ status_t AwesomePlayer::setDataSource_l(const sp<MediaExtractor> &extractor) {
                 TrackStat *stat =
                     &mStats.mTracks.editItemAt(mStats.mAudioTrackIndex);
                 stat->mMIME = mime.string();
+                stat->mSource = mAudioTrack;
             }
 
             if (!strcasecmp(mime.string(), MEDIA_MIMETYPE_AUDIO_VORBIS)) {
@@ -3497,6 +3499,15 @@ status_t AwesomePlayer::dump(int fd, const Vector<String16> &args) const {
                     mStats.mNumVideoFramesDecoded,
                     mStats.mNumVideoFramesDropped);
         }
+
+        sp<MediaSource> source = stat.mSource.promote();
+        if (source != NULL) {
+            String8 bufferStats;
+            source->dumpBufferStats(bufferStats);
+            if (!bufferStats.isEmpty()) {
+                fprintf(out, "   buffers(%s)\n", bufferStats.string());
+            }
+        }
     }
 
     fclose(out);
@@ -16,8 +16,11 @@
 
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/FileSource.h>
+#include <cutils/properties.h>
+#include <utils/String8.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -31,6 +34,11 @@ FileSource::FileSource(const char *filename)
     : mFd(-1),
       mOffset(0),
       mLength(-1),
+      mMapBase(NULL),
+      mMapSize(0),
+      mMapData(NULL),
+      mMapAttempted(false),
+      mMapAllowed(true),
       mDecryptHandle(NULL),
       mDrmManagerClient(NULL),
       mDrmBufOffset(0),
@@ -55,6 +63,11 @@ FileSource::FileSource(int fd, int64_t offset, int64_t length)
     : mFd(fd),
       mOffset(offset),
       mLength(length),
+      mMapBase(NULL),
+      mMapSize(0),
+      mMapData(NULL),
+      mMapAttempted(false),
+      mMapAllowed(false),
       mDecryptHandle(NULL),
       mDrmManagerClient(NULL),
       mDrmBufOffset(0),
@@ -71,6 +84,8 @@ FileSource::FileSource(int fd, int64_t offset, int64_t length)
 }
 
 FileSource::~FileSource() {
+    unmapFile_l();
+
     if (mFd >= 0) {
         close(mFd);
         mFd = -1;
@@ -115,9 +130,11 @@ ssize_t FileSource::readAt(off64_t offset, void *data, size_t size) {
         }
     }
 
-    if (mDecryptHandle != NULL && DecryptApiType::CONTAINER_BASED
-            == mDecryptHandle->decryptApiType) {
+    if (isDRMContainerBased()) {
         return readAtDRM(offset, data, size);
+    } else if (offset >= 0 && mapFile_l()) {
+        memcpy(data, mMapData + offset, size);
+        return size;
    } else {
         off64_t result = lseek64(mFd, offset + mOffset, SEEK_SET);
         if (result == -1) {
@@ -157,6 +174,161 @@ status_t FileSource::getSize(off64_t *size) {
     return OK;
 }
 
+bool FileSource::isDRMContainerBased() const {
+    return mDecryptHandle != NULL
+        && DecryptApiType::CONTAINER_BASED == mDecryptHandle->decryptApiType;
+}
+
+bool FileSource::mapFile_l() {
+    // On 32-bit processes large files would eat too much address space,
+    // those keep using plain reads.
+    static const int64_t kMaxMapSize32 = 256 * 1024 * 1024;
+
+    if (mMapData != NULL) {
+        return true;
+    }
+
+    if (mMapAttempted) {
+        return false;
+    }
+    mMapAttempted = true;
+
+    if (!mMapAllowed || mFd < 0 || mLength <= 0
+            || (sizeof(void *) < 8 && mLength > kMaxMapSize32)) {
+        return false;
+    }
+
+    // Even a file we opened can be truncated by someone else while it is
+    // mapped, so mapping stays opt-in.
+    char value[PROPERTY_VALUE_MAX];
+    if (!property_get("media.stagefright.filesource-mmap", value, "0")
+            || strcmp(value, "1")) {
+        return false;
+    }
+
+    // Only map regular files that actually cover the window, touching a
+    // mapped page beyond EOF would raise SIGBUS.
+    struct stat64 st;
+    if (fstat64(mFd, &st) != 0 || !S_ISREG(st.st_mode)
+            || st.st_size < mOffset + mLength) {
+        return false;
+    }
+
+    // mmap offsets must be page aligned, fds handed to us with an
+    // offset/length window generally are not.
+    off64_t pageMask = (off64_t)sysconf(_SC_PAGESIZE) - 1;
+    off64_t base = mOffset & ~pageMask;
+    size_t delta = mOffset - base;
+    size_t size = delta + mLength;
+
+    void *ptr = mmap64(NULL, size, PROT_READ, MAP_SHARED, mFd, base);
+    if (ptr == MAP_FAILED) {
+        ALOGW("mmap of %lld bytes failed (%s), using read()",
+              mLength, strerror(errno));
+        return false;
+    }
+
+    mMapBase = ptr;
+    mMapSize = size;
+    mMapData = (const uint8_t *)ptr + delta;
+
+    return true;
+}
+
+void FileSource::unmapFile_l() {
+    if (mMapBase != NULL) {
+        munmap(mMapBase, mMapSize);
+        mMapBase = NULL;
+        mMapSize = 0;
+        mMapData = NULL;
+    }
+}
+
+const void *FileSource::getDirectPointer(off64_t offset, size_t size) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mDecryptHandle != NULL || offset < 0 || !mapFile_l()) {
+        return NULL;
+    }
+
+    if (offset + (int64_t)size > mLength) {
+        return NULL;
+    }
+
+    return mMapData + offset;
+}
+
+void FileSource::setAccessPattern(AccessPattern pattern) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mFd < 0) {
+        return;
+    }
+
+    int fileAdvice, memAdvice;
+    switch (pattern) {
+        case kAccessSequential:
+            fileAdvice = POSIX_FADV_SEQUENTIAL;
+            memAdvice = MADV_SEQUENTIAL;
+            break;
+        case kAccessRandom:
+            fileAdvice = POSIX_FADV_RANDOM;
+            memAdvice = MADV_RANDOM;
+            break;
+        default:
+            fileAdvice = POSIX_FADV_NORMAL;
+            memAdvice = MADV_NORMAL;
+            break;
+    }
+
+    posix_fadvise(mFd, mOffset, mLength > 0 ? mLength : 0, fileAdvice);
+
+    if (mMapBase != NULL) {
+        madvise(mMapBase, mMapSize, memAdvice);
+    }
+}
+
+void FileSource::prefetch(off64_t offset, size_t size) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mFd < 0 || offset < 0 || size == 0
+            || (mLength >= 0 && offset >= mLength)) {
+        return;
+    }
+
+    if (mLength >= 0 && offset + (int64_t)size > mLength) {
+        size = mLength - offset;
+    }
+
+    posix_fadvise(mFd, mOffset + offset, size, POSIX_FADV_WILLNEED);
+
+    if (mMapBase != NULL) {
+        uintptr_t pageMask = (uintptr_t)sysconf(_SC_PAGESIZE) - 1;
+        uintptr_t start = (uintptr_t)(mMapData + offset) & ~pageMask;
+        uintptr_t end = (uintptr_t)(mMapData + offset + size);
+
+        madvise((void *)start, end - start, MADV_WILLNEED);
+    }
+}
+
+bool FileSource::getFileIdentity(String8 *key, int64_t *size, int64_t *mtime) {
+    Mutex::Autolock autoLock(mLock);
+
+    struct stat64 st;
+    if (mFd < 0 || fstat64(mFd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+
+    *key = String8::format(
+            "%llx-%llx-%llx-%llx",
+            (unsigned long long)st.st_dev, (unsigned long long)st.st_ino,
+            (unsigned long long)mOffset, (unsigned long long)mLength);
+    *size = st.st_size;
+    *mtime = st.st_mtime;
+
+    return true;
+}
+
 sp<DecryptHandle> FileSource::DrmInitialization(const char *mime) {
     const int OMA_DRM_TYPE = 1;
     const int WIDEVINE_DRM_TYPE = 2;
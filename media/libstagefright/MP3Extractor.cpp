@@ -25,6 +25,7 @@
 #include "include/VBRISeeker.h"
 #include "include/XINGSeeker.h"
 
+#include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/DataSource.h>
@@ -252,6 +253,8 @@ MP3Extractor::MP3Extractor(
       mDataSource(source),
       mFirstFramePos(-1),
       mFixedHeader(0) {
+    mDataSource->setAccessPattern(DataSource::kAccessSequential);
+
     off64_t pos = 0;
     off64_t post_id3_pos;
     uint32_t header;
@@ -557,12 +560,24 @@ status_t MP3Source::read(
 
     CHECK(frame_size <= buffer->size());
 
-    ssize_t n = mDataSource->readAt(mCurrentPos, buffer->data(), frame_size);
-    if (n < (ssize_t)frame_size) {
+    const void *frame = mDataSource->getDirectPointer(mCurrentPos, frame_size);
+    if (frame != NULL) {
+        // Hand out the mapped frame instead of a copy, the wrapper keeps
+        // the data source (and with it the mapping) alive.
         buffer->release();
-        buffer = NULL;
 
-        return ERROR_END_OF_STREAM;
+        sp<ABuffer> data = new ABuffer(const_cast<void *>(frame), frame_size);
+        data->meta()->setObject("source", mDataSource);
+
+        buffer = new MediaBuffer(data);
+    } else {
+        ssize_t n = mDataSource->readAt(mCurrentPos, buffer->data(), frame_size);
+        if (n < (ssize_t)frame_size) {
+            buffer->release();
+            buffer = NULL;
+
+            return ERROR_END_OF_STREAM;
+        }
     }
 
     buffer->set_range(0, frame_size);
@@ -84,6 +84,8 @@ public:
     virtual status_t read(MediaBuffer **buffer, const ReadOptions *options = NULL);
     virtual status_t fragmentedRead(MediaBuffer **buffer, const ReadOptions *options = NULL);
 
+    virtual void dumpBufferStats(String8 &result);
+
 protected:
     virtual ~MPEG4Source();
 
@@ -2772,6 +2774,22 @@ status_t MPEG4Source::stop() {
     return OK;
 }
 
+void MPEG4Source::dumpBufferStats(String8 &result) {
+    // read() holds mLock while it waits for a buffer, dumpsys must not.
+    if (mLock.tryLock() != NO_ERROR) {
+        result.append("busy");
+        return;
+    }
+
+    if (mGroup != NULL) {
+        mGroup->dump(result);
+    } else {
+        result.append("stopped");
+    }
+
+    mLock.unlock();
+}
+
 status_t MPEG4Source::parseChunk(off64_t *offset) {
     uint32_t hdr[2];
     if (mDataSource->readAt(*offset, hdr, 8) < 8) {
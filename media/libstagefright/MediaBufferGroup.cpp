@@ -17,70 +17,240 @@
 #define LOG_TAG "MediaBufferGroup"
 #include <utils/Log.h>
 
+#include <string.h>
+#include <sys/atomics.h>
+
 #include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
 #include <media/stagefright/MediaBuffer.h>
 #include <media/stagefright/MediaBufferGroup.h>
 
 namespace android {
 
 MediaBufferGroup::MediaBufferGroup()
-    : mFirstBuffer(NULL),
-      mLastBuffer(NULL) {
+    : mNumBuffers(0),
+      mFreeHead(kNoSlot),
+      mNumWaiters(0),
+      mNumInUse(0),
+      mPeakInUse(0),
+      mNumAcquires(0),
+      mNumWaits(0),
+      mNumTimeouts(0),
+      mMaxWaitUs(0) {
+    memset(mChunks, 0, sizeof(mChunks));
+    memset(mWaitHistogram, 0, sizeof(mWaitHistogram));
 }
 
 MediaBufferGroup::~MediaBufferGroup() {
-    MediaBuffer *next;
-    for (MediaBuffer *buffer = mFirstBuffer; buffer != NULL;
-         buffer = next) {
-        next = buffer->nextBuffer();
+#if !LOG_NDEBUG
+    String8 stats;
+    dump(stats);
+    ALOGV("%s", stats.string());
+#endif
+
+    for (size_t i = 0; i < mNumBuffers; ++i) {
+        MediaBuffer *buffer = slotAt(i)->mBuffer;
 
         CHECK_EQ(buffer->refcount(), 0);
 
         buffer->setObserver(NULL);
         buffer->release();
     }
+
+    for (size_t i = 0; i < kMaxChunks && mChunks[i] != NULL; ++i) {
+        delete[] mChunks[i];
+    }
+}
+
+MediaBufferGroup::Slot *MediaBufferGroup::slotAt(int32_t index) const {
+    return &mChunks[index >> kChunkShift][index & (kChunkSize - 1)];
+}
+
+void MediaBufferGroup::pushFree(int32_t index) {
+    Slot *slot = slotAt(index);
+
+    for (;;) {
+        int32_t head = mFreeHead;
+        slot->mNextFree = head & 0xffff;
+
+        int32_t newHead = ((head + 0x10000) & 0xffff0000) | index;
+        if (__atomic_cmpxchg(head, newHead, &mFreeHead) == 0) {
+            break;
+        }
+    }
+}
+
+MediaBuffer *MediaBufferGroup::popFree() {
+    for (;;) {
+        int32_t head = mFreeHead;
+        int32_t index = head & 0xffff;
+
+        if (index == kNoSlot) {
+            return NULL;
+        }
+
+        Slot *slot = slotAt(index);
+
+        // The tag makes the exchange fail if "index" was popped and pushed
+        // back in the meantime, i.e. if mNextFree may be stale.
+        int32_t newHead = ((head + 0x10000) & 0xffff0000) | slot->mNextFree;
+        if (__atomic_cmpxchg(head, newHead, &mFreeHead) == 0) {
+            return slot->mBuffer;
+        }
+    }
 }
 
 void MediaBufferGroup::add_buffer(MediaBuffer *buffer) {
     Mutex::Autolock autoLock(mLock);
 
+    size_t index = mNumBuffers;
+    CHECK_LT(index, (size_t)kMaxChunks * kChunkSize);
+
+    Slot *&chunk = mChunks[index >> kChunkShift];
+    if (chunk == NULL) {
+        chunk = new Slot[kChunkSize];
+    }
+
+    Slot *slot = &chunk[index & (kChunkSize - 1)];
+    slot->mBuffer = buffer;
+    slot->mNextFree = kNoSlot;
+
     buffer->setObserver(this);
+    buffer->mGroupIndex = index;
 
-    if (mLastBuffer) {
-        mLastBuffer->setNextBuffer(buffer);
+    ++mNumBuffers;
+
+    if (buffer->refcount() == 0) {
+        pushFree(index);
     } else {
-        mFirstBuffer = buffer;
+        __atomic_inc(&mNumInUse);
     }
+}
 
-    mLastBuffer = buffer;
+status_t MediaBufferGroup::acquire_buffer(
+        MediaBuffer **out, bool nonBlocking) {
+    return acquire(out, nonBlocking ? 0 : -1);
 }
 
-status_t MediaBufferGroup::acquire_buffer(MediaBuffer **out) {
-    Mutex::Autolock autoLock(mLock);
+status_t MediaBufferGroup::acquire_buffer_timed(
+        MediaBuffer **out, int64_t timeoutUs) {
+    return acquire(out, timeoutUs < 0 ? 0 : timeoutUs);
+}
 
-    for (;;) {
-        for (MediaBuffer *buffer = mFirstBuffer;
-             buffer != NULL; buffer = buffer->nextBuffer()) {
-            if (buffer->refcount() == 0) {
-                buffer->add_ref();
-                buffer->reset();
-
-                *out = buffer;
-                goto exit;
+status_t MediaBufferGroup::acquire(MediaBuffer **out, int64_t timeoutUs) {
+    MediaBuffer *buffer = popFree();
+
+    if (buffer == NULL) {
+        if (timeoutUs == 0) {
+            return WOULD_BLOCK;
+        }
+
+        Mutex::Autolock autoLock(mLock);
+
+        // Announce ourselves before retrying, signalBufferReturned() only
+        // takes mLock to wake us up if it sees a waiter.
+        __atomic_inc(&mNumWaiters);
+
+        int64_t startUs = ALooper::GetNowUs();
+        status_t err = OK;
+
+        while ((buffer = popFree()) == NULL) {
+            if (timeoutUs < 0) {
+                // All buffers are in use. Block until one of them is
+                // returned to us.
+                mCondition.wait(mLock);
+                continue;
+            }
+
+            int64_t remainingUs = startUs + timeoutUs - ALooper::GetNowUs();
+            if (remainingUs <= 0) {
+                err = TIMED_OUT;
+                break;
             }
+
+            mCondition.waitRelative(mLock, remainingUs * 1000ll);
         }
 
-        // All buffers are in use. Block until one of them is returned to us.
-        mCondition.wait(mLock);
+        __atomic_dec(&mNumWaiters);
+
+        recordWait_l(ALooper::GetNowUs() - startUs, err != OK);
+
+        if (err != OK) {
+            ALOGW("no buffer returned to group %p within %lld us",
+                  this, timeoutUs);
+            return err;
+        }
+    }
+
+    buffer->add_ref();
+    buffer->reset();
+
+    *out = buffer;
+
+    __atomic_inc(&mNumAcquires);
+
+    int32_t inUse = __atomic_inc(&mNumInUse) + 1;
+    for (;;) {
+        int32_t peak = mPeakInUse;
+        if (inUse <= peak
+                || __atomic_cmpxchg(peak, inUse, &mPeakInUse) == 0) {
+            break;
+        }
     }
 
-exit:
     return OK;
 }
 
-void MediaBufferGroup::signalBufferReturned(MediaBuffer *) {
+void MediaBufferGroup::recordWait_l(int64_t waitUs, bool timedOut) {
+    ++mNumWaits;
+
+    if (timedOut) {
+        ++mNumTimeouts;
+    }
+
+    if (waitUs > mMaxWaitUs) {
+        mMaxWaitUs = waitUs;
+    }
+
+    size_t bucket = 0;
+    int64_t limitUs = 1000ll;
+    while (bucket + 1 < kNumWaitBuckets && waitUs >= limitUs) {
+        ++bucket;
+        limitUs *= 2;
+    }
+
+    ++mWaitHistogram[bucket];
+}
+
+void MediaBufferGroup::signalBufferReturned(MediaBuffer *buffer) {
+    CHECK_GE(buffer->mGroupIndex, 0);
+
+    __atomic_dec(&mNumInUse);
+    pushFree(buffer->mGroupIndex);
+
+    if (mNumWaiters > 0) {
+        Mutex::Autolock autoLock(mLock);
+        mCondition.signal();
+    }
+}
+
+void MediaBufferGroup::dump(String8 &result) const {
     Mutex::Autolock autoLock(mLock);
-    mCondition.signal();
+
+    result.appendFormat(
+            "%zu buffers, peak %d in use, %d acquires, %u waits, "
+            "%u timeouts, max wait %lld us, wait time histogram:",
+            mNumBuffers, mPeakInUse, mNumAcquires, mNumWaits, mNumTimeouts,
+            mMaxWaitUs);
+
+    for (size_t i = 0; i < kNumWaitBuckets; ++i) {
+        if (i + 1 < kNumWaitBuckets) {
+            result.appendFormat(" <%dms:%u", 1 << i, mWaitHistogram[i]);
+        } else {
+            result.appendFormat(
+                    " >=%dms:%u", 1 << (i - 1), mWaitHistogram[i]);
+        }
+    }
 }
 
 }  // namespace android
@@ -640,6 +640,15 @@ void MediaCodec::onMessageReceived(const sp<AMessage> &msg) {
                     CHECK_EQ(mState, CONFIGURING);
                     setState(CONFIGURED);
 
+                    // Software decoders that write straight into the native
+                    // window buffers need no renderer of ours.
+                    int32_t nativeWindowOutput;
+                    if (msg->findInt32(
+                                "native-window-output", &nativeWindowOutput)
+                            && nativeWindowOutput) {
+                        mFlags &= ~kFlagIsSoftwareCodec;
+                    }
+
                     // reset input surface flag
                     mHaveInputSurface = false;
 
@@ -22,6 +22,7 @@
 #include "include/HTTPBase.h"
 
 #include <cutils/properties.h>
+#include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/MediaErrors.h>
@@ -35,6 +36,12 @@ struct PageCache {
     struct Page {
         void *mData;
         size_t mSize;
+
+        // Number of outstanding borrowed references (see
+        // NuCachedSource2::borrowAt). A page released while still pinned is
+        // orphaned and freed by the last unpin instead of being recycled.
+        int32_t mPinCount;
+        bool mOrphaned;
     };
 
     Page *acquirePage();
@@ -49,46 +56,81 @@ struct PageCache {
 
     void copy(size_t from, void *data, size_t size);
 
+    // Returns the page holding cache offset "from" and the position of
+    // "from" within that page.
+    Page *findPage(size_t from, size_t *offsetInPage);
+
+    static void PinPage(Page *page);
+    static void UnpinPage(Page *page);
+
 private:
     size_t mPageSize;
     size_t mTotalSize;
 
-    List<Page *> mActivePages;
-    List<Page *> mFreePages;
+    // Active pages are mActivePages[mFirstActive..]. mPageStart holds the
+    // position of each page in the stream of all bytes ever appended, so a
+    // cache offset maps to a page by binary search. Released pages at the
+    // front are compacted away lazily. The positions are 64-bit, a stream
+    // can run through more than 4GB of cache over its lifetime.
+    Vector<Page *> mActivePages;
+    Vector<off64_t> mPageStart;
+    size_t mFirstActive;
+    off64_t mReleasedBytes;
+
+    Vector<Page *> mFreePages;
 
-    void freePages(List<Page *> *list);
+    size_t findPageIndex(size_t from) const;
+    static void FreePage(Page *page);
 
     DISALLOW_EVIL_CONSTRUCTORS(PageCache);
 };
 
 PageCache::PageCache(size_t pageSize)
     : mPageSize(pageSize),
-      mTotalSize(0) {
+      mTotalSize(0),
+      mFirstActive(0),
+      mReleasedBytes(0) {
 }
 
 PageCache::~PageCache() {
-    freePages(&mActivePages);
-    freePages(&mFreePages);
+    for (size_t i = mFirstActive; i < mActivePages.size(); ++i) {
+        FreePage(mActivePages.itemAt(i));
+    }
+
+    for (size_t i = 0; i < mFreePages.size(); ++i) {
+        FreePage(mFreePages.itemAt(i));
+    }
+}
+
+// static
+void PageCache::FreePage(Page *page) {
+    if (page->mPinCount > 0) {
+        page->mOrphaned = true;
+        return;
+    }
+
+    free(page->mData);
+    delete page;
 }
 
-void PageCache::freePages(List<Page *> *list) {
-    List<Page *>::iterator it = list->begin();
-    while (it != list->end()) {
-        Page *page = *it;
+// static
+void PageCache::PinPage(Page *page) {
+    ++page->mPinCount;
+}
 
-        free(page->mData);
-        delete page;
-        page = NULL;
+// static
+void PageCache::UnpinPage(Page *page) {
+    CHECK_GT(page->mPinCount, 0);
 
-        ++it;
+    if (--page->mPinCount == 0 && page->mOrphaned) {
+        FreePage(page);
     }
 }
 
 PageCache::Page *PageCache::acquirePage() {
-    if (!mFreePages.empty()) {
-        List<Page *>::iterator it = mFreePages.begin();
-        Page *page = *it;
-        mFreePages.erase(it);
+    if (!mFreePages.isEmpty()) {
+        Page *page = mFreePages.top();
+        mFreePages.pop();
 
         return page;
     }
@@ -96,33 +138,40 @@ PageCache::Page *PageCache::acquirePage() {
     Page *page = new Page;
     page->mData = malloc(mPageSize);
     page->mSize = 0;
+    page->mPinCount = 0;
+    page->mOrphaned = false;
 
     return page;
 }
 
 void PageCache::releasePage(Page *page) {
+    if (page->mPinCount > 0) {
+        page->mOrphaned = true;
+        return;
+    }
+
     page->mSize = 0;
-    mFreePages.push_back(page);
+    mFreePages.push(page);
 }
 
 void PageCache::appendPage(Page *page) {
+    mPageStart.push(mReleasedBytes + mTotalSize);
+    mActivePages.push(page);
+
     mTotalSize += page->mSize;
-    mActivePages.push_back(page);
 }
 
 size_t PageCache::releaseFromStart(size_t maxBytes) {
     size_t bytesReleased = 0;
 
-    while (maxBytes > 0 && !mActivePages.empty()) {
-        List<Page *>::iterator it = mActivePages.begin();
-
-        Page *page = *it;
+    while (maxBytes > 0 && mFirstActive < mActivePages.size()) {
+        Page *page = mActivePages.itemAt(mFirstActive);
 
         if (maxBytes < page->mSize) {
             break;
         }
 
-        mActivePages.erase(it);
+        ++mFirstActive;
 
         maxBytes -= page->mSize;
         bytesReleased += page->mSize;
@@ -131,47 +180,74 @@ size_t PageCache::releaseFromStart(size_t maxBytes) {
     }
 
     mTotalSize -= bytesReleased;
+    mReleasedBytes += bytesReleased;
+
+    if (mFirstActive == mActivePages.size()) {
+        mActivePages.clear();
+        mPageStart.clear();
+        mFirstActive = 0;
+    } else if (mFirstActive >= 32 && mFirstActive * 2 >= mActivePages.size()) {
+        mActivePages.removeItemsAt(0, mFirstActive);
+        mPageStart.removeItemsAt(0, mFirstActive);
+        mFirstActive = 0;
+    }
+
     return bytesReleased;
 }
 
-void PageCache::copy(size_t from, void *data, size_t size) {
-    ALOGV("copy from %d size %d", from, size);
+size_t PageCache::findPageIndex(size_t from) const {
+    off64_t pos = mReleasedBytes + from;
 
-    if (size == 0) {
-        return;
+    // Last page starting at or before "pos".
+    size_t lo = mFirstActive;
+    size_t hi = mActivePages.size();
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (mPageStart.itemAt(mid) <= pos) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
     }
 
-    CHECK_LE(from + size, mTotalSize);
+    return lo;
+}
 
-    size_t offset = 0;
-    List<Page *>::iterator it = mActivePages.begin();
-    while (from >= offset + (*it)->mSize) {
-        offset += (*it)->mSize;
-        ++it;
+PageCache::Page *PageCache::findPage(size_t from, size_t *offsetInPage) {
+    if (from >= mTotalSize) {
+        return NULL;
     }
 
-    size_t delta = from - offset;
-    size_t avail = (*it)->mSize - delta;
+    size_t index = findPageIndex(from);
+    *offsetInPage = (size_t)(mReleasedBytes + from - mPageStart.itemAt(index));
 
-    if (avail >= size) {
-        memcpy(data, (const uint8_t *)(*it)->mData + delta, size);
+    return mActivePages.itemAt(index);
+}
+
+void PageCache::copy(size_t from, void *data, size_t size) {
+    ALOGV("copy from %zu size %zu", from, size);
+
+    if (size == 0) {
         return;
     }
 
-    memcpy(data, (const uint8_t *)(*it)->mData + delta, avail);
-    ++it;
-    data = (uint8_t *)data + avail;
-    size -= avail;
+    CHECK_LE(from + size, mTotalSize);
+
+    size_t index = findPageIndex(from);
+    size_t delta = (size_t)(mReleasedBytes + from - mPageStart.itemAt(index));
 
     while (size > 0) {
-        size_t copy = (*it)->mSize;
+        const Page *page = mActivePages.itemAt(index++);
+
+        size_t copy = page->mSize - delta;
         if (copy > size) {
             copy = size;
         }
-        memcpy(data, (*it)->mData, copy);
+
+        memcpy(data, (const uint8_t *)page->mData + delta, copy);
         data = (uint8_t *)data + copy;
         size -= copy;
-        ++it;
+        delta = 0;
     }
 }
 
@@ -228,6 +304,11 @@ NuCachedSource2::~NuCachedSource2() {
 
     delete mCache;
     mCache = NULL;
+
+    for (size_t i = 0; i < mRetainedRanges.size(); ++i) {
+        delete mRetainedRanges.itemAt(i).mCache;
+    }
+    mRetainedRanges.clear();
 }
 
 status_t NuCachedSource2::getEstimatedBandwidthKbps(int32_t *kbps) {
@@ -278,6 +359,17 @@ void NuCachedSource2::onMessageReceived(const sp<AMessage> &msg) {
 			waitRead(msg);
             break;
         }
+
+        case kWhatUnpinPage:
+        {
+            void *page;
+            CHECK(msg->findPointer("page", &page));
+
+            Mutex::Autolock autoLock(mLock);
+            PageCache::UnpinPage(static_cast<PageCache::Page *>(page));
+            break;
+        }
+
         default:
             TRESPASS();
     }
@@ -529,6 +621,16 @@ ssize_t NuCachedSource2::readAt(off64_t offset, void *data, size_t size) {
         return size;
     }
 
+    // Reads that fall into a previously active range, i.e. index data near
+    // EOF, are served from there without disturbing the active window.
+    ssize_t rangeIndex = findRetainedRange_l(offset, size);
+    if (rangeIndex >= 0) {
+        const CachedRange &range = mRetainedRanges.itemAt(rangeIndex);
+        range.mCache->copy(offset - range.mOffset, data, size);
+
+        return size;
+    }
+
 	if (offset > mCacheOffset + mCache->totalSize())
 	{
 		if ((seek_en&&(offset - mCacheOffset - mCache->totalSize() < kDefaultHighWaterThreshold/4))||(offset - mCacheOffset - mCache->totalSize() < kDefaultLowWaterThreshold))
@@ -632,6 +734,13 @@ ssize_t NuCachedSource2::readInternal(off64_t offset, void *data, size_t size) {
                 true); // force
     }
 
+    ssize_t rangeIndex;
+    if ((offset < mCacheOffset
+            || offset >= (off64_t)(mCacheOffset + mCache->totalSize()))
+            && (rangeIndex = findRetainedRange_l(offset, 1)) >= 0) {
+        activateRetainedRange_l(rangeIndex);
+    }
+
     if (offset < mCacheOffset
             || offset >= (off64_t)(mCacheOffset + mCache->totalSize())) {
         static const off64_t kPadding = 256 * 1024;
@@ -684,15 +793,128 @@ status_t NuCachedSource2::seekInternal_l(off64_t offset) {
 
     ALOGI("new range: offset= %lld", offset);
 
+    retainActiveRange_l();
+
     mCacheOffset = offset;
 
+    mNumRetriesLeft = kMaxNumRetries;
+    mFetching = true;
+
+    return OK;
+}
+
+ssize_t NuCachedSource2::findRetainedRange_l(
+        off64_t offset, size_t size) const {
+    for (size_t i = mRetainedRanges.size(); i-- > 0;) {
+        const CachedRange &range = mRetainedRanges.itemAt(i);
+
+        if (offset >= range.mOffset
+                && offset + size
+                    <= range.mOffset + (off64_t)range.mCache->totalSize()) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void NuCachedSource2::retainActiveRange_l() {
     size_t totalSize = mCache->totalSize();
-    CHECK_EQ(mCache->releaseFromStart(totalSize), totalSize);
+
+    if (totalSize == 0) {
+        return;
+    }
+
+    CachedRange range;
+    range.mOffset = mCacheOffset;
+    range.mCache = mCache;
+    mRetainedRanges.push(range);
+
+    mCache = new PageCache(kPageSize);
+
+    // Retained data is bounded by the range count and by the same budget
+    // as the active window.
+    size_t retainedSize = 0;
+    for (size_t i = 0; i < mRetainedRanges.size(); ++i) {
+        retainedSize += mRetainedRanges.itemAt(i).mCache->totalSize();
+    }
+
+    while (mRetainedRanges.size() > kMaxNumRetainedRanges
+            || (mRetainedRanges.size() > 1
+                && retainedSize > mHighwaterThresholdBytes)) {
+        PageCache *oldest = mRetainedRanges.itemAt(0).mCache;
+        retainedSize -= oldest->totalSize();
+
+        ALOGV("dropping retained range at %lld (%zu bytes)",
+              mRetainedRanges.itemAt(0).mOffset, oldest->totalSize());
+
+        delete oldest;
+        mRetainedRanges.removeAt(0);
+    }
+}
+
+void NuCachedSource2::activateRetainedRange_l(size_t index) {
+    CachedRange range = mRetainedRanges.itemAt(index);
+    mRetainedRanges.removeAt(index);
+
+    ALOGI("switching back to retained range at %lld", range.mOffset);
+
+    retainActiveRange_l();
+
+    delete mCache;
+    mCache = range.mCache;
+    mCacheOffset = range.mOffset;
+    mLastAccessPos = range.mOffset;
 
     mNumRetriesLeft = kMaxNumRetries;
     mFetching = true;
+}
 
-    return OK;
+sp<ABuffer> NuCachedSource2::borrowAt(off64_t offset, size_t size) {
+    Mutex::Autolock autoLock(mLock);
+
+    PageCache *cache = NULL;
+    size_t delta = 0;
+
+    if (offset >= mCacheOffset
+            && offset < mCacheOffset + (off64_t)mCache->totalSize()) {
+        cache = mCache;
+        delta = offset - mCacheOffset;
+
+        mLastAccessPos = offset + size;
+    } else {
+        ssize_t rangeIndex = findRetainedRange_l(offset, 1);
+        if (rangeIndex < 0) {
+            return NULL;
+        }
+
+        const CachedRange &range = mRetainedRanges.itemAt(rangeIndex);
+        cache = range.mCache;
+        delta = offset - range.mOffset;
+    }
+
+    size_t offsetInPage;
+    PageCache::Page *page = cache->findPage(delta, &offsetInPage);
+    CHECK(page != NULL);
+
+    size_t avail = page->mSize - offsetInPage;
+    if (size > avail) {
+        size = avail;
+    }
+
+    PageCache::PinPage(page);
+
+    sp<ABuffer> buffer =
+        new ABuffer((uint8_t *)page->mData + offsetInPage, size);
+
+    // The farewell message keeps this source alive until the page has been
+    // unpinned.
+    sp<AMessage> msg = new AMessage(kWhatUnpinPage, mReflector->id());
+    msg->setPointer("page", page);
+    msg->setObject("source", this);
+    buffer->setFarewellMessage(msg);
+
+    return buffer;
 }
 
 void NuCachedSource2::resumeFetchingIfNecessary() {
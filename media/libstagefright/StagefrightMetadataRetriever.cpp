@@ -20,6 +20,8 @@
 #include "vpu_global.h"
 #include "include/StagefrightMetadataRetriever.h"
 
+#include <cutils/properties.h>
+
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/ColorConverter.h>
 #include <media/stagefright/DataSource.h>
@@ -169,6 +171,16 @@ static bool isYUV420PlanarSupported(
     return false;
 }
 
+// Largest side of the frames returned, 0 to return them at their decoded
+// size. Frames larger than that are scaled down while being converted.
+static int32_t getMaxFrameSize() {
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("media.stagefright.thumbnail-max", value, NULL) > 0) {
+        return atoi(value);
+    }
+    return 0;
+}
+
 static VideoFrame *extractVideoFrameWithCodecFlags(
         OMXClient *client,
         const sp<MetaData> &trackMeta,
@@ -356,9 +368,6 @@ static VideoFrame *extractVideoFrameWithCodecFlags(
     frame->mHeight = crop_bottom - crop_top + 1;
     frame->mDisplayWidth = frame->mWidth;
     frame->mDisplayHeight = frame->mHeight;
-    frame->mSize = frame->mWidth * frame->mHeight * 2;
-    frame->mData = new uint8_t[frame->mSize];
-    frame->mRotationAngle = rotationAngle;
 
     int32_t displayWidth, displayHeight;
     if (meta->findInt32(kKeyDisplayWidth, &displayWidth)) {
@@ -368,6 +377,47 @@ static VideoFrame *extractVideoFrameWithCodecFlags(
         frame->mDisplayHeight = displayHeight;
     }
 
+    const uint32_t cropWidth = frame->mWidth;
+    const uint32_t cropHeight = frame->mHeight;
+
+    int32_t maxSize = getMaxFrameSize();
+    if (maxSize > 0 && (frame->mWidth > (uint32_t)maxSize
+            || frame->mHeight > (uint32_t)maxSize)) {
+        if (frame->mWidth >= frame->mHeight) {
+            frame->mHeight = (frame->mHeight * maxSize + frame->mWidth / 2) / frame->mWidth;
+            frame->mWidth = maxSize;
+        } else {
+            frame->mWidth = (frame->mWidth * maxSize + frame->mHeight / 2) / frame->mHeight;
+            frame->mHeight = maxSize;
+        }
+        if (frame->mWidth == 0) {
+            frame->mWidth = 1;
+        }
+        if (frame->mHeight == 0) {
+            frame->mHeight = 1;
+        }
+
+        // Keep the display aspect ratio by scaling the display size along
+        // with the frame.
+        frame->mDisplayWidth = (uint32_t)(((uint64_t)frame->mDisplayWidth
+                * frame->mWidth + cropWidth / 2) / cropWidth);
+        frame->mDisplayHeight = (uint32_t)(((uint64_t)frame->mDisplayHeight
+                * frame->mHeight + cropHeight / 2) / cropHeight);
+        if (frame->mDisplayWidth == 0) {
+            frame->mDisplayWidth = 1;
+        }
+        if (frame->mDisplayHeight == 0) {
+            frame->mDisplayHeight = 1;
+        }
+
+        ALOGV("scaling the frame down to %ux%u (display %ux%u)",
+                frame->mWidth, frame->mHeight,
+                frame->mDisplayWidth, frame->mDisplayHeight);
+    }
+    frame->mSize = frame->mWidth * frame->mHeight * 2;
+    frame->mData = new uint8_t[frame->mSize];
+    frame->mRotationAngle = rotationAngle;
+
 
 
     ColorConverter converter(
@@ -222,6 +222,38 @@ void FindAVCDimensions(
     }
 }
 
+static inline bool HasZeroByte(uint32_t x) {
+    return ((x - 0x01010101) & ~x & 0x80808080) != 0;
+}
+
+ssize_t findNextStartCode(const uint8_t *data, size_t size) {
+    size_t offset = 0;
+    while (offset + 2 < size) {
+        // Every startcode contains a zero byte, skip words that have none.
+        if (offset + 4 <= size) {
+            uint32_t word;
+            memcpy(&word, &data[offset], sizeof(word));
+
+            if (!HasZeroByte(word)) {
+                offset += 4;
+                continue;
+            }
+        }
+
+        if (data[offset + 2] > 1) {
+            offset += 3;
+        } else if (data[offset + 1] != 0x00) {
+            offset += 2;
+        } else if (data[offset] != 0x00 || data[offset + 2] != 0x01) {
+            ++offset;
+        } else {
+            return offset;
+        }
+    }
+
+    return -1;
+}
+
 status_t getNextNALUnit(
         const uint8_t **_data, size_t *_size,
         const uint8_t **nalStart, size_t *nalSize,
@@ -257,25 +289,16 @@ status_t getNextNALUnit(
 
     size_t startOffset = offset;
 
-    for (;;) {
-        while (offset < size && data[offset] != 0x01) {
-            ++offset;
-        }
-
-        if (offset == size) {
-            if (startCodeFollows) {
-                offset = size + 2;
-                break;
-            }
-
-            return -EAGAIN;
-        }
+    ssize_t nextStartCode =
+        findNextStartCode(&data[startOffset], size - startOffset);
 
-        if (data[offset - 1] == 0x00 && data[offset - 2] == 0x00) {
-            break;
-        }
-
-        ++offset;
+    if (nextStartCode >= 0) {
+        // Point "offset" at the 0x01 of the next startcode.
+        offset = startOffset + nextStartCode + 2;
+    } else if (startCodeFollows) {
+        offset = size + 2;
+    } else {
+        return -EAGAIN;
     }
 
     size_t endOffset = offset - 2;
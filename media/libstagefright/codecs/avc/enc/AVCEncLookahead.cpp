@@ -0,0 +1,472 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "AVCEncLookahead"
+#include <utils/Log.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+
+#include "AVCEncLookahead.h"
+
+namespace android {
+
+// A frame starts a new scene if its P cost is above this fraction of its I
+// cost, in 1/16: most of the blocks found nothing to predict from.
+static const uint32_t kSceneCutRatio = 11;
+
+static inline int32_t clip(int32_t x, int32_t lo, int32_t hi) {
+    return x < lo ? lo : (x > hi ? hi : x);
+}
+
+AVCEncLookahead::AVCEncLookahead(int32_t width, int32_t height, size_t depth)
+    : mInitCheck(NO_INIT),
+      mWidth(width),
+      mHeight(height),
+      mDepth(depth),
+      mLowResWidth(width / 2),
+      mLowResHeight(height / 2),
+      mBlocksWide(width / 16),
+      mBlocksHigh(height / 16),
+      mSlots(NULL),
+      mLowRes(NULL),
+      mPrevLowRes(NULL),
+      mMotion(NULL),
+      mPrevMotion(NULL),
+      mHavePrevFrame(false),
+      mFramesSinceSceneCut(0),
+      mQueued(0),
+      mAnalyzed(0),
+      mPopped(0),
+      mDone(false),
+      mThreadStarted(false) {
+    CHECK(width % 16 == 0 && height % 16 == 0);
+
+    if (mDepth < 1) {
+        mDepth = 1;
+    } else if (mDepth > AVC_MAX_LOOKAHEAD) {
+        mDepth = AVC_MAX_LOOKAHEAD;
+    }
+
+    mSlots = new Slot[mDepth];
+    memset(mSlots, 0, mDepth * sizeof(Slot));
+
+    const size_t frameSize = (mWidth * mHeight * 3) >> 1;
+    for (size_t i = 0; i < mDepth; ++i) {
+        mSlots[i].mFrame.mData = (uint8_t *)malloc(frameSize);
+        if (mSlots[i].mFrame.mData == NULL) {
+            mInitCheck = NO_MEMORY;
+            return;
+        }
+    }
+
+    const size_t lowResSize = mLowResWidth * mLowResHeight;
+    const size_t numBlocks = mBlocksWide * mBlocksHigh;
+    mLowRes = (uint8_t *)malloc(lowResSize);
+    mPrevLowRes = (uint8_t *)malloc(lowResSize);
+    mMotion = (int16_t *)calloc(2 * numBlocks, sizeof(int16_t));
+    mPrevMotion = (int16_t *)calloc(2 * numBlocks, sizeof(int16_t));
+    if (mLowRes == NULL || mPrevLowRes == NULL
+            || mMotion == NULL || mPrevMotion == NULL) {
+        mInitCheck = NO_MEMORY;
+        return;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+    if (pthread_create(&mThread, &attr, ThreadWrapper, this) != 0) {
+        pthread_attr_destroy(&attr);
+        ALOGE("Unable to start the lookahead thread");
+        mInitCheck = UNKNOWN_ERROR;
+        return;
+    }
+    pthread_attr_destroy(&attr);
+
+    mThreadStarted = true;
+    mInitCheck = OK;
+}
+
+AVCEncLookahead::~AVCEncLookahead() {
+    if (mThreadStarted) {
+        {
+            Mutex::Autolock autoLock(mLock);
+            mDone = true;
+            mQueuedCondition.signal();
+        }
+
+        void *dummy;
+        pthread_join(mThread, &dummy);
+    }
+
+    for (size_t i = 0; i < mDepth; ++i) {
+        free(mSlots[i].mFrame.mData);
+    }
+    delete[] mSlots;
+    mSlots = NULL;
+
+    free(mLowRes);
+    free(mPrevLowRes);
+    free(mMotion);
+    free(mPrevMotion);
+}
+
+status_t AVCEncLookahead::initCheck() const {
+    return mInitCheck;
+}
+
+size_t AVCEncLookahead::numFrames() const {
+    Mutex::Autolock autoLock(mLock);
+    return mQueued - mPopped;
+}
+
+bool AVCEncLookahead::isFull() const {
+    return numFrames() >= mDepth;
+}
+
+uint8_t *AVCEncLookahead::inputBuffer() {
+    Mutex::Autolock autoLock(mLock);
+    CHECK_LT(mQueued - mPopped, mDepth);
+    return mSlots[mQueued % mDepth].mFrame.mData;
+}
+
+void AVCEncLookahead::queueFrame(int64_t timeUs, uint32_t flags) {
+    Mutex::Autolock autoLock(mLock);
+    CHECK_LT(mQueued - mPopped, mDepth);
+
+    Frame *frame = &mSlots[mQueued % mDepth].mFrame;
+    frame->mTimeUs = timeUs;
+    frame->mFlags = flags;
+
+    ++mQueued;
+    mQueuedCondition.signal();
+}
+
+const AVCEncLookahead::Frame *AVCEncLookahead::peekFrame(
+        AVCLookaheadInfo *info) {
+    Mutex::Autolock autoLock(mLock);
+    CHECK_GT(mQueued, mPopped);
+
+    while (mAnalyzed < mQueued) {
+        mAnalyzedCondition.wait(mLock);
+    }
+
+    info->num_frames = mQueued - mPopped;
+    for (int i = 0; i < info->num_frames; ++i) {
+        const Slot &slot = mSlots[(mPopped + i) % mDepth];
+        info->intra_cost[i] = slot.mIntraCost;
+        info->inter_cost[i] = slot.mInterCost;
+        info->scene_cut[i] = slot.mSceneCut ? AVC_ON : AVC_OFF;
+    }
+
+    return &mSlots[mPopped % mDepth].mFrame;
+}
+
+void AVCEncLookahead::popFrame() {
+    Mutex::Autolock autoLock(mLock);
+    CHECK_GT(mQueued, mPopped);
+    ++mPopped;
+}
+
+void AVCEncLookahead::flush() {
+    Mutex::Autolock autoLock(mLock);
+
+    while (mAnalyzed < mQueued) {
+        mAnalyzedCondition.wait(mLock);
+    }
+    mPopped = mQueued;
+
+    // The next frame does not follow the last one analysed.
+    mHavePrevFrame = false;
+    mFramesSinceSceneCut = 0;
+}
+
+// static
+void *AVCEncLookahead::ThreadWrapper(void *me) {
+    static_cast<AVCEncLookahead *>(me)->threadEntry();
+    return NULL;
+}
+
+void AVCEncLookahead::threadEntry() {
+    Mutex::Autolock autoLock(mLock);
+
+    for (;;) {
+        while (!mDone && mAnalyzed == mQueued) {
+            mQueuedCondition.wait(mLock);
+        }
+        if (mDone) {
+            break;
+        }
+
+        // The slot is not reused before the frame is popped, which waits for
+        // its analysis.
+        Slot *slot = &mSlots[mAnalyzed % mDepth];
+        mLock.unlock();
+        analyze(slot);
+        mLock.lock();
+
+        ++mAnalyzed;
+        mAnalyzedCondition.signal();
+    }
+}
+
+void AVCEncLookahead::analyze(Slot *slot) {
+    downscale(slot->mFrame.mData, mLowRes);
+
+    uint32_t intraCostSum = 0;
+    uint32_t interCostSum = 0;
+    for (int32_t by = 0; by < mBlocksHigh; ++by) {
+        for (int32_t bx = 0; bx < mBlocksWide; ++bx) {
+            int16_t *mv = &mMotion[2 * (by * mBlocksWide + bx)];
+            uint32_t intra = intraCost(mLowRes, bx, by);
+            uint32_t inter = intra;
+            if (mHavePrevFrame) {
+                inter = interCost(mLowRes, bx, by, mv);
+            } else {
+                mv[0] = mv[1] = 0;
+            }
+
+            // A P frame codes the blocks it cannot predict as intra.
+            intraCostSum += intra;
+            interCostSum += inter < intra ? inter : intra;
+        }
+    }
+
+    slot->mIntraCost = intraCostSum;
+    slot->mInterCost = interCostSum;
+    slot->mSceneCut = mHavePrevFrame
+            && mFramesSinceSceneCut >= kMinSceneCutInterval
+            && (uint64_t)interCostSum * 16 > (uint64_t)intraCostSum * kSceneCutRatio;
+
+    ALOGV("intra %u inter %u%s", intraCostSum, interCostSum,
+            slot->mSceneCut ? " scene cut" : "");
+
+    if (!mHavePrevFrame || slot->mSceneCut) {
+        mFramesSinceSceneCut = 0;
+    }
+    ++mFramesSinceSceneCut;
+
+    uint8_t *tmp = mPrevLowRes;
+    mPrevLowRes = mLowRes;
+    mLowRes = tmp;
+
+    int16_t *tmpMotion = mPrevMotion;
+    mPrevMotion = mMotion;
+    mMotion = tmpMotion;
+
+    mHavePrevFrame = true;
+}
+
+void AVCEncLookahead::downscale(const uint8_t *src, uint8_t *dst) const {
+    for (int32_t y = 0; y < mLowResHeight; ++y) {
+        const uint8_t *row0 = src + 2 * y * mWidth;
+        const uint8_t *row1 = row0 + mWidth;
+        for (int32_t x = 0; x < mLowResWidth; ++x) {
+            dst[x] = (row0[2 * x] + row0[2 * x + 1]
+                    + row1[2 * x] + row1[2 * x + 1] + 2) >> 2;
+        }
+        dst += mLowResWidth;
+    }
+}
+
+// Smallest SAD of the DC, vertical and horizontal predictions of the block
+// from its neighbours in the source frame.
+uint32_t AVCEncLookahead::intraCost(
+        const uint8_t *plane, int32_t bx, int32_t by) const {
+    const int32_t stride = mLowResWidth;
+    const uint8_t *block = plane + by * kBlockSize * stride + bx * kBlockSize;
+    const uint8_t *top = by > 0 ? block - stride : NULL;
+
+    int32_t dc = 0;
+    int32_t count = 0;
+    if (top != NULL) {
+        for (int32_t i = 0; i < kBlockSize; ++i) {
+            dc += top[i];
+        }
+        count += kBlockSize;
+    }
+    if (bx > 0) {
+        for (int32_t i = 0; i < kBlockSize; ++i) {
+            dc += block[i * stride - 1];
+        }
+        count += kBlockSize;
+    }
+    dc = count > 0 ? (dc + count / 2) / count : 128;
+
+    uint32_t dcCost = 0;
+    uint32_t verCost = 0;
+    uint32_t horCost = 0;
+    for (int32_t y = 0; y < kBlockSize; ++y) {
+        const uint8_t *row = block + y * stride;
+        for (int32_t x = 0; x < kBlockSize; ++x) {
+            dcCost += abs(row[x] - dc);
+            if (top != NULL) {
+                verCost += abs(row[x] - top[x]);
+            }
+            if (bx > 0) {
+                horCost += abs(row[x] - row[-1]);
+            }
+        }
+    }
+
+    uint32_t cost = dcCost;
+    if (top != NULL && verCost < cost) {
+        cost = verCost;
+    }
+    if (bx > 0 && horCost < cost) {
+        cost = horCost;
+    }
+    return cost;
+}
+
+uint32_t AVCEncLookahead::blockSAD(
+        const uint8_t *plane, int32_t x, int32_t y,
+        int32_t dx, int32_t dy) const {
+    const int32_t stride = mLowResWidth;
+    const uint8_t *cur = plane + y * stride + x;
+    const uint8_t *ref = mPrevLowRes + (y + dy) * stride + x + dx;
+
+    uint32_t sad = 0;
+    for (int32_t i = 0; i < kBlockSize; ++i) {
+        for (int32_t j = 0; j < kBlockSize; ++j) {
+            sad += abs(cur[j] - ref[j]);
+        }
+        cur += stride;
+        ref += stride;
+    }
+    return sad;
+}
+
+// SAD against the reference half a pixel away from (dx, dy) in the direction
+// of (fx, fy), interpolated bilinearly.
+uint32_t AVCEncLookahead::halfPelSAD(
+        const uint8_t *plane, int32_t x, int32_t y,
+        int32_t dx, int32_t dy, int32_t fx, int32_t fy) const {
+    const int32_t stride = mLowResWidth;
+    const uint8_t *cur = plane + y * stride + x;
+    const uint8_t *ref = mPrevLowRes + (y + dy) * stride + x + dx;
+    const int32_t offset = fy * stride + fx;
+
+    uint32_t sad = 0;
+    for (int32_t i = 0; i < kBlockSize; ++i) {
+        for (int32_t j = 0; j < kBlockSize; ++j) {
+            int32_t value;
+            if (fx != 0 && fy != 0) {
+                value = (ref[j] + ref[j + fx] + ref[j + fy * stride]
+                        + ref[j + offset] + 2) >> 2;
+            } else {
+                value = (ref[j] + ref[j + offset] + 1) >> 1;
+            }
+            sad += abs(cur[j] - value);
+        }
+        cur += stride;
+        ref += stride;
+    }
+    return sad;
+}
+
+// Motion search against the previous frame: the best of the zero vector, the
+// vectors of the left and top blocks and of the block at the same place in the
+// previous frame, refined by a small diamond search and then to half a pixel,
+// which fast pans at half the resolution mostly need.
+uint32_t AVCEncLookahead::interCost(
+        const uint8_t *plane, int32_t bx, int32_t by, int16_t *mv) const {
+    const int32_t x = bx * kBlockSize;
+    const int32_t y = by * kBlockSize;
+    const int32_t minDx = -(x < kSearchRange ? x : kSearchRange);
+    const int32_t minDy = -(y < kSearchRange ? y : kSearchRange);
+    const int32_t maxDx = clip(mLowResWidth - kBlockSize - x, 0, kSearchRange);
+    const int32_t maxDy = clip(mLowResHeight - kBlockSize - y, 0, kSearchRange);
+    const int32_t blockIndex = by * mBlocksWide + bx;
+
+    int32_t candidates[4][2];
+    int32_t numCandidates = 0;
+    if (bx > 0) {
+        candidates[numCandidates][0] = mMotion[2 * (blockIndex - 1)];
+        candidates[numCandidates++][1] = mMotion[2 * (blockIndex - 1) + 1];
+    }
+    if (by > 0) {
+        candidates[numCandidates][0] = mMotion[2 * (blockIndex - mBlocksWide)];
+        candidates[numCandidates++][1] =
+            mMotion[2 * (blockIndex - mBlocksWide) + 1];
+    }
+    candidates[numCandidates][0] = mPrevMotion[2 * blockIndex];
+    candidates[numCandidates++][1] = mPrevMotion[2 * blockIndex + 1];
+
+    int32_t bestDx = 0;
+    int32_t bestDy = 0;
+    uint32_t bestSAD = blockSAD(plane, x, y, 0, 0);
+    for (int32_t i = 0; i < numCandidates; ++i) {
+        int32_t dx = clip(candidates[i][0], minDx, maxDx);
+        int32_t dy = clip(candidates[i][1], minDy, maxDy);
+        if (dx == bestDx && dy == bestDy) {
+            continue;
+        }
+        uint32_t sad = blockSAD(plane, x, y, dx, dy);
+        if (sad < bestSAD) {
+            bestSAD = sad;
+            bestDx = dx;
+            bestDy = dy;
+        }
+    }
+
+    static const int32_t kDiamond[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+    for (int32_t step = 0; step < kSearchRange; ++step) {
+        int32_t centerDx = bestDx;
+        int32_t centerDy = bestDy;
+        for (int32_t i = 0; i < 4; ++i) {
+            int32_t dx = centerDx + kDiamond[i][0];
+            int32_t dy = centerDy + kDiamond[i][1];
+            if (dx < minDx || dx > maxDx || dy < minDy || dy > maxDy) {
+                continue;
+            }
+            uint32_t sad = blockSAD(plane, x, y, dx, dy);
+            if (sad < bestSAD) {
+                bestSAD = sad;
+                bestDx = dx;
+                bestDy = dy;
+            }
+        }
+        if (bestDx == centerDx && bestDy == centerDy) {
+            break;
+        }
+    }
+
+    // The vector kept for the neighbours is the full pixel one.
+    mv[0] = bestDx;
+    mv[1] = bestDy;
+
+    for (int32_t fy = -1; fy <= 1; ++fy) {
+        for (int32_t fx = -1; fx <= 1; ++fx) {
+            if ((fx == 0 && fy == 0)
+                    || bestDx + fx < minDx || bestDx + fx > maxDx
+                    || bestDy + fy < minDy || bestDy + fy > maxDy) {
+                continue;
+            }
+            uint32_t sad = halfPelSAD(plane, x, y, bestDx, bestDy, fx, fy);
+            if (sad < bestSAD) {
+                bestSAD = sad;
+            }
+        }
+    }
+    return bestSAD;
+}
+
+}  // namespace android
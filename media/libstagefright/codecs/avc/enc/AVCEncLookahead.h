@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AVC_ENC_LOOKAHEAD_H_
+#define AVC_ENC_LOOKAHEAD_H_
+
+#include <pthread.h>
+
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/Errors.h>
+#include <utils/threads.h>
+
+#include "avcenc_api.h"
+
+namespace android {
+
+// Queue of the frames ahead of the encoder. Every frame queued is analysed on
+// a worker thread, on a half resolution copy of its luma: the costs of coding
+// it as an I and as a P frame are estimated, and a frame hardly cheaper as P
+// than as I starts a new scene. The encoder takes the oldest frame together
+// with the estimates of the whole queue, see PVAVCEncSetLookahead().
+struct AVCEncLookahead {
+    struct Frame {
+        uint8_t *mData;     // YUV 4:2:0 planar, width x height
+        int64_t mTimeUs;
+        uint32_t mFlags;
+    };
+
+    // width and height must be multiples of 16, depth is clipped to
+    // [1, AVC_MAX_LOOKAHEAD].
+    AVCEncLookahead(int32_t width, int32_t height, size_t depth);
+    ~AVCEncLookahead();
+
+    status_t initCheck() const;
+
+    size_t depth() const { return mDepth; }
+    size_t numFrames() const;
+    bool isFull() const;
+
+    // Buffer the next frame is to be written to, only valid if the queue is
+    // not full.
+    uint8_t *inputBuffer();
+
+    // Queues the frame written to inputBuffer() and starts its analysis.
+    void queueFrame(int64_t timeUs, uint32_t flags);
+
+    // Waits for the analysis of all the queued frames, then returns the oldest
+    // one and the estimates of the queue. The queue must not be empty.
+    const Frame *peekFrame(AVCLookaheadInfo *info);
+
+    // Removes the oldest frame from the queue.
+    void popFrame();
+
+    // Drops all the queued frames.
+    void flush();
+
+private:
+    enum {
+        kBlockSize = 8,             // half resolution, one block per MB
+        kSearchRange = 16,          // half resolution pixels
+        kMinSceneCutInterval = 4,   // frames
+    };
+
+    struct Slot {
+        Frame mFrame;
+        uint32_t mIntraCost;
+        uint32_t mInterCost;
+        bool mSceneCut;
+    };
+
+    status_t mInitCheck;
+
+    int32_t mWidth;
+    int32_t mHeight;
+    size_t mDepth;
+
+    int32_t mLowResWidth;
+    int32_t mLowResHeight;
+    int32_t mBlocksWide;
+    int32_t mBlocksHigh;
+
+    Slot *mSlots;
+
+    // Owned by the worker thread.
+    uint8_t *mLowRes;
+    uint8_t *mPrevLowRes;
+    int16_t *mMotion;       // vectors of the blocks, x then y
+    int16_t *mPrevMotion;
+    bool mHavePrevFrame;
+    size_t mFramesSinceSceneCut;
+
+    // Frame counts since the start, the slot of frame n is n % mDepth.
+    // mQueued and mPopped are only changed by the encoder thread, mAnalyzed
+    // by the worker.
+    mutable Mutex mLock;
+    Condition mQueuedCondition;
+    Condition mAnalyzedCondition;
+    size_t mQueued;
+    size_t mAnalyzed;
+    size_t mPopped;
+    bool mDone;
+
+    pthread_t mThread;
+    bool mThreadStarted;
+
+    static void *ThreadWrapper(void *me);
+    void threadEntry();
+
+    void analyze(Slot *slot);
+    void downscale(const uint8_t *src, uint8_t *dst) const;
+    uint32_t intraCost(const uint8_t *plane, int32_t bx, int32_t by) const;
+    uint32_t interCost(
+            const uint8_t *plane, int32_t bx, int32_t by, int16_t *mv) const;
+    uint32_t blockSAD(
+            const uint8_t *plane, int32_t x, int32_t y,
+            int32_t dx, int32_t dy) const;
+    uint32_t halfPelSAD(
+            const uint8_t *plane, int32_t x, int32_t y,
+            int32_t dx, int32_t dy, int32_t fx, int32_t fy) const;
+
+    DISALLOW_EVIL_CONSTRUCTORS(AVCEncLookahead);
+};
+
+}  // namespace android
+
+#endif  // AVC_ENC_LOOKAHEAD_H_
@@ -2,6 +2,7 @@ LOCAL_PATH := $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES := \
+    AVCEncLookahead.cpp \
     src/avcenc_api.cpp \
     src/bitstream_io.cpp \
     src/block.cpp \
@@ -15,6 +16,7 @@ LOCAL_SRC_FILES := \
     src/residual.cpp \
     src/sad.cpp \
     src/sad_halfpel.cpp \
+    src/sad_simd.cpp \
     src/slice.cpp \
     src/vlc_encode.cpp
 
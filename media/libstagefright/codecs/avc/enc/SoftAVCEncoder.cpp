@@ -31,11 +31,18 @@
 #include <media/stagefright/Utils.h>
 #include <ui/Rect.h>
 #include <ui/GraphicBufferMapper.h>
+#include <unistd.h>
 
+#include "AVCEncLookahead.h"
 #include "SoftAVCEncoder.h"
 
 namespace android {
 
+static const char *kLookaheadExtensionName =
+    "OMX.google.android.index.lookaheadFrames";
+static const char *kVBVBufferSizeExtensionName =
+    "OMX.google.android.index.vbvBufferSizeMs";
+
 template<class T>
 static void InitOMXParams(T *params) {
     params->nSize = sizeof(T);
@@ -182,6 +189,8 @@ SoftAVCEncoder::SoftAVCEncoder(
       mIDRFrameRefreshIntervalInSec(1),
       mAVCEncProfile(AVC_BASELINE),
       mAVCEncLevel(AVC_LEVEL2),
+      mLookaheadFrames(0),
+      mVBVBufferSizeMs(0),
       mNumInputFrames(-1),
       mPrevTimestampUs(-1),
       mStarted(false),
@@ -190,7 +199,8 @@ SoftAVCEncoder::SoftAVCEncoder(
       mHandle(new tagAVCHandle),
       mEncParams(new tagAVCEncParam),
       mInputFrameData(NULL),
-      mSliceGroup(NULL) {
+      mSliceGroup(NULL),
+      mLookahead(NULL) {
 
     initPorts();
     ALOGI("Construct SoftAVCEncoder");
@@ -217,7 +227,7 @@ OMX_ERRORTYPE SoftAVCEncoder::initEncParams() {
     mHandle->CBAVC_Free = FreeWrapper;
 
     CHECK(mEncParams != NULL);
-    memset(mEncParams, 0, sizeof(mEncParams));
+    memset(mEncParams, 0, sizeof(tagAVCEncParam));
     mEncParams->rate_control = AVC_ON;
     mEncParams->initQP = 0;
     mEncParams->init_CBP_removal_delay = 1600;
@@ -254,6 +264,14 @@ OMX_ERRORTYPE SoftAVCEncoder::initEncParams() {
 
     mEncParams->use_overrun_buffer = AVC_OFF;
 
+    long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    mEncParams->me_threads = 1;
+    if (numCpus > 1) {
+        mEncParams->me_threads = (int)(
+                numCpus < kMaxMotionSearchThreads ? numCpus : kMaxMotionSearchThreads);
+    }
+    mEncParams->scalar_only = AVC_OFF;
+
     if (mVideoColorFormat == OMX_COLOR_FormatYUV420SemiPlanar) {
         // Color conversion is needed.
         CHECK(mInputFrameData == NULL);
@@ -274,6 +292,13 @@ OMX_ERRORTYPE SoftAVCEncoder::initEncParams() {
     mEncParams->bitrate = mVideoBitRate;
     mEncParams->frame_rate = 1000 * mVideoFrameRate;  // In frames/ms!
     mEncParams->CPB_size = (uint32_t) (mVideoBitRate >> 1);
+    if (mVBVBufferSizeMs > 0) {
+        // No frame is skipped, the quantizer goes up instead to keep the
+        // coded picture buffer from overflowing.
+        mEncParams->CPB_size =
+            (uint32_t) (((int64_t) mVideoBitRate * mVBVBufferSizeMs) / 1000);
+        mEncParams->vbv_constrained = AVC_ON;
+    }
 
     int32_t nMacroBlocks = ((((mVideoWidth + 15) >> 4) << 4) *
             (((mVideoHeight + 15) >> 4) << 4)) >> 8;
@@ -325,10 +350,26 @@ OMX_ERRORTYPE SoftAVCEncoder::initEncoder() {
         return OMX_ErrorUndefined;
     }
 
+    if (mLookaheadFrames > 0) {
+        CHECK(mLookahead == NULL);
+        mLookahead = new AVCEncLookahead(mVideoWidth, mVideoHeight, mLookaheadFrames);
+        if (mLookahead->initCheck() != OK) {
+            ALOGE("Failed to start the lookahead of %u frames", mLookaheadFrames);
+            delete mLookahead;
+            mLookahead = NULL;
+            PVAVCCleanUpEncoder(mHandle);
+            releaseOutputBuffers();
+            mSignalledError = true;
+            notify(OMX_EventError, OMX_ErrorUndefined, 0, 0);
+            return OMX_ErrorUndefined;
+        }
+    }
+
     mNumInputFrames = -2;  // 1st two buffers contain SPS and PPS
     mSpsPpsHeaderReceived = false;
     mReadyForNextFrame = true;
     mIsIDRFrame = false;
+    mSignalledOutputEOS = false;
     mStarted = true;
 
     return OMX_ErrorNone;
@@ -339,6 +380,9 @@ OMX_ERRORTYPE SoftAVCEncoder::releaseEncoder() {
         return OMX_ErrorNone;
     }
 
+    delete mLookahead;
+    mLookahead = NULL;
+
     PVAVCCleanUpEncoder(mHandle);
     releaseOutputBuffers();
 
@@ -427,7 +471,7 @@ void SoftAVCEncoder::initPorts() {
 
 OMX_ERRORTYPE SoftAVCEncoder::internalGetParameter(
         OMX_INDEXTYPE index, OMX_PTR params) {
-    switch (index) {
+    switch ((int)index) {
         case OMX_IndexParamVideoErrorCorrection:
         {
             return OMX_ErrorNotImplemented;
@@ -532,6 +576,20 @@ OMX_ERRORTYPE SoftAVCEncoder::internalGetParameter(
             return OMX_ErrorNone;
         }
 
+        case kLookaheadExtensionIndex:
+        case kVBVBufferSizeExtensionIndex:
+        {
+            OMX_PARAM_U32TYPE *u32Params = (OMX_PARAM_U32TYPE *)params;
+
+            if (u32Params->nPortIndex != 1) {
+                return OMX_ErrorUndefined;
+            }
+
+            u32Params->nU32 = ((int32_t)index == kLookaheadExtensionIndex)
+                    ? mLookaheadFrames : mVBVBufferSizeMs;
+            return OMX_ErrorNone;
+        }
+
         default:
             return SimpleSoftOMXComponent::internalGetParameter(index, params);
     }
@@ -706,13 +764,85 @@ OMX_ERRORTYPE SoftAVCEncoder::internalSetParameter(
             return OMX_ErrorNone;
         }
 
+        case kLookaheadExtensionIndex:
+        {
+            const OMX_PARAM_U32TYPE *lookaheadParams =
+                (const OMX_PARAM_U32TYPE *)params;
+
+            if (lookaheadParams->nPortIndex != 1) {
+                return OMX_ErrorUndefined;
+            }
+
+            // The lookahead is set up with the encoder.
+            if (mStarted || lookaheadParams->nU32 > AVC_MAX_LOOKAHEAD) {
+                return OMX_ErrorBadParameter;
+            }
+
+            mLookaheadFrames = lookaheadParams->nU32;
+            return OMX_ErrorNone;
+        }
+
+        case kVBVBufferSizeExtensionIndex:
+        {
+            const OMX_PARAM_U32TYPE *vbvParams =
+                (const OMX_PARAM_U32TYPE *)params;
+
+            if (vbvParams->nPortIndex != 1) {
+                return OMX_ErrorUndefined;
+            }
+
+            if (mStarted) {
+                return OMX_ErrorBadParameter;
+            }
+
+            mVBVBufferSizeMs = vbvParams->nU32;
+            return OMX_ErrorNone;
+        }
+
         default:
             return SimpleSoftOMXComponent::internalSetParameter(index, params);
     }
 }
 
+// Combine SPS and PPS and place them in the very first output buffer
+// SPS and PPS are separated by start code 0x00000001
+// Assume that we have exactly one SPS and exactly one PPS.
+void SoftAVCEncoder::encodeCodecConfig(OMX_BUFFERHEADERTYPE *outHeader) {
+    CHECK(!mSpsPpsHeaderReceived);
+
+    // 4 bytes are reserved for holding the start code 0x00000001
+    // of the sequence parameter set at the beginning.
+    uint8_t *outPtr = (uint8_t *) outHeader->pBuffer + 4;
+    uint32_t dataLength = outHeader->nAllocLen - 4;
+    int32_t type;
+
+    while (PVAVCEncodeNAL(mHandle, outPtr, &dataLength, &type) != AVCENC_WRONG_STATE) {
+        switch (type) {
+            case AVC_NALTYPE_SPS:
+                ++mNumInputFrames;
+                memcpy((uint8_t *)outHeader->pBuffer, "\x00\x00\x00\x01", 4);
+                outHeader->nFilledLen = 4 + dataLength;
+                outPtr += (dataLength + 4);  // 4 bytes for next start code
+                dataLength = outHeader->nAllocLen - outHeader->nFilledLen;
+                break;
+            default:
+                CHECK_EQ(AVC_NALTYPE_PPS, type);
+                ++mNumInputFrames;
+                memcpy((uint8_t *) outHeader->pBuffer + outHeader->nFilledLen,
+                        "\x00\x00\x00\x01", 4);
+                outHeader->nFilledLen += (dataLength + 4);
+                outPtr += (dataLength + 4);
+                break;
+        }
+    }
+
+    mSpsPpsHeaderReceived = true;
+    CHECK_EQ(0, mNumInputFrames);  // 1st video frame is 0
+    outHeader->nFlags = OMX_BUFFERFLAG_CODECCONFIG;
+}
+
 void SoftAVCEncoder::onQueueFilled(OMX_U32 portIndex) {
-    if (mSignalledError || mSawInputEOS) {
+    if (mSignalledError || (mSawInputEOS && mLookahead == NULL)) {
         return;
     }
 
@@ -722,6 +852,11 @@ void SoftAVCEncoder::onQueueFilled(OMX_U32 portIndex) {
         }
     }
 
+    if (mLookahead != NULL) {
+        onQueueFilledLookahead();
+        return;
+    }
+
     List<BufferInfo *> &inQueue = getPortQueue(0);
     List<BufferInfo *> &outQueue = getPortQueue(1);
 
@@ -740,48 +875,15 @@ void SoftAVCEncoder::onQueueFilled(OMX_U32 portIndex) {
         uint8_t *outPtr = (uint8_t *) outHeader->pBuffer;
         uint32_t dataLength = outHeader->nAllocLen;
 
-        if (!mSpsPpsHeaderReceived && mNumInputFrames < 0) {
-            // 4 bytes are reserved for holding the start code 0x00000001
-            // of the sequence parameter set at the beginning.
-            outPtr += 4;
-            dataLength -= 4;
-        }
-
         int32_t type;
         AVCEnc_Status encoderStatus = AVCENC_SUCCESS;
 
-        // Combine SPS and PPS and place them in the very first output buffer
-        // SPS and PPS are separated by start code 0x00000001
-        // Assume that we have exactly one SPS and exactly one PPS.
-        while (!mSpsPpsHeaderReceived && mNumInputFrames <= 0) {
-            encoderStatus = PVAVCEncodeNAL(mHandle, outPtr, &dataLength, &type);
-            if (encoderStatus == AVCENC_WRONG_STATE) {
-                mSpsPpsHeaderReceived = true;
-                CHECK_EQ(0, mNumInputFrames);  // 1st video frame is 0
-                outHeader->nFlags = OMX_BUFFERFLAG_CODECCONFIG;
-                outQueue.erase(outQueue.begin());
-                outInfo->mOwnedByUs = false;
-                notifyFillBufferDone(outHeader);
-                return;
-            } else {
-                switch (type) {
-                    case AVC_NALTYPE_SPS:
-                        ++mNumInputFrames;
-                        memcpy((uint8_t *)outHeader->pBuffer, "\x00\x00\x00\x01", 4);
-                        outHeader->nFilledLen = 4 + dataLength;
-                        outPtr += (dataLength + 4);  // 4 bytes for next start code
-                        dataLength = outHeader->nAllocLen - outHeader->nFilledLen;
-                        break;
-                    default:
-                        CHECK_EQ(AVC_NALTYPE_PPS, type);
-                        ++mNumInputFrames;
-                        memcpy((uint8_t *) outHeader->pBuffer + outHeader->nFilledLen,
-                                "\x00\x00\x00\x01", 4);
-                        outHeader->nFilledLen += (dataLength + 4);
-                        outPtr += (dataLength + 4);
-                        break;
-                }
-            }
+        if (!mSpsPpsHeaderReceived) {
+            encodeCodecConfig(outHeader);
+            outQueue.erase(outQueue.begin());
+            outInfo->mOwnedByUs = false;
+            notifyFillBufferDone(outHeader);
+            return;
         }
 
         buffer_handle_t srcBuffer; // for MetaDataMode only
@@ -921,6 +1023,226 @@ void SoftAVCEncoder::onQueueFilled(OMX_U32 portIndex) {
     }
 }
 
+// Copies the frame of the input buffer to the lookahead, converted to planar
+// if needed, so that the buffer can be returned right away.
+bool SoftAVCEncoder::queueLookaheadFrame(OMX_BUFFERHEADERTYPE *inHeader) {
+    buffer_handle_t srcBuffer; // for MetaDataMode only
+    uint8_t *inputData = NULL;
+    if (mStoreMetaDataInBuffers) {
+        if (inHeader->nFilledLen != 8) {
+            ALOGE("MetaData buffer is wrong size! "
+                    "(got %lu bytes, expected 8)", inHeader->nFilledLen);
+            return false;
+        }
+        inputData =
+                extractGrallocData(inHeader->pBuffer + inHeader->nOffset,
+                        &srcBuffer);
+        if (inputData == NULL) {
+            ALOGE("Unable to extract gralloc buffer in metadata mode");
+            return false;
+        }
+    } else {
+        inputData = (uint8_t *)inHeader->pBuffer + inHeader->nOffset;
+    }
+
+    // PV's encoder takes frames with a pitch of the width, which is a
+    // multiple of 16.
+    uint8_t *frameData = mLookahead->inputBuffer();
+    if (mVideoColorFormat != OMX_COLOR_FormatYUV420Planar) {
+        ConvertYUV420SemiPlanarToYUV420Planar(
+            inputData, frameData, mVideoWidth, mVideoHeight);
+    } else {
+        memcpy(frameData, inputData, (mVideoWidth * mVideoHeight * 3) >> 1);
+    }
+    releaseGrallocData(srcBuffer);
+
+    mLookahead->queueFrame(
+            inHeader->nTimeStamp, inHeader->nFlags & ~OMX_BUFFERFLAG_EOS);
+    return true;
+}
+
+// Input buffers are copied to the lookahead and returned at once, a frame is
+// only encoded when the lookahead is full, or once the input ended, together
+// with the estimates of the frames after it.
+void SoftAVCEncoder::onQueueFilledLookahead() {
+    List<BufferInfo *> &inQueue = getPortQueue(0);
+    List<BufferInfo *> &outQueue = getPortQueue(1);
+
+    for (;;) {
+        if (!mSawInputEOS && !inQueue.empty() && !mLookahead->isFull()) {
+            BufferInfo *inInfo = *inQueue.begin();
+            OMX_BUFFERHEADERTYPE *inHeader = inInfo->mHeader;
+
+            if (inHeader->nFlags & OMX_BUFFERFLAG_EOS) {
+                mSawInputEOS = true;
+            }
+            mPrevTimestampUs = inHeader->nTimeStamp;
+
+            if (inHeader->nFilledLen > 0 && !queueLookaheadFrame(inHeader)) {
+                mSignalledError = true;
+                notify(OMX_EventError, OMX_ErrorUndefined, 0, 0);
+                return;
+            }
+
+            inQueue.erase(inQueue.begin());
+            inInfo->mOwnedByUs = false;
+            notifyEmptyBufferDone(inHeader);
+            continue;
+        }
+
+        if (outQueue.empty()) {
+            return;
+        }
+
+        BufferInfo *outInfo = *outQueue.begin();
+        OMX_BUFFERHEADERTYPE *outHeader = outInfo->mHeader;
+
+        outHeader->nTimeStamp = 0;
+        outHeader->nFlags = 0;
+        outHeader->nOffset = 0;
+        outHeader->nFilledLen = 0;
+
+        if (!mSpsPpsHeaderReceived) {
+            encodeCodecConfig(outHeader);
+            outQueue.erase(outQueue.begin());
+            outInfo->mOwnedByUs = false;
+            notifyFillBufferDone(outHeader);
+            continue;
+        }
+
+        if (mLookahead->numFrames() == 0) {
+            if (mSawInputEOS && !mSignalledOutputEOS) {
+                outHeader->nTimeStamp = mPrevTimestampUs;
+                outHeader->nFlags = OMX_BUFFERFLAG_EOS;
+                outQueue.erase(outQueue.begin());
+                outInfo->mOwnedByUs = false;
+                notifyFillBufferDone(outHeader);
+                mSignalledOutputEOS = true;
+            }
+            return;
+        }
+
+        if (!mSawInputEOS && !mLookahead->isFull()) {
+            return;
+        }
+
+        AVCLookaheadInfo info;
+        const AVCEncLookahead::Frame *frame = mLookahead->peekFrame(&info);
+
+        AVCEnc_Status encoderStatus;
+        if (mReadyForNextFrame) {
+            CHECK_EQ(AVCENC_SUCCESS, PVAVCEncSetLookahead(mHandle, &info));
+
+            AVCFrameIO videoInput;
+            memset(&videoInput, 0, sizeof(videoInput));
+            videoInput.height = mVideoHeight;
+            videoInput.pitch = mVideoWidth;
+            videoInput.coding_timestamp = (frame->mTimeUs + 500) / 1000;  // in ms
+            videoInput.YCbCr[0] = frame->mData;
+            videoInput.YCbCr[1] = videoInput.YCbCr[0] + videoInput.height * videoInput.pitch;
+            videoInput.YCbCr[2] = videoInput.YCbCr[1] +
+                ((videoInput.height * videoInput.pitch) >> 2);
+            videoInput.disp_order = mNumInputFrames;
+
+            encoderStatus = PVAVCEncSetInput(mHandle, &videoInput);
+            if (encoderStatus < AVCENC_SUCCESS) {
+                ALOGE("encoderStatus = %d at line %d", encoderStatus, __LINE__);
+                mSignalledError = true;
+                notify(OMX_EventError, OMX_ErrorUndefined, 0, 0);
+                return;
+            } else if (encoderStatus != AVCENC_SUCCESS
+                    && encoderStatus != AVCENC_NEW_IDR) {
+                ALOGV("encoderStatus = %d at line %d", encoderStatus, __LINE__);
+                mLookahead->popFrame();
+                continue;
+            }
+
+            mReadyForNextFrame = false;
+            ++mNumInputFrames;
+            mIsIDRFrame = (encoderStatus == AVCENC_NEW_IDR);
+        }
+
+        uint32_t dataLength = outHeader->nAllocLen;
+        int32_t type;
+        encoderStatus = PVAVCEncodeNAL(
+                mHandle, (uint8_t *) outHeader->pBuffer, &dataLength, &type);
+        if (encoderStatus < AVCENC_SUCCESS) {
+            ALOGE("encoderStatus = %d at line %d", encoderStatus, __LINE__);
+            mSignalledError = true;
+            notify(OMX_EventError, OMX_ErrorUndefined, 0, 0);
+            return;
+        }
+
+        CHECK(NULL == PVAVCEncGetOverrunBuffer(mHandle));
+        outHeader->nTimeStamp = frame->mTimeUs;
+        outHeader->nFlags = frame->mFlags;
+        if (encoderStatus == AVCENC_PICTURE_READY) {
+            if (mIsIDRFrame) {
+                outHeader->nFlags |= OMX_BUFFERFLAG_SYNCFRAME;
+                mIsIDRFrame = false;
+            }
+            AVCFrameIO recon;
+            if (PVAVCEncGetRecon(mHandle, &recon) == AVCENC_SUCCESS) {
+                PVAVCEncReleaseRecon(mHandle, &recon);
+            }
+        } else if (encoderStatus != AVCENC_SUCCESS) {
+            dataLength = 0;
+        }
+
+        if (encoderStatus != AVCENC_SUCCESS) {
+            // Done with the frame, one more slice is to come otherwise.
+            outHeader->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
+            mLookahead->popFrame();
+            mReadyForNextFrame = true;
+        }
+
+        outHeader->nFilledLen = dataLength;
+        outQueue.erase(outQueue.begin());
+        outInfo->mOwnedByUs = false;
+        notifyFillBufferDone(outHeader);
+    }
+}
+
+void SoftAVCEncoder::onPortFlushCompleted(OMX_U32 portIndex) {
+    if (portIndex == 0 && mLookahead != NULL) {
+        // The frames left in the lookahead were flushed along with the
+        // input port. A frame still being encoded points into it, so it is
+        // finished first.
+        drainPendingFrame();
+        mLookahead->flush();
+        mReadyForNextFrame = true;
+    }
+}
+
+// Encodes the remaining slices of the current frame, if any, and drops them.
+void SoftAVCEncoder::drainPendingFrame() {
+    if (mReadyForNextFrame) {
+        return;
+    }
+
+    const uint32_t size = editPortInfo(1)->mDef.nBufferSize;
+    uint8_t *scratch = new uint8_t[size];
+
+    AVCEnc_Status encoderStatus;
+    do {
+        uint32_t dataLength = size;
+        int32_t type;
+        encoderStatus = PVAVCEncodeNAL(mHandle, scratch, &dataLength, &type);
+    } while (encoderStatus == AVCENC_SUCCESS);
+
+    if (encoderStatus == AVCENC_PICTURE_READY) {
+        AVCFrameIO recon;
+        if (PVAVCEncGetRecon(mHandle, &recon) == AVCENC_SUCCESS) {
+            PVAVCEncReleaseRecon(mHandle, &recon);
+        }
+    } else {
+        ALOGW("encoderStatus = %d while draining a flushed frame", encoderStatus);
+    }
+
+    delete[] scratch;
+    mReadyForNextFrame = true;
+}
+
 int32_t SoftAVCEncoder::allocOutputBuffers(
         unsigned int sizeInMbs, unsigned int numBuffers) {
     CHECK(mOutputBuffers.isEmpty());
@@ -956,6 +1278,14 @@ OMX_ERRORTYPE SoftAVCEncoder::getExtensionIndex(
         *(int32_t*)index = kStoreMetaDataExtensionIndex;
         return OMX_ErrorNone;
     }
+    if (!strcmp(name, kLookaheadExtensionName)) {
+        *(int32_t*)index = kLookaheadExtensionIndex;
+        return OMX_ErrorNone;
+    }
+    if (!strcmp(name, kVBVBufferSizeExtensionName)) {
+        *(int32_t*)index = kVBVBufferSizeExtensionIndex;
+        return OMX_ErrorNone;
+    }
     return OMX_ErrorUndefined;
 }
 
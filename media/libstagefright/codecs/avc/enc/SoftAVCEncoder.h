@@ -26,6 +26,7 @@
 
 namespace android {
 
+struct AVCEncLookahead;
 struct MediaBuffer;
 
 struct SoftAVCEncoder : public MediaBufferObserver,
@@ -44,6 +45,7 @@ struct SoftAVCEncoder : public MediaBufferObserver,
             OMX_INDEXTYPE index, const OMX_PTR params);
 
     virtual void onQueueFilled(OMX_U32 portIndex);
+    virtual void onPortFlushCompleted(OMX_U32 portIndex);
 
     // Override SoftOMXComponent methods
 
@@ -68,7 +70,14 @@ private:
     };
 
     enum {
-        kStoreMetaDataExtensionIndex = OMX_IndexVendorStartUnused + 1
+        // Upper limit for the number of motion estimation threads.
+        kMaxMotionSearchThreads = 4,
+    };
+
+    enum {
+        kStoreMetaDataExtensionIndex = OMX_IndexVendorStartUnused + 1,
+        kLookaheadExtensionIndex,
+        kVBVBufferSizeExtensionIndex,
     };
 
     // OMX input buffer's timestamp and flags
@@ -86,6 +95,8 @@ private:
     int32_t  mIDRFrameRefreshIntervalInSec;
     AVCProfile mAVCEncProfile;
     AVCLevel   mAVCEncLevel;
+    uint32_t mLookaheadFrames;      // 0 if frames are encoded as they come
+    uint32_t mVBVBufferSizeMs;      // 0 if the rate control may skip frames
 
     int64_t  mNumInputFrames;
     int64_t  mPrevTimestampUs;
@@ -95,11 +106,13 @@ private:
     bool     mSawInputEOS;
     bool     mSignalledError;
     bool     mIsIDRFrame;
+    bool     mSignalledOutputEOS;
 
     tagAVCHandle          *mHandle;
     tagAVCEncParam        *mEncParams;
     uint8_t               *mInputFrameData;
     uint32_t              *mSliceGroup;
+    AVCEncLookahead       *mLookahead;
     Vector<MediaBuffer *> mOutputBuffers;
     Vector<InputBufferInfo> mInputBufferInfoVec;
 
@@ -109,6 +122,11 @@ private:
     OMX_ERRORTYPE releaseEncoder();
     void releaseOutputBuffers();
 
+    void encodeCodecConfig(OMX_BUFFERHEADERTYPE *outHeader);
+    void onQueueFilledLookahead();
+    bool queueLookaheadFrame(OMX_BUFFERHEADERTYPE *inHeader);
+    void drainPendingFrame();
+
     uint8_t* extractGrallocData(void *data, buffer_handle_t *buffer);
     void releaseGrallocData(buffer_handle_t buffer);
 
@@ -218,10 +218,15 @@ OSCL_EXPORT_REF AVCEnc_Status PVAVCEncInitialize(AVCHandle *avcHandle, AVCEncPar
         return AVCENC_MEMORY_FAIL;
     }
     encvid->functionPointer->SAD_Macroblock = &AVCSAD_Macroblock_C;
+    encvid->functionPointer->SATD_Macroblock = &AVCSAD_Macroblock_C;
     encvid->functionPointer->SAD_MB_HalfPel[0] = NULL;
     encvid->functionPointer->SAD_MB_HalfPel[1] = &AVCSAD_MB_HalfPel_Cxh;
     encvid->functionPointer->SAD_MB_HalfPel[2] = &AVCSAD_MB_HalfPel_Cyh;
     encvid->functionPointer->SAD_MB_HalfPel[3] = &AVCSAD_MB_HalfPel_Cxhyh;
+    if (encParam->scalar_only != AVC_ON)
+    {
+        AVCInitSADFunctions(encvid->functionPointer);
+    }
 
     /* initialize timing control */
     encvid->modTimeRef = 0;     /* ALWAYS ASSUME THAT TIMESTAMP START FROM 0 !!!*/
@@ -307,6 +312,7 @@ OSCL_EXPORT_REF AVCEnc_Status PVAVCEncSetInput(AVCHandle *avcHandle, AVCFrameIO
     /* Also set video->nal_unit_type, sliceHdr->slice_type, video->slice_type */
     if (AVCENC_SUCCESS != RCDetermineFrameNum(encvid, rateCtrl, input->coding_timestamp, &frameNum))
     {
+        rateCtrl->laValid = FALSE; /* the lookahead window was for this frame */
         return AVCENC_SKIPPED_PICTURE; /* not time to encode, thus skipping */
     }
 
@@ -357,6 +363,42 @@ RECALL_INITFRAME:
     return status; // return status, including the AVCENC_FAIL case and all 3 above.
 }
 
+/* ======================================================================== */
+/*  Function : PVAVCEncSetLookahead()                                       */
+/*  Date     : 10/17/2014                                                   */
+/*  Purpose  : To pass the complexity of the next frames to the rate        */
+/*             control, for the frame of the next PVAVCEncSetInput call.    */
+/*  In/out   :                                                              */
+/*  Return   : AVCENC_SUCCESS for success.                                  */
+/*  Modified :                                                              */
+/* ======================================================================== */
+OSCL_EXPORT_REF AVCEnc_Status PVAVCEncSetLookahead(AVCHandle *avcHandle, AVCLookaheadInfo *lookahead)
+{
+    AVCEncObject *encvid = (AVCEncObject*)avcHandle->AVCObject;
+    AVCRateControl *rateCtrl;
+
+    if (encvid == NULL)
+    {
+        return AVCENC_UNINITIALIZED;
+    }
+
+    if (lookahead->num_frames < 1 || lookahead->num_frames > AVC_MAX_LOOKAHEAD)
+    {
+        return AVCENC_FAIL;
+    }
+
+    rateCtrl = encvid->rateCtrl;
+    memcpy(&rateCtrl->lookahead, lookahead, sizeof(AVCLookaheadInfo));
+    rateCtrl->laValid = TRUE;
+
+    if (lookahead->scene_cut[0] == AVC_ON)
+    {
+        rateCtrl->idrRequest = TRUE; /* kept until an IDR frame is coded */
+    }
+
+    return AVCENC_SUCCESS;
+}
+
 /* ======================================================================== */
 /*  Function : PVAVCEncodeNAL()                                             */
 /*  Date     : 4/29/2004                                                    */
@@ -708,9 +750,17 @@ OSCL_EXPORT_REF AVCEnc_Status PVAVCEncUpdateIDRInterval(AVCHandle *avcHandle, in
 
 OSCL_EXPORT_REF AVCEnc_Status PVAVCEncIDRRequest(AVCHandle *avcHandle)
 {
-    OSCL_UNUSED_ARG(avcHandle);
+    AVCEncObject *encvid = (AVCEncObject*)avcHandle->AVCObject;
 
-    return AVCENC_FAIL;
+    if (encvid == NULL)
+    {
+        return AVCENC_UNINITIALIZED;
+    }
+
+    /* the next frame the rate control does not skip is coded as IDR */
+    encvid->rateCtrl->idrRequest = TRUE;
+
+    return AVCENC_SUCCESS;
 }
 
 OSCL_EXPORT_REF AVCEnc_Status PVAVCEncUpdateIMBRefresh(AVCHandle *avcHandle, int numMB)
@@ -86,6 +86,7 @@ typedef enum
 } AVCEnc_Status;
 
 #define MAX_NUM_SLICE_GROUP  8      /* maximum for all the profiles */
+#define AVC_MAX_LOOKAHEAD   16      /* maximum number of frames in a lookahead window */
 
 /**
 This structure contains the encoding parameters.
@@ -158,8 +159,26 @@ typedef struct tagAVCEncParam
 
     AVCFlag use_overrun_buffer;  /* do not throw away the frame if output buffer is not big enough.
                                     copy excess bits to the overrun buffer */
+
+    int me_threads;     /* number of threads for the motion estimation, 0 or 1 for single threaded */
+    AVCFlag scalar_only;    /* use the C SAD kernels even if SIMD ones are available, for testing */
+    AVCFlag vbv_constrained; /* keep every frame within the CPB, raising QP instead of skipping frames */
 } AVCEncParams;
 
+/**
+This structure contains the complexity estimates of the frames ahead of the encoder, for
+the rate control. Entry 0 is the frame passed with the next PVAVCEncSetInput call, the
+others follow in input order. The costs may be in any unit proportional to the SAD of the
+frame residual, as long as the same unit is used for all the frames.
+*/
+typedef struct tagAVCLookaheadInfo
+{
+    int num_frames;     /* number of valid entries, 1 to AVC_MAX_LOOKAHEAD */
+    uint32 intra_cost[AVC_MAX_LOOKAHEAD];   /* cost of the frame coded as an I frame */
+    uint32 inter_cost[AVC_MAX_LOOKAHEAD];   /* cost of the frame coded as a P frame */
+    AVCFlag scene_cut[AVC_MAX_LOOKAHEAD];   /* the frame starts a new scene */
+} AVCLookaheadInfo;
+
 
 /**
 This structure contains current frame encoding statistics for debugging purpose.
@@ -228,6 +247,17 @@ extern "C"
     */
     OSCL_IMPORT_REF AVCEnc_Status PVAVCEncSetInput(AVCHandle *avcHandle, AVCFrameIO *input);
 
+    /**
+    This function gives the rate control the complexity of the next frames. It applies to the
+    next call to PVAVCEncSetInput only, and has to be called before every PVAVCEncSetInput
+    for the rate control to plan over the window. A frame flagged as scene cut is encoded
+    as an IDR frame.
+    \param "avcHandle"  "Handle to the AVC encoder library object."
+    \param "lookahead"  "Pointer to the AVCLookaheadInfo structure."
+    \return "AVCENC_SUCCESS for success, AVCENC_FAIL for an invalid number of frames."
+    */
+    OSCL_IMPORT_REF AVCEnc_Status PVAVCEncSetLookahead(AVCHandle *avcHandle, AVCLookaheadInfo *lookahead);
+
     /**
     This function is called to encode a NAL unit which can be an SPS NAL, a PPS NAL or
     a VCL (video coding layer) NAL which contains one slice of data. It could be a
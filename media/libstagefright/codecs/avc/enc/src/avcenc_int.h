@@ -31,6 +31,8 @@ and necessary type defitionitions and enumerations.
 #include "avcenc_api.h"
 #endif
 
+#include <pthread.h>
+
 typedef float OsclFloat;
 
 /* Definition for the structures below */
@@ -86,6 +88,8 @@ typedef float OsclFloat;
 
 #define DEFAULT_OVERRUN_BUFFER_SIZE 1000
 
+#define MAX_ME_THREADS  8  /* max number of threads for motion estimation, calling thread included */
+
 // associated with the above cost model
 const uint8 COEFF_COST[2][16] =
 {
@@ -316,6 +320,20 @@ typedef struct tagAVCRateControl
     int     VBV_fullness_offset;    /* offset of VBV_fullness, usually is zero, but can be changed in H.263 mode*/
     /* End BX */
 
+    /* lookahead and VBV constrained rate control */
+    uint    vbvConstrained; /* raise QP to keep every frame within the buffer */
+    uint    idrRequest;     /* encode the next frame as IDR */
+    uint    laValid;        /* lookahead holds the window of the current frame */
+    AVCLookaheadInfo lookahead;
+    OsclFloat laCoef[2];    /* bits * Qstep / cost for I and P frames, 0 until known */
+    uint32  laCost;         /* cost of the current frame, 0 if not known */
+    int     laPrevQP;       /* average QP of the previous frame */
+    int     vbvMaxBits;     /* largest size of the current frame that fits in the buffer */
+    int     vbvQP;          /* QP of the next MB in VBV constrained mode */
+    int     vbvCheckBits;   /* MB bits of the current frame at the last check */
+    int     numMBs;         /* number of MBs of the current frame started so far */
+    int     sumMBQP;        /* sum of the QPs of these MBs */
+
 } AVCRateControl;
 
 
@@ -336,9 +354,56 @@ typedef struct tagAVCEncFuncPtr
 
     int (*SAD_MB_HalfPel[4])(uint8*, uint8*, int, void *);
     int (*SAD_Macroblock)(uint8 *ref, uint8 *blk, int dmin_lx, void *extra_info);
+    int (*SATD_Macroblock)(uint8 *ref, uint8 *blk, int dmin_lx, void *extra_info); /* sub-pel search */
 
 } AVCEncFuncPtr;
 
+/**
+This structure contains the scratch memory of the macroblock motion search. Each thread
+taking part in the motion estimation has its own, so that the search of macroblocks of
+different rows can run concurrently. */
+typedef struct tagAVCMEScratch
+{
+    /********* subpel position **************************************/
+    uint32  subpel_pred[SUBPEL_PRED_BLK_SIZE/*<<2*/]; /* all 16 sub-pel positions  */
+    uint8   *hpel_cand[9];      /* pointer to half-pel position */
+    int     best_hpel_pos;          /* best position */
+    uint8   qpel_cand[8][24*16];        /* pointer to quarter-pel position */
+    int     best_qpel_pos;
+    uint8   *bilin_base[9][4];    /* pointer to 4 position at top left of bilinear quarter-pel */
+
+    uint8 currYMB[256];     /* interleaved current macroblock in HTFM order */
+
+    /* statistics of the current pass */
+    int     numIntraSearch;     /* number of MBs to be intra searched */
+    int     totalSAD;           /* sum of the SAD of the MBs, for rate control */
+} AVCMEScratch;
+
+/**
+This structure contains the worker threads of the motion estimation and the state of the
+current pass. The macroblock rows are interleaved across the threads and a macroblock is
+searched only after the row above has finished the macroblocks up to its top-right
+neighbor, so the motion vector candidates are the same as in the raster scan order. */
+typedef struct tagAVCMEThreads
+{
+    int     numThreads;         /* number of threads, calling thread included */
+    pthread_t threads[MAX_ME_THREADS - 1];
+    pthread_mutex_t mutex;
+    pthread_cond_t passCond;    /* a pass was started or shutdown requested */
+    pthread_cond_t doneCond;    /* all the workers finished the pass */
+    pthread_cond_t progressCond;    /* a row made progress */
+    uint    passSeq;            /* incremented for every pass */
+    int     nextIndex;          /* thread index given to the next worker joining the pass */
+    int     numRunning;         /* number of workers still in the pass */
+    bool    shutdown;
+
+    /* current pass */
+    int     startCol;           /* first column of the even rows */
+    int     incrCol;            /* column increment, 2 for the checkerboard passes */
+    int     typePred;           /* type of candidate selection */
+    int     *rowProgress;       /* columns before this are done, for each MB row */
+} AVCMEThreads;
+
 /**
 This structure contains information necessary for correct padding.
 */
@@ -406,13 +471,10 @@ typedef struct tagEncObject
     AVCMV(*mot8x16)[2];     /* Saved motion vectors for 8x16 block*/
     AVCMV(*mot8x8)[4];      /* Saved motion vectors for 8x8 block*/
 
-    /********* subpel position **************************************/
-    uint32  subpel_pred[SUBPEL_PRED_BLK_SIZE/*<<2*/]; /* all 16 sub-pel positions  */
-    uint8   *hpel_cand[9];      /* pointer to half-pel position */
-    int     best_hpel_pos;          /* best position */
-    uint8   qpel_cand[8][24*16];        /* pointer to quarter-pel position */
-    int     best_qpel_pos;
-    uint8   *bilin_base[9][4];    /* pointer to 4 position at top left of bilinear quarter-pel */
+    /********* motion search scratch memory, one per thread ***********/
+    AVCMEScratch *meScratch;
+    AVCMEThreads *meThreads;    /* NULL if the motion estimation is single threaded */
+    int     numMEThreads;       /* requested number of motion estimation threads */
 
     /* need for intra refresh rate */
     uint8   *intraSearch;       /* Intra Array for MBs to be intra searched */
@@ -428,7 +490,6 @@ typedef struct tagEncObject
 
     /* to speedup the SAD calculation */
     void *sad_extra_info;
-    uint8 currYMB[256];     /* interleaved current macroblock in HTFM order */
 
 #ifdef HTFM
     int nrmlz_th[48];       /* Threshold for fast SAD calculation using HTFM */
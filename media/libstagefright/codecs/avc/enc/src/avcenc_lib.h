@@ -526,21 +526,23 @@ extern "C"
     void InitHTFM(VideoEncData *encvid, HTFM_Stat *htfm_stat, double *newvar, int *collect);
     void UpdateHTFM(AVCEncObject *encvid, double *newvar, double *exp_lamda, HTFM_Stat *htfm_stat);
     void CalcThreshold(double pf, double exp_lamda[], int nrmlz_th[]);
-    void    HTFMPrepareCurMB_AVC(AVCEncObject *encvid, HTFM_Stat *htfm_stat, uint8 *cur, int pitch);
+    void    HTFMPrepareCurMB_AVC(AVCEncObject *encvid, HTFM_Stat *htfm_stat, AVCMEScratch *scratch,
+                                 uint8 *cur, int pitch);
 #endif
 
     /**
     This function reads the input MB into a smaller faster memory space to minimize the cache miss.
-    \param "encvid" "Pointer to the global AVCEncObject."
+    \param "scratch" "Pointer to the motion search scratch memory of the thread."
     \param "cur"    "Pointer to the original input macroblock."
     \param "pitch"  "Stride size of the input frame (luma)."
     \return "void"
     */
-    void    AVCPrepareCurMB(AVCEncObject *encvid, uint8 *cur, int pitch);
+    void    AVCPrepareCurMB(AVCMEScratch *scratch, uint8 *cur, int pitch);
 
     /**
     Performs motion vector search for a macroblock.
     \param "encvid" "Pointer to AVCEncObject structure."
+    \param "scratch" "Pointer to the motion search scratch memory of the thread."
     \param "cur"    "Pointer to the current macroblock in the input frame."
     \param "best_cand" "Array of best candidates (to be filled in and returned)."
     \param "i0"     "X-coordinate of the macroblock."
@@ -550,8 +552,9 @@ extern "C"
     \param "hp_guess"   "Guess for half-pel search."
     \return "void"
     */
-    void AVCMBMotionSearch(AVCEncObject *encvid, uint8 *cur, uint8 *best_cand[],
-                           int i0, int j0, int type_pred, int FS_en, int *hp_guess);
+    void AVCMBMotionSearch(AVCEncObject *encvid, AVCMEScratch *scratch, uint8 *cur,
+                           uint8 *best_cand[], int i0, int j0, int type_pred, int FS_en,
+                           int *hp_guess);
 
 //AVCEnc_Status AVCMBMotionSearch(AVCEncObject *encvid, AVCMacroblock *currMB, int mbNum,
 //                           int num_pass);
@@ -609,6 +612,7 @@ extern "C"
     /**
     Search for the best half-pel resolution MV around the full-pel MV.
     \param "encvid" "Pointer to the global AVCEncObject structure."
+    \param "scratch" "Pointer to the motion search scratch memory of the thread."
     \param "cur"    "Pointer to the current macroblock."
     \param "mot"    "Pointer to the AVCMV array of the frame."
     \param "ncand"  "Pointer to the origin of the fullsearch result."
@@ -618,8 +622,8 @@ extern "C"
     \param "cmvx, cmvy" "Predicted motion vector use for mvcost."
     \return "Minimal cost (SATD) without MV cost. (for rate control purpose)"
     */
-    int AVCFindHalfPelMB(AVCEncObject *encvid, uint8 *cur, AVCMV *mot, uint8 *ncand,
-                         int xpos, int ypos, int hp_guess, int cmvx, int cmvy);
+    int AVCFindHalfPelMB(AVCEncObject *encvid, AVCMEScratch *scratch, uint8 *cur, AVCMV *mot,
+                         uint8 *ncand, int xpos, int ypos, int hp_guess, int cmvx, int cmvy);
 
     /**
     This function generates sub-pel pixels required to do subpel MV search.
@@ -650,12 +654,13 @@ extern "C"
 
     /**
     This function calculates the SATD of a subpel candidate.
+    \param "encvid" "Pointer to the global AVCEncObject structure."
     \param "cand"   "Pointer to a candidate."
     \param "cur"    "Pointer to the current block."
     \param "dmin"   "Min-so-far SATD."
     \return "Sum of Absolute Transformed Difference."
     */
-    int SATD_MB(uint8 *cand, uint8 *cur, int dmin);
+    int SATD_MB(AVCEncObject *encvid, uint8 *cand, uint8 *cur, int dmin);
 
     /*------------- rate_control.c -------------------*/
 
@@ -805,6 +810,16 @@ extern "C"
     int AVCSAD_MB_HalfPel_Cxh(uint8 *ref, uint8 *blk, int dmin_lx, void *extra_info);
     int AVCSAD_Macroblock_C(uint8 *ref, uint8 *blk, int dmin_lx, void *extra_info);
 
+    /*------------- sad_simd.c ----------------------*/
+
+    /**
+    This function replaces the C SAD kernels in the function table by the SIMD versions
+    the CPU supports. They give the same results.
+    \param "functionPointer" "Pointer to the function table."
+    \return "void"
+    */
+    void AVCInitSADFunctions(AVCEncFuncPtr *functionPointer);
+
 #ifdef HTFM /*  3/2/1, Hypothesis Testing Fast Matching */
     int AVCSAD_MB_HP_HTFM_Collectxhyh(uint8 *ref, uint8 *blk, int dmin_x, void *extra_info);
     int AVCSAD_MB_HP_HTFM_Collectyh(uint8 *ref, uint8 *blk, int dmin_x, void *extra_info);
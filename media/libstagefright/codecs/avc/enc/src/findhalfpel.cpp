@@ -51,8 +51,8 @@ const static int distance_tab[9][9] =   /* [hp_guess][k] */
     Purpose:    Find half pel resolution MV surrounding the full-pel MV
 =====================================================================*/
 
-int AVCFindHalfPelMB(AVCEncObject *encvid, uint8 *cur, AVCMV *mot, uint8 *ncand,
-                     int xpos, int ypos, int hp_guess, int cmvx, int cmvy)
+int AVCFindHalfPelMB(AVCEncObject *encvid, AVCMEScratch *scratch, uint8 *cur, AVCMV *mot,
+                     uint8 *ncand, int xpos, int ypos, int hp_guess, int cmvx, int cmvy)
 {
     AVCPictureData *currPic = encvid->common->currPic;
     int lx = currPic->pitch;
@@ -62,8 +62,8 @@ int AVCFindHalfPelMB(AVCEncObject *encvid, uint8 *cur, AVCMV *mot, uint8 *ncand,
     uint8 *mvbits = encvid->mvbits;
     int mvcost;
     /* list of candidate to go through for half-pel search*/
-    uint8 *subpel_pred = (uint8*) encvid->subpel_pred; // all 16 sub-pel positions
-    uint8 **hpel_cand = (uint8**) encvid->hpel_cand; /* half-pel position */
+    uint8 *subpel_pred = (uint8*) scratch->subpel_pred; // all 16 sub-pel positions
+    uint8 **hpel_cand = (uint8**) scratch->hpel_cand; /* half-pel position */
 
     int xh[9] = {0, 0, 2, 2, 2, 0, -2, -2, -2};
     int yh[9] = {0, -2, -2, 0, 2, 2, 2, 0, -2};
@@ -77,12 +77,12 @@ int AVCFindHalfPelMB(AVCEncObject *encvid, uint8 *cur, AVCMV *mot, uint8 *ncand,
 
     GenerateHalfPelPred(subpel_pred, ncand, lx);
 
-    cur = encvid->currYMB; // pre-load current original MB
+    cur = scratch->currYMB; // pre-load current original MB
 
     cand = hpel_cand[0];
 
     // find cost for the current full-pel position
-    dmin = SATD_MB(cand, cur, 65535); // get Hadamaard transform SAD
+    dmin = SATD_MB(encvid, cand, cur, 65535); // get Hadamaard transform SAD
     mvcost = MV_COST_S(lambda_motion, mot->x, mot->y, cmvx, cmvy);
     satd_min = dmin;
     dmin += mvcost;
@@ -91,7 +91,7 @@ int AVCFindHalfPelMB(AVCEncObject *encvid, uint8 *cur, AVCMV *mot, uint8 *ncand,
     /* find half-pel */
     for (h = 1; h < 9; h++)
     {
-        d = SATD_MB(hpel_cand[h], cur, dmin);
+        d = SATD_MB(encvid, hpel_cand[h], cur, dmin);
         mvcost = MV_COST_S(lambda_motion, mot->x + xh[h], mot->y + yh[h], cmvx, cmvy);
         d += mvcost;
 
@@ -106,16 +106,16 @@ int AVCFindHalfPelMB(AVCEncObject *encvid, uint8 *cur, AVCMV *mot, uint8 *ncand,
     mot->sad = dmin;
     mot->x += xh[hmin];
     mot->y += yh[hmin];
-    encvid->best_hpel_pos = hmin;
+    scratch->best_hpel_pos = hmin;
 
     /*** search for quarter-pel ****/
-    GenerateQuartPelPred(encvid->bilin_base[hmin], &(encvid->qpel_cand[0][0]), hmin);
+    GenerateQuartPelPred(scratch->bilin_base[hmin], &(scratch->qpel_cand[0][0]), hmin);
 
-    encvid->best_qpel_pos = qmin = -1;
+    scratch->best_qpel_pos = qmin = -1;
 
     for (q = 0; q < 8; q++)
     {
-        d = SATD_MB(encvid->qpel_cand[q], cur, dmin);
+        d = SATD_MB(encvid, scratch->qpel_cand[q], cur, dmin);
         mvcost = MV_COST_S(lambda_motion, mot->x + xq[q], mot->y + yq[q], cmvx, cmvy);
         d += mvcost;
         if (d < dmin)
@@ -131,7 +131,7 @@ int AVCFindHalfPelMB(AVCEncObject *encvid, uint8 *cur, AVCMV *mot, uint8 *ncand,
         mot->sad = dmin;
         mot->x += xq[qmin];
         mot->y += yq[qmin];
-        encvid->best_qpel_pos = qmin;
+        scratch->best_qpel_pos = qmin;
     }
 
     return satd_min;
@@ -605,13 +605,13 @@ void GenerateQuartPelPred(uint8 **bilin_base, uint8 *qpel_cand, int hpel_pos)
 
 
 /* assuming cand always has a pitch of 24 */
-int SATD_MB(uint8 *cand, uint8 *cur, int dmin)
+int SATD_MB(AVCEncObject *encvid, uint8 *cand, uint8 *cur, int dmin)
 {
     int cost;
 
 
     dmin = (dmin << 16) | 24;
-    cost = AVCSAD_Macroblock_C(cand, cur, dmin, NULL);
+    cost = (*encvid->functionPointer->SATD_Macroblock)(cand, cur, dmin, NULL);
 
     return cost;
 }
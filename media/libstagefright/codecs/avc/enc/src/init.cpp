@@ -55,6 +55,16 @@ AVCEnc_Status  SetEncodeParam(AVCHandle* avcHandle, AVCEncParams* encParam,
 
     encvid->fullsearch_enable = encParam->fullsearch;
 
+    encvid->numMEThreads = encParam->me_threads;
+    if (encvid->numMEThreads < 1)
+    {
+        encvid->numMEThreads = 1;
+    }
+    else if (encvid->numMEThreads > MAX_ME_THREADS)
+    {
+        encvid->numMEThreads = MAX_ME_THREADS;
+    }
+
     encvid->outOfBandParamSet = ((encParam->out_of_band_param_set == AVC_ON) ? TRUE : FALSE);
 
     /* parameters derived from the the encParam that are used in SPS */
@@ -519,6 +529,7 @@ AVCEnc_Status  SetEncodeParam(AVCHandle* avcHandle, AVCEncParams* encParam,
     rateCtrl->bitRate = encParam->bitrate;
     rateCtrl->cpbSize = encParam->CPB_size;
     rateCtrl->initDelayOffset = (rateCtrl->bitRate * encParam->init_CBP_removal_delay / 1000);
+    rateCtrl->vbvConstrained = (encParam->vbv_constrained == AVC_ON) ? TRUE : FALSE;
 
     if (encParam->frame_rate == 0)
     {
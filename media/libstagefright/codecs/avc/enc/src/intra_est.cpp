@@ -152,7 +152,7 @@ void MBIntraSearch(AVCEncObject *encvid, int mbnum, uint8 *curL, int picPitch)
         if (video->slice_type == AVC_P_SLICE)
         {
             /* save current inter prediction */
-            saved_inter = encvid->subpel_pred; /* reuse existing buffer */
+            saved_inter = encvid->meScratch->subpel_pred; /* reuse existing buffer */
             j = 16;
             curL -= 4;
             picPitch -= 16;
@@ -186,7 +186,7 @@ void MBIntraSearch(AVCEncObject *encvid, int mbnum, uint8 *curL, int picPitch)
     else if (video->slice_type == AVC_P_SLICE && intra == true)
     {
         /* restore current inter prediction */
-        saved_inter = encvid->subpel_pred; /* reuse existing buffer */
+        saved_inter = encvid->meScratch->subpel_pred; /* reuse existing buffer */
         j = 16;
         curL -= ((picPitch + 16) << 4);
         while (j--)
@@ -64,6 +64,8 @@ uint32 num_cand = 0;
 #define FIXED_SUBMB_MODE    AVC_4x4
 /*************************************************************************/
 
+static void *AVCMotionSearchThread(void *arg);
+
 /* Initialize arrays necessary for motion search */
 AVCEnc_Status InitMotionSearchModule(AVCHandle *avcHandle)
 {
@@ -75,8 +77,12 @@ AVCEnc_Status InitMotionSearchModule(AVCHandle *avcHandle)
     int temp_bits = 0;
     uint8 *mvbits;
     int bits, imax, imin, i;
-    uint8* subpel_pred = (uint8*) encvid->subpel_pred; // all 16 sub-pel positions
+    AVCMEScratch *scratch;
+    AVCMEThreads *threads;
+    uint8* subpel_pred;
 
+    encvid->meScratch = NULL;
+    encvid->meThreads = NULL;
 
     while (number_of_subpel_positions > 0)
     {
@@ -106,65 +112,128 @@ AVCEnc_Status InitMotionSearchModule(AVCHandle *avcHandle)
         for (i = imin; i < imax; i++)   mvbits[-i] = mvbits[i] = bits;
     }
 
-    /* initialize half-pel search */
-    encvid->hpel_cand[0] = subpel_pred + REF_CENTER;
-    encvid->hpel_cand[1] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE + 1 ;
-    encvid->hpel_cand[2] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE + 1;
-    encvid->hpel_cand[3] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE + 25;
-    encvid->hpel_cand[4] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE + 25;
-    encvid->hpel_cand[5] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE + 25;
-    encvid->hpel_cand[6] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE + 24;
-    encvid->hpel_cand[7] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE + 24;
-    encvid->hpel_cand[8] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE;
-
-    /* For quarter-pel interpolation around best half-pel result */
-
-    encvid->bilin_base[0][0] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE;
-    encvid->bilin_base[0][1] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE + 1;
-    encvid->bilin_base[0][2] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE + 24;
-    encvid->bilin_base[0][3] = subpel_pred + REF_CENTER;
-
-
-    encvid->bilin_base[1][0] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE;
-    encvid->bilin_base[1][1] = subpel_pred + REF_CENTER - 24;
-    encvid->bilin_base[1][2] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE;
-    encvid->bilin_base[1][3] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE + 1;
+#ifdef HTFM
+    encvid->numMEThreads = 1; /* the HTFM statistics are collected over the whole frame */
+#endif
+    if (encvid->common->FrameHeightInMbs < 2)
+    {
+        encvid->numMEThreads = 1; /* nothing to run in parallel */
+    }
 
-    encvid->bilin_base[2][0] = subpel_pred + REF_CENTER - 24;
-    encvid->bilin_base[2][1] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE + 1;
-    encvid->bilin_base[2][2] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE + 1;
-    encvid->bilin_base[2][3] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE + 1;
+    encvid->meScratch = (AVCMEScratch*) avcHandle->CBAVC_Malloc(encvid->avcHandle->userData,
+                        sizeof(AVCMEScratch) * encvid->numMEThreads, DEFAULT_ATTR);
 
-    encvid->bilin_base[3][0] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE + 1;
-    encvid->bilin_base[3][1] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE + 1;
-    encvid->bilin_base[3][2] = subpel_pred + REF_CENTER;
-    encvid->bilin_base[3][3] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE + 25;
+    if (encvid->meScratch == NULL)
+    {
+        return AVCENC_MEMORY_FAIL;
+    }
 
-    encvid->bilin_base[4][0] = subpel_pred + REF_CENTER;
-    encvid->bilin_base[4][1] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE + 25;
-    encvid->bilin_base[4][2] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE + 25;
-    encvid->bilin_base[4][3] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE + 25;
+    for (scratch = encvid->meScratch; scratch < encvid->meScratch + encvid->numMEThreads; scratch++)
+    {
+        subpel_pred = (uint8*) scratch->subpel_pred; // all 16 sub-pel positions
+
+        /* initialize half-pel search */
+        scratch->hpel_cand[0] = subpel_pred + REF_CENTER;
+        scratch->hpel_cand[1] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE + 1 ;
+        scratch->hpel_cand[2] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE + 1;
+        scratch->hpel_cand[3] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE + 25;
+        scratch->hpel_cand[4] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE + 25;
+        scratch->hpel_cand[5] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE + 25;
+        scratch->hpel_cand[6] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE + 24;
+        scratch->hpel_cand[7] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE + 24;
+        scratch->hpel_cand[8] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE;
+
+        /* For quarter-pel interpolation around best half-pel result */
+
+        scratch->bilin_base[0][0] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE;
+        scratch->bilin_base[0][1] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE + 1;
+        scratch->bilin_base[0][2] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE + 24;
+        scratch->bilin_base[0][3] = subpel_pred + REF_CENTER;
+
+
+        scratch->bilin_base[1][0] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE;
+        scratch->bilin_base[1][1] = subpel_pred + REF_CENTER - 24;
+        scratch->bilin_base[1][2] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE;
+        scratch->bilin_base[1][3] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE + 1;
+
+        scratch->bilin_base[2][0] = subpel_pred + REF_CENTER - 24;
+        scratch->bilin_base[2][1] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE + 1;
+        scratch->bilin_base[2][2] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE + 1;
+        scratch->bilin_base[2][3] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE + 1;
+
+        scratch->bilin_base[3][0] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE + 1;
+        scratch->bilin_base[3][1] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE + 1;
+        scratch->bilin_base[3][2] = subpel_pred + REF_CENTER;
+        scratch->bilin_base[3][3] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE + 25;
+
+        scratch->bilin_base[4][0] = subpel_pred + REF_CENTER;
+        scratch->bilin_base[4][1] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE + 25;
+        scratch->bilin_base[4][2] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE + 25;
+        scratch->bilin_base[4][3] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE + 25;
+
+        scratch->bilin_base[5][0] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE + 24;
+        scratch->bilin_base[5][1] = subpel_pred + REF_CENTER;
+        scratch->bilin_base[5][2] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE + 24;
+        scratch->bilin_base[5][3] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE + 25;
+
+        scratch->bilin_base[6][0] = subpel_pred + REF_CENTER - 1;
+        scratch->bilin_base[6][1] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE + 24;
+        scratch->bilin_base[6][2] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE + 24;
+        scratch->bilin_base[6][3] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE + 24;
+
+        scratch->bilin_base[7][0] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE;
+        scratch->bilin_base[7][1] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE;
+        scratch->bilin_base[7][2] = subpel_pred + REF_CENTER - 1;
+        scratch->bilin_base[7][3] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE + 24;
+
+        scratch->bilin_base[8][0] = subpel_pred + REF_CENTER - 25;
+        scratch->bilin_base[8][1] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE;
+        scratch->bilin_base[8][2] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE;
+        scratch->bilin_base[8][3] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE;
+    }
 
-    encvid->bilin_base[5][0] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE + 24;
-    encvid->bilin_base[5][1] = subpel_pred + REF_CENTER;
-    encvid->bilin_base[5][2] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE + 24;
-    encvid->bilin_base[5][3] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE + 25;
+    if (encvid->numMEThreads == 1)
+    {
+        return AVCENC_SUCCESS;
+    }
 
-    encvid->bilin_base[6][0] = subpel_pred + REF_CENTER - 1;
-    encvid->bilin_base[6][1] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE + 24;
-    encvid->bilin_base[6][2] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE + 24;
-    encvid->bilin_base[6][3] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE + 24;
+    /* start the worker threads, the motion estimation stays single threaded if this fails */
+    threads = (AVCMEThreads*) avcHandle->CBAVC_Malloc(encvid->avcHandle->userData,
+              sizeof(AVCMEThreads), DEFAULT_ATTR);
+    if (threads == NULL)
+    {
+        return AVCENC_SUCCESS;
+    }
+    memset(threads, 0, sizeof(AVCMEThreads));
 
-    encvid->bilin_base[7][0] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE;
-    encvid->bilin_base[7][1] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE;
-    encvid->bilin_base[7][2] = subpel_pred + REF_CENTER - 1;
-    encvid->bilin_base[7][3] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE + 24;
+    threads->rowProgress = (int*) avcHandle->CBAVC_Malloc(encvid->avcHandle->userData,
+                           sizeof(int) * encvid->common->FrameHeightInMbs, DEFAULT_ATTR);
+    if (threads->rowProgress == NULL)
+    {
+        avcHandle->CBAVC_Free(avcHandle->userData, threads);
+        return AVCENC_SUCCESS;
+    }
 
-    encvid->bilin_base[8][0] = subpel_pred + REF_CENTER - 25;
-    encvid->bilin_base[8][1] = subpel_pred + V0Q_H2Q * SUBPEL_PRED_BLK_SIZE;
-    encvid->bilin_base[8][2] = subpel_pred + V2Q_H0Q * SUBPEL_PRED_BLK_SIZE;
-    encvid->bilin_base[8][3] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE;
+    if (pthread_mutex_init(&threads->mutex, NULL) ||
+            pthread_cond_init(&threads->passCond, NULL) ||
+            pthread_cond_init(&threads->doneCond, NULL) ||
+            pthread_cond_init(&threads->progressCond, NULL))
+    {
+        avcHandle->CBAVC_Free(avcHandle->userData, threads->rowProgress);
+        avcHandle->CBAVC_Free(avcHandle->userData, threads);
+        return AVCENC_SUCCESS;
+    }
 
+    encvid->meThreads = threads;
+    threads->numThreads = 1;
+    for (i = 0; i < encvid->numMEThreads - 1; i++)
+    {
+        if (pthread_create(&threads->threads[i], NULL, AVCMotionSearchThread, encvid))
+        {
+            break;
+        }
+        threads->numThreads++;
+    }
 
     return AVCENC_SUCCESS;
 }
@@ -173,6 +242,36 @@ AVCEnc_Status InitMotionSearchModule(AVCHandle *avcHandle)
 void CleanMotionSearchModule(AVCHandle *avcHandle)
 {
     AVCEncObject *encvid = (AVCEncObject*) avcHandle->AVCObject;
+    AVCMEThreads *threads = encvid->meThreads;
+    int i;
+
+    if (threads)
+    {
+        pthread_mutex_lock(&threads->mutex);
+        threads->shutdown = true;
+        pthread_cond_broadcast(&threads->passCond);
+        pthread_mutex_unlock(&threads->mutex);
+
+        for (i = 0; i < threads->numThreads - 1; i++)
+        {
+            pthread_join(threads->threads[i], NULL);
+        }
+
+        pthread_cond_destroy(&threads->progressCond);
+        pthread_cond_destroy(&threads->doneCond);
+        pthread_cond_destroy(&threads->passCond);
+        pthread_mutex_destroy(&threads->mutex);
+
+        avcHandle->CBAVC_Free(avcHandle->userData, threads->rowProgress);
+        avcHandle->CBAVC_Free(avcHandle->userData, threads);
+        encvid->meThreads = NULL;
+    }
+
+    if (encvid->meScratch)
+    {
+        avcHandle->CBAVC_Free(avcHandle->userData, encvid->meScratch);
+        encvid->meScratch = NULL;
+    }
 
     if (encvid->mvbits_array)
     {
@@ -232,45 +331,298 @@ bool IntraDecisionABE(int *min_cost, uint8 *cur, int pitch, bool ave)
     return intra;
 }
 
-/******* main function for macroblock prediction for the entire frame ***/
-/* if turns out to be IDR frame, set video->nal_unit_type to AVC_NALTYPE_IDR */
-void AVCMotionEstimation(AVCEncObject *encvid)
+/*=====================================================================
+    Function:   AVCMotionSearchRow
+    Date:       2014
+    Purpose:    Motion search of the macroblocks of row j, from column start_i
+                every incr_i columns. With the worker threads, a macroblock is
+                searched only after the row above is done up to its top-right
+                neighbor, whose motion vector is one of the candidates.
+=====================================================================*/
+
+static void AVCMotionSearchRow(AVCEncObject *encvid, AVCMEScratch *scratch, int j,
+                               int start_i, int incr_i, int type_pred)
 {
     AVCCommonObj *video = encvid->common;
-    int slice_type = video->slice_type;
+    AVCMEThreads *threads = encvid->meThreads;
     AVCFrameIO *currInput = encvid->currInput;
-    AVCPictureData *refPic = video->RefPicList0[0];
-    int i, j, k;
+    int i, k;
     int mbwidth = video->PicWidthInMbs;
     int mbheight = video->PicHeightInMbs;
-    int totalMB = video->PicSizeInMbs;
     int pitch = currInput->pitch;
     AVCMacroblock *currMB, *mblock = video->mblock;
     AVCMV *mot_mb_16x16, *mot16x16 = encvid->mot16x16;
-    // AVCMV *mot_mb_16x8, *mot_mb_8x16, *mot_mb_8x8, etc;
     AVCRateControl *rateCtrl = encvid->rateCtrl;
     uint8 *intraSearch = encvid->intraSearch;
     uint FS_en = encvid->fullsearch_enable;
+    int mbnum, offset, last, above;
+    uint8 *cur, *best_cand[5];
+    int abe_cost;
+    int hp_guess = 0;
+    uint32 mv_uint32;
+
+    offset = pitch * (j << 4) + (start_i << 4);
+
+    mbnum = j * mbwidth + start_i;
+
+    i = start_i;
+    last = mbwidth;
+    do
+    {
+        if (threads && j > 0)
+        {
+            /* wait for the top-right neighbor, or the top one for the last column */
+            pthread_mutex_lock(&threads->mutex);
+            while ((above = threads->rowProgress[j - 1]) < AVC_MIN(i + 2, mbwidth))
+            {
+                pthread_cond_wait(&threads->progressCond, &threads->mutex);
+            }
+            pthread_mutex_unlock(&threads->mutex);
+            last = (above == mbwidth) ? mbwidth : above - 1;
+        }
+
+        for (; i < last; i += incr_i)
+        {
+            currMB = mblock + mbnum;
+            mot_mb_16x16 = mot16x16 + mbnum;
+
+            cur = currInput->YCbCr[0] + offset;
+
+            if (currMB->mb_intra == 0) /* for INTER mode */
+            {
+#if defined(HTFM)
+                HTFMPrepareCurMB_AVC(encvid, &encvid->htfm_stat, scratch, cur, pitch);
+#else
+                AVCPrepareCurMB(scratch, cur, pitch);
+#endif
+                /************************************************************/
+                /******** full-pel 1MV search **********************/
+
+                AVCMBMotionSearch(encvid, scratch, cur, best_cand, i << 4, j << 4, type_pred,
+                                  FS_en, &hp_guess);
+
+                abe_cost = encvid->min_cost[mbnum] = mot_mb_16x16->sad;
+
+                /* set mbMode and MVs */
+                currMB->mbMode = AVC_P16;
+                currMB->MBPartPredMode[0][0] = AVC_Pred_L0;
+                mv_uint32 = ((mot_mb_16x16->y) << 16) | ((mot_mb_16x16->x) & 0xffff);
+                for (k = 0; k < 32; k += 2)
+                {
+                    currMB->mvL0[k>>1] = mv_uint32;
+                }
+
+                /* make a decision whether it should be tested for intra or not */
+                if (i != mbwidth - 1 && j != mbheight - 1 && i != 0 && j != 0)
+                {
+                    if (false == IntraDecisionABE(&abe_cost, cur, pitch, true))
+                    {
+                        intraSearch[mbnum] = 0;
+                    }
+                    else
+                    {
+                        scratch->numIntraSearch++;
+                        rateCtrl->MADofMB[mbnum] = abe_cost;
+                    }
+                }
+                else // boundary MBs, always do intra search
+                {
+                    scratch->numIntraSearch++;
+                }
+
+                scratch->totalSAD += (int) rateCtrl->MADofMB[mbnum];//mot_mb_16x16->sad;
+            }
+            else    /* INTRA update, use for prediction */
+            {
+                mot_mb_16x16[0].x = mot_mb_16x16[0].y = 0;
+
+                /* reset all other MVs to zero */
+                /* mot_mb_16x8, mot_mb_8x16, mot_mb_8x8, etc. */
+                abe_cost = encvid->min_cost[mbnum] = 0x7FFFFFFF;  /* max value for int */
+
+                if (i != mbwidth - 1 && j != mbheight - 1 && i != 0 && j != 0)
+                {
+                    IntraDecisionABE(&abe_cost, cur, pitch, false);
+
+                    rateCtrl->MADofMB[mbnum] = abe_cost;
+                    scratch->totalSAD += abe_cost;
+                }
+
+                scratch->numIntraSearch++ ;
+                /* cannot do I16 prediction here because it needs full decoding. */
+                // intraSearch[mbnum] = 1;
+
+            }
+
+            mbnum += incr_i;
+            offset += (incr_i << 4);
+
+        } /* for i */
+
+        if (threads)
+        {
+            pthread_mutex_lock(&threads->mutex);
+            threads->rowProgress[j] = last;
+            pthread_cond_broadcast(&threads->progressCond);
+            pthread_mutex_unlock(&threads->mutex);
+        }
+    }
+    while (last < mbwidth);
+
+    return ;
+}
+
+/*=====================================================================
+    Function:   AVCMotionSearchRows
+    Date:       2014
+    Purpose:    Motion search of the rows index, index + numThreads, ...
+                of the current pass.
+=====================================================================*/
+
+static void AVCMotionSearchRows(AVCEncObject *encvid, int index, int numThreads,
+                                int start_i, int incr_i, int type_pred)
+{
+    int mbheight = encvid->common->PicHeightInMbs;
+    int j;
+
+    for (j = index; j < mbheight; j += numThreads)
+    {
+        /* alternate the first column for the checkerboard passes */
+        AVCMotionSearchRow(encvid, encvid->meScratch + index, j,
+                           (incr_i > 1) ? ((start_i + j) & 1) : 0, incr_i, type_pred);
+    }
+
+    return ;
+}
+
+/*=====================================================================
+    Function:   AVCMotionSearchPass
+    Date:       2014
+    Purpose:    Motion search of one pass over the frame, on all the threads.
+                The statistics of the pass are added to numIntraSearch and
+                totalSAD.
+=====================================================================*/
+
+static void AVCMotionSearchPass(AVCEncObject *encvid, int start_i, int incr_i, int type_pred,
+                                int *numIntraSearch, int *totalSAD)
+{
+    AVCMEThreads *threads = encvid->meThreads;
+    int numThreads = threads ? threads->numThreads : 1;
+    int k;
+
+    for (k = 0; k < numThreads; k++)
+    {
+        encvid->meScratch[k].numIntraSearch = 0;
+        encvid->meScratch[k].totalSAD = 0;
+    }
+
+    if (threads == NULL)
+    {
+        AVCMotionSearchRows(encvid, 0, 1, start_i, incr_i, type_pred);
+    }
+    else
+    {
+        pthread_mutex_lock(&threads->mutex);
+        memset(threads->rowProgress, 0, sizeof(int) * encvid->common->PicHeightInMbs);
+        threads->startCol = start_i;
+        threads->incrCol = incr_i;
+        threads->typePred = type_pred;
+        threads->nextIndex = 1;
+        threads->numRunning = numThreads - 1;
+        threads->passSeq++;
+        pthread_cond_broadcast(&threads->passCond);
+        pthread_mutex_unlock(&threads->mutex);
+
+        AVCMotionSearchRows(encvid, 0, numThreads, start_i, incr_i, type_pred);
+
+        pthread_mutex_lock(&threads->mutex);
+        while (threads->numRunning)
+        {
+            pthread_cond_wait(&threads->doneCond, &threads->mutex);
+        }
+        pthread_mutex_unlock(&threads->mutex);
+    }
+
+    for (k = 0; k < numThreads; k++)
+    {
+        *numIntraSearch += encvid->meScratch[k].numIntraSearch;
+        *totalSAD += encvid->meScratch[k].totalSAD;
+    }
+
+    return ;
+}
+
+/*=====================================================================
+    Function:   AVCMotionSearchThread
+    Date:       2014
+    Purpose:    Main loop of a motion estimation worker thread.
+=====================================================================*/
+
+static void *AVCMotionSearchThread(void *arg)
+{
+    AVCEncObject *encvid = (AVCEncObject*) arg;
+    AVCMEThreads *threads = encvid->meThreads;
+    uint passSeq = 0;
+    int index;
+
+    pthread_mutex_lock(&threads->mutex);
+
+    for (;;)
+    {
+        while (!threads->shutdown && threads->passSeq == passSeq)
+        {
+            pthread_cond_wait(&threads->passCond, &threads->mutex);
+        }
+
+        if (threads->shutdown)
+        {
+            break;
+        }
+
+        passSeq = threads->passSeq;
+        index = threads->nextIndex++;
+        pthread_mutex_unlock(&threads->mutex);
+
+        AVCMotionSearchRows(encvid, index, threads->numThreads, threads->startCol,
+                            threads->incrCol, threads->typePred);
+
+        pthread_mutex_lock(&threads->mutex);
+        if (--threads->numRunning == 0)
+        {
+            pthread_cond_signal(&threads->doneCond);
+        }
+    }
+
+    pthread_mutex_unlock(&threads->mutex);
+
+    return NULL;
+}
+
+/******* main function for macroblock prediction for the entire frame ***/
+/* if turns out to be IDR frame, set video->nal_unit_type to AVC_NALTYPE_IDR */
+void AVCMotionEstimation(AVCEncObject *encvid)
+{
+    AVCCommonObj *video = encvid->common;
+    int slice_type = video->slice_type;
+    AVCPictureData *refPic = video->RefPicList0[0];
+    int i;
+    int totalMB = video->PicSizeInMbs;
+    AVCMacroblock *mblock = video->mblock;
+    // AVCMV *mot_mb_16x8, *mot_mb_8x16, *mot_mb_8x8, etc;
+    AVCRateControl *rateCtrl = encvid->rateCtrl;
+    uint8 *intraSearch = encvid->intraSearch;
 
     int NumIntraSearch, start_i, numLoop, incr_i;
-    int mbnum, offset;
-    uint8 *cur, *best_cand[5];
     int totalSAD = 0;   /* average SAD for rate control */
     int type_pred;
-    int abe_cost;
 
 #ifdef HTFM
     /***** HYPOTHESIS TESTING ********/  /* 2/28/01 */
     int collect = 0;
-    HTFM_Stat htfm_stat;
     double newvar[16];
     double exp_lamda[15];
     /*********************************/
 #endif
-    int hp_guess = 0;
-    uint32 mv_uint32;
-
-    offset = 0;
 
     if (slice_type == AVC_I_SLICE)
     {
@@ -309,7 +661,7 @@ void AVCMotionEstimation(AVCEncObject *encvid)
     encvid->sad_extra_info = NULL;
 #ifdef HTFM
     /***** HYPOTHESIS TESTING ********/
-    InitHTFM(video, &htfm_stat, newvar, &collect);
+    InitHTFM(video, &encvid->htfm_stat, newvar, &collect);
     /*********************************/
 #endif
 
@@ -319,7 +671,7 @@ void AVCMotionEstimation(AVCEncObject *encvid)
     {
         incr_i = 2;
         numLoop = 2;
-        start_i = 1;
+        start_i = 0;    /* first column of row 0 */
         type_pred = 0; /* for initial candidate selection */
     }
     else
@@ -336,94 +688,7 @@ void AVCMotionEstimation(AVCEncObject *encvid)
     NumIntraSearch = 0; // to be intra searched in the encoding loop.
     while (numLoop--)
     {
-        for (j = 0; j < mbheight; j++)
-        {
-            if (incr_i > 1)
-                start_i = (start_i == 0 ? 1 : 0) ; /* toggle 0 and 1 */
-
-            offset = pitch * (j << 4) + (start_i << 4);
-
-            mbnum = j * mbwidth + start_i;
-
-            for (i = start_i; i < mbwidth; i += incr_i)
-            {
-                video->mbNum = mbnum;
-                video->currMB = currMB = mblock + mbnum;
-                mot_mb_16x16 = mot16x16 + mbnum;
-
-                cur = currInput->YCbCr[0] + offset;
-
-                if (currMB->mb_intra == 0) /* for INTER mode */
-                {
-#if defined(HTFM)
-                    HTFMPrepareCurMB_AVC(encvid, &htfm_stat, cur, pitch);
-#else
-                    AVCPrepareCurMB(encvid, cur, pitch);
-#endif
-                    /************************************************************/
-                    /******** full-pel 1MV search **********************/
-
-                    AVCMBMotionSearch(encvid, cur, best_cand, i << 4, j << 4, type_pred,
-                                      FS_en, &hp_guess);
-
-                    abe_cost = encvid->min_cost[mbnum] = mot_mb_16x16->sad;
-
-                    /* set mbMode and MVs */
-                    currMB->mbMode = AVC_P16;
-                    currMB->MBPartPredMode[0][0] = AVC_Pred_L0;
-                    mv_uint32 = ((mot_mb_16x16->y) << 16) | ((mot_mb_16x16->x) & 0xffff);
-                    for (k = 0; k < 32; k += 2)
-                    {
-                        currMB->mvL0[k>>1] = mv_uint32;
-                    }
-
-                    /* make a decision whether it should be tested for intra or not */
-                    if (i != mbwidth - 1 && j != mbheight - 1 && i != 0 && j != 0)
-                    {
-                        if (false == IntraDecisionABE(&abe_cost, cur, pitch, true))
-                        {
-                            intraSearch[mbnum] = 0;
-                        }
-                        else
-                        {
-                            NumIntraSearch++;
-                            rateCtrl->MADofMB[mbnum] = abe_cost;
-                        }
-                    }
-                    else // boundary MBs, always do intra search
-                    {
-                        NumIntraSearch++;
-                    }
-
-                    totalSAD += (int) rateCtrl->MADofMB[mbnum];//mot_mb_16x16->sad;
-                }
-                else    /* INTRA update, use for prediction */
-                {
-                    mot_mb_16x16[0].x = mot_mb_16x16[0].y = 0;
-
-                    /* reset all other MVs to zero */
-                    /* mot_mb_16x8, mot_mb_8x16, mot_mb_8x8, etc. */
-                    abe_cost = encvid->min_cost[mbnum] = 0x7FFFFFFF;  /* max value for int */
-
-                    if (i != mbwidth - 1 && j != mbheight - 1 && i != 0 && j != 0)
-                    {
-                        IntraDecisionABE(&abe_cost, cur, pitch, false);
-
-                        rateCtrl->MADofMB[mbnum] = abe_cost;
-                        totalSAD += abe_cost;
-                    }
-
-                    NumIntraSearch++ ;
-                    /* cannot do I16 prediction here because it needs full decoding. */
-                    // intraSearch[mbnum] = 1;
-
-                }
-
-                mbnum += incr_i;
-                offset += (incr_i << 4);
-
-            } /* for i */
-        } /* for j */
+        AVCMotionSearchPass(encvid, start_i, incr_i, type_pred, &NumIntraSearch, &totalSAD);
 
         /* since we cannot do intra/inter decision here, the SCD has to be
         based on other criteria such as motion vectors coherency or the SAD */
@@ -453,7 +718,7 @@ void AVCMotionEstimation(AVCEncObject *encvid)
             }
         }
         /******** no scene change, continue motion search **********************/
-        start_i = 0;
+        start_i = 1;    /* the other half of the checkerboard */
         type_pred++; /* second pass */
     }
 
@@ -464,7 +729,7 @@ void AVCMotionEstimation(AVCEncObject *encvid)
     if (collect)
     {
         collect = 0;
-        UpdateHTFM(encvid, newvar, exp_lamda, &htfm_stat);
+        UpdateHTFM(encvid, newvar, exp_lamda, &encvid->htfm_stat);
     }
     /*********************************/
 #endif
@@ -739,10 +1004,11 @@ void CalcThreshold(double pf, double exp_lamda[], int nrmlz_th[])
     return ;
 }
 
-void    HTFMPrepareCurMB_AVC(AVCEncObject *encvid, HTFM_Stat *htfm_stat, uint8 *cur, int pitch)
+void    HTFMPrepareCurMB_AVC(AVCEncObject *encvid, HTFM_Stat *htfm_stat, AVCMEScratch *scratch,
+                             uint8 *cur, int pitch)
 {
     AVCCommonObj *video = encvid->common;
-    uint32 *htfmMB = (uint32*)(encvid->currYMB);
+    uint32 *htfmMB = (uint32*)(scratch->currYMB);
     uint8 *ptr, byte;
     int *offset;
     int i;
@@ -803,9 +1069,9 @@ void    HTFMPrepareCurMB_AVC(AVCEncObject *encvid, HTFM_Stat *htfm_stat, uint8 *
 
 #endif // HTFM
 
-void    AVCPrepareCurMB(AVCEncObject *encvid, uint8 *cur, int pitch)
+void    AVCPrepareCurMB(AVCMEScratch *scratch, uint8 *cur, int pitch)
 {
-    void* tmp = (void*)(encvid->currYMB);
+    void* tmp = (void*)(scratch->currYMB);
     uint32 *currYMB = (uint32*) tmp;
     int i;
 
@@ -952,17 +1218,18 @@ AVCEnc_Status AVCMBMotionSearch(AVCEncObject *encvid, AVCMacroblock *currMB, int
   partition. At each level, a decision can be made to stop the search if the expected
   prediction gain is not worth the computation. The decision can also be made at the finest
   level for more fullsearch-like behavior with the price of heavier computation. */
-void AVCMBMotionSearch(AVCEncObject *encvid, uint8 *cur, uint8 *best_cand[],
-                       int i0, int j0, int type_pred, int FS_en, int *hp_guess)
+void AVCMBMotionSearch(AVCEncObject *encvid, AVCMEScratch *scratch, uint8 *cur,
+                       uint8 *best_cand[], int i0, int j0, int type_pred, int FS_en,
+                       int *hp_guess)
 {
     AVCCommonObj *video = encvid->common;
     AVCPictureData *currPic = video->currPic;
     AVCSeqParamSet *currSPS = video->currSeqParams;
     AVCRateControl *rateCtrl = encvid->rateCtrl;
-    AVCMacroblock *currMB = video->currMB;
+    int mbnum = (j0 >> 4) * video->PicWidthInMbs + (i0 >> 4);
+    AVCMacroblock *currMB = video->mblock + mbnum;
     uint8 *ref, *cand, *ncand;
     void *extra_info = encvid->sad_extra_info;
-    int mbnum = video->mbNum;
     int width = currPic->width; /* 6/12/01, must be multiple of 16 */
     int height = currPic->height;
     AVCMV *mot16x16 = encvid->mot16x16;
@@ -1003,7 +1270,7 @@ void AVCMBMotionSearch(AVCEncObject *encvid, uint8 *cur, uint8 *best_cand[],
     currMB->RefIdx[0] = currMB->RefIdx[1] =
                             currMB->RefIdx[2] = currMB->RefIdx[3] = video->RefPicList0[DEFAULT_REF_IDX]->RefIdx;
 
-    cur = encvid->currYMB; /* use smaller memory space for current MB */
+    cur = scratch->currYMB; /* use smaller memory space for current MB */
 
     /*  find limit of the search (adjusting search range)*/
     lev_idx = mapLev2Idx[currSPS->level_idc];
@@ -1212,18 +1479,18 @@ void AVCMBMotionSearch(AVCEncObject *encvid, uint8 *cur, uint8 *best_cand[],
     if (rateCtrl->subPelEnable) // always enable half-pel search
     {
         /* find half-pel resolution motion vector */
-        min_sad = AVCFindHalfPelMB(encvid, cur, mot16x16 + mbnum, best_cand[0], i0, j0, *hp_guess, cmvx, cmvy);
+        min_sad = AVCFindHalfPelMB(encvid, scratch, cur, mot16x16 + mbnum, best_cand[0], i0, j0, *hp_guess, cmvx, cmvy);
 
         encvid->rateCtrl->MADofMB[mbnum] = min_sad / 256.0;
 
 
-        if (encvid->best_qpel_pos == -1)
+        if (scratch->best_qpel_pos == -1)
         {
-            ncand = encvid->hpel_cand[encvid->best_hpel_pos];
+            ncand = scratch->hpel_cand[scratch->best_hpel_pos];
         }
         else
         {
-            ncand = encvid->qpel_cand[encvid->best_qpel_pos];
+            ncand = scratch->qpel_cand[scratch->best_qpel_pos];
         }
     }
     else
@@ -1268,6 +1535,7 @@ int AVCFullSearch(AVCEncObject *encvid, uint8 *prev, uint8 *cur,
     int d, dmin;
     int i0 = *imin; /* current position */
     int j0 = *jmin;
+    int mbnum;
     int (*SAD_Macroblock)(uint8*, uint8*, int, void*) = encvid->functionPointer->SAD_Macroblock;
     void *extra_info = encvid->sad_extra_info;
     int lx = currPic->pitch; /* with padding */
@@ -1337,7 +1605,8 @@ int AVCFullSearch(AVCEncObject *encvid, uint8 *prev, uint8 *cur,
         }
     }
 
-    encvid->rateCtrl->MADofMB[encvid->common->mbNum] = (min_sad / 256.0); // for rate control
+    mbnum = (j0 >> 4) * encvid->common->PicWidthInMbs + (i0 >> 4);
+    encvid->rateCtrl->MADofMB[mbnum] = (min_sad / 256.0); // for rate control
 
     return dmin;
 }
@@ -1359,8 +1628,8 @@ void AVCCandidateSelection(int *mvx, int *mvy, int *num_can, int imb, int jmb,
     AVCCommonObj *video = encvid->common;
     AVCMV *mot16x16 = encvid->mot16x16;
     AVCMV *pmot;
-    int mbnum = video->mbNum;
     int mbwidth = video->PicWidthInMbs;
+    int mbnum = jmb * mbwidth + imb;
     int mbheight = video->PicHeightInMbs;
     int i, j, same, num1;
 
@@ -42,6 +42,10 @@ void AVCSaveRDSamples(MultiPass *pMP, int counter_samples);
 
 void updateRateControl(AVCRateControl *rateControl, int nal_type);
 
+void RCLookaheadQP(AVCCommonObj *video, AVCRateControl *rateCtrl);
+
+void RCCheckVBV(AVCCommonObj *video, AVCRateControl *rateCtrl);
+
 int GetAvgFrameQP(AVCRateControl *rateCtrl)
 {
     return rateCtrl->Qc;
@@ -69,6 +73,7 @@ AVCEnc_Status RCDetermineFrameNum(AVCEncObject *encvid, AVCRateControl *rateCtrl
         encvid->prevProcFrameNum = 0;
 
         *frameNum = 0;
+        rateCtrl->idrRequest = FALSE;
 
         /* set frame type to IDR-frame */
         video->nal_unit_type = AVC_NALTYPE_IDR;
@@ -105,10 +110,17 @@ AVCEnc_Status RCDetermineFrameNum(AVCEncObject *encvid, AVCRateControl *rateCtrl
         *frameNum = currFrameNum;
 
         /* This part would be similar to DetermineVopType of m4venc */
-        if ((*frameNum >= (uint)rateCtrl->idrPeriod && rateCtrl->idrPeriod > 0) || (*frameNum > video->MaxFrameNum)) /* first frame or IDR*/
+        if (rateCtrl->idrRequest ||
+                (*frameNum >= (uint)rateCtrl->idrPeriod && rateCtrl->idrPeriod > 0) || (*frameNum > video->MaxFrameNum)) /* first frame or IDR*/
         {
             /* set frame type to IDR-frame */
-            if (rateCtrl->idrPeriod)
+            if (rateCtrl->idrRequest) /* restart the IDR period at this frame */
+            {
+                encvid->modTimeRef += (uint32)(currFrameNum * 1000 / rateCtrl->frame_rate);
+                *frameNum = 0;
+                rateCtrl->idrRequest = FALSE;
+            }
+            else if (rateCtrl->idrPeriod)
             {
                 encvid->modTimeRef += (uint32)(rateCtrl->idrPeriod * 1000 / rateCtrl->frame_rate);
                 *frameNum -= rateCtrl->idrPeriod;
@@ -175,6 +187,17 @@ AVCEnc_Status InitRateControlModule(AVCHandle *avcHandle)
 
     rateCtrl->basicUnit = video->PicSizeInMbs;
 
+    rateCtrl->idrRequest = FALSE;
+    rateCtrl->laValid = FALSE;
+    rateCtrl->laCoef[0] = rateCtrl->laCoef[1] = 0;
+    rateCtrl->laCost = 0;
+    rateCtrl->numMBs = 0;
+    rateCtrl->sumMBQP = 0;
+    if (rateCtrl->rcEnable == FALSE)
+    {
+        rateCtrl->vbvConstrained = FALSE; /* there is no buffer model without rate control */
+    }
+
     rateCtrl->MADofMB = (double*) avcHandle->CBAVC_Malloc(encvid->avcHandle->userData,
                         video->PicSizeInMbs * sizeof(double), DEFAULT_ATTR);
 
@@ -278,6 +301,7 @@ AVCEnc_Status InitRateControlModule(AVCHandle *avcHandle)
         }
 
         rateCtrl->Qc = rateCtrl->initQP;
+        rateCtrl->laPrevQP = rateCtrl->initQP;
     }
 
     return AVCENC_SUCCESS;
@@ -350,6 +374,19 @@ void RCInitFrameQP(AVCEncObject *encvid)
             video->QPy = rateCtrl->Qc;
         }
 
+        /* the lookahead overrides the QP, the BX rate control above still does the bookkeeping */
+        rateCtrl->laCost = 0;
+        if (rateCtrl->laValid)
+        {
+            RCLookaheadQP(video, rateCtrl);
+            video->QPy = rateCtrl->Qc;
+        }
+
+        /* largest frame that does not overflow the buffer, see updateRateControl */
+        rateCtrl->vbvMaxBits = rateCtrl->Bs / 2 - rateCtrl->VBV_fullness + rateCtrl->bitsPerFrame;
+        rateCtrl->vbvQP = video->QPy;
+        rateCtrl->vbvCheckBits = 0;
+
         rateCtrl->NumberofHeaderBits = 0;
         rateCtrl->NumberofTextureBits = 0;
         rateCtrl->numFrameBits = 0; // reset
@@ -387,6 +424,9 @@ void RCInitFrameQP(AVCEncObject *encvid)
         video->QPy = rateCtrl->initQP;
     }
 
+    rateCtrl->numMBs = 0;
+    rateCtrl->sumMBQP = 0;
+
 //  printf(" %d ",video->QPy);
 
     if (video->CurrPicNum == 0 && encvid->outOfBandParamSet == FALSE)
@@ -689,6 +729,122 @@ void updateRC_PostProc(AVCRateControl *rateCtrl, MultiPass *pMP)
 }
 
 
+/* Lookahead QP: bits = coef * cost / Qstep predicts the size of a frame from its lookahead
+   cost, with one coefficient for I and one for P frames learnt from the coded frames. The QP
+   is chosen for the frames of the window to spend what the buffer can give over the window.
+   In VBV constrained mode, the QP is then raised until no frame of the window overflows the
+   buffer, which drains the buffer ahead of an expensive frame such as a scene cut. */
+void RCLookaheadQP(AVCCommonObj *video, AVCRateControl *rateCtrl)
+{
+    AVCLookaheadInfo *la = &rateCtrl->lookahead;
+    OsclFloat coef[2], complexity[AVC_MAX_LOOKAHEAD];
+    OsclFloat sum, budget, Qstep, fullness, limit;
+    uint32 cost;
+    int i, n, type, QP;
+
+    rateCtrl->laValid = FALSE; /* only valid for this frame */
+
+    /* a frame the motion estimation turns into an I frame still has its cost as P frame, which
+       counts its blocks as intra */
+    n = la->num_frames;
+    type = (video->nal_unit_type == AVC_NALTYPE_IDR) ? 0 : 1;
+    rateCtrl->laCost = AVC_MAX((type == 0) ? la->intra_cost[0] : la->inter_cost[0], video->PicSizeInMbs);
+
+    coef[0] = rateCtrl->laCoef[0];
+    coef[1] = rateCtrl->laCoef[1];
+    if (coef[0] == 0 && coef[1] == 0)
+    {
+        return ; /* nothing learnt yet, keep the QP of the BX rate control */
+    }
+    if (coef[0] == 0) coef[0] = coef[1];
+    if (coef[1] == 0) coef[1] = coef[0];
+
+    sum = 0;
+    for (i = 0; i < n; i++)
+    {
+        if (i > 0)
+        {
+            type = (la->scene_cut[i] == AVC_ON) ? 0 : 1;
+        }
+        cost = AVC_MAX((type == 0) ? la->intra_cost[i] : la->inter_cost[i], video->PicSizeInMbs);
+        complexity[i] = coef[type] * cost;
+        sum += complexity[i];
+    }
+    type = (video->nal_unit_type == AVC_NALTYPE_IDR) ? 0 : 1;
+
+    /* bits for the window, bringing the buffer back to its initial fullness over one second */
+    budget = n * (rateCtrl->bitsPerFrame -
+                  (rateCtrl->VBV_fullness - (rateCtrl->Bs / 3 - rateCtrl->Bs / 2)) / rateCtrl->frame_rate);
+    budget = AVC_MAX(budget, n * rateCtrl->bitsPerFrame * 0.25);
+
+    QP = Qstep2QP(sum / budget);
+    if (type != 0) /* keep the quality of P frames smooth */
+    {
+        QP = AVC_CLIP3(rateCtrl->laPrevQP - 3, rateCtrl->laPrevQP + 3, QP);
+    }
+
+    if (rateCtrl->vbvConstrained)
+    {
+        /* 10% of the buffer is left for the prediction errors */
+        limit = rateCtrl->Bs / 2 - rateCtrl->Bs * 0.1;
+        for (; QP < RC_MAX_QUANT; QP++)
+        {
+            Qstep = QP2Qstep(QP);
+            fullness = rateCtrl->VBV_fullness;
+            for (i = 0; i < n; i++)
+            {
+                fullness += complexity[i] / Qstep - rateCtrl->bitsPerFrame;
+                if (fullness > limit)
+                {
+                    break;
+                }
+                if (fullness < rateCtrl->low_bound)
+                {
+                    fullness = rateCtrl->low_bound;
+                }
+            }
+            if (i == n)
+            {
+                break;
+            }
+        }
+    }
+
+    rateCtrl->Qc = AVC_CLIP3(RC_MIN_QUANT, RC_MAX_QUANT, QP);
+
+    return ;
+}
+
+/* VBV constrained mode, called at the start of every MB row: raise the QP of the remaining
+   MBs when the frame, at the rate of the last row, would not fit in the buffer. */
+void RCCheckVBV(AVCCommonObj *video, AVCRateControl *rateCtrl)
+{
+    int bits, rowBits, projected;
+
+    bits = rateCtrl->NumberofHeaderBits + rateCtrl->NumberofTextureBits;
+    rowBits = bits - rateCtrl->vbvCheckBits;
+    rateCtrl->vbvCheckBits = bits;
+
+    projected = bits + (int)((OsclFloat)rowBits * (video->PicSizeInMbs - rateCtrl->numMBs) / video->PicWidthInMbs);
+
+    if (bits > rateCtrl->vbvMaxBits * 0.8)
+    {
+        rateCtrl->vbvQP = RC_MAX_QUANT;
+    }
+    else if (projected > rateCtrl->vbvMaxBits * 1.5)
+    {
+        rateCtrl->vbvQP += 3;
+    }
+    else if (projected > rateCtrl->vbvMaxBits * 0.9)
+    {
+        rateCtrl->vbvQP++;
+    }
+
+    rateCtrl->vbvQP = AVC_MIN(rateCtrl->vbvQP, RC_MAX_QUANT);
+
+    return ;
+}
+
 void RCInitChromaQP(AVCEncObject *encvid)
 {
     AVCCommonObj *video = encvid->common;
@@ -735,9 +891,23 @@ void RCInitMBQP(AVCEncObject *encvid)
 {
     AVCCommonObj *video =  encvid->common;
     AVCMacroblock *currMB = video->currMB;
+    AVCRateControl *rateCtrl = encvid->rateCtrl;
 
     currMB->QPy = video->QPy; /* set to previous value or picture level */
 
+    if (rateCtrl->vbvConstrained)
+    {
+        if (rateCtrl->numMBs > 0 && rateCtrl->numMBs % video->PicWidthInMbs == 0)
+        {
+            RCCheckVBV(video, rateCtrl);
+        }
+        /* mb_qp_delta must stay within [-26, +25], so approach vbvQP over several MBs */
+        currMB->QPy = AVC_CLIP3(video->QPy - 26, video->QPy + 25, rateCtrl->vbvQP);
+    }
+
+    rateCtrl->numMBs++;
+    rateCtrl->sumMBQP += currMB->QPy;
+
     RCInitChromaQP(encvid);
 
 }
@@ -797,6 +967,8 @@ AVCEnc_Status RCUpdateFrame(AVCEncObject *encvid)
     MultiPass *pMP = rateCtrl->pMP;
     int diff_BTCounter;
     int nal_type = video->nal_unit_type;
+    int QP, type;
+    OsclFloat coef;
 
     /* update the complexity weight of I, P, B frame */
 
@@ -827,6 +999,23 @@ AVCEnc_Status RCUpdateFrame(AVCEncObject *encvid)
         rateCtrl->T = pMP->target_bits = rateCtrl->TMN_TH - rateCtrl->TMN_W;
         pMP->diff_counter -= diff_BTCounter;
 
+        /* learn the size of a frame for its lookahead cost */
+        if (rateCtrl->numMBs > 0)
+        {
+            QP = (rateCtrl->sumMBQP + rateCtrl->numMBs / 2) / rateCtrl->numMBs;
+            rateCtrl->laPrevQP = QP;
+            if (rateCtrl->laCost > 0)
+            {
+                type = (nal_type == AVC_NALTYPE_IDR) ? 0 : 1;
+                coef = (OsclFloat)rateCtrl->numFrameBits * QP2Qstep(QP) / rateCtrl->laCost;
+                if (rateCtrl->laCoef[type] > 0)
+                {
+                    coef = (rateCtrl->laCoef[type] + coef) / 2;
+                }
+                rateCtrl->laCoef[type] = coef;
+            }
+        }
+
         rateCtrl->Rc = rateCtrl->numFrameBits;  /* Total Bits for current frame */
         rateCtrl->Hc = rateCtrl->NumberofHeaderBits;    /* Total Bits in Header and Motion Vector */
 
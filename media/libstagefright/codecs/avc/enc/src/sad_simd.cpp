@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "avcenc_lib.h"
+
+/* consist of
+int AVCSAD_Macroblock_SSE2(uint8 *ref,uint8 *blk,int dmin_lx,void *extra_info)
+int AVCSAD_Macroblock_AVX2(uint8 *ref,uint8 *blk,int dmin_lx,void *extra_info)
+int AVCSAD_Macroblock_NEON(uint8 *ref,uint8 *blk,int dmin_lx,void *extra_info)
+void AVCInitSADFunctions(AVCEncFuncPtr *functionPointer)
+
+The kernels return exactly what AVCSAD_Macroblock_C returns, including the partial SAD when
+the search gives up on a candidate: the C version stops after the first row at which the sum
+exceeds dmin. The sum only grows, so the SIMD versions check 4 rows at once and go back to
+the row sums only for a candidate being dropped. */
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#include <emmintrin.h>
+#define AVC_SAD_SSE2 1
+/* AVX2 intrinsics can be compiled into a file built for a lesser target from gcc 4.9 and
+   clang 3.8 on, the kernel is only used after checking the CPU at runtime */
+#if defined(__AVX2__) || (defined(__clang__) && \
+        (__clang_major__ > 3 || (__clang_major__ == 3 && __clang_minor__ >= 8))) || \
+        (!defined(__clang__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#include <immintrin.h>
+#define AVC_SAD_AVX2 1
+#endif
+#endif
+
+/* NEON is a build time choice on ARM */
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#define AVC_SAD_NEON 1
+#endif
+
+#ifdef AVC_SAD_SSE2
+/*==================================================================
+    Function:   AVCSAD_Macroblock_SSE2
+    Purpose:    Compute SAD 16x16 between blk and ref, 1 row per
+                psadbw.
+==================================================================*/
+static inline int SADRow_SSE2(__m128i row)
+{
+    return _mm_cvtsi128_si32(row) + _mm_cvtsi128_si32(_mm_srli_si128(row, 8));
+}
+
+static int AVCSAD_Macroblock_SSE2(uint8 *ref, uint8 *blk, int dmin_lx, void *extra_info)
+{
+    (void)(extra_info);
+
+    __m128i row[4];
+    int sad = 0, sad4;
+    int dmin = (uint32)dmin_lx >> 16;
+    int lx = dmin_lx & 0xFFFF;
+    int i, k;
+
+    for (i = 0; i < 16; i += 4)
+    {
+        for (k = 0; k < 4; k++)
+        {
+            row[k] = _mm_sad_epu8(_mm_loadu_si128((__m128i*)ref),
+                                  _mm_loadu_si128((__m128i*)blk));
+            ref += lx;
+            blk += 16;
+        }
+
+        sad4 = sad + SADRow_SSE2(_mm_add_epi64(_mm_add_epi64(row[0], row[1]),
+                                               _mm_add_epi64(row[2], row[3])));
+        if (sad4 > dmin)
+        {
+            for (k = 0; k < 4; k++)
+            {
+                sad += SADRow_SSE2(row[k]);
+                if (sad > dmin)
+                {
+                    return sad;
+                }
+            }
+        }
+        sad = sad4;
+    }
+
+    return sad;
+}
+#endif /* AVC_SAD_SSE2 */
+
+#ifdef AVC_SAD_AVX2
+/*==================================================================
+    Function:   AVCSAD_Macroblock_AVX2
+    Purpose:    Compute SAD 16x16 between blk and ref, 2 rows per
+                vpsadbw.
+==================================================================*/
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+/* SAD of 2 rows, row 0 in the low lane and row 1 in the high lane */
+static inline AVX2_TARGET __m256i SADRows_AVX2(uint8 *ref, int lx, uint8 *blk)
+{
+    __m256i r = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                    _mm_loadu_si128((__m128i*)ref)), _mm_loadu_si128((__m128i*)(ref + lx)), 1);
+
+    return _mm256_sad_epu8(r, _mm256_loadu_si256((__m256i*)blk));
+}
+
+static AVX2_TARGET int AVCSAD_Macroblock_AVX2(uint8 *ref, uint8 *blk, int dmin_lx,
+        void *extra_info)
+{
+    (void)(extra_info);
+
+    __m256i rows01, rows23, tmp;
+    __m128i sum;
+    int sad = 0, sad4, k;
+    int rowSad[4];
+    int dmin = (uint32)dmin_lx >> 16;
+    int lx = dmin_lx & 0xFFFF;
+    int i;
+
+    for (i = 0; i < 16; i += 4)
+    {
+        rows01 = SADRows_AVX2(ref, lx, blk);
+        rows23 = SADRows_AVX2(ref + 2 * lx, lx, blk + 32);
+        ref += 4 * lx;
+        blk += 64;
+
+        tmp = _mm256_add_epi64(rows01, rows23);
+        sum = _mm_add_epi64(_mm256_castsi256_si128(tmp), _mm256_extracti128_si256(tmp, 1));
+        sad4 = sad + _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+        if (sad4 > dmin)
+        {
+            /* row sums in the 32-bit elements 0 and 4 */
+            rows01 = _mm256_add_epi64(rows01, _mm256_srli_si256(rows01, 8));
+            rows23 = _mm256_add_epi64(rows23, _mm256_srli_si256(rows23, 8));
+            rowSad[0] = _mm256_extract_epi32(rows01, 0);
+            rowSad[1] = _mm256_extract_epi32(rows01, 4);
+            rowSad[2] = _mm256_extract_epi32(rows23, 0);
+            rowSad[3] = _mm256_extract_epi32(rows23, 4);
+            for (k = 0; k < 4; k++)
+            {
+                sad += rowSad[k];
+                if (sad > dmin)
+                {
+                    return sad;
+                }
+            }
+        }
+        sad = sad4;
+    }
+
+    return sad;
+}
+#endif /* AVC_SAD_AVX2 */
+
+#ifdef AVC_SAD_NEON
+/*==================================================================
+    Function:   AVCSAD_Macroblock_NEON
+    Purpose:    Compute SAD 16x16 between blk and ref, 1 row per
+                vabd.
+==================================================================*/
+static inline int SumU16_NEON(uint16x8_t x)
+{
+#if defined(__aarch64__)
+    return vaddvq_u16(x);
+#else
+    uint64x2_t s = vpaddlq_u32(vpaddlq_u16(x));
+    return (int)(vgetq_lane_u64(s, 0) + vgetq_lane_u64(s, 1));
+#endif
+}
+
+static int AVCSAD_Macroblock_NEON(uint8 *ref, uint8 *blk, int dmin_lx, void *extra_info)
+{
+    (void)(extra_info);
+
+    uint8x16_t row[4];
+    uint16x8_t acc;
+    int sad = 0, sad4;
+    int dmin = (uint32)dmin_lx >> 16;
+    int lx = dmin_lx & 0xFFFF;
+    int i, k;
+
+    for (i = 0; i < 16; i += 4)
+    {
+        for (k = 0; k < 4; k++)
+        {
+            row[k] = vabdq_u8(vld1q_u8(ref), vld1q_u8(blk));
+            ref += lx;
+            blk += 16;
+        }
+
+        acc = vpaddlq_u8(row[0]);
+        acc = vpadalq_u8(acc, row[1]);
+        acc = vpadalq_u8(acc, row[2]);
+        acc = vpadalq_u8(acc, row[3]);
+        sad4 = sad + SumU16_NEON(acc);
+        if (sad4 > dmin)
+        {
+            for (k = 0; k < 4; k++)
+            {
+                sad += SumU16_NEON(vpaddlq_u8(row[k]));
+                if (sad > dmin)
+                {
+                    return sad;
+                }
+            }
+        }
+        sad = sad4;
+    }
+
+    return sad;
+}
+#endif /* AVC_SAD_NEON */
+
+#ifdef AVC_SAD_SSE2
+static bool CpuHasSSE2()
+{
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (edx & bit_SSE2);
+}
+#endif
+
+#ifdef AVC_SAD_AVX2
+static bool CpuHasAVX2()
+{
+    unsigned int eax, ebx, ecx, edx;
+    unsigned int xcr0lo, xcr0hi;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE))
+    {
+        return false;
+    }
+    /* the OS must save the ymm registers */
+    __asm__("xgetbv" : "=a"(xcr0lo), "=d"(xcr0hi) : "c"(0));
+    if ((xcr0lo & 6) != 6)
+    {
+        return false;
+    }
+    if (__get_cpuid_max(0, NULL) < 7)
+    {
+        return false;
+    }
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx & (1 << 5)) != 0;   /* AVX2 */
+}
+#endif
+
+/*==================================================================
+    Function:   AVCInitSADFunctions
+    Purpose:    Replace the C SAD kernel of the function table by the
+                fastest one the CPU supports.
+==================================================================*/
+void AVCInitSADFunctions(AVCEncFuncPtr *functionPointer)
+{
+    (void)(functionPointer);
+
+#ifdef AVC_SAD_SSE2
+    if (CpuHasSSE2())
+    {
+        functionPointer->SAD_Macroblock = &AVCSAD_Macroblock_SSE2;
+        functionPointer->SATD_Macroblock = &AVCSAD_Macroblock_SSE2;
+    }
+#endif
+#ifdef AVC_SAD_AVX2
+    if (CpuHasAVX2())
+    {
+        functionPointer->SAD_Macroblock = &AVCSAD_Macroblock_AVX2;
+        functionPointer->SATD_Macroblock = &AVCSAD_Macroblock_AVX2;
+    }
+#endif
+#ifdef AVC_SAD_NEON
+    functionPointer->SAD_Macroblock = &AVCSAD_Macroblock_NEON;
+    functionPointer->SATD_Macroblock = &AVCSAD_Macroblock_NEON;
+#endif
+
+    return ;
+}
@@ -46,6 +46,9 @@ SoftVPX::SoftVPX(
             kNumBuffers,
             codingType == OMX_VIDEO_CodingVP8 ? MEDIA_MIMETYPE_VIDEO_VP8 : MEDIA_MIMETYPE_VIDEO_VP9);
 
+    // Frames are copied out of libvpx's own frame buffers.
+    setNativeBuffersSupported();
+
     CHECK_EQ(initDecoder(), (status_t)OK);
 }
 
@@ -150,35 +153,17 @@ void SoftVPX::onQueueFilled(OMX_U32 portIndex) {
                 return;
             }
 
-            outHeader->nOffset = 0;
-            outHeader->nFilledLen = (width * height * 3) / 2;
             outHeader->nFlags = EOSseen ? OMX_BUFFERFLAG_EOS : 0;
             outHeader->nTimeStamp = inHeader->nTimeStamp;
 
-            const uint8_t *srcLine = (const uint8_t *)img->planes[PLANE_Y];
-            uint8_t *dst = outHeader->pBuffer;
-            for (size_t i = 0; i < img->d_h; ++i) {
-                memcpy(dst, srcLine, img->d_w);
-
-                srcLine += img->stride[PLANE_Y];
-                dst += img->d_w;
-            }
-
-            srcLine = (const uint8_t *)img->planes[PLANE_U];
-            for (size_t i = 0; i < img->d_h / 2; ++i) {
-                memcpy(dst, srcLine, img->d_w / 2);
-
-                srcLine += img->stride[PLANE_U];
-                dst += img->d_w / 2;
-            }
-
-            srcLine = (const uint8_t *)img->planes[PLANE_V];
-            for (size_t i = 0; i < img->d_h / 2; ++i) {
-                memcpy(dst, srcLine, img->d_w / 2);
-
-                srcLine += img->stride[PLANE_V];
-                dst += img->d_w / 2;
-            }
+            copyYUV420FrameToOutputBuffer(
+                    outHeader,
+                    (const uint8_t *)img->planes[PLANE_Y],
+                    (const uint8_t *)img->planes[PLANE_U],
+                    (const uint8_t *)img->planes[PLANE_V],
+                    img->stride[PLANE_Y],
+                    img->stride[PLANE_U],
+                    img->stride[PLANE_V]);
 
             outInfo->mOwnedByUs = false;
             outQueue.erase(outQueue.begin());
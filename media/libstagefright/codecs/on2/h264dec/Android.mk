@@ -26,6 +26,7 @@ LOCAL_SRC_FILES := \
 	./source/h264bsd_dpb.c \
 	./source/h264bsd_image.c \
 	./source/h264bsd_deblocking.c \
+	./source/h264bsd_thread_pool.c \
 	./source/h264bsd_conceal.c \
 	./source/h264bsd_vui.c \
 	./source/h264bsd_pic_order_cnt.c \
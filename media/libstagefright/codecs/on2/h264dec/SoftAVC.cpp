@@ -20,6 +20,8 @@
 
 #include "SoftAVC.h"
 
+#include <unistd.h>
+
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MediaErrors.h>
@@ -28,6 +30,9 @@
 
 namespace android {
 
+static const char *kNumThreadsExtensionName =
+    "OMX.google.android.index.numDecoderThreads";
+
 static const CodecProfileLevel kProfileLevels[] = {
     { OMX_VIDEO_AVCProfileBaseline, OMX_VIDEO_AVCLevel1  },
     { OMX_VIDEO_AVCProfileBaseline, OMX_VIDEO_AVCLevel1b },
@@ -64,11 +69,21 @@ SoftAVC::SoftAVC(
       mPicId(0),
       mHeadersDecoded(false),
       mEOSStatus(INPUT_DATA_AVAILABLE),
-      mSignalledError(false) {
+      mSignalledError(false),
+      mNumThreads(1) {
+    long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (numCpus > 1) {
+        mNumThreads = (uint32_t)(
+                numCpus < kMaxDefaultThreads ? numCpus : kMaxDefaultThreads);
+    }
+
     initPorts(
             kNumInputBuffers, 8192 /* inputBufferSize */,
             kNumOutputBuffers, MEDIA_MIMETYPE_VIDEO_AVC);
 
+    // Pictures are copied out of the decoder's own reference frames.
+    setNativeBuffersSupported();
+
     CHECK_EQ(initDecoder(), (status_t)OK);
 }
 
@@ -92,10 +107,80 @@ SoftAVC::~SoftAVC() {
 
 status_t SoftAVC::initDecoder() {
     // Force decoder to output buffers in display order.
-    if (H264SwDecInit(&mHandle, 0) == H264SWDEC_OK) {
-        return OK;
+    if (H264SwDecInit(&mHandle, 0) != H264SWDEC_OK) {
+        return UNKNOWN_ERROR;
+    }
+
+    if (mNumThreads > 1
+            && H264SwDecSetNumThreads(mHandle, mNumThreads) != H264SWDEC_OK) {
+        ALOGW("Failed to start %u decoder threads", mNumThreads);
+    }
+    return OK;
+}
+
+OMX_ERRORTYPE SoftAVC::internalGetParameter(
+        OMX_INDEXTYPE index, OMX_PTR params) {
+    switch ((int)index) {
+        case kNumThreadsExtensionIndex:
+        {
+            OMX_PARAM_U32TYPE *threadParams = (OMX_PARAM_U32TYPE *)params;
+
+            if (threadParams->nPortIndex != kInputPortIndex) {
+                return OMX_ErrorBadPortIndex;
+            }
+
+            threadParams->nU32 = mNumThreads;
+            return OMX_ErrorNone;
+        }
+
+        default:
+            return SoftVideoDecoderOMXComponent::internalGetParameter(
+                    index, params);
     }
-    return UNKNOWN_ERROR;
+}
+
+OMX_ERRORTYPE SoftAVC::internalSetParameter(
+        OMX_INDEXTYPE index, const OMX_PTR params) {
+    switch ((int)index) {
+        case kNumThreadsExtensionIndex:
+        {
+            const OMX_PARAM_U32TYPE *threadParams =
+                (const OMX_PARAM_U32TYPE *)params;
+
+            if (threadParams->nPortIndex != kInputPortIndex) {
+                return OMX_ErrorBadPortIndex;
+            }
+
+            if (threadParams->nU32 == 0) {
+                return OMX_ErrorBadParameter;
+            }
+
+            // Output does not depend on the thread count, so it may be
+            // changed at any time between decode calls.
+            if (threadParams->nU32 != mNumThreads) {
+                mNumThreads = threadParams->nU32;
+                if (H264SwDecSetNumThreads(mHandle, mNumThreads)
+                        != H264SWDEC_OK) {
+                    ALOGW("Failed to start %u decoder threads", mNumThreads);
+                }
+            }
+            return OMX_ErrorNone;
+        }
+
+        default:
+            return SoftVideoDecoderOMXComponent::internalSetParameter(
+                    index, params);
+    }
+}
+
+OMX_ERRORTYPE SoftAVC::getExtensionIndex(
+        const char *name, OMX_INDEXTYPE *index) {
+    if (!strcmp(name, kNumThreadsExtensionName)) {
+        *(int32_t*)index = kNumThreadsExtensionIndex;
+        return OMX_ErrorNone;
+    }
+
+    return SoftVideoDecoderOMXComponent::getExtensionIndex(name, index);
 }
 
 void SoftAVC::onQueueFilled(OMX_U32 portIndex) {
@@ -263,9 +348,12 @@ void SoftAVC::drainOneOutputBuffer(int32_t picId, uint8_t* data) {
     OMX_BUFFERHEADERTYPE *header = mPicToHeaderMap.valueFor(picId);
     outHeader->nTimeStamp = header->nTimeStamp;
     outHeader->nFlags = header->nFlags;
-    outHeader->nFilledLen = mPictureSize;
-    memcpy(outHeader->pBuffer + outHeader->nOffset,
-            data, mPictureSize);
+    // The decoder hands out packed planar pictures of mWidth x mHeight.
+    const uint8_t *srcY = data;
+    const uint8_t *srcU = srcY + mWidth * mHeight;
+    const uint8_t *srcV = srcU + (mWidth / 2) * (mHeight / 2);
+    copyYUV420FrameToOutputBuffer(
+            outHeader, srcY, srcU, srcV, mWidth, mWidth / 2, mWidth / 2);
     mPicToHeaderMap.removeItem(picId);
     delete header;
     outInfo->mOwnedByUs = false;
@@ -35,6 +35,15 @@ struct SoftAVC : public SoftVideoDecoderOMXComponent {
 protected:
     virtual ~SoftAVC();
 
+    virtual OMX_ERRORTYPE internalGetParameter(
+            OMX_INDEXTYPE index, OMX_PTR params);
+
+    virtual OMX_ERRORTYPE internalSetParameter(
+            OMX_INDEXTYPE index, const OMX_PTR params);
+
+    virtual OMX_ERRORTYPE getExtensionIndex(
+            const char *name, OMX_INDEXTYPE *index);
+
     virtual void onQueueFilled(OMX_U32 portIndex);
     virtual void onPortFlushCompleted(OMX_U32 portIndex);
     virtual void onReset();
@@ -45,6 +54,17 @@ private:
         kNumOutputBuffers = 2,
     };
 
+    enum {
+        // Upper limit for the default number of decoder threads, the
+        // vendor parameter below may ask for more.
+        kMaxDefaultThreads = 4,
+    };
+
+    enum {
+        // OMX_PARAM_U32TYPE, nU32 is the number of decoder threads.
+        kNumThreadsExtensionIndex = OMX_IndexVendorStartUnused + 1,
+    };
+
     enum EOSStatus {
         INPUT_DATA_AVAILABLE,
         INPUT_EOS_SEEN,
@@ -71,6 +91,8 @@ private:
 
     bool mSignalledError;
 
+    uint32_t mNumThreads;
+
     status_t initDecoder();
     void drainAllOutputBuffers(bool eos);
     void drainOneOutputBuffer(int32_t picId, uint8_t *data);
@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 /*------------------------------------------------------------------------------
     Module defines
@@ -40,6 +41,7 @@ void WriteOutput(char *filename, u8 *data, u32 picSize);
 u32 NextPacket(u8 **pStrm);
 u32 CropPicture(u8 *pOutImage, u8 *pInImage,
     u32 picWidth, u32 picHeight, CropParams *pCropParams);
+static double NowMs(void);
 
 /* Global variables for stream handling */
 u8 *streamStop = NULL;
@@ -102,6 +104,8 @@ int main(int argc, char **argv)
     u32 numErrors = 0;
     u32 cropDisplay = 0;
     u32 disableOutputReordering = 0;
+    u32 numThreads = 1;
+    double decodeStart, decodeTimeMs = 0;
 
     FILE *finput;
 
@@ -123,8 +127,8 @@ int main(int argc, char **argv)
     if (argc < 2)
     {
         DEBUG((
-            "Usage: %s [-Nn] [-Ooutfile] [-P] [-U] [-C] [-R] [-T] file.h264\n",
-            argv[0]));
+            "Usage: %s [-Nn] [-Ooutfile] [-P] [-U] [-C] [-R] [-Mn] [-T] "
+            "file.h264\n", argv[0]));
         DEBUG(("\t-Nn forces decoding to stop after n pictures\n"));
 #if defined(_NO_OUT)
         DEBUG(("\t-Ooutfile output writing disabled at compile time\n"));
@@ -136,6 +140,7 @@ int main(int argc, char **argv)
         DEBUG(("\t-U NAL unit stream mode\n"));
         DEBUG(("\t-C display cropped image (default decoded image)\n"));
         DEBUG(("\t-R disable DPB output reordering\n"));
+        DEBUG(("\t-Mn decode using n threads (default 1)\n"));
         DEBUG(("\t-T to print tag name and exit\n"));
         return 0;
     }
@@ -167,6 +172,10 @@ int main(int argc, char **argv)
         {
             disableOutputReordering = 1;
         }
+        else if ( strncmp(argv[i], "-M", 2) == 0 )
+        {
+            numThreads = (u32)atoi(argv[i]+2);
+        }
     }
 
     /* open input file for reading, file name given by user. If file open
@@ -204,6 +213,12 @@ int main(int argc, char **argv)
         return -1;
     }
 
+    if (numThreads > 1 &&
+        H264SwDecSetNumThreads(decInst, numThreads) != H264SWDEC_OK)
+    {
+        DEBUG(("UNABLE TO CREATE %d DECODER THREADS\n", numThreads));
+    }
+
     /* initialize H264SwDecDecode() input structure */
     streamStop = byteStrmStart + strmLen;
     decInput.pStream = byteStrmStart;
@@ -223,7 +238,9 @@ int main(int argc, char **argv)
         decInput.picId = picDecodeNumber;
 
         /* call API function to perform decoding */
+        decodeStart = NowMs();
         ret = H264SwDecDecode(decInst, &decInput, &decOutput);
+        decodeTimeMs += NowMs() - decodeStart;
 
         switch(ret)
         {
@@ -421,6 +438,14 @@ int main(int argc, char **argv)
     DEBUG(("Output file: %s\n", outFileName));
 
     DEBUG(("DECODING DONE\n"));
+
+    /* decoding speed, time spent in H264SwDecDecode() only */
+    if (decodeTimeMs > 0)
+    {
+        DEBUG(("Decoded %d pictures in %.1f ms using %d threads, %.1f fps\n",
+            picDecodeNumber - 1, decodeTimeMs, numThreads,
+            (picDecodeNumber - 1) * 1000.0 / decodeTimeMs));
+    }
     if (numErrors || picDecodeNumber == 1)
     {
         DEBUG(("ERRORS FOUND\n"));
@@ -759,3 +784,19 @@ void H264SwDecMemset(void *ptr, i32 value, u32 count)
     memset(ptr, value, count);
 }
 
+/*------------------------------------------------------------------------------
+
+    Function name: NowMs
+
+    Purpose:
+        Return monotonic time in milliseconds, used for measuring the
+        decoding speed.
+
+------------------------------------------------------------------------------*/
+double NowMs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
@@ -29,6 +29,7 @@
           H264SwDecDecode
           H264SwDecGetAPIVersion
           H264SwDecNextPicture
+          H264SwDecSetNumThreads
 
 ------------------------------------------------------------------------------*/
 
@@ -47,7 +48,7 @@
 ------------------------------------------------------------------------------*/
 
 #define H264SWDEC_MAJOR_VERSION 2
-#define H264SWDEC_MINOR_VERSION 3
+#define H264SWDEC_MINOR_VERSION 4
 
 /*------------------------------------------------------------------------------
     2. External compiler flags
@@ -565,3 +566,72 @@ H264SwDecRet H264SwDecNextPicture(H264SwDecInst decInst,
 }
 
 
+
+/*------------------------------------------------------------------------------
+
+    Function: H264SwDecSetNumThreads
+
+        Functional description:
+            Set the number of threads the decoder instance may use. The
+            calling thread is included in the count, i.e. value 1 (default)
+            means that all the processing is done in the thread calling
+            H264SwDecDecode. Currently the additional threads are used for
+            deblocking filtering of decoded pictures, output of the decoder is
+            identical regardless of the number of threads. Shall not be called
+            while H264SwDecDecode is running for the same instance.
+
+        Input:
+            decInst     decoder instance
+            numThreads  number of threads, values above the supported maximum
+                        are clipped
+
+        Output:
+            none
+
+        Returns:
+            H264SWDEC_OK            success
+            H264SWDEC_PARAM_ERR     invalid parameters
+            H264SWDEC_NOT_INITIALIZED   decoder instance not initialized yet
+            H264SWDEC_MEMFAIL       failed to create the threads, decoding
+                                    continues in the calling thread only
+
+------------------------------------------------------------------------------*/
+
+H264SwDecRet H264SwDecSetNumThreads(H264SwDecInst decInst, u32 numThreads)
+{
+
+    decContainer_t *pDecCont;
+
+    DEC_API_TRC("H264SwDecSetNumThreads#");
+
+    if (decInst == NULL || numThreads == 0)
+    {
+        DEC_API_TRC("H264SwDecSetNumThreads# ERROR: Invalid parameters");
+        return(H264SWDEC_PARAM_ERR);
+    }
+
+    pDecCont = (decContainer_t*)decInst;
+
+    if (pDecCont->decStat == UNINITIALIZED)
+    {
+        DEC_API_TRC("H264SwDecSetNumThreads# ERROR: Decoder not initialized");
+        return(H264SWDEC_NOT_INITIALIZED);
+    }
+
+#ifdef H264DEC_TRACE
+    sprintf(pDecCont->str, "H264SwDecSetNumThreads# decInst %p numThreads %d",
+            decInst, numThreads);
+    DEC_API_TRC(pDecCont->str);
+#endif
+
+    if (h264bsdSetNumThreads(&pDecCont->storage, numThreads) != HANTRO_OK)
+    {
+        DEC_API_TRC("H264SwDecSetNumThreads# ERROR: Thread creation failed");
+        return(H264SWDEC_MEMFAIL);
+    }
+
+    DEC_API_TRC("H264SwDecSetNumThreads# OK");
+
+    return(H264SWDEC_OK);
+
+}
@@ -24,6 +24,9 @@
      4. Local function prototypes
      5. Functions
           h264bsdFilterPicture
+          h264bsdFilterPictureWavefront
+          FilterWavefront
+          FilterMbRow
           FilterVerLumaEdge
           FilterHorLumaEdge
           FilterHorLuma
@@ -53,6 +56,8 @@
 #include "h264bsd_deblocking.h"
 #include "h264bsd_dpb.h"
 
+#include <pthread.h>
+
 #ifdef H264DEC_OMXDL
 #include "omxtypes.h"
 #include "omxVC.h"
@@ -145,6 +150,18 @@ enum { TOP = 0, LEFT = 1, INNER = 2 };
 /* clipping table defined in intra_prediction.c */
 extern const u8 h264bsdClip[];
 
+/* state shared by the threads filtering a picture as a wavefront */
+typedef struct
+{
+    image_t *image;
+    mbStorage_t *mb;
+    u32 numThreads;
+    /* number of filtered macroblocks on each macroblock row */
+    u32 *rowProgress;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} wavefront_t;
+
 /*------------------------------------------------------------------------------
     4. Local function prototypes
 ------------------------------------------------------------------------------*/
@@ -166,6 +183,11 @@ static u32 IsSliceBoundaryOnTop(mbStorage_t *mb);
 
 static u32 GetMbFilteringFlags(mbStorage_t *mb);
 
+static void FilterMbRow(image_t *image, mbStorage_t *mb, u32 mbRow,
+    u32 firstCol, u32 lastCol);
+
+static void FilterWavefront(void *arg, u32 threadIndex);
+
 #ifndef H264DEC_OMXDL
 
 static u32 GetBoundaryStrengths(mbStorage_t *mb, bS_t *bs, u32 flags);
@@ -548,20 +570,23 @@ u32 EdgeBoundaryStrengthLeft(mbStorage_t *mb1, mbStorage_t *mb2)
 #endif /* H264DEC_OMXDL */
 /*------------------------------------------------------------------------------
 
-    Function: h264bsdFilterPicture
+    Function: FilterMbRow
 
         Functional description:
-          Perform deblocking filtering for a picture. Filter does not copy
-          the original picture anywhere but filtering is performed directly
-          on the original image. Parameters controlling the filtering process
-          are computed based on information in macroblock structures of the
-          filtered macroblock, macroblock above and macroblock on the left of
-          the filtered one.
+          Perform deblocking filtering for macroblocks firstCol..lastCol-1 of
+          one macroblock row. Filter does not copy the original picture
+          anywhere but filtering is performed directly on the original image.
+          Parameters controlling the filtering process are computed based on
+          information in macroblock structures of the filtered macroblock,
+          macroblock above and macroblock on the left of the filtered one.
 
         Inputs:
           image         pointer to image to be filtered
           mb            pointer to macroblock data structure of the top-left
                         macroblock of the picture
+          mbRow         macroblock row to be filtered
+          firstCol      first macroblock column to be filtered
+          lastCol       one past the last macroblock column to be filtered
 
         Outputs:
           image         filtered image stored here
@@ -571,15 +596,18 @@ u32 EdgeBoundaryStrengthLeft(mbStorage_t *mb1, mbStorage_t *mb2)
 
 ------------------------------------------------------------------------------*/
 #ifndef H264DEC_OMXDL
-void h264bsdFilterPicture(
+void FilterMbRow(
   image_t *image,
-  mbStorage_t *mb)
+  mbStorage_t *mb,
+  u32 mbRow,
+  u32 firstCol,
+  u32 lastCol)
 {
 
 /* Variables */
 
     u32 flags;
-    u32 picSizeInMbs, mbRow, mbCol;
+    u32 picSizeInMbs, mbCol;
     u32 picWidthInMbs;
     u8 *data;
     mbStorage_t *pMb;
@@ -591,16 +619,15 @@ void h264bsdFilterPicture(
     ASSERT(image);
     ASSERT(mb);
     ASSERT(image->data);
-    ASSERT(image->width);
-    ASSERT(image->height);
+    ASSERT(mbRow < image->height);
+    ASSERT(lastCol <= image->width);
 
     picWidthInMbs = image->width;
-    data = image->data;
     picSizeInMbs = picWidthInMbs * image->height;
 
-    pMb = mb;
+    pMb = mb + mbRow * picWidthInMbs + firstCol;
 
-    for (mbRow = 0, mbCol = 0; mbRow < image->height; pMb++)
+    for (mbCol = firstCol; mbCol < lastCol; mbCol++, pMb++)
     {
         flags = GetMbFilteringFlags(pMb);
 
@@ -627,13 +654,6 @@ void h264bsdFilterPicture(
 
             }
         }
-
-        mbCol++;
-        if (mbCol == picWidthInMbs)
-        {
-            mbCol = 0;
-            mbRow++;
-        }
     }
 
 }
@@ -1739,20 +1759,23 @@ void FilterChroma(
 
 /*------------------------------------------------------------------------------
 
-    Function: h264bsdFilterPicture
+    Function: FilterMbRow
 
         Functional description:
-          Perform deblocking filtering for a picture. Filter does not copy
-          the original picture anywhere but filtering is performed directly
-          on the original image. Parameters controlling the filtering process
-          are computed based on information in macroblock structures of the
-          filtered macroblock, macroblock above and macroblock on the left of
-          the filtered one.
+          Perform deblocking filtering for macroblocks firstCol..lastCol-1 of
+          one macroblock row. Filter does not copy the original picture
+          anywhere but filtering is performed directly on the original image.
+          Parameters controlling the filtering process are computed based on
+          information in macroblock structures of the filtered macroblock,
+          macroblock above and macroblock on the left of the filtered one.
 
         Inputs:
           image         pointer to image to be filtered
           mb            pointer to macroblock data structure of the top-left
                         macroblock of the picture
+          mbRow         macroblock row to be filtered
+          firstCol      first macroblock column to be filtered
+          lastCol       one past the last macroblock column to be filtered
 
         Outputs:
           image         filtered image stored here
@@ -1763,15 +1786,18 @@ void FilterChroma(
 ------------------------------------------------------------------------------*/
 
 /*lint --e{550} Symbol not accessed */
-void h264bsdFilterPicture(
+void FilterMbRow(
   image_t *image,
-  mbStorage_t *mb)
+  mbStorage_t *mb,
+  u32 mbRow,
+  u32 firstCol,
+  u32 lastCol)
 {
 
 /* Variables */
 
     u32 flags;
-    u32 picSizeInMbs, mbRow, mbCol;
+    u32 picSizeInMbs, mbCol;
     u32 picWidthInMbs;
     u8 *data;
     mbStorage_t *pMb;
@@ -1787,16 +1813,15 @@ void h264bsdFilterPicture(
     ASSERT(image);
     ASSERT(mb);
     ASSERT(image->data);
-    ASSERT(image->width);
-    ASSERT(image->height);
+    ASSERT(mbRow < image->height);
+    ASSERT(lastCol <= image->width);
 
     picWidthInMbs = image->width;
-    data = image->data;
     picSizeInMbs = picWidthInMbs * image->height;
 
-    pMb = mb;
+    pMb = mb + mbRow * picWidthInMbs + firstCol;
 
-    for (mbRow = 0, mbCol = 0; mbRow < image->height; pMb++)
+    for (mbCol = firstCol; mbCol < lastCol; mbCol++, pMb++)
     {
         flags = GetMbFilteringFlags(pMb);
 
@@ -1858,13 +1883,6 @@ void h264bsdFilterPicture(
                                               (const OMX_U8*)bS+16 );
             }
         }
-
-        mbCol++;
-        if (mbCol == picWidthInMbs)
-        {
-            mbCol = 0;
-            mbRow++;
-        }
     }
 
 }
@@ -2413,5 +2431,192 @@ void GetChromaEdgeThresholds(
 
 #endif /* H264DEC_OMXDL */
 
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdFilterPicture
+
+        Functional description:
+          Perform deblocking filtering for a picture, macroblocks are
+          filtered in raster scan order.
+
+        Inputs:
+          image         pointer to image to be filtered
+          mb            pointer to macroblock data structure of the top-left
+                        macroblock of the picture
+
+        Outputs:
+          image         filtered image stored here
+
+        Returns:
+          none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdFilterPicture(
+  image_t *image,
+  mbStorage_t *mb)
+{
+
+/* Variables */
+
+    u32 mbRow;
+
+/* Code */
+
+    ASSERT(image);
+    ASSERT(image->width);
+    ASSERT(image->height);
+
+    for (mbRow = 0; mbRow < image->height; mbRow++)
+        FilterMbRow(image, mb, mbRow, 0, image->width);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdFilterPictureWavefront
+
+        Functional description:
+          Perform deblocking filtering for a picture using all the threads
+          of the pool. Filtering a macroblock modifies up to three pixel
+          rows of the macroblock above and three pixel columns of the
+          macroblock on the left, and the left edge of the macroblock above
+          right reads pixels of the macroblock above. Macroblock (row, col)
+          can thus be filtered as soon as the macroblocks of row-1 have been
+          filtered up to and including column col+1. Rows are interleaved
+          between the threads and each row trails the row above by two
+          macroblocks, which gives exactly the same result as filtering in
+          raster scan order.
+
+          Falls back to h264bsdFilterPicture if the pool has no workers or
+          memory for the progress counters cannot be allocated.
+
+        Inputs:
+          image         pointer to image to be filtered
+          mb            pointer to macroblock data structure of the top-left
+                        macroblock of the picture
+          pPool         pointer to thread pool
+
+        Outputs:
+          image         filtered image stored here
+
+        Returns:
+          none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdFilterPictureWavefront(
+  image_t *image,
+  mbStorage_t *mb,
+  threadPool_t *pPool)
+{
+
+/* Variables */
+
+    wavefront_t wavefront;
+
+/* Code */
+
+    ASSERT(image);
+    ASSERT(image->width);
+    ASSERT(image->height);
+    ASSERT(pPool);
+
+    if (pPool->numThreads <= 1 || image->height == 1)
+    {
+        h264bsdFilterPicture(image, mb);
+        return;
+    }
+
+    ALLOCATE(wavefront.rowProgress, image->height, u32);
+    if (wavefront.rowProgress == NULL)
+    {
+        h264bsdFilterPicture(image, mb);
+        return;
+    }
+    H264SwDecMemset(wavefront.rowProgress, 0, image->height * sizeof(u32));
+
+    if (pthread_mutex_init(&wavefront.mutex, NULL))
+    {
+        FREE(wavefront.rowProgress);
+        h264bsdFilterPicture(image, mb);
+        return;
+    }
+    if (pthread_cond_init(&wavefront.cond, NULL))
+    {
+        pthread_mutex_destroy(&wavefront.mutex);
+        FREE(wavefront.rowProgress);
+        h264bsdFilterPicture(image, mb);
+        return;
+    }
+
+    wavefront.image = image;
+    wavefront.mb = mb;
+    wavefront.numThreads = pPool->numThreads;
+
+    h264bsdRunThreadPool(pPool, FilterWavefront, &wavefront);
+
+    pthread_cond_destroy(&wavefront.cond);
+    pthread_mutex_destroy(&wavefront.mutex);
+    FREE(wavefront.rowProgress);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: FilterWavefront
+
+        Functional description:
+          Thread pool job of h264bsdFilterPictureWavefront. Thread n filters
+          rows n, n+numThreads, n+2*numThreads... Each row is filtered in
+          runs limited by the progress of the row above, progress of the
+          row is published after every run.
+
+------------------------------------------------------------------------------*/
+
+void FilterWavefront(void *arg, u32 threadIndex)
+{
+
+/* Variables */
+
+    wavefront_t *pWf = (wavefront_t*)arg;
+    u32 mbRow, mbCol, lastCol, above;
+    u32 picWidthInMbs;
+
+/* Code */
+
+    picWidthInMbs = pWf->image->width;
+
+    for (mbRow = threadIndex; mbRow < pWf->image->height;
+         mbRow += pWf->numThreads)
+    {
+        mbCol = 0;
+        while (mbCol < picWidthInMbs)
+        {
+            if (mbRow == 0)
+                lastCol = picWidthInMbs;
+            else
+            {
+                pthread_mutex_lock(&pWf->mutex);
+                while ((above = pWf->rowProgress[mbRow - 1]) <
+                       MIN(mbCol + 2, picWidthInMbs))
+                    pthread_cond_wait(&pWf->cond, &pWf->mutex);
+                pthread_mutex_unlock(&pWf->mutex);
+
+                lastCol = (above == picWidthInMbs) ? picWidthInMbs : above - 1;
+            }
+
+            FilterMbRow(pWf->image, pWf->mb, mbRow, mbCol, lastCol);
+            mbCol = lastCol;
+
+            pthread_mutex_lock(&pWf->mutex);
+            pWf->rowProgress[mbRow] = mbCol;
+            pthread_cond_broadcast(&pWf->cond);
+            pthread_mutex_unlock(&pWf->mutex);
+        }
+    }
+
+}
+
 /*lint +e701 +e702 */
 
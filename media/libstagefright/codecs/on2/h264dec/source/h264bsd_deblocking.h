@@ -35,6 +35,7 @@
 #include "basetype.h"
 #include "h264bsd_image.h"
 #include "h264bsd_macroblock_layer.h"
+#include "h264bsd_thread_pool.h"
 
 /*------------------------------------------------------------------------------
     2. Module defines
@@ -52,5 +53,10 @@ void h264bsdFilterPicture(
   image_t *image,
   mbStorage_t *mb);
 
+void h264bsdFilterPictureWavefront(
+  image_t *image,
+  mbStorage_t *mb,
+  threadPool_t *pPool);
+
 #endif /* #ifdef H264SWDEC_DEBLOCKING_H */
 
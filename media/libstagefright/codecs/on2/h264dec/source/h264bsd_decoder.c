@@ -35,6 +35,7 @@
           h264bsdVideoRange
           h264bsdMatrixCoefficients
           h264bsdCroppingParams
+          h264bsdSetNumThreads
 
 ------------------------------------------------------------------------------*/
 
@@ -471,7 +472,8 @@ u32 h264bsdDecode(storage_t *pStorage, u8 *byteStrm, u32 len, u32 picId,
 
     if (picReady)
     {
-        h264bsdFilterPicture(pStorage->currImage, pStorage->mb);
+        h264bsdFilterPictureWavefront(pStorage->currImage, pStorage->mb,
+            pStorage->threadPool);
 
         h264bsdResetStorage(pStorage);
 
@@ -569,6 +571,8 @@ void h264bsdShutdown(storage_t *pStorage)
 
     h264bsdFreeDpb(pStorage->dpb);
 
+    h264bsdFreeThreadPool(pStorage->threadPool);
+
 }
 
 /*------------------------------------------------------------------------------
@@ -959,3 +963,38 @@ u32 h264bsdProfile(storage_t *pStorage)
         return 0;
 }
 
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdSetNumThreads
+
+        Functional description:
+            Set the number of threads used for deblocking filtering. Existing
+            worker threads are stopped and new ones created.
+
+        Inputs:
+            pStorage    pointer to storage structure
+            numThreads  number of threads, calling thread included
+
+        Outputs:
+            none
+
+        Returns:
+            HANTRO_OK   success
+            HANTRO_NOK  failed to create the threads, decoding continues
+                        with the calling thread only
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdSetNumThreads(storage_t *pStorage, u32 numThreads)
+{
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    h264bsdFreeThreadPool(pStorage->threadPool);
+
+    return(h264bsdInitThreadPool(pStorage->threadPool, numThreads));
+
+}
@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*------------------------------------------------------------------------------
+
+    Table of contents
+
+     1. Include headers
+     2. External compiler flags
+     3. Module defines
+     4. Local function prototypes
+     5. Functions
+          h264bsdInitThreadPool
+          h264bsdRunThreadPool
+          h264bsdFreeThreadPool
+          WorkerThread
+
+------------------------------------------------------------------------------*/
+
+/*------------------------------------------------------------------------------
+    1. Include headers
+------------------------------------------------------------------------------*/
+
+#include "h264bsd_thread_pool.h"
+#include "h264bsd_util.h"
+
+/*------------------------------------------------------------------------------
+    2. External compiler flags
+--------------------------------------------------------------------------------
+
+--------------------------------------------------------------------------------
+    3. Module defines
+------------------------------------------------------------------------------*/
+
+/*------------------------------------------------------------------------------
+    4. Local function prototypes
+------------------------------------------------------------------------------*/
+
+static void *WorkerThread(void *arg);
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdInitThreadPool
+
+        Functional description:
+            Create numThreads-1 worker threads. The calling thread takes part
+            in every job as thread 0, so a pool of one thread has no workers
+            and jobs are executed directly by the caller. If creation of a
+            worker fails, the pool is left with the workers created so far.
+
+        Inputs:
+            pPool       pointer to pool structure, must be zeroed or freed
+            numThreads  number of threads, clipped to [1, MAX_NUM_THREADS]
+
+        Outputs:
+            pPool       initialized pool
+
+        Returns:
+            HANTRO_OK   success
+            HANTRO_NOK  failed to initialize synchronization primitives or
+                        to allocate memory
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdInitThreadPool(threadPool_t *pPool, u32 numThreads)
+{
+
+/* Variables */
+
+    u32 i;
+
+/* Code */
+
+    ASSERT(pPool);
+    ASSERT(pPool->threads == NULL);
+
+    numThreads = CLIP3(1, MAX_NUM_THREADS, numThreads);
+
+    H264SwDecMemset(pPool, 0, sizeof(threadPool_t));
+    pPool->numThreads = 1;
+
+    if (numThreads == 1)
+        return(HANTRO_OK);
+
+    ALLOCATE(pPool->threads, numThreads - 1, pthread_t);
+    if (pPool->threads == NULL)
+        return(HANTRO_NOK);
+
+    if (pthread_mutex_init(&pPool->mutex, NULL) ||
+        pthread_cond_init(&pPool->jobCond, NULL) ||
+        pthread_cond_init(&pPool->doneCond, NULL))
+    {
+        FREE(pPool->threads);
+        return(HANTRO_NOK);
+    }
+
+    for (i = 0; i < numThreads - 1; i++)
+    {
+        if (pthread_create(pPool->threads + i, NULL, WorkerThread, pPool))
+            break;
+        pPool->numThreads++;
+    }
+
+    return(HANTRO_OK);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdRunThreadPool
+
+        Functional description:
+            Execute job on all the threads of the pool and wait until every
+            thread has returned from it. Job is called with threadIndex 0 in
+            the calling thread.
+
+        Inputs:
+            pPool       pointer to pool structure
+            job         function to execute
+            arg         argument passed to job
+
+        Outputs:
+            none
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdRunThreadPool(threadPool_t *pPool, threadPoolJob_t job, void *arg)
+{
+
+/* Code */
+
+    ASSERT(pPool);
+    ASSERT(job);
+
+    if (pPool->numThreads <= 1)
+    {
+        job(arg, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&pPool->mutex);
+    pPool->job = job;
+    pPool->jobArg = arg;
+    pPool->nextIndex = 1;
+    pPool->numRunning = pPool->numThreads - 1;
+    pPool->jobSeq++;
+    pthread_cond_broadcast(&pPool->jobCond);
+    pthread_mutex_unlock(&pPool->mutex);
+
+    job(arg, 0);
+
+    pthread_mutex_lock(&pPool->mutex);
+    while (pPool->numRunning)
+        pthread_cond_wait(&pPool->doneCond, &pPool->mutex);
+    pthread_mutex_unlock(&pPool->mutex);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdFreeThreadPool
+
+        Functional description:
+            Stop and join the worker threads and release resources of the
+            pool. Safe to call for a zeroed pool.
+
+        Inputs:
+            pPool       pointer to pool structure
+
+        Outputs:
+            none
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdFreeThreadPool(threadPool_t *pPool)
+{
+
+/* Variables */
+
+    u32 i;
+
+/* Code */
+
+    ASSERT(pPool);
+
+    if (pPool->threads == NULL)
+    {
+        pPool->numThreads = 0;
+        return;
+    }
+
+    pthread_mutex_lock(&pPool->mutex);
+    pPool->shutdown = HANTRO_TRUE;
+    pthread_cond_broadcast(&pPool->jobCond);
+    pthread_mutex_unlock(&pPool->mutex);
+
+    for (i = 0; i < pPool->numThreads - 1; i++)
+        pthread_join(pPool->threads[i], NULL);
+
+    pthread_cond_destroy(&pPool->doneCond);
+    pthread_cond_destroy(&pPool->jobCond);
+    pthread_mutex_destroy(&pPool->mutex);
+
+    FREE(pPool->threads);
+    pPool->numThreads = 0;
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: WorkerThread
+
+        Functional description:
+            Main loop of a worker thread. Waits for a new job to be posted,
+            executes it and signals completion until shutdown is requested.
+
+------------------------------------------------------------------------------*/
+
+void *WorkerThread(void *arg)
+{
+
+/* Variables */
+
+    threadPool_t *pPool = (threadPool_t*)arg;
+    u32 jobSeq = 0;
+    u32 threadIndex;
+
+/* Code */
+
+    pthread_mutex_lock(&pPool->mutex);
+
+    for (;;)
+    {
+        while (!pPool->shutdown && pPool->jobSeq == jobSeq)
+            pthread_cond_wait(&pPool->jobCond, &pPool->mutex);
+
+        if (pPool->shutdown)
+            break;
+
+        jobSeq = pPool->jobSeq;
+        threadIndex = pPool->nextIndex++;
+        pthread_mutex_unlock(&pPool->mutex);
+
+        pPool->job(pPool->jobArg, threadIndex);
+
+        pthread_mutex_lock(&pPool->mutex);
+        if (--pPool->numRunning == 0)
+            pthread_cond_signal(&pPool->doneCond);
+    }
+
+    pthread_mutex_unlock(&pPool->mutex);
+
+    return NULL;
+
+}
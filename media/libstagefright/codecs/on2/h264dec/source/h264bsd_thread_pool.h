@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*------------------------------------------------------------------------------
+
+    Table of contents
+
+    1. Include headers
+    2. Module defines
+    3. Data types
+    4. Function prototypes
+
+------------------------------------------------------------------------------*/
+
+#ifndef H264SWDEC_THREAD_POOL_H
+#define H264SWDEC_THREAD_POOL_H
+
+/*------------------------------------------------------------------------------
+    1. Include headers
+------------------------------------------------------------------------------*/
+
+#include <pthread.h>
+
+#include "basetype.h"
+
+/*------------------------------------------------------------------------------
+    2. Module defines
+------------------------------------------------------------------------------*/
+
+/* upper limit for the number of threads, calling thread included */
+#define MAX_NUM_THREADS 8
+
+/*------------------------------------------------------------------------------
+    3. Data types
+------------------------------------------------------------------------------*/
+
+/* job executed by all the threads of the pool, threadIndex is 0 for the
+ * calling thread and 1..numThreads-1 for the workers */
+typedef void (*threadPoolJob_t)(void *arg, u32 threadIndex);
+
+typedef struct
+{
+    /* total number of threads taking part in a job, calling thread
+     * included. 0 or 1 -> no worker threads exist */
+    u32 numThreads;
+    pthread_t *threads;
+    pthread_mutex_t mutex;
+    pthread_cond_t jobCond;
+    pthread_cond_t doneCond;
+    /* current job, jobSeq is incremented every time a new job is posted */
+    threadPoolJob_t job;
+    void *jobArg;
+    u32 jobSeq;
+    u32 nextIndex;
+    u32 numRunning;
+    u32 shutdown;
+} threadPool_t;
+
+/*------------------------------------------------------------------------------
+    4. Function prototypes
+------------------------------------------------------------------------------*/
+
+u32 h264bsdInitThreadPool(threadPool_t *pPool, u32 numThreads);
+void h264bsdRunThreadPool(threadPool_t *pPool, threadPoolJob_t job,
+    void *arg);
+void h264bsdFreeThreadPool(threadPool_t *pPool);
+
+#endif /* #ifdef H264SWDEC_THREAD_POOL_H */
@@ -18,507 +18,937 @@
 #define LOG_TAG "ColorConverter"
 #include <utils/Log.h>
 
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/ColorConverter.h>
 #include <media/stagefright/MediaErrors.h>
+#include <utils/threads.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define COLOR_CONVERTER_SSE2 1
+#elif defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#define COLOR_CONVERTER_NEON 1
+#endif
 
 namespace android {
 
-ColorConverter::ColorConverter(
-        OMX_COLOR_FORMATTYPE from, OMX_COLOR_FORMATTYPE to)
-    : mSrcFormat(from),
-      mDstFormat(to),
-      mClip(NULL) {
-}
+// B = 1.164 * (Y - 16) + 2.018 * (U - 128)
+// G = 1.164 * (Y - 16) - 0.813 * (V - 128) - 0.391 * (U - 128)
+// R = 1.164 * (Y - 16) + 1.596 * (V - 128)
 
-ColorConverter::~ColorConverter() {
-    delete[] mClip;
-    mClip = NULL;
-}
+// B = 298/256 * (Y - 16) + 517/256 * (U - 128)
+// G = .................. - 208/256 * (V - 128) - 100/256 * (U - 128)
+// R = .................. + 409/256 * (V - 128)
 
-bool ColorConverter::isValid() const {
-    if (mDstFormat != OMX_COLOR_Format16bitRGB565) {
-        return false;
-    }
+// The sums are shifted down by 8 bits, which only differs from dividing them
+// by 256 for negative sums, and those clip to 0 either way.
 
-    switch (mSrcFormat) {
-        case OMX_COLOR_FormatYUV420Planar:
-        case OMX_COLOR_FormatCbYCrY:
-        case OMX_QCOM_COLOR_FormatYVU420SemiPlanar:
-        case OMX_COLOR_FormatYUV420SemiPlanar:
-        case OMX_TI_COLOR_FormatYUV420PackedSemiPlanar:
-            return true;
+enum ChromaLayout {
+    kChromaPlanar,      // U and V planes, u[x / 2] and v[x / 2]
+    kChromaInterleaved, // U and V bytes alternate, u[x & ~1] and v[x & ~1]
+    kChromaPacked,      // U Y0 V Y1, all of them in the luma row
+    kChromaFull,        // one sample per pixel, u[x] and v[x]
+};
 
-        default:
-            return false;
-    }
-}
+struct ColorConverter::Source {
+    ChromaLayout mChroma;
 
-ColorConverter::BitmapParams::BitmapParams(
-        void *bits,
-        size_t width, size_t height,
-        size_t cropLeft, size_t cropTop,
-        size_t cropRight, size_t cropBottom)
-    : mBits(bits),
-      mWidth(width),
-      mHeight(height),
-      mCropLeft(cropLeft),
-      mCropTop(cropTop),
-      mCropRight(cropRight),
-      mCropBottom(cropBottom) {
-}
+    // The semi-planar formats have always been converted with U and V
+    // swapped, and R and B swapped in the output; kept as is.
+    bool mSwapRB;
 
-size_t ColorConverter::BitmapParams::cropWidth() const {
-    return mCropRight - mCropLeft + 1;
-}
+    const uint8_t *mY;      // first pixel of the crop rectangle
+    size_t mYStride;
+    const uint8_t *mU;      // chroma of the first row of the crop rectangle
+    const uint8_t *mV;
+    size_t mCStride;
+    size_t mTop;            // first row of the crop rectangle
 
-size_t ColorConverter::BitmapParams::cropHeight() const {
-    return mCropBottom - mCropTop + 1;
-}
+    size_t mWidth;          // of the crop rectangle
+    size_t mHeight;
 
-status_t ColorConverter::convert(
-        const void *srcBits,
-        size_t srcWidth, size_t srcHeight,
-        size_t srcCropLeft, size_t srcCropTop,
-        size_t srcCropRight, size_t srcCropBottom,
-        void *dstBits,
-        size_t dstWidth, size_t dstHeight,
-        size_t dstCropLeft, size_t dstCropTop,
-        size_t dstCropRight, size_t dstCropBottom) {
-    if (mDstFormat != OMX_COLOR_Format16bitRGB565) {
-        return ERROR_UNSUPPORTED;
+    const uint8_t *lumaRow(size_t y) const {
+        return mY + y * mYStride;
     }
 
-    BitmapParams src(
-            const_cast<void *>(srcBits),
-            srcWidth, srcHeight,
-            srcCropLeft, srcCropTop, srcCropRight, srcCropBottom);
-
-    BitmapParams dst(
-            dstBits,
-            dstWidth, dstHeight,
-            dstCropLeft, dstCropTop, dstCropRight, dstCropBottom);
-
-    status_t err;
-
-    switch (mSrcFormat) {
-        case OMX_COLOR_FormatYUV420Planar:
-            err = convertYUV420Planar(src, dst);
-            break;
+    size_t chromaRow(size_t y) const {
+        return ((mTop & 1) + y) >> 1;
+    }
+};
 
-        case OMX_COLOR_FormatCbYCrY:
-            err = convertCbYCrY(src, dst);
-            break;
+struct ColorConverter::Job {
+    const Source *mSource;
+    bool mRGBA;
+    uint8_t *mDst;          // first pixel of the destination crop rectangle
+    size_t mDstStride;      // in bytes
+    size_t mDstWidth;
+    size_t mDstHeight;
 
-        case OMX_QCOM_COLOR_FormatYVU420SemiPlanar:
-            err = convertQCOMYUV420SemiPlanar(src, dst);
-            break;
+    // Scaling only, mScratchSize bytes per band.
+    uint8_t *mScratch;
+    size_t mScratchSize;
+};
 
-        case OMX_COLOR_FormatYUV420SemiPlanar:
-            err = convertYUV420SemiPlanar(src, dst);
-            break;
+////////////////////////////////////////////////////////////////////////////////
 
-        case OMX_TI_COLOR_FormatYUV420PackedSemiPlanar:
-            err = convertTIYUV420PackedSemiPlanar(src, dst);
-            break;
+static inline uint8_t clip(int32_t x) {
+    return x < 0 ? 0 : (x > 255 ? 255 : x);
+}
 
-        default:
-        {
-            CHECK(!"Should not be here. Unknown color conversion.");
-            break;
-        }
+template<bool kRGBA>
+static inline void storePixel(
+        bool swapRB, int32_t luma, int32_t u, int32_t v,
+        uint8_t *dst, size_t x) {
+    int32_t tmp = (luma - 16) * 298;
+    u -= 128;
+    v -= 128;
+
+    int32_t r = (tmp + v * 409) >> 8;
+    int32_t g = (tmp - v * 208 - u * 100) >> 8;
+    int32_t b = (tmp + u * 517) >> 8;
+    if (swapRB) {
+        int32_t t = r;
+        r = b;
+        b = t;
     }
 
-    return err;
+    if (kRGBA) {
+        uint8_t *p = dst + 4 * x;
+        p[0] = clip(r);
+        p[1] = clip(g);
+        p[2] = clip(b);
+        p[3] = 0xff;
+    } else {
+        ((uint16_t *)dst)[x] =
+            ((clip(r) >> 3) << 11) | ((clip(g) >> 2) << 5) | (clip(b) >> 3);
+    }
 }
 
-status_t ColorConverter::convertCbYCrY(
-        const BitmapParams &src, const BitmapParams &dst) {
-    // XXX Untested
+#if defined(COLOR_CONVERTER_SSE2)
 
-    uint8_t *kAdjustedClip = initClip();
+static inline __m128i coefficients(int16_t a, int16_t b) {
+    return _mm_set1_epi32((uint16_t)a | ((uint32_t)(uint16_t)b << 16));
+}
 
-    if (!((src.mCropLeft & 1) == 0
-        && src.cropWidth() == dst.cropWidth()
-        && src.cropHeight() == dst.cropHeight())) {
-        return ERROR_UNSUPPORTED;
+static inline __m128i shiftAndClip(__m128i lo, __m128i hi) {
+    __m128i x = _mm_packs_epi32(_mm_srai_epi32(lo, 8), _mm_srai_epi32(hi, 8));
+    return _mm_min_epi16(
+            _mm_max_epi16(x, _mm_setzero_si128()), _mm_set1_epi16(255));
+}
+
+// Converts 8 pixels given as 16 bit Y, U and V samples, one of each per pixel.
+// The sums are formed exactly in 32 bits, two products at a time.
+template<bool kRGBA>
+static inline void convert8(
+        bool swapRB, __m128i y, __m128i u, __m128i v, uint8_t *dst) {
+    y = _mm_sub_epi16(y, _mm_set1_epi16(16));
+    u = _mm_sub_epi16(u, _mm_set1_epi16(128));
+    v = _mm_sub_epi16(v, _mm_set1_epi16(128));
+
+    __m128i yuLo = _mm_unpacklo_epi16(y, u);
+    __m128i yuHi = _mm_unpackhi_epi16(y, u);
+    __m128i yvLo = _mm_unpacklo_epi16(y, v);
+    __m128i yvHi = _mm_unpackhi_epi16(y, v);
+    __m128i vvLo = _mm_unpacklo_epi16(v, v);
+    __m128i vvHi = _mm_unpackhi_epi16(v, v);
+
+    const __m128i kR = coefficients(298, 409);
+    const __m128i kGY = coefficients(298, -100);
+    const __m128i kGV = coefficients(-104, -104);
+    const __m128i kB = coefficients(298, 517);
+
+    __m128i r = shiftAndClip(
+            _mm_madd_epi16(yvLo, kR), _mm_madd_epi16(yvHi, kR));
+    __m128i g = shiftAndClip(
+            _mm_add_epi32(_mm_madd_epi16(yuLo, kGY), _mm_madd_epi16(vvLo, kGV)),
+            _mm_add_epi32(_mm_madd_epi16(yuHi, kGY), _mm_madd_epi16(vvHi, kGV)));
+    __m128i b = shiftAndClip(
+            _mm_madd_epi16(yuLo, kB), _mm_madd_epi16(yuHi, kB));
+    if (swapRB) {
+        __m128i t = r;
+        r = b;
+        b = t;
     }
 
-    uint16_t *dst_ptr = (uint16_t *)dst.mBits
-        + dst.mCropTop * dst.mWidth + dst.mCropLeft;
+    if (kRGBA) {
+        __m128i r8 = _mm_packus_epi16(r, r);
+        __m128i g8 = _mm_packus_epi16(g, g);
+        __m128i b8 = _mm_packus_epi16(b, b);
+        __m128i rg = _mm_unpacklo_epi8(r8, g8);
+        __m128i ba = _mm_unpacklo_epi8(b8, _mm_set1_epi8((char)0xff));
+        _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi16(rg, ba));
+    } else {
+        __m128i rgb = _mm_or_si128(
+                _mm_or_si128(
+                    _mm_slli_epi16(_mm_and_si128(r, _mm_set1_epi16(0xf8)), 8),
+                    _mm_slli_epi16(_mm_and_si128(g, _mm_set1_epi16(0xfc)), 3)),
+                _mm_srli_epi16(b, 3));
+        _mm_storeu_si128((__m128i *)dst, rgb);
+    }
+}
 
-    const uint8_t *src_ptr = (const uint8_t *)src.mBits
-        + (src.mCropTop * dst.mWidth + src.mCropLeft) * 2;
+static inline __m128i load4(const uint8_t *p) {
+    int32_t x;
+    memcpy(&x, p, sizeof(x));
+    return _mm_unpacklo_epi8(_mm_cvtsi32_si128(x), _mm_setzero_si128());
+}
 
-    for (size_t y = 0; y < src.cropHeight(); ++y) {
-        for (size_t x = 0; x < src.cropWidth(); x += 2) {
-            signed y1 = (signed)src_ptr[2 * x + 1] - 16;
-            signed y2 = (signed)src_ptr[2 * x + 3] - 16;
-            signed u = (signed)src_ptr[2 * x] - 128;
-            signed v = (signed)src_ptr[2 * x + 2] - 128;
+static inline __m128i load8(const uint8_t *p) {
+    return _mm_unpacklo_epi8(
+            _mm_loadl_epi64((const __m128i *)p), _mm_setzero_si128());
+}
 
-            signed u_b = u * 517;
-            signed u_g = -u * 100;
-            signed v_g = -v * 208;
-            signed v_r = v * 409;
+// Lanes 0, 2, 4 and 6 of 16 bit U/V pairs, each one twice.
+static inline __m128i evenLanes(__m128i x) {
+    return _mm_shufflehi_epi16(
+            _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 2, 0, 0)),
+            _MM_SHUFFLE(2, 2, 0, 0));
+}
 
-            signed tmp1 = y1 * 298;
-            signed b1 = (tmp1 + u_b) / 256;
-            signed g1 = (tmp1 + v_g + u_g) / 256;
-            signed r1 = (tmp1 + v_r) / 256;
+static inline __m128i oddLanes(__m128i x) {
+    return _mm_shufflehi_epi16(
+            _mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 1, 1)),
+            _MM_SHUFFLE(3, 3, 1, 1));
+}
 
-            signed tmp2 = y2 * 298;
-            signed b2 = (tmp2 + u_b) / 256;
-            signed g2 = (tmp2 + v_g + u_g) / 256;
-            signed r2 = (tmp2 + v_r) / 256;
+// Returns the number of pixels converted, a multiple of 8.
+template<ChromaLayout kChroma, bool kRGBA>
+static size_t convertRowSIMD(
+        bool swapRB,
+        const uint8_t *y, const uint8_t *u, const uint8_t *v,
+        size_t width, uint8_t *dst) {
+    const uint8_t *uv = u < v ? u : v;
+    const bool uFirst = u < v;
+    const size_t bpp = kRGBA ? 4 : 2;
+
+    size_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i luma, cu, cv;
+        switch (kChroma) {
+            case kChromaPlanar:
+            {
+                luma = load8(y + x);
+                cu = load4(u + x / 2);
+                cv = load4(v + x / 2);
+                cu = _mm_unpacklo_epi16(cu, cu);
+                cv = _mm_unpacklo_epi16(cv, cv);
+                break;
+            }
 
-            uint32_t rgb1 =
-                ((kAdjustedClip[r1] >> 3) << 11)
-                | ((kAdjustedClip[g1] >> 2) << 5)
-                | (kAdjustedClip[b1] >> 3);
+            case kChromaInterleaved:
+            {
+                luma = load8(y + x);
+                __m128i c = load8(uv + x);
+                cu = uFirst ? evenLanes(c) : oddLanes(c);
+                cv = uFirst ? oddLanes(c) : evenLanes(c);
+                break;
+            }
 
-            uint32_t rgb2 =
-                ((kAdjustedClip[r2] >> 3) << 11)
-                | ((kAdjustedClip[g2] >> 2) << 5)
-                | (kAdjustedClip[b2] >> 3);
+            case kChromaPacked:
+            {
+                __m128i p = _mm_loadu_si128((const __m128i *)(y + 2 * x));
+                __m128i c = _mm_and_si128(p, _mm_set1_epi16(0xff));
+                luma = _mm_srli_epi16(p, 8);
+                cu = evenLanes(c);
+                cv = oddLanes(c);
+                break;
+            }
 
-            if (x + 1 < src.cropWidth()) {
-                *(uint32_t *)(&dst_ptr[x]) = (rgb2 << 16) | rgb1;
-            } else {
-                dst_ptr[x] = rgb1;
+            default:
+            {
+                luma = load8(y + x);
+                cu = load8(u + x);
+                cv = load8(v + x);
+                break;
             }
         }
 
-        src_ptr += src.mWidth * 2;
-        dst_ptr += dst.mWidth;
+        convert8<kRGBA>(swapRB, luma, cu, cv, dst + bpp * x);
     }
 
-    return OK;
+    return x;
 }
 
-status_t ColorConverter::convertYUV420Planar(
-        const BitmapParams &src, const BitmapParams &dst) {
-    if (!((src.mCropLeft & 1) == 0
-            && src.cropWidth() == dst.cropWidth()
-            && src.cropHeight() == dst.cropHeight())) {
-        return ERROR_UNSUPPORTED;
+#elif defined(COLOR_CONVERTER_NEON)
+
+// Converts 8 pixels given as Y, U and V samples, one of each per pixel.
+template<bool kRGBA>
+static inline void convert8(
+        bool swapRB, uint8x8_t y8, uint8x8_t u8, uint8x8_t v8, uint8_t *dst) {
+    int16x8_t y = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(y8)), vdupq_n_s16(16));
+    int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), vdupq_n_s16(128));
+    int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), vdupq_n_s16(128));
+
+    int32x4_t yLo = vmull_n_s16(vget_low_s16(y), 298);
+    int32x4_t yHi = vmull_n_s16(vget_high_s16(y), 298);
+
+    int32x4_t rLo = vmlal_n_s16(yLo, vget_low_s16(v), 409);
+    int32x4_t rHi = vmlal_n_s16(yHi, vget_high_s16(v), 409);
+    int32x4_t gLo = vmlal_n_s16(
+            vmlal_n_s16(yLo, vget_low_s16(v), -208), vget_low_s16(u), -100);
+    int32x4_t gHi = vmlal_n_s16(
+            vmlal_n_s16(yHi, vget_high_s16(v), -208), vget_high_s16(u), -100);
+    int32x4_t bLo = vmlal_n_s16(yLo, vget_low_s16(u), 517);
+    int32x4_t bHi = vmlal_n_s16(yHi, vget_high_s16(u), 517);
+
+    uint8x8_t r = vqmovun_s16(vcombine_s16(vshrn_n_s32(rLo, 8), vshrn_n_s32(rHi, 8)));
+    uint8x8_t g = vqmovun_s16(vcombine_s16(vshrn_n_s32(gLo, 8), vshrn_n_s32(gHi, 8)));
+    uint8x8_t b = vqmovun_s16(vcombine_s16(vshrn_n_s32(bLo, 8), vshrn_n_s32(bHi, 8)));
+    if (swapRB) {
+        uint8x8_t t = r;
+        r = b;
+        b = t;
     }
 
-    uint8_t *kAdjustedClip = initClip();
-
-    uint16_t *dst_ptr = (uint16_t *)dst.mBits
-        + dst.mCropTop * dst.mWidth + dst.mCropLeft;
-
-    const uint8_t *src_y =
-        (const uint8_t *)src.mBits + src.mCropTop * src.mWidth + src.mCropLeft;
-
-    const uint8_t *src_u =
-        (const uint8_t *)src_y + src.mWidth * src.mHeight
-        + src.mCropTop * (src.mWidth / 2) + src.mCropLeft / 2;
-
-    const uint8_t *src_v =
-        src_u + (src.mWidth / 2) * (src.mHeight / 2);
-
-    for (size_t y = 0; y < src.cropHeight(); ++y) {
-        for (size_t x = 0; x < src.cropWidth(); x += 2) {
-            // B = 1.164 * (Y - 16) + 2.018 * (U - 128)
-            // G = 1.164 * (Y - 16) - 0.813 * (V - 128) - 0.391 * (U - 128)
-            // R = 1.164 * (Y - 16) + 1.596 * (V - 128)
+    if (kRGBA) {
+        uint8x8x4_t rgba;
+        rgba.val[0] = r;
+        rgba.val[1] = g;
+        rgba.val[2] = b;
+        rgba.val[3] = vdup_n_u8(0xff);
+        vst4_u8(dst, rgba);
+    } else {
+        uint16x8_t rgb = vshll_n_u8(r, 8);
+        rgb = vsriq_n_u16(rgb, vshll_n_u8(g, 8), 5);
+        rgb = vsriq_n_u16(rgb, vshll_n_u8(b, 8), 11);
+        vst1q_u16((uint16_t *)dst, rgb);
+    }
+}
 
-            // B = 298/256 * (Y - 16) + 517/256 * (U - 128)
-            // G = .................. - 208/256 * (V - 128) - 100/256 * (U - 128)
-            // R = .................. + 409/256 * (V - 128)
+// 4 bytes, each one twice.
+static inline uint8x8_t load4Twice(const uint8_t *p) {
+    uint32_t x;
+    memcpy(&x, p, sizeof(x));
+    uint8x8_t c = vreinterpret_u8_u32(vdup_n_u32(x));
+    return vzip_u8(c, c).val[0];
+}
 
-            // min_B = (298 * (- 16) + 517 * (- 128)) / 256 = -277
-            // min_G = (298 * (- 16) - 208 * (255 - 128) - 100 * (255 - 128)) / 256 = -172
-            // min_R = (298 * (- 16) + 409 * (- 128)) / 256 = -223
+// Returns the number of pixels converted, a multiple of 8.
+template<ChromaLayout kChroma, bool kRGBA>
+static size_t convertRowSIMD(
+        bool swapRB,
+        const uint8_t *y, const uint8_t *u, const uint8_t *v,
+        size_t width, uint8_t *dst) {
+    const uint8_t *uv = u < v ? u : v;
+    const bool uFirst = u < v;
+    const size_t bpp = kRGBA ? 4 : 2;
+
+    size_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        uint8x8_t luma, cu, cv;
+        switch (kChroma) {
+            case kChromaPlanar:
+            {
+                luma = vld1_u8(y + x);
+                cu = load4Twice(u + x / 2);
+                cv = load4Twice(v + x / 2);
+                break;
+            }
 
-            // max_B = (298 * (255 - 16) + 517 * (255 - 128)) / 256 = 534
-            // max_G = (298 * (255 - 16) - 208 * (- 128) - 100 * (- 128)) / 256 = 432
-            // max_R = (298 * (255 - 16) + 409 * (255 - 128)) / 256 = 481
+            case kChromaInterleaved:
+            {
+                luma = vld1_u8(y + x);
+                uint8x8_t c = vld1_u8(uv + x);
+                uint8x8x2_t split = vuzp_u8(c, c);
+                uint8x8_t even = vzip_u8(split.val[0], split.val[0]).val[0];
+                uint8x8_t odd = vzip_u8(split.val[1], split.val[1]).val[0];
+                cu = uFirst ? even : odd;
+                cv = uFirst ? odd : even;
+                break;
+            }
 
-            // clip range -278 .. 535
+            case kChromaPacked:
+            {
+                uint8x8x2_t p = vld2_u8(y + 2 * x);
+                uint8x8x2_t split = vuzp_u8(p.val[0], p.val[0]);
+                luma = p.val[1];
+                cu = vzip_u8(split.val[0], split.val[0]).val[0];
+                cv = vzip_u8(split.val[1], split.val[1]).val[0];
+                break;
+            }
 
-            signed y1 = (signed)src_y[x] - 16;
-            signed y2 = (signed)src_y[x + 1] - 16;
+            default:
+            {
+                luma = vld1_u8(y + x);
+                cu = vld1_u8(u + x);
+                cv = vld1_u8(v + x);
+                break;
+            }
+        }
 
-            signed u = (signed)src_u[x / 2] - 128;
-            signed v = (signed)src_v[x / 2] - 128;
+        convert8<kRGBA>(swapRB, luma, cu, cv, dst + bpp * x);
+    }
 
-            signed u_b = u * 517;
-            signed u_g = -u * 100;
-            signed v_g = -v * 208;
-            signed v_r = v * 409;
+    return x;
+}
 
-            signed tmp1 = y1 * 298;
-            signed b1 = (tmp1 + u_b) / 256;
-            signed g1 = (tmp1 + v_g + u_g) / 256;
-            signed r1 = (tmp1 + v_r) / 256;
+#endif
+
+template<ChromaLayout kChroma, bool kRGBA>
+static void convertRow(
+        bool swapRB,
+        const uint8_t *y, const uint8_t *u, const uint8_t *v,
+        size_t width, uint8_t *dst) {
+    size_t x = 0;
+#if defined(COLOR_CONVERTER_SSE2) || defined(COLOR_CONVERTER_NEON)
+    x = convertRowSIMD<kChroma, kRGBA>(swapRB, y, u, v, width, dst);
+#endif
+
+    for (; x < width; ++x) {
+        switch (kChroma) {
+            case kChromaPlanar:
+                storePixel<kRGBA>(swapRB, y[x], u[x / 2], v[x / 2], dst, x);
+                break;
+
+            case kChromaInterleaved:
+                storePixel<kRGBA>(swapRB, y[x], u[x & ~1], v[x & ~1], dst, x);
+                break;
+
+            case kChromaPacked:
+                storePixel<kRGBA>(
+                        swapRB, y[2 * x + 1], y[2 * (x & ~1)], y[2 * (x & ~1) + 2],
+                        dst, x);
+                break;
+
+            default:
+                storePixel<kRGBA>(swapRB, y[x], u[x], v[x], dst, x);
+                break;
+        }
+    }
+}
 
-            signed tmp2 = y2 * 298;
-            signed b2 = (tmp2 + u_b) / 256;
-            signed g2 = (tmp2 + v_g + u_g) / 256;
-            signed r2 = (tmp2 + v_r) / 256;
+template<bool kRGBA>
+static void convertRow(
+        ChromaLayout chroma, bool swapRB,
+        const uint8_t *y, const uint8_t *u, const uint8_t *v,
+        size_t width, uint8_t *dst) {
+    switch (chroma) {
+        case kChromaPlanar:
+            convertRow<kChromaPlanar, kRGBA>(swapRB, y, u, v, width, dst);
+            break;
 
-            uint32_t rgb1 =
-                ((kAdjustedClip[r1] >> 3) << 11)
-                | ((kAdjustedClip[g1] >> 2) << 5)
-                | (kAdjustedClip[b1] >> 3);
+        case kChromaInterleaved:
+            convertRow<kChromaInterleaved, kRGBA>(swapRB, y, u, v, width, dst);
+            break;
 
-            uint32_t rgb2 =
-                ((kAdjustedClip[r2] >> 3) << 11)
-                | ((kAdjustedClip[g2] >> 2) << 5)
-                | (kAdjustedClip[b2] >> 3);
+        case kChromaPacked:
+            convertRow<kChromaPacked, kRGBA>(swapRB, y, u, v, width, dst);
+            break;
 
-            if (x + 1 < src.cropWidth()) {
-                *(uint32_t *)(&dst_ptr[x]) = (rgb2 << 16) | rgb1;
-            } else {
-                dst_ptr[x] = rgb1;
-            }
-        }
+        default:
+            convertRow<kChromaFull, kRGBA>(swapRB, y, u, v, width, dst);
+            break;
+    }
+}
 
-        src_y += src.mWidth;
+static void convertRow(
+        bool rgba, ChromaLayout chroma, bool swapRB,
+        const uint8_t *y, const uint8_t *u, const uint8_t *v,
+        size_t width, uint8_t *dst) {
+    if (rgba) {
+        convertRow<true>(chroma, swapRB, y, u, v, width, dst);
+    } else {
+        convertRow<false>(chroma, swapRB, y, u, v, width, dst);
+    }
+}
 
-        if (y & 1) {
-            src_u += src.mWidth / 2;
-            src_v += src.mWidth / 2;
+////////////////////////////////////////////////////////////////////////////////
+
+// Threads for the bands of rows of a frame, the calling thread converts the
+// first band.
+struct ColorConverter::Workers {
+    Workers(size_t numThreads);
+    ~Workers();
+
+    // Runs func(cookie, band, numBands) for every band, numBands is at most
+    // the number of threads.
+    void run(void (*func)(void *, size_t, size_t), void *cookie, size_t numBands);
+
+private:
+    struct Thread {
+        Workers *mWorkers;
+        size_t mBand;
+        pthread_t mThread;
+    };
+
+    Mutex mLock;
+    Condition mStartCondition;
+    Condition mDoneCondition;
+
+    Thread *mThreads;
+    size_t mNumThreads;     // started, the calling thread not included
+
+    uint32_t mGeneration;
+    size_t mPending;
+    bool mExit;
+
+    void (*mFunc)(void *, size_t, size_t);
+    void *mCookie;
+    size_t mNumBands;
+
+    static void *ThreadWrapper(void *me);
+    void threadEntry(size_t band);
+
+    Workers(const Workers &);
+    Workers &operator=(const Workers &);
+};
+
+ColorConverter::Workers::Workers(size_t numThreads)
+    : mThreads(new Thread[numThreads - 1]),
+      mNumThreads(0),
+      mGeneration(0),
+      mPending(0),
+      mExit(false),
+      mFunc(NULL),
+      mCookie(NULL),
+      mNumBands(0) {
+    for (size_t i = 0; i + 1 < numThreads; ++i) {
+        Thread *thread = &mThreads[mNumThreads];
+        thread->mWorkers = this;
+        thread->mBand = mNumThreads + 1;
+        if (pthread_create(&thread->mThread, NULL, ThreadWrapper, thread) != 0) {
+            ALOGW("Failed to start conversion thread %zu", mNumThreads + 1);
+            break;
         }
-
-        dst_ptr += dst.mWidth;
+        ++mNumThreads;
     }
-
-    return OK;
 }
 
-status_t ColorConverter::convertQCOMYUV420SemiPlanar(
-        const BitmapParams &src, const BitmapParams &dst) {
-    uint8_t *kAdjustedClip = initClip();
-
-    if (!((src.mCropLeft & 1) == 0
-            && src.cropWidth() == dst.cropWidth()
-            && src.cropHeight() == dst.cropHeight())) {
-        return ERROR_UNSUPPORTED;
+ColorConverter::Workers::~Workers() {
+    {
+        Mutex::Autolock autoLock(mLock);
+        mExit = true;
+        mStartCondition.broadcast();
     }
 
-    uint16_t *dst_ptr = (uint16_t *)dst.mBits
-        + dst.mCropTop * dst.mWidth + dst.mCropLeft;
+    for (size_t i = 0; i < mNumThreads; ++i) {
+        pthread_join(mThreads[i].mThread, NULL);
+    }
+    delete[] mThreads;
+}
 
-    const uint8_t *src_y =
-        (const uint8_t *)src.mBits + src.mCropTop * src.mWidth + src.mCropLeft;
+// static
+void *ColorConverter::Workers::ThreadWrapper(void *me) {
+    Thread *thread = static_cast<Thread *>(me);
+    thread->mWorkers->threadEntry(thread->mBand);
+    return NULL;
+}
 
-    const uint8_t *src_u =
-        (const uint8_t *)src_y + src.mWidth * src.mHeight
-        + src.mCropTop * src.mWidth + src.mCropLeft;
+void ColorConverter::Workers::threadEntry(size_t band) {
+    Mutex::Autolock autoLock(mLock);
 
-    for (size_t y = 0; y < src.cropHeight(); ++y) {
-        for (size_t x = 0; x < src.cropWidth(); x += 2) {
-            signed y1 = (signed)src_y[x] - 16;
-            signed y2 = (signed)src_y[x + 1] - 16;
+    // Not read from mGeneration, a job may have been posted already.
+    uint32_t generation = 0;
+    for (;;) {
+        while (!mExit && mGeneration == generation) {
+            mStartCondition.wait(mLock);
+        }
+        if (mExit) {
+            break;
+        }
+        generation = mGeneration;
 
-            signed u = (signed)src_u[x & ~1] - 128;
-            signed v = (signed)src_u[(x & ~1) + 1] - 128;
+        if (band < mNumBands) {
+            void (*func)(void *, size_t, size_t) = mFunc;
+            void *cookie = mCookie;
+            size_t numBands = mNumBands;
 
-            signed u_b = u * 517;
-            signed u_g = -u * 100;
-            signed v_g = -v * 208;
-            signed v_r = v * 409;
+            mLock.unlock();
+            func(cookie, band, numBands);
+            mLock.lock();
 
-            signed tmp1 = y1 * 298;
-            signed b1 = (tmp1 + u_b) / 256;
-            signed g1 = (tmp1 + v_g + u_g) / 256;
-            signed r1 = (tmp1 + v_r) / 256;
+            if (--mPending == 0) {
+                mDoneCondition.signal();
+            }
+        }
+    }
+}
 
-            signed tmp2 = y2 * 298;
-            signed b2 = (tmp2 + u_b) / 256;
-            signed g2 = (tmp2 + v_g + u_g) / 256;
-            signed r2 = (tmp2 + v_r) / 256;
+void ColorConverter::Workers::run(
+        void (*func)(void *, size_t, size_t), void *cookie, size_t numBands) {
+    if (numBands > mNumThreads + 1) {
+        numBands = mNumThreads + 1;
+    }
 
-            uint32_t rgb1 =
-                ((kAdjustedClip[b1] >> 3) << 11)
-                | ((kAdjustedClip[g1] >> 2) << 5)
-                | (kAdjustedClip[r1] >> 3);
+    {
+        Mutex::Autolock autoLock(mLock);
+        mFunc = func;
+        mCookie = cookie;
+        mNumBands = numBands;
+        mPending = numBands - 1;
+        ++mGeneration;
+        mStartCondition.broadcast();
+    }
 
-            uint32_t rgb2 =
-                ((kAdjustedClip[b2] >> 3) << 11)
-                | ((kAdjustedClip[g2] >> 2) << 5)
-                | (kAdjustedClip[r2] >> 3);
+    func(cookie, 0, numBands);
 
-            if (x + 1 < src.cropWidth()) {
-                *(uint32_t *)(&dst_ptr[x]) = (rgb2 << 16) | rgb1;
-            } else {
-                dst_ptr[x] = rgb1;
-            }
-        }
+    Mutex::Autolock autoLock(mLock);
+    while (mPending > 0) {
+        mDoneCondition.wait(mLock);
+    }
+}
 
-        src_y += src.mWidth;
+////////////////////////////////////////////////////////////////////////////////
 
-        if (y & 1) {
-            src_u += src.mWidth;
+ColorConverter::ColorConverter(
+        OMX_COLOR_FORMATTYPE from, OMX_COLOR_FORMATTYPE to)
+    : mSrcFormat(from),
+      mDstFormat(to),
+      mNumThreads(1),
+      mWorkers(NULL) {
+    long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (numCpus > 1) {
+        mNumThreads = numCpus;
+        if (mNumThreads > kMaxDefaultThreads) {
+            mNumThreads = kMaxDefaultThreads;
         }
-
-        dst_ptr += dst.mWidth;
     }
+}
 
-    return OK;
+ColorConverter::~ColorConverter() {
+    delete mWorkers;
+    mWorkers = NULL;
 }
 
-status_t ColorConverter::convertYUV420SemiPlanar(
-        const BitmapParams &src, const BitmapParams &dst) {
-    // XXX Untested
+bool ColorConverter::isValid() const {
+    if (mDstFormat != OMX_COLOR_Format16bitRGB565
+            && mDstFormat != kColorFormatRGBA8888) {
+        return false;
+    }
 
-    uint8_t *kAdjustedClip = initClip();
+    switch (mSrcFormat) {
+        case OMX_COLOR_FormatYUV420Planar:
+        case OMX_COLOR_FormatCbYCrY:
+        case OMX_QCOM_COLOR_FormatYVU420SemiPlanar:
+        case OMX_COLOR_FormatYUV420SemiPlanar:
+        case OMX_TI_COLOR_FormatYUV420PackedSemiPlanar:
+            return true;
 
-    if (!((src.mCropLeft & 1) == 0
-            && src.cropWidth() == dst.cropWidth()
-            && src.cropHeight() == dst.cropHeight())) {
-        return ERROR_UNSUPPORTED;
+        default:
+            return false;
     }
+}
 
-    uint16_t *dst_ptr = (uint16_t *)dst.mBits
-        + dst.mCropTop * dst.mWidth + dst.mCropLeft;
+void ColorConverter::setNumThreads(size_t numThreads) {
+    if (numThreads < 1) {
+        numThreads = 1;
+    } else if (numThreads > kMaxThreads) {
+        numThreads = kMaxThreads;
+    }
 
-    const uint8_t *src_y =
-        (const uint8_t *)src.mBits + src.mCropTop * src.mWidth + src.mCropLeft;
+    if (numThreads != mNumThreads) {
+        delete mWorkers;
+        mWorkers = NULL;
+        mNumThreads = numThreads;
+    }
+}
 
-    const uint8_t *src_u =
-        (const uint8_t *)src_y + src.mWidth * src.mHeight
-        + src.mCropTop * src.mWidth + src.mCropLeft;
+ColorConverter::BitmapParams::BitmapParams(
+        void *bits,
+        size_t width, size_t height,
+        size_t cropLeft, size_t cropTop,
+        size_t cropRight, size_t cropBottom)
+    : mBits(bits),
+      mWidth(width),
+      mHeight(height),
+      mCropLeft(cropLeft),
+      mCropTop(cropTop),
+      mCropRight(cropRight),
+      mCropBottom(cropBottom) {
+}
 
-    for (size_t y = 0; y < src.cropHeight(); ++y) {
-        for (size_t x = 0; x < src.cropWidth(); x += 2) {
-            signed y1 = (signed)src_y[x] - 16;
-            signed y2 = (signed)src_y[x + 1] - 16;
+size_t ColorConverter::BitmapParams::cropWidth() const {
+    return mCropRight - mCropLeft + 1;
+}
 
-            signed v = (signed)src_u[x & ~1] - 128;
-            signed u = (signed)src_u[(x & ~1) + 1] - 128;
+size_t ColorConverter::BitmapParams::cropHeight() const {
+    return mCropBottom - mCropTop + 1;
+}
 
-            signed u_b = u * 517;
-            signed u_g = -u * 100;
-            signed v_g = -v * 208;
-            signed v_r = v * 409;
+status_t ColorConverter::initSource(
+        const BitmapParams &src, Source *source) const {
+    // Pixels are converted in pairs sharing their chroma.
+    if ((src.mCropLeft & 1) != 0) {
+        return ERROR_UNSUPPORTED;
+    }
 
-            signed tmp1 = y1 * 298;
-            signed b1 = (tmp1 + u_b) / 256;
-            signed g1 = (tmp1 + v_g + u_g) / 256;
-            signed r1 = (tmp1 + v_r) / 256;
+    const uint8_t *bits = (const uint8_t *)src.mBits;
+    const size_t width = src.mWidth;
+    const size_t height = src.mHeight;
+    const size_t cropLeft = src.mCropLeft;
+    const size_t cropTop = src.mCropTop;
 
-            signed tmp2 = y2 * 298;
-            signed b2 = (tmp2 + u_b) / 256;
-            signed g2 = (tmp2 + v_g + u_g) / 256;
-            signed r2 = (tmp2 + v_r) / 256;
+    source->mSwapRB = false;
+    source->mY = bits + cropTop * width + cropLeft;
+    source->mYStride = width;
+    source->mCStride = width;
+    source->mTop = cropTop;
+    source->mWidth = src.cropWidth();
+    source->mHeight = src.cropHeight();
 
-            uint32_t rgb1 =
-                ((kAdjustedClip[b1] >> 3) << 11)
-                | ((kAdjustedClip[g1] >> 2) << 5)
-                | (kAdjustedClip[r1] >> 3);
+    switch (mSrcFormat) {
+        case OMX_COLOR_FormatYUV420Planar:
+        {
+            source->mChroma = kChromaPlanar;
+            source->mU = bits + width * height
+                + (cropTop / 2) * (width / 2) + cropLeft / 2;
+            source->mV = source->mU + (width / 2) * (height / 2);
+            source->mCStride = width / 2;
+            break;
+        }
 
-            uint32_t rgb2 =
-                ((kAdjustedClip[b2] >> 3) << 11)
-                | ((kAdjustedClip[g2] >> 2) << 5)
-                | (kAdjustedClip[r2] >> 3);
+        case OMX_COLOR_FormatCbYCrY:
+        {
+            source->mChroma = kChromaPacked;
+            source->mY = bits + (cropTop * width + cropLeft) * 2;
+            source->mYStride = width * 2;
+            source->mU = source->mV = NULL;
+            source->mCStride = 0;
+            break;
+        }
 
-            if (x + 1 < src.cropWidth()) {
-                *(uint32_t *)(&dst_ptr[x]) = (rgb2 << 16) | rgb1;
-            } else {
-                dst_ptr[x] = rgb1;
-            }
+        case OMX_QCOM_COLOR_FormatYVU420SemiPlanar:
+        {
+            source->mChroma = kChromaInterleaved;
+            source->mSwapRB = true;
+            source->mU = bits + width * height + (cropTop / 2) * width + cropLeft;
+            source->mV = source->mU + 1;
+            break;
         }
 
-        src_y += src.mWidth;
+        case OMX_COLOR_FormatYUV420SemiPlanar:
+        {
+            source->mChroma = kChromaInterleaved;
+            source->mSwapRB = true;
+            source->mV = bits + width * height + (cropTop / 2) * width + cropLeft;
+            source->mU = source->mV + 1;
+            break;
+        }
 
-        if (y & 1) {
-            src_u += src.mWidth;
+        case OMX_TI_COLOR_FormatYUV420PackedSemiPlanar:
+        {
+            // The buffer starts at the crop rectangle, "height" includes the
+            // rows above it.
+            source->mChroma = kChromaInterleaved;
+            source->mY = bits;
+            source->mU = bits + width * (height - cropTop + cropTop / 2);
+            source->mV = source->mU + 1;
+            break;
         }
 
-        dst_ptr += dst.mWidth;
+        default:
+            return ERROR_UNSUPPORTED;
     }
 
     return OK;
 }
 
-status_t ColorConverter::convertTIYUV420PackedSemiPlanar(
-        const BitmapParams &src, const BitmapParams &dst) {
-    uint8_t *kAdjustedClip = initClip();
-
-    if (!((src.mCropLeft & 1) == 0
-            && src.cropWidth() == dst.cropWidth()
-            && src.cropHeight() == dst.cropHeight())) {
+status_t ColorConverter::convert(
+        const void *srcBits,
+        size_t srcWidth, size_t srcHeight,
+        size_t srcCropLeft, size_t srcCropTop,
+        size_t srcCropRight, size_t srcCropBottom,
+        void *dstBits,
+        size_t dstWidth, size_t dstHeight,
+        size_t dstCropLeft, size_t dstCropTop,
+        size_t dstCropRight, size_t dstCropBottom) {
+    if (!isValid()) {
         return ERROR_UNSUPPORTED;
     }
 
-    uint16_t *dst_ptr = (uint16_t *)dst.mBits
-        + dst.mCropTop * dst.mWidth + dst.mCropLeft;
+    BitmapParams src(
+            const_cast<void *>(srcBits),
+            srcWidth, srcHeight,
+            srcCropLeft, srcCropTop, srcCropRight, srcCropBottom);
+
+    BitmapParams dst(
+            dstBits,
+            dstWidth, dstHeight,
+            dstCropLeft, dstCropTop, dstCropRight, dstCropBottom);
 
-    const uint8_t *src_y = (const uint8_t *)src.mBits;
+    Source source;
+    status_t err = initSource(src, &source);
+    if (err != OK) {
+        return err;
+    }
 
-    const uint8_t *src_u =
-        (const uint8_t *)src_y + src.mWidth * (src.mHeight - src.mCropTop / 2);
+    Job job;
+    job.mSource = &source;
+    job.mRGBA = (mDstFormat == kColorFormatRGBA8888);
+    const size_t bpp = job.mRGBA ? 4 : 2;
+    job.mDst = (uint8_t *)dst.mBits + (dst.mCropTop * dst.mWidth + dst.mCropLeft) * bpp;
+    job.mDstStride = dst.mWidth * bpp;
+    job.mDstWidth = dst.cropWidth();
+    job.mDstHeight = dst.cropHeight();
+    job.mScratch = NULL;
+    job.mScratchSize = 0;
+
+    size_t numBands = 1;
+    if (mNumThreads > 1 && source.mWidth * source.mHeight >= kMinPixelsForThreads) {
+        numBands = mNumThreads < job.mDstHeight ? mNumThreads : job.mDstHeight;
+    }
 
-    for (size_t y = 0; y < src.cropHeight(); ++y) {
-        for (size_t x = 0; x < src.cropWidth(); x += 2) {
-            signed y1 = (signed)src_y[x] - 16;
-            signed y2 = (signed)src_y[x + 1] - 16;
+    void (*func)(void *, size_t, size_t) = ConvertRows;
+    if (job.mDstWidth != source.mWidth || job.mDstHeight != source.mHeight) {
+        func = ScaleRows;
+
+        // Column sums of the source rows, then the averaged samples of one
+        // destination row.
+        job.mScratchSize =
+            (source.mWidth * 3 * sizeof(uint32_t) + job.mDstWidth * 3 + 15) & ~15;
+        job.mScratch = (uint8_t *)malloc(job.mScratchSize * numBands);
+        if (job.mScratch == NULL) {
+            return NO_MEMORY;
+        }
+    }
 
-            signed u = (signed)src_u[x & ~1] - 128;
-            signed v = (signed)src_u[(x & ~1) + 1] - 128;
+    if (numBands > 1) {
+        if (mWorkers == NULL) {
+            mWorkers = new Workers(mNumThreads);
+        }
+        mWorkers->run(func, &job, numBands);
+    } else {
+        func(&job, 0, 1);
+    }
 
-            signed u_b = u * 517;
-            signed u_g = -u * 100;
-            signed v_g = -v * 208;
-            signed v_r = v * 409;
+    free(job.mScratch);
+    job.mScratch = NULL;
 
-            signed tmp1 = y1 * 298;
-            signed b1 = (tmp1 + u_b) / 256;
-            signed g1 = (tmp1 + v_g + u_g) / 256;
-            signed r1 = (tmp1 + v_r) / 256;
+    return OK;
+}
 
-            signed tmp2 = y2 * 298;
-            signed b2 = (tmp2 + u_b) / 256;
-            signed g2 = (tmp2 + v_g + u_g) / 256;
-            signed r2 = (tmp2 + v_r) / 256;
+// static
+void ColorConverter::ConvertRows(void *cookie, size_t band, size_t numBands) {
+    const Job *job = static_cast<const Job *>(cookie);
+    const Source *src = job->mSource;
+
+    size_t y = (src->mHeight * band) / numBands;
+    size_t end = (src->mHeight * (band + 1)) / numBands;
+    for (; y < end; ++y) {
+        const uint8_t *u = NULL;
+        const uint8_t *v = NULL;
+        if (src->mChroma != kChromaPacked) {
+            u = src->mU + src->chromaRow(y) * src->mCStride;
+            v = src->mV + src->chromaRow(y) * src->mCStride;
+        }
 
-            uint32_t rgb1 =
-                ((kAdjustedClip[r1] >> 3) << 11)
-                | ((kAdjustedClip[g1] >> 2) << 5)
-                | (kAdjustedClip[b1] >> 3);
+        convertRow(
+                job->mRGBA, src->mChroma, src->mSwapRB,
+                src->lumaRow(y), u, v, src->mWidth,
+                job->mDst + y * job->mDstStride);
+    }
+}
 
-            uint32_t rgb2 =
-                ((kAdjustedClip[r2] >> 3) << 11)
-                | ((kAdjustedClip[g2] >> 2) << 5)
-                | (kAdjustedClip[b2] >> 3);
+// Source pixels [*start, *end) covered by destination pixel i of n, at least
+// one.
+static inline void coveredRange(
+        size_t i, size_t n, size_t size, size_t *start, size_t *end) {
+    *start = (i * size) / n;
+    *end = ((i + 1) * size) / n;
+    if (*start >= size) {
+        *start = size - 1;
+    }
+    if (*end <= *start) {
+        *end = *start + 1;
+    }
+}
 
-            if (x + 1 < src.cropWidth()) {
-                *(uint32_t *)(&dst_ptr[x]) = (rgb2 << 16) | rgb1;
+// static
+void ColorConverter::ScaleRows(void *cookie, size_t band, size_t numBands) {
+    const Job *job = static_cast<const Job *>(cookie);
+    const Source *src = job->mSource;
+    const size_t width = src->mWidth;
+    const size_t chromaWidth = (width + 1) / 2;
+
+    uint32_t *sumY = (uint32_t *)(job->mScratch + band * job->mScratchSize);
+    uint32_t *sumU = sumY + width;
+    uint32_t *sumV = sumU + chromaWidth;
+    uint8_t *rowY = (uint8_t *)(sumY + 3 * width);
+    uint8_t *rowU = rowY + job->mDstWidth;
+    uint8_t *rowV = rowU + job->mDstWidth;
+
+    // The packed format has the chroma of every row, the others of every
+    // second one.
+    const bool packed = (src->mChroma == kChromaPacked);
+    const size_t chromaStep = (src->mChroma == kChromaInterleaved) ? 2 : 1;
+
+    size_t dy = (job->mDstHeight * band) / numBands;
+    size_t end = (job->mDstHeight * (band + 1)) / numBands;
+    for (; dy < end; ++dy) {
+        size_t y0, y1;
+        coveredRange(dy, job->mDstHeight, src->mHeight, &y0, &y1);
+
+        memset(sumY, 0, width * sizeof(uint32_t));
+        memset(sumU, 0, 2 * chromaWidth * sizeof(uint32_t));
+
+        for (size_t y = y0; y < y1; ++y) {
+            const uint8_t *row = src->lumaRow(y);
+            if (packed) {
+                for (size_t x = 0; x < width; ++x) {
+                    sumY[x] += row[2 * x + 1];
+                }
+                for (size_t x = 0; x < chromaWidth; ++x) {
+                    sumU[x] += row[4 * x];
+                    sumV[x] += row[4 * x + 2];
+                }
             } else {
-                dst_ptr[x] = rgb1;
+                for (size_t x = 0; x < width; ++x) {
+                    sumY[x] += row[x];
+                }
             }
         }
 
-        src_y += src.mWidth;
-
-        if (y & 1) {
-            src_u += src.mWidth;
+        size_t chromaRows = y1 - y0;
+        if (!packed) {
+            size_t c0 = src->chromaRow(y0);
+            size_t c1 = src->chromaRow(y1 - 1) + 1;
+            for (size_t c = c0; c < c1; ++c) {
+                const uint8_t *u = src->mU + c * src->mCStride;
+                const uint8_t *v = src->mV + c * src->mCStride;
+                for (size_t x = 0; x < chromaWidth; ++x) {
+                    sumU[x] += u[chromaStep * x];
+                    sumV[x] += v[chromaStep * x];
+                }
+            }
+            chromaRows = c1 - c0;
         }
 
-        dst_ptr += dst.mWidth;
-    }
-
-    return OK;
-}
-
-uint8_t *ColorConverter::initClip() {
-    static const signed kClipMin = -278;
-    static const signed kClipMax = 535;
-
-    if (mClip == NULL) {
-        mClip = new uint8_t[kClipMax - kClipMin + 1];
+        for (size_t dx = 0; dx < job->mDstWidth; ++dx) {
+            size_t x0, x1;
+            coveredRange(dx, job->mDstWidth, width, &x0, &x1);
 
-        for (signed i = kClipMin; i <= kClipMax; ++i) {
-            mClip[i - kClipMin] = (i < 0) ? 0 : (i > 255) ? 255 : (uint8_t)i;
+            uint32_t sum = 0;
+            for (size_t x = x0; x < x1; ++x) {
+                sum += sumY[x];
+            }
+            uint32_t count = (x1 - x0) * (y1 - y0);
+            rowY[dx] = (sum + count / 2) / count;
+
+            size_t c0 = x0 / 2;
+            size_t c1 = (x1 - 1) / 2 + 1;
+            uint32_t u = 0;
+            uint32_t v = 0;
+            for (size_t c = c0; c < c1; ++c) {
+                u += sumU[c];
+                v += sumV[c];
+            }
+            count = (c1 - c0) * chromaRows;
+            rowU[dx] = (u + count / 2) / count;
+            rowV[dx] = (v + count / 2) / count;
         }
-    }
 
-    return &mClip[-kClipMin];
+        convertRow(
+                job->mRGBA, kChromaFull, src->mSwapRB,
+                rowY, rowU, rowV, job->mDstWidth,
+                job->mDst + dy * job->mDstStride);
+    }
 }
 
 }  // namespace android
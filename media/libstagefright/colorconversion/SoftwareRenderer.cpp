@@ -64,7 +64,9 @@ SoftwareRenderer::SoftwareRenderer(
       init_Flag(true),
       rga_fd(-1),
       power_fd(-1),
-      mHttpFlag(0) {
+      mHttpFlag(0),
+      mNumFramesRendered(0),
+      mNumBytesCopied(0) {
 #if WRITE_DATA_DEBUG
     pOutFile = fopen("/sdcard/Movies/rgb.dat", "wb");
     if (pOutFile) {
@@ -162,8 +164,11 @@ SoftwareRenderer::SoftwareRenderer(
             bufWidth = mCropWidth;
             bufHeight = mCropHeight;
 
+            // Converted straight into the window's format, no second pass.
             mConverter = new ColorConverter(
-                    mColorFormat, OMX_COLOR_Format16bitRGB565);
+                    mColorFormat,
+                    halFormat == HAL_PIXEL_FORMAT_RGBA_8888
+                        ? kColorFormatRGBA8888 : OMX_COLOR_Format16bitRGB565);
             CHECK(mConverter->isValid());
             break;
     }
@@ -309,6 +314,9 @@ SoftwareRenderer::~SoftwareRenderer() {
         pOutFile = NULL;
     }
 #endif
+    ALOGI("SoftwareRenderer rendered %u frames, copied %llu bytes",
+          mNumFramesRendered, (unsigned long long)mNumBytesCopied);
+
     int err;
     bool mStatus = true;
     if(!mHttpFlag && init_Flag){
@@ -539,6 +547,7 @@ void SoftwareRenderer::render(
     if(!mHttpFlag){
 		if(mSwdecFlag){
         	memcpy(dst,data,mWidth*mHeight*3/2);
+            mNumBytesCopied += mWidth * mHeight * 3 / 2;
         }else{
 	        frame->FrameWidth = (mWidth + 15)&(~15);
 	        frame->FrameHeight = (mHeight + 15)&(~15);
@@ -556,6 +565,7 @@ void SoftwareRenderer::render(
     }else{
         if(mSwdecFlag){
         	memcpy(dst,data,mWidth*mHeight*3/2);
+            mNumBytesCopied += mWidth * mHeight * 3 / 2;
         } else if (rga_fd >0) {
            hwcYuv2RGB(dst,frame,mWidth,mHeight,rga_fd);
         }
@@ -567,6 +577,11 @@ void SoftwareRenderer::render(
 
     CHECK_EQ(0, mapper.unlock(buf->handle));
 
+    if (++mNumFramesRendered % kStatsInterval == 0) {
+        ALOGV("rendered %u frames, copied %llu bytes",
+              mNumFramesRendered, (unsigned long long)mNumBytesCopied);
+    }
+
     if ((err = mNativeWindow->queueBuffer(mNativeWindow.get(), buf,
             -1)) != 0) {
         ALOGW("Surface::queueBuffer returned error %d", err);
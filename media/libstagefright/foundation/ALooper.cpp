@@ -22,6 +22,7 @@
 
 #include "ALooper.h"
 
+#include "ADebug.h"
 #include "AHandler.h"
 #include "ALooperRoster.h"
 #include "AMessage.h"
@@ -67,7 +68,9 @@ int64_t ALooper::GetNowUs() {
 }
 
 ALooper::ALooper()
-    : mRunningLocally(false) {
+    : mNextSeq(0),
+      mBatchDelivery(false),
+      mRunningLocally(false) {
 }
 
 ALooper::~ALooper() {
@@ -82,6 +85,11 @@ void ALooper::setName(const char *name) {
     mName = name;
 }
 
+void ALooper::setBatchDelivery(bool enabled) {
+    Mutex::Autolock autoLock(mLock);
+    mBatchDelivery = enabled;
+}
+
 ALooper::handler_id ALooper::registerHandler(const sp<AHandler> &handler) {
     return gLooperRoster.registerHandler(this, handler);
 }
@@ -158,6 +166,71 @@ status_t ALooper::stop() {
     return OK;
 }
 
+// static
+bool ALooper::EventBefore(const Event &a, const Event &b) {
+    if (a.mWhenUs != b.mWhenUs) {
+        return a.mWhenUs < b.mWhenUs;
+    }
+
+    return a.mSeq < b.mSeq;
+}
+
+void ALooper::pushEvent_l(const Event &event) {
+    mEventQueue.push();
+
+    Event *heap = mEventQueue.editArray();
+    size_t index = mEventQueue.size() - 1;
+
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (!EventBefore(event, heap[parent])) {
+            break;
+        }
+
+        heap[index] = heap[parent];
+        index = parent;
+    }
+
+    heap[index] = event;
+}
+
+void ALooper::popEvent_l(Event *event) {
+    CHECK(!mEventQueue.isEmpty());
+
+    *event = mEventQueue.itemAt(0);
+
+    Event last = mEventQueue.top();
+    mEventQueue.removeAt(mEventQueue.size() - 1);
+
+    size_t size = mEventQueue.size();
+    if (size == 0) {
+        return;
+    }
+
+    Event *heap = mEventQueue.editArray();
+    size_t index = 0;
+
+    for (;;) {
+        size_t child = 2 * index + 1;
+        if (child >= size) {
+            break;
+        }
+
+        if (child + 1 < size && EventBefore(heap[child + 1], heap[child])) {
+            ++child;
+        }
+
+        if (!EventBefore(heap[child], last)) {
+            break;
+        }
+
+        heap[index] = heap[child];
+        index = child;
+    }
+
+    heap[index] = last;
+}
+
 void ALooper::post(const sp<AMessage> &msg, int64_t delayUs) {
     Mutex::Autolock autoLock(mLock);
 
@@ -168,20 +241,16 @@ void ALooper::post(const sp<AMessage> &msg, int64_t delayUs) {
         whenUs = GetNowUs();
     }
 
-    List<Event>::iterator it = mEventQueue.begin();
-    while (it != mEventQueue.end() && (*it).mWhenUs <= whenUs) {
-        ++it;
-    }
-
     Event event;
     event.mWhenUs = whenUs;
+    event.mSeq = mNextSeq++;
     event.mMessage = msg;
 
-    if (it == mEventQueue.begin()) {
+    pushEvent_l(event);
+
+    if (mEventQueue.itemAt(0).mSeq == event.mSeq) {
         mQueueChangedCondition.signal();
     }
-
-    mEventQueue.insert(it, event);
 }
 
 void ALooper::clearMessage() {
@@ -191,17 +260,18 @@ void ALooper::clearMessage() {
 }
 bool ALooper::loop() {
     Event event;
+    Vector<sp<AMessage> > batch;
 
     {
         Mutex::Autolock autoLock(mLock);
         if (mThread == NULL && !mRunningLocally) {
             return false;
         }
-        if (mEventQueue.empty()) {
+        if (mEventQueue.isEmpty()) {
             mQueueChangedCondition.wait(mLock);
             return true;
         }
-        int64_t whenUs = (*mEventQueue.begin()).mWhenUs;
+        int64_t whenUs = mEventQueue.itemAt(0).mWhenUs;
         int64_t nowUs = GetNowUs();
 
         if (whenUs > nowUs) {
@@ -211,12 +281,26 @@ bool ALooper::loop() {
             return true;
         }
 
-        event = *mEventQueue.begin();
-        mEventQueue.erase(mEventQueue.begin());
+        popEvent_l(&event);
+
+        if (mBatchDelivery) {
+            while (!mEventQueue.isEmpty()
+                    && mEventQueue.itemAt(0).mWhenUs <= nowUs) {
+                Event next;
+                popEvent_l(&next);
+                batch.push(next.mMessage);
+            }
+        }
     }
 
     gLooperRoster.deliverMessage(event.mMessage);
 
+    // Messages dequeued as part of a batch are delivered even if the looper
+    // is stopped by one of the handlers above, they were already due.
+    for (size_t i = 0; i < batch.size(); ++i) {
+        gLooperRoster.deliverMessage(batch.itemAt(i));
+    }
+
     // NOTE: It's important to note that at this point our "ALooper" object
     // may no longer exist (its final reference may have gone away while
     // delivering the message). We have made sure, however, that loop()
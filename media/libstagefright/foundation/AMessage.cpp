@@ -17,6 +17,7 @@
 #include "AMessage.h"
 
 #include <ctype.h>
+#include <pthread.h>
 
 #include "AAtomizer.h"
 #include "ABuffer.h"
@@ -31,10 +32,124 @@ namespace android {
 
 extern ALooperRoster gLooperRoster;
 
+// String values never change after being set, so dup() shares them instead
+// of copying.
+struct AMessage::SharedString : public LightRefBase<SharedString> {
+    SharedString(const char *s, size_t len)
+        : mValue(s, len) {
+    }
+
+    AString mValue;
+
+private:
+    DISALLOW_EVIL_CONSTRUCTORS(SharedString);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Per-thread free list of AMessage sized blocks. Messages are typically
+// created on one thread and released on a looper thread, so each thread
+// only keeps a bounded number of blocks around.
+static const size_t kMaxPooledMessages = 32;
+
+struct MessagePool {
+    void *mHead;
+    size_t mCount;
+};
+
+static pthread_once_t gMessagePoolOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t gMessagePoolKey;
+
+static void DestroyMessagePool(void *cookie) {
+    MessagePool *pool = static_cast<MessagePool *>(cookie);
+
+    while (pool->mHead != NULL) {
+        void *block = pool->mHead;
+        pool->mHead = *static_cast<void **>(block);
+        ::operator delete(block);
+    }
+
+    delete pool;
+}
+
+static void CreateMessagePoolKey() {
+    CHECK_EQ(pthread_key_create(&gMessagePoolKey, DestroyMessagePool), 0);
+}
+
+static MessagePool *GetMessagePool() {
+    pthread_once(&gMessagePoolOnce, CreateMessagePoolKey);
+
+    MessagePool *pool =
+        static_cast<MessagePool *>(pthread_getspecific(gMessagePoolKey));
+
+    if (pool == NULL) {
+        pool = new MessagePool;
+        pool->mHead = NULL;
+        pool->mCount = 0;
+
+        pthread_setspecific(gMessagePoolKey, pool);
+    }
+
+    return pool;
+}
+
+// static
+void *AMessage::operator new(size_t size) {
+    if (size == sizeof(AMessage)) {
+        MessagePool *pool = GetMessagePool();
+
+        if (pool->mHead != NULL) {
+            void *block = pool->mHead;
+            pool->mHead = *static_cast<void **>(block);
+            --pool->mCount;
+
+            return block;
+        }
+    }
+
+    return ::operator new(size);
+}
+
+// static
+void AMessage::operator delete(void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return;
+    }
+
+    if (size == sizeof(AMessage)) {
+        MessagePool *pool = GetMessagePool();
+
+        if (pool->mCount < kMaxPooledMessages) {
+            *static_cast<void **>(ptr) = pool->mHead;
+            pool->mHead = ptr;
+            ++pool->mCount;
+
+            return;
+        }
+    }
+
+    ::operator delete(ptr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+const char *AMessage::Key::atom() const {
+    // Racing threads atomize to the same pointer, so the unsynchronized
+    // store is benign.
+    if (mAtom == NULL) {
+        mAtom = AAtomizer::Atomize(mName);
+    }
+
+    return mAtom;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 AMessage::AMessage(uint32_t what, ALooper::handler_id target)
     : mWhat(what),
       mTarget(target),
       mNumItems(0) {
+    memset(mIndex, 0, sizeof(mIndex));
 }
 
 AMessage::~AMessage() {
@@ -58,18 +173,24 @@ ALooper::handler_id AMessage::target() const {
 }
 
 void AMessage::clear() {
+    if (mNumItems == 0) {
+        return;
+    }
+
     for (size_t i = 0; i < mNumItems; ++i) {
         Item *item = &mItems[i];
         freeItem(item);
     }
     mNumItems = 0;
+
+    memset(mIndex, 0, sizeof(mIndex));
 }
 
 void AMessage::freeItem(Item *item) {
     switch (item->mType) {
         case kTypeString:
         {
-            delete item->u.stringValue;
+            item->u.stringValue->decStrong(this);
             break;
         }
 
@@ -88,17 +209,32 @@ void AMessage::freeItem(Item *item) {
     }
 }
 
-AMessage::Item *AMessage::allocateItem(const char *name) {
-    name = AAtomizer::Atomize(name);
+// static
+size_t AMessage::IndexSlot(const char *atom) {
+    // Atoms are unique, stable pointers, hash the address itself.
+    uintptr_t x = reinterpret_cast<uintptr_t>(atom);
+    x ^= x >> 4;
+    x *= 0x9e3779b1u;
 
-    size_t i = 0;
-    while (i < mNumItems && mItems[i].mName != name) {
-        ++i;
+    return (x >> 8) & (kIndexSize - 1);
+}
+
+void AMessage::addToIndex(size_t itemIndex) {
+    size_t slot = IndexSlot(mItems[itemIndex].mName);
+
+    while (mIndex[slot] != 0) {
+        slot = (slot + 1) & (kIndexSize - 1);
     }
 
+    mIndex[slot] = itemIndex + 1;
+}
+
+AMessage::Item *AMessage::allocateItemAtom(const char *atom) {
+    ssize_t i = findItemIndex(atom);
+
     Item *item;
 
-    if (i < mNumItems) {
+    if (i >= 0) {
         item = &mItems[i];
         freeItem(item);
     } else {
@@ -106,37 +242,60 @@ AMessage::Item *AMessage::allocateItem(const char *name) {
         i = mNumItems++;
         item = &mItems[i];
 
-        item->mName = name;
+        item->mName = atom;
+        addToIndex(i);
     }
 
     return item;
 }
 
-const AMessage::Item *AMessage::findItem(
-        const char *name, Type type) const {
-    name = AAtomizer::Atomize(name);
+ssize_t AMessage::findItemIndex(const char *atom) const {
+    size_t slot = IndexSlot(atom);
 
-    for (size_t i = 0; i < mNumItems; ++i) {
-        const Item *item = &mItems[i];
+    while (mIndex[slot] != 0) {
+        size_t i = mIndex[slot] - 1;
 
-        if (item->mName == name) {
-            return item->mType == type ? item : NULL;
+        if (mItems[i].mName == atom) {
+            return i;
         }
+
+        slot = (slot + 1) & (kIndexSize - 1);
     }
 
-    return NULL;
+    return -1;
+}
+
+const AMessage::Item *AMessage::findItemAtom(
+        const char *atom, Type type) const {
+    ssize_t i = findItemIndex(atom);
+
+    if (i < 0) {
+        return NULL;
+    }
+
+    const Item *item = &mItems[i];
+
+    return item->mType == type ? item : NULL;
 }
 
 #define BASIC_TYPE(NAME,FIELDNAME,TYPENAME)                             \
 void AMessage::set##NAME(const char *name, TYPENAME value) {            \
-    Item *item = allocateItem(name);                                    \
+    set##NAME(Key(name), value);                                        \
+}                                                                       \
+                                                                        \
+void AMessage::set##NAME(const Key &key, TYPENAME value) {              \
+    Item *item = allocateItemAtom(key.atom());                          \
                                                                         \
     item->mType = kType##NAME;                                          \
     item->u.FIELDNAME = value;                                          \
 }                                                                       \
                                                                         \
 bool AMessage::find##NAME(const char *name, TYPENAME *value) const {    \
-    const Item *item = findItem(name, kType##NAME);                     \
+    return find##NAME(Key(name), value);                                \
+}                                                                       \
+                                                                        \
+bool AMessage::find##NAME(const Key &key, TYPENAME *value) const {      \
+    const Item *item = findItemAtom(key.atom(), kType##NAME);           \
     if (item) {                                                         \
         *value = item->u.FIELDNAME;                                     \
         return true;                                                    \
@@ -155,14 +314,21 @@ BASIC_TYPE(Pointer,ptrValue,void *)
 
 void AMessage::setString(
         const char *name, const char *s, ssize_t len) {
-    Item *item = allocateItem(name);
+    setString(Key(name), s, len);
+}
+
+void AMessage::setString(const Key &key, const char *s, ssize_t len) {
+    SharedString *value = new SharedString(s, len < 0 ? strlen(s) : len);
+    value->incStrong(this);
+
+    Item *item = allocateItemAtom(key.atom());
     item->mType = kTypeString;
-    item->u.stringValue = new AString(s, len < 0 ? strlen(s) : len);
+    item->u.stringValue = value;
 }
 
 void AMessage::setObjectInternal(
-        const char *name, const sp<RefBase> &obj, Type type) {
-    Item *item = allocateItem(name);
+        const Key &key, const sp<RefBase> &obj, Type type) {
+    Item *item = allocateItemAtom(key.atom());
     item->mType = type;
 
     if (obj != NULL) { obj->incStrong(this); }
@@ -170,25 +336,33 @@ void AMessage::setObjectInternal(
 }
 
 void AMessage::setObject(const char *name, const sp<RefBase> &obj) {
-    setObjectInternal(name, obj, kTypeObject);
+    setObjectInternal(Key(name), obj, kTypeObject);
+}
+
+void AMessage::setObject(const Key &key, const sp<RefBase> &obj) {
+    setObjectInternal(key, obj, kTypeObject);
 }
 
 void AMessage::setBuffer(const char *name, const sp<ABuffer> &buffer) {
-    setObjectInternal(name, sp<RefBase>(buffer), kTypeBuffer);
+    setObjectInternal(Key(name), sp<RefBase>(buffer), kTypeBuffer);
+}
+
+void AMessage::setBuffer(const Key &key, const sp<ABuffer> &buffer) {
+    setObjectInternal(key, sp<RefBase>(buffer), kTypeBuffer);
 }
 
 void AMessage::setMessage(const char *name, const sp<AMessage> &obj) {
-    Item *item = allocateItem(name);
-    item->mType = kTypeMessage;
+    setObjectInternal(Key(name), obj, kTypeMessage);
+}
 
-    if (obj != NULL) { obj->incStrong(this); }
-    item->u.refValue = obj.get();
+void AMessage::setMessage(const Key &key, const sp<AMessage> &obj) {
+    setObjectInternal(key, obj, kTypeMessage);
 }
 
 void AMessage::setRect(
         const char *name,
         int32_t left, int32_t top, int32_t right, int32_t bottom) {
-    Item *item = allocateItem(name);
+    Item *item = allocateItemAtom(Key(name).atom());
     item->mType = kTypeRect;
 
     item->u.rectValue.mLeft = left;
@@ -198,16 +372,24 @@ void AMessage::setRect(
 }
 
 bool AMessage::findString(const char *name, AString *value) const {
-    const Item *item = findItem(name, kTypeString);
+    return findString(Key(name), value);
+}
+
+bool AMessage::findString(const Key &key, AString *value) const {
+    const Item *item = findItemAtom(key.atom(), kTypeString);
     if (item) {
-        *value = *item->u.stringValue;
+        *value = item->u.stringValue->mValue;
         return true;
     }
     return false;
 }
 
 bool AMessage::findObject(const char *name, sp<RefBase> *obj) const {
-    const Item *item = findItem(name, kTypeObject);
+    return findObject(Key(name), obj);
+}
+
+bool AMessage::findObject(const Key &key, sp<RefBase> *obj) const {
+    const Item *item = findItemAtom(key.atom(), kTypeObject);
     if (item) {
         *obj = item->u.refValue;
         return true;
@@ -216,7 +398,11 @@ bool AMessage::findObject(const char *name, sp<RefBase> *obj) const {
 }
 
 bool AMessage::findBuffer(const char *name, sp<ABuffer> *buf) const {
-    const Item *item = findItem(name, kTypeBuffer);
+    return findBuffer(Key(name), buf);
+}
+
+bool AMessage::findBuffer(const Key &key, sp<ABuffer> *buf) const {
+    const Item *item = findItemAtom(key.atom(), kTypeBuffer);
     if (item) {
         *buf = (ABuffer *)(item->u.refValue);
         return true;
@@ -225,7 +411,11 @@ bool AMessage::findBuffer(const char *name, sp<ABuffer> *buf) const {
 }
 
 bool AMessage::findMessage(const char *name, sp<AMessage> *obj) const {
-    const Item *item = findItem(name, kTypeMessage);
+    return findMessage(Key(name), obj);
+}
+
+bool AMessage::findMessage(const Key &key, sp<AMessage> *obj) const {
+    const Item *item = findItemAtom(key.atom(), kTypeMessage);
     if (item) {
         *obj = static_cast<AMessage *>(item->u.refValue);
         return true;
@@ -236,7 +426,7 @@ bool AMessage::findMessage(const char *name, sp<AMessage> *obj) const {
 bool AMessage::findRect(
         const char *name,
         int32_t *left, int32_t *top, int32_t *right, int32_t *bottom) const {
-    const Item *item = findItem(name, kTypeRect);
+    const Item *item = findItemAtom(Key(name).atom(), kTypeRect);
     if (item == NULL) {
         return false;
     }
@@ -277,6 +467,7 @@ bool AMessage::senderAwaitsResponse(uint32_t *replyID) const {
 sp<AMessage> AMessage::dup() const {
     sp<AMessage> msg = new AMessage(mWhat, mTarget);
     msg->mNumItems = mNumItems;
+    memcpy(msg->mIndex, mIndex, sizeof(mIndex));
 
     for (size_t i = 0; i < mNumItems; ++i) {
         const Item *from = &mItems[i];
@@ -288,8 +479,8 @@ sp<AMessage> AMessage::dup() const {
         switch (from->mType) {
             case kTypeString:
             {
-                to->u.stringValue =
-                    new AString(*from->u.stringValue);
+                to->u.stringValue = from->u.stringValue;
+                to->u.stringValue->incStrong(msg.get());
                 break;
             }
 
@@ -393,7 +584,7 @@ AString AMessage::debugString(int32_t indent) const {
                 tmp = StringPrintf(
                         "string %s = \"%s\"",
                         item.mName,
-                        item.u.stringValue->c_str());
+                        item.u.stringValue->mValue.c_str());
                 break;
             case kTypeObject:
                 tmp = StringPrintf(
@@ -459,6 +650,7 @@ sp<AMessage> AMessage::FromParcel(const Parcel &parcel) {
 
         item->mName = AAtomizer::Atomize(parcel.readCString());
         item->mType = static_cast<Type>(parcel.readInt32());
+        msg->addToIndex(i);
 
         switch (item->mType) {
             case kTypeInt32:
@@ -493,7 +685,9 @@ sp<AMessage> AMessage::FromParcel(const Parcel &parcel) {
 
             case kTypeString:
             {
-                item->u.stringValue = new AString(parcel.readCString());
+                const char *s = parcel.readCString();
+                item->u.stringValue = new SharedString(s, strlen(s));
+                item->u.stringValue->incStrong(msg.get());
                 break;
             }
 
@@ -560,7 +754,7 @@ void AMessage::writeToParcel(Parcel *parcel) const {
 
             case kTypeString:
             {
-                parcel->writeCString(item.u.stringValue->c_str());
+                parcel->writeCString(item.u.stringValue->mValue.c_str());
                 break;
             }
 
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ABRPolicy"
+#include <utils/Log.h>
+
+#include "ABRPolicy.h"
+
+#include <media/stagefright/foundation/ADebug.h>
+
+#include <string.h>
+
+namespace android {
+
+// static
+const int64_t ABRPolicy::kMinUpSwitchIntervalUs = 10000000ll;
+
+// static
+sp<ABRPolicy> ABRPolicy::Create(const char *name) {
+    if (name != NULL && !strcmp(name, "buffer")) {
+        return new BufferABRPolicy;
+    }
+
+    return new ThroughputABRPolicy;
+}
+
+ABRPolicy::ABRPolicy()
+    : mNumSamples(0),
+      mInitialBandwidthBps(-1),
+      mNumUpSwitchProposals(0),
+      mUpSwitchIndex(0),
+      mLastSwitchTimeUs(-1ll) {
+}
+
+ABRPolicy::~ABRPolicy() {
+}
+
+void ABRPolicy::addSegmentDownload(size_t numBytes, int64_t downloadTimeUs) {
+    if (numBytes == 0 || downloadTimeUs <= 0) {
+        return;
+    }
+
+    Mutex::Autolock autoLock(mLock);
+
+    Sample sample;
+    sample.mNumBytes = numBytes;
+    sample.mDownloadTimeUs = downloadTimeUs;
+    mSamples.push_back(sample);
+
+    if (++mNumSamples > kMaxNumSamples) {
+        mSamples.erase(mSamples.begin());
+        --mNumSamples;
+    }
+}
+
+void ABRPolicy::setInitialBandwidth(int32_t bandwidthBps) {
+    Mutex::Autolock autoLock(mLock);
+    mInitialBandwidthBps = bandwidthBps;
+}
+
+bool ABRPolicy::estimateBandwidth_l(int32_t *bandwidthBps) const {
+    if (mNumSamples == 0) {
+        if (mInitialBandwidthBps < 0) {
+            return false;
+        }
+
+        *bandwidthBps = mInitialBandwidthBps;
+        return true;
+    }
+
+    // n / sum(1 / throughput_i), with throughput_i = bits_i / time_i.
+    double sumInverse = 0.0;
+    for (List<Sample>::const_iterator it = mSamples.begin();
+            it != mSamples.end(); ++it) {
+        sumInverse += (it->mDownloadTimeUs / 1E6) / (it->mNumBytes * 8.0);
+    }
+
+    *bandwidthBps = (int32_t)(mNumSamples / sumInverse);
+
+    return true;
+}
+
+// static
+size_t ABRPolicy::highestVariantBelow(
+        const Vector<unsigned long> &bandwidths, int64_t bandwidthBps) {
+    size_t index = bandwidths.size() - 1;
+    while (index > 0 && (int64_t)bandwidths.itemAt(index) > bandwidthBps) {
+        --index;
+    }
+
+    return index;
+}
+
+size_t ABRPolicy::pickVariant(
+        const Vector<unsigned long> &bandwidths, ssize_t currentIndex,
+        int64_t bufferedDurationUs, int64_t nowUs) {
+    CHECK(!bandwidths.isEmpty());
+
+    Mutex::Autolock autoLock(mLock);
+
+    size_t index = selectVariant_l(bandwidths, currentIndex, bufferedDurationUs);
+    CHECK_LT(index, bandwidths.size());
+
+    if (currentIndex < 0 || (size_t)currentIndex >= bandwidths.size()) {
+        mNumUpSwitchProposals = 0;
+        mLastSwitchTimeUs = nowUs;
+        return index;
+    }
+
+    if (index < (size_t)currentIndex) {
+        ALOGV("[%s] switching down from %d to %d",
+              name(), currentIndex, index);
+
+        mNumUpSwitchProposals = 0;
+        mLastSwitchTimeUs = nowUs;
+        return index;
+    }
+
+    if (index == (size_t)currentIndex) {
+        mNumUpSwitchProposals = 0;
+        return index;
+    }
+
+    // Go up no further than the most cautious of the proposals seen
+    // while waiting for confirmation.
+    if (mNumUpSwitchProposals == 0 || index < mUpSwitchIndex) {
+        mUpSwitchIndex = index;
+    }
+    ++mNumUpSwitchProposals;
+
+    if (mNumUpSwitchProposals < kNumUpSwitchConfirmations
+            || nowUs - mLastSwitchTimeUs < kMinUpSwitchIntervalUs) {
+        return currentIndex;
+    }
+
+    ALOGV("[%s] switching up from %d to %d",
+          name(), currentIndex, mUpSwitchIndex);
+
+    mNumUpSwitchProposals = 0;
+    mLastSwitchTimeUs = nowUs;
+
+    return mUpSwitchIndex;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+ThroughputABRPolicy::ThroughputABRPolicy() {
+}
+
+const char *ThroughputABRPolicy::name() const {
+    return "throughput";
+}
+
+size_t ThroughputABRPolicy::selectVariant_l(
+        const Vector<unsigned long> &bandwidths, ssize_t currentIndex,
+        int64_t bufferedDurationUs) {
+    int32_t bandwidthBps;
+    if (!estimateBandwidth_l(&bandwidthBps)) {
+        // Start out with the lowest bandwidth stream.
+        return currentIndex >= 0 ? currentIndex : 0;
+    }
+
+    ALOGV("bandwidth estimated at %.2f kbps", bandwidthBps / 1024.0f);
+
+    // Consider only 80% of the available bandwidth usable.
+    return highestVariantBelow(bandwidths, (bandwidthBps * 8ll) / 10);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// static
+const int64_t BufferABRPolicy::kReservoirUs = 3000000ll;
+
+// static
+const int64_t BufferABRPolicy::kCushionUs = 6000000ll;
+
+BufferABRPolicy::BufferABRPolicy() {
+}
+
+const char *BufferABRPolicy::name() const {
+    return "buffer";
+}
+
+size_t BufferABRPolicy::selectVariant_l(
+        const Vector<unsigned long> &bandwidths, ssize_t currentIndex,
+        int64_t bufferedDurationUs) {
+    if (bufferedDurationUs <= kReservoirUs) {
+        if (currentIndex < 0) {
+            // Nothing buffered yet, the throughput is all we know.
+            int32_t bandwidthBps;
+            if (estimateBandwidth_l(&bandwidthBps)) {
+                return highestVariantBelow(
+                        bandwidths, (bandwidthBps * 8ll) / 10);
+            }
+        }
+
+        return 0;
+    }
+
+    if (bufferedDurationUs >= kReservoirUs + kCushionUs) {
+        return bandwidths.size() - 1;
+    }
+
+    int64_t minBps = bandwidths.itemAt(0);
+    int64_t maxBps = bandwidths.itemAt(bandwidths.size() - 1);
+
+    int64_t targetBps = minBps
+        + (maxBps - minBps) * (bufferedDurationUs - kReservoirUs) / kCushionUs;
+
+    return highestVariantBelow(bandwidths, targetBps);
+}
+
+}  // namespace android
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ABR_POLICY_H_
+
+#define ABR_POLICY_H_
+
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/List.h>
+#include <utils/RefBase.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+// Decides which variant of an HTTP live stream to fetch. Implementations
+// only propose a variant, the base class applies hysteresis so that
+// switching up requires a consistent proposal for a while, switching down
+// happens right away.
+struct ABRPolicy : public RefBase {
+    // "name" is one of "throughput" or "buffer", NULL or an unknown name
+    // yields the default (throughput) policy.
+    static sp<ABRPolicy> Create(const char *name);
+
+    virtual const char *name() const = 0;
+
+    // Records a completed media segment download. May be called from any
+    // thread.
+    void addSegmentDownload(size_t numBytes, int64_t downloadTimeUs);
+
+    // Used until the first segment download has been recorded.
+    void setInitialBandwidth(int32_t bandwidthBps);
+
+    // "bandwidths" are the variants' advertised bandwidths in ascending
+    // order, "currentIndex" is negative if no variant was picked yet.
+    size_t pickVariant(
+            const Vector<unsigned long> &bandwidths, ssize_t currentIndex,
+            int64_t bufferedDurationUs, int64_t nowUs);
+
+protected:
+    ABRPolicy();
+    virtual ~ABRPolicy();
+
+    virtual size_t selectVariant_l(
+            const Vector<unsigned long> &bandwidths, ssize_t currentIndex,
+            int64_t bufferedDurationUs) = 0;
+
+    // Harmonic mean of the throughput of the most recent segment
+    // downloads, which unlike the arithmetic mean is not dominated by
+    // the occasional fast outlier.
+    bool estimateBandwidth_l(int32_t *bandwidthBps) const;
+
+    // Index of the highest variant not exceeding "bandwidthBps", or 0.
+    static size_t highestVariantBelow(
+            const Vector<unsigned long> &bandwidths, int64_t bandwidthBps);
+
+private:
+    enum {
+        kMaxNumSamples = 5,
+
+        // Consecutive checks that must propose a higher variant before
+        // we switch up.
+        kNumUpSwitchConfirmations = 2,
+    };
+
+    static const int64_t kMinUpSwitchIntervalUs;
+
+    struct Sample {
+        size_t mNumBytes;
+        int64_t mDownloadTimeUs;
+    };
+
+    mutable Mutex mLock;
+
+    List<Sample> mSamples;
+    size_t mNumSamples;
+    int32_t mInitialBandwidthBps;
+
+    size_t mNumUpSwitchProposals;
+    size_t mUpSwitchIndex;
+    int64_t mLastSwitchTimeUs;
+
+    DISALLOW_EVIL_CONSTRUCTORS(ABRPolicy);
+};
+
+// Picks the highest variant that fits into a fraction of the estimated
+// throughput.
+struct ThroughputABRPolicy : public ABRPolicy {
+    ThroughputABRPolicy();
+
+    virtual const char *name() const;
+
+protected:
+    virtual size_t selectVariant_l(
+            const Vector<unsigned long> &bandwidths, ssize_t currentIndex,
+            int64_t bufferedDurationUs);
+
+private:
+    DISALLOW_EVIL_CONSTRUCTORS(ThroughputABRPolicy);
+};
+
+// Maps the amount of buffered media linearly onto the range of variant
+// bandwidths: below a reservoir the lowest variant is fetched, above
+// reservoir plus cushion the highest one.
+struct BufferABRPolicy : public ABRPolicy {
+    BufferABRPolicy();
+
+    virtual const char *name() const;
+
+protected:
+    virtual size_t selectVariant_l(
+            const Vector<unsigned long> &bandwidths, ssize_t currentIndex,
+            int64_t bufferedDurationUs);
+
+private:
+    static const int64_t kReservoirUs;
+    static const int64_t kCushionUs;
+
+    DISALLOW_EVIL_CONSTRUCTORS(BufferABRPolicy);
+};
+
+}  // namespace android
+
+#endif  // ABR_POLICY_H_
@@ -3,10 +3,12 @@ LOCAL_PATH:= $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES:=               \
+        ABRPolicy.cpp           \
         LiveDataSource.cpp      \
         LiveSession.cpp         \
         M3UParser.cpp           \
         PlaylistFetcher.cpp     \
+        SegmentPrefetcher.cpp   \
 
 LOCAL_C_INCLUDES:= \
 	$(TOP)/frameworks/av/media/libstagefright \
@@ -20,6 +20,7 @@
 
 #include "LiveSession.h"
 
+#include "ABRPolicy.h"
 #include "M3UParser.h"
 #include "PlaylistFetcher.h"
 
@@ -43,6 +44,9 @@
 
 namespace android {
 
+// static
+const int64_t LiveSession::kCheckBandwidthIntervalUs = 2000000ll;
+
 LiveSession::LiveSession(
         const sp<AMessage> &notify, uint32_t flags, bool uidValid, uid_t uid)
     : mNotify(notify),
@@ -66,6 +70,12 @@ LiveSession::LiveSession(
         mHTTPDataSource->setUID(mUID);
     }
 
+    char value[PROPERTY_VALUE_MAX];
+    mABRPolicy = ABRPolicy::Create(
+            property_get("media.httplive.abr", value, NULL) ? value : NULL);
+
+    ALOGV("using '%s' adaptive bitrate policy", mABRPolicy->name());
+
     mPacketSources.add(
             STREAMTYPE_AUDIO, new AnotherPacketSource(NULL /* meta */));
 
@@ -512,11 +522,60 @@ sp<PlaylistFetcher> LiveSession::addFetcher(const char *uri) {
     return info.mFetcher;
 }
 
+sp<HTTPBase> LiveSession::createHTTPDataSource() const {
+    sp<HTTPBase> source = HTTPBase::Create(
+            (mFlags & kFlagIncognito) ? HTTPBase::kFlagIncognito : 0);
+
+    if (mUIDValid) {
+        source->setUID(mUID);
+    }
+
+    return source;
+}
+
+void LiveSession::addBandwidthMeasurement(size_t numBytes, int64_t delayUs) {
+    mHTTPDataSource->addBandwidthMeasurement(numBytes, delayUs);
+}
+
+void LiveSession::addSegmentDownload(size_t numBytes, int64_t downloadTimeUs) {
+    ALOGV("segment of %d bytes downloaded in %lld us",
+          numBytes, downloadTimeUs);
+
+    mABRPolicy->addSegmentDownload(numBytes, downloadTimeUs);
+}
+
+int64_t LiveSession::getBufferedDurationUs() const {
+    bool first = true;
+    int64_t minBufferedDurationUs = 0ll;
+
+    for (size_t i = 0; i < mPacketSources.size(); ++i) {
+        StreamType type = mPacketSources.keyAt(i);
+        if (!(mStreamMask & type) || type == STREAMTYPE_SUBTITLES) {
+            continue;
+        }
+
+        status_t finalResult;
+        int64_t bufferedDurationUs =
+            mPacketSources.valueAt(i)->getBufferedDurationUs(&finalResult);
+
+        if (first || bufferedDurationUs < minBufferedDurationUs) {
+            minBufferedDurationUs = bufferedDurationUs;
+            first = false;
+        }
+    }
+
+    return minBufferedDurationUs;
+}
+
 status_t LiveSession::fetchFile(
         const char *url, sp<ABuffer> *out,
-        int64_t range_offset, int64_t range_length) {
+        int64_t range_offset, int64_t range_length,
+        const sp<HTTPBase> &httpDataSource) {
     *out = NULL;
 
+    sp<HTTPBase> httpSource =
+        (httpDataSource != NULL) ? httpDataSource : mHTTPDataSource;
+
     sp<DataSource> source;
 
     if (!strncasecmp(url, "file://", 7)) {
@@ -536,13 +595,13 @@ status_t LiveSession::fetchFile(
                             range_length < 0
                                 ? "" : StringPrintf("%lld", range_offset + range_length - 1).c_str()).c_str()));
         }
-        status_t err = mHTTPDataSource->connect(url, &headers);
+        status_t err = httpSource->connect(url, &headers);
 
         if (err != OK) {
             return err;
         }
 
-        source = mHTTPDataSource;
+        source = httpSource;
     }
 
     off64_t size;
@@ -604,7 +663,8 @@ status_t LiveSession::fetchFile(
 }
 
 sp<M3UParser> LiveSession::fetchPlaylist(
-        const char *url, uint8_t *curPlaylistHash, bool *unchanged) {
+        const char *url, uint8_t *curPlaylistHash, bool *unchanged,
+        const sp<M3UParser> &previousPlaylist) {
     ALOGV("fetchPlaylist '%s'", url);
 
     *unchanged = false;
@@ -643,8 +703,8 @@ sp<M3UParser> LiveSession::fetchPlaylist(
     }
 #endif
 
-    sp<M3UParser> playlist =
-        new M3UParser(url, buffer->data(), buffer->size());
+    sp<M3UParser> playlist = new M3UParser(
+            url, buffer->data(), buffer->size(), previousPlaylist);
 
     if (playlist->initCheck() != OK) {
         ALOGE("failed to parse .m3u8 playlist");
@@ -678,37 +738,36 @@ size_t LiveSession::getBandwidthIndex() {
     }
 
     if (index < 0) {
+        // Until the first segment has been downloaded the transfers of
+        // the playlists are all we can go by.
         int32_t bandwidthBps;
         if (mHTTPDataSource != NULL
                 && mHTTPDataSource->estimateBandwidth(&bandwidthBps)) {
-            ALOGV("bandwidth estimated at %.2f kbps", bandwidthBps / 1024.0f);
-        } else {
-            ALOGV("no bandwidth estimate.");
-            return 0;  // Pick the lowest bandwidth stream by default.
+            mABRPolicy->setInitialBandwidth(bandwidthBps);
         }
 
+        Vector<unsigned long> bandwidths;
+        for (size_t i = 0; i < mBandwidthItems.size(); ++i) {
+            bandwidths.push(mBandwidthItems.itemAt(i).mBandwidth);
+        }
+
+        index = mABRPolicy->pickVariant(
+                bandwidths, mPrevBandwidthIndex, getBufferedDurationUs(),
+                ALooper::GetNowUs());
+
         char value[PROPERTY_VALUE_MAX];
         if (property_get("media.httplive.max-bw", value, NULL)) {
             char *end;
             long maxBw = strtoul(value, &end, 10);
-            if (end > value && *end == '\0') {
-                if (maxBw > 0 && bandwidthBps > maxBw) {
-                    ALOGV("bandwidth capped to %ld bps", maxBw);
-                    bandwidthBps = maxBw;
+            if (end > value && *end == '\0' && maxBw > 0) {
+                ALOGV("bandwidth capped to %ld bps", maxBw);
+
+                while (index > 0 && mBandwidthItems.itemAt(index).mBandwidth
+                                        > (unsigned long)maxBw) {
+                    --index;
                 }
             }
         }
-
-        // Consider only 80% of the available bandwidth usable.
-        bandwidthBps = (bandwidthBps * 8) / 10;
-
-        // Pick the highest bandwidth stream below or equal to estimated bandwidth.
-
-        index = mBandwidthItems.size() - 1;
-        while (index > 0 && mBandwidthItems.itemAt(index).mBandwidth
-                                > (size_t)bandwidthBps) {
-            --index;
-        }
     }
 #elif 0
     // Change bandwidth at random()
@@ -1096,9 +1155,11 @@ void LiveSession::onChangeConfiguration3(const sp<AMessage> &msg) {
 }
 
 void LiveSession::scheduleCheckBandwidthEvent() {
+    // The policy's hysteresis keeps frequent checks from turning into
+    // frequent switches.
     sp<AMessage> msg = new AMessage(kWhatCheckBandwidth, id());
     msg->setInt32("generation", mCheckBandwidthGeneration);
-    msg->post(10000000ll);
+    msg->post(kCheckBandwidthIntervalUs);
 }
 
 void LiveSession::cancelCheckBandwidthEvent() {
@@ -24,6 +24,7 @@
 
 namespace android {
 
+struct ABRPolicy;
 struct ABuffer;
 struct AnotherPacketSource;
 struct DataSource;
@@ -81,6 +82,7 @@ protected:
 
 private:
     friend struct PlaylistFetcher;
+    friend struct SegmentPrefetcher;
 
     enum {
         kWhatConnect                    = 'conn',
@@ -94,6 +96,8 @@ private:
         kWhatFinishDisconnect2          = 'fin2',
     };
 
+    static const int64_t kCheckBandwidthIntervalUs;
+
     struct BandwidthItem {
         size_t mPlaylistIndex;
         unsigned long mBandwidth;
@@ -115,6 +119,8 @@ private:
     sp<HTTPBase> mHTTPDataSource;
     KeyedVector<String8, String8> mExtraHeaders;
 
+    sp<ABRPolicy> mABRPolicy;
+
     AString mMasterURL;
 
     Vector<BandwidthItem> mBandwidthItems;
@@ -145,12 +151,34 @@ private:
     status_t onSeek(const sp<AMessage> &msg);
     void onFinishDisconnect2();
 
+    // HTTP sources for downloads running in parallel to the ones done
+    // through mHTTPDataSource.
+    sp<HTTPBase> createHTTPDataSource() const;
+
+    // Downloads through "httpDataSource" if not NULL, mHTTPDataSource
+    // otherwise. Safe to call concurrently with distinct data sources.
     status_t fetchFile(
             const char *url, sp<ABuffer> *out,
-            int64_t range_offset = 0, int64_t range_length = -1);
+            int64_t range_offset = 0, int64_t range_length = -1,
+            const sp<HTTPBase> &httpDataSource = NULL);
 
+    // If given, "previousPlaylist" is the last parsed version of the
+    // playlist at "url" and only segments it does not know are parsed.
     sp<M3UParser> fetchPlaylist(
-            const char *url, uint8_t *curPlaylistHash, bool *unchanged);
+            const char *url, uint8_t *curPlaylistHash, bool *unchanged,
+            const sp<M3UParser> &previousPlaylist = NULL);
+
+    // Accounts for transfers that did not go through mHTTPDataSource in
+    // its bandwidth estimate.
+    void addBandwidthMeasurement(size_t numBytes, int64_t delayUs);
+
+    // Called by the fetchers for every media segment they downloaded, from
+    // whatever thread did the download.
+    void addSegmentDownload(size_t numBytes, int64_t downloadTimeUs);
+
+    // The least amount of media buffered across the active audio and
+    // video streams.
+    int64_t getBufferedDurationUs() const;
 
     size_t getBandwidthIndex();
 
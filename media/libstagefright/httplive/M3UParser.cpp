@@ -238,7 +238,20 @@ M3UParser::M3UParser(
       mIsComplete(false),
       mIsEvent(false),
       mSelectedIndex(-1) {
-    mInitCheck = parse(data, size);
+    mInitCheck = parse(data, size, NULL /* previous */);
+}
+
+M3UParser::M3UParser(
+        const char *baseURI, const void *data, size_t size,
+        const sp<M3UParser> &previous)
+    : mInitCheck(NO_INIT),
+      mBaseURI(baseURI),
+      mIsExtM3U(false),
+      mIsVariantPlaylist(false),
+      mIsComplete(false),
+      mIsEvent(false),
+      mSelectedIndex(-1) {
+    mInitCheck = parse(data, size, previous);
 }
 
 M3UParser::~M3UParser() {
@@ -439,27 +452,110 @@ static bool MakeURL(const char *baseURL, const char *url, AString *out) {
     return true;
 }
 
-status_t M3UParser::parse(const void *_data, size_t size) {
+bool M3UParser::canReuseItemsOf(const sp<M3UParser> &previous) const {
+    return previous != NULL
+        && previous->mInitCheck == OK
+        && previous->mIsExtM3U
+        && !previous->mIsVariantPlaylist
+        && previous->mBaseURI == mBaseURI;
+}
+
+// Tags that only describe the segment following them, all of them are
+// already reflected in the meta data of a segment taken over from the
+// previous version of the playlist.
+static bool IsSegmentTag(const char *line, size_t length) {
+    static const char *kSegmentTags[] = {
+        "#EXTINF",
+        "#EXT-X-BYTERANGE",
+        "#EXT-X-KEY",
+        "#EXT-X-PROGRAM-DATE-TIME",
+    };
+
+    for (size_t i = 0; i < sizeof(kSegmentTags) / sizeof(kSegmentTags[0]);
+            ++i) {
+        size_t tagLength = strlen(kSegmentTags[i]);
+        if (length >= tagLength
+                && !memcmp(line, kSegmentTags[i], tagLength)) {
+            return true;
+        }
+    }
+
+    // Not to be confused with #EXT-X-DISCONTINUITY-SEQUENCE.
+    static const char kDiscontinuity[] = "#EXT-X-DISCONTINUITY";
+    return length == sizeof(kDiscontinuity) - 1
+        && !memcmp(line, kDiscontinuity, length);
+}
+
+status_t M3UParser::parse(
+        const void *_data, size_t size, const sp<M3UParser> &previous) {
     int32_t lineNo = 0;
 
     sp<AMessage> itemMeta;
 
+    bool reuseItems = canReuseItemsOf(previous);
+
+    int32_t prevFirstSeqNumber = 0;
+    if (reuseItems && previous->mMeta != NULL) {
+        previous->mMeta->findInt32("media-sequence", &prevFirstSeqNumber);
+    }
+
+    size_t numReusedItems = 0;
+
     const char *data = (const char *)_data;
     size_t offset = 0;
     uint64_t segmentRangeOffset = 0;
     while (offset < size) {
-        size_t offsetLF = offset;
-        while (offsetLF < size && data[offsetLF] != '\n') {
-            ++offsetLF;
+        const char *lf =
+            (const char *)memchr(&data[offset], '\n', size - offset);
+        size_t offsetLF = (lf != NULL) ? (size_t)(lf - data) : size;
+
+        size_t lineLength = offsetLF - offset;
+        if (lineLength > 0 && data[offsetLF - 1] == '\r') {
+            --lineLength;
         }
 
-        AString line;
-        if (offsetLF > offset && data[offsetLF - 1] == '\r') {
-            line.setTo(&data[offset], offsetLF - offset - 1);
-        } else {
-            line.setTo(&data[offset], offsetLF - offset);
+        if (reuseItems && mIsExtM3U && lineLength > 0) {
+            // The media sequence tag precedes the first segment, so by the
+            // time we get to any segment we know its sequence number.
+            int32_t firstSeqNumber = 0;
+            if (mMeta != NULL) {
+                mMeta->findInt32("media-sequence", &firstSeqNumber);
+            }
+
+            int64_t prevIndex = (int64_t)firstSeqNumber
+                + (int64_t)mItems.size() - prevFirstSeqNumber;
+
+            if (prevIndex >= 0
+                    && prevIndex < (int64_t)previous->mItems.size()) {
+                if (data[offset] != '#') {
+                    const Item &prevItem = previous->mItems.itemAt(prevIndex);
+                    mItems.push(prevItem);
+
+                    int64_t rangeOffset, rangeLength;
+                    if (prevItem.mMeta != NULL
+                            && prevItem.mMeta->findInt64(
+                                "range-offset", &rangeOffset)
+                            && prevItem.mMeta->findInt64(
+                                "range-length", &rangeLength)) {
+                        segmentRangeOffset = rangeOffset + rangeLength;
+                    }
+
+                    itemMeta.clear();
+                    ++numReusedItems;
+
+                    offset = offsetLF + 1;
+                    ++lineNo;
+                    continue;
+                } else if (IsSegmentTag(&data[offset], lineLength)) {
+                    offset = offsetLF + 1;
+                    ++lineNo;
+                    continue;
+                }
+            }
         }
 
+        AString line(&data[offset], lineLength);
+
         // ALOGI("#%s#", line.c_str());
 
         if (line.empty()) {
@@ -562,6 +658,10 @@ status_t M3UParser::parse(const void *_data, size_t size) {
         ++lineNo;
     }
 
+    if (reuseItems) {
+        ALOGV("reused %d of %d playlist items", numReusedItems, mItems.size());
+    }
+
     return OK;
 }
 
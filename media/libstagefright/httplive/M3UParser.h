@@ -28,6 +28,13 @@ namespace android {
 struct M3UParser : public RefBase {
     M3UParser(const char *baseURI, const void *data, size_t size);
 
+    // Parses a refreshed version of the playlist "previous" was parsed
+    // from. Segments whose sequence numbers "previous" already covers are
+    // taken over from it instead of being parsed again.
+    M3UParser(
+            const char *baseURI, const void *data, size_t size,
+            const sp<M3UParser> &previous);
+
     status_t initCheck() const;
 
     bool isExtM3U() const;
@@ -75,7 +82,10 @@ private:
     // Media groups keyed by group ID.
     KeyedVector<AString, sp<MediaGroup> > mMediaGroups;
 
-    status_t parse(const void *data, size_t size);
+    status_t parse(
+            const void *data, size_t size, const sp<M3UParser> &previous);
+
+    bool canReuseItemsOf(const sp<M3UParser> &previous) const;
 
     static status_t parseMetaData(
             const AString &line, sp<AMessage> *meta, const char *key);
@@ -22,12 +22,14 @@
 
 #include "LiveDataSource.h"
 #include "M3UParser.h"
+#include "SegmentPrefetcher.h"
 
 #include "include/avc_utils.h"
 #include "include/HTTPBase.h"
 #include "include/ID3.h"
 #include "mpeg2ts/AnotherPacketSource.h"
 
+#include <cutils/properties.h>
 #include <media/IStreamSource.h>
 #include <media/stagefright/foundation/ABitReader.h>
 #include <media/stagefright/foundation/ABuffer.h>
@@ -39,6 +41,7 @@
 #include <media/stagefright/Utils.h>
 
 #include <ctype.h>
+#include <stdlib.h>
 #include <openssl/aes.h>
 #include <openssl/md5.h>
 
@@ -66,6 +69,21 @@ PlaylistFetcher::PlaylistFetcher(
       mFirstPTSValid(false),
       mAbsoluteTimeAnchorUs(0ll) {
     memset(mPlaylistHash, 0, sizeof(mPlaylistHash));
+
+    // Number of segments downloaded in parallel, 0 fetches one segment at
+    // a time on this fetcher's own thread.
+    char value[PROPERTY_VALUE_MAX];
+    size_t numPrefetchSegments = 2;
+    if (property_get("media.httplive.prefetch-segments", value, NULL)) {
+        numPrefetchSegments = strtoul(value, NULL, 10);
+        if (numPrefetchSegments > kMaxNumPrefetchSegments) {
+            numPrefetchSegments = kMaxNumPrefetchSegments;
+        }
+    }
+
+    if (numPrefetchSegments > 0) {
+        mPrefetcher = new SegmentPrefetcher(session, numPrefetchSegments);
+    }
 }
 
 PlaylistFetcher::~PlaylistFetcher() {
@@ -414,6 +432,10 @@ status_t PlaylistFetcher::onStart(const sp<AMessage> &msg) {
     if (mStartTimeUs >= 0ll) {
         mSeqNumber = -1;
         mStartup = true;
+
+        if (mPrefetcher != NULL) {
+            mPrefetcher->flush();
+        }
     }
 
     postMonitorQueue();
@@ -431,6 +453,10 @@ void PlaylistFetcher::onPause() {
 void PlaylistFetcher::onStop() {
     cancelMonitorQueue();
 
+    if (mPrefetcher != NULL) {
+        mPrefetcher->flush();
+    }
+
     for (size_t i = 0; i < mPacketSources.size(); ++i) {
         mPacketSources.valueAt(i)->clear();
     }
@@ -508,7 +534,7 @@ void PlaylistFetcher::onDownloadNext() {
             || (!mPlaylist->isComplete() && timeToRefreshPlaylist(nowUs))) {
         bool unchanged;
         sp<M3UParser> playlist = mSession->fetchPlaylist(
-                mURI.c_str(), mPlaylistHash, &unchanged);
+                mURI.c_str(), mPlaylistHash, &unchanged, mPlaylist);
 
         if (playlist == NULL) {
             if (unchanged) {
@@ -620,8 +646,8 @@ void PlaylistFetcher::onDownloadNext() {
     ALOGV("fetching '%s'", uri.c_str());
 
     sp<ABuffer> buffer;
-    status_t err = mSession->fetchFile(
-            uri.c_str(), &buffer, range_offset, range_length);
+    status_t err = fetchSegment(
+            firstSeqNumberInPlaylist, uri, range_offset, range_length, &buffer);
 
     if (err != OK) {
         ALOGE("failed to fetch .ts segment at url '%s'", uri.c_str());
@@ -676,6 +702,57 @@ void PlaylistFetcher::onDownloadNext() {
     mStartup = false;
 }
 
+status_t PlaylistFetcher::fetchSegment(
+        int32_t firstSeqNumberInPlaylist, const AString &uri,
+        int64_t rangeOffset, int64_t rangeLength, sp<ABuffer> *buffer) {
+    if (mPrefetcher == NULL) {
+        int64_t startUs = ALooper::GetNowUs();
+
+        status_t err = mSession->fetchFile(
+                uri.c_str(), buffer, rangeOffset, rangeLength);
+
+        if (err == OK) {
+            mSession->addSegmentDownload(
+                    (*buffer)->size(), ALooper::GetNowUs() - startUs);
+        }
+
+        return err;
+    }
+
+    if (!mPrefetcher->queue(mSeqNumber, uri, rangeOffset, rangeLength)) {
+        // The pipeline is full of segments we skipped past.
+        mPrefetcher->flush();
+        CHECK(mPrefetcher->queue(mSeqNumber, uri, rangeOffset, rangeLength));
+    }
+
+    // Keep the following segments in the pipeline while we wait for this
+    // one. They are picked up by later calls if they are still wanted.
+    int32_t lastSeqNumberInPlaylist =
+        firstSeqNumberInPlaylist + (int32_t)mPlaylist->size() - 1;
+
+    for (int32_t seqNumber = mSeqNumber + 1;
+            seqNumber <= lastSeqNumberInPlaylist; ++seqNumber) {
+        AString nextURI;
+        sp<AMessage> itemMeta;
+        CHECK(mPlaylist->itemAt(
+                    seqNumber - firstSeqNumberInPlaylist, &nextURI, &itemMeta));
+
+        int64_t nextRangeOffset, nextRangeLength;
+        if (!itemMeta->findInt64("range-offset", &nextRangeOffset)
+                || !itemMeta->findInt64("range-length", &nextRangeLength)) {
+            nextRangeOffset = 0;
+            nextRangeLength = -1;
+        }
+
+        if (!mPrefetcher->queue(
+                    seqNumber, nextURI, nextRangeOffset, nextRangeLength)) {
+            break;
+        }
+    }
+
+    return mPrefetcher->dequeue(mSeqNumber, buffer);
+}
+
 int32_t PlaylistFetcher::getSeqNumberForTime(int64_t timeUs) const {
     int32_t firstSeqNumberInPlaylist;
     if (mPlaylist->meta() == NULL || !mPlaylist->meta()->findInt32(
@@ -733,15 +810,11 @@ status_t PlaylistFetcher::extractAndQueueAccessUnits(
             mNextPTSTimeUs = -1ll;
         }
 
-        size_t offset = 0;
-        while (offset < buffer->size()) {
-            status_t err = mTSParser->feedTSPacket(buffer->data() + offset, 188);
-
-            if (err != OK) {
-                return err;
-            }
+        status_t err = mTSParser->feedTSPackets(
+                buffer->data(), buffer->size() / 188);
 
-            offset += 188;
+        if (err != OK) {
+            return err;
         }
 
         for (size_t i = mPacketSources.size(); i-- > 0;) {
@@ -31,6 +31,7 @@ struct DataSource;
 struct HTTPBase;
 struct LiveDataSource;
 struct M3UParser;
+struct SegmentPrefetcher;
 struct String8;
 
 struct PlaylistFetcher : public AHandler {
@@ -68,7 +69,8 @@ protected:
 
 private:
     enum {
-        kMaxNumRetries         = 5,
+        kMaxNumRetries          = 5,
+        kMaxNumPrefetchSegments = 8,
     };
 
     enum {
@@ -113,6 +115,9 @@ private:
 
     sp<ATSParser> mTSParser;
 
+    // NULL unless segments are to be downloaded ahead of time.
+    sp<SegmentPrefetcher> mPrefetcher;
+
     bool mFirstPTSValid;
     uint64_t mFirstPTS;
     int64_t mAbsoluteTimeAnchorUs;
@@ -135,6 +140,10 @@ private:
     void onMonitorQueue();
     void onDownloadNext();
 
+    status_t fetchSegment(
+            int32_t firstSeqNumberInPlaylist, const AString &uri,
+            int64_t rangeOffset, int64_t rangeLength, sp<ABuffer> *buffer);
+
     status_t extractAndQueueAccessUnits(
             const sp<ABuffer> &buffer, const sp<AMessage> &itemMeta);
 
@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SegmentPrefetcher"
+#include <utils/Log.h>
+
+#include "SegmentPrefetcher.h"
+
+#include "LiveSession.h"
+
+#include "include/HTTPBase.h"
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/MediaErrors.h>
+
+namespace android {
+
+struct SegmentPrefetcher::Downloader : public AHandler {
+    Downloader(SegmentPrefetcher *owner, const sp<LiveSession> &session);
+
+    void download(
+            int32_t generation, int32_t seqNumber, const AString &uri,
+            int64_t rangeOffset, int64_t rangeLength);
+
+    void disconnect();
+
+protected:
+    virtual ~Downloader();
+
+    virtual void onMessageReceived(const sp<AMessage> &msg);
+
+private:
+    enum {
+        kWhatDownload = 'down',
+    };
+
+    SegmentPrefetcher *mOwner;
+    sp<LiveSession> mSession;
+    sp<HTTPBase> mHTTPDataSource;
+
+    DISALLOW_EVIL_CONSTRUCTORS(Downloader);
+};
+
+SegmentPrefetcher::Downloader::Downloader(
+        SegmentPrefetcher *owner, const sp<LiveSession> &session)
+    : mOwner(owner),
+      mSession(session),
+      mHTTPDataSource(session->createHTTPDataSource()) {
+}
+
+SegmentPrefetcher::Downloader::~Downloader() {
+}
+
+void SegmentPrefetcher::Downloader::download(
+        int32_t generation, int32_t seqNumber, const AString &uri,
+        int64_t rangeOffset, int64_t rangeLength) {
+    sp<AMessage> msg = new AMessage(kWhatDownload, id());
+    msg->setInt32("generation", generation);
+    msg->setInt32("seqNumber", seqNumber);
+    msg->setString("uri", uri.c_str());
+    msg->setInt64("range-offset", rangeOffset);
+    msg->setInt64("range-length", rangeLength);
+    msg->post();
+}
+
+void SegmentPrefetcher::Downloader::disconnect() {
+    mHTTPDataSource->disconnect();
+}
+
+void SegmentPrefetcher::Downloader::onMessageReceived(
+        const sp<AMessage> &msg) {
+    CHECK_EQ(msg->what(), (uint32_t)kWhatDownload);
+
+    int32_t generation, seqNumber;
+    CHECK(msg->findInt32("generation", &generation));
+    CHECK(msg->findInt32("seqNumber", &seqNumber));
+
+    if (!mOwner->startDownload(generation, seqNumber)) {
+        // Flushed before we got to it.
+        return;
+    }
+
+    AString uri;
+    int64_t rangeOffset, rangeLength;
+    CHECK(msg->findString("uri", &uri));
+    CHECK(msg->findInt64("range-offset", &rangeOffset));
+    CHECK(msg->findInt64("range-length", &rangeLength));
+
+    ALOGV("prefetching segment %d", seqNumber);
+
+    int64_t startUs = ALooper::GetNowUs();
+
+    sp<ABuffer> buffer;
+    status_t err = mSession->fetchFile(
+            uri.c_str(), &buffer, rangeOffset, rangeLength, mHTTPDataSource);
+
+    mOwner->onDownloadDone(
+            generation, seqNumber, err, buffer,
+            ALooper::GetNowUs() - startUs);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+SegmentPrefetcher::SegmentPrefetcher(
+        const sp<LiveSession> &session, size_t maxNumSegments)
+    : mSession(session),
+      mMaxNumSegments(maxNumSegments),
+      mNextDownloader(0),
+      mGeneration(0),
+      mNumActiveDownloads(0) {
+    CHECK_GT(maxNumSegments, 0u);
+
+    for (size_t i = 0; i < maxNumSegments; ++i) {
+        sp<ALooper> looper = new ALooper;
+        looper->setName("segment prefetcher");
+        looper->start();
+
+        sp<Downloader> downloader = new Downloader(this, session);
+        looper->registerHandler(downloader);
+
+        mLoopers.push(looper);
+        mDownloaders.push(downloader);
+    }
+}
+
+SegmentPrefetcher::~SegmentPrefetcher() {
+    flush();
+
+    // Abort downloads in progress, the loopers' threads are joined below
+    // and the downloaders must not call back into us afterwards.
+    for (size_t i = 0; i < mDownloaders.size(); ++i) {
+        mDownloaders.itemAt(i)->disconnect();
+    }
+
+    for (size_t i = 0; i < mLoopers.size(); ++i) {
+        mLoopers.itemAt(i)->unregisterHandler(mDownloaders.itemAt(i)->id());
+        mLoopers.itemAt(i)->stop();
+    }
+}
+
+size_t SegmentPrefetcher::maxNumSegments() const {
+    return mMaxNumSegments;
+}
+
+bool SegmentPrefetcher::queue(
+        int32_t seqNumber, const AString &uri,
+        int64_t rangeOffset, int64_t rangeLength) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mSegments.indexOfKey(seqNumber) >= 0) {
+        return true;
+    }
+
+    if (mSegments.size() >= mMaxNumSegments) {
+        return false;
+    }
+
+    Segment segment;
+    segment.mDone = false;
+    segment.mErr = OK;
+    mSegments.add(seqNumber, segment);
+
+    mDownloaders.itemAt(mNextDownloader)->download(
+            mGeneration, seqNumber, uri, rangeOffset, rangeLength);
+
+    mNextDownloader = (mNextDownloader + 1) % mDownloaders.size();
+
+    return true;
+}
+
+status_t SegmentPrefetcher::dequeue(int32_t seqNumber, sp<ABuffer> *buffer) {
+    buffer->clear();
+
+    Mutex::Autolock autoLock(mLock);
+
+    while (mSegments.size() > 0 && mSegments.keyAt(0) < seqNumber) {
+        mSegments.removeItemsAt(0);
+    }
+
+    for (;;) {
+        ssize_t index = mSegments.indexOfKey(seqNumber);
+        CHECK_GE(index, 0);
+
+        const Segment &segment = mSegments.valueAt(index);
+        if (segment.mDone) {
+            status_t err = segment.mErr;
+            *buffer = segment.mBuffer;
+            mSegments.removeItemsAt(index);
+
+            return err;
+        }
+
+        mCondition.wait(mLock);
+    }
+}
+
+void SegmentPrefetcher::flush() {
+    Mutex::Autolock autoLock(mLock);
+
+    mSegments.clear();
+    ++mGeneration;
+}
+
+bool SegmentPrefetcher::startDownload(int32_t generation, int32_t seqNumber) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (generation != mGeneration || mSegments.indexOfKey(seqNumber) < 0) {
+        return false;
+    }
+
+    ++mNumActiveDownloads;
+
+    return true;
+}
+
+void SegmentPrefetcher::onDownloadDone(
+        int32_t generation, int32_t seqNumber,
+        status_t err, const sp<ABuffer> &buffer, int64_t delayUs) {
+    Mutex::Autolock autoLock(mLock);
+
+    CHECK_GT(mNumActiveDownloads, 0u);
+
+    if (err == OK && buffer != NULL) {
+        // Concurrent downloads share the link, scale the transfer time
+        // so the session's estimate still reflects its total throughput.
+        int64_t scaledDelayUs = delayUs / mNumActiveDownloads;
+
+        mSession->addBandwidthMeasurement(buffer->size(), scaledDelayUs);
+        mSession->addSegmentDownload(buffer->size(), scaledDelayUs);
+    }
+
+    --mNumActiveDownloads;
+
+    if (generation != mGeneration) {
+        return;
+    }
+
+    ssize_t index = mSegments.indexOfKey(seqNumber);
+    if (index < 0) {
+        // Discarded by dequeue() while we were downloading it.
+        return;
+    }
+
+    Segment *segment = &mSegments.editValueAt(index);
+    segment->mDone = true;
+    segment->mErr = err;
+    segment->mBuffer = buffer;
+
+    mCondition.broadcast();
+}
+
+}  // namespace android
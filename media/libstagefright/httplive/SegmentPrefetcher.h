@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SEGMENT_PREFETCHER_H_
+
+#define SEGMENT_PREFETCHER_H_
+
+#include <media/stagefright/foundation/ABase.h>
+#include <media/stagefright/foundation/AString.h>
+#include <utils/KeyedVector.h>
+#include <utils/RefBase.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+struct ABuffer;
+struct ALooper;
+struct LiveSession;
+
+// Downloads up to a fixed number of media segments in parallel, each on
+// its own thread and HTTP connection, so that a PlaylistFetcher does not
+// have to wait for a full round-trip per segment.
+struct SegmentPrefetcher : public RefBase {
+    SegmentPrefetcher(const sp<LiveSession> &session, size_t maxNumSegments);
+
+    size_t maxNumSegments() const;
+
+    // Starts downloading the segment unless it is already known. Returns
+    // false if the maximum number of segments is already pending or
+    // waiting to be dequeued.
+    bool queue(
+            int32_t seqNumber, const AString &uri,
+            int64_t rangeOffset, int64_t rangeLength);
+
+    // Blocks until the given segment, which must have been queued, is
+    // downloaded and hands it over to the caller. Segments with lower
+    // sequence numbers are discarded.
+    status_t dequeue(int32_t seqNumber, sp<ABuffer> *buffer);
+
+    // Discards all segments. Downloads already in progress complete
+    // but their results are dropped.
+    void flush();
+
+protected:
+    virtual ~SegmentPrefetcher();
+
+private:
+    struct Downloader;
+
+    struct Segment {
+        bool mDone;
+        status_t mErr;
+        sp<ABuffer> mBuffer;
+    };
+
+    sp<LiveSession> mSession;
+    size_t mMaxNumSegments;
+
+    Vector<sp<ALooper> > mLoopers;
+    Vector<sp<Downloader> > mDownloaders;
+    size_t mNextDownloader;
+
+    Mutex mLock;
+    Condition mCondition;
+
+    // Keyed by sequence number.
+    KeyedVector<int32_t, Segment> mSegments;
+    int32_t mGeneration;
+    size_t mNumActiveDownloads;
+
+    bool startDownload(int32_t generation, int32_t seqNumber);
+    void onDownloadDone(
+            int32_t generation, int32_t seqNumber,
+            status_t err, const sp<ABuffer> &buffer, int64_t delayUs);
+
+    DISALLOW_EVIL_CONSTRUCTORS(SegmentPrefetcher);
+};
+
+}  // namespace android
+
+#endif  // SEGMENT_PREFETCHER_H_
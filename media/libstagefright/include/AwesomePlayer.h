@@ -331,6 +331,7 @@ private:
     struct TrackStat {
         String8 mMIME;
         String8 mDecoderName;
+        wp<MediaSource> mSource;
     };
 
     // protected by mStatsLock
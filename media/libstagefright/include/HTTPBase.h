@@ -63,7 +63,6 @@ struct HTTPBase : public DataSource {
     static void RegisterSocketUserMark(int sockfd, uid_t uid);
     static void UnRegisterSocketUserMark(int sockfd);
 
-protected:
     void addBandwidthMeasurement(size_t numBytes, int64_t delayUs);
 
 private:
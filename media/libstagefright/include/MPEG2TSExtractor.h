@@ -20,6 +20,7 @@
 
 #include <media/stagefright/foundation/ABase.h>
 #include <media/stagefright/MediaExtractor.h>
+#include <utils/String8.h>
 #include <utils/threads.h>
 #include <utils/Vector.h>
 
@@ -48,8 +49,8 @@ struct AnotherPacketSource;
 struct ATSParser;
 struct DataSource;
 struct MPEG2TSSource;
-struct String8;
 struct MPEG2TSDataSource;
+struct TSSeekIndex;
 
 
 struct MPEG2TSExtractor : public MediaExtractor {
@@ -108,6 +109,13 @@ private:
     bool hasAudioPlayFlag;
     bool _success;
     uint8_t *packet;
+    off64_t mPacketOffset;
+    sp<TSSeekIndex> mSeekIndex;
+    String8 mSeekIndexPath;
+    int64_t mSeekIndexFileSize;
+    int64_t mSeekIndexModificationTime;
+    void initSeekIndex();
+    void indexPacket(const uint8_t *data, off64_t offset);
     void init();
     void start();
     void stop();
@@ -24,6 +24,7 @@
 
 namespace android {
 
+struct ABuffer;
 struct ALooper;
 struct PageCache;
 
@@ -58,6 +59,13 @@ struct NuCachedSource2 : public DataSource {
 
     ////////////////////////////////////////////////////////////////////////////
 
+    // Returns a buffer referencing up to "size" cached bytes at "offset"
+    // without copying them, or NULL if "offset" is not currently cached.
+    // The buffer never spans more than one cache page, so it may be shorter
+    // than requested. Its contents are read-only; the underlying page stays
+    // valid until the buffer is released.
+    sp<ABuffer> borrowAt(off64_t offset, size_t size);
+
     size_t cachedSize();
     size_t approxDataRemaining(status_t *finalStatus) const;
 
@@ -96,11 +104,22 @@ private:
     enum {
         kWhatFetchMore  = 'fetc',
         kWhatRead       = 'read',
-		kWaitRead		= 'wait'
+		kWaitRead		= 'wait',
+        kWhatUnpinPage  = 'unpn',
     };
 
     enum {
         kMaxNumRetries = 10,
+
+        // Number of previously active byte ranges kept around when reads
+        // jump elsewhere, e.g. the playback window while the extractor
+        // reads an index near EOF.
+        kMaxNumRetainedRanges = 2,
+    };
+
+    struct CachedRange {
+        off64_t mOffset;
+        PageCache *mCache;
     };
 
     sp<DataSource> mSource;
@@ -113,6 +132,9 @@ private:
 
     PageCache *mCache;
     off64_t mCacheOffset;
+
+    // Inactive ranges, least recently used first.
+    Vector<CachedRange> mRetainedRanges;
     status_t mFinalStatus;
     off64_t mLastAccessPos;
 	off64_t update_pos;
@@ -141,6 +163,10 @@ private:
     ssize_t readInternal(off64_t offset, void *data, size_t size);
     status_t seekInternal_l(off64_t offset);
 
+    ssize_t findRetainedRange_l(off64_t offset, size_t size) const;
+    void retainActiveRange_l();
+    void activateRetainedRange_l(size_t index);
+
     size_t approxDataRemaining_l(status_t *finalStatus) const;
 
     void restartPrefetcherIfNecessary_l(
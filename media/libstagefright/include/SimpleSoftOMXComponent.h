@@ -75,6 +75,22 @@ protected:
 
     PortInfo *editPortInfo(OMX_U32 portIndex);
 
+    // Take mLock, overrides call these rather than the internal versions
+    // when they need to wrap them.
+    virtual OMX_ERRORTYPE setParameter(
+            OMX_INDEXTYPE index, const OMX_PTR params);
+
+    virtual OMX_ERRORTYPE useBuffer(
+            OMX_BUFFERHEADERTYPE **buffer,
+            OMX_U32 portIndex,
+            OMX_PTR appPrivate,
+            OMX_U32 size,
+            OMX_U8 *ptr);
+
+    virtual OMX_ERRORTYPE freeBuffer(
+            OMX_U32 portIndex,
+            OMX_BUFFERHEADERTYPE *buffer);
+
 private:
     enum {
         kWhatSendCommand,
@@ -101,26 +117,12 @@ private:
     virtual OMX_ERRORTYPE getParameter(
             OMX_INDEXTYPE index, OMX_PTR params);
 
-    virtual OMX_ERRORTYPE setParameter(
-            OMX_INDEXTYPE index, const OMX_PTR params);
-
-    virtual OMX_ERRORTYPE useBuffer(
-            OMX_BUFFERHEADERTYPE **buffer,
-            OMX_U32 portIndex,
-            OMX_PTR appPrivate,
-            OMX_U32 size,
-            OMX_U8 *ptr);
-
     virtual OMX_ERRORTYPE allocateBuffer(
             OMX_BUFFERHEADERTYPE **buffer,
             OMX_U32 portIndex,
             OMX_PTR appPrivate,
             OMX_U32 size);
 
-    virtual OMX_ERRORTYPE freeBuffer(
-            OMX_U32 portIndex,
-            OMX_BUFFERHEADERTYPE *buffer);
-
     virtual OMX_ERRORTYPE emptyThisBuffer(
             OMX_BUFFERHEADERTYPE *buffer);
 
@@ -23,6 +23,8 @@
 #include <media/stagefright/foundation/AHandlerReflector.h>
 #include <media/IOMX.h>
 
+#include <system/window.h>
+#include <utils/KeyedVector.h>
 #include <utils/RefBase.h>
 #include <utils/threads.h>
 #include <utils/Vector.h>
@@ -57,6 +59,15 @@ protected:
     virtual OMX_ERRORTYPE getConfig(
             OMX_INDEXTYPE index, OMX_PTR params);
 
+    virtual OMX_ERRORTYPE setParameter(
+            OMX_INDEXTYPE index, const OMX_PTR params);
+
+    virtual OMX_ERRORTYPE freeBuffer(
+            OMX_U32 portIndex, OMX_BUFFERHEADERTYPE *header);
+
+    virtual OMX_ERRORTYPE getExtensionIndex(
+            const char *name, OMX_INDEXTYPE *index);
+
     void initPorts(OMX_U32 numInputBuffers,
             OMX_U32 inputBufferSize,
             OMX_U32 numOutputBuffers,
@@ -64,6 +75,19 @@ protected:
 
     virtual void updatePortDefinitions();
 
+    // For decoders that copy every frame out of buffers of their own: the
+    // client may then hand native window buffers to the output port, and
+    // the frames are written straight into them.
+    void setNativeBuffersSupported();
+
+    // Writes a decoded YUV 4:2:0 planar frame of mWidth x mHeight to an
+    // output buffer, or to the native window buffer behind it, packed as
+    // OMX_COLOR_FormatYUV420Planar.
+    void copyYUV420FrameToOutputBuffer(
+            OMX_BUFFERHEADERTYPE *header,
+            const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV,
+            size_t srcYStride, size_t srcUStride, size_t srcVStride);
+
     enum {
         kInputPortIndex  = 0,
         kOutputPortIndex = 1,
@@ -80,6 +104,32 @@ protected:
     } mOutputPortSettingsChange;
 
 private:
+    // Kept clear of the extension indices of the subclasses, which start
+    // at OMX_IndexVendorStartUnused.
+    enum {
+        kEnableNativeBuffersIndex = OMX_IndexVendorStartUnused + 0x100,
+        kGetNativeBufferUsageIndex,
+        kUseNativeBufferIndex,
+    };
+
+    enum {
+        // Frames between two logs of the output statistics.
+        kStatsInterval = 300,
+    };
+
+    bool mNativeBuffersSupported;
+    bool mNativeBuffersEnabled;
+
+    // The native window buffers behind the output buffer headers.
+    Mutex mNativeBuffersLock;
+    KeyedVector<OMX_BUFFERHEADERTYPE *, sp<ANativeWindowBuffer> > mNativeBuffers;
+
+    uint32_t mNumFramesOutput;
+    uint32_t mNumNativeFramesOutput;
+
+    OMX_ERRORTYPE useNativeBuffer(const OMX_PTR params);
+    sp<ANativeWindowBuffer> getNativeBuffer(OMX_BUFFERHEADERTYPE *header);
+
     const char *mComponentRole;
     OMX_VIDEO_CODINGTYPE mCodingType;
     const CodecProfileLevel *mProfileLevels;
@@ -42,6 +42,11 @@ private:
         None,
     };
 
+    enum {
+        // Frames between two logs of the render statistics.
+        kStatsInterval = 300,
+    };
+
     OMX_COLOR_FORMATTYPE mColorFormat;
     ColorConverter *mConverter;
     YUVMode mYUVMode;
@@ -56,6 +61,12 @@ private:
     int32_t power_fd;
 	int32_t mHttpFlag;
     int32_t mSwdecFlag;
+
+    // Frames that went through render() and the bytes of them that had to
+    // be copied into the window buffers.
+    uint32_t mNumFramesRendered;
+    uint64_t mNumBytesCopied;
+
     SoftwareRenderer(const SoftwareRenderer &);
     SoftwareRenderer &operator=(const SoftwareRenderer &);
 };
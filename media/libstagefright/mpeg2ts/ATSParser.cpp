@@ -78,6 +78,7 @@ struct ATSParser::Program : public RefBase {
     sp<MediaSource> getSource(SourceType type);
 
     int64_t getTimeus(unsigned elementaryPID);
+    sp<Stream> findStream(unsigned pid) const;
 	void set_player_type(int type);
 	int get_player_type(){return player_type;};
     void createLiveStream(unsigned AudioPID,unsigned AudioType,unsigned VideoPID,unsigned VideoType);
@@ -143,6 +144,9 @@ struct ATSParser::Stream : public RefBase {
             unsigned payload_unit_start_indicator,
             ABitReader *br);
 
+    // Equivalent to calling parse() for each chunk in turn.
+    status_t parsePayloads(const PayloadChunk *chunks, size_t numChunks);
+
     status_t Seekparse(
             unsigned payload_unit_start_indicator,
             ABitReader *br);
@@ -192,6 +196,7 @@ private:
 #endif
     status_t flush();
     status_t parsePES(ABitReader *br);
+    void ensureBufferCapacity(size_t neededSize);
 
     status_t Seekflush();
     status_t SeekparsePES(ABitReader *br);
@@ -207,6 +212,14 @@ private:
     DISALLOW_EVIL_CONSTRUCTORS(Stream);
 };
 
+// The payload of a single TS packet.
+struct ATSParser::PayloadChunk {
+    const uint8_t *mData;
+    size_t mSize;
+    unsigned mContinuityCounter;
+    unsigned mPayloadUnitStart;
+};
+
 struct ATSParser::PSISection : public RefBase {
     PSISection();
 
@@ -305,6 +318,15 @@ bool ATSParser::Program::parsePID(
     return true;
 }
 
+sp<ATSParser::Stream> ATSParser::Program::findStream(unsigned pid) const {
+    ssize_t index = mStreams.indexOfKey(pid);
+    if (index < 0) {
+        return NULL;
+    }
+
+    return mStreams.valueAt(index);
+}
+
 void ATSParser::Program::signalDiscontinuity(
         DiscontinuityType type, const sp<AMessage> &extra) {
     int64_t mediaTimeUs;
@@ -854,62 +876,94 @@ status_t ATSParser::Stream::parse(
         return OK;
     }
 #endif
-    mExpectedContinuityCounter = (continuity_counter + 1) & 0x0f;
+    size_t payloadSizeBits = br->numBitsLeft();
+    CHECK_EQ(payloadSizeBits % 8, 0u);
 
-    if (payload_unit_start_indicator) {
-        if (mPayloadStarted) {
-            // Otherwise we run the danger of receiving the trailing bytes
-            // of a PES packet that we never saw the start of and assuming
-            // we have a a complete PES packet.
+    PayloadChunk chunk;
+    chunk.mData = br->data();
+    chunk.mSize = payloadSizeBits / 8;
+    chunk.mContinuityCounter = continuity_counter;
+    chunk.mPayloadUnitStart = payload_unit_start_indicator;
 
-            status_t err = flush();
-            mPes_Length = 0;
-            mPes_Getlength_Flag = false;
-            if (err != OK) {
-                return err;
-            }
-        }
+    return parsePayloads(&chunk, 1);
+}
 
-        mPayloadStarted = true;
+void ATSParser::Stream::ensureBufferCapacity(size_t neededSize) {
+    if (mBuffer->capacity() >= neededSize) {
+        return;
     }
 
-    if (!mPayloadStarted) {
+    // Increment in multiples of 64K.
+    neededSize = (neededSize + 65535) & ~65535;
+
+    ALOGI("resizing buffer to %d bytes", neededSize);
+
+    sp<ABuffer> newBuffer = new ABuffer(neededSize);
+    memcpy(newBuffer->data(), mBuffer->data(), mBuffer->size());
+    newBuffer->setRange(0, mBuffer->size());
+    mBuffer = newBuffer;
+}
+
+status_t ATSParser::Stream::parsePayloads(
+        const PayloadChunk *chunks, size_t numChunks) {
+    if (mQueue == NULL) {
         return OK;
     }
 
-    size_t payloadSizeBits = br->numBitsLeft();
-    CHECK_EQ(payloadSizeBits % 8, 0u);
+    // Make room for the whole batch up front, it usually ends up in the
+    // current PES packet.
+    size_t totalSize = 0;
+    for (size_t i = 0; i < numChunks; ++i) {
+        totalSize += chunks[i].mSize;
+    }
+    ensureBufferCapacity(mBuffer->size() + totalSize);
 
-    size_t neededSize = mBuffer->size() + payloadSizeBits / 8;
-    if (mBuffer->capacity() < neededSize) {
-        // Increment in multiples of 64K.
-        neededSize = (neededSize + 65535) & ~65535;
+    for (size_t i = 0; i < numChunks; ++i) {
+        const PayloadChunk &chunk = chunks[i];
 
-        ALOGI("resizing buffer to %d bytes", neededSize);
+        mExpectedContinuityCounter = (chunk.mContinuityCounter + 1) & 0x0f;
 
-        sp<ABuffer> newBuffer = new ABuffer(neededSize);
-        memcpy(newBuffer->data(), mBuffer->data(), mBuffer->size());
-        newBuffer->setRange(0, mBuffer->size());
-        mBuffer = newBuffer;
-    }
+        if (chunk.mPayloadUnitStart) {
+            if (mPayloadStarted) {
+                // Otherwise we run the danger of receiving the trailing bytes
+                // of a PES packet that we never saw the start of and assuming
+                // we have a a complete PES packet.
 
-    memcpy(mBuffer->data() + mBuffer->size(), br->data(), payloadSizeBits / 8);
-    mBuffer->setRange(0, mBuffer->size() + payloadSizeBits / 8);
+                status_t err = flush();
+                mPes_Length = 0;
+                mPes_Getlength_Flag = false;
+                if (err != OK) {
+                    return err;
+                }
+            }
 
-    if (mBuffer->size() >= 6 && !mPes_Getlength_Flag) {
-        ABitReader brTmp(mBuffer->data(), mBuffer->size());
-        brTmp.skipBits(32);
-        mPes_Length = brTmp.getBits(16);
-        mPes_Getlength_Flag = true;
-    }
-    if((mPes_Length + 6) == mBuffer->size()){
-         status_t err = flush();
-         mPes_Length = 0;
-         mPes_Getlength_Flag = false;
-         if (err != OK) {
-                return err;
-         }
+            mPayloadStarted = true;
+        }
+
+        if (!mPayloadStarted) {
+            continue;
+        }
+
+        ensureBufferCapacity(mBuffer->size() + chunk.mSize);
+
+        memcpy(mBuffer->data() + mBuffer->size(), chunk.mData, chunk.mSize);
+        mBuffer->setRange(0, mBuffer->size() + chunk.mSize);
+
+        if (mBuffer->size() >= 6 && !mPes_Getlength_Flag) {
+            const uint8_t *pes = mBuffer->data();
+            mPes_Length = (pes[4] << 8) | pes[5];
+            mPes_Getlength_Flag = true;
+        }
+        if((mPes_Length + 6) == mBuffer->size()){
+             status_t err = flush();
+             mPes_Length = 0;
+             mPes_Getlength_Flag = false;
+             if (err != OK) {
+                    return err;
+             }
+        }
     }
+
     return OK;
 }
 
@@ -1727,6 +1781,135 @@ status_t ATSParser::feedTSPacket(const void *data, size_t size,uint32_t seekflag
     return parseTS(&br);
 }
 
+status_t ATSParser::feedTSPackets(
+        const void *data, size_t numPackets, size_t stride,
+        uint32_t seekflag) {
+    kTSPacketSize = 188;
+    seekFlag = seekflag;
+
+    const uint8_t *base = (const uint8_t *)data;
+
+    size_t i = 0;
+    while (i < numPackets) {
+        const uint8_t *packet = &base[i * stride];
+
+#ifdef TS_DEBUG
+        fwrite(packet, 1, kTSPacketSize, fp);
+        fflush(fp);
+#endif
+
+        if (packet[0] != 0x47) {
+            ++i;
+            continue;
+        }
+
+        unsigned PID = ((packet[1] & 0x1f) << 8) | packet[2];
+
+        // Tables, unknown PIDs and seek scanning take the regular path.
+        sp<Stream> stream;
+        if (!seekFlag && mPSISections.indexOfKey(PID) < 0) {
+            stream = findStream(PID);
+        }
+
+        if (stream == NULL) {
+            ABitReader br(packet, kTSPacketSize);
+            status_t err = parseTS(&br);
+            if (err != OK) {
+                return err;
+            }
+
+            ++i;
+            continue;
+        }
+
+        if (playStart && !isPIDSelected(PID)) {
+            ++i;
+            continue;
+        }
+
+        // Collect the payloads of the run of packets on this PID.
+        PayloadChunk chunks[kMaxBatchPackets];
+        size_t numChunks = 0;
+
+        for (;;) {
+            unsigned adaptation_field_control = (packet[3] >> 4) & 3;
+
+            const uint8_t *payload = &packet[4];
+            size_t payloadSize = kTSPacketSize - 4;
+
+            if (adaptation_field_control == 2
+                    || adaptation_field_control == 3) {
+                ABitReader br(payload, payloadSize);
+                parseAdaptationField(&br, PID);
+
+                payload = br.data();
+                payloadSize = br.numBitsLeft() / 8;
+            }
+
+            if (adaptation_field_control == 1
+                    || adaptation_field_control == 3) {
+                PayloadChunk *chunk = &chunks[numChunks++];
+                chunk->mData = payload;
+                chunk->mSize = payloadSize;
+                chunk->mContinuityCounter = packet[3] & 0x0f;
+                chunk->mPayloadUnitStart = (packet[1] & 0x40) != 0;
+            }
+
+            ++mNumTSPacketsParsed;
+
+            if (++i == numPackets || numChunks == kMaxBatchPackets) {
+                break;
+            }
+
+            packet = &base[i * stride];
+
+            if (packet[0] != 0x47
+                    || (((packet[1] & 0x1f) << 8) | packet[2]) != PID) {
+                break;
+            }
+
+            // A PCR must reach updatePCR() after the payloads before it,
+            // so the packet carrying one starts the next run.
+            if ((packet[3] & 0x20) && packet[4] > 0 && (packet[5] & 0x10)) {
+                break;
+            }
+
+#ifdef TS_DEBUG
+            fwrite(packet, 1, kTSPacketSize, fp);
+            fflush(fp);
+#endif
+        }
+
+        status_t err = stream->parsePayloads(chunks, numChunks);
+        if (err != OK) {
+            return err;
+        }
+    }
+
+    return OK;
+}
+
+sp<ATSParser::Stream> ATSParser::findStream(unsigned PID) {
+    for (size_t i = 0; i < mPrograms.size(); ++i) {
+        sp<Stream> stream = mPrograms.editItemAt(i)->findStream(PID);
+        if (stream != NULL) {
+            return stream;
+        }
+    }
+
+    return NULL;
+}
+
+bool ATSParser::isPIDSelected(unsigned PID) const {
+    for (size_t i = 0; i < mPIDbuffer.size(); ++i) {
+        if ((unsigned)mPIDbuffer.itemAt(i) == PID) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void ATSParser::createLiveProgramID(unsigned AudioPID,unsigned AudioType,unsigned VideoPID,unsigned VideoType)
 {
     unsigned programMapPID = 0xff; //live ts the programe we have chose;
@@ -2030,21 +2213,8 @@ status_t ATSParser::parseTS(ABitReader *br) {
     MY_LOGV("transport_priority = %u", br->getBits(1));
 
     unsigned PID = br->getBits(13);
-    if(playStart)
-    {
-        bool pass = false;
-        for(int i = 0; i< mPIDbuffer.size();i++)
-        {
-            if(PID == mPIDbuffer.editItemAt(i))
-            {
-                pass = true;
-                break;
-            }
-        }
-        if(!pass)
-        {
-            return OK;
-        }
+    if (playStart && !isPIDSelected(PID)) {
+        return OK;
     }
     ALOGV("PID = 0x%04x", PID);
 
@@ -2142,6 +2312,38 @@ bool ATSParser::PTSTimeDeltaEstablished() {
     return mPrograms.editItemAt(0)->PTSTimeDeltaEstablished();
 }
 
+bool ATSParser::convertPTSToTimestamp(
+        unsigned elementaryPID, uint64_t PTS, int64_t *timeUs) {
+    for (size_t i = 0; i < mPrograms.size(); ++i) {
+        const sp<Program> &program = mPrograms.editItemAt(i);
+
+        if (program->findStream(elementaryPID) == NULL) {
+            continue;
+        }
+
+        // Once the program has rebased its timestamps after a
+        // discontinuity, PTS alone no longer determines them.
+        if (!program->mFirstPTSValid || program->mrestFlag
+                || program->mPlusBaseTimeFlag) {
+            return false;
+        }
+
+        if (!(mFlags & TS_TIMESTAMPS_ARE_ABSOLUTE)) {
+            // Unwrap the 33 bit PTS around the program's first one, earlier
+            // ones map to the start of the timeline.
+            const uint64_t kWrap = 1ull << 33;
+            uint64_t delta = (PTS - program->mFirstPTS) & (kWrap - 1);
+            PTS = delta < kWrap / 2
+                ? program->mFirstPTS + delta : 0;
+        }
+
+        *timeUs = program->convertPTSToTimestamp(PTS);
+        return true;
+    }
+
+    return false;
+}
+
 void ATSParser::updatePCR(
         unsigned PID, uint64_t PCR, size_t byteOffsetFromStart) {
     ALOGV("PCR 0x%016llx @ %d", PCR, byteOffsetFromStart);
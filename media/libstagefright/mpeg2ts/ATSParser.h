@@ -68,6 +68,14 @@ struct ATSParser : public RefBase {
     status_t feedTSPacket(const void *data, size_t size,uint32_t seekflag);
     status_t feedTSPacket(const void *data, size_t size);
 
+    // Feeds "numPackets" consecutive 188 byte TS packets that start
+    // "stride" bytes apart. Runs of packets for the same elementary stream
+    // are dispatched together, which is considerably cheaper than feeding
+    // them one by one.
+    status_t feedTSPackets(
+            const void *data, size_t numPackets,
+            size_t stride = 188, uint32_t seekflag = 0);
+
     void signalDiscontinuity(
             DiscontinuityType type, const sp<AMessage> &extra);
 
@@ -84,6 +92,12 @@ struct ATSParser : public RefBase {
     int64_t getTimeus(uint32_t ProgramID,unsigned elementaryPID);
     void Start(unsigned AudioPID,unsigned VideoPID);
     bool PTSTimeDeltaEstablished();
+
+    // Converts a PTS of the elementary stream "elementaryPID" to the
+    // timeline of the timestamps its source reports. Returns false if the
+    // stream is unknown or its program has no fixed time base yet.
+    bool convertPTSToTimestamp(
+            unsigned elementaryPID, uint64_t PTS, int64_t *timeUs);
     Vector<int32_t> mPIDbuffer;
 
     enum {
@@ -117,6 +131,12 @@ private:
     struct Program;
     struct Stream;
     struct PSISection;
+    struct PayloadChunk;
+
+    enum {
+        // Maximum number of packets dispatched to a stream at once.
+        kMaxBatchPackets = 64,
+    };
 
     uint32_t mFlags;
 #ifdef TS_DEBUG
@@ -151,6 +171,9 @@ private:
     void parseAdaptationField(ABitReader *br, unsigned PID);
     status_t parseTS(ABitReader *br);
 
+    sp<Stream> findStream(unsigned PID);
+    bool isPIDSelected(unsigned PID) const;
+
     void updatePCR(unsigned PID, uint64_t PCR, size_t byteOffsetFromStart);
 
     uint64_t mPCR[2];
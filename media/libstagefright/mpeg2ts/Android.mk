@@ -7,6 +7,7 @@ LOCAL_SRC_FILES:= \
 			ATSParser.cpp             \
 			ESQueue.cpp               \
 			MPEG2TSExtractor.cpp \
+			TSSeekIndex.cpp \
 			bitstream.cpp
 
 LOCAL_C_INCLUDES:= \
@@ -145,6 +145,9 @@ ElementaryStreamQueue::ElementaryStreamQueue(Mode mode, uint32_t flags)
     spsSize = 0;
     SpsPpsBuf = NULL;
 	mLatmAacExtConfig = NULL;
+    mPendingNALBytes = 0;
+    mPendingFoundSlice = false;
+    mScanOffset = 0;
 
 	if(mMode == AAC_LATM)
 	{
@@ -233,6 +236,7 @@ void ElementaryStreamQueue::clear(bool clearFormat) {
     if (mBuffer != NULL) {
         mBuffer->setRange(0, 0);
     }
+    clearPendingNALs();
 	mTimestamps.clear();
     mRangeInfos.clear();
 
@@ -248,6 +252,7 @@ void ElementaryStreamQueue::clear(bool clearFormat) {
 void ElementaryStreamQueue::seekflush() {
     if(mBuffer != NULL)
         mBuffer->setRange(0, 0);
+    clearPendingNALs();
     mTimestamps.clear();
     mRangeInfos.clear();
     seekFlag = true;
@@ -258,6 +263,22 @@ void ElementaryStreamQueue::seekflush() {
 	appendlastTimeus = 0;
 }
 
+void ElementaryStreamQueue::consumeBuffer(size_t size) {
+    if (size >= mBuffer->size()) {
+        mBuffer->setRange(0, 0);
+        return;
+    }
+
+    mBuffer->setRange(mBuffer->offset() + size, mBuffer->size() - size);
+}
+
+void ElementaryStreamQueue::clearPendingNALs() {
+    mPendingNALs.clear();
+    mPendingNALBytes = 0;
+    mPendingFoundSlice = false;
+    mScanOffset = 0;
+}
+
 static bool IsSeeminglyValidADTSHeader(const uint8_t *ptr, size_t size) {
     if (size < 3) {
         // Not enough data to verify header.
@@ -415,8 +436,20 @@ status_t ElementaryStreamQueue::appendData(
     }
 
     size_t neededSize = (mBuffer == NULL ? 0 : mBuffer->size()) + size;
-    if (mBuffer == NULL || neededSize > mBuffer->capacity()) {
-        neededSize = (neededSize + 65535) & ~65535;
+    bool needsRoom = mBuffer == NULL
+            || mBuffer->offset() + neededSize > mBuffer->capacity();
+
+    if (needsRoom && mBuffer != NULL
+            && neededSize <= mBuffer->capacity() / 2) {
+        // At least half the buffer has been consumed since the data was
+        // last moved, so this is cheap compared to moving it on every
+        // dequeue.
+        memmove(mBuffer->base(), mBuffer->data(), mBuffer->size());
+        mBuffer->setRange(0, mBuffer->size());
+    } else if (needsRoom) {
+        // Leave headroom so that the buffer doesn't need to be compacted
+        // again right away.
+        neededSize = (2 * neededSize + 65535) & ~65535;
 
         ALOGV("resizing buffer to size %d", neededSize);
 
@@ -432,7 +465,7 @@ status_t ElementaryStreamQueue::appendData(
     }
 
     memcpy(mBuffer->data() + mBuffer->size(), data, size);
-    mBuffer->setRange(0, mBuffer->size() + size);
+    mBuffer->setRange(mBuffer->offset(), mBuffer->size() + size);
 #ifdef ES_DEBUG
  /* if(mMode == H264)
   {
@@ -484,11 +517,7 @@ MediaBuffer * ElementaryStreamQueue::dequeueAccessUnit() {
         memcpy(accessUnit->data(), mBuffer->data(), info.mLength);
         accessUnit->meta()->setInt64("timeUs", info.mTimestampUs);
 
-        memmove(mBuffer->data(),
-                mBuffer->data() + info.mLength,
-                mBuffer->size() - info.mLength);
-
-        mBuffer->setRange(0, mBuffer->size() - info.mLength);
+        consumeBuffer(info.mLength);
 
         if (mFormat == NULL) {
             mFormat = MakeAVCCodecSpecificData(accessUnit);
@@ -574,23 +603,21 @@ int64_t ElementaryStreamQueue::fetchTimestamp(size_t size) {
     return timeUs;
 }
 
-struct NALPosition {
-    size_t nalOffset;
-    size_t nalSize;
-};
-
 MediaBuffer *ElementaryStreamQueue::dequeueAccessUnitH264() {
-    const uint8_t *data = mBuffer->data();
-    size_t size = mBuffer->size();
-    Vector<NALPosition> nals;
+    // Pick up after the last NAL unit seen by the previous call.
+    const uint8_t *data = mBuffer->data() + mScanOffset;
+    size_t size = mBuffer->size() - mScanOffset;
+    Vector<NALPosition> &nals = mPendingNALs;
 
-    size_t totalSize = 0;
+    size_t &totalSize = mPendingNALBytes;
 
     status_t err;
     const uint8_t *nalStart;
     size_t nalSize;
-    bool foundSlice = false;
+    bool &foundSlice = mPendingFoundSlice;
     while ((err = getNextNALUnit(&data, &size, &nalStart, &nalSize)) == OK) {
+        mScanOffset = nalStart + nalSize - mBuffer->data();
+
         //CHECK_GT(nalSize, 0u);
         if(nalSize <= 0)
         {
@@ -709,11 +736,8 @@ MediaBuffer *ElementaryStreamQueue::dequeueAccessUnitH264() {
             const NALPosition &pos = nals.itemAt(nals.size() - 1);
             nextScan = pos.nalOffset + pos.nalSize;
 
-            memmove(mBuffer->data(),
-                    mBuffer->data() + nextScan,
-                    mBuffer->size() - nextScan);
-
-            mBuffer->setRange(0, mBuffer->size() - nextScan);
+            consumeBuffer(nextScan);
+            clearPendingNALs();
             int64_t timeUs = 0;
 
 
@@ -777,6 +801,7 @@ MediaBuffer *ElementaryStreamQueue::dequeueAccessUnitH264() {
     {
         ALOGV("no nal header in this slice");
         mBuffer->setRange(0,0);
+        clearPendingNALs();
     }
     return NULL;
 }
@@ -810,10 +835,7 @@ MediaBuffer *ElementaryStreamQueue::dequeueAccessUnitHEVC() {
         nextScan = nalStart - mBuffer->data() + nalSize;
     }
     if(nextScan){
-        memmove(mBuffer->data(),
-                        mBuffer->data() + nextScan,
-                        mBuffer->size() - nextScan);
-        mBuffer->setRange(0, mBuffer->size() - nextScan);
+        consumeBuffer(nextScan);
     }
     return NULL;
 }
@@ -953,11 +975,7 @@ MediaBuffer *ElementaryStreamQueue::dequeueAccessUnitH264_Wireless() {
             const NALPosition &pos = nals.itemAt(nals.size() - 1);
             nextScan = pos.nalOffset + pos.nalSize;
 
-            memmove(mBuffer->data(),
-                    mBuffer->data() + nextScan,
-                    mBuffer->size() - nextScan);
-
-            mBuffer->setRange(0, mBuffer->size() - nextScan);
+            consumeBuffer(nextScan);
             int64_t timeUs = 0;
             if(mTimestamps.size() == 0)
             {
@@ -1138,11 +1156,7 @@ MediaBuffer *ElementaryStreamQueue::dequeueAccessUnitH264_Wireless()
             const NALPosition &pos = nals.itemAt(nals.size() - 1);
             nextScan = pos.nalOffset + pos.nalSize;
 
-            memmove(mBuffer->data(),
-                    mBuffer->data() + nextScan,
-                    mBuffer->size() - nextScan);
-
-            mBuffer->setRange(0, mBuffer->size() - nextScan);
+            consumeBuffer(nextScan);
             int64_t timeUs = 0;
             if(mTimestamps.size() == 0)
             {
@@ -1228,9 +1242,7 @@ MediaBuffer * ElementaryStreamQueue::dequeueAccessUnitMPEG2() {
                     if(codeType == 1)
                     {
                         offset -= 2;
-                        memmove(mBuffer->data(), mBuffer->data() + offset,
-                        mBuffer->size() - offset);
-                        mBuffer->setRange(0, mBuffer->size() - offset);
+                        consumeBuffer(offset);
                         seekFlag = false;
                         int64_t timeUs = fetchTimestamp(offset);
         return NULL;
@@ -1275,14 +1287,7 @@ MediaBuffer * ElementaryStreamQueue::dequeueAccessUnitMPEG2() {
             {
                 if(startoffset > 0)
                 {
-                    uint8_t *buf = (uint8_t *)malloc(mBuffer->size() - startoffset);
-                    if(buf)
-                    {
-                         memcpy(buf, mBuffer->data() + startoffset,mBuffer->size() - startoffset);
-                         memcpy(mBuffer->data(),buf,mBuffer->size() - startoffset);
-                         free(buf);
-                    }
-                    mBuffer->setRange(0, mBuffer->size() - startoffset);
+                    consumeBuffer(startoffset);
                     Nextsize += offset - startoffset - 2;
                     fetchTimestamp(startoffset);
                     startoffset = 0;
@@ -1351,15 +1356,8 @@ MediaBuffer * ElementaryStreamQueue::dequeueAccessUnitMPEG2() {
 
     if((mFormat == NULL) || skipFlag ||!auSize)
     {
-        uint8_t *buf = (uint8_t *)malloc(mBuffer->size() - offset);
-        if(buf)
-        {
-             memcpy(buf, mBuffer->data() + offset,mBuffer->size() - offset);
-             memcpy(mBuffer->data(),buf,mBuffer->size() - offset);
-             free(buf);
-        }
         ALOGV("skip the data before SEQUENCE_HEADER_CODE found \n");
-                mBuffer->setRange(0, mBuffer->size() - offset);
+                consumeBuffer(offset);
         fetchTimestamp(offset);
                 // hexdump(csd->data(), csd->size());
 
@@ -1382,20 +1380,8 @@ MediaBuffer * ElementaryStreamQueue::dequeueAccessUnitMPEG2() {
     memcpy(accessUnit->data()+sizeof(TsBitsHeader),(uint8_t*)mBuffer->data(),auSize);
 #ifdef ES_DEBUG
 #endif
-    {
-        uint8_t *buf = (uint8_t *)malloc(mBuffer->size() - offset);
-        if(buf)
-        {
-             memcpy(buf, mBuffer->data() + offset,mBuffer->size() - offset);
-             memcpy(mBuffer->data(),buf,mBuffer->size() - offset);
-             free(buf);
-        }
-    }
             // Picture start
-
-
-
-                mBuffer->setRange(0, mBuffer->size() - offset);
+    consumeBuffer(offset);
 
 
 
@@ -1536,9 +1522,7 @@ MediaBuffer * ElementaryStreamQueue::dequeueAccessUnitVC1() {
                     if(IPicTypeFlag)
                     {
                         offset -= 2;
-                        memmove(mBuffer->data(), mBuffer->data() + offset,
-                        mBuffer->size() - offset);
-                        mBuffer->setRange(0, mBuffer->size() - offset);
+                        consumeBuffer(offset);
                         seekFlag = false;
                         int64_t timeUs = fetchTimestamp(offset);
                         return NULL;
@@ -1563,14 +1547,7 @@ repe:
             {
                 if(startoffset > 0)
                 {
-                    uint8_t *buf = (uint8_t *)malloc(mBuffer->size() - startoffset);
-                    if(buf)
-                    {
-                         memcpy(buf, mBuffer->data() + startoffset,mBuffer->size() - startoffset);
-                         memcpy(mBuffer->data(),buf,mBuffer->size() - startoffset);
-                         free(buf);
-                    }
-                    mBuffer->setRange(0, mBuffer->size() - startoffset);
+                    consumeBuffer(startoffset);
                     Nextsize += offset - startoffset - 2;
                     startoffset = 0;
                 }
@@ -1637,15 +1614,8 @@ repe:
     int64_t timeUs = 0;
     if((mFormat == NULL) || skipFlag ||!auSize)
     {
-        uint8_t *buf = (uint8_t *)malloc(mBuffer->size() - offset);
-        if(buf)
-        {
-             memcpy(buf, mBuffer->data() + offset,mBuffer->size() - offset);
-             memcpy(mBuffer->data(),buf,mBuffer->size() - offset);
-             free(buf);
-        }
         ALOGV("skip the data before SEQUENCE_HEADER_CODE found \n");
-        mBuffer->setRange(0, mBuffer->size() - offset);
+        consumeBuffer(offset);
         fetchTimestamp(offset);
         return NULL;
     }
@@ -1806,11 +1776,7 @@ MediaBuffer *ElementaryStreamQueue::dequeueAccessUnitPCMAudio() {
 
 			if(loop_time > 0)
 			{
-				memmove(
-		            mBuffer->data(),
-		            mBuffer->data() + loop_time * 4,
-		            mBuffer->size() - loop_time * 4);
-		    	mBuffer->setRange(0, mBuffer->size() - loop_time * 4);
+				consumeBuffer(loop_time * 4);
 
 			}
         	return NULL;
@@ -1843,11 +1809,7 @@ MediaBuffer *ElementaryStreamQueue::dequeueAccessUnitPCMAudio() {
 		{
 			if(loop_time!=0)
 			{
-				memmove(
-		            mBuffer->data(),
-		            mBuffer->data() + loop_time * 4,
-		            mBuffer->size() - loop_time * 4);
-	    		mBuffer->setRange(0, mBuffer->size() - loop_time * 4);
+				consumeBuffer(loop_time * 4);
 			}
 			break;
 		}
@@ -1883,12 +1845,7 @@ MediaBuffer *ElementaryStreamQueue::dequeueAccessUnitPCMAudio() {
         ptr[i] = ntohs(ptr[i]);
     }
 
-    memmove(
-            mBuffer->data(),
-            mBuffer->data() + 4 + payloadSize,
-            mBuffer->size() - 4 - payloadSize);
-
-    mBuffer->setRange(0, mBuffer->size() - 4 - payloadSize);
+    consumeBuffer(4 + payloadSize);
 
     return accessUnit;
 
@@ -1935,12 +1892,7 @@ MediaBuffer *ElementaryStreamQueue::dequeueAccessUnitPCMAudio() {
         ptr[i] = ntohs(ptr[i]);
     }
 
-    memmove(
-            mBuffer->data(),
-            mBuffer->data() + 4 + payloadSize,
-            mBuffer->size() - 4 - payloadSize);
-
-    mBuffer->setRange(0, mBuffer->size() - 4 - payloadSize);
+    consumeBuffer(4 + payloadSize);
 
     return accessUnit;
 #endif
@@ -2035,8 +1987,7 @@ MediaBuffer * ElementaryStreamQueue::dequeueAccessUnitMP3() {
           }
 		  if(mFormat==NULL)
    		  {
-   		  	memmove(mBuffer->data(), mBuffer->data() + offset,mBuffer->size() - offset);
-    		mBuffer->setRange(0, mBuffer->size() - offset);
+   		  	consumeBuffer(offset);
 			return NULL;
    		  }
 #ifdef ES_DEBUG
@@ -2200,12 +2151,10 @@ MediaBuffer *ElementaryStreamQueue::dequeueAccessUnitAAC_ADTS() {
         dstOffset += frameSizes.itemAt(i);
     }
 
-    memmove(mBuffer->data(), mBuffer->data() + offset,
-            mBuffer->size() - offset);
     if(hasframe)
         mBuffer->setRange(0,0);
     else
-    mBuffer->setRange(0, mBuffer->size() - offset);
+    consumeBuffer(offset);
 
     int64_t timeUs = 0;
     if(mTimestamps.size() > 0)
@@ -3054,8 +3003,7 @@ MediaBuffer *ElementaryStreamQueue::dequeueAccessUnitAAC_ADTS() {
 #endif
 
 
-							memmove(mBuffer->data(), mBuffer->data() + offset+muxlen, mBuffer->size() - offset-muxlen);
-							mBuffer->setRange(0,len-muxlen -offset);
+							consumeBuffer(offset + muxlen);
 
 
 					}
@@ -3112,15 +3060,13 @@ MediaBuffer *ElementaryStreamQueue::dequeueAccessUnitAAC_ADTS() {
 					ALOGI("--->remove this package data ");
 					if(mLatmAacExtConfig->outputBufferLength <= len && mLatmAacExtConfig->outputBufferLength >0)
 					{
-						memmove(mBuffer->data(), mBuffer->data() + mLatmAacExtConfig->outputBufferLength,mBuffer->size() - mLatmAacExtConfig->outputBufferLength);
-    					mBuffer->setRange(0, mBuffer->size() - mLatmAacExtConfig->outputBufferLength);
+						consumeBuffer(mLatmAacExtConfig->outputBufferLength);
 					}
 					else if(mLatmAacExtConfig->outputBufferLength <= 0)
 					{
 						if(len > muxlen + offset )
 						{
-							    memmove(mBuffer->data(), mBuffer->data() + offset+muxlen, mBuffer->size() - offset-muxlen);
-								mBuffer->setRange(0,len-muxlen -offset);
+							    consumeBuffer(offset + muxlen);
 						}
 						else{
 					        mTimestamps.clear();
@@ -3218,10 +3164,7 @@ MediaBuffer *ElementaryStreamQueue::dequeueAccessUnitAAC_ADTS() {
 	if(fp)
 		fwrite(mBuffer->data(),1,offset,fp);
 #endif
-    memmove(mBuffer->data(), mBuffer->data() + offset,
-            mBuffer->size() - offset);
-
-    mBuffer->setRange(0, mBuffer->size() - offset);
+    consumeBuffer(offset);
 
     tmpbuf->release();
     tmpbuf = NULL;
@@ -23,6 +23,7 @@
 #include <media/stagefright/MediaBuffer.h>
 #include <utils/List.h>
 #include <utils/RefBase.h>
+#include <utils/Vector.h>
 #include "AnotherPacketSource.h"
 
 namespace android {
@@ -150,9 +151,16 @@ private:
         size_t mLength;
     };
 
+    struct NALPosition {
+        size_t nalOffset;
+        size_t nalSize;
+    };
+
     Mode mMode;
     uint32_t mFlags;
 
+    // Consumed data is dropped by advancing the range offset, the space in
+    // front of it is only reclaimed once appendData() runs out of room.
     sp<ABuffer> mBuffer;
     List<RangeInfo> mRangeInfos;
 	List<int64_t> mTimestamps;
@@ -171,6 +179,16 @@ private:
     uint8_t *SpsPpsBuf;
     uint32_t spsSize;
 	LatmAacExtConfig * mLatmAacExtConfig;
+
+    // H.264 NAL units already scanned for the access unit being assembled,
+    // so that dequeueAccessUnitH264() resumes where it left off.
+    Vector<NALPosition> mPendingNALs;
+    size_t mPendingNALBytes;
+    bool mPendingFoundSlice;
+    size_t mScanOffset;
+
+    void consumeBuffer(size_t size);
+    void clearPendingNALs();
     MediaBuffer * dequeueAccessUnitH264_Wireless();
     MediaBuffer * dequeueAccessUnitH264();
     MediaBuffer * dequeueAccessUnitHEVC();
@@ -39,10 +39,12 @@
 #include <media/stagefright/MediaSource.h>
 #include <media/stagefright/MetaData.h>
 #include <media/stagefright/MediaBuffer.h>
+#include <cutils/properties.h>
 #include <utils/String8.h>
 
 #include "AnotherPacketSource.h"
 #include "ATSParser.h"
+#include "TSSeekIndex.h"
 #include <dlfcn.h>
 
 #define MAX_AUDIO_TRACK 10
@@ -175,6 +177,10 @@ struct MPEG2TSDataSource : public DataSource {
     virtual ssize_t readAt(off64_t offset, void *data, size_t size);
     virtual status_t getSize(off64_t *size);
     virtual void updatecache(off64_t offset);
+    virtual const void *getDirectPointer(off64_t offset, size_t size);
+    virtual void setAccessPattern(AccessPattern pattern);
+    virtual void prefetch(off64_t offset, size_t size);
+    virtual bool getFileIdentity(String8 *key, int64_t *size, int64_t *mtime);
 protected:
     virtual ~MPEG2TSDataSource();
 private:
@@ -200,6 +206,19 @@ status_t MPEG2TSDataSource::initCheck() const {
 ssize_t MPEG2TSDataSource::readAt(off64_t offset, void *data, size_t size) {
     return mSource->readAt(offset, data, size);
 }
+const void *MPEG2TSDataSource::getDirectPointer(off64_t offset, size_t size) {
+    return mSource->getDirectPointer(offset, size);
+}
+void MPEG2TSDataSource::setAccessPattern(AccessPattern pattern) {
+    mSource->setAccessPattern(pattern);
+}
+void MPEG2TSDataSource::prefetch(off64_t offset, size_t size) {
+    mSource->prefetch(offset, size);
+}
+bool MPEG2TSDataSource::getFileIdentity(
+        String8 *key, int64_t *size, int64_t *mtime) {
+    return mSource->getFileIdentity(key, size, mtime);
+}
 MPEG2TSDataSource::~MPEG2TSDataSource() {
 }
 MPEG2TSSource::MPEG2TSSource(
@@ -658,6 +677,9 @@ MPEG2TSExtractor::MPEG2TSExtractor(const sp<DataSource> &source,AppType type)
         endEos = false;
         threadout = false;
         packet = NULL;
+        mPacketOffset = 0;
+        mSeekIndexFileSize = 0;
+        mSeekIndexModificationTime = 0;
 #if DVB_ENABLE
 		mDvbLibHandle = NULL;
 		dvbGetData = NULL;
@@ -666,6 +688,7 @@ MPEG2TSExtractor::MPEG2TSExtractor(const sp<DataSource> &source,AppType type)
 		dvbGetExit= NULL;
 #endif //DVB_ENABLE
     	mDataSource->initCheck();
+        mDataSource->setAccessPattern(DataSource::kAccessSequential);
 	init();
         lastseektimeus = 0;
 }
@@ -675,6 +698,15 @@ MPEG2TSExtractor::~MPEG2TSExtractor(){
         sp<AnotherPacketSource> mTImpl = mSourceImpls.editItemAt(i);
         mTImpl->stop();
     }
+    if (mSeekIndex != NULL && !mSeekIndexPath.isEmpty()) {
+        status_t err = mSeekIndex->save(
+                mSeekIndexPath.string(),
+                mSeekIndexFileSize, mSeekIndexModificationTime);
+        if (err != OK) {
+            ALOGW("failed to save seek index '%s' (%d)",
+                  mSeekIndexPath.string(), err);
+        }
+    }
 #if DVB_ENABLE
 
     if(mType == LIVE_TV)
@@ -755,13 +787,29 @@ sp<MetaData> MPEG2TSExtractor::getMetaData() {
 }
 off64_t MPEG2TSExtractor::FirstPackfound(off64_t mOffset)
 {
+    // A sync byte has to repeat at the packet size for 5 packets, the first
+    // one may be anywhere within the first packet. Fetch the whole probe
+    // window at once rather than issuing a read per byte.
+    static const int kNumProbePackets = 5;
+    uint8_t window[TS_MAX_PACKET_SIZE * (kNumProbePackets + 1)];
+    size_t windowSize = kTSPacketSize * (kNumProbePackets + 1);
+
+    const uint8_t *data =
+        (const uint8_t *)mDataSource->getDirectPointer(mOffset, windowSize);
+    ssize_t n = windowSize;
+    if (data == NULL) {
+        n = mDataSource->readAt(mOffset, window, windowSize);
+        data = window;
+    }
+    if (n < 0) {
+        n = 0;
+    }
+
     int mpegtsFlag = 1;
-    char header;
     off64_t packoffset = 0;
-    for (int i = 0; i < 5; ++i)
+    for (int i = 0; i < kNumProbePackets; ++i)
     {
-        if (mDataSource->readAt(mOffset + kTSPacketSize * i, &header, 1) != 1
-            || header != 0x47) {
+        if (kTSPacketSize * i >= n || data[kTSPacketSize * i] != 0x47) {
             mpegtsFlag = 0;
             break;
         }
@@ -770,23 +818,23 @@ off64_t MPEG2TSExtractor::FirstPackfound(off64_t mOffset)
     {
         for(int i = 0; i < kTSPacketSize; i++)
         {
-            if (mDataSource->readAt(mOffset + i, &header, 1) != 1)
+            if (i >= n)
             {
                 ALOGV("found first packert read error");
                 return -1;
             }
             else
             {
-                if(header == 0x47)
+                if(data[i] == 0x47)
                 {
                     mpegtsFlag = 1;
-                    for(int j = 1; j < 5; j++)
+                    for(int j = 1; j < kNumProbePackets; j++)
                     {
-                        if (mDataSource->readAt(mOffset + j*kTSPacketSize + i, &header, 1) != 1)
+                        if (j*kTSPacketSize + i >= n)
                         {
                             break;
                         }
-                        if(header != 0x47)
+                        if(data[j*kTSPacketSize + i] != 0x47)
                         {
                             mpegtsFlag = 0;
                             break;
@@ -804,6 +852,36 @@ off64_t MPEG2TSExtractor::FirstPackfound(off64_t mOffset)
     return packoffset;
 }
 
+void MPEG2TSExtractor::initSeekIndex() {
+    mSeekIndex = new TSSeekIndex;
+
+    // Indices are only persisted if a directory has been configured for them.
+    char dir[PROPERTY_VALUE_MAX];
+    if (!property_get("media.stagefright.ts-index-dir", dir, NULL)) {
+        return;
+    }
+
+    String8 key;
+    if (!mDataSource->getFileIdentity(
+                &key, &mSeekIndexFileSize, &mSeekIndexModificationTime)) {
+        return;
+    }
+
+    mSeekIndexPath = String8::format("%s/%s.tsidx", dir, key.string());
+
+    if (mSeekIndex->load(
+                mSeekIndexPath.string(),
+                mSeekIndexFileSize, mSeekIndexModificationTime) == OK) {
+        ALOGI("using seek index with %d entries", mSeekIndex->countEntries());
+    }
+}
+
+void MPEG2TSExtractor::indexPacket(const uint8_t *data, off64_t offset) {
+    if (mSeekIndex != NULL) {
+        mSeekIndex->addPacket(data, offset);
+    }
+}
+
 void MPEG2TSExtractor::init() {
     bool haveAudio = false;
     bool haveVideo = false;
@@ -857,6 +935,8 @@ void MPEG2TSExtractor::init() {
              return;
           }
           mOffset += FirstPackoffset;
+
+          initSeekIndex();
             break;
         }
         case LIVE_TV:
@@ -1153,6 +1233,9 @@ void MPEG2TSExtractor::init() {
             }
         }
         mParser->signalSeek();
+        if (mSeekIndex != NULL) {
+            mSeekIndex->signalSeek();
+        }
         if(Totalsize > 20000*188)
         {
             mOffset = Totalsize - 20000*188;
@@ -1180,6 +1263,9 @@ void MPEG2TSExtractor::init() {
         if(timeUsEnd)
            mSeekSize = Totalsize /(timeUsEnd/1000);
         mOffset = startOffset;
+        if (mSeekIndex != NULL) {
+            mSeekIndex->signalSeek();
+        }
         MY_LOGD("haveAudio=%d, haveVideo=%d", haveAudio, haveVideo);
     }
     init_flag = 1;
@@ -1232,6 +1318,7 @@ int32_t MPEG2TSExtractor::FileProcess()
           return 1000;
         if(mOffset + kTSPacketSize*TS_MAX_PACKET < Totalsize)
         {
+            mPacketOffset = mOffset;
             if(kTSPacketSize*TS_MAX_PACKET != mDataSource->readAt(mOffset, packet, kTSPacketSize*TS_MAX_PACKET))
             {
                 endEos = true;
@@ -1241,6 +1328,7 @@ int32_t MPEG2TSExtractor::FileProcess()
         }
         else
         {
+            mPacketOffset = mOffset;
             if((Totalsize - mOffset) != mDataSource->readAt(mOffset, packet, Totalsize - mOffset)){
                 packetNum = 0;
                 Lastpackt = 0;
@@ -1275,6 +1363,7 @@ int32_t MPEG2TSExtractor::FileProcess()
         }
         if(mOffset + kTSPacketSize*TS_MAX_PACKET < Totalsize)
         {
+            mPacketOffset = mOffset;
             if(kTSPacketSize*TS_MAX_PACKET != mDataSource->readAt(mOffset, packet, kTSPacketSize*TS_MAX_PACKET))
             {
                 endEos = true;
@@ -1284,6 +1373,7 @@ int32_t MPEG2TSExtractor::FileProcess()
         }
         else
         {
+            mPacketOffset = mOffset;
             if((Totalsize - mOffset) != mDataSource->readAt(mOffset, packet, Totalsize - mOffset)){
                 packetNum = 0;
                 Lastpackt = 0;
@@ -1295,6 +1385,8 @@ int32_t MPEG2TSExtractor::FileProcess()
             mOffset = Totalsize;
         }
     }
+    indexPacket(&packet[kTSPacketSize*packetNum],
+                mPacketOffset + kTSPacketSize*packetNum);
     if(TS_DVHS_PACKET_SIZE == kTSPacketSize)
     {
        mParser->feedTSPacket(&packet[kTSPacketSize*packetNum], kTSPacketSize - 4,seekFlag);
@@ -1537,6 +1629,7 @@ retry:
         else{
             mParser->feedTSPacket(packet, kTSPacketSize,seekFlag);
         }
+        indexPacket(packet, mOffset);
     }
 
     mOffset += n;
@@ -1554,6 +1647,20 @@ void MPEG2TSExtractor::seekTo(int64_t seekTimeUs) {
 
     mParser->signalDiscontinuity(ATSParser::DISCONTINUITY_SEEK,NULL);
     mParser->signalSeek();
+
+    if (mSeekIndex != NULL) {
+        mSeekIndex->signalSeek();
+    }
+
+    off64_t indexedOffset;
+    if (mSeekIndex != NULL
+            && mSeekIndex->findOffset(seekTimeUs, mParser, &indexedOffset)) {
+        ALOGV("seek to %lld us using index, offset %lld",
+              seekTimeUs, indexedOffset);
+        mOffset = indexedOffset;
+        return;
+    }
+
     off64_t startOffset;
     startOffset = seekTimeUs/1000*mSeekSize;
     if(startOffset > 2*1024*1024)
@@ -0,0 +1,395 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "TSSeekIndex"
+#include <utils/Log.h>
+
+#include "TSSeekIndex.h"
+
+#include "ATSParser.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/MediaErrors.h>
+
+namespace android {
+
+static const uint32_t kSidecarMagic = 'TSIX';
+static const uint32_t kSidecarVersion = 2;
+
+struct SidecarHeader {
+    uint32_t mMagic;
+    uint32_t mVersion;
+    int64_t mFileSize;
+    int64_t mModificationTime;
+    int64_t mDiscontinuityOffset;
+    uint64_t mBasePTS;
+    uint32_t mPID;
+    uint32_t mNumEntries;
+};
+
+// Sanity limit, about one entry per half second of a 6 day recording.
+static const uint32_t kMaxSidecarEntries = 1 << 20;
+
+static const uint64_t kPTSMask = (1ull << 33) - 1;
+
+static uint64_t usToPTS(int64_t timeUs) {
+    return (uint64_t)timeUs * 9 / 100;
+}
+
+TSSeekIndex::TSSeekIndex()
+    : mPIDValid(false),
+      mPID(0),
+      mBasePTSValid(false),
+      mBasePTS(0),
+      mLastPTSValid(false),
+      mLastPTS(0),
+      mDiscontinuityOffset(LLONG_MAX),
+      mNumPESWithoutRAI(0),
+      mDirty(false) {
+}
+
+TSSeekIndex::~TSSeekIndex() {
+}
+
+void TSSeekIndex::addPacket(const uint8_t *packet, off64_t offset) {
+    if (packet[0] != 0x47) {
+        return;
+    }
+
+    bool payloadUnitStart = (packet[1] & 0x40) != 0;
+    unsigned PID = ((packet[1] & 0x1f) << 8) | packet[2];
+    unsigned adaptationFieldControl = (packet[3] >> 4) & 3;
+
+    Mutex::Autolock autoLock(mLock);
+
+    if (mPIDValid && PID != mPID) {
+        return;
+    }
+
+    size_t pos = 4;
+    bool randomAccess = false;
+
+    if (adaptationFieldControl & 2) {
+        unsigned adaptationFieldLength = packet[4];
+        if (adaptationFieldLength > 0) {
+            if (mPIDValid && (packet[5] & 0x80)) {
+                // discontinuity_indicator
+                markDiscontinuity_l(offset);
+            }
+            randomAccess = (packet[5] & 0x40) != 0;
+        }
+        pos = 5 + adaptationFieldLength;
+    }
+
+    if (!payloadUnitStart || !(adaptationFieldControl & 1)) {
+        return;
+    }
+
+    // Need the PES header up to and including the PTS.
+    if (pos + 14 > 188) {
+        return;
+    }
+
+    const uint8_t *pes = &packet[pos];
+    if (pes[0] != 0x00 || pes[1] != 0x00 || pes[2] != 0x01) {
+        return;
+    }
+
+    unsigned streamID = pes[3];
+    if ((streamID & 0xf0) != 0xe0 || !(pes[7] & 0x80)) {
+        // Not video or no PTS.
+        return;
+    }
+
+    uint64_t PTS = ((uint64_t)(pes[9] & 0x0e) << 29)
+        | ((uint64_t)pes[10] << 22)
+        | ((uint64_t)(pes[11] & 0xfe) << 14)
+        | ((uint64_t)pes[12] << 7)
+        | (pes[13] >> 1);
+
+    if (mPIDValid && mLastPTSValid) {
+        // Decode order may run slightly backwards, a jump either way by more
+        // than kMaxPTSStepUs (modulo the 33 bit wraparound) starts a new
+        // time base.
+        uint64_t step = (PTS - mLastPTS) & kPTSMask;
+        if (step > usToPTS(kMaxPTSStepUs)
+                && step < (1ull << 33) - usToPTS(kMaxPTSStepUs)) {
+            markDiscontinuity_l(offset);
+        }
+    }
+    mLastPTSValid = true;
+    mLastPTS = PTS;
+
+    if (!randomAccess) {
+        if (mNumPESWithoutRAI < kMaxPESWithoutRAI) {
+            ++mNumPESWithoutRAI;
+            return;
+        }
+    } else {
+        mNumPESWithoutRAI = 0;
+    }
+
+    if (!mPIDValid) {
+        mPIDValid = true;
+        mPID = PID;
+    }
+
+    addEntry_l(PTS, offset);
+}
+
+void TSSeekIndex::signalSeek() {
+    Mutex::Autolock autoLock(mLock);
+    mLastPTSValid = false;
+}
+
+// Entries may be recorded out of order, e.g. after a seek, so the PTS is
+// unwrapped to within half the 33 bit range either side of the first one,
+// biased by 2^33 to stay positive.
+uint64_t TSSeekIndex::unwrapPTS_l(uint64_t PTS) const {
+    int64_t delta = (int64_t)((PTS - mBasePTS) & kPTSMask);
+    if (delta >= (1ll << 32)) {
+        delta -= 1ll << 33;
+    }
+
+    return mBasePTS + (1ull << 33) + delta;
+}
+
+void TSSeekIndex::markDiscontinuity_l(off64_t offset) {
+    if (offset >= mDiscontinuityOffset) {
+        return;
+    }
+
+    ALOGV("timestamp discontinuity at offset %lld", offset);
+    mDiscontinuityOffset = offset;
+
+    size_t n = mEntries.size();
+    while (n > 0 && mEntries.itemAt(n - 1).mOffset >= offset) {
+        --n;
+    }
+
+    if (n < mEntries.size()) {
+        mEntries.removeItemsAt(n, mEntries.size() - n);
+        mDirty = true;
+    }
+}
+
+void TSSeekIndex::addEntry_l(uint64_t PTS, off64_t offset) {
+    if (offset >= mDiscontinuityOffset) {
+        return;
+    }
+
+    if (!mBasePTSValid) {
+        mBasePTSValid = true;
+        mBasePTS = PTS;
+    }
+
+    PTS = unwrapPTS_l(PTS);
+
+    // Find the first entry at or past "offset".
+    size_t lo = 0;
+    size_t hi = mEntries.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (mEntries.itemAt(mid).mOffset < offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // Times must grow with the offset, otherwise a time base change lies
+    // somewhere between the neighbours that was never parsed.
+    if (lo > 0 && PTS <= mEntries.itemAt(lo - 1).mPTS) {
+        markDiscontinuity_l(mEntries.itemAt(lo - 1).mOffset + 1);
+        return;
+    }
+
+    if (lo < mEntries.size() && mEntries.itemAt(lo).mOffset != offset
+            && PTS >= mEntries.itemAt(lo).mPTS) {
+        markDiscontinuity_l(offset + 1);
+    }
+
+    if (lo < mEntries.size()) {
+        const Entry &next = mEntries.itemAt(lo);
+        if (next.mOffset == offset
+                || next.mPTS - PTS < usToPTS(kMinEntrySpacingUs)) {
+            return;
+        }
+    }
+
+    if (lo > 0 && PTS - mEntries.itemAt(lo - 1).mPTS
+            < usToPTS(kMinEntrySpacingUs)) {
+        return;
+    }
+
+    Entry entry;
+    entry.mPTS = PTS;
+    entry.mOffset = offset;
+    mEntries.insertAt(entry, lo);
+
+    mDirty = true;
+}
+
+bool TSSeekIndex::findOffset(
+        int64_t timeUs, const sp<ATSParser> &parser, off64_t *offset) const {
+    Mutex::Autolock autoLock(mLock);
+
+    if (!mPIDValid || mEntries.size() < 2) {
+        return false;
+    }
+
+    // Last entry at or before "timeUs".
+    size_t lo = 0;
+    size_t hi = mEntries.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        int64_t entryTimeUs;
+        if (!parser->convertPTSToTimestamp(
+                    mPID, mEntries.itemAt(mid).mPTS & kPTSMask,
+                    &entryTimeUs)) {
+            return false;
+        }
+
+        if (entryTimeUs <= timeUs) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo == 0 || lo == mEntries.size()) {
+        return false;
+    }
+
+    const Entry &entry = mEntries.itemAt(lo - 1);
+    const Entry &next = mEntries.itemAt(lo);
+
+    if (next.mPTS - entry.mPTS > usToPTS(kMaxEntryGapUs)) {
+        return false;
+    }
+
+    *offset = entry.mOffset;
+
+    return true;
+}
+
+size_t TSSeekIndex::countEntries() const {
+    Mutex::Autolock autoLock(mLock);
+    return mEntries.size();
+}
+
+status_t TSSeekIndex::load(const char *path, int64_t fileSize, int64_t mtime) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    status_t err = OK;
+
+    SidecarHeader header;
+    if (read(fd, &header, sizeof(header)) != (ssize_t)sizeof(header)
+            || header.mMagic != kSidecarMagic
+            || header.mVersion != kSidecarVersion
+            || header.mFileSize != fileSize
+            || header.mModificationTime != mtime
+            || header.mNumEntries > kMaxSidecarEntries) {
+        ALOGV("ignoring stale or malformed index '%s'", path);
+        err = ERROR_MALFORMED;
+    }
+
+    Vector<Entry> entries;
+    if (err == OK) {
+        entries.insertAt(0, header.mNumEntries);
+
+        ssize_t size = header.mNumEntries * sizeof(Entry);
+        if (read(fd, entries.editArray(), size) != size) {
+            err = ERROR_MALFORMED;
+        }
+    }
+
+    close(fd);
+
+    if (err != OK) {
+        return err;
+    }
+
+    Mutex::Autolock autoLock(mLock);
+
+    // The stored entries supersede whatever has been parsed so far.
+    mEntries = entries;
+    mPIDValid = true;
+    mPID = header.mPID;
+    mBasePTSValid = true;
+    mBasePTS = header.mBasePTS;
+    mDiscontinuityOffset = header.mDiscontinuityOffset;
+    mDirty = false;
+
+    ALOGV("loaded %zu entries from '%s'", mEntries.size(), path);
+
+    return OK;
+}
+
+status_t TSSeekIndex::save(const char *path, int64_t fileSize, int64_t mtime) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (!mDirty || mEntries.isEmpty() || !mPIDValid) {
+        return OK;
+    }
+
+    // Write to a temporary file first so readers never see a partial index.
+    char tmpPath[PATH_MAX];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+    int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0640);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    SidecarHeader header;
+    header.mMagic = kSidecarMagic;
+    header.mVersion = kSidecarVersion;
+    header.mFileSize = fileSize;
+    header.mModificationTime = mtime;
+    header.mDiscontinuityOffset = mDiscontinuityOffset;
+    header.mBasePTS = mBasePTS;
+    header.mPID = mPID;
+    header.mNumEntries = mEntries.size();
+
+    ssize_t size = mEntries.size() * sizeof(Entry);
+    bool ok = write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header)
+        && write(fd, mEntries.array(), size) == size;
+
+    close(fd);
+
+    if (!ok || rename(tmpPath, path) != 0) {
+        unlink(tmpPath);
+        return UNKNOWN_ERROR;
+    }
+
+    mDirty = false;
+
+    return OK;
+}
+
+}  // namespace android
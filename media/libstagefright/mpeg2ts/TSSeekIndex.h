@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TS_SEEK_INDEX_H_
+
+#define TS_SEEK_INDEX_H_
+
+#include <sys/types.h>
+
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+struct ATSParser;
+
+// Maps presentation time to the byte offset of random access points in a
+// transport stream. The index is filled in incrementally from the packets
+// the extractor parses anyway, and can be saved to and restored from a
+// sidecar file so later sessions can seek with a binary search.
+//
+// Entries hold the raw PTS, times are only derived from them through the
+// parser's program when looking up, so they share the timeline of the
+// timestamps the sources report. Only the stream up to its first timestamp
+// discontinuity is indexed.
+struct TSSeekIndex : public RefBase {
+    TSSeekIndex();
+
+    // Inspects the 188 byte TS packet found at "offset" in the stream and
+    // records it if it starts a video access unit at a random access point.
+    void addPacket(const uint8_t *packet, off64_t offset);
+
+    // The next packet is not the one following the last packet added.
+    void signalSeek();
+
+    // Returns true and the offset of the last indexed random access point
+    // at or before "timeUs", if the index covers that time without gaps.
+    bool findOffset(
+            int64_t timeUs, const sp<ATSParser> &parser,
+            off64_t *offset) const;
+
+    size_t countEntries() const;
+
+    // The sidecar is only accepted if it was written for a file of the
+    // same size and modification time.
+    status_t load(const char *path, int64_t fileSize, int64_t mtime);
+    status_t save(const char *path, int64_t fileSize, int64_t mtime);
+
+protected:
+    virtual ~TSSeekIndex();
+
+private:
+    enum {
+        // Entries closer together than this are not worth recording.
+        kMinEntrySpacingUs = 500000,
+
+        // Neighbouring entries further apart than this are assumed to
+        // have unindexed data in between.
+        kMaxEntryGapUs = 5000000,
+
+        // Streams that never flag random access points get every video
+        // PES start indexed once this many have been seen.
+        kMaxPESWithoutRAI = 64,
+
+        // Consecutive video PES further apart than this in time belong to
+        // different time bases.
+        kMaxPTSStepUs = 10000000,
+    };
+
+    struct Entry {
+        // See unwrapPTS_l(), the raw PTS are the lower 33 bits.
+        uint64_t mPTS;
+        off64_t mOffset;
+    };
+
+    mutable Mutex mLock;
+
+    // Sorted by offset, the PTS grows with it.
+    Vector<Entry> mEntries;
+
+    bool mPIDValid;
+    unsigned mPID;
+
+    bool mBasePTSValid;
+    uint64_t mBasePTS;
+
+    // PTS of the last video PES start on mPID, to detect discontinuities
+    // between consecutive packets.
+    bool mLastPTSValid;
+    uint64_t mLastPTS;
+
+    // Nothing at or past this offset is indexed.
+    off64_t mDiscontinuityOffset;
+
+    size_t mNumPESWithoutRAI;
+    bool mDirty;
+
+    uint64_t unwrapPTS_l(uint64_t PTS) const;
+    void addEntry_l(uint64_t PTS, off64_t offset);
+    void markDiscontinuity_l(off64_t offset);
+
+    DISALLOW_EVIL_CONSTRUCTORS(TSSeekIndex);
+};
+
+}  // namespace android
+
+#endif  // TS_SEEK_INDEX_H_
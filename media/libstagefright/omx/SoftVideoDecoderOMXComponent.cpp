@@ -20,10 +20,14 @@
 
 #include "include/SoftVideoDecoderOMXComponent.h"
 
+#include <HardwareAPI.h>
+#include <hardware/gralloc.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/ALooper.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/MediaDefs.h>
+#include <ui/GraphicBufferMapper.h>
+#include <ui/Rect.h>
 
 namespace android {
 
@@ -55,6 +59,10 @@ SoftVideoDecoderOMXComponent::SoftVideoDecoderOMXComponent(
         mCropWidth(width),
         mCropHeight(height),
         mOutputPortSettingsChange(NONE),
+        mNativeBuffersSupported(false),
+        mNativeBuffersEnabled(false),
+        mNumFramesOutput(0),
+        mNumNativeFramesOutput(0),
         mComponentRole(componentRole),
         mCodingType(codingType),
         mProfileLevels(profileLevels),
@@ -130,6 +138,10 @@ void SoftVideoDecoderOMXComponent::updatePortDefinitions() {
     def->format.video.nStride = def->format.video.nFrameWidth;
     def->format.video.nSliceHeight = def->format.video.nFrameHeight;
 
+    def->format.video.eColorFormat = mNativeBuffersEnabled
+            ? (OMX_COLOR_FORMATTYPE)HAL_PIXEL_FORMAT_YV12
+            : OMX_COLOR_FormatYUV420Planar;
+
     def->nBufferSize =
             (def->format.video.nFrameWidth *
              def->format.video.nFrameHeight * 3) / 2;
@@ -164,7 +176,9 @@ OMX_ERRORTYPE SoftVideoDecoderOMXComponent::internalGetParameter(
                 CHECK_EQ(formatParams->nPortIndex, 1u);
 
                 formatParams->eCompressionFormat = OMX_VIDEO_CodingUnused;
-                formatParams->eColorFormat = OMX_COLOR_FormatYUV420Planar;
+                formatParams->eColorFormat = mNativeBuffersEnabled
+                        ? (OMX_COLOR_FORMATTYPE)HAL_PIXEL_FORMAT_YV12
+                        : OMX_COLOR_FormatYUV420Planar;
                 formatParams->xFramerate = 0;
             }
 
@@ -191,7 +205,23 @@ OMX_ERRORTYPE SoftVideoDecoderOMXComponent::internalGetParameter(
         }
 
         default:
+        {
+            if ((int32_t)index == kGetNativeBufferUsageIndex
+                    && mNativeBuffersSupported) {
+                GetAndroidNativeBufferUsageParams *usageParams =
+                    (GetAndroidNativeBufferUsageParams *)params;
+
+                if (usageParams->nPortIndex != kOutputPortIndex) {
+                    return OMX_ErrorUndefined;
+                }
+
+                usageParams->nUsage =
+                    GRALLOC_USAGE_SW_READ_NEVER | GRALLOC_USAGE_SW_WRITE_OFTEN;
+                return OMX_ErrorNone;
+            }
+
             return SimpleSoftOMXComponent::internalGetParameter(index, params);
+        }
     }
 }
 
@@ -229,7 +259,172 @@ OMX_ERRORTYPE SoftVideoDecoderOMXComponent::internalSetParameter(
         }
 
         default:
+        {
+            if ((int32_t)index == kEnableNativeBuffersIndex
+                    && mNativeBuffersSupported) {
+                const EnableAndroidNativeBuffersParams *enableParams =
+                    (const EnableAndroidNativeBuffersParams *)params;
+
+                if (enableParams->nPortIndex != kOutputPortIndex) {
+                    return OMX_ErrorUndefined;
+                }
+
+                mNativeBuffersEnabled = enableParams->enable;
+                updatePortDefinitions();
+                return OMX_ErrorNone;
+            }
+
             return SimpleSoftOMXComponent::internalSetParameter(index, params);
+        }
+    }
+}
+
+OMX_ERRORTYPE SoftVideoDecoderOMXComponent::setParameter(
+        OMX_INDEXTYPE index, const OMX_PTR params) {
+    // useBuffer() takes the lock itself, so this cannot go through
+    // internalSetParameter().
+    if ((int32_t)index == kUseNativeBufferIndex && mNativeBuffersSupported) {
+        return useNativeBuffer(params);
+    }
+
+    return SimpleSoftOMXComponent::setParameter(index, params);
+}
+
+OMX_ERRORTYPE SoftVideoDecoderOMXComponent::useNativeBuffer(const OMX_PTR params) {
+    const UseAndroidNativeBufferParams *useParams =
+        (const UseAndroidNativeBufferParams *)params;
+
+    if (!mNativeBuffersEnabled
+            || useParams->nPortIndex != kOutputPortIndex
+            || useParams->nativeBuffer == NULL) {
+        return OMX_ErrorUndefined;
+    }
+
+    const OMX_PARAM_PORTDEFINITIONTYPE &def =
+        editPortInfo(kOutputPortIndex)->mDef;
+
+    // The frames are written through the native buffer, the header does not
+    // have any memory of its own.
+    OMX_ERRORTYPE err = useBuffer(
+            useParams->bufferHeader, kOutputPortIndex,
+            useParams->pAppPrivate, def.nBufferSize, NULL);
+
+    if (err != OMX_ErrorNone) {
+        return err;
+    }
+
+    Mutex::Autolock autoLock(mNativeBuffersLock);
+    mNativeBuffers.add(*useParams->bufferHeader, useParams->nativeBuffer);
+
+    return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE SoftVideoDecoderOMXComponent::freeBuffer(
+        OMX_U32 portIndex, OMX_BUFFERHEADERTYPE *header) {
+    {
+        Mutex::Autolock autoLock(mNativeBuffersLock);
+        mNativeBuffers.removeItem(header);
+    }
+
+    return SimpleSoftOMXComponent::freeBuffer(portIndex, header);
+}
+
+sp<ANativeWindowBuffer> SoftVideoDecoderOMXComponent::getNativeBuffer(
+        OMX_BUFFERHEADERTYPE *header) {
+    Mutex::Autolock autoLock(mNativeBuffersLock);
+
+    ssize_t index = mNativeBuffers.indexOfKey(header);
+    return index < 0 ? NULL : mNativeBuffers.valueAt(index);
+}
+
+OMX_ERRORTYPE SoftVideoDecoderOMXComponent::getExtensionIndex(
+        const char *name, OMX_INDEXTYPE *index) {
+    if (mNativeBuffersSupported) {
+        if (!strcmp(name, "OMX.google.android.index.enableAndroidNativeBuffers")) {
+            *(int32_t *)index = kEnableNativeBuffersIndex;
+            return OMX_ErrorNone;
+        }
+        if (!strcmp(name, "OMX.google.android.index.getAndroidNativeBufferUsage")) {
+            *(int32_t *)index = kGetNativeBufferUsageIndex;
+            return OMX_ErrorNone;
+        }
+        if (!strcmp(name, "OMX.google.android.index.useAndroidNativeBuffer")) {
+            *(int32_t *)index = kUseNativeBufferIndex;
+            return OMX_ErrorNone;
+        }
+    }
+
+    return SimpleSoftOMXComponent::getExtensionIndex(name, index);
+}
+
+void SoftVideoDecoderOMXComponent::setNativeBuffersSupported() {
+    mNativeBuffersSupported = true;
+}
+
+static void copyPlane(
+        uint8_t *dst, size_t dstStride,
+        const uint8_t *src, size_t srcStride,
+        size_t width, size_t height) {
+    if (dstStride == width && srcStride == width) {
+        memcpy(dst, src, width * height);
+        return;
+    }
+
+    for (size_t y = 0; y < height; ++y) {
+        memcpy(dst, src, width);
+        dst += dstStride;
+        src += srcStride;
+    }
+}
+
+void SoftVideoDecoderOMXComponent::copyYUV420FrameToOutputBuffer(
+        OMX_BUFFERHEADERTYPE *header,
+        const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV,
+        size_t srcYStride, size_t srcUStride, size_t srcVStride) {
+    header->nOffset = 0;
+    header->nFilledLen = (mWidth * mHeight * 3) / 2;
+
+    ++mNumFramesOutput;
+
+    uint8_t *dst = header->pBuffer;
+
+    // A native buffer gets the same packed layout as SoftwareRenderer's copy,
+    // which is what the composer reads out of YV12 buffers of soft decoders.
+    sp<ANativeWindowBuffer> nativeBuffer = getNativeBuffer(header);
+    if (nativeBuffer != NULL) {
+        if ((uint32_t)nativeBuffer->width < mWidth
+                || (uint32_t)nativeBuffer->height < mHeight) {
+            ALOGE("native buffer of %dx%d too small for a %ux%u frame",
+                    nativeBuffer->width, nativeBuffer->height, mWidth, mHeight);
+            header->nFilledLen = 0;
+            return;
+        }
+
+        Rect bounds(nativeBuffer->width, nativeBuffer->height);
+        if (GraphicBufferMapper::get().lock(
+                    nativeBuffer->handle, GRALLOC_USAGE_SW_WRITE_OFTEN,
+                    bounds, (void **)&dst) != OK) {
+            ALOGE("failed to lock native buffer %p", nativeBuffer->handle);
+            header->nFilledLen = 0;
+            return;
+        }
+    }
+
+    copyPlane(dst, mWidth, srcY, srcYStride, mWidth, mHeight);
+    dst += mWidth * mHeight;
+    copyPlane(dst, mWidth / 2, srcU, srcUStride, mWidth / 2, mHeight / 2);
+    dst += (mWidth / 2) * (mHeight / 2);
+    copyPlane(dst, mWidth / 2, srcV, srcVStride, mWidth / 2, mHeight / 2);
+
+    if (nativeBuffer == NULL) {
+        return;
+    }
+
+    GraphicBufferMapper::get().unlock(nativeBuffer->handle);
+
+    if (++mNumNativeFramesOutput % kStatsInterval == 0) {
+        ALOGV("%u of %u frames written to native buffers",
+                mNumNativeFramesOutput, mNumFramesOutput);
     }
 }
 
@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ATSParser_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/MediaErrors.h>
+#include <utils/Vector.h>
+
+#include "mpeg2ts/ATSParser.h"
+#include "mpeg2ts/AnotherPacketSource.h"
+
+namespace android {
+
+// Builds a synthetic multi-program transport stream, each program carrying
+// a single MPEG-1 layer III audio stream, and feeds it through both the
+// per-packet and the batched ATSParser entry points.
+
+static const size_t kTSPacketSize = 188;
+static const size_t kNumPrograms = 4;
+static const size_t kNumFramesPerProgram = 4000;
+
+// MPEG-1 layer III, 128kbps, 44.1kHz, no padding: 417 byte frames.
+static const uint8_t kMP3Header[] = { 0xff, 0xfb, 0x90, 0x64 };
+static const size_t kMP3FrameSize = 417;
+static const int64_t kMP3FrameDurationUs = 1152ll * 1000000ll / 44100;
+
+static unsigned programMapPID(size_t program) { return 0x100 + program; }
+static unsigned audioPID(size_t program) { return 0x200 + program; }
+
+class TSWriter {
+public:
+    TSWriter() {
+        memset(mContinuityCounter, 0, sizeof(mContinuityCounter));
+    }
+
+    // Splits "data" over as many TS packets as needed, padding the last
+    // one with adaptation field stuffing.
+    void writePayload(unsigned PID, const uint8_t *data, size_t size) {
+        bool first = true;
+        while (size > 0) {
+            size_t n = size < kTSPacketSize - 4 ? size : kTSPacketSize - 4;
+            writePacket(PID, first, data, n);
+            data += n;
+            size -= n;
+            first = false;
+        }
+    }
+
+    void writeSection(unsigned PID, const uint8_t *section, size_t size) {
+        Vector<uint8_t> payload;
+        payload.push(0);  // pointer_field
+        payload.appendArray(section, size);
+        writePayload(PID, payload.array(), payload.size());
+    }
+
+    const Vector<uint8_t> &data() const { return mData; }
+
+private:
+    Vector<uint8_t> mData;
+    unsigned mContinuityCounter[0x2000];
+
+    void writePacket(
+            unsigned PID, bool start, const uint8_t *data, size_t size) {
+        uint8_t packet[kTSPacketSize];
+        memset(packet, 0xff, sizeof(packet));
+
+        size_t stuffing = kTSPacketSize - 4 - size;
+
+        packet[0] = 0x47;
+        packet[1] = (start ? 0x40 : 0x00) | (PID >> 8);
+        packet[2] = PID & 0xff;
+        packet[3] = (stuffing > 0 ? 0x30 : 0x10)
+            | (mContinuityCounter[PID]++ & 0x0f);
+
+        size_t offset = 4;
+        if (stuffing > 0) {
+            packet[4] = stuffing - 1;  // adaptation_field_length
+            if (stuffing > 1) {
+                packet[5] = 0x00;      // no flags
+            }
+            offset += stuffing;
+        }
+
+        memcpy(&packet[offset], data, size);
+        mData.appendArray(packet, sizeof(packet));
+    }
+};
+
+static uint32_t crc32(const uint8_t *data, size_t size) {
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= (uint32_t)data[i] << 24;
+        for (size_t bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+static void appendCRC(Vector<uint8_t> *section) {
+    uint32_t crc = crc32(section->array(), section->size());
+    section->push(crc >> 24);
+    section->push((crc >> 16) & 0xff);
+    section->push((crc >> 8) & 0xff);
+    section->push(crc & 0xff);
+}
+
+static void writeTables(TSWriter *writer) {
+    Vector<uint8_t> pat;
+    size_t patLength = 5 + 4 * kNumPrograms + 4;
+    pat.push(0x00);                            // table_id
+    pat.push(0xb0 | (patLength >> 8));
+    pat.push(patLength & 0xff);
+    pat.push(0x00); pat.push(0x01);            // transport_stream_id
+    pat.push(0xc1);                            // version 0, current
+    pat.push(0x00); pat.push(0x00);            // section numbers
+    for (size_t i = 0; i < kNumPrograms; ++i) {
+        pat.push(0x00); pat.push(i + 1);       // program_number
+        pat.push(0xe0 | (programMapPID(i) >> 8));
+        pat.push(programMapPID(i) & 0xff);
+    }
+    appendCRC(&pat);
+    writer->writeSection(0, pat.array(), pat.size());
+
+    for (size_t i = 0; i < kNumPrograms; ++i) {
+        Vector<uint8_t> pmt;
+        size_t pmtLength = 9 + 5 + 4;
+        pmt.push(0x02);                        // table_id
+        pmt.push(0xb0 | (pmtLength >> 8));
+        pmt.push(pmtLength & 0xff);
+        pmt.push(0x00); pmt.push(i + 1);       // program_number
+        pmt.push(0xc1);
+        pmt.push(0x00); pmt.push(0x00);
+        pmt.push(0xe0 | (audioPID(i) >> 8));   // PCR_PID
+        pmt.push(audioPID(i) & 0xff);
+        pmt.push(0xf0); pmt.push(0x00);        // program_info_length
+        pmt.push(ATSParser::STREAMTYPE_MPEG1_AUDIO);
+        pmt.push(0xe0 | (audioPID(i) >> 8));
+        pmt.push(audioPID(i) & 0xff);
+        pmt.push(0xf0); pmt.push(0x00);        // ES_info_length
+        appendCRC(&pmt);
+        writer->writeSection(programMapPID(i), pmt.array(), pmt.size());
+    }
+}
+
+static void writeAudioFrame(TSWriter *writer, size_t program, size_t frame) {
+    uint8_t pes[14 + kMP3FrameSize];
+
+    uint64_t PTS = 90000ll + frame * kMP3FrameDurationUs * 9 / 100;
+    size_t PES_packet_length = sizeof(pes) - 6;
+
+    pes[0] = 0x00;
+    pes[1] = 0x00;
+    pes[2] = 0x01;
+    pes[3] = 0xc0;
+    pes[4] = PES_packet_length >> 8;
+    pes[5] = PES_packet_length & 0xff;
+    pes[6] = 0x80;
+    pes[7] = 0x80;                             // PTS only
+    pes[8] = 5;                                // PES_header_data_length
+    pes[9] = 0x21 | ((PTS >> 29) & 0x0e);
+    pes[10] = (PTS >> 22) & 0xff;
+    pes[11] = ((PTS >> 14) & 0xfe) | 1;
+    pes[12] = (PTS >> 7) & 0xff;
+    pes[13] = ((PTS << 1) & 0xfe) | 1;
+
+    memcpy(&pes[14], kMP3Header, sizeof(kMP3Header));
+    for (size_t i = sizeof(kMP3Header); i < kMP3FrameSize; ++i) {
+        pes[14 + i] = (uint8_t)(frame + i);
+    }
+
+    writer->writePayload(audioPID(program), pes, sizeof(pes));
+}
+
+static const Vector<uint8_t> &getStream() {
+    static TSWriter *writer = NULL;
+
+    if (writer == NULL) {
+        writer = new TSWriter;
+
+        writeTables(writer);
+        for (size_t frame = 0; frame < kNumFramesPerProgram; ++frame) {
+            for (size_t i = 0; i < kNumPrograms; ++i) {
+                writeAudioFrame(writer, i, frame);
+            }
+        }
+    }
+
+    return writer->data();
+}
+
+struct Summary {
+    size_t mNumAccessUnits;
+    size_t mNumBytes;
+    int64_t mLastTimeUs;
+};
+
+static void summarize(
+        const sp<ATSParser> &parser, Vector<Summary> *summaries) {
+    for (size_t i = 0; i < kNumPrograms; ++i) {
+        uint32_t programID = i;
+        unsigned elementaryPID = 0;
+        sp<AnotherPacketSource> source = static_cast<AnotherPacketSource *>(
+                parser->getSource(
+                    ATSParser::AUDIO, programID, elementaryPID).get());
+        ASSERT_TRUE(source != NULL);
+
+        Summary summary;
+        summary.mNumAccessUnits = 0;
+        summary.mNumBytes = 0;
+        summary.mLastTimeUs = -1;
+
+        status_t finalResult;
+        while (source->hasBufferAvailable(&finalResult)) {
+            sp<ABuffer> accessUnit;
+            if (source->dequeueAccessUnit(&accessUnit) != OK) {
+                continue;
+            }
+
+            ++summary.mNumAccessUnits;
+            summary.mNumBytes += accessUnit->size();
+            accessUnit->meta()->findInt64("timeUs", &summary.mLastTimeUs);
+        }
+
+        summaries->push(summary);
+    }
+}
+
+static void feed(const sp<ATSParser> &parser, bool batched) {
+    const Vector<uint8_t> &stream = getStream();
+    size_t numPackets = stream.size() / kTSPacketSize;
+
+    if (batched) {
+        EXPECT_EQ((status_t)OK,
+                  parser->feedTSPackets(stream.array(), numPackets));
+    } else {
+        for (size_t i = 0; i < numPackets; ++i) {
+            EXPECT_EQ((status_t)OK,
+                      parser->feedTSPacket(
+                          stream.array() + i * kTSPacketSize,
+                          kTSPacketSize));
+        }
+    }
+
+    parser->signalEOS(ERROR_END_OF_STREAM);
+}
+
+TEST(ATSParser_test, BatchedFeedMatchesSinglePacketFeed) {
+    sp<ATSParser> single = new ATSParser;
+    sp<ATSParser> batched = new ATSParser;
+
+    feed(single, false /* batched */);
+    feed(batched, true /* batched */);
+
+    Vector<Summary> expected, actual;
+    summarize(single, &expected);
+    summarize(batched, &actual);
+
+    ASSERT_EQ(kNumPrograms, expected.size());
+    ASSERT_EQ(kNumPrograms, actual.size());
+
+    for (size_t i = 0; i < kNumPrograms; ++i) {
+        EXPECT_GT(expected[i].mNumAccessUnits, 0u);
+        EXPECT_EQ(expected[i].mNumAccessUnits, actual[i].mNumAccessUnits);
+        EXPECT_EQ(expected[i].mNumBytes, actual[i].mNumBytes);
+        EXPECT_EQ(expected[i].mLastTimeUs, actual[i].mLastTimeUs);
+    }
+}
+
+}  // namespace android
@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "AVCEncoderVBV_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <utils/Vector.h>
+
+#include "avcenc_api.h"
+#include "AVCEncLookahead.h"
+
+namespace android {
+
+// Encodes synthetic high motion content with hard scene cuts through the PV
+// encoder and its lookahead, the way SoftAVCEncoder does, and checks the frame
+// sizes against a leaky bucket model of the coded picture buffer.
+
+static const int32_t kWidth = 320;
+static const int32_t kHeight = 240;
+static const int32_t kFrameRate = 30;
+static const int32_t kBitRate = 500000;
+static const int32_t kBufferMs = 200;
+static const size_t kNumFrames = 150;
+static const size_t kSceneLength = 30;
+static const size_t kLookaheadDepth = 8;
+
+// Fast pan over a texture that changes with every scene, some of the scenes
+// being much more detailed than the others.
+static void makeFrame(size_t index, uint8_t *yuv) {
+    const size_t scene = index / kSceneLength;
+    const int32_t t = index % kSceneLength;
+    const double detail = (scene % 2) ? 0.6 : 0.15;
+    const int32_t noise = (scene % 2) ? 6 : 2;
+    const int32_t vx = 6 + 3 * scene;
+    const int32_t vy = 4 - 2 * (int32_t)scene;
+
+    unsigned seed = index * 7919 + 1;
+    for (int32_t y = 0; y < kHeight; ++y) {
+        for (int32_t x = 0; x < kWidth; ++x) {
+            double u = (x + vx * t) * detail + scene * 17;
+            double v = (y + vy * t) * detail * 0.7 + scene * 5;
+            int32_t value = 128 + (int32_t)(60 * sin(u) * cos(v)
+                    + 40 * sin((u + v) * 0.13 + scene))
+                    + (int32_t)(rand_r(&seed) % (noise + 1)) - noise / 2;
+            yuv[y * kWidth + x] = value < 0 ? 0 : (value > 255 ? 255 : value);
+        }
+    }
+
+    uint8_t *chroma = yuv + kWidth * kHeight;
+    for (int32_t i = 0; i < (kWidth * kHeight) / 2; ++i) {
+        chroma[i] = 128 + (int32_t)(30 * sin(i * 0.003 + scene + t * 0.1));
+    }
+}
+
+static uint8_t *gDPB[16];
+
+static void *MallocWrapper(void * /* userData */, int32_t size, int32_t /* attrs */) {
+    return calloc(1, size);
+}
+
+static void FreeWrapper(void * /* userData */, void *ptr) {
+    free(ptr);
+}
+
+static int32_t DpbAllocWrapper(
+        void * /* userData */, unsigned int sizeInMbs, unsigned int numBuffers) {
+    for (unsigned int i = 0; i < numBuffers && i < 16; ++i) {
+        gDPB[i] = (uint8_t *)malloc((sizeInMbs << 7) * 3);
+    }
+    return 1;
+}
+
+static int32_t BindFrameWrapper(void * /* userData */, int32_t index, uint8_t **yuv) {
+    *yuv = gDPB[index];
+    return 1;
+}
+
+static void UnbindFrameWrapper(void * /* userData */, int32_t /* index */) {
+}
+
+struct EncodedFrame {
+    size_t mIndex;
+    size_t mBits;
+    bool mIDR;
+};
+
+class AVCEncoderVBVTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        memset(gDPB, 0, sizeof(gDPB));
+    }
+
+    virtual void TearDown() {
+        for (size_t i = 0; i < 16; ++i) {
+            free(gDPB[i]);
+            gDPB[i] = NULL;
+        }
+    }
+
+    // Frames skipped by the rate control are not in "frames".
+    void encode(bool vbvConstrained, Vector<EncodedFrame> *frames);
+};
+
+void AVCEncoderVBVTest::encode(bool vbvConstrained, Vector<EncodedFrame> *frames) {
+    AVCHandle handle;
+    memset(&handle, 0, sizeof(handle));
+    handle.CBAVC_DPBAlloc = DpbAllocWrapper;
+    handle.CBAVC_FrameBind = BindFrameWrapper;
+    handle.CBAVC_FrameUnbind = UnbindFrameWrapper;
+    handle.CBAVC_Malloc = MallocWrapper;
+    handle.CBAVC_Free = FreeWrapper;
+
+    AVCEncParams params;
+    memset(&params, 0, sizeof(params));
+    params.rate_control = AVC_ON;
+    params.init_CBP_removal_delay = 1600;
+    params.auto_scd = AVC_ON;
+    params.out_of_band_param_set = AVC_ON;
+    params.poc_type = 2;
+    params.log2_max_poc_lsb_minus_4 = 12;
+    params.num_ref_frame = 1;
+    params.num_slice_group = 1;
+    params.db_filter = AVC_ON;
+    params.search_range = 16;
+    params.width = kWidth;
+    params.height = kHeight;
+    params.bitrate = kBitRate;
+    params.frame_rate = 1000 * kFrameRate;
+    params.CPB_size = kBitRate / 1000 * kBufferMs;
+    params.idr_period = 10 * kFrameRate;
+    params.profile = AVC_BASELINE;
+    params.level = AVC_LEVEL3;
+    params.me_threads = 1;
+    params.vbv_constrained = vbvConstrained ? AVC_ON : AVC_OFF;
+
+    ASSERT_EQ(AVCENC_SUCCESS, PVAVCEncInitialize(&handle, &params, NULL, NULL));
+
+    static uint8_t nal[kWidth * kHeight * 3];
+    uint32_t size;
+    int32_t type;
+    for (;;) {
+        size = sizeof(nal);
+        if (PVAVCEncodeNAL(&handle, nal, &size, &type) != AVCENC_SUCCESS) {
+            break;
+        }
+    }
+
+    AVCEncLookahead lookahead(kWidth, kHeight, kLookaheadDepth);
+    ASSERT_EQ((status_t)OK, lookahead.initCheck());
+
+    size_t numQueued = 0;
+    while (numQueued < kNumFrames || lookahead.numFrames() > 0) {
+        if (numQueued < kNumFrames && !lookahead.isFull()) {
+            makeFrame(numQueued, lookahead.inputBuffer());
+            lookahead.queueFrame(numQueued * 1000000ll / kFrameRate, numQueued);
+            ++numQueued;
+            continue;
+        }
+
+        AVCLookaheadInfo info;
+        const AVCEncLookahead::Frame *frame = lookahead.peekFrame(&info);
+        ASSERT_EQ(AVCENC_SUCCESS, PVAVCEncSetLookahead(&handle, &info));
+
+        AVCFrameIO input;
+        memset(&input, 0, sizeof(input));
+        input.height = kHeight;
+        input.pitch = kWidth;
+        input.coding_timestamp = (frame->mTimeUs + 500) / 1000;
+        input.YCbCr[0] = frame->mData;
+        input.YCbCr[1] = input.YCbCr[0] + kWidth * kHeight;
+        input.YCbCr[2] = input.YCbCr[1] + (kWidth * kHeight) / 4;
+        input.disp_order = frame->mFlags;
+
+        EncodedFrame encoded;
+        encoded.mIndex = frame->mFlags;
+        encoded.mBits = 0;
+
+        AVCEnc_Status status = PVAVCEncSetInput(&handle, &input);
+        if (status == AVCENC_SUCCESS || status == AVCENC_NEW_IDR) {
+            encoded.mIDR = (status == AVCENC_NEW_IDR);
+            do {
+                size = sizeof(nal);
+                status = PVAVCEncodeNAL(&handle, nal, &size, &type);
+                encoded.mBits += size * 8;
+            } while (status == AVCENC_SUCCESS);
+
+            if (status == AVCENC_PICTURE_READY) {
+                frames->push(encoded);
+
+                AVCFrameIO recon;
+                if (PVAVCEncGetRecon(&handle, &recon) == AVCENC_SUCCESS) {
+                    PVAVCEncReleaseRecon(&handle, &recon);
+                }
+            } else {
+                EXPECT_EQ(AVCENC_SKIPPED_PICTURE, status);
+            }
+        } else {
+            EXPECT_EQ(AVCENC_SKIPPED_PICTURE, status);
+        }
+
+        lookahead.popFrame();
+    }
+
+    PVAVCCleanUpEncoder(&handle);
+}
+
+TEST(AVCEncLookaheadTest, FindsSceneCuts) {
+    AVCEncLookahead lookahead(kWidth, kHeight, kLookaheadDepth);
+    ASSERT_EQ((status_t)OK, lookahead.initCheck());
+
+    size_t numQueued = 0;
+    size_t numPopped = 0;
+    while (numPopped < kNumFrames) {
+        if (numQueued < kNumFrames && !lookahead.isFull()) {
+            makeFrame(numQueued, lookahead.inputBuffer());
+            lookahead.queueFrame(0, numQueued);
+            ++numQueued;
+            continue;
+        }
+
+        AVCLookaheadInfo info;
+        const AVCEncLookahead::Frame *frame = lookahead.peekFrame(&info);
+        EXPECT_EQ(numPopped, frame->mFlags);
+        EXPECT_EQ(numQueued - numPopped, (size_t)info.num_frames);
+
+        // The first frame has nothing to be predicted from.
+        bool cut = numPopped > 0 && numPopped % kSceneLength == 0;
+        EXPECT_EQ(cut ? AVC_ON : AVC_OFF, info.scene_cut[0]) << "frame " << numPopped;
+        if (numPopped > 0 && !cut) {
+            EXPECT_LT(info.inter_cost[0], info.intra_cost[0]) << "frame " << numPopped;
+        }
+
+        lookahead.popFrame();
+        ++numPopped;
+    }
+}
+
+TEST_F(AVCEncoderVBVTest, StaysWithinBuffer) {
+    Vector<EncodedFrame> frames;
+    encode(true /* vbvConstrained */, &frames);
+
+    // The buffer takes the bits of every frame and is drained at the bit rate,
+    // it must never hold more than its size.
+    const double bufferBits = (double)kBitRate * kBufferMs / 1000;
+    const double bitsPerFrame = (double)kBitRate / kFrameRate;
+    double fullness = 0;
+    size_t totalBits = 0;
+
+    // Low latency streaming cannot afford dropping frames either.
+    ASSERT_EQ(kNumFrames, frames.size());
+
+    for (size_t i = 0; i < frames.size(); ++i) {
+        const EncodedFrame &frame = frames[i];
+        EXPECT_EQ(i, frame.mIndex);
+
+        fullness += frame.mBits - bitsPerFrame;
+        if (fullness < 0) {
+            fullness = 0;
+        }
+        EXPECT_LE(fullness, bufferBits)
+            << "frame " << i << " of " << frame.mBits << " bits overflows the buffer";
+
+        // Every scene starts with an IDR frame.
+        if (i > 0 && i % kSceneLength == 0) {
+            EXPECT_TRUE(frame.mIDR) << "frame " << i;
+        }
+
+        totalBits += frame.mBits;
+    }
+
+    ALOGV("%zu frames, %.1f kbps", frames.size(),
+            totalBits * (double)kFrameRate / frames.size() / 1000);
+}
+
+}  // namespace android
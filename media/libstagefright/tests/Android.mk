@@ -43,6 +43,102 @@ LOCAL_C_INCLUDES := \
 
 include $(BUILD_EXECUTABLE)
 
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := ATSParser_test
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+    ATSParser_test.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright \
+	libstagefright_foundation \
+	libstlport \
+	libutils \
+	liblog
+
+LOCAL_STATIC_LIBRARIES := \
+	libgtest \
+	libgtest_main \
+
+LOCAL_C_INCLUDES := \
+    bionic \
+    bionic/libstdc++/include \
+    external/gtest/include \
+    external/stlport/stlport \
+	frameworks/av/media/libstagefright \
+	frameworks/av/media/libstagefright/include \
+	$(TOP)/frameworks/native/include/media/openmax \
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := AVCEncoderVBV_test
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+    AVCEncoderVBV_test.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright_avc_common \
+	libstagefright_foundation \
+	libstlport \
+	libutils \
+	liblog
+
+LOCAL_STATIC_LIBRARIES := \
+	libstagefright_avcenc \
+	libgtest \
+	libgtest_main \
+
+LOCAL_C_INCLUDES := \
+    bionic \
+    bionic/libstdc++/include \
+    external/gtest/include \
+    external/stlport/stlport \
+	frameworks/av/media/libstagefright/include \
+	frameworks/av/media/libstagefright/codecs/avc/enc \
+	frameworks/av/media/libstagefright/codecs/avc/enc/src \
+	frameworks/av/media/libstagefright/codecs/avc/common/include \
+
+LOCAL_CFLAGS := \
+    -DOSCL_IMPORT_REF= -DOSCL_UNUSED_ARG= -DOSCL_EXPORT_REF=
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := ColorConverter_test
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+    ColorConverter_test.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libstlport \
+	libutils \
+	liblog
+
+LOCAL_STATIC_LIBRARIES := \
+	libstagefright_color_conversion \
+	libgtest \
+	libgtest_main \
+
+LOCAL_C_INCLUDES := \
+    bionic \
+    bionic/libstdc++/include \
+    external/gtest/include \
+    external/stlport/stlport \
+	frameworks/av/media/libstagefright/include \
+	$(TOP)/frameworks/native/include/media/openmax \
+
+include $(BUILD_EXECUTABLE)
+
 endif
 
 # Include subdirectory makefiles
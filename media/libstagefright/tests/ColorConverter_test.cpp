@@ -0,0 +1,422 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ColorConverter_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <media/stagefright/ColorConverter.h>
+#include <media/stagefright/MediaErrors.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+static const OMX_COLOR_FORMATTYPE kSrcFormats[] = {
+    OMX_COLOR_FormatYUV420Planar,
+    OMX_COLOR_FormatCbYCrY,
+    OMX_QCOM_COLOR_FormatYVU420SemiPlanar,
+    OMX_COLOR_FormatYUV420SemiPlanar,
+    OMX_TI_COLOR_FormatYUV420PackedSemiPlanar,
+};
+
+static const size_t kNumSrcFormats = sizeof(kSrcFormats) / sizeof(kSrcFormats[0]);
+
+static const uint8_t kUntouched = 0xa5;
+
+struct Rect {
+    size_t mLeft, mTop, mRight, mBottom;
+
+    size_t width() const { return mRight - mLeft + 1; }
+    size_t height() const { return mBottom - mTop + 1; }
+};
+
+static size_t bufferSize(OMX_COLOR_FORMATTYPE format, size_t width, size_t height) {
+    return format == OMX_COLOR_FormatCbYCrY
+        ? width * height * 2 : width * height + 2 * (width / 2) * ((height + 1) / 2);
+}
+
+static uint8_t clip(int32_t x) {
+    return x < 0 ? 0 : (x > 255 ? 255 : x);
+}
+
+// One pixel of the crop rectangle, addressed the way every format describes
+// it, converted with the coefficients of the original per format loops.
+static void referencePixel(
+        OMX_COLOR_FORMATTYPE format, const uint8_t *bits,
+        size_t width, size_t height, const Rect &crop, size_t x, size_t y,
+        uint8_t *rgb) {
+    const size_t sx = crop.mLeft + x;
+    const size_t sy = crop.mTop + y;
+    int32_t luma, u, v;
+    bool swapRB = false;
+
+    switch (format) {
+        case OMX_COLOR_FormatYUV420Planar:
+        {
+            const uint8_t *chroma = bits + width * height;
+            luma = bits[sy * width + sx];
+            u = chroma[(sy / 2) * (width / 2) + sx / 2];
+            v = chroma[(width / 2) * (height / 2) + (sy / 2) * (width / 2) + sx / 2];
+            break;
+        }
+
+        case OMX_COLOR_FormatCbYCrY:
+        {
+            const uint8_t *pair = bits + (sy * width + (sx & ~1)) * 2;
+            u = pair[0];
+            luma = pair[1 + 2 * (sx & 1)];
+            v = pair[2];
+            break;
+        }
+
+        case OMX_QCOM_COLOR_FormatYVU420SemiPlanar:
+        case OMX_COLOR_FormatYUV420SemiPlanar:
+        {
+            const uint8_t *uv = bits + width * height + (sy / 2) * width + (sx & ~1);
+            luma = bits[sy * width + sx];
+            u = uv[format == OMX_COLOR_FormatYUV420SemiPlanar ? 1 : 0];
+            v = uv[format == OMX_COLOR_FormatYUV420SemiPlanar ? 0 : 1];
+            swapRB = true;
+            break;
+        }
+
+        default:
+        {
+            // Starts at the crop rectangle, its left edge is not applied.
+            const uint8_t *uv = bits + width * (height - crop.mTop)
+                + (sy / 2) * width + (x & ~1);
+            luma = bits[y * width + x];
+            u = uv[0];
+            v = uv[1];
+            break;
+        }
+    }
+
+    int32_t tmp = (luma - 16) * 298;
+    u -= 128;
+    v -= 128;
+    rgb[0] = clip((tmp + v * 409) / 256);
+    rgb[1] = clip((tmp - v * 208 - u * 100) / 256);
+    rgb[2] = clip((tmp + u * 517) / 256);
+    if (swapRB) {
+        uint8_t t = rgb[0];
+        rgb[0] = rgb[2];
+        rgb[2] = t;
+    }
+}
+
+static void referenceFrame(
+        OMX_COLOR_FORMATTYPE format, const uint8_t *bits,
+        size_t width, size_t height, const Rect &crop, uint8_t *rgb) {
+    for (size_t y = 0; y < crop.height(); ++y) {
+        for (size_t x = 0; x < crop.width(); ++x) {
+            referencePixel(
+                    format, bits, width, height, crop, x, y,
+                    &rgb[(y * crop.width() + x) * 3]);
+        }
+    }
+}
+
+static void randomFrame(uint8_t *bits, size_t size, unsigned seed) {
+    for (size_t i = 0; i < size; ++i) {
+        bits[i] = rand_r(&seed) & 0xff;
+    }
+}
+
+// Gradients with some texture, the same in every format. Scaling them should
+// not lose much.
+static void smoothFrame(
+        OMX_COLOR_FORMATTYPE format, uint8_t *bits, size_t width, size_t height) {
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            uint8_t luma = 128 + 70 * sin(x * 0.02) * cos(y * 0.015);
+            uint8_t u = 128 + 30 * sin((x + y) * 0.01);
+            uint8_t v = 128 + 30 * cos(x * 0.008 - y * 0.012);
+
+            if (format == OMX_COLOR_FormatCbYCrY) {
+                bits[(y * width + x) * 2] = (x & 1) ? v : u;
+                bits[(y * width + x) * 2 + 1] = luma;
+                continue;
+            }
+
+            bits[y * width + x] = luma;
+            if ((x & 1) || (y & 1)) {
+                continue;
+            }
+
+            uint8_t *chroma = bits + width * height;
+            switch (format) {
+                case OMX_COLOR_FormatYUV420Planar:
+                    chroma[(y / 2) * (width / 2) + x / 2] = u;
+                    chroma[(width / 2) * (height / 2) + (y / 2) * (width / 2) + x / 2] = v;
+                    break;
+
+                case OMX_COLOR_FormatYUV420SemiPlanar:
+                    chroma[(y / 2) * width + x] = v;
+                    chroma[(y / 2) * width + x + 1] = u;
+                    break;
+
+                default:
+                    chroma[(y / 2) * width + x] = u;
+                    chroma[(y / 2) * width + x + 1] = v;
+                    break;
+            }
+        }
+    }
+}
+
+static void unpackPixel(
+        OMX_COLOR_FORMATTYPE dstFormat, const uint8_t *bits, size_t index,
+        uint8_t *rgb) {
+    if (dstFormat == kColorFormatRGBA8888) {
+        memcpy(rgb, &bits[index * 4], 3);
+        return;
+    }
+
+    uint16_t pixel = ((const uint16_t *)bits)[index];
+    rgb[0] = (pixel >> 11) << 3;
+    rgb[1] = ((pixel >> 5) & 0x3f) << 2;
+    rgb[2] = (pixel & 0x1f) << 3;
+}
+
+static void truncate(OMX_COLOR_FORMATTYPE dstFormat, uint8_t *rgb) {
+    if (dstFormat == OMX_COLOR_Format16bitRGB565) {
+        rgb[0] &= 0xf8;
+        rgb[1] &= 0xfc;
+        rgb[2] &= 0xf8;
+    }
+}
+
+// Converts the crop rectangle of a source frame into the crop rectangle
+// (dstLeft, dstTop, dstWidth x dstHeight) of a destination bitmap that is 3
+// pixels wider and 2 higher, and checks that nothing outside of it changed.
+static void convertInto(
+        ColorConverter *converter, OMX_COLOR_FORMATTYPE dstFormat,
+        const uint8_t *bits, size_t width, size_t height, const Rect &crop,
+        size_t dstWidth, size_t dstHeight, Vector<uint8_t> *dst) {
+    const size_t bpp = dstFormat == kColorFormatRGBA8888 ? 4 : 2;
+    const size_t stride = dstWidth + 3;
+    const size_t rows = dstHeight + 2;
+    const size_t left = 1;
+    const size_t top = 1;
+
+    Vector<uint8_t> bitmap;
+    bitmap.insertAt(kUntouched, 0, stride * rows * bpp);
+    ASSERT_EQ((status_t)OK, converter->convert(
+            bits, width, height, crop.mLeft, crop.mTop, crop.mRight, crop.mBottom,
+            bitmap.editArray(), stride, rows,
+            left, top, left + dstWidth - 1, top + dstHeight - 1));
+
+    dst->clear();
+    for (size_t y = 0; y < rows; ++y) {
+        for (size_t x = 0; x < stride; ++x) {
+            const uint8_t *pixel = &bitmap[(y * stride + x) * bpp];
+            bool inside = x >= left && x < left + dstWidth && y >= top && y < top + dstHeight;
+            if (inside) {
+                dst->appendArray(pixel, bpp);
+                continue;
+            }
+            for (size_t i = 0; i < bpp; ++i) {
+                ASSERT_EQ(kUntouched, pixel[i]) << "(" << x << ", " << y << ")";
+            }
+        }
+    }
+}
+
+TEST(ColorConverterTest, MatchesReference) {
+    static const OMX_COLOR_FORMATTYPE kDstFormats[] = {
+        OMX_COLOR_Format16bitRGB565, kColorFormatRGBA8888,
+    };
+    static const struct {
+        size_t mWidth, mHeight;
+        Rect mCrop;
+    } kCases[] = {
+        { 64, 32, { 0, 0, 63, 31 } },
+        { 70, 18, { 0, 0, 68, 16 } },           // odd width and height
+        { 96, 40, { 10, 3, 76, 30 } },          // odd crop top
+        { 128, 36, { 34, 8, 56, 35 } },         // narrow, odd width
+    };
+
+    for (size_t f = 0; f < kNumSrcFormats; ++f) {
+        for (size_t d = 0; d < 2; ++d) {
+            for (size_t c = 0; c < sizeof(kCases) / sizeof(kCases[0]); ++c) {
+                const OMX_COLOR_FORMATTYPE srcFormat = kSrcFormats[f];
+                const size_t width = kCases[c].mWidth;
+                const size_t height = kCases[c].mHeight;
+                const Rect &crop = kCases[c].mCrop;
+
+                Vector<uint8_t> bits;
+                bits.insertAt(0, 0, bufferSize(srcFormat, width, height));
+                randomFrame(bits.editArray(), bits.size(), f * 100 + c);
+
+                ColorConverter converter(srcFormat, kDstFormats[d]);
+                ASSERT_TRUE(converter.isValid());
+
+                Vector<uint8_t> dst;
+                convertInto(
+                        &converter, kDstFormats[d], bits.array(), width, height, crop,
+                        crop.width(), crop.height(), &dst);
+
+                Vector<uint8_t> expected;
+                expected.insertAt(0, 0, crop.width() * crop.height() * 3);
+                referenceFrame(
+                        srcFormat, bits.array(), width, height, crop,
+                        expected.editArray());
+
+                for (size_t i = 0; i < crop.width() * crop.height(); ++i) {
+                    uint8_t rgb[3];
+                    unpackPixel(kDstFormats[d], dst.array(), i, rgb);
+                    truncate(kDstFormats[d], &expected.editItemAt(i * 3));
+                    ASSERT_EQ(0, memcmp(rgb, &expected[i * 3], 3))
+                        << "format " << f << " to " << d << ", case " << c
+                        << ", pixel (" << i % crop.width() << ", " << i / crop.width() << ")";
+                    if (kDstFormats[d] == kColorFormatRGBA8888) {
+                        ASSERT_EQ(0xff, dst[i * 4 + 3]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(ColorConverterTest, ThreadsDoNotChangeOutput) {
+    const size_t width = 1280;
+    const size_t height = 720;
+
+    for (size_t f = 0; f < kNumSrcFormats; ++f) {
+        Vector<uint8_t> bits;
+        bits.insertAt(0, 0, bufferSize(kSrcFormats[f], width, height));
+        randomFrame(bits.editArray(), bits.size(), f);
+
+        ColorConverter converter(kSrcFormats[f], kColorFormatRGBA8888);
+        const Rect crop = { 0, 0, width - 1, height - 1 };
+        const size_t scaledWidth = 853;
+        const size_t scaledHeight = 480;
+
+        Vector<uint8_t> single, singleScaled, multi, multiScaled;
+        converter.setNumThreads(1);
+        convertInto(&converter, kColorFormatRGBA8888, bits.array(), width, height,
+                crop, width, height, &single);
+        convertInto(&converter, kColorFormatRGBA8888, bits.array(), width, height,
+                crop, scaledWidth, scaledHeight, &singleScaled);
+
+        converter.setNumThreads(4);
+        for (size_t i = 0; i < 3; ++i) {
+            convertInto(&converter, kColorFormatRGBA8888, bits.array(), width, height,
+                    crop, width, height, &multi);
+            ASSERT_EQ(0, memcmp(single.array(), multi.array(), single.size()));
+            convertInto(&converter, kColorFormatRGBA8888, bits.array(), width, height,
+                    crop, scaledWidth, scaledHeight, &multiScaled);
+            ASSERT_EQ(0, memcmp(
+                    singleScaled.array(), multiScaled.array(), singleScaled.size()));
+        }
+    }
+}
+
+// The fused downscale against a full size conversion averaged down in RGB.
+TEST(ColorConverterTest, ScalesByAveraging) {
+    const size_t width = 640;
+    const size_t height = 360;
+    const Rect crop = { 8, 6, 631, 353 };
+
+    static const struct {
+        size_t mWidth, mHeight;
+    } kSizes[] = {
+        { 312, 174 },   // half
+        { 200, 150 },   // uneven in both directions
+        { 96, 64 },
+        { 700, 400 },   // up
+    };
+
+    for (size_t f = 0; f < kNumSrcFormats; ++f) {
+        Vector<uint8_t> bits;
+        bits.insertAt(0, 0, bufferSize(kSrcFormats[f], width, height));
+        smoothFrame(kSrcFormats[f], bits.editArray(), width, height);
+
+        Vector<uint8_t> full;
+        full.insertAt(0, 0, crop.width() * crop.height() * 3);
+        referenceFrame(
+                kSrcFormats[f], bits.array(), width, height, crop, full.editArray());
+
+        ColorConverter converter(kSrcFormats[f], kColorFormatRGBA8888);
+        for (size_t s = 0; s < sizeof(kSizes) / sizeof(kSizes[0]); ++s) {
+            const size_t dw = kSizes[s].mWidth;
+            const size_t dh = kSizes[s].mHeight;
+
+            Vector<uint8_t> scaled;
+            convertInto(&converter, kColorFormatRGBA8888, bits.array(), width, height,
+                    crop, dw, dh, &scaled);
+
+            double error = 0;
+            for (size_t y = 0; y < dh; ++y) {
+                size_t y0 = y * crop.height() / dh;
+                size_t y1 = (y + 1) * crop.height() / dh;
+                if (y1 <= y0) {
+                    y1 = y0 + 1;
+                }
+                for (size_t x = 0; x < dw; ++x) {
+                    size_t x0 = x * crop.width() / dw;
+                    size_t x1 = (x + 1) * crop.width() / dw;
+                    if (x1 <= x0) {
+                        x1 = x0 + 1;
+                    }
+                    for (size_t c = 0; c < 3; ++c) {
+                        double sum = 0;
+                        for (size_t sy = y0; sy < y1; ++sy) {
+                            for (size_t sx = x0; sx < x1; ++sx) {
+                                sum += full[(sy * crop.width() + sx) * 3 + c];
+                            }
+                        }
+                        double d = sum / ((x1 - x0) * (y1 - y0))
+                            - scaled[(y * dw + x) * 4 + c];
+                        error += d * d;
+                    }
+                }
+            }
+
+            double psnr = 10 * log10(255.0 * 255.0 / (error / (dw * dh * 3)));
+            EXPECT_GT(psnr, 40.0) << "format " << f << ", " << dw << "x" << dh;
+        }
+    }
+}
+
+TEST(ColorConverterTest, RejectsUnsupported) {
+    EXPECT_FALSE(ColorConverter(
+            OMX_COLOR_FormatYUV420Planar, OMX_COLOR_Format32bitARGB8888).isValid());
+    EXPECT_FALSE(ColorConverter(
+            OMX_COLOR_FormatL8, OMX_COLOR_Format16bitRGB565).isValid());
+
+    uint8_t src[64 * 16 * 2];
+    uint8_t dst[64 * 16 * 4];
+    memset(src, 0, sizeof(src));
+
+    ColorConverter invalid(OMX_COLOR_FormatL8, kColorFormatRGBA8888);
+    EXPECT_EQ(ERROR_UNSUPPORTED, invalid.convert(
+            src, 64, 16, 0, 0, 63, 15, dst, 64, 16, 0, 0, 63, 15));
+
+    // Pixels are converted in pairs sharing their chroma.
+    ColorConverter converter(OMX_COLOR_FormatYUV420Planar, kColorFormatRGBA8888);
+    EXPECT_EQ(ERROR_UNSUPPORTED, converter.convert(
+            src, 64, 16, 1, 0, 63, 15, dst, 64, 16, 0, 0, 62, 15));
+}
+
+}  // namespace android
@@ -19,11 +19,13 @@ LOCAL_SRC_FILES:=               \
     Tracks.cpp                  \
     Effects.cpp                 \
     AudioMixer.cpp.arm          \
+    AudioMixerKernels.cpp.arm   \
     AudioResampler.cpp.arm      \
     AudioPolicyService.cpp      \
     ServiceUtilities.cpp        \
     AudioResamplerCubic.cpp.arm \
-    AudioResamplerSinc.cpp.arm
+    AudioResamplerSinc.cpp.arm  \
+    AudioResamplerPolyphase.cpp.arm
 
 LOCAL_SRC_FILES += StateQueue.cpp
 
@@ -77,7 +79,8 @@ LOCAL_SRC_FILES:=               \
 	test-resample.cpp 			\
     AudioResampler.cpp.arm      \
 	AudioResamplerCubic.cpp.arm \
-    AudioResamplerSinc.cpp.arm
+    AudioResamplerSinc.cpp.arm  \
+    AudioResamplerPolyphase.cpp.arm
 
 LOCAL_SHARED_LIBRARIES := \
     libdl \
@@ -91,4 +94,62 @@ LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_EXECUTABLE)
 
+#
+# build audio mixer benchmark tool
+#
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:=               \
+    test-mixer.cpp              \
+    AudioMixer.cpp.arm          \
+    AudioMixerKernels.cpp.arm   \
+    AudioResampler.cpp.arm      \
+    AudioResamplerCubic.cpp.arm \
+    AudioResamplerSinc.cpp.arm  \
+    AudioResamplerPolyphase.cpp.arm
+
+LOCAL_C_INCLUDES := \
+    $(call include-path-for, audio-effects) \
+    $(call include-path-for, audio-utils)
+
+LOCAL_SHARED_LIBRARIES := \
+    libaudioutils \
+    libcommon_time_client \
+    libdl \
+    libcutils \
+    libutils \
+    liblog \
+    libnbaio \
+    libeffects
+
+LOCAL_MODULE:= test-mixer
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+#
+# build effect chain benchmark tool
+#
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:=               \
+    test-effects.cpp
+
+LOCAL_C_INCLUDES := \
+    $(call include-path-for, audio-effects) \
+    $(call include-path-for, audio-utils)
+
+LOCAL_SHARED_LIBRARIES := \
+    libcutils \
+    libutils \
+    liblog \
+    libeffects
+
+LOCAL_MODULE:= test-effects
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
 include $(call all-makefiles-under,$(LOCAL_PATH))
@@ -235,7 +235,9 @@ public:
     sp<NBLog::Writer>   newWriter_l(size_t size, const char *name);
     void                unregisterWriter(const sp<NBLog::Writer>& writer);
 private:
-    static const size_t kLogMemorySize = 10 * 1024;
+    // Each timeline is its circular buffer plus about 3 KB of NBLog format table, see
+    // NBLog::Timeline::sharedSize(): this fits the mixer thread and FastMixer 4 KB logs.
+    static const size_t kLogMemorySize = 20 * 1024;
     sp<MemoryDealer>    mLogMemoryDealer;   // == 0 when NBLog is disabled
 public:
 
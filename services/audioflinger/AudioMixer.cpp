@@ -40,6 +40,12 @@
 #include <media/EffectsFactoryApi.h>
 
 #include "AudioMixer.h"
+#include "AudioMixerKernels.h"
+#include "AudioMixerOps.h"
+
+#ifndef FCC_2
+#define FCC_2 2     // FCC_2 = Fixed Channel Count 2
+#endif
 
 namespace android {
 
@@ -89,6 +95,77 @@ void AudioMixer::DownmixerBufferProvider::releaseBuffer(AudioBufferProvider::Buf
 }
 
 
+// ----------------------------------------------------------------------------
+AudioMixer::ReformatBufferProvider::ReformatBufferProvider(audio_format_t format,
+        uint32_t channelCount) : AudioBufferProvider(),
+        mTrackBufferProvider(NULL), mFormat(format), mChannelCount(channelCount),
+        mConverted(NULL), mConvertedFrameCount(0)
+{
+    ALOGV("ReformatBufferProvider(%p)(%#x, %u)", this, format, channelCount);
+    mBuffer.raw = NULL;
+    mBuffer.frameCount = 0;
+}
+
+AudioMixer::ReformatBufferProvider::~ReformatBufferProvider()
+{
+    ALOGV("AudioMixer deleting ReformatBufferProvider (%p)", this);
+    delete [] mConverted;
+}
+
+status_t AudioMixer::ReformatBufferProvider::getNextBuffer(AudioBufferProvider::Buffer *pBuffer,
+        int64_t pts) {
+    if (mTrackBufferProvider == NULL) {
+        ALOGE("ReformatBufferProvider::getNextBuffer() error: NULL track buffer provider");
+        return NO_INIT;
+    }
+    mBuffer.frameCount = pBuffer->frameCount;
+    status_t res = mTrackBufferProvider->getNextBuffer(&mBuffer, pts);
+    if (res != OK || mBuffer.raw == NULL) {
+        pBuffer->raw = NULL;
+        pBuffer->frameCount = 0;
+        return res;
+    }
+    if (mBuffer.frameCount > mConvertedFrameCount) {
+        // only grows until the largest request of the mixer or resampler has been seen
+        delete [] mConverted;
+        mConvertedFrameCount = mBuffer.frameCount;
+        mConverted = new int16_t[mConvertedFrameCount * mChannelCount];
+    }
+    const size_t count = mBuffer.frameCount * mChannelCount;
+    switch (mFormat) {
+    case AUDIO_FORMAT_PCM_FLOAT: {
+        const float *in = (const float *) mBuffer.raw;
+        for (size_t i = 0; i < count; ++i) {
+            mConverted[i] = clamp16_from_float(in[i]);
+        }
+        } break;
+    case AUDIO_FORMAT_PCM_24_BIT_PACKED: {
+        const packed24_t *in = (const packed24_t *) mBuffer.raw;
+        for (size_t i = 0; i < count; ++i) {
+            mConverted[i] = clamp16_from_float(float_from_p24(in[i]));
+        }
+        } break;
+    default:
+        LOG_FATAL("ReformatBufferProvider: bad format %#x", mFormat);
+    }
+    pBuffer->raw = mConverted;
+    pBuffer->frameCount = mBuffer.frameCount;
+    return res;
+}
+
+void AudioMixer::ReformatBufferProvider::releaseBuffer(AudioBufferProvider::Buffer *pBuffer) {
+    if (mTrackBufferProvider == NULL) {
+        ALOGE("ReformatBufferProvider::releaseBuffer() error: NULL track buffer provider");
+        return;
+    }
+    // the consumer may release fewer frames than it obtained
+    mBuffer.frameCount = pBuffer->frameCount;
+    mTrackBufferProvider->releaseBuffer(&mBuffer);
+    pBuffer->raw = NULL;
+    pBuffer->frameCount = 0;
+}
+
+
 // ----------------------------------------------------------------------------
 bool AudioMixer::isMultichannelCapable = false;
 
@@ -101,8 +178,8 @@ AudioMixer::AudioMixer(size_t frameCount, uint32_t sampleRate, uint32_t maxNumTr
     :   mTrackNames(0), mConfiguredNames((maxNumTracks >= 32 ? 0 : 1 << maxNumTracks) - 1),
         mSampleRate(sampleRate)
 {
-    // AudioMixer is not yet capable of multi-channel beyond stereo
-    COMPILE_TIME_ASSERT_FUNCTION_SCOPE(2 == MAX_NUM_CHANNELS);
+    // the legacy path and the volume parameters are left/right only
+    COMPILE_TIME_ASSERT_FUNCTION_SCOPE(2 == MAX_NUM_VOLUMES);
 
     ALOG_ASSERT(maxNumTracks <= MAX_NUM_TRACKS, "maxNumTracks %u > MAX_NUM_TRACKS %u",
             maxNumTracks, MAX_NUM_TRACKS);
@@ -110,8 +187,8 @@ AudioMixer::AudioMixer(size_t frameCount, uint32_t sampleRate, uint32_t maxNumTr
     // AudioMixer is not yet capable of more than 32 active track inputs
     ALOG_ASSERT(32 >= MAX_NUM_TRACKS, "bad MAX_NUM_TRACKS %d", MAX_NUM_TRACKS);
 
-    // AudioMixer is not yet capable of multi-channel output beyond stereo
-    ALOG_ASSERT(2 == MAX_NUM_CHANNELS, "bad MAX_NUM_CHANNELS %d", MAX_NUM_CHANNELS);
+    // the multichannel track hooks cover up to 7.1 output
+    ALOG_ASSERT(8 >= MAX_NUM_CHANNELS, "bad MAX_NUM_CHANNELS %d", MAX_NUM_CHANNELS);
 
     LocalClock lc;
 
@@ -124,7 +201,7 @@ AudioMixer::AudioMixer(size_t frameCount, uint32_t sampleRate, uint32_t maxNumTr
     mState.outputTemp   = NULL;
     mState.resampleTemp = NULL;
     mState.mLog         = &mDummyLog;
-    // mState.reserved
+    mState.mixTemp      = NULL;
 
     // FIXME Most of the following initialization is probably redundant since
     // tracks[i] should only be referenced if (mTrackNames & (1 << i)) != 0
@@ -133,6 +210,7 @@ AudioMixer::AudioMixer(size_t frameCount, uint32_t sampleRate, uint32_t maxNumTr
     for (unsigned i=0 ; i < MAX_NUM_TRACKS ; i++) {
         t->resampler = NULL;
         t->downmixerBufferProvider = NULL;
+        t->mReformatBufferProvider = NULL;
         t++;
     }
 
@@ -165,10 +243,12 @@ AudioMixer::~AudioMixer()
     for (unsigned i=0 ; i < MAX_NUM_TRACKS ; i++) {
         delete t->resampler;
         delete t->downmixerBufferProvider;
+        delete t->mReformatBufferProvider;
         t++;
     }
     delete [] mState.outputTemp;
     delete [] mState.resampleTemp;
+    delete [] mState.mixTemp;
 }
 
 void AudioMixer::setLog(NBLog::Writer *log)
@@ -216,9 +296,26 @@ int AudioMixer::getTrackName(audio_channel_mask_t channelMask, int sessionId)
         t->mainBuffer = NULL;
         t->auxBuffer = NULL;
         t->downmixerBufferProvider = NULL;
+        t->mInputBufferProvider = NULL;
+        t->mReformatBufferProvider = NULL;
+        t->mHookFloat = NULL;
+        t->mFormat = AUDIO_FORMAT_PCM_16_BIT;
+        t->mMixerFormat = AUDIO_FORMAT_PCM_16_BIT;
+        t->mVolume[0] = 1.0f;
+        t->mVolume[1] = 1.0f;
+        t->mPrevVolume[0] = 1.0f;
+        t->mPrevVolume[1] = 1.0f;
+        t->mVolumeInc[0] = 0;
+        t->mVolumeInc[1] = 0;
+        t->mAuxLevel = 0;
+        t->mPrevAuxLevel = 0;
+        t->mAuxInc = 0;
+        t->mMixerChannelMask = AUDIO_CHANNEL_OUT_STEREO;
+        t->mMixerChannelCount = FCC_2;
 
         status_t status = initTrackDownmix(&mState.tracks[n], n, channelMask);
-        if (status == OK) {
+        // without a downmixer the float path still folds the common layouts itself
+        if (status == OK || isMultichannelMixerMask(channelMask)) {
             return TRACK0 + n;
         }
         ALOGE("AudioMixer::getTrackName(0x%x) failed, error preparing track for downmix",
@@ -235,14 +332,45 @@ void AudioMixer::invalidateState(uint32_t mask)
     }
  }
 
+bool AudioMixer::isMultichannelMixerMask(audio_channel_mask_t mask)
+{
+    switch (mask) {
+    case AUDIO_CHANNEL_OUT_QUAD:
+    case AUDIO_CHANNEL_OUT_5POINT1:
+    case AUDIO_CHANNEL_OUT_7POINT1:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Tracks with more than 2 channels are mixed natively by the float path, the downmix effect is
+// only needed for a stereo mix, for the resampler which is stereo only, or for channel masks
+// that have no multichannel track hook.
+bool AudioMixer::needsDownmix(const track_t* pTrack, audio_channel_mask_t mask)
+{
+    if (popcount(mask) <= FCC_2) {
+        return false;
+    }
+    return pTrack->mMixerChannelCount <= FCC_2 || pTrack->resampler != NULL ||
+            !isMultichannelMixerMask(mask);
+}
+
 status_t AudioMixer::initTrackDownmix(track_t* pTrack, int trackNum, audio_channel_mask_t mask)
 {
     uint32_t channelCount = popcount(mask);
     ALOG_ASSERT((channelCount <= MAX_NUM_CHANNELS_TO_DOWNMIX) && channelCount);
     status_t status = OK;
-    if (channelCount > MAX_NUM_CHANNELS) {
+    if (channelCount > FCC_2) {
         pTrack->channelMask = mask;
         pTrack->channelCount = channelCount;
+    }
+    if (needsDownmix(pTrack, mask)) {
+        if (pTrack->downmixerBufferProvider != NULL &&
+                pTrack->downmixerBufferProvider->mDownmixConfig.inputCfg.channels == mask) {
+            // already configured for this mask
+            return OK;
+        }
         ALOGV("initTrackDownmix(track=%d, mask=0x%x) calls prepareTrackForDownmix()",
                 trackNum, mask);
         status = prepareTrackForDownmix(pTrack, trackNum);
@@ -258,9 +386,9 @@ void AudioMixer::unprepareTrackForDownmix(track_t* pTrack, int trackName) {
     if (pTrack->downmixerBufferProvider != NULL) {
         // this track had previously been configured with a downmixer, delete it
         ALOGV(" deleting old downmixer");
-        pTrack->bufferProvider = pTrack->downmixerBufferProvider->mTrackBufferProvider;
         delete pTrack->downmixerBufferProvider;
         pTrack->downmixerBufferProvider = NULL;
+        reconfigureBufferProviders(pTrack);
     } else {
         ALOGV(" nothing to do, no downmixer to delete");
     }
@@ -354,12 +482,10 @@ status_t AudioMixer::prepareTrackForDownmix(track_t* pTrack, int trackName)
     }// end of scope for local variables that are not used in goto label "noDownmixForActiveTrack"
 
     // initialization successful:
-    // - keep track of the real buffer provider in case it was set before
-    pDbp->mTrackBufferProvider = pTrack->bufferProvider;
     // - we'll use the downmix effect integrated inside this
     //    track's buffer provider, and we'll use it as the track's buffer provider
     pTrack->downmixerBufferProvider = pDbp;
-    pTrack->bufferProvider = pDbp;
+    reconfigureBufferProviders(pTrack);
 
     return NO_ERROR;
 
@@ -369,6 +495,43 @@ noDownmixForActiveTrack:
     return NO_INIT;
 }
 
+void AudioMixer::prepareTrackForReformat(track_t* pTrack, int trackName)
+{
+    // the downmixer and the resampler only take 16-bit, the float track hooks take any format
+    const bool needsReformat = pTrack->mFormat != AUDIO_FORMAT_PCM_16_BIT &&
+            (pTrack->downmixerBufferProvider != NULL || pTrack->resampler != NULL);
+    ReformatBufferProvider* pRbp = pTrack->mReformatBufferProvider;
+    if (needsReformat) {
+        if (pRbp == NULL || pRbp->mFormat != pTrack->mFormat ||
+                pRbp->mChannelCount != pTrack->channelCount) {
+            ALOGV("prepareTrackForReformat(%d) from format %#x, %u channels",
+                    trackName, pTrack->mFormat, pTrack->channelCount);
+            delete pRbp;
+            pTrack->mReformatBufferProvider =
+                    new ReformatBufferProvider(pTrack->mFormat, pTrack->channelCount);
+        }
+    } else if (pRbp != NULL) {
+        ALOGV("prepareTrackForReformat(%d) deleting reformatter", trackName);
+        delete pRbp;
+        pTrack->mReformatBufferProvider = NULL;
+    }
+    reconfigureBufferProviders(pTrack);
+}
+
+// Chains the providers of a track: input -> [reformat] -> [downmix] -> bufferProvider.
+void AudioMixer::reconfigureBufferProviders(track_t* pTrack)
+{
+    pTrack->bufferProvider = pTrack->mInputBufferProvider;
+    if (pTrack->mReformatBufferProvider != NULL) {
+        pTrack->mReformatBufferProvider->mTrackBufferProvider = pTrack->bufferProvider;
+        pTrack->bufferProvider = pTrack->mReformatBufferProvider;
+    }
+    if (pTrack->downmixerBufferProvider != NULL) {
+        pTrack->downmixerBufferProvider->mTrackBufferProvider = pTrack->bufferProvider;
+        pTrack->bufferProvider = pTrack->downmixerBufferProvider;
+    }
+}
+
 void AudioMixer::deleteTrackName(int name)
 {
     ALOGV("AudioMixer::deleteTrackName(%d)", name);
@@ -385,6 +548,9 @@ void AudioMixer::deleteTrackName(int name)
     track.resampler = NULL;
     // delete the downmixer
     unprepareTrackForDownmix(&mState.tracks[name], name);
+    // delete the reformatter
+    delete track.mReformatBufferProvider;
+    track.mReformatBufferProvider = NULL;
 
     mTrackNames &= ~(1<<name);
 }
@@ -437,6 +603,7 @@ void AudioMixer::setParameter(int name, int target, int param, void *value)
                 track.channelCount = channelCount;
                 // the mask has changed, does this track need a downmixer?
                 initTrackDownmix(&mState.tracks[name], name, mask);
+                prepareTrackForReformat(&mState.tracks[name], name);
                 ALOGV("setParameter(TRACK, CHANNEL_MASK, %x)", mask);
                 invalidateState(1 << name);
             }
@@ -455,9 +622,39 @@ void AudioMixer::setParameter(int name, int target, int param, void *value)
                 invalidateState(1 << name);
             }
             break;
-        case FORMAT:
-            ALOG_ASSERT(valueInt == AUDIO_FORMAT_PCM_16_BIT);
-            break;
+        case FORMAT: {
+            audio_format_t format = (audio_format_t) valueInt;
+            ALOG_ASSERT(is_mixer_format(format), "bad format %#x", format);
+            if (track.mFormat != format) {
+                track.mFormat = format;
+                ALOGV("setParameter(TRACK, FORMAT, %#x)", format);
+                prepareTrackForReformat(&mState.tracks[name], name);
+                invalidateState(1 << name);
+            }
+            } break;
+        case MIXER_FORMAT: {
+            audio_format_t format = (audio_format_t) valueInt;
+            ALOG_ASSERT(is_mixer_format(format), "bad mixer format %#x", format);
+            if (track.mMixerFormat != format) {
+                track.mMixerFormat = format;
+                ALOGV("setParameter(TRACK, MIXER_FORMAT, %#x)", format);
+                invalidateState(1 << name);
+            }
+            } break;
+        case MIXER_CHANNEL_MASK: {
+            audio_channel_mask_t mask = (audio_channel_mask_t) value;
+            ALOG_ASSERT(mask == AUDIO_CHANNEL_OUT_STEREO || isMultichannelMixerMask(mask),
+                    "bad mixer channel mask %#x", mask);
+            if (track.mMixerChannelMask != mask) {
+                track.mMixerChannelMask = mask;
+                track.mMixerChannelCount = popcount(mask);
+                ALOGV("setParameter(TRACK, MIXER_CHANNEL_MASK, %#x)", mask);
+                // a multichannel track no longer needs the downmixer in a wide enough mix
+                initTrackDownmix(&mState.tracks[name], name, track.channelMask);
+                prepareTrackForReformat(&mState.tracks[name], name);
+                invalidateState(1 << name);
+            }
+            } break;
         // FIXME do we want to support setting the downmix type from AudioFlinger?
         //         for a specific track? or per mixer?
         /* case DOWNMIX_TYPE:
@@ -474,6 +671,9 @@ void AudioMixer::setParameter(int name, int target, int param, void *value)
             if (track.setResampler(uint32_t(valueInt), mSampleRate)) {
                 ALOGV("setParameter(RESAMPLE, SAMPLE_RATE, %u)",
                         uint32_t(valueInt));
+                // the resampler is stereo only, a multichannel track now needs the downmixer
+                initTrackDownmix(&mState.tracks[name], name, track.channelMask);
+                prepareTrackForReformat(&mState.tracks[name], name);
                 invalidateState(1 << name);
             }
             break;
@@ -485,6 +685,8 @@ void AudioMixer::setParameter(int name, int target, int param, void *value)
             delete track.resampler;
             track.resampler = NULL;
             track.sampleRate = mSampleRate;
+            initTrackDownmix(&mState.tracks[name], name, track.channelMask);
+            prepareTrackForReformat(&mState.tracks[name], name);
             invalidateState(1 << name);
             break;
         default:
@@ -512,6 +714,16 @@ void AudioMixer::setParameter(int name, int target, int param, void *value)
                         track.prevVolume[param-VOLUME0] = valueInt << 16;
                     }
                 }
+                // float mixing path
+                track.mPrevVolume[param-VOLUME0] = track.mVolume[param-VOLUME0];
+                track.mVolume[param-VOLUME0] = float(valueInt) / UNITY_GAIN;
+                if (target == VOLUME) {
+                    track.mPrevVolume[param-VOLUME0] = track.mVolume[param-VOLUME0];
+                    track.mVolumeInc[param-VOLUME0] = 0;
+                } else {
+                    track.mVolumeInc[param-VOLUME0] = (track.mVolume[param-VOLUME0] -
+                            track.mPrevVolume[param-VOLUME0]) / float(mState.frameCount);
+                }
                 invalidateState(1 << name);
             }
             break;
@@ -532,6 +744,16 @@ void AudioMixer::setParameter(int name, int target, int param, void *value)
                         track.prevAuxLevel = valueInt << 16;
                     }
                 }
+                // float mixing path, MAX_GAIN_INT is unity like UNITY_GAIN
+                track.mPrevAuxLevel = track.mAuxLevel;
+                track.mAuxLevel = float(valueInt) / UNITY_GAIN;
+                if (target == VOLUME) {
+                    track.mPrevAuxLevel = track.mAuxLevel;
+                    track.mAuxInc = 0;
+                } else {
+                    track.mAuxInc = (track.mAuxLevel - track.mPrevAuxLevel) /
+                            float(mState.frameCount);
+                }
                 invalidateState(1 << name);
             }
             break;
@@ -565,10 +787,13 @@ bool AudioMixer::track_t::setResampler(uint32_t value, uint32_t devSampleRate)
                 }
                 resampler = AudioResampler::create(
                         format,
-                        // the resampler sees the number of channels after the downmixer, if any
-                        downmixerBufferProvider != NULL ? MAX_NUM_CHANNELS : channelCount,
+                        // the resampler sees the number of channels after the downmixer, which
+                        // the caller sets up for any track with more than 2 channels
+                        channelCount > FCC_2 ? FCC_2 : channelCount,
                         devSampleRate, quality);
                 resampler->setLocalTimeFreq(sLocalTimeFreq);
+                // lets the resampler set up for the initial ratio here rather than in the mix
+                resampler->setSampleRate(value);
             }
             return true;
         }
@@ -579,11 +804,13 @@ bool AudioMixer::track_t::setResampler(uint32_t value, uint32_t devSampleRate)
 inline
 void AudioMixer::track_t::adjustVolumeRamp(bool aux)
 {
-    for (uint32_t i=0 ; i<MAX_NUM_CHANNELS ; i++) {
+    for (uint32_t i=0 ; i<MAX_NUM_VOLUMES ; i++) {
         if (((volumeInc[i]>0) && (((prevVolume[i]+volumeInc[i])>>16) >= volume[i])) ||
             ((volumeInc[i]<0) && (((prevVolume[i]+volumeInc[i])>>16) <= volume[i]))) {
             volumeInc[i] = 0;
             prevVolume[i] = volume[i]<<16;
+            mVolumeInc[i] = 0;
+            mPrevVolume[i] = mVolume[i];
         }
     }
     if (aux) {
@@ -591,6 +818,33 @@ void AudioMixer::track_t::adjustVolumeRamp(bool aux)
             ((auxInc<0) && (((prevAuxLevel+auxInc)>>16) <= auxLevel))) {
             auxInc = 0;
             prevAuxLevel = auxLevel<<16;
+            mAuxInc = 0;
+            mPrevAuxLevel = mAuxLevel;
+        }
+    }
+}
+
+// Like adjustVolumeRamp() for the float path, also ends the integer ramp so that the legacy
+// path does not resume a stale ramp should the mixer switch back to it.
+inline
+void AudioMixer::track_t::adjustVolumeRampFloat(bool aux)
+{
+    for (uint32_t i=0 ; i<MAX_NUM_VOLUMES ; i++) {
+        if (((mVolumeInc[i]>0) && (mPrevVolume[i]+mVolumeInc[i] >= mVolume[i])) ||
+            ((mVolumeInc[i]<0) && (mPrevVolume[i]+mVolumeInc[i] <= mVolume[i]))) {
+            mVolumeInc[i] = 0;
+            mPrevVolume[i] = mVolume[i];
+            volumeInc[i] = 0;
+            prevVolume[i] = volume[i]<<16;
+        }
+    }
+    if (aux) {
+        if (((mAuxInc>0) && (mPrevAuxLevel+mAuxInc >= mAuxLevel)) ||
+            ((mAuxInc<0) && (mPrevAuxLevel+mAuxInc <= mAuxLevel))) {
+            mAuxInc = 0;
+            mPrevAuxLevel = mAuxLevel;
+            auxInc = 0;
+            prevAuxLevel = auxLevel<<16;
         }
     }
 }
@@ -608,21 +862,15 @@ void AudioMixer::setBufferProvider(int name, AudioBufferProvider* bufferProvider
 {
     name -= TRACK0;
     ALOG_ASSERT(uint32_t(name) < MAX_NUM_TRACKS, "bad track name %d", name);
+    track_t& track = mState.tracks[name];
 
-    if (mState.tracks[name].downmixerBufferProvider != NULL) {
-        // update required?
-        if (mState.tracks[name].downmixerBufferProvider->mTrackBufferProvider != bufferProvider) {
-            ALOGV("AudioMixer::setBufferProvider(%p) for downmix", bufferProvider);
-            // setting the buffer provider for a track that gets downmixed consists in:
-            //  1/ setting the buffer provider to the "downmix / buffer provider" wrapper
-            //     so it's the one that gets called when the buffer provider is needed,
-            mState.tracks[name].bufferProvider = mState.tracks[name].downmixerBufferProvider;
-            //  2/ saving the buffer provider for the track so the wrapper can use it
-            //     when it downmixes.
-            mState.tracks[name].downmixerBufferProvider->mTrackBufferProvider = bufferProvider;
-        }
-    } else {
-        mState.tracks[name].bufferProvider = bufferProvider;
+    // update required?
+    if (track.mInputBufferProvider != bufferProvider) {
+        ALOGV("AudioMixer::setBufferProvider(%p)", bufferProvider);
+        // the track buffer provider is at the head of the chain, any reformatter or downmixer
+        // wraps it and is the one that gets called when the buffer provider is needed
+        track.mInputBufferProvider = bufferProvider;
+        reconfigureBufferProviders(&track);
     }
 }
 
@@ -659,6 +907,8 @@ void AudioMixer::process__validate(state_t* state, int64_t pts)
     bool all16BitsStereoNoResample = true;
     bool resampling = false;
     bool volumeRamp = false;
+    // any track that is not 16-bit in and out needs the float path
+    bool useFloat = false;
     uint32_t en = state->enabledTracks;
     while (en) {
         const int i = 31 - __builtin_clz(en);
@@ -668,7 +918,25 @@ void AudioMixer::process__validate(state_t* state, int64_t pts)
         track_t& t = state->tracks[i];
         uint32_t n = 0;
         n |= NEEDS_CHANNEL_1 + t.channelCount - 1;
-        n |= NEEDS_FORMAT_16;
+        switch (t.mixerInFormat()) {
+        case AUDIO_FORMAT_PCM_FLOAT:
+            n |= NEEDS_FORMAT_FLOAT;
+            break;
+        case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+            n |= NEEDS_FORMAT_24_PACKED;
+            break;
+        default:
+            n |= NEEDS_FORMAT_16;
+            break;
+        }
+        if (t.mFormat != AUDIO_FORMAT_PCM_16_BIT || t.mMixerFormat != AUDIO_FORMAT_PCM_16_BIT) {
+            useFloat = true;
+        }
+        // only the float path mixes multichannel, natively or when no downmixer is available
+        if (t.mMixerChannelCount != FCC_2 ||
+                (t.channelCount > FCC_2 && t.downmixerBufferProvider == NULL)) {
+            useFloat = true;
+        }
         n |= t.doesResample() ? NEEDS_RESAMPLE_ENABLED : NEEDS_RESAMPLE_DISABLED;
         if (t.auxLevel != 0 && t.auxBuffer != NULL) {
             n |= NEEDS_AUX_ENABLED;
@@ -683,7 +951,9 @@ void AudioMixer::process__validate(state_t* state, int64_t pts)
 
         if ((n & NEEDS_MUTE__MASK) == NEEDS_MUTE_ENABLED) {
             t.hook = track__nop;
+            t.mHookFloat = track__nopFloat;
         } else {
+            t.mHookFloat = getTrackHookFloat(t);
             if ((n & NEEDS_AUX__MASK) == NEEDS_AUX_ENABLED) {
                 all16BitsStereoNoResample = false;
             }
@@ -707,15 +977,35 @@ void AudioMixer::process__validate(state_t* state, int64_t pts)
         }
     }
 
+    if (useFloat) {
+        all16BitsStereoNoResample = false;
+    } else if (state->mixTemp) {
+        delete [] state->mixTemp;
+        state->mixTemp = NULL;
+    }
+
     // select the processing hooks
     state->hook = process__nop;
     if (countActiveTracks) {
-        if (resampling) {
+        if (useFloat) {
+            // the float path mixes a whole buffer at a time, like process__genericResampling()
+            if (!state->mixTemp) {
+                state->mixTemp = new float[MAX_NUM_CHANNELS * state->frameCount];
+            }
+            if (resampling && !state->resampleTemp) {
+                state->resampleTemp = new int32_t[FCC_2 * state->frameCount];
+            }
+            if (state->outputTemp) {
+                delete [] state->outputTemp;
+                state->outputTemp = NULL;
+            }
+            state->hook = process__genericFloat;
+        } else if (resampling) {
             if (!state->outputTemp) {
-                state->outputTemp = new int32_t[MAX_NUM_CHANNELS * state->frameCount];
+                state->outputTemp = new int32_t[FCC_2 * state->frameCount];
             }
             if (!state->resampleTemp) {
-                state->resampleTemp = new int32_t[MAX_NUM_CHANNELS * state->frameCount];
+                state->resampleTemp = new int32_t[FCC_2 * state->frameCount];
             }
             state->hook = process__genericResampling;
         } else {
@@ -737,9 +1027,9 @@ void AudioMixer::process__validate(state_t* state, int64_t pts)
     }
 
     ALOGV("mixer configuration change: %d activeTracks (%08x) "
-        "all16BitsStereoNoResample=%d, resampling=%d, volumeRamp=%d",
+        "all16BitsStereoNoResample=%d, resampling=%d, volumeRamp=%d, useFloat=%d",
         countActiveTracks, state->enabledTracks,
-        all16BitsStereoNoResample, resampling, volumeRamp);
+        all16BitsStereoNoResample, resampling, volumeRamp, useFloat);
 
    state->hook(state, pts);
 
@@ -756,6 +1046,7 @@ void AudioMixer::process__validate(state_t* state, int64_t pts)
             {
                 t.needs |= NEEDS_MUTE_ENABLED;
                 t.hook = track__nop;
+                t.mHookFloat = track__nopFloat;
             } else {
                 allMuted = false;
             }
@@ -782,7 +1073,7 @@ void AudioMixer::track__genericResample(track_t* t, int32_t* out, size_t outFram
         // to apply send level after resampling
         // TODO: modify each resampler to support aux channel?
         t->resampler->setVolume(UNITY_GAIN, UNITY_GAIN);
-        memset(temp, 0, outFrameCount * MAX_NUM_CHANNELS * sizeof(int32_t));
+        memset(temp, 0, outFrameCount * FCC_2 * sizeof(int32_t));
         t->resampler->resample(temp, outFrameCount, t->bufferProvider);
         if (CC_UNLIKELY(t->volumeInc[0]|t->volumeInc[1]|t->auxInc)) {
             volumeRampStereo(t, out, outFrameCount, temp, aux);
@@ -792,7 +1083,7 @@ void AudioMixer::track__genericResample(track_t* t, int32_t* out, size_t outFram
     } else {
         if (CC_UNLIKELY(t->volumeInc[0]|t->volumeInc[1])) {
             t->resampler->setVolume(UNITY_GAIN, UNITY_GAIN);
-            memset(temp, 0, outFrameCount * MAX_NUM_CHANNELS * sizeof(int32_t));
+            memset(temp, 0, outFrameCount * FCC_2 * sizeof(int32_t));
             t->resampler->resample(temp, outFrameCount, t->bufferProvider);
             volumeRampStereo(t, out, outFrameCount, temp, aux);
         }
@@ -813,73 +1104,20 @@ void AudioMixer::track__nop(track_t* t, int32_t* out, size_t outFrameCount, int3
 void AudioMixer::volumeRampStereo(track_t* t, int32_t* out, size_t frameCount, int32_t* temp,
         int32_t* aux)
 {
-    int32_t vl = t->prevVolume[0];
-    int32_t vr = t->prevVolume[1];
-    const int32_t vlInc = t->volumeInc[0];
-    const int32_t vrInc = t->volumeInc[1];
-
     //ALOGD("[0] %p: inc=%f, v0=%f, v1=%d, final=%f, count=%d",
-    //        t, vlInc/65536.0f, vl/65536.0f, t->volume[0],
-    //       (vl + vlInc*frameCount)/65536.0f, frameCount);
+    //        t, t->volumeInc[0]/65536.0f, t->prevVolume[0]/65536.0f, t->volume[0],
+    //       (t->prevVolume[0] + t->volumeInc[0]*frameCount)/65536.0f, frameCount);
 
     // ramp volume
-    if (CC_UNLIKELY(aux != NULL)) {
-        int32_t va = t->prevAuxLevel;
-        const int32_t vaInc = t->auxInc;
-        int32_t l;
-        int32_t r;
-
-        do {
-            l = (*temp++ >> 12);
-            r = (*temp++ >> 12);
-            *out++ += (vl >> 16) * l;
-            *out++ += (vr >> 16) * r;
-            *aux++ += (va >> 17) * (l + r);
-            vl += vlInc;
-            vr += vrInc;
-            va += vaInc;
-        } while (--frameCount);
-        t->prevAuxLevel = va;
-    } else {
-        do {
-            *out++ += (vl >> 16) * (*temp++ >> 12);
-            *out++ += (vr >> 16) * (*temp++ >> 12);
-            vl += vlInc;
-            vr += vrInc;
-        } while (--frameCount);
-    }
-    t->prevVolume[0] = vl;
-    t->prevVolume[1] = vr;
+    sKernels->stereo32Ramp(out, temp, frameCount, t->prevVolume, t->volumeInc, aux,
+            &t->prevAuxLevel, t->auxInc);
     t->adjustVolumeRamp(aux != NULL);
 }
 
 void AudioMixer::volumeStereo(track_t* t, int32_t* out, size_t frameCount, int32_t* temp,
         int32_t* aux)
 {
-    const int16_t vl = t->volume[0];
-    const int16_t vr = t->volume[1];
-
-    if (CC_UNLIKELY(aux != NULL)) {
-        const int16_t va = t->auxLevel;
-        do {
-            int16_t l = (int16_t)(*temp++ >> 12);
-            int16_t r = (int16_t)(*temp++ >> 12);
-            out[0] = mulAdd(l, vl, out[0]);
-            int16_t a = (int16_t)(((int32_t)l + r) >> 1);
-            out[1] = mulAdd(r, vr, out[1]);
-            out += 2;
-            aux[0] = mulAdd(a, va, aux[0]);
-            aux++;
-        } while (--frameCount);
-    } else {
-        do {
-            int16_t l = (int16_t)(*temp++ >> 12);
-            int16_t r = (int16_t)(*temp++ >> 12);
-            out[0] = mulAdd(l, vl, out[0]);
-            out[1] = mulAdd(r, vr, out[1]);
-            out += 2;
-        } while (--frameCount);
-    }
+    sKernels->stereo32(out, temp, frameCount, t->volume, aux, (int16_t)t->auxLevel);
 }
 
 void AudioMixer::track__16BitsStereo(track_t* t, int32_t* out, size_t frameCount, int32_t* temp,
@@ -887,184 +1125,236 @@ void AudioMixer::track__16BitsStereo(track_t* t, int32_t* out, size_t frameCount
 {
     const int16_t *in = static_cast<const int16_t *>(t->in);
 
-    if (CC_UNLIKELY(aux != NULL)) {
-        int32_t l;
-        int32_t r;
-        // ramp gain
-        if (CC_UNLIKELY(t->volumeInc[0]|t->volumeInc[1]|t->auxInc)) {
-            int32_t vl = t->prevVolume[0];
-            int32_t vr = t->prevVolume[1];
-            int32_t va = t->prevAuxLevel;
-            const int32_t vlInc = t->volumeInc[0];
-            const int32_t vrInc = t->volumeInc[1];
-            const int32_t vaInc = t->auxInc;
-            // ALOGD("[1] %p: inc=%f, v0=%f, v1=%d, final=%f, count=%d",
-            //        t, vlInc/65536.0f, vl/65536.0f, t->volume[0],
-            //        (vl + vlInc*frameCount)/65536.0f, frameCount);
-
-            do {
-                l = (int32_t)*in++;
-                r = (int32_t)*in++;
-                *out++ += (vl >> 16) * l;
-                *out++ += (vr >> 16) * r;
-                *aux++ += (va >> 17) * (l + r);
-                vl += vlInc;
-                vr += vrInc;
-                va += vaInc;
-            } while (--frameCount);
-
-            t->prevVolume[0] = vl;
-            t->prevVolume[1] = vr;
-            t->prevAuxLevel = va;
-            t->adjustVolumeRamp(true);
-        }
+    // ramp gain
+    if (CC_UNLIKELY(t->volumeInc[0]|t->volumeInc[1]|(aux != NULL ? t->auxInc : 0))) {
+        // ALOGD("[1] %p: inc=%f, v0=%f, v1=%d, final=%f, count=%d",
+        //        t, t->volumeInc[0]/65536.0f, t->prevVolume[0]/65536.0f, t->volume[0],
+        //        (t->prevVolume[0] + t->volumeInc[0]*frameCount)/65536.0f, frameCount);
+        sKernels->stereo16Ramp(out, in, frameCount, t->prevVolume, t->volumeInc, aux,
+                &t->prevAuxLevel, t->auxInc);
+        t->adjustVolumeRamp(aux != NULL);
+    }
+    // constant gain
+    else {
+        sKernels->stereo16(out, in, frameCount, t->volume, aux, (int16_t)t->auxLevel);
+    }
+    t->in = in + frameCount * FCC_2;
+}
 
-        // constant gain
-        else {
-            const uint32_t vrl = t->volumeRL;
-            const int16_t va = (int16_t)t->auxLevel;
-            do {
-                uint32_t rl = *reinterpret_cast<const uint32_t *>(in);
-                int16_t a = (int16_t)(((int32_t)in[0] + in[1]) >> 1);
-                in += 2;
-                out[0] = mulAddRL(1, rl, vrl, out[0]);
-                out[1] = mulAddRL(0, rl, vrl, out[1]);
-                out += 2;
-                aux[0] = mulAdd(a, va, aux[0]);
-                aux++;
-            } while (--frameCount);
-        }
+void AudioMixer::track__16BitsMono(track_t* t, int32_t* out, size_t frameCount, int32_t* temp,
+        int32_t* aux)
+{
+    const int16_t *in = static_cast<int16_t const *>(t->in);
+
+    // ramp gain
+    if (CC_UNLIKELY(t->volumeInc[0]|t->volumeInc[1]|(aux != NULL ? t->auxInc : 0))) {
+        // ALOGD("[2] %p: inc=%f, v0=%f, v1=%d, final=%f, count=%d",
+        //         t, t->volumeInc[0]/65536.0f, t->prevVolume[0]/65536.0f, t->volume[0],
+        //         (t->prevVolume[0] + t->volumeInc[0]*frameCount)/65536.0f, frameCount);
+        sKernels->mono16Ramp(out, in, frameCount, t->prevVolume, t->volumeInc, aux,
+                &t->prevAuxLevel, t->auxInc);
+        t->adjustVolumeRamp(aux != NULL);
+    }
+    // constant gain
+    else {
+        sKernels->mono16(out, in, frameCount, t->volume, aux, (int16_t)t->auxLevel);
+    }
+    t->in = in + frameCount;
+}
+
+void AudioMixer::track__nopFloat(track_t* t, float* out, size_t outFrameCount, int32_t* temp,
+        int32_t* aux)
+{
+}
+
+template <int NCHAN, typename TI>
+void AudioMixer::volumeFloat(track_t* t, float* out, size_t frameCount, const TI* in,
+        int32_t* aux)
+{
+    if (CC_UNLIKELY(t->mVolumeInc[0] != 0 || t->mVolumeInc[1] != 0 ||
+            (aux != NULL && t->mAuxInc != 0))) {
+        volumeRampMulAdd<NCHAN>(out, in, frameCount, t->mPrevVolume, t->mVolumeInc,
+                aux, &t->mPrevAuxLevel, t->mAuxInc);
+        t->adjustVolumeRampFloat(aux != NULL);
     } else {
-        // ramp gain
-        if (CC_UNLIKELY(t->volumeInc[0]|t->volumeInc[1])) {
-            int32_t vl = t->prevVolume[0];
-            int32_t vr = t->prevVolume[1];
-            const int32_t vlInc = t->volumeInc[0];
-            const int32_t vrInc = t->volumeInc[1];
-
-            // ALOGD("[1] %p: inc=%f, v0=%f, v1=%d, final=%f, count=%d",
-            //        t, vlInc/65536.0f, vl/65536.0f, t->volume[0],
-            //        (vl + vlInc*frameCount)/65536.0f, frameCount);
-
-            do {
-                *out++ += (vl >> 16) * (int32_t) *in++;
-                *out++ += (vr >> 16) * (int32_t) *in++;
-                vl += vlInc;
-                vr += vrInc;
-            } while (--frameCount);
-
-            t->prevVolume[0] = vl;
-            t->prevVolume[1] = vr;
-            t->adjustVolumeRamp(false);
-        }
+        volumeMulAdd<NCHAN>(out, in, frameCount, t->mVolume, aux, t->mAuxLevel);
+    }
+}
 
-        // constant gain
-        else {
-            const uint32_t vrl = t->volumeRL;
-            do {
-                uint32_t rl = *reinterpret_cast<const uint32_t *>(in);
-                in += 2;
-                out[0] = mulAddRL(1, rl, vrl, out[0]);
-                out[1] = mulAddRL(0, rl, vrl, out[1]);
-                out += 2;
-            } while (--frameCount);
-        }
+void AudioMixer::track__genericResampleFloat(track_t* t, float* out, size_t outFrameCount,
+        int32_t* temp, int32_t* aux)
+{
+    t->resampler->setSampleRate(t->sampleRate);
+
+    // resample at unity gain to temp, in float if the resampler has float output
+    // or else in Q4.27, then apply the float volumes
+    t->resampler->setVolume(UNITY_GAIN, UNITY_GAIN);
+    memset(temp, 0, outFrameCount * FCC_2 * sizeof(int32_t));
+    if (t->resampler->hasFloatOutput()) {
+        float *tempFloat = reinterpret_cast<float *>(temp);
+        t->resampler->resampleFloat(tempFloat, outFrameCount, t->bufferProvider);
+        volumeResampled(t, out, outFrameCount, static_cast<const float *>(tempFloat), aux);
+    } else {
+        t->resampler->resample(temp, outFrameCount, t->bufferProvider);
+        volumeResampled(t, out, outFrameCount, static_cast<const int32_t *>(temp), aux);
     }
-    t->in = in;
 }
 
-void AudioMixer::track__16BitsMono(track_t* t, int32_t* out, size_t frameCount, int32_t* temp,
+template <typename TI>
+void AudioMixer::volumeResampled(track_t* t, float* out, size_t outFrameCount, const TI* in,
         int32_t* aux)
 {
-    const int16_t *in = static_cast<int16_t const *>(t->in);
+    switch (t->mMixerChannelMask) {
+    case AUDIO_CHANNEL_OUT_QUAD:
+        volumeMulti<AUDIO_CHANNEL_OUT_STEREO, AUDIO_CHANNEL_OUT_QUAD>(t, out, outFrameCount,
+                in, aux);
+        break;
+    case AUDIO_CHANNEL_OUT_5POINT1:
+        volumeMulti<AUDIO_CHANNEL_OUT_STEREO, AUDIO_CHANNEL_OUT_5POINT1>(t, out, outFrameCount,
+                in, aux);
+        break;
+    case AUDIO_CHANNEL_OUT_7POINT1:
+        volumeMulti<AUDIO_CHANNEL_OUT_STEREO, AUDIO_CHANNEL_OUT_7POINT1>(t, out, outFrameCount,
+                in, aux);
+        break;
+    default:
+        volumeFloat<FCC_2>(t, out, outFrameCount, in, aux);
+        break;
+    }
+}
 
-    if (CC_UNLIKELY(aux != NULL)) {
-        // ramp gain
-        if (CC_UNLIKELY(t->volumeInc[0]|t->volumeInc[1]|t->auxInc)) {
-            int32_t vl = t->prevVolume[0];
-            int32_t vr = t->prevVolume[1];
-            int32_t va = t->prevAuxLevel;
-            const int32_t vlInc = t->volumeInc[0];
-            const int32_t vrInc = t->volumeInc[1];
-            const int32_t vaInc = t->auxInc;
-
-            // ALOGD("[2] %p: inc=%f, v0=%f, v1=%d, final=%f, count=%d",
-            //         t, vlInc/65536.0f, vl/65536.0f, t->volume[0],
-            //         (vl + vlInc*frameCount)/65536.0f, frameCount);
-
-            do {
-                int32_t l = *in++;
-                *out++ += (vl >> 16) * l;
-                *out++ += (vr >> 16) * l;
-                *aux++ += (va >> 16) * l;
-                vl += vlInc;
-                vr += vrInc;
-                va += vaInc;
-            } while (--frameCount);
-
-            t->prevVolume[0] = vl;
-            t->prevVolume[1] = vr;
-            t->prevAuxLevel = va;
-            t->adjustVolumeRamp(true);
-        }
-        // constant gain
-        else {
-            const int16_t vl = t->volume[0];
-            const int16_t vr = t->volume[1];
-            const int16_t va = (int16_t)t->auxLevel;
-            do {
-                int16_t l = *in++;
-                out[0] = mulAdd(l, vl, out[0]);
-                out[1] = mulAdd(l, vr, out[1]);
-                out += 2;
-                aux[0] = mulAdd(l, va, aux[0]);
-                aux++;
-            } while (--frameCount);
-        }
+template <int NCHAN, typename TI>
+void AudioMixer::track__NoResampleFloat(track_t* t, float* out, size_t frameCount,
+        int32_t* temp, int32_t* aux)
+{
+    const TI *in = static_cast<const TI *>(t->in);
+    volumeFloat<NCHAN>(t, out, frameCount, in, aux);
+    t->in = in + frameCount * NCHAN;
+}
+
+template <uint32_t IN_MASK, uint32_t OUT_MASK, typename TI>
+void AudioMixer::volumeMulti(track_t* t, float* out, size_t frameCount, const TI* in,
+        int32_t* aux)
+{
+    if (CC_UNLIKELY(t->mVolumeInc[0] != 0 || t->mVolumeInc[1] != 0 ||
+            (aux != NULL && t->mAuxInc != 0))) {
+        channelMixRampMulAdd<IN_MASK, OUT_MASK>(out, in, frameCount, t->mPrevVolume,
+                t->mVolumeInc, aux, &t->mPrevAuxLevel, t->mAuxInc);
+        t->adjustVolumeRampFloat(aux != NULL);
     } else {
-        // ramp gain
-        if (CC_UNLIKELY(t->volumeInc[0]|t->volumeInc[1])) {
-            int32_t vl = t->prevVolume[0];
-            int32_t vr = t->prevVolume[1];
-            const int32_t vlInc = t->volumeInc[0];
-            const int32_t vrInc = t->volumeInc[1];
-
-            // ALOGD("[2] %p: inc=%f, v0=%f, v1=%d, final=%f, count=%d",
-            //         t, vlInc/65536.0f, vl/65536.0f, t->volume[0],
-            //         (vl + vlInc*frameCount)/65536.0f, frameCount);
-
-            do {
-                int32_t l = *in++;
-                *out++ += (vl >> 16) * l;
-                *out++ += (vr >> 16) * l;
-                vl += vlInc;
-                vr += vrInc;
-            } while (--frameCount);
-
-            t->prevVolume[0] = vl;
-            t->prevVolume[1] = vr;
-            t->adjustVolumeRamp(false);
+        channelMixMulAdd<IN_MASK, OUT_MASK>(out, in, frameCount, t->mVolume, aux, t->mAuxLevel);
+    }
+}
+
+template <uint32_t IN_MASK, uint32_t OUT_MASK, typename TI>
+void AudioMixer::track__NoResampleMulti(track_t* t, float* out, size_t frameCount,
+        int32_t* temp, int32_t* aux)
+{
+    const TI *in = static_cast<const TI *>(t->in);
+    volumeMulti<IN_MASK, OUT_MASK>(t, out, frameCount, in, aux);
+    t->in = in + frameCount * ChannelCount<IN_MASK>::value;
+}
+
+// Multichannel track hooks for an OUT_MASK mix, NULL if there is none for inMask.
+template <uint32_t OUT_MASK, typename TI>
+AudioMixer::hook_float_t AudioMixer::getTrackHookMulti(audio_channel_mask_t inMask)
+{
+    switch (inMask) {
+    case AUDIO_CHANNEL_OUT_MONO:
+        return track__NoResampleMulti<AUDIO_CHANNEL_OUT_MONO, OUT_MASK, TI>;
+    case AUDIO_CHANNEL_OUT_STEREO:
+        return track__NoResampleMulti<AUDIO_CHANNEL_OUT_STEREO, OUT_MASK, TI>;
+    case AUDIO_CHANNEL_OUT_QUAD:
+        return track__NoResampleMulti<AUDIO_CHANNEL_OUT_QUAD, OUT_MASK, TI>;
+    case AUDIO_CHANNEL_OUT_5POINT1:
+        return track__NoResampleMulti<AUDIO_CHANNEL_OUT_5POINT1, OUT_MASK, TI>;
+    case AUDIO_CHANNEL_OUT_7POINT1:
+        return track__NoResampleMulti<AUDIO_CHANNEL_OUT_7POINT1, OUT_MASK, TI>;
+    default:
+        return NULL;
+    }
+}
+
+template <typename TI>
+AudioMixer::hook_float_t AudioMixer::getTrackHookMulti(audio_channel_mask_t inMask,
+        audio_channel_mask_t outMask)
+{
+    switch (outMask) {
+    case AUDIO_CHANNEL_OUT_STEREO:
+        // only reached by multichannel tracks when the downmix effect is not available,
+        // mono and stereo tracks use the stereo hooks
+        switch (inMask) {
+        case AUDIO_CHANNEL_OUT_QUAD:
+            return track__NoResampleMulti<AUDIO_CHANNEL_OUT_QUAD, AUDIO_CHANNEL_OUT_STEREO, TI>;
+        case AUDIO_CHANNEL_OUT_5POINT1:
+            return track__NoResampleMulti<AUDIO_CHANNEL_OUT_5POINT1, AUDIO_CHANNEL_OUT_STEREO,
+                    TI>;
+        case AUDIO_CHANNEL_OUT_7POINT1:
+            return track__NoResampleMulti<AUDIO_CHANNEL_OUT_7POINT1, AUDIO_CHANNEL_OUT_STEREO,
+                    TI>;
+        default:
+            return NULL;
         }
-        // constant gain
-        else {
-            const int16_t vl = t->volume[0];
-            const int16_t vr = t->volume[1];
-            do {
-                int16_t l = *in++;
-                out[0] = mulAdd(l, vl, out[0]);
-                out[1] = mulAdd(l, vr, out[1]);
-                out += 2;
-            } while (--frameCount);
+    case AUDIO_CHANNEL_OUT_QUAD:
+        return getTrackHookMulti<AUDIO_CHANNEL_OUT_QUAD, TI>(inMask);
+    case AUDIO_CHANNEL_OUT_5POINT1:
+        return getTrackHookMulti<AUDIO_CHANNEL_OUT_5POINT1, TI>(inMask);
+    case AUDIO_CHANNEL_OUT_7POINT1:
+        return getTrackHookMulti<AUDIO_CHANNEL_OUT_7POINT1, TI>(inMask);
+    default:
+        return NULL;
+    }
+}
+
+AudioMixer::hook_float_t AudioMixer::getTrackHookFloat(const track_t& t)
+{
+    const uint32_t needs = t.needs;
+    if ((needs & NEEDS_RESAMPLE__MASK) == NEEDS_RESAMPLE_ENABLED) {
+        if (t.channelCount > FCC_2 && t.downmixerBufferProvider == NULL) {
+            ALOGE("cannot resample %u channels without a downmixer, muting", t.channelCount);
+            return track__nopFloat;
         }
+        return track__genericResampleFloat;
+    }
+
+    const audio_channel_mask_t inMask = t.mixerInChannelMask();
+    if (t.mMixerChannelCount != FCC_2 || popcount(inMask) > FCC_2) {
+        hook_float_t hook;
+        switch (needs & NEEDS_FORMAT__MASK) {
+        case NEEDS_FORMAT_FLOAT:
+            hook = getTrackHookMulti<float>(inMask, t.mMixerChannelMask);
+            break;
+        case NEEDS_FORMAT_24_PACKED:
+            hook = getTrackHookMulti<packed24_t>(inMask, t.mMixerChannelMask);
+            break;
+        case NEEDS_FORMAT_16:
+        default:
+            hook = getTrackHookMulti<int16_t>(inMask, t.mMixerChannelMask);
+            break;
+        }
+        ALOGE_IF(hook == NULL, "no track hook from channel mask %#x to %#x, muting",
+                inMask, t.mMixerChannelMask);
+        return hook != NULL ? hook : track__nopFloat;
+    }
+
+    // more than 2 channels have been downmixed to stereo
+    const bool mono = (needs & NEEDS_CHANNEL_COUNT__MASK) == NEEDS_CHANNEL_1;
+    switch (needs & NEEDS_FORMAT__MASK) {
+    case NEEDS_FORMAT_FLOAT:
+        return mono ? track__NoResampleFloat<1, float> : track__NoResampleFloat<2, float>;
+    case NEEDS_FORMAT_24_PACKED:
+        return mono ? track__NoResampleFloat<1, packed24_t> :
+                track__NoResampleFloat<2, packed24_t>;
+    case NEEDS_FORMAT_16:
+    default:
+        return mono ? track__NoResampleFloat<1, int16_t> : track__NoResampleFloat<2, int16_t>;
     }
-    t->in = in;
 }
 
 // no-op case
 void AudioMixer::process__nop(state_t* state, int64_t pts)
 {
     uint32_t e0 = state->enabledTracks;
-    size_t bufSize = state->frameCount * sizeof(int16_t) * MAX_NUM_CHANNELS;
     while (e0) {
         // process by group of tracks with same output buffer to
         // avoid multiple memset() on same buffer
@@ -1083,7 +1373,8 @@ void AudioMixer::process__nop(state_t* state, int64_t pts)
             }
             e0 &= ~(e1);
 
-            memset(t1.mainBuffer, 0, bufSize);
+            memset(t1.mainBuffer, 0, state->frameCount * t1.mMixerChannelCount *
+                    mixer_bytes_per_sample(t1.mMixerFormat));
         }
 
         while (e1) {
@@ -1109,7 +1400,7 @@ void AudioMixer::process__nop(state_t* state, int64_t pts)
 // generic code without resampling
 void AudioMixer::process__genericNoResampling(state_t* state, int64_t pts)
 {
-    int32_t outTemp[BLOCKSIZE * MAX_NUM_CHANNELS] __attribute__((aligned(32)));
+    int32_t outTemp[BLOCKSIZE * FCC_2] __attribute__((aligned(32)));
 
     // acquire each track's buffer
     uint32_t enabledTracks = state->enabledTracks;
@@ -1163,7 +1454,7 @@ void AudioMixer::process__genericNoResampling(state_t* state, int64_t pts)
                 while (outFrames) {
                     size_t inFrames = (t.frameCount > outFrames)?outFrames:t.frameCount;
                     if (inFrames) {
-                        t.hook(&t, outTemp + (BLOCKSIZE-outFrames)*MAX_NUM_CHANNELS, inFrames,
+                        t.hook(&t, outTemp + (BLOCKSIZE-outFrames)*FCC_2, inFrames,
                                 state->resampleTemp, aux);
                         t.frameCount -= inFrames;
                         outFrames -= inFrames;
@@ -1210,7 +1501,7 @@ void AudioMixer::process__genericResampling(state_t* state, int64_t pts)
 {
     // this const just means that local variable outTemp doesn't change
     int32_t* const outTemp = state->outputTemp;
-    const size_t size = sizeof(int32_t) * MAX_NUM_CHANNELS * state->frameCount;
+    const size_t size = sizeof(int32_t) * FCC_2 * state->frameCount;
 
     size_t numFrames = state->frameCount;
 
@@ -1264,7 +1555,7 @@ void AudioMixer::process__genericResampling(state_t* state, int64_t pts)
                     if (CC_UNLIKELY(aux != NULL)) {
                         aux += outFrames;
                     }
-                    t.hook(&t, outTemp + outFrames*MAX_NUM_CHANNELS, t.buffer.frameCount,
+                    t.hook(&t, outTemp + outFrames*FCC_2, t.buffer.frameCount,
                             state->resampleTemp, aux);
                     outFrames += t.buffer.frameCount;
                     t.bufferProvider->releaseBuffer(&t.buffer);
@@ -1275,6 +1566,69 @@ void AudioMixer::process__genericResampling(state_t* state, int64_t pts)
     }
 }
 
+// generic code for the float path, with or without resampling: tracks are mixed in float
+// and clamped only once when writing to each output buffer in its own format
+void AudioMixer::process__genericFloat(state_t* state, int64_t pts)
+{
+    float* const outTemp = state->mixTemp;
+    const size_t numFrames = state->frameCount;
+
+    uint32_t e0 = state->enabledTracks;
+    while (e0) {
+        // process by group of tracks with same output buffer
+        // to optimize cache use
+        uint32_t e1 = e0, e2 = e0;
+        int j = 31 - __builtin_clz(e1);
+        track_t& t1 = state->tracks[j];
+        e2 &= ~(1<<j);
+        while (e2) {
+            j = 31 - __builtin_clz(e2);
+            e2 &= ~(1<<j);
+            track_t& t2 = state->tracks[j];
+            if (CC_UNLIKELY(t2.mainBuffer != t1.mainBuffer)) {
+                e1 &= ~(1<<j);
+            }
+        }
+        e0 &= ~(e1);
+        // all tracks of a group share the channel count of their output buffer
+        const size_t channelCount = t1.mMixerChannelCount;
+        memset(outTemp, 0, sizeof(float) * channelCount * numFrames);
+        while (e1) {
+            const int i = 31 - __builtin_clz(e1);
+            e1 &= ~(1<<i);
+            track_t& t = state->tracks[i];
+            int32_t *aux = NULL;
+            if (CC_UNLIKELY((t.needs & NEEDS_AUX__MASK) == NEEDS_AUX_ENABLED)) {
+                aux = t.auxBuffer;
+            }
+
+            if ((t.needs & NEEDS_RESAMPLE__MASK) == NEEDS_RESAMPLE_ENABLED) {
+                // the resampler acquires and releases the buffers itself
+                t.resampler->setPTS(pts);
+                t.mHookFloat(&t, outTemp, numFrames, state->resampleTemp, aux);
+            } else {
+                size_t outFrames = 0;
+                while (outFrames < numFrames) {
+                    t.buffer.frameCount = numFrames - outFrames;
+                    int64_t outputPTS = calculateOutputPTS(t, pts, outFrames);
+                    t.bufferProvider->getNextBuffer(&t.buffer, outputPTS);
+                    t.in = t.buffer.raw;
+                    // t.in == NULL can happen if the track was flushed just after having
+                    // been enabled for mixing.
+                    if (t.in == NULL) break;
+
+                    t.mHookFloat(&t, outTemp + outFrames*channelCount, t.buffer.frameCount,
+                            state->resampleTemp, aux != NULL ? aux + outFrames : NULL);
+                    outFrames += t.buffer.frameCount;
+                    t.bufferProvider->releaseBuffer(&t.buffer);
+                }
+            }
+        }
+        memcpy_to_mixer_format_from_float(t1.mainBuffer, t1.mMixerFormat, outTemp,
+                numFrames * channelCount);
+    }
+}
+
 // one track, 16 bits stereo without resampling is the most common case
 void AudioMixer::process__OneTrack16BitsStereoNoResampling(state_t* state,
                                                            int64_t pts)
@@ -1292,9 +1646,6 @@ void AudioMixer::process__OneTrack16BitsStereoNoResampling(state_t* state,
     int32_t* out = t.mainBuffer;
     size_t numFrames = state->frameCount;
 
-    const int16_t vl = t.volume[0];
-    const int16_t vr = t.volume[1];
-    const uint32_t vrl = t.volumeRL;
     while (numFrames) {
         b.frameCount = numFrames;
         int64_t outputPTS = calculateOutputPTS(t, pts, out - t.mainBuffer);
@@ -1304,7 +1655,7 @@ void AudioMixer::process__OneTrack16BitsStereoNoResampling(state_t* state,
         // in == NULL can happen if the track was flushed just after having
         // been enabled for mixing.
         if (in == NULL || ((unsigned long)in & 3)) {
-            memset(out, 0, numFrames*MAX_NUM_CHANNELS*sizeof(int16_t));
+            memset(out, 0, numFrames*FCC_2*sizeof(int16_t));
             ALOGE_IF(((unsigned long)in & 3), "process stereo track: input buffer alignment pb: "
                                               "buffer %p track %d, channels %d, needs %08x",
                     in, i, t.channelCount, t.needs);
@@ -1312,28 +1663,10 @@ void AudioMixer::process__OneTrack16BitsStereoNoResampling(state_t* state,
         }
         size_t outFrames = b.frameCount;
 
-        if (CC_UNLIKELY(uint32_t(vl) > UNITY_GAIN || uint32_t(vr) > UNITY_GAIN)) {
-            // volume is boosted, so we might need to clamp even though
-            // we process only one track.
-            do {
-                uint32_t rl = *reinterpret_cast<const uint32_t *>(in);
-                in += 2;
-                int32_t l = mulRL(1, rl, vrl) >> 12;
-                int32_t r = mulRL(0, rl, vrl) >> 12;
-                // clamping...
-                l = clamp16(l);
-                r = clamp16(r);
-                *out++ = (r<<16) | (l & 0xFFFF);
-            } while (--outFrames);
-        } else {
-            do {
-                uint32_t rl = *reinterpret_cast<const uint32_t *>(in);
-                in += 2;
-                int32_t l = mulRL(1, rl, vrl) >> 12;
-                int32_t r = mulRL(0, rl, vrl) >> 12;
-                *out++ = (r<<16) | (l & 0xFFFF);
-            } while (--outFrames);
-        }
+        // the kernel clamps, which is only needed when the volume is boosted; without boost
+        // the clamp never triggers and the result is the same
+        sKernels->stereo16To16(reinterpret_cast<int16_t *>(out), in, outFrames, t.volume);
+        out += outFrames;
         numFrames -= b.frameCount;
         t.bufferProvider->releaseBuffer(&b);
     }
@@ -1383,7 +1716,7 @@ void AudioMixer::process__TwoTracks16BitsStereoNoResampling(state_t* state,
             t0.bufferProvider->getNextBuffer(&b0, outputPTS);
             if (b0.i16 == NULL) {
                 if (buff == NULL) {
-                    buff = new int16_t[MAX_NUM_CHANNELS * state->frameCount];
+                    buff = new int16_t[FCC_2 * state->frameCount];
                 }
                 in0 = buff;
                 b0.frameCount = numFrames;
@@ -1399,7 +1732,7 @@ void AudioMixer::process__TwoTracks16BitsStereoNoResampling(state_t* state,
             t1.bufferProvider->getNextBuffer(&b1, outputPTS);
             if (b1.i16 == NULL) {
                 if (buff == NULL) {
-                    buff = new int16_t[MAX_NUM_CHANNELS * state->frameCount];
+                    buff = new int16_t[FCC_2 * state->frameCount];
                 }
                 in1 = buff;
                 b1.frameCount = numFrames;
@@ -1452,12 +1785,16 @@ int64_t AudioMixer::calculateOutputPTS(const track_t& t, int64_t basePTS,
 }
 
 /*static*/ uint64_t AudioMixer::sLocalTimeFreq;
+/*static*/ const MixerKernels* AudioMixer::sKernels;
 /*static*/ pthread_once_t AudioMixer::sOnceControl = PTHREAD_ONCE_INIT;
 
 /*static*/ void AudioMixer::sInitRoutine()
 {
     LocalClock lc;
     sLocalTimeFreq = lc.getLocalFreq();
+
+    sKernels = MixerKernels::getKernels();
+    ALOGV("mixer kernels %s", sKernels->name);
 }
 
 // ----------------------------------------------------------------------------
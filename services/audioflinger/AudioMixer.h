@@ -34,6 +34,8 @@ namespace android {
 
 // ----------------------------------------------------------------------------
 
+struct MixerKernels;
+
 class AudioMixer
 {
 public:
@@ -48,10 +50,13 @@ public:
     static const uint32_t MAX_NUM_TRACKS = 32;
     // maximum number of channels supported by the mixer
 
-    // This mixer has a hard-coded upper limit of 2 channels for output.
-    // There is support for > 2 channel tracks down-mixed to 2 channel output via a down-mix effect.
-    // Adding support for > 2 channel output would require more than simply changing this value.
-    static const uint32_t MAX_NUM_CHANNELS = 2;
+    // The legacy 16-bit path mixes to 2 channels only.  The float path mixes to up to
+    // MAX_NUM_CHANNELS output channels, see MIXER_CHANNEL_MASK, folding each track to the
+    // channel layout of the mix.  The down-mix effect is still used for > 2 channel tracks in a
+    // stereo mix and for resampled tracks, as the resampler is stereo only.
+    static const uint32_t MAX_NUM_CHANNELS = 8;
+    // number of independent volumes per track: left and right, see VOLUME0 and VOLUME1
+    static const uint32_t MAX_NUM_VOLUMES = 2;
     // maximum number of channels supported for the content
     static const uint32_t MAX_NUM_CHANNELS_TO_DOWNMIX = 8;
 
@@ -77,6 +82,13 @@ public:
         MAIN_BUFFER     = 0x4002,
         AUX_BUFFER      = 0x4003,
         DOWNMIX_TYPE    = 0X4004,
+        MIXER_FORMAT    = 0x4005, // AUDIO_FORMAT_PCM_16_BIT (default), AUDIO_FORMAT_PCM_FLOAT or
+                                  // AUDIO_FORMAT_PCM_24_BIT_PACKED: format of MAIN_BUFFER.
+                                  // Any track that is not 16-bit in and out switches the whole
+                                  // mixer to float mixing.
+        MIXER_CHANNEL_MASK = 0x4006, // Channel mask of MAIN_BUFFER, AUDIO_CHANNEL_OUT_STEREO
+                                  // (default), QUAD, 5POINT1 or 7POINT1.  Anything but stereo
+                                  // switches the whole mixer to float mixing.
         // for target RESAMPLE
         SAMPLE_RATE     = 0x4100, // Configure sample rate conversion on this track name;
                                   // parameter 'value' is the new sample rate in Hz.
@@ -132,6 +144,8 @@ private:
         NEEDS_CHANNEL_2             = 0x00000001,
 
         NEEDS_FORMAT_16             = 0x00000010,
+        NEEDS_FORMAT_FLOAT          = 0x00000020,
+        NEEDS_FORMAT_24_PACKED      = 0x00000030,
 
         NEEDS_MUTE_DISABLED         = 0x00000000,
         NEEDS_MUTE_ENABLED          = 0x00000100,
@@ -146,24 +160,29 @@ private:
     struct state_t;
     struct track_t;
     class DownmixerBufferProvider;
+    class ReformatBufferProvider;
 
     typedef void (*hook_t)(track_t* t, int32_t* output, size_t numOutFrames, int32_t* temp,
                            int32_t* aux);
+    // float mixing path, output is float with t->mMixerChannelCount channels,
+    // aux is Q4.27 like for hook_t
+    typedef void (*hook_float_t)(track_t* t, float* output, size_t numOutFrames, int32_t* temp,
+                                 int32_t* aux);
     static const int BLOCKSIZE = 16; // 4 cache lines
 
     struct track_t {
         uint32_t    needs;
 
         union {
-        int16_t     volume[MAX_NUM_CHANNELS]; // [0]3.12 fixed point
+        int16_t     volume[MAX_NUM_VOLUMES]; // [0]3.12 fixed point
         int32_t     volumeRL;
         };
 
-        int32_t     prevVolume[MAX_NUM_CHANNELS];
+        int32_t     prevVolume[MAX_NUM_VOLUMES];
 
         // 16-byte boundary
 
-        int32_t     volumeInc[MAX_NUM_CHANNELS];
+        int32_t     volumeInc[MAX_NUM_VOLUMES];
         int32_t     auxInc;
         int32_t     prevAuxLevel;
 
@@ -201,14 +220,49 @@ private:
 
         int32_t     sessionId;
 
-        int32_t     padding[2];
+        // the buffer provider set with setBufferProvider(), at the head of the chain that
+        // ends in bufferProvider; see reconfigureBufferProviders()
+        AudioBufferProvider*    mInputBufferProvider;
+        // converts the input to 16-bit for the downmixer and the resampler, or NULL
+        ReformatBufferProvider* mReformatBufferProvider;
+
+        // 16-byte boundary
+
+        // float mixing path only, the integer fields above still drive the legacy path
+        hook_float_t    mHookFloat;
+        audio_format_t  mFormat;        // track input format
+        audio_format_t  mMixerFormat;   // format of mainBuffer
+        float       mAuxLevel;
+
+        // 16-byte boundary
+
+        float       mVolume[MAX_NUM_VOLUMES];
+        float       mPrevVolume[MAX_NUM_VOLUMES];
 
         // 16-byte boundary
 
+        float       mVolumeInc[MAX_NUM_VOLUMES];
+        float       mPrevAuxLevel;
+        float       mAuxInc;
+
+        // 16-byte boundary
+
+        audio_channel_mask_t mMixerChannelMask;     // channel mask of mainBuffer
+        uint32_t    mMixerChannelCount;             // 2 to MAX_NUM_CHANNELS
+
         bool        setResampler(uint32_t sampleRate, uint32_t devSampleRate);
         bool        doesResample() const { return resampler != NULL; }
         void        resetResampler() { if (resampler != NULL) resampler->reset(); }
         void        adjustVolumeRamp(bool aux);
+        void        adjustVolumeRampFloat(bool aux);
+        // format of the samples seen by the non-resampling track hooks
+        audio_format_t  mixerInFormat() const {
+                            return mReformatBufferProvider != NULL ?
+                                    AUDIO_FORMAT_PCM_16_BIT : mFormat; }
+        // channel mask of the samples seen by the non-resampling track hooks
+        audio_channel_mask_t mixerInChannelMask() const {
+                            return downmixerBufferProvider != NULL ?
+                                    AUDIO_CHANNEL_OUT_STEREO : channelMask; }
         size_t      getUnreleasedFrames() const { return resampler != NULL ?
                                                     resampler->getUnreleasedFrames() : 0; };
     };
@@ -222,7 +276,7 @@ private:
         int32_t         *outputTemp;
         int32_t         *resampleTemp;
         NBLog::Writer*  mLog;
-        int32_t         reserved[1];
+        float           *mixTemp;       // float mixing only
         // FIXME allocate dynamically to save some memory when maxNumTracks < MAX_NUM_TRACKS
         track_t         tracks[MAX_NUM_TRACKS]; __attribute__((aligned(32)));
     };
@@ -240,6 +294,24 @@ private:
         effect_config_t    mDownmixConfig;
     };
 
+    // AudioBufferProvider that converts the samples of a track AudioBufferProvider to 16-bit,
+    // for the downmix effect and the resampler which only handle 16-bit.
+    class ReformatBufferProvider : public AudioBufferProvider {
+    public:
+        virtual status_t getNextBuffer(Buffer* buffer, int64_t pts);
+        virtual void releaseBuffer(Buffer* buffer);
+        ReformatBufferProvider(audio_format_t format, uint32_t channelCount);
+        virtual ~ReformatBufferProvider();
+
+        AudioBufferProvider* mTrackBufferProvider;
+        const audio_format_t mFormat;
+        const uint32_t       mChannelCount;
+    private:
+        Buffer               mBuffer;       // as obtained from mTrackBufferProvider
+        int16_t*             mConverted;
+        size_t               mConvertedFrameCount;
+    };
+
     // bitmask of allocated track names, where bit 0 corresponds to TRACK0 etc.
     uint32_t        mTrackNames;
 
@@ -265,8 +337,11 @@ private:
     void invalidateState(uint32_t mask);
 
     static status_t initTrackDownmix(track_t* pTrack, int trackNum, audio_channel_mask_t mask);
+    static bool needsDownmix(const track_t* pTrack, audio_channel_mask_t mask);
     static status_t prepareTrackForDownmix(track_t* pTrack, int trackNum);
     static void unprepareTrackForDownmix(track_t* pTrack, int trackName);
+    static void prepareTrackForReformat(track_t* pTrack, int trackName);
+    static void reconfigureBufferProviders(track_t* pTrack);
 
     static void track__genericResample(track_t* t, int32_t* out, size_t numFrames, int32_t* temp,
             int32_t* aux);
@@ -280,12 +355,41 @@ private:
     static void volumeStereo(track_t* t, int32_t* out, size_t frameCount, int32_t* temp,
             int32_t* aux);
 
+    static void track__genericResampleFloat(track_t* t, float* out, size_t numFrames,
+            int32_t* temp, int32_t* aux);
+    static void track__nopFloat(track_t* t, float* out, size_t numFrames, int32_t* temp,
+            int32_t* aux);
+    template <int NCHAN, typename TI>
+    static void track__NoResampleFloat(track_t* t, float* out, size_t numFrames, int32_t* temp,
+            int32_t* aux);
+    template <int NCHAN, typename TI>
+    static void volumeFloat(track_t* t, float* out, size_t frameCount, const TI* in,
+            int32_t* aux);
+    template <uint32_t IN_MASK, uint32_t OUT_MASK, typename TI>
+    static void track__NoResampleMulti(track_t* t, float* out, size_t numFrames, int32_t* temp,
+            int32_t* aux);
+    template <uint32_t IN_MASK, uint32_t OUT_MASK, typename TI>
+    static void volumeMulti(track_t* t, float* out, size_t frameCount, const TI* in,
+            int32_t* aux);
+    // applies the track volume to the stereo output of the resampler
+    template <typename TI>
+    static void volumeResampled(track_t* t, float* out, size_t frameCount, const TI* in,
+            int32_t* aux);
+    template <uint32_t OUT_MASK, typename TI>
+    static hook_float_t getTrackHookMulti(audio_channel_mask_t inMask);
+    template <typename TI>
+    static hook_float_t getTrackHookMulti(audio_channel_mask_t inMask,
+            audio_channel_mask_t outMask);
+    static hook_float_t getTrackHookFloat(const track_t& t);
+    static bool isMultichannelMixerMask(audio_channel_mask_t mask);
+
     static void process__validate(state_t* state, int64_t pts);
     static void process__nop(state_t* state, int64_t pts);
     static void process__genericNoResampling(state_t* state, int64_t pts);
     static void process__genericResampling(state_t* state, int64_t pts);
     static void process__OneTrack16BitsStereoNoResampling(state_t* state,
                                                           int64_t pts);
+    static void process__genericFloat(state_t* state, int64_t pts);
 #if 0
     static void process__TwoTracks16BitsStereoNoResampling(state_t* state,
                                                            int64_t pts);
@@ -295,6 +399,7 @@ private:
                                       int outputFrameIndex);
 
     static uint64_t         sLocalTimeFreq;
+    static const MixerKernels* sKernels;    // inner loops of the 16-bit hooks, for this CPU
     static pthread_once_t   sOnceControl;
     static void             sInitRoutine();
 };
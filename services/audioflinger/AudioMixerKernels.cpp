@@ -0,0 +1,1004 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "AudioMixerKernels"
+//#define LOG_NDEBUG 0
+
+#include <stdint.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+#include <audio_utils/primitives.h>
+
+#include "AudioMixerKernels.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#include <emmintrin.h>
+#define MIXER_KERNELS_SSE2 1
+// AVX2 intrinsics can be compiled into a file built for a lesser target from gcc 4.9 and
+// clang 3.8 on; the kernels are only called after checking the CPU at runtime
+#if defined(__AVX2__) || (defined(__clang__) && \
+        (__clang_major__ > 3 || (__clang_major__ == 3 && __clang_minor__ >= 8))) || \
+        (!defined(__clang__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#include <immintrin.h>
+#define MIXER_KERNELS_AVX2 1
+#endif
+#endif
+
+// NEON is a build time choice on ARM, as for the resampler
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#define MIXER_KERNELS_NEON 1
+#endif
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+// Scalar reference, these are the loops of the original track hooks.  The SIMD versions
+// use them for the frames left over after their last full vector.
+
+static void stereo16_c(int32_t* out, const int16_t* in, size_t frameCount,
+        const int16_t* vol, int32_t* aux, int16_t va)
+{
+    const uint32_t vrl = (uint16_t) vol[0] | ((uint32_t) (uint16_t) vol[1] << 16);
+    if (aux != NULL) {
+        for (size_t i = 0; i < frameCount; ++i) {
+            uint32_t rl = *reinterpret_cast<const uint32_t *>(in);
+            int16_t a = (int16_t)(((int32_t)in[0] + in[1]) >> 1);
+            in += 2;
+            out[0] = mulAddRL(1, rl, vrl, out[0]);
+            out[1] = mulAddRL(0, rl, vrl, out[1]);
+            out += 2;
+            aux[0] = mulAdd(a, va, aux[0]);
+            aux++;
+        }
+    } else {
+        for (size_t i = 0; i < frameCount; ++i) {
+            uint32_t rl = *reinterpret_cast<const uint32_t *>(in);
+            in += 2;
+            out[0] = mulAddRL(1, rl, vrl, out[0]);
+            out[1] = mulAddRL(0, rl, vrl, out[1]);
+            out += 2;
+        }
+    }
+}
+
+static void mono16_c(int32_t* out, const int16_t* in, size_t frameCount,
+        const int16_t* vol, int32_t* aux, int16_t va)
+{
+    const int16_t vl = vol[0];
+    const int16_t vr = vol[1];
+    if (aux != NULL) {
+        for (size_t i = 0; i < frameCount; ++i) {
+            int16_t l = *in++;
+            out[0] = mulAdd(l, vl, out[0]);
+            out[1] = mulAdd(l, vr, out[1]);
+            out += 2;
+            aux[0] = mulAdd(l, va, aux[0]);
+            aux++;
+        }
+    } else {
+        for (size_t i = 0; i < frameCount; ++i) {
+            int16_t l = *in++;
+            out[0] = mulAdd(l, vl, out[0]);
+            out[1] = mulAdd(l, vr, out[1]);
+            out += 2;
+        }
+    }
+}
+
+static void stereo16Ramp_c(int32_t* out, const int16_t* in, size_t frameCount,
+        int32_t* vol, const int32_t* volInc, int32_t* aux, int32_t* va, int32_t vaInc)
+{
+    int32_t vl = vol[0];
+    int32_t vr = vol[1];
+    const int32_t vlInc = volInc[0];
+    const int32_t vrInc = volInc[1];
+    if (aux != NULL) {
+        int32_t a = *va;
+        for (size_t i = 0; i < frameCount; ++i) {
+            int32_t l = *in++;
+            int32_t r = *in++;
+            *out++ += (vl >> 16) * l;
+            *out++ += (vr >> 16) * r;
+            *aux++ += (a >> 17) * (l + r);
+            vl += vlInc;
+            vr += vrInc;
+            a += vaInc;
+        }
+        *va = a;
+    } else {
+        for (size_t i = 0; i < frameCount; ++i) {
+            *out++ += (vl >> 16) * (int32_t) *in++;
+            *out++ += (vr >> 16) * (int32_t) *in++;
+            vl += vlInc;
+            vr += vrInc;
+        }
+    }
+    vol[0] = vl;
+    vol[1] = vr;
+}
+
+static void mono16Ramp_c(int32_t* out, const int16_t* in, size_t frameCount,
+        int32_t* vol, const int32_t* volInc, int32_t* aux, int32_t* va, int32_t vaInc)
+{
+    int32_t vl = vol[0];
+    int32_t vr = vol[1];
+    const int32_t vlInc = volInc[0];
+    const int32_t vrInc = volInc[1];
+    if (aux != NULL) {
+        int32_t a = *va;
+        for (size_t i = 0; i < frameCount; ++i) {
+            int32_t l = *in++;
+            *out++ += (vl >> 16) * l;
+            *out++ += (vr >> 16) * l;
+            *aux++ += (a >> 16) * l;
+            vl += vlInc;
+            vr += vrInc;
+            a += vaInc;
+        }
+        *va = a;
+    } else {
+        for (size_t i = 0; i < frameCount; ++i) {
+            int32_t l = *in++;
+            *out++ += (vl >> 16) * l;
+            *out++ += (vr >> 16) * l;
+            vl += vlInc;
+            vr += vrInc;
+        }
+    }
+    vol[0] = vl;
+    vol[1] = vr;
+}
+
+static void stereo32_c(int32_t* out, const int32_t* in, size_t frameCount,
+        const int16_t* vol, int32_t* aux, int16_t va)
+{
+    const int16_t vl = vol[0];
+    const int16_t vr = vol[1];
+    if (aux != NULL) {
+        for (size_t i = 0; i < frameCount; ++i) {
+            int16_t l = (int16_t)(*in++ >> 12);
+            int16_t r = (int16_t)(*in++ >> 12);
+            out[0] = mulAdd(l, vl, out[0]);
+            int16_t a = (int16_t)(((int32_t)l + r) >> 1);
+            out[1] = mulAdd(r, vr, out[1]);
+            out += 2;
+            aux[0] = mulAdd(a, va, aux[0]);
+            aux++;
+        }
+    } else {
+        for (size_t i = 0; i < frameCount; ++i) {
+            int16_t l = (int16_t)(*in++ >> 12);
+            int16_t r = (int16_t)(*in++ >> 12);
+            out[0] = mulAdd(l, vl, out[0]);
+            out[1] = mulAdd(r, vr, out[1]);
+            out += 2;
+        }
+    }
+}
+
+static void stereo32Ramp_c(int32_t* out, const int32_t* in, size_t frameCount,
+        int32_t* vol, const int32_t* volInc, int32_t* aux, int32_t* va, int32_t vaInc)
+{
+    int32_t vl = vol[0];
+    int32_t vr = vol[1];
+    const int32_t vlInc = volInc[0];
+    const int32_t vrInc = volInc[1];
+    if (aux != NULL) {
+        int32_t a = *va;
+        for (size_t i = 0; i < frameCount; ++i) {
+            int32_t l = *in++ >> 12;
+            int32_t r = *in++ >> 12;
+            *out++ += (vl >> 16) * l;
+            *out++ += (vr >> 16) * r;
+            *aux++ += (a >> 17) * (l + r);
+            vl += vlInc;
+            vr += vrInc;
+            a += vaInc;
+        }
+        *va = a;
+    } else {
+        for (size_t i = 0; i < frameCount; ++i) {
+            *out++ += (vl >> 16) * (*in++ >> 12);
+            *out++ += (vr >> 16) * (*in++ >> 12);
+            vl += vlInc;
+            vr += vrInc;
+        }
+    }
+    vol[0] = vl;
+    vol[1] = vr;
+}
+
+static void stereo16To16_c(int16_t* out, const int16_t* in, size_t frameCount,
+        const int16_t* vol)
+{
+    const uint32_t vrl = (uint16_t) vol[0] | ((uint32_t) (uint16_t) vol[1] << 16);
+    for (size_t i = 0; i < frameCount; ++i) {
+        uint32_t rl = *reinterpret_cast<const uint32_t *>(in);
+        in += 2;
+        *out++ = clamp16(mulRL(1, rl, vrl) >> 12);
+        *out++ = clamp16(mulRL(0, rl, vrl) >> 12);
+    }
+}
+
+static const MixerKernels sKernelsScalar = {
+    "scalar",
+    stereo16_c,
+    mono16_c,
+    stereo16Ramp_c,
+    mono16Ramp_c,
+    stereo32_c,
+    stereo32Ramp_c,
+    stereo16To16_c,
+};
+
+// Value reached by a ramp after frameCount increments, with the wrap around of the
+// scalar loops but without relying on signed overflow.
+static inline int32_t rampEnd(int32_t v, int32_t inc, size_t frameCount)
+{
+    return (int32_t) ((uint32_t) v + (uint32_t) inc * (uint32_t) frameCount);
+}
+
+#ifdef MIXER_KERNELS_SSE2
+// ----------------------------------------------------------------------------
+// SSE2, 4 frames per iteration.
+
+// low 32 bits of a 32 x 32 bit product, SSE2 lacks pmulld
+static inline __m128i mullo32_sse2(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// out[0..3] += x[0..3] * v[0..3], out[4..7] += x[4..7] * v[4..7] with 16-bit x and v
+static inline void mulAdd16_sse2(int32_t* out, __m128i x, __m128i v)
+{
+    __m128i lo = _mm_mullo_epi16(x, v);
+    __m128i hi = _mm_mulhi_epi16(x, v);
+    __m128i* o = reinterpret_cast<__m128i*>(out);
+    _mm_storeu_si128(o, _mm_add_epi32(_mm_loadu_si128(o), _mm_unpacklo_epi16(lo, hi)));
+    _mm_storeu_si128(o + 1, _mm_add_epi32(_mm_loadu_si128(o + 1), _mm_unpackhi_epi16(lo, hi)));
+}
+
+// sign extends the low or high 4 samples of x to 32 bits
+static inline __m128i lo16to32_sse2(__m128i x)
+{
+    return _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+}
+
+static inline __m128i hi16to32_sse2(__m128i x)
+{
+    return _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+}
+
+// interleaved left and right volumes, or the ramp increments, of two frames
+static inline __m128i pair32_sse2(int32_t l, int32_t r)
+{
+    return _mm_set_epi32(r, l, r, l);
+}
+
+static inline void add32_sse2(int32_t* out, __m128i x)
+{
+    __m128i* o = reinterpret_cast<__m128i*>(out);
+    _mm_storeu_si128(o, _mm_add_epi32(_mm_loadu_si128(o), x));
+}
+
+static void stereo16_sse2(int32_t* out, const int16_t* in, size_t frameCount,
+        const int16_t* vol, int32_t* aux, int16_t va)
+{
+    const __m128i v = _mm_set1_epi32((uint16_t) vol[0] | ((uint32_t) (uint16_t) vol[1] << 16));
+    const __m128i ones = _mm_set1_epi16(1);
+    // pmaddwd of a 16-bit value in a 32-bit lane with (va, 0) is a 16 x 16 bit product
+    const __m128i va32 = _mm_set1_epi32((uint16_t) va);
+    const size_t n = frameCount & ~3;
+    for (size_t i = 0; i < n; i += 4) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+        mulAdd16_sse2(out + 2 * i, x, v);
+        if (aux != NULL) {
+            __m128i a = _mm_srai_epi32(_mm_madd_epi16(x, ones), 1);
+            add32_sse2(aux + i, _mm_madd_epi16(a, va32));
+        }
+    }
+    stereo16_c(out + 2 * n, in + 2 * n, frameCount - n, vol, aux != NULL ? aux + n : NULL, va);
+}
+
+static void mono16_sse2(int32_t* out, const int16_t* in, size_t frameCount,
+        const int16_t* vol, int32_t* aux, int16_t va)
+{
+    const __m128i v = _mm_set1_epi32((uint16_t) vol[0] | ((uint32_t) (uint16_t) vol[1] << 16));
+    const __m128i va16 = _mm_set1_epi16(va);
+    const size_t n = frameCount & ~7;
+    for (size_t i = 0; i < n; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        mulAdd16_sse2(out + 2 * i, _mm_unpacklo_epi16(x, x), v);
+        mulAdd16_sse2(out + 2 * i + 8, _mm_unpackhi_epi16(x, x), v);
+        if (aux != NULL) {
+            mulAdd16_sse2(aux + i, x, va16);
+        }
+    }
+    mono16_c(out + 2 * n, in + n, frameCount - n, vol, aux != NULL ? aux + n : NULL, va);
+}
+
+static void stereo16Ramp_sse2(int32_t* out, const int16_t* in, size_t frameCount,
+        int32_t* vol, const int32_t* volInc, int32_t* aux, int32_t* va, int32_t vaInc)
+{
+    const size_t n = frameCount & ~3;
+    if (n != 0) {
+        // volumes of frames 0 and 1, then 2 and 3
+        const __m128i inc = pair32_sse2(volInc[0], volInc[1]);
+        const __m128i inc2 = _mm_add_epi32(inc, inc);
+        const __m128i inc4 = _mm_add_epi32(inc2, inc2);
+        __m128i v0 = _mm_add_epi32(pair32_sse2(vol[0], vol[1]),
+                _mm_unpackhi_epi64(_mm_setzero_si128(), inc));
+        __m128i v1 = _mm_add_epi32(v0, inc2);
+        // aux volumes of frames 0 to 3
+        const __m128i ones = _mm_set1_epi16(1);
+        const __m128i incA = _mm_set1_epi32(vaInc * 4);
+        __m128i a = _mm_add_epi32(_mm_set1_epi32(aux != NULL ? *va : 0),
+                mullo32_sse2(_mm_set1_epi32(vaInc), _mm_set_epi32(3, 2, 1, 0)));
+        for (size_t i = 0; i < n; i += 4) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+            add32_sse2(out + 2 * i, mullo32_sse2(_mm_srai_epi32(v0, 16), lo16to32_sse2(x)));
+            add32_sse2(out + 2 * i + 4, mullo32_sse2(_mm_srai_epi32(v1, 16), hi16to32_sse2(x)));
+            v0 = _mm_add_epi32(v0, inc4);
+            v1 = _mm_add_epi32(v1, inc4);
+            if (aux != NULL) {
+                add32_sse2(aux + i, mullo32_sse2(_mm_srai_epi32(a, 17), _mm_madd_epi16(x, ones)));
+                a = _mm_add_epi32(a, incA);
+            }
+        }
+        vol[0] = rampEnd(vol[0], volInc[0], n);
+        vol[1] = rampEnd(vol[1], volInc[1], n);
+        if (aux != NULL) {
+            *va = rampEnd(*va, vaInc, n);
+        }
+    }
+    stereo16Ramp_c(out + 2 * n, in + 2 * n, frameCount - n, vol, volInc,
+            aux != NULL ? aux + n : NULL, va, vaInc);
+}
+
+static void mono16Ramp_sse2(int32_t* out, const int16_t* in, size_t frameCount,
+        int32_t* vol, const int32_t* volInc, int32_t* aux, int32_t* va, int32_t vaInc)
+{
+    const size_t n = frameCount & ~3;
+    if (n != 0) {
+        const __m128i inc = pair32_sse2(volInc[0], volInc[1]);
+        const __m128i inc2 = _mm_add_epi32(inc, inc);
+        const __m128i inc4 = _mm_add_epi32(inc2, inc2);
+        __m128i v0 = _mm_add_epi32(pair32_sse2(vol[0], vol[1]),
+                _mm_unpackhi_epi64(_mm_setzero_si128(), inc));
+        __m128i v1 = _mm_add_epi32(v0, inc2);
+        const __m128i incA = _mm_set1_epi32(vaInc * 4);
+        __m128i a = _mm_add_epi32(_mm_set1_epi32(aux != NULL ? *va : 0),
+                mullo32_sse2(_mm_set1_epi32(vaInc), _mm_set_epi32(3, 2, 1, 0)));
+        for (size_t i = 0; i < n; i += 4) {
+            __m128i x = lo16to32_sse2(
+                    _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i)));
+            add32_sse2(out + 2 * i,
+                    mullo32_sse2(_mm_srai_epi32(v0, 16), _mm_unpacklo_epi32(x, x)));
+            add32_sse2(out + 2 * i + 4,
+                    mullo32_sse2(_mm_srai_epi32(v1, 16), _mm_unpackhi_epi32(x, x)));
+            v0 = _mm_add_epi32(v0, inc4);
+            v1 = _mm_add_epi32(v1, inc4);
+            if (aux != NULL) {
+                add32_sse2(aux + i, mullo32_sse2(_mm_srai_epi32(a, 16), x));
+                a = _mm_add_epi32(a, incA);
+            }
+        }
+        vol[0] = rampEnd(vol[0], volInc[0], n);
+        vol[1] = rampEnd(vol[1], volInc[1], n);
+        if (aux != NULL) {
+            *va = rampEnd(*va, vaInc, n);
+        }
+    }
+    mono16Ramp_c(out + 2 * n, in + n, frameCount - n, vol, volInc,
+            aux != NULL ? aux + n : NULL, va, vaInc);
+}
+
+// left and right samples of frames 0 to 3 of two registers of interleaved frames
+static inline __m128i left32_sse2(__m128i x0, __m128i x1)
+{
+    return _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(x0), _mm_castsi128_ps(x1),
+            _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+static inline __m128i right32_sse2(__m128i x0, __m128i x1)
+{
+    return _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(x0), _mm_castsi128_ps(x1),
+            _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+static void stereo32_sse2(int32_t* out, const int32_t* in, size_t frameCount,
+        const int16_t* vol, int32_t* aux, int16_t va)
+{
+    const __m128i v = pair32_sse2((uint16_t) vol[0], (uint16_t) vol[1]);
+    const __m128i va32 = _mm_set1_epi32((uint16_t) va);
+    const size_t n = frameCount & ~3;
+    for (size_t i = 0; i < n; i += 4) {
+        const __m128i* p = reinterpret_cast<const __m128i*>(in + 2 * i);
+        // int16_t(x >> 12), sign extended again so pmaddwd sees a 16-bit value
+        __m128i x0 = _mm_srai_epi32(_mm_slli_epi32(_mm_srai_epi32(_mm_loadu_si128(p), 12), 16),
+                16);
+        __m128i x1 = _mm_srai_epi32(_mm_slli_epi32(_mm_srai_epi32(_mm_loadu_si128(p + 1), 12),
+                16), 16);
+        add32_sse2(out + 2 * i, _mm_madd_epi16(x0, v));
+        add32_sse2(out + 2 * i + 4, _mm_madd_epi16(x1, v));
+        if (aux != NULL) {
+            __m128i a = _mm_srai_epi32(_mm_add_epi32(left32_sse2(x0, x1), right32_sse2(x0, x1)),
+                    1);
+            add32_sse2(aux + i, _mm_madd_epi16(a, va32));
+        }
+    }
+    stereo32_c(out + 2 * n, in + 2 * n, frameCount - n, vol, aux != NULL ? aux + n : NULL, va);
+}
+
+static void stereo32Ramp_sse2(int32_t* out, const int32_t* in, size_t frameCount,
+        int32_t* vol, const int32_t* volInc, int32_t* aux, int32_t* va, int32_t vaInc)
+{
+    const size_t n = frameCount & ~3;
+    if (n != 0) {
+        const __m128i inc = pair32_sse2(volInc[0], volInc[1]);
+        const __m128i inc2 = _mm_add_epi32(inc, inc);
+        const __m128i inc4 = _mm_add_epi32(inc2, inc2);
+        __m128i v0 = _mm_add_epi32(pair32_sse2(vol[0], vol[1]),
+                _mm_unpackhi_epi64(_mm_setzero_si128(), inc));
+        __m128i v1 = _mm_add_epi32(v0, inc2);
+        const __m128i incA = _mm_set1_epi32(vaInc * 4);
+        __m128i a = _mm_add_epi32(_mm_set1_epi32(aux != NULL ? *va : 0),
+                mullo32_sse2(_mm_set1_epi32(vaInc), _mm_set_epi32(3, 2, 1, 0)));
+        for (size_t i = 0; i < n; i += 4) {
+            const __m128i* p = reinterpret_cast<const __m128i*>(in + 2 * i);
+            __m128i x0 = _mm_srai_epi32(_mm_loadu_si128(p), 12);
+            __m128i x1 = _mm_srai_epi32(_mm_loadu_si128(p + 1), 12);
+            add32_sse2(out + 2 * i, mullo32_sse2(_mm_srai_epi32(v0, 16), x0));
+            add32_sse2(out + 2 * i + 4, mullo32_sse2(_mm_srai_epi32(v1, 16), x1));
+            v0 = _mm_add_epi32(v0, inc4);
+            v1 = _mm_add_epi32(v1, inc4);
+            if (aux != NULL) {
+                __m128i lr = _mm_add_epi32(left32_sse2(x0, x1), right32_sse2(x0, x1));
+                add32_sse2(aux + i, mullo32_sse2(_mm_srai_epi32(a, 17), lr));
+                a = _mm_add_epi32(a, incA);
+            }
+        }
+        vol[0] = rampEnd(vol[0], volInc[0], n);
+        vol[1] = rampEnd(vol[1], volInc[1], n);
+        if (aux != NULL) {
+            *va = rampEnd(*va, vaInc, n);
+        }
+    }
+    stereo32Ramp_c(out + 2 * n, in + 2 * n, frameCount - n, vol, volInc,
+            aux != NULL ? aux + n : NULL, va, vaInc);
+}
+
+static void stereo16To16_sse2(int16_t* out, const int16_t* in, size_t frameCount,
+        const int16_t* vol)
+{
+    const __m128i v = _mm_set1_epi32((uint16_t) vol[0] | ((uint32_t) (uint16_t) vol[1] << 16));
+    const size_t n = frameCount & ~3;
+    for (size_t i = 0; i < n; i += 4) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+        __m128i lo = _mm_mullo_epi16(x, v);
+        __m128i hi = _mm_mulhi_epi16(x, v);
+        // packssdw saturates like clamp16()
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), _mm_packs_epi32(
+                _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 12),
+                _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 12)));
+    }
+    stereo16To16_c(out + 2 * n, in + 2 * n, frameCount - n, vol);
+}
+
+static const MixerKernels sKernelsSse2 = {
+    "sse2",
+    stereo16_sse2,
+    mono16_sse2,
+    stereo16Ramp_sse2,
+    mono16Ramp_sse2,
+    stereo32_sse2,
+    stereo32Ramp_sse2,
+    stereo16To16_sse2,
+};
+#endif // MIXER_KERNELS_SSE2
+
+#ifdef MIXER_KERNELS_AVX2
+// ----------------------------------------------------------------------------
+// AVX2, 8 frames per iteration.  The resampler output kernels are left to SSE2, resampling
+// dominates their cost.
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+static inline AVX2_TARGET void add32_avx2(int32_t* out, __m256i x)
+{
+    __m256i* o = reinterpret_cast<__m256i*>(out);
+    _mm256_storeu_si256(o, _mm256_add_epi32(_mm256_loadu_si256(o), x));
+}
+
+// 8 samples sign extended to 32 bits
+static inline AVX2_TARGET __m256i load16to32_avx2(const int16_t* in)
+{
+    return _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)));
+}
+
+static inline AVX2_TARGET __m256i pair32_avx2(int32_t l, int32_t r)
+{
+    return _mm256_set_epi32(r, l, r, l, r, l, r, l);
+}
+
+// start + inc * {0, 1, ... 7}
+static inline AVX2_TARGET __m256i ramp8_avx2(int32_t start, int32_t inc)
+{
+    return _mm256_add_epi32(_mm256_set1_epi32(start),
+            _mm256_mullo_epi32(_mm256_set1_epi32(inc), _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0)));
+}
+
+// start + inc * {0, 0, 1, 1, ... 3, 3} for left and right
+static inline AVX2_TARGET __m256i rampPair_avx2(const int32_t* start, const int32_t* inc)
+{
+    return _mm256_add_epi32(pair32_avx2(start[0], start[1]),
+            _mm256_mullo_epi32(pair32_avx2(inc[0], inc[1]),
+                    _mm256_set_epi32(3, 3, 2, 2, 1, 1, 0, 0)));
+}
+
+static AVX2_TARGET void stereo16_avx2(int32_t* out, const int16_t* in, size_t frameCount,
+        const int16_t* vol, int32_t* aux, int16_t va)
+{
+    const __m256i v = pair32_avx2(vol[0], vol[1]);
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i va32 = _mm256_set1_epi32(va);
+    const size_t n = frameCount & ~7;
+    for (size_t i = 0; i < n; i += 8) {
+        add32_avx2(out + 2 * i, _mm256_mullo_epi32(load16to32_avx2(in + 2 * i), v));
+        add32_avx2(out + 2 * i + 8, _mm256_mullo_epi32(load16to32_avx2(in + 2 * i + 8), v));
+        if (aux != NULL) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 2 * i));
+            __m256i a = _mm256_srai_epi32(_mm256_madd_epi16(x, ones), 1);
+            add32_avx2(aux + i, _mm256_mullo_epi32(a, va32));
+        }
+    }
+    stereo16_c(out + 2 * n, in + 2 * n, frameCount - n, vol, aux != NULL ? aux + n : NULL, va);
+}
+
+static AVX2_TARGET void mono16_avx2(int32_t* out, const int16_t* in, size_t frameCount,
+        const int16_t* vol, int32_t* aux, int16_t va)
+{
+    const __m256i v = pair32_avx2(vol[0], vol[1]);
+    const __m256i va32 = _mm256_set1_epi32(va);
+    const __m256i dupLo = _mm256_set_epi32(3, 3, 2, 2, 1, 1, 0, 0);
+    const __m256i dupHi = _mm256_set_epi32(7, 7, 6, 6, 5, 5, 4, 4);
+    const size_t n = frameCount & ~7;
+    for (size_t i = 0; i < n; i += 8) {
+        __m256i x = load16to32_avx2(in + i);
+        add32_avx2(out + 2 * i,
+                _mm256_mullo_epi32(_mm256_permutevar8x32_epi32(x, dupLo), v));
+        add32_avx2(out + 2 * i + 8,
+                _mm256_mullo_epi32(_mm256_permutevar8x32_epi32(x, dupHi), v));
+        if (aux != NULL) {
+            add32_avx2(aux + i, _mm256_mullo_epi32(x, va32));
+        }
+    }
+    mono16_c(out + 2 * n, in + n, frameCount - n, vol, aux != NULL ? aux + n : NULL, va);
+}
+
+static AVX2_TARGET void stereo16Ramp_avx2(int32_t* out, const int16_t* in, size_t frameCount,
+        int32_t* vol, const int32_t* volInc, int32_t* aux, int32_t* va, int32_t vaInc)
+{
+    const size_t n = frameCount & ~7;
+    if (n != 0) {
+        // volumes of frames 0 to 3, then 4 to 7
+        const __m256i inc4 = pair32_avx2(volInc[0] * 4, volInc[1] * 4);
+        const __m256i inc8 = _mm256_add_epi32(inc4, inc4);
+        __m256i v0 = rampPair_avx2(vol, volInc);
+        __m256i v1 = _mm256_add_epi32(v0, inc4);
+        const __m256i ones = _mm256_set1_epi16(1);
+        const __m256i incA = _mm256_set1_epi32(vaInc * 8);
+        __m256i a = ramp8_avx2(aux != NULL ? *va : 0, vaInc);
+        for (size_t i = 0; i < n; i += 8) {
+            add32_avx2(out + 2 * i, _mm256_mullo_epi32(_mm256_srai_epi32(v0, 16),
+                    load16to32_avx2(in + 2 * i)));
+            add32_avx2(out + 2 * i + 8, _mm256_mullo_epi32(_mm256_srai_epi32(v1, 16),
+                    load16to32_avx2(in + 2 * i + 8)));
+            v0 = _mm256_add_epi32(v0, inc8);
+            v1 = _mm256_add_epi32(v1, inc8);
+            if (aux != NULL) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 2 * i));
+                add32_avx2(aux + i, _mm256_mullo_epi32(_mm256_srai_epi32(a, 17),
+                        _mm256_madd_epi16(x, ones)));
+                a = _mm256_add_epi32(a, incA);
+            }
+        }
+        vol[0] = rampEnd(vol[0], volInc[0], n);
+        vol[1] = rampEnd(vol[1], volInc[1], n);
+        if (aux != NULL) {
+            *va = rampEnd(*va, vaInc, n);
+        }
+    }
+    stereo16Ramp_c(out + 2 * n, in + 2 * n, frameCount - n, vol, volInc,
+            aux != NULL ? aux + n : NULL, va, vaInc);
+}
+
+static AVX2_TARGET void mono16Ramp_avx2(int32_t* out, const int16_t* in, size_t frameCount,
+        int32_t* vol, const int32_t* volInc, int32_t* aux, int32_t* va, int32_t vaInc)
+{
+    const size_t n = frameCount & ~7;
+    if (n != 0) {
+        const __m256i inc4 = pair32_avx2(volInc[0] * 4, volInc[1] * 4);
+        const __m256i inc8 = _mm256_add_epi32(inc4, inc4);
+        __m256i v0 = rampPair_avx2(vol, volInc);
+        __m256i v1 = _mm256_add_epi32(v0, inc4);
+        const __m256i dupLo = _mm256_set_epi32(3, 3, 2, 2, 1, 1, 0, 0);
+        const __m256i dupHi = _mm256_set_epi32(7, 7, 6, 6, 5, 5, 4, 4);
+        const __m256i incA = _mm256_set1_epi32(vaInc * 8);
+        __m256i a = ramp8_avx2(aux != NULL ? *va : 0, vaInc);
+        for (size_t i = 0; i < n; i += 8) {
+            __m256i x = load16to32_avx2(in + i);
+            add32_avx2(out + 2 * i, _mm256_mullo_epi32(_mm256_srai_epi32(v0, 16),
+                    _mm256_permutevar8x32_epi32(x, dupLo)));
+            add32_avx2(out + 2 * i + 8, _mm256_mullo_epi32(_mm256_srai_epi32(v1, 16),
+                    _mm256_permutevar8x32_epi32(x, dupHi)));
+            v0 = _mm256_add_epi32(v0, inc8);
+            v1 = _mm256_add_epi32(v1, inc8);
+            if (aux != NULL) {
+                add32_avx2(aux + i, _mm256_mullo_epi32(_mm256_srai_epi32(a, 16), x));
+                a = _mm256_add_epi32(a, incA);
+            }
+        }
+        vol[0] = rampEnd(vol[0], volInc[0], n);
+        vol[1] = rampEnd(vol[1], volInc[1], n);
+        if (aux != NULL) {
+            *va = rampEnd(*va, vaInc, n);
+        }
+    }
+    mono16Ramp_c(out + 2 * n, in + n, frameCount - n, vol, volInc,
+            aux != NULL ? aux + n : NULL, va, vaInc);
+}
+
+static AVX2_TARGET void stereo16To16_avx2(int16_t* out, const int16_t* in, size_t frameCount,
+        const int16_t* vol)
+{
+    const __m256i v = pair32_avx2(vol[0], vol[1]);
+    const size_t n = frameCount & ~7;
+    for (size_t i = 0; i < n; i += 8) {
+        __m256i p0 = _mm256_srai_epi32(
+                _mm256_mullo_epi32(load16to32_avx2(in + 2 * i), v), 12);
+        __m256i p1 = _mm256_srai_epi32(
+                _mm256_mullo_epi32(load16to32_avx2(in + 2 * i + 8), v), 12);
+        // vpackssdw packs within 128-bit lanes, put the quadwords back in order
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i),
+                _mm256_permute4x64_epi64(_mm256_packs_epi32(p0, p1), _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    stereo16To16_c(out + 2 * n, in + 2 * n, frameCount - n, vol);
+}
+
+static const MixerKernels sKernelsAvx2 = {
+    "avx2",
+    stereo16_avx2,
+    mono16_avx2,
+    stereo16Ramp_avx2,
+    mono16Ramp_avx2,
+    stereo32_sse2,
+    stereo32Ramp_sse2,
+    stereo16To16_avx2,
+};
+#endif // MIXER_KERNELS_AVX2
+
+#ifdef MIXER_KERNELS_NEON
+// ----------------------------------------------------------------------------
+// NEON, 4 frames per iteration.
+
+static inline int32x4_t pair32_neon(int32_t l, int32_t r)
+{
+    const int32_t v[4] = { l, r, l, r };
+    return vld1q_s32(v);
+}
+
+static inline int16x4_t pair16_neon(int16_t l, int16_t r)
+{
+    const int16_t v[4] = { l, r, l, r };
+    return vld1_s16(v);
+}
+
+// start + inc * {0, 1, 2, 3}
+static inline int32x4_t ramp4_neon(int32_t start, int32_t inc)
+{
+    const int32_t steps[4] = { 0, 1, 2, 3 };
+    return vmlaq_n_s32(vdupq_n_s32(start), vld1q_s32(steps), inc);
+}
+
+// sums of adjacent lanes: {x0[0] + x0[1], x0[2] + x0[3], x1[0] + x1[1], x1[2] + x1[3]}
+static inline int32x4_t pairwiseAdd_neon(int32x4_t x0, int32x4_t x1)
+{
+    return vcombine_s32(vpadd_s32(vget_low_s32(x0), vget_high_s32(x0)),
+            vpadd_s32(vget_low_s32(x1), vget_high_s32(x1)));
+}
+
+static void stereo16_neon(int32_t* out, const int16_t* in, size_t frameCount,
+        const int16_t* vol, int32_t* aux, int16_t va)
+{
+    const int16x4_t v = pair16_neon(vol[0], vol[1]);
+    const size_t n = frameCount & ~3;
+    for (size_t i = 0; i < n; i += 4) {
+        int16x8_t x = vld1q_s16(in + 2 * i);
+        int32_t* o = out + 2 * i;
+        vst1q_s32(o, vmlal_s16(vld1q_s32(o), vget_low_s16(x), v));
+        vst1q_s32(o + 4, vmlal_s16(vld1q_s32(o + 4), vget_high_s16(x), v));
+        if (aux != NULL) {
+            int32x4_t a = vshrq_n_s32(vpaddlq_s16(x), 1);
+            vst1q_s32(aux + i, vmlaq_n_s32(vld1q_s32(aux + i), a, va));
+        }
+    }
+    stereo16_c(out + 2 * n, in + 2 * n, frameCount - n, vol, aux != NULL ? aux + n : NULL, va);
+}
+
+static void mono16_neon(int32_t* out, const int16_t* in, size_t frameCount,
+        const int16_t* vol, int32_t* aux, int16_t va)
+{
+    const int16x4_t v = pair16_neon(vol[0], vol[1]);
+    const size_t n = frameCount & ~3;
+    for (size_t i = 0; i < n; i += 4) {
+        int16x4_t x = vld1_s16(in + i);
+        int16x4x2_t d = vzip_s16(x, x);
+        int32_t* o = out + 2 * i;
+        vst1q_s32(o, vmlal_s16(vld1q_s32(o), d.val[0], v));
+        vst1q_s32(o + 4, vmlal_s16(vld1q_s32(o + 4), d.val[1], v));
+        if (aux != NULL) {
+            vst1q_s32(aux + i, vmlal_n_s16(vld1q_s32(aux + i), x, va));
+        }
+    }
+    mono16_c(out + 2 * n, in + n, frameCount - n, vol, aux != NULL ? aux + n : NULL, va);
+}
+
+static void stereo16Ramp_neon(int32_t* out, const int16_t* in, size_t frameCount,
+        int32_t* vol, const int32_t* volInc, int32_t* aux, int32_t* va, int32_t vaInc)
+{
+    const size_t n = frameCount & ~3;
+    if (n != 0) {
+        // volumes of frames 0 and 1, then 2 and 3
+        const int32x4_t inc2 = pair32_neon(volInc[0] * 2, volInc[1] * 2);
+        const int32x4_t inc4 = vaddq_s32(inc2, inc2);
+        int32x4_t v0 = vaddq_s32(pair32_neon(vol[0], vol[1]),
+                vcombine_s32(vdup_n_s32(0), vld1_s32(volInc)));
+        int32x4_t v1 = vaddq_s32(v0, inc2);
+        const int32x4_t incA = vdupq_n_s32(vaInc * 4);
+        int32x4_t a = ramp4_neon(aux != NULL ? *va : 0, vaInc);
+        for (size_t i = 0; i < n; i += 4) {
+            int16x8_t x = vld1q_s16(in + 2 * i);
+            int32_t* o = out + 2 * i;
+            vst1q_s32(o, vmlaq_s32(vld1q_s32(o), vshrq_n_s32(v0, 16),
+                    vmovl_s16(vget_low_s16(x))));
+            vst1q_s32(o + 4, vmlaq_s32(vld1q_s32(o + 4), vshrq_n_s32(v1, 16),
+                    vmovl_s16(vget_high_s16(x))));
+            v0 = vaddq_s32(v0, inc4);
+            v1 = vaddq_s32(v1, inc4);
+            if (aux != NULL) {
+                vst1q_s32(aux + i, vmlaq_s32(vld1q_s32(aux + i), vshrq_n_s32(a, 17),
+                        vpaddlq_s16(x)));
+                a = vaddq_s32(a, incA);
+            }
+        }
+        vol[0] = rampEnd(vol[0], volInc[0], n);
+        vol[1] = rampEnd(vol[1], volInc[1], n);
+        if (aux != NULL) {
+            *va = rampEnd(*va, vaInc, n);
+        }
+    }
+    stereo16Ramp_c(out + 2 * n, in + 2 * n, frameCount - n, vol, volInc,
+            aux != NULL ? aux + n : NULL, va, vaInc);
+}
+
+static void mono16Ramp_neon(int32_t* out, const int16_t* in, size_t frameCount,
+        int32_t* vol, const int32_t* volInc, int32_t* aux, int32_t* va, int32_t vaInc)
+{
+    const size_t n = frameCount & ~3;
+    if (n != 0) {
+        const int32x4_t inc2 = pair32_neon(volInc[0] * 2, volInc[1] * 2);
+        const int32x4_t inc4 = vaddq_s32(inc2, inc2);
+        int32x4_t v0 = vaddq_s32(pair32_neon(vol[0], vol[1]),
+                vcombine_s32(vdup_n_s32(0), vld1_s32(volInc)));
+        int32x4_t v1 = vaddq_s32(v0, inc2);
+        const int32x4_t incA = vdupq_n_s32(vaInc * 4);
+        int32x4_t a = ramp4_neon(aux != NULL ? *va : 0, vaInc);
+        for (size_t i = 0; i < n; i += 4) {
+            int32x4_t x = vmovl_s16(vld1_s16(in + i));
+            int32x4x2_t d = vzipq_s32(x, x);
+            int32_t* o = out + 2 * i;
+            vst1q_s32(o, vmlaq_s32(vld1q_s32(o), vshrq_n_s32(v0, 16), d.val[0]));
+            vst1q_s32(o + 4, vmlaq_s32(vld1q_s32(o + 4), vshrq_n_s32(v1, 16), d.val[1]));
+            v0 = vaddq_s32(v0, inc4);
+            v1 = vaddq_s32(v1, inc4);
+            if (aux != NULL) {
+                vst1q_s32(aux + i, vmlaq_s32(vld1q_s32(aux + i), vshrq_n_s32(a, 16), x));
+                a = vaddq_s32(a, incA);
+            }
+        }
+        vol[0] = rampEnd(vol[0], volInc[0], n);
+        vol[1] = rampEnd(vol[1], volInc[1], n);
+        if (aux != NULL) {
+            *va = rampEnd(*va, vaInc, n);
+        }
+    }
+    mono16Ramp_c(out + 2 * n, in + n, frameCount - n, vol, volInc,
+            aux != NULL ? aux + n : NULL, va, vaInc);
+}
+
+static void stereo32_neon(int32_t* out, const int32_t* in, size_t frameCount,
+        const int16_t* vol, int32_t* aux, int16_t va)
+{
+    const int16x4_t v = pair16_neon(vol[0], vol[1]);
+    const size_t n = frameCount & ~3;
+    for (size_t i = 0; i < n; i += 4) {
+        // vmovn truncates like the int16_t cast
+        int16x4_t x0 = vmovn_s32(vshrq_n_s32(vld1q_s32(in + 2 * i), 12));
+        int16x4_t x1 = vmovn_s32(vshrq_n_s32(vld1q_s32(in + 2 * i + 4), 12));
+        int32_t* o = out + 2 * i;
+        vst1q_s32(o, vmlal_s16(vld1q_s32(o), x0, v));
+        vst1q_s32(o + 4, vmlal_s16(vld1q_s32(o + 4), x1, v));
+        if (aux != NULL) {
+            int32x4_t a = vshrq_n_s32(vpaddlq_s16(vcombine_s16(x0, x1)), 1);
+            vst1q_s32(aux + i, vmlaq_n_s32(vld1q_s32(aux + i), a, va));
+        }
+    }
+    stereo32_c(out + 2 * n, in + 2 * n, frameCount - n, vol, aux != NULL ? aux + n : NULL, va);
+}
+
+static void stereo32Ramp_neon(int32_t* out, const int32_t* in, size_t frameCount,
+        int32_t* vol, const int32_t* volInc, int32_t* aux, int32_t* va, int32_t vaInc)
+{
+    const size_t n = frameCount & ~3;
+    if (n != 0) {
+        const int32x4_t inc2 = pair32_neon(volInc[0] * 2, volInc[1] * 2);
+        const int32x4_t inc4 = vaddq_s32(inc2, inc2);
+        int32x4_t v0 = vaddq_s32(pair32_neon(vol[0], vol[1]),
+                vcombine_s32(vdup_n_s32(0), vld1_s32(volInc)));
+        int32x4_t v1 = vaddq_s32(v0, inc2);
+        const int32x4_t incA = vdupq_n_s32(vaInc * 4);
+        int32x4_t a = ramp4_neon(aux != NULL ? *va : 0, vaInc);
+        for (size_t i = 0; i < n; i += 4) {
+            int32x4_t x0 = vshrq_n_s32(vld1q_s32(in + 2 * i), 12);
+            int32x4_t x1 = vshrq_n_s32(vld1q_s32(in + 2 * i + 4), 12);
+            int32_t* o = out + 2 * i;
+            vst1q_s32(o, vmlaq_s32(vld1q_s32(o), vshrq_n_s32(v0, 16), x0));
+            vst1q_s32(o + 4, vmlaq_s32(vld1q_s32(o + 4), vshrq_n_s32(v1, 16), x1));
+            v0 = vaddq_s32(v0, inc4);
+            v1 = vaddq_s32(v1, inc4);
+            if (aux != NULL) {
+                vst1q_s32(aux + i, vmlaq_s32(vld1q_s32(aux + i), vshrq_n_s32(a, 17),
+                        pairwiseAdd_neon(x0, x1)));
+                a = vaddq_s32(a, incA);
+            }
+        }
+        vol[0] = rampEnd(vol[0], volInc[0], n);
+        vol[1] = rampEnd(vol[1], volInc[1], n);
+        if (aux != NULL) {
+            *va = rampEnd(*va, vaInc, n);
+        }
+    }
+    stereo32Ramp_c(out + 2 * n, in + 2 * n, frameCount - n, vol, volInc,
+            aux != NULL ? aux + n : NULL, va, vaInc);
+}
+
+static void stereo16To16_neon(int16_t* out, const int16_t* in, size_t frameCount,
+        const int16_t* vol)
+{
+    const int16x4_t v = pair16_neon(vol[0], vol[1]);
+    const size_t n = frameCount & ~3;
+    for (size_t i = 0; i < n; i += 4) {
+        int16x8_t x = vld1q_s16(in + 2 * i);
+        // vqshrn saturates like clamp16()
+        vst1q_s16(out + 2 * i, vcombine_s16(
+                vqshrn_n_s32(vmull_s16(vget_low_s16(x), v), 12),
+                vqshrn_n_s32(vmull_s16(vget_high_s16(x), v), 12)));
+    }
+    stereo16To16_c(out + 2 * n, in + 2 * n, frameCount - n, vol);
+}
+
+static const MixerKernels sKernelsNeon = {
+    "neon",
+    stereo16_neon,
+    mono16_neon,
+    stereo16Ramp_neon,
+    mono16Ramp_neon,
+    stereo32_neon,
+    stereo32Ramp_neon,
+    stereo16To16_neon,
+};
+#endif // MIXER_KERNELS_NEON
+
+// ----------------------------------------------------------------------------
+
+#ifdef MIXER_KERNELS_SSE2
+static bool cpuHasSse2()
+{
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (edx & bit_SSE2);
+}
+#endif
+
+#ifdef MIXER_KERNELS_AVX2
+static bool cpuHasAvx2()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE)) {
+        return false;
+    }
+    // the OS must save the ymm registers
+    unsigned int xcr0lo, xcr0hi;
+    __asm__ ("xgetbv" : "=a" (xcr0lo), "=d" (xcr0hi) : "c" (0));
+    if ((xcr0lo & 6) != 6) {
+        return false;
+    }
+    if (__get_cpuid_max(0, NULL) < 7) {
+        return false;
+    }
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx & (1 << 5)) != 0;   // AVX2
+}
+#endif
+
+static const MixerKernels* sKernels[4];
+static size_t sNumKernels;
+static pthread_once_t sOnceControl = PTHREAD_ONCE_INIT;
+
+static void sInitRoutine()
+{
+    sKernels[sNumKernels++] = &sKernelsScalar;
+#ifdef MIXER_KERNELS_SSE2
+    if (cpuHasSse2()) {
+        sKernels[sNumKernels++] = &sKernelsSse2;
+    }
+#endif
+#ifdef MIXER_KERNELS_AVX2
+    if (cpuHasAvx2()) {
+        sKernels[sNumKernels++] = &sKernelsAvx2;
+    }
+#endif
+#ifdef MIXER_KERNELS_NEON
+    sKernels[sNumKernels++] = &sKernelsNeon;
+#endif
+}
+
+// static
+size_t MixerKernels::getNumKernels()
+{
+    pthread_once(&sOnceControl, sInitRoutine);
+    return sNumKernels;
+}
+
+// static
+const MixerKernels* MixerKernels::getKernelsAt(size_t index)
+{
+    pthread_once(&sOnceControl, sInitRoutine);
+    return index < sNumKernels ? sKernels[index] : NULL;
+}
+
+// static
+const MixerKernels* MixerKernels::getKernels()
+{
+    pthread_once(&sOnceControl, sInitRoutine);
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("af.mixer.simd", value, NULL) > 0 && atoi(value) == 0) {
+        return sKernels[0];
+    }
+    return sKernels[sNumKernels - 1];
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
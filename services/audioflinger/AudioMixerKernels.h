@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_MIXER_KERNELS_H
+#define ANDROID_AUDIO_MIXER_KERNELS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+// Inner loops of the 16-bit AudioMixer track hooks, one table per instruction set.
+// Every table is bit-exact with the scalar reference, which defines the arithmetic:
+// products and sums are 32-bit and wrap like the original C loops.
+//
+// Volumes are Q3.12 (UNITY_GAIN is 0x1000).  Ramped volumes are Q3.12 in the upper 16 bits
+// of an int32_t; the ramp adds volInc[] per frame and the kernel writes back the value reached.
+// Stereo output is interleaved left, right and accumulated into.  Aux, if not NULL, gets one
+// sample per frame.  frameCount may be 0.
+struct MixerKernels {
+    // name of the instruction set, "scalar", "sse2", "avx2" or "neon"
+    const char* name;
+
+    // out[2i+c] += in[2i+c] * vol[c]; aux[i] += ((in[2i] + in[2i+1]) >> 1) * va
+    void (*stereo16)(int32_t* out, const int16_t* in, size_t frameCount,
+            const int16_t* vol, int32_t* aux, int16_t va);
+
+    // out[2i+c] += in[i] * vol[c]; aux[i] += in[i] * va
+    void (*mono16)(int32_t* out, const int16_t* in, size_t frameCount,
+            const int16_t* vol, int32_t* aux, int16_t va);
+
+    // like stereo16 with gains vol[c] >> 16 and aux gain *va >> 17 applied to (l + r)
+    void (*stereo16Ramp)(int32_t* out, const int16_t* in, size_t frameCount,
+            int32_t* vol, const int32_t* volInc, int32_t* aux, int32_t* va, int32_t vaInc);
+
+    // like mono16 with gains vol[c] >> 16 and aux gain *va >> 16
+    void (*mono16Ramp)(int32_t* out, const int16_t* in, size_t frameCount,
+            int32_t* vol, const int32_t* volInc, int32_t* aux, int32_t* va, int32_t vaInc);
+
+    // Q4.27 resampler output: l = int16_t(in[2i] >> 12), likewise r, then as stereo16
+    void (*stereo32)(int32_t* out, const int32_t* in, size_t frameCount,
+            const int16_t* vol, int32_t* aux, int16_t va);
+
+    // Q4.27 resampler output: l = in[2i] >> 12 not truncated to 16 bits, then as stereo16Ramp
+    void (*stereo32Ramp)(int32_t* out, const int32_t* in, size_t frameCount,
+            int32_t* vol, const int32_t* volInc, int32_t* aux, int32_t* va, int32_t vaInc);
+
+    // single track straight to a 16-bit stereo buffer: out[2i+c] = clamp16((in[2i+c] *
+    // vol[c]) >> 12)
+    void (*stereo16To16)(int16_t* out, const int16_t* in, size_t frameCount,
+            const int16_t* vol);
+
+    // Kernels supported by this CPU, index 0 is the scalar reference and the last one is
+    // the fastest.
+    static size_t getNumKernels();
+    static const MixerKernels* getKernelsAt(size_t index);
+
+    // The fastest kernels supported by this CPU, or the scalar reference if property
+    // af.mixer.simd is 0.
+    static const MixerKernels* getKernels();
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_AUDIO_MIXER_KERNELS_H
@@ -0,0 +1,414 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_MIXER_OPS_H
+#define ANDROID_AUDIO_MIXER_OPS_H
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <system/audio.h>
+
+namespace android {
+
+// Sample conversions and volume kernels for the float mixing path of AudioMixer.
+//
+// Float samples are nominally in [-1.0, 1.0); the mix itself is unbounded and only clamped
+// when written to a 16-bit or 24-bit destination.  The legacy integer path accumulates in
+// Q4.27 (a 16-bit sample times a Q3.12 volume), which is also the format of aux buffers.
+
+// 24-bit packed little endian sample, as found in AUDIO_FORMAT_PCM_24_BIT_PACKED buffers.
+// sizeof(packed24_t) is 3 and its alignment is 1, so arrays of it index like samples.
+struct packed24_t {
+    uint8_t b[3];
+};
+
+static inline float float_from_i16(int16_t ival)
+{
+    return ival * (1.0f / (1 << 15));
+}
+
+static inline float float_from_p24(const packed24_t& pval)
+{
+    // sign extend through the top byte of a 32-bit value
+    int32_t ival = (int32_t) (((uint32_t) pval.b[0] << 8) | ((uint32_t) pval.b[1] << 16) |
+            ((uint32_t) pval.b[2] << 24));
+    return ival * (1.0f / (1U << 31));
+}
+
+static inline float float_from_q4_27(int32_t ival)
+{
+    return ival * (1.0f / (1 << 27));
+}
+
+static inline int16_t clamp16_from_float(float f)
+{
+    static const float scale = 1 << 15;
+    static const float limpos = 0x7fff;
+    static const float limneg = -0x8000;
+
+    f *= scale;
+    if (f <= limneg) {
+        return -0x8000;
+    } else if (f >= limpos) {
+        return 0x7fff;
+    }
+    // round to nearest, away from zero on ties
+    f += f >= 0 ? 0.5f : -0.5f;
+    return (int16_t) f;
+}
+
+static inline int32_t clamp24_from_float(float f)
+{
+    static const float scale = 1 << 23;
+    static const float limpos = 0x7fffff;
+    static const float limneg = -0x800000;
+
+    f *= scale;
+    if (f <= limneg) {
+        return -0x800000;
+    } else if (f >= limpos) {
+        return 0x7fffff;
+    }
+    f += f >= 0 ? 0.5f : -0.5f;
+    return (int32_t) f;
+}
+
+static inline int32_t clampq4_27_from_float(float f)
+{
+    static const float scale = 1 << 27;
+    static const float limpos = 16.0f - 1.0f / (1 << 27);
+    static const float limneg = -16.0f;
+
+    if (f <= limneg) {
+        return (int32_t) 0x80000000;
+    } else if (f >= limpos) {
+        return 0x7fffffff;
+    }
+    f *= scale;
+    return (int32_t) (f + (f >= 0 ? 0.5f : -0.5f));
+}
+
+static inline void p24_from_i32(packed24_t *dst, int32_t ival)
+{
+    dst->b[0] = ival;
+    dst->b[1] = ival >> 8;
+    dst->b[2] = ival >> 16;
+}
+
+// Generic input accessor so the kernels below can be instantiated for every track format.
+static inline float mixer_input(const int16_t *in, size_t i) { return float_from_i16(in[i]); }
+static inline float mixer_input(const float *in, size_t i) { return in[i]; }
+static inline float mixer_input(const packed24_t *in, size_t i) { return float_from_p24(in[i]); }
+// Q4.27 is what AudioResampler produces at unity gain
+static inline float mixer_input(const int32_t *in, size_t i) { return float_from_q4_27(in[i]); }
+
+// Bytes per sample of a format that AudioMixer accepts as track input or mix output.
+static inline size_t mixer_bytes_per_sample(audio_format_t format)
+{
+    switch (format) {
+    case AUDIO_FORMAT_PCM_16_BIT:
+        return sizeof(int16_t);
+    case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+        return sizeof(packed24_t);
+    case AUDIO_FORMAT_PCM_FLOAT:
+        return sizeof(float);
+    default:
+        return 0;
+    }
+}
+
+static inline bool is_mixer_format(audio_format_t format)
+{
+    return mixer_bytes_per_sample(format) != 0;
+}
+
+// Converts float samples to a mix output format, clamping to the integer range if needed.
+static inline void memcpy_to_mixer_format_from_float(void *dst, audio_format_t dstFormat,
+        const float *src, size_t count)
+{
+    switch (dstFormat) {
+    case AUDIO_FORMAT_PCM_16_BIT: {
+        int16_t *out = (int16_t *) dst;
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = clamp16_from_float(src[i]);
+        }
+        } break;
+    case AUDIO_FORMAT_PCM_24_BIT_PACKED: {
+        packed24_t *out = (packed24_t *) dst;
+        for (size_t i = 0; i < count; ++i) {
+            p24_from_i32(&out[i], clamp24_from_float(src[i]));
+        }
+        } break;
+    case AUDIO_FORMAT_PCM_FLOAT:
+        memcpy(dst, src, count * sizeof(float));
+        break;
+    default:
+        break;
+    }
+}
+
+// Volume kernels.  Output is always stereo float and is accumulated into.  NCHAN is the
+// number of input channels (1 or 2); mono input is sent to both output channels.
+// The optional aux send accumulates in Q4.27 with the average of both channels.
+//
+// The loops are kept free of loop-carried dependencies (the ramp is evaluated as
+// start + inc * i rather than accumulated) and take restrict-qualified pointers so that
+// the compiler can vectorize them; this also keeps a long ramp from drifting.
+
+template <int NCHAN, typename TI>
+inline void volumeMulAdd(float * __restrict out, const TI * __restrict in, size_t frameCount,
+        const float *vol, int32_t * __restrict aux, float va)
+{
+    const float vl = vol[0];
+    const float vr = vol[1];
+    if (aux != NULL) {
+        for (size_t i = 0; i < frameCount; ++i) {
+            const float l = mixer_input(in, i * NCHAN);
+            const float r = NCHAN == 1 ? l : mixer_input(in, i * NCHAN + 1);
+            out[2 * i] += l * vl;
+            out[2 * i + 1] += r * vr;
+            aux[i] += clampq4_27_from_float((l + r) * 0.5f * va);
+        }
+    } else {
+        for (size_t i = 0; i < frameCount; ++i) {
+            const float l = mixer_input(in, i * NCHAN);
+            const float r = NCHAN == 1 ? l : mixer_input(in, i * NCHAN + 1);
+            out[2 * i] += l * vl;
+            out[2 * i + 1] += r * vr;
+        }
+    }
+}
+
+// Ramps from vol[] by volInc[] per frame and returns the volume reached in vol[],
+// likewise for *va and vaInc.
+template <int NCHAN, typename TI>
+inline void volumeRampMulAdd(float * __restrict out, const TI * __restrict in, size_t frameCount,
+        float *vol, const float *volInc, int32_t * __restrict aux, float *va, float vaInc)
+{
+    const float vl = vol[0];
+    const float vr = vol[1];
+    const float vlInc = volInc[0];
+    const float vrInc = volInc[1];
+    if (aux != NULL) {
+        const float a0 = *va;
+        for (size_t i = 0; i < frameCount; ++i) {
+            const float l = mixer_input(in, i * NCHAN);
+            const float r = NCHAN == 1 ? l : mixer_input(in, i * NCHAN + 1);
+            out[2 * i] += l * (vl + vlInc * i);
+            out[2 * i + 1] += r * (vr + vrInc * i);
+            aux[i] += clampq4_27_from_float((l + r) * 0.5f * (a0 + vaInc * i));
+        }
+        *va = a0 + vaInc * frameCount;
+    } else {
+        for (size_t i = 0; i < frameCount; ++i) {
+            const float l = mixer_input(in, i * NCHAN);
+            const float r = NCHAN == 1 ? l : mixer_input(in, i * NCHAN + 1);
+            out[2 * i] += l * (vl + vlInc * i);
+            out[2 * i + 1] += r * (vr + vrInc * i);
+        }
+    }
+    vol[0] = vl + vlInc * frameCount;
+    vol[1] = vr + vrInc * frameCount;
+}
+
+// Multichannel kernels.  The channel mapping from IN_MASK to OUT_MASK is resolved at compile
+// time, so each (IN_MASK, OUT_MASK) pair gets a straight-line kernel without per-sample
+// branches or lookups.  Samples are interleaved in ascending channel bit order.
+//
+// A channel present in both masks is copied.  Otherwise it is folded into the nearest
+// channel(s) of the output:
+//   mono                     -> front left and right, at unity like the stereo kernels
+//   front center, LFE        -> front left and right at -3 dB
+//   back center              -> back left and right at -3 dB, else front left and right
+//   front left/right center  -> front left/right
+//   side left/right          -> back left/right, else front left/right at -3 dB
+//   back left/right          -> side left/right, else front left/right at -3 dB
+// Other channels are dropped.  Left output channels get the left volume, right
+// ones the right volume and center ones the average of both.
+
+static const float kMinus3dB = 0.70710678f;
+
+template <uint32_t MASK>
+struct ChannelCount {
+    enum { value = (MASK & 1) + ChannelCount<(MASK >> 1)>::value };
+};
+
+template <>
+struct ChannelCount<0> {
+    enum { value = 0 };
+};
+
+// interleaved index of channel BIT in a frame of MASK
+template <uint32_t MASK, uint32_t BIT>
+struct ChannelIndex {
+    enum { value = ChannelCount<MASK & (BIT - 1)>::value };
+};
+
+// BIT if it is part of MASK, else ALT if it is part of MASK, else 0
+template <uint32_t MASK, uint32_t BIT, uint32_t ALT>
+struct ChannelPick {
+    enum { value = (MASK & BIT) ? BIT : (MASK & ALT) ? ALT : 0 };
+};
+
+// Where input channel BIT of IN_MASK goes in OUT_MASK: up to two output channels, both at
+// unity or both at -3 dB.
+template <uint32_t IN_MASK, uint32_t OUT_MASK, uint32_t BIT>
+struct ChannelRoute {
+    enum {
+        kFL = AUDIO_CHANNEL_OUT_FRONT_LEFT,
+        kFR = AUDIO_CHANNEL_OUT_FRONT_RIGHT,
+        kFC = AUDIO_CHANNEL_OUT_FRONT_CENTER,
+        kLFE = AUDIO_CHANNEL_OUT_LOW_FREQUENCY,
+        kBL = AUDIO_CHANNEL_OUT_BACK_LEFT,
+        kBR = AUDIO_CHANNEL_OUT_BACK_RIGHT,
+        kBC = AUDIO_CHANNEL_OUT_BACK_CENTER,
+        kSL = AUDIO_CHANNEL_OUT_SIDE_LEFT,
+        kSR = AUDIO_CHANNEL_OUT_SIDE_RIGHT,
+
+        mono = IN_MASK == AUDIO_CHANNEL_OUT_MONO,
+        direct = !mono && (OUT_MASK & BIT) != 0,
+        folded = !mono && !direct,
+
+        // centered channels are split over a left and right pair
+        split = folded && (BIT == kFC || BIT == kLFE || BIT == kBC),
+        splitToBack = split && BIT == kBC && (OUT_MASK & kBL) != 0,
+
+        // back and side channels swap, or fall back to the front
+        rearLeft = BIT == kBL || BIT == kSL,
+        rearRight = BIT == kBR || BIT == kSR,
+        rearAlt = BIT == kBL ? kSL : BIT == kSL ? kBL : BIT == kBR ? kSR : BIT == kSR ? kBR : 0,
+        rearToFront = folded && (rearLeft || rearRight) && (OUT_MASK & rearAlt) == 0,
+
+        attenuate = split || rearToFront,
+
+        primary = mono ? kFL :
+                direct ? BIT :
+                split ? (splitToBack ? kBL : kFL) :
+                rearToFront ? (rearLeft ? kFL : kFR) :
+                rearLeft || rearRight ? rearAlt :
+                BIT == AUDIO_CHANNEL_OUT_FRONT_LEFT_OF_CENTER ? kFL :
+                BIT == AUDIO_CHANNEL_OUT_FRONT_RIGHT_OF_CENTER ? kFR : 0,
+        secondary = mono ? kFR :
+                split ? (splitToBack ? kBR : kFR) : 0,
+    };
+};
+
+// 0 for left, 1 for right and 2 for center output channels, an index into the volumes
+template <uint32_t BIT>
+struct ChannelSide {
+    enum {
+        value = (BIT & (AUDIO_CHANNEL_OUT_FRONT_LEFT | AUDIO_CHANNEL_OUT_BACK_LEFT |
+                        AUDIO_CHANNEL_OUT_FRONT_LEFT_OF_CENTER |
+                        AUDIO_CHANNEL_OUT_SIDE_LEFT)) ? 0 :
+                (BIT & (AUDIO_CHANNEL_OUT_FRONT_RIGHT | AUDIO_CHANNEL_OUT_BACK_RIGHT |
+                        AUDIO_CHANNEL_OUT_FRONT_RIGHT_OF_CENTER |
+                        AUDIO_CHANNEL_OUT_SIDE_RIGHT)) ? 1 : 2
+    };
+};
+
+// Mixes one frame, recursing over the REMAINING input channels lowest bit first.
+// vol[] holds the left, right and center volumes.
+template <uint32_t IN_MASK, uint32_t OUT_MASK, uint32_t REMAINING, typename TI>
+struct ChannelMixer {
+    static inline void mix(float *out, const TI *in, const float *vol) {
+        enum { BIT = REMAINING & (~REMAINING + 1) };
+        typedef ChannelRoute<IN_MASK, OUT_MASK, BIT> Route;
+        const float gain = Route::attenuate ? kMinus3dB : 1.0f;
+        const float s = mixer_input(in, ChannelIndex<IN_MASK, BIT>::value) * gain;
+        if (Route::primary != 0) {
+            out[ChannelIndex<OUT_MASK, Route::primary>::value] +=
+                    s * vol[ChannelSide<Route::primary>::value];
+        }
+        if (Route::secondary != 0) {
+            out[ChannelIndex<OUT_MASK, Route::secondary>::value] +=
+                    s * vol[ChannelSide<Route::secondary>::value];
+        }
+        ChannelMixer<IN_MASK, OUT_MASK, REMAINING & (REMAINING - 1), TI>::mix(out, in, vol);
+    }
+
+    // sum of the REMAINING input channels, for the aux send
+    static inline float sum(const TI *in) {
+        enum { BIT = REMAINING & (~REMAINING + 1) };
+        return mixer_input(in, ChannelIndex<IN_MASK, BIT>::value) +
+                ChannelMixer<IN_MASK, OUT_MASK, REMAINING & (REMAINING - 1), TI>::sum(in);
+    }
+};
+
+template <uint32_t IN_MASK, uint32_t OUT_MASK, typename TI>
+struct ChannelMixer<IN_MASK, OUT_MASK, 0, TI> {
+    static inline void mix(float *, const TI *, const float *) { }
+    static inline float sum(const TI *) { return 0; }
+};
+
+// Like volumeMulAdd() for IN_MASK input mixed into OUT_MASK output.  The aux send gets the
+// average of all input channels.
+template <uint32_t IN_MASK, uint32_t OUT_MASK, typename TI>
+inline void channelMixMulAdd(float * __restrict out, const TI * __restrict in,
+        size_t frameCount, const float *vol, int32_t * __restrict aux, float va)
+{
+    typedef ChannelMixer<IN_MASK, OUT_MASK, IN_MASK, TI> Mixer;
+    const size_t nIn = ChannelCount<IN_MASK>::value;
+    const size_t nOut = ChannelCount<OUT_MASK>::value;
+    const float v[3] = { vol[0], vol[1], (vol[0] + vol[1]) * 0.5f };
+    if (aux != NULL) {
+        const float vaNorm = va / nIn;
+        for (size_t i = 0; i < frameCount; ++i) {
+            Mixer::mix(out + i * nOut, in + i * nIn, v);
+            aux[i] += clampq4_27_from_float(Mixer::sum(in + i * nIn) * vaNorm);
+        }
+    } else {
+        for (size_t i = 0; i < frameCount; ++i) {
+            Mixer::mix(out + i * nOut, in + i * nIn, v);
+        }
+    }
+}
+
+// Like volumeRampMulAdd() for IN_MASK input mixed into OUT_MASK output.
+template <uint32_t IN_MASK, uint32_t OUT_MASK, typename TI>
+inline void channelMixRampMulAdd(float * __restrict out, const TI * __restrict in,
+        size_t frameCount, float *vol, const float *volInc, int32_t * __restrict aux,
+        float *va, float vaInc)
+{
+    typedef ChannelMixer<IN_MASK, OUT_MASK, IN_MASK, TI> Mixer;
+    const size_t nIn = ChannelCount<IN_MASK>::value;
+    const size_t nOut = ChannelCount<OUT_MASK>::value;
+    const float vl = vol[0];
+    const float vr = vol[1];
+    const float vlInc = volInc[0];
+    const float vrInc = volInc[1];
+    for (size_t i = 0; i < frameCount; ++i) {
+        const float l = vl + vlInc * i;
+        const float r = vr + vrInc * i;
+        const float v[3] = { l, r, (l + r) * 0.5f };
+        Mixer::mix(out + i * nOut, in + i * nIn, v);
+    }
+    if (aux != NULL) {
+        const float a0 = *va;
+        for (size_t i = 0; i < frameCount; ++i) {
+            aux[i] += clampq4_27_from_float(Mixer::sum(in + i * nIn) * (a0 + vaInc * i) / nIn);
+        }
+        *va = a0 + vaInc * frameCount;
+    }
+    vol[0] = vl + vlInc * frameCount;
+    vol[1] = vr + vrInc * frameCount;
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_AUDIO_MIXER_OPS_H
@@ -25,6 +25,7 @@
 #include "AudioResampler.h"
 #include "AudioResamplerSinc.h"
 #include "AudioResamplerCubic.h"
+#include "AudioResamplerPolyphase.h"
 
 #ifdef __arm__
 #include <machine/cpu-features.h>
@@ -85,6 +86,7 @@ bool AudioResampler::qualityIsSupported(src_quality quality)
     case MED_QUALITY:
     case HIGH_QUALITY:
     case VERY_HIGH_QUALITY:
+    case POLYPHASE_QUALITY:
         return true;
     default:
         return false;
@@ -105,7 +107,7 @@ void AudioResampler::init_routine()
         if (*endptr == '\0') {
             defaultQuality = (src_quality) l;
             ALOGD("forcing AudioResampler quality to %d", defaultQuality);
-            if (defaultQuality < DEFAULT_QUALITY || defaultQuality > VERY_HIGH_QUALITY) {
+            if (defaultQuality < DEFAULT_QUALITY || defaultQuality > POLYPHASE_QUALITY) {
                 defaultQuality = DEFAULT_QUALITY;
             }
         }
@@ -125,6 +127,9 @@ uint32_t AudioResampler::qualityMHz(src_quality quality)
         return 20;
     case VERY_HIGH_QUALITY:
         return 34;
+    case POLYPHASE_QUALITY:
+        // cheaper than HIGH_QUALITY when upsampling, up to twice the taps when downsampling
+        return 20;
     }
 }
 
@@ -134,6 +139,20 @@ static uint32_t currentMHz = 0;
 
 AudioResampler* AudioResampler::create(int bitDepth, int inChannelCount,
         int32_t sampleRate, src_quality quality) {
+    if (bitDepth != 16) {
+        ALOGE("Unsupported sample format, %d bits", bitDepth);
+    }
+    return create(AUDIO_FORMAT_PCM_16_BIT, inChannelCount, sampleRate, quality);
+}
+
+AudioResampler* AudioResampler::create(audio_format_t format, int inChannelCount,
+        int32_t sampleRate, src_quality quality) {
+
+    // only the polyphase resampler reads float
+    if (format == AUDIO_FORMAT_PCM_FLOAT && quality != POLYPHASE_QUALITY) {
+        ALOGV("float input, using the polyphase resampler instead of quality %d", quality);
+        quality = POLYPHASE_QUALITY;
+    }
 
     bool atFinalQuality;
     if (quality == DEFAULT_QUALITY) {
@@ -147,6 +166,9 @@ AudioResampler* AudioResampler::create(int bitDepth, int inChannelCount,
     } else {
         atFinalQuality = true;
     }
+    if (format == AUDIO_FORMAT_PCM_FLOAT) {
+        atFinalQuality = true;
+    }
 
     // naive implementation of CPU load throttling doesn't account for whether resampler is active
     pthread_mutex_lock(&mutex);
@@ -173,6 +195,7 @@ AudioResampler* AudioResampler::create(int bitDepth, int inChannelCount,
             quality = MED_QUALITY;
             break;
         case VERY_HIGH_QUALITY:
+        case POLYPHASE_QUALITY:
             quality = HIGH_QUALITY;
             break;
         }
@@ -181,6 +204,8 @@ AudioResampler* AudioResampler::create(int bitDepth, int inChannelCount,
 
     AudioResampler* resampler;
 
+    // the other resamplers only take 16-bit input, passed to them as a bit depth
+    const int bitDepth = 16;
     switch (quality) {
     default:
     case DEFAULT_QUALITY:
@@ -200,6 +225,10 @@ AudioResampler* AudioResampler::create(int bitDepth, int inChannelCount,
         ALOGV("Create VERY_HIGH_QUALITY sinc Resampler = %d", quality);
         resampler = new AudioResamplerSinc(bitDepth, inChannelCount, sampleRate, quality);
         break;
+    case POLYPHASE_QUALITY:
+        ALOGV("Create polyphase Resampler");
+        resampler = new AudioResamplerPolyphase(format, inChannelCount, sampleRate);
+        break;
     }
 
     // initialize resampler
@@ -209,7 +238,7 @@ AudioResampler* AudioResampler::create(int bitDepth, int inChannelCount,
 
 AudioResampler::AudioResampler(int bitDepth, int inChannelCount,
         int32_t sampleRate, src_quality quality) :
-    mBitDepth(bitDepth), mChannelCount(inChannelCount),
+    mFormat(AUDIO_FORMAT_PCM_16_BIT), mBitDepth(bitDepth), mChannelCount(inChannelCount),
             mSampleRate(sampleRate), mInSampleRate(sampleRate), mInputIndex(0),
             mPhaseFraction(0), mLocalTimeFreq(0),
             mPTS(AudioBufferProvider::kInvalidPTS), mQuality(quality) {
@@ -229,6 +258,26 @@ AudioResampler::AudioResampler(int bitDepth, int inChannelCount,
 
 }
 
+AudioResampler::AudioResampler(audio_format_t format, int inChannelCount,
+        int32_t sampleRate, src_quality quality) :
+    mFormat(format), mBitDepth(format == AUDIO_FORMAT_PCM_FLOAT ? 32 : 16),
+            mChannelCount(inChannelCount),
+            mSampleRate(sampleRate), mInSampleRate(sampleRate), mInputIndex(0),
+            mPhaseFraction(0), mLocalTimeFreq(0),
+            mPTS(AudioBufferProvider::kInvalidPTS), mQuality(quality) {
+    // sanity check on format
+    if ((format != AUDIO_FORMAT_PCM_16_BIT && format != AUDIO_FORMAT_PCM_FLOAT) ||
+            (inChannelCount < 1) || (inChannelCount > 2)) {
+        ALOGE("Unsupported sample format %#x, %d channels", format, inChannelCount);
+    }
+    if (sampleRate <= 0) {
+        ALOGE("Unsupported sample rate %d Hz", sampleRate);
+    }
+
+    mVolume[0] = mVolume[1] = 0;
+    mBuffer.frameCount = 0;
+}
+
 AudioResampler::~AudioResampler() {
     pthread_mutex_lock(&mutex);
     src_quality quality = getQuality();
@@ -252,6 +301,11 @@ void AudioResampler::setVolume(int16_t left, int16_t right) {
     mVolume[1] = right;
 }
 
+void AudioResampler::resampleFloat(float* out, size_t outFrameCount,
+        AudioBufferProvider* provider) {
+    LOG_ALWAYS_FATAL("resampler quality %d has no float output", mQuality);
+}
+
 void AudioResampler::setLocalTimeFreq(uint64_t freq) {
     mLocalTimeFreq = freq;
 }
@@ -20,6 +20,7 @@
 #include <stdint.h>
 #include <sys/types.h>
 #include <cutils/compiler.h>
+#include <system/audio.h>
 
 #include <media/AudioBufferProvider.h>
 
@@ -32,20 +33,29 @@ public:
     //  LOW_QUALITY: linear interpolator (1st order)
     //  MED_QUALITY: cubic interpolator (3rd order)
     //  HIGH_QUALITY: fixed multi-tap FIR (e.g. 48KHz->44.1KHz)
+    //  POLYPHASE_QUALITY: polyphase FIR designed for the actual ratio, float I/O
     // NOTE: high quality SRC will only be supported for
     // certain fixed rate conversions. Sample rate cannot be
-    // changed dynamically.
+    // changed dynamically.  POLYPHASE_QUALITY supports any
+    // ratio up to 2:1 downsampling, and rate changes.
     enum src_quality {
         DEFAULT_QUALITY=0,
         LOW_QUALITY=1,
         MED_QUALITY=2,
         HIGH_QUALITY=3,
         VERY_HIGH_QUALITY=4,
+        POLYPHASE_QUALITY=5,
     };
 
     static AudioResampler* create(int bitDepth, int inChannelCount,
             int32_t sampleRate, src_quality quality=DEFAULT_QUALITY);
 
+    // As above, with the format of the samples delivered by the provider.
+    // AUDIO_FORMAT_PCM_FLOAT is only read by POLYPHASE_QUALITY, which is then used
+    // whatever the requested quality.
+    static AudioResampler* create(audio_format_t format, int inChannelCount,
+            int32_t sampleRate, src_quality quality=DEFAULT_QUALITY);
+
     virtual ~AudioResampler();
 
     virtual void init() = 0;
@@ -67,9 +77,17 @@ public:
     virtual void resample(int32_t* out, size_t outFrameCount,
             AudioBufferProvider* provider) = 0;
 
+    // Resample like resample(), but accumulate float samples with full scale 1.0 into 'out'.
+    // Only supported if hasFloatOutput().
+    virtual bool hasFloatOutput() const { return false; }
+    virtual void resampleFloat(float* out, size_t outFrameCount,
+            AudioBufferProvider* provider);
+
     virtual void reset();
     virtual size_t getUnreleasedFrames() const { return mInputIndex; }
 
+    audio_format_t getFormat() const { return mFormat; }
+
     // called from destructor, so must not be virtual
     src_quality getQuality() const { return mQuality; }
 
@@ -84,6 +102,8 @@ protected:
     static const double kPhaseMultiplier = 1L << kNumPhaseBits;
 
     AudioResampler(int bitDepth, int inChannelCount, int32_t sampleRate, src_quality quality);
+    AudioResampler(audio_format_t format, int inChannelCount, int32_t sampleRate,
+            src_quality quality);
 
     // prevent copying
     AudioResampler(const AudioResampler&);
@@ -91,6 +111,7 @@ protected:
 
     int64_t calculateOutputPTS(int outputFrameIndex);
 
+    const audio_format_t mFormat;
     const int32_t mBitDepth;
     const int32_t mChannelCount;
     const int32_t mSampleRate;
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_RESAMPLER_FIR_GEN_H
+#define ANDROID_AUDIO_RESAMPLER_FIR_GEN_H
+
+#include <math.h>
+
+// Kaiser windowed sinc low pass filter design, shared by the "fir" coefficient generator in
+// tools/resampler_tools and by AudioResamplerPolyphase, which designs its polyphase bank at
+// run time for the actual sample rate ratio.
+
+namespace android {
+
+static inline double firSinc(double x) {
+    if (fabs(x) == 0.0f) return 1.0f;
+    return sin(x) / x;
+}
+
+static inline double firSqr(double x) {
+    return x*x;
+}
+
+static inline double firI0(double x) {
+    // from the Numerical Recipes in C p. 237
+    double ax,ans,y;
+    ax=fabs(x);
+    if (ax < 3.75) {
+        y=x/3.75;
+        y*=y;
+        ans=1.0+y*(3.5156229+y*(3.0899424+y*(1.2067492
+                +y*(0.2659732+y*(0.360768e-1+y*0.45813e-2)))));
+    } else {
+        y=3.75/ax;
+        ans=(exp(ax)/sqrt(ax))*(0.39894228+y*(0.1328592e-1
+                +y*(0.225319e-2+y*(-0.157565e-2+y*(0.916281e-2
+                        +y*(-0.2057706e-1+y*(0.2635537e-1+y*(-0.1647633e-1
+                                +y*0.392377e-2))))))));
+    }
+    return ans;
+}
+
+// discrete window of N+1 points, 0 <= k <= N
+static inline double firKaiser(int k, int N, double beta) {
+    if (k < 0 || k > N)
+        return 0;
+    return firI0(beta * sqrt(1.0 - firSqr((2.0*k)/N - 1.0))) / firI0(beta);
+}
+
+// continuous window over -halfWidth < x < halfWidth
+static inline double firKaiserWindow(double x, double halfWidth, double beta) {
+    if (fabs(x) >= halfWidth)
+        return 0;
+    return firI0(beta * sqrt(1.0 - firSqr(x / halfWidth))) / firI0(beta);
+}
+
+// Kaiser beta for a stop band attenuation in dB:
+//         | 0.1102*(A - 8.7)                         A > 50
+//  beta = | 0.5842*(A - 21)^0.4 + 0.07886*(A - 21)   21 <= A <= 50
+//         | 0                                        A < 21
+static inline double firKaiserBeta(double attenuationDb) {
+    if (attenuationDb > 50)
+        return 0.1102 * (attenuationDb - 8.7);
+    if (attenuationDb >= 21)
+        return 0.5842 * pow(attenuationDb - 21, 0.4) + 0.07886 * (attenuationDb - 21);
+    return 0;
+}
+
+// Transition band in cycles per sample of a Kaiser windowed filter with numTaps taps:
+//   numTaps = (A - 8) / (2.285 * dw), with dw = 2*pi*dF
+static inline double firTransitionWidth(double attenuationDb, int numTaps) {
+    return (attenuationDb - 8) / (2.285 * 2.0 * M_PI * numTaps);
+}
+
+// Impulse response of the low pass at a distance of x input samples from its center, for a
+// cut-off of Fcr cycles per input sample and halfNumCoefs samples on each side.
+static inline double firLowPass(double x, double Fcr, int halfNumCoefs, double beta) {
+    return firKaiserWindow(x, halfNumCoefs, beta) * firSinc(2.0 * M_PI * Fcr * x) * 2.0 * Fcr;
+}
+
+}; // namespace android
+
+#endif // ANDROID_AUDIO_RESAMPLER_FIR_GEN_H
@@ -0,0 +1,623 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "AudioResamplerPolyphase"
+//#define LOG_NDEBUG 0
+
+#include <malloc.h>
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <cutils/compiler.h>
+#include <utils/Log.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+#include "AudioResamplerPolyphase.h"
+#include "AudioResamplerFirGen.h"
+
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#define USE_NEON (true)
+#else
+#define USE_NEON (false)
+#endif
+
+#if !USE_NEON && defined(__SSE__)
+#include <xmmintrin.h>
+#define USE_SSE (true)
+#else
+#define USE_SSE (false)
+#endif
+
+namespace android {
+// ----------------------------------------------------------------------------
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while (b != 0) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Dot product of numTaps coefficients with numTaps frames of x, numTaps a multiple of 4.
+// When INTERPOLATE, the coefficients are c0 + w * (c1 - c0).  For mono, r is not written.
+template<int CHANNELS, bool INTERPOLATE>
+static inline void dotProduct(float& l, float& r, const float* c0, const float* c1, float w,
+        const float* x, int numTaps)
+{
+#if USE_NEON
+    const float32x4_t zero = vdupq_n_f32(0);
+    float32x4_t accL = zero;
+    float32x4_t accR = zero;
+    for (int j = 0; j < numTaps; j += 4) {
+        float32x4_t c = vld1q_f32(c0 + j);
+        if (INTERPOLATE) {
+            c = vmlaq_n_f32(c, vsubq_f32(vld1q_f32(c1 + j), c), w);
+        }
+        if (CHANNELS == 1) {
+            accL = vmlaq_f32(accL, c, vld1q_f32(x + j));
+        } else {
+            float32x4x2_t s = vld2q_f32(x + 2 * j);
+            accL = vmlaq_f32(accL, c, s.val[0]);
+            accR = vmlaq_f32(accR, c, s.val[1]);
+        }
+    }
+    float32x2_t sumL = vadd_f32(vget_low_f32(accL), vget_high_f32(accL));
+    if (CHANNELS == 1) {
+        l = vget_lane_f32(vpadd_f32(sumL, sumL), 0);
+    } else {
+        float32x2_t sumR = vadd_f32(vget_low_f32(accR), vget_high_f32(accR));
+        float32x2_t sum = vpadd_f32(sumL, sumR);
+        l = vget_lane_f32(sum, 0);
+        r = vget_lane_f32(sum, 1);
+    }
+#elif USE_SSE
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    const __m128 weight = _mm_set1_ps(w);
+    for (int j = 0; j < numTaps; j += 4) {
+        __m128 c = _mm_load_ps(c0 + j);
+        if (INTERPOLATE) {
+            c = _mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(c1 + j), c), weight));
+        }
+        if (CHANNELS == 1) {
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(c, _mm_loadu_ps(x + j)));
+        } else {
+            // frames are interleaved, pair each coefficient with both of its samples
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_unpacklo_ps(c, c),
+                    _mm_loadu_ps(x + 2 * j)));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_unpackhi_ps(c, c),
+                    _mm_loadu_ps(x + 2 * j + 4)));
+        }
+    }
+    if (CHANNELS == 1) {
+        // l = acc0[0] + acc0[1] + acc0[2] + acc0[3]
+        acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+        acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+        _mm_store_ss(&l, acc0);
+    } else {
+        // l = acc[0] + acc[2], r = acc[1] + acc[3]
+        acc0 = _mm_add_ps(acc0, acc1);
+        acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+        _mm_store_ss(&l, acc0);
+        _mm_store_ss(&r, _mm_shuffle_ps(acc0, acc0, 1));
+    }
+#else
+    float accL = 0;
+    float accR = 0;
+    for (int j = 0; j < numTaps; ++j) {
+        float c = c0[j];
+        if (INTERPOLATE) {
+            c += (c1[j] - c) * w;
+        }
+        accL += c * x[j * CHANNELS];
+        if (CHANNELS == 2) {
+            accR += c * x[j * CHANNELS + 1];
+        }
+    }
+    l = accL;
+    r = accR;
+#endif
+}
+
+static inline void accumulate(int32_t* out, float l, float r, const float* gain)
+{
+    out[0] += (int32_t) lrintf(l * gain[0]);
+    out[1] += (int32_t) lrintf(r * gain[1]);
+}
+
+static inline void accumulate(float* out, float l, float r, const float* gain)
+{
+    out[0] += l * gain[0];
+    out[1] += r * gain[1];
+}
+
+// ----------------------------------------------------------------------------
+
+struct AudioResamplerPolyphase::BankRequest {
+    BankRequest() : mPending(false), mReady(NULL), mRetired(NULL) {}
+
+    bool        mPending;           // mLayout is wanted and not delivered yet
+    Layout      mLayout;
+    Bank*       mReady;             // designed, not picked up by the resampler yet
+    Bank*       mRetired;           // no longer used, to be freed by the designer
+};
+
+// Designs the banks requested by changes of rate and frees the ones they replace, off the
+// mixer thread.  The mixer thread only ever tries its lock.
+class AudioResamplerPolyphase::BankDesigner : public Thread {
+public:
+    BankDesigner() : Thread(false /*canCallJava*/) {}
+
+    static void add(BankRequest* request);
+    static void remove(BankRequest* request);
+
+    static Mutex sLock;
+    static Condition sCond;
+
+private:
+    virtual bool threadLoop();
+
+    static Vector<BankRequest*> sRequests;
+    static sp<BankDesigner> sDesigner;
+};
+
+Mutex AudioResamplerPolyphase::BankDesigner::sLock;
+Condition AudioResamplerPolyphase::BankDesigner::sCond;
+Vector<AudioResamplerPolyphase::BankRequest*> AudioResamplerPolyphase::BankDesigner::sRequests;
+sp<AudioResamplerPolyphase::BankDesigner> AudioResamplerPolyphase::BankDesigner::sDesigner;
+
+void AudioResamplerPolyphase::BankDesigner::add(BankRequest* request)
+{
+    Mutex::Autolock _l(sLock);
+    if (sDesigner == 0) {
+        sDesigner = new BankDesigner();
+        sDesigner->run("AudioResamplerPolyphase", ANDROID_PRIORITY_NORMAL);
+    }
+    sRequests.add(request);
+}
+
+void AudioResamplerPolyphase::BankDesigner::remove(BankRequest* request)
+{
+    Mutex::Autolock _l(sLock);
+    for (size_t i = 0; i < sRequests.size(); ++i) {
+        if (sRequests[i] == request) {
+            sRequests.removeAt(i);
+            break;
+        }
+    }
+}
+
+bool AudioResamplerPolyphase::BankDesigner::threadLoop()
+{
+    sLock.lock();
+    Bank* retired = NULL;
+    BankRequest* request = NULL;
+    for (size_t i = 0; i < sRequests.size(); ++i) {
+        BankRequest* r = sRequests[i];
+        while (r->mRetired != NULL) {
+            Bank* bank = r->mRetired;
+            r->mRetired = bank->next;
+            bank->next = retired;
+            retired = bank;
+        }
+        if (r->mPending && request == NULL) {
+            request = r;
+        }
+    }
+    if (retired == NULL && request == NULL) {
+        sCond.wait(sLock);
+        sLock.unlock();
+        return true;
+    }
+    Layout layout;
+    if (request != NULL) {
+        layout = request->mLayout;
+    }
+    sLock.unlock();
+
+    freeBanks(retired);
+    if (request == NULL) {
+        return true;
+    }
+    Bank* bank = designBank(layout);
+
+    // the resampler may have asked for another bank, or be gone, in the meantime
+    sLock.lock();
+    for (size_t i = 0; i < sRequests.size(); ++i) {
+        if (sRequests[i] == request) {
+            if (request->mPending && sameLayout(request->mLayout, layout)) {
+                request->mPending = false;
+                bank->next = request->mReady;
+                request->mReady = bank;
+                bank = NULL;
+            }
+            break;
+        }
+    }
+    sLock.unlock();
+    freeBanks(bank);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+AudioResamplerPolyphase::AudioResamplerPolyphase(audio_format_t format, int inChannelCount,
+        int32_t sampleRate)
+    : AudioResampler(format, inChannelCount, sampleRate, POLYPHASE_QUALITY),
+    mBank(NULL), mRequest(NULL), mBankWanted(true), mPhase(0), mStepInt(1), mStepFrac(0),
+    mHistory(NULL), mHistoryFrames(0), mHistoryStart(0)
+{
+    mGainQ27[0] = mGainQ27[1] = 0;
+    mGainFloat[0] = mGainFloat[1] = 0;
+}
+
+AudioResamplerPolyphase::~AudioResamplerPolyphase()
+{
+    if (mRequest != NULL) {
+        BankDesigner::remove(mRequest);
+        freeBanks(mRequest->mReady);
+        freeBanks(mRequest->mRetired);
+        delete mRequest;
+    }
+    freeBanks(mBank);
+    free(mHistory);
+}
+
+void AudioResamplerPolyphase::init()
+{
+    mHistory = (float*) memalign(32,
+            (kMaxNumTaps + kInputBlockFrames) * mChannelCount * sizeof(float));
+    getLayout(mInSampleRate, mSampleRate, &mWantedLayout);
+    mRequest = new BankRequest();
+    BankDesigner::add(mRequest);
+    reset();
+}
+
+void AudioResamplerPolyphase::reset()
+{
+    AudioResampler::reset();
+    // the first output is centered on the first input frame
+    mHistoryFrames = (mBank != NULL ? mBank->halfNumCoefs : mWantedLayout.halfNumCoefs) - 1;
+    mHistoryStart = 0;
+    memset(mHistory, 0, mHistoryFrames * mChannelCount * sizeof(float));
+    mPhase = 0;
+}
+
+void AudioResamplerPolyphase::setSampleRate(int32_t inSampleRate)
+{
+    // called for every buffer by AudioMixer, only look for a bank on an actual change
+    if (inSampleRate != mInSampleRate) {
+        AudioResampler::setSampleRate(inSampleRate);
+        getLayout(mInSampleRate, mSampleRate, &mWantedLayout);
+        mBankWanted = true;
+    }
+    if (!mBankWanted) {
+        return;
+    }
+
+    if (mBank == NULL) {
+        // set up with the track, before anything is mixed
+        useBank(designBank(mWantedLayout));
+        mBankWanted = false;
+        reset();
+        return;
+    }
+    if (sameLayout(*mBank, mWantedLayout)) {
+        // the bank does not depend on the ratio when interpolating without downsampling
+        useBank(mBank);
+        mBankWanted = false;
+    }
+
+    // keep mixing at the previous rate until the designer delivers, retry on contention
+    if (BankDesigner::sLock.tryLock() != NO_ERROR) {
+        return;
+    }
+    BankRequest* const request = mRequest;
+    Bank* ready = request->mReady;
+    request->mReady = NULL;
+    if (mBankWanted && ready != NULL && sameLayout(*ready, mWantedLayout)) {
+        Bank* stale = ready->next;
+        ready->next = NULL;
+        mBank->next = stale;
+        stale = mBank;
+        useBank(ready);
+        mBankWanted = false;
+        ready = stale;
+    }
+    // whatever is left is for an older rate
+    while (ready != NULL) {
+        Bank* bank = ready;
+        ready = bank->next;
+        bank->next = request->mRetired;
+        request->mRetired = bank;
+    }
+    if (mBankWanted) {
+        if (!request->mPending || !sameLayout(request->mLayout, mWantedLayout)) {
+            request->mLayout = mWantedLayout;
+            request->mPending = true;
+            BankDesigner::sCond.signal();
+        }
+    } else {
+        request->mPending = false;
+        if (request->mRetired != NULL) {
+            BankDesigner::sCond.signal();
+        }
+    }
+    BankDesigner::sLock.unlock();
+}
+
+void AudioResamplerPolyphase::setVolume(int16_t left, int16_t right)
+{
+    AudioResampler::setVolume(left, right);
+    // Q3.12 volumes: a full scale float times (volume << 15) is a Q4.27 sample
+    mGainQ27[0] = left * 32768.0f;
+    mGainQ27[1] = right * 32768.0f;
+    mGainFloat[0] = left * (1.0f / 4096);
+    mGainFloat[1] = right * (1.0f / 4096);
+}
+
+void AudioResamplerPolyphase::getLayout(uint32_t inRate, uint32_t outRate, Layout* layout)
+{
+    const uint32_t L = outRate / gcd(inRate, outRate);
+
+    // when downsampling, the cut-off and transition band scale with the output rate, so the
+    // filter gets longer in input samples
+    double ratio = double(inRate) / outRate;
+    if (ratio < 1) {
+        ratio = 1;
+    } else if (ratio > kMaxDownsampleRatio) {
+        ALOGW("downsampling %u Hz to %u Hz exceeds %d:1, will alias", inRate, outRate,
+                kMaxDownsampleRatio);
+        ratio = kMaxDownsampleRatio;
+    }
+    int halfNumCoefs = (int) ceil(kHalfNumCoefs * ratio);
+    halfNumCoefs = (halfNumCoefs + 1) & ~1;
+    const double transition = firTransitionWidth(kStopBandAttenuationDb, 2 * kHalfNumCoefs);
+
+    layout->halfNumCoefs = halfNumCoefs;
+    layout->numTaps = 2 * halfNumCoefs;
+    layout->cutoff = (0.5 - transition / 2) / ratio;
+    layout->interpolate = size_t(L) * layout->numTaps > kMaxBankCoefs;
+    layout->numPhases = layout->interpolate ? 1 << kNumInterpPhaseBits : L;
+}
+
+bool AudioResamplerPolyphase::sameLayout(const Layout& a, const Layout& b)
+{
+    return a.numTaps == b.numTaps && a.numPhases == b.numPhases &&
+            a.interpolate == b.interpolate && a.cutoff == b.cutoff;
+}
+
+AudioResamplerPolyphase::Bank* AudioResamplerPolyphase::designBank(const Layout& layout)
+{
+    ALOGV("designing %u phases of %d taps, cut-off %f%s", layout.numPhases, layout.numTaps,
+            layout.cutoff, layout.interpolate ? ", interpolated" : "");
+    const double beta = firKaiserBeta(kStopBandAttenuationDb);
+    const uint32_t numBankPhases = layout.interpolate ? layout.numPhases + 1 : layout.numPhases;
+    Bank* bank = new Bank();
+    static_cast<Layout&>(*bank) = layout;
+    bank->coefs = (float*) memalign(32, numBankPhases * layout.numTaps * sizeof(float));
+    bank->next = NULL;
+    for (uint32_t p = 0; p < numBankPhases; ++p) {
+        const double frac = double(p) / layout.numPhases;
+        float* coefs = bank->coefs + p * layout.numTaps;
+        for (int j = 0; j < layout.numTaps; ++j) {
+            // distance from input frame mHistoryStart + j to the output
+            coefs[j] = firLowPass(frac + layout.halfNumCoefs - 1 - j, layout.cutoff,
+                    layout.halfNumCoefs, beta);
+        }
+    }
+    return bank;
+}
+
+void AudioResamplerPolyphase::freeBanks(Bank* bank)
+{
+    while (bank != NULL) {
+        Bank* next = bank->next;
+        free(bank->coefs);
+        delete bank;
+        bank = next;
+    }
+}
+
+void AudioResamplerPolyphase::useBank(Bank* bank)
+{
+    const uint32_t inRate = mInSampleRate;
+    const uint32_t outRate = mSampleRate;
+
+    // carry the position over to the new bank
+    double fraction = 0;
+    if (mBank != NULL) {
+        fraction = mBank->interpolate ? mPhase / 4294967296.0 :
+                double(mPhase) / mBank->numPhases;
+    }
+    if (bank->interpolate) {
+        mPhase = uint32_t(fraction * 4294967296.0);
+        mStepInt = inRate / outRate;
+        mStepFrac = uint32_t((uint64_t(inRate % outRate) << 32) / outRate);
+    } else {
+        const uint32_t g = gcd(inRate, outRate);
+        const uint32_t L = outRate / g;
+        const uint32_t M = inRate / g;
+        mPhase = uint32_t(fraction * bank->numPhases);
+        mStepInt = M / L;
+        mStepFrac = M % L;
+    }
+    if (mBank != NULL && bank->halfNumCoefs != mBank->halfNumCoefs) {
+        // keep the center of the window; at the very start there may not be enough history
+        // for a longer filter, so the position jumps a few frames
+        ssize_t start = ssize_t(mHistoryStart) + mBank->halfNumCoefs - bank->halfNumCoefs;
+        mHistoryStart = start < 0 ? 0 : start;
+    }
+    mBank = bank;
+}
+
+template<int CHANNELS>
+bool AudioResamplerPolyphase::fill(AudioBufferProvider* provider, size_t framesWanted,
+        int64_t pts)
+{
+    if (mBuffer.frameCount == 0) {
+        mBuffer.frameCount = framesWanted;
+        provider->getNextBuffer(&mBuffer, pts);
+        if (mBuffer.raw == NULL) {
+            return false;
+        }
+        mInputIndex = 0;
+    }
+
+    // beyond kMaxDownsampleRatio a step may jump past the buffered input, skip the gap
+    if (mHistoryStart > mHistoryFrames) {
+        size_t skip = mHistoryStart - mHistoryFrames;
+        if (skip > mBuffer.frameCount - mInputIndex) {
+            skip = mBuffer.frameCount - mInputIndex;
+        }
+        mHistoryStart -= skip;
+        mInputIndex += skip;
+        if (mInputIndex == mBuffer.frameCount) {
+            provider->releaseBuffer(&mBuffer);
+            mBuffer.frameCount = 0;
+            mInputIndex = 0;
+        }
+        return true;
+    }
+
+    // drop the frames behind the filter window to make room
+    const size_t capacity = kMaxNumTaps + kInputBlockFrames;
+    if (mHistoryFrames == capacity) {
+        mHistoryFrames -= mHistoryStart;
+        memmove(mHistory, mHistory + mHistoryStart * CHANNELS,
+                mHistoryFrames * CHANNELS * sizeof(float));
+        mHistoryStart = 0;
+    }
+
+    size_t frames = mBuffer.frameCount - mInputIndex;
+    if (frames > capacity - mHistoryFrames) {
+        frames = capacity - mHistoryFrames;
+    }
+    float* dst = mHistory + mHistoryFrames * CHANNELS;
+    if (mFormat == AUDIO_FORMAT_PCM_FLOAT) {
+        memcpy(dst, static_cast<const float*>(mBuffer.raw) + mInputIndex * CHANNELS,
+                frames * CHANNELS * sizeof(float));
+    } else {
+        const int16_t* src = mBuffer.i16 + mInputIndex * CHANNELS;
+        for (size_t i = 0; i < frames * CHANNELS; ++i) {
+            dst[i] = src[i] * (1.0f / 32768);
+        }
+    }
+    mHistoryFrames += frames;
+    mInputIndex += frames;
+    if (mInputIndex == mBuffer.frameCount) {
+        provider->releaseBuffer(&mBuffer);
+        mBuffer.frameCount = 0;
+        mInputIndex = 0;
+    }
+    return true;
+}
+
+template<int CHANNELS, bool INTERPOLATE, typename TO>
+void AudioResamplerPolyphase::resample(TO* out, size_t outFrameCount,
+        AudioBufferProvider* provider, const float* gain)
+{
+    const int numTaps = mBank->numTaps;
+    const float* const coefs = mBank->coefs;
+    const uint32_t numPhases = mBank->numPhases;
+    const uint32_t stepInt = mStepInt;
+    const uint32_t stepFrac = mStepFrac;
+    size_t start = mHistoryStart;
+    uint32_t phase = mPhase;
+    size_t outputIndex = 0;
+
+    while (outputIndex < outFrameCount) {
+        if (CC_UNLIKELY(start + numTaps > mHistoryFrames)) {
+            mHistoryStart = start;
+            size_t framesWanted = (outFrameCount - outputIndex) * mInSampleRate / mSampleRate
+                    + numTaps;
+            if (!fill<CHANNELS>(provider, framesWanted, calculateOutputPTS(outputIndex))) {
+                break;
+            }
+            start = mHistoryStart;
+            continue;
+        }
+
+        const float* x = mHistory + start * CHANNELS;
+        float l, r;
+        if (INTERPOLATE) {
+            const uint32_t index = phase >> (32 - kNumInterpPhaseBits);
+            const float w = (phase << kNumInterpPhaseBits) * (1.0f / 4294967296.0f);
+            const float* c0 = coefs + index * numTaps;
+            dotProduct<CHANNELS, true>(l, r, c0, c0 + numTaps, w, x, numTaps);
+        } else {
+            dotProduct<CHANNELS, false>(l, r, coefs + phase * numTaps, NULL, 0, x, numTaps);
+        }
+        accumulate(out + outputIndex * 2, l, CHANNELS == 1 ? l : r, gain);
+        outputIndex++;
+
+        start += stepInt;
+        if (INTERPOLATE) {
+            const uint32_t prev = phase;
+            phase += stepFrac;
+            start += phase < prev;
+        } else {
+            phase += stepFrac;
+            if (phase >= numPhases) {
+                phase -= numPhases;
+                start++;
+            }
+        }
+    }
+
+    mHistoryStart = start;
+    mPhase = phase;
+}
+
+template<typename TO>
+void AudioResamplerPolyphase::resample(TO* out, size_t outFrameCount,
+        AudioBufferProvider* provider, const float* gain)
+{
+    if (mBank->interpolate) {
+        if (mChannelCount == 1) {
+            resample<1, true>(out, outFrameCount, provider, gain);
+        } else {
+            resample<2, true>(out, outFrameCount, provider, gain);
+        }
+    } else {
+        if (mChannelCount == 1) {
+            resample<1, false>(out, outFrameCount, provider, gain);
+        } else {
+            resample<2, false>(out, outFrameCount, provider, gain);
+        }
+    }
+}
+
+void AudioResamplerPolyphase::resample(int32_t* out, size_t outFrameCount,
+        AudioBufferProvider* provider)
+{
+    resample(out, outFrameCount, provider, mGainQ27);
+}
+
+void AudioResamplerPolyphase::resampleFloat(float* out, size_t outFrameCount,
+        AudioBufferProvider* provider)
+{
+    resample(out, outFrameCount, provider, mGainFloat);
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_RESAMPLER_POLYPHASE_H
+#define ANDROID_AUDIO_RESAMPLER_POLYPHASE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <cutils/log.h>
+
+#include "AudioResampler.h"
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+// Polyphase FIR resampler with float I/O.  The bank of Kaiser windowed sinc filters is designed
+// for the actual ratio: with L/M the ratio reduced to its lowest terms, output frame n uses
+// phase (n * M) % L, one dot product per output frame.  When L is too large for an exact bank
+// (e.g. rates moved by a playback rate), the bank has a fixed number of phases and the
+// coefficients of the two nearest ones are interpolated.
+//
+// The first bank is designed by the first setSampleRate(), when the track is set up.  Later
+// changes of rate that need another bank are designed by a thread shared by all polyphase
+// resamplers, and the new rate takes effect once its bank is ready, so the mixer thread never
+// designs or allocates while mixing.
+//
+// The input is kept as float in a history buffer, so 16-bit and float providers share the
+// dot products, which are SIMD on NEON and SSE.
+class AudioResamplerPolyphase : public AudioResampler {
+public:
+    AudioResamplerPolyphase(audio_format_t format, int inChannelCount, int32_t sampleRate);
+
+    virtual ~AudioResamplerPolyphase();
+
+    virtual void setSampleRate(int32_t inSampleRate);
+    virtual void setVolume(int16_t left, int16_t right);
+
+    virtual void resample(int32_t* out, size_t outFrameCount,
+            AudioBufferProvider* provider);
+
+    virtual bool hasFloatOutput() const { return true; }
+    virtual void resampleFloat(float* out, size_t outFrameCount,
+            AudioBufferProvider* provider);
+
+    virtual void reset();
+
+private:
+    // number of zero-crossings on each side of the filter, when not downsampling
+    static const int kHalfNumCoefs = 32;
+
+    // stop band attenuation in dB
+    static const int kStopBandAttenuationDb = 90;
+
+    // downsampling widens the filter by the ratio, up to this factor
+    static const int kMaxDownsampleRatio = 2;
+    static const int kMaxNumTaps = 2 * kHalfNumCoefs * kMaxDownsampleRatio;
+
+    // largest exact bank, in coefficients; larger ones use interpolated phases
+    static const size_t kMaxBankCoefs = 16384;
+
+    // phases of the interpolated bank
+    static const int kNumInterpPhaseBits = 8;
+
+    // input frames converted to float at a time
+    static const size_t kInputBlockFrames = 256;
+
+    // shape of a bank, derived from the input and output sample rates
+    struct Layout {
+        int         halfNumCoefs;
+        int         numTaps;        // 2 * halfNumCoefs, a multiple of 4
+        uint32_t    numPhases;
+        bool        interpolate;
+        double      cutoff;         // cut-off frequency in cycles per input sample
+    };
+
+    struct Bank : public Layout {
+        float*      coefs;          // numPhases phases of numTaps coefficients,
+                                    // plus one phase when interpolating
+        Bank*       next;           // chains banks waiting to be freed
+    };
+
+    // banks requested from and delivered by the designer, guarded by its lock
+    struct BankRequest;
+    class BankDesigner;
+
+    void init();
+
+    static void getLayout(uint32_t inRate, uint32_t outRate, Layout* layout);
+    static bool sameLayout(const Layout& a, const Layout& b);
+
+    // allocates and computes a bank
+    static Bank* designBank(const Layout& layout);
+
+    // frees a chain of banks
+    static void freeBanks(Bank* bank);
+
+    // switches to a bank designed for the current sample rates, keeping the position
+    void useBank(Bank* bank);
+
+    // appends input to the history buffer, returns false if the provider has none
+    template<int CHANNELS>
+    bool fill(AudioBufferProvider* provider, size_t framesWanted, int64_t pts);
+
+    template<int CHANNELS, bool INTERPOLATE, typename TO>
+    void resample(TO* out, size_t outFrameCount, AudioBufferProvider* provider,
+            const float* gain);
+
+    template<typename TO>
+    void resample(TO* out, size_t outFrameCount, AudioBufferProvider* provider,
+            const float* gain);
+
+    Bank*       mBank;              // in use, NULL until the first setSampleRate()
+    BankRequest* mRequest;
+    bool        mBankWanted;        // mBank does not match the sample rates yet
+    Layout      mWantedLayout;      // for the sample rates, valid if mBankWanted
+
+    // Position of the next output between input frames mHistoryStart + halfNumCoefs - 1 and
+    // the one after: the exact phase in [0, numPhases), or a Q0.32 fraction when interpolating.
+    uint32_t    mPhase;
+    uint32_t    mStepInt;           // input frames per output frame, integer part
+    uint32_t    mStepFrac;          // and fractional part, same unit as mPhase
+
+    float*      mHistory;           // input frames, interleaved if stereo
+    size_t      mHistoryFrames;     // valid frames in mHistory
+    size_t      mHistoryStart;      // first frame of the filter window
+
+    float       mGainQ27[2];        // volumes for the Q4.27 output of resample()
+    float       mGainFloat[2];      // volumes for the float output of resampleFloat()
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+
+#endif /*ANDROID_AUDIO_RESAMPLER_POLYPHASE_H*/
@@ -27,6 +27,7 @@
 #include <media/EffectsFactoryApi.h>
 
 #include "AudioFlinger.h"
+#include "AudioMixerOps.h"
 #include "ServiceUtilities.h"
 
 // ----------------------------------------------------------------------------
@@ -66,7 +67,8 @@ AudioFlinger::EffectModule::EffectModule(ThreadBase *thread,
       mStatus(NO_INIT), mState(IDLE),
       // mMaxDisableWaitCnt is set by configure() and not used before then
       // mDisableWaitCnt is set by process() and updateState() and not used before then
-      mSuspended(false)
+      mSuspended(false),
+      mFormat(AUDIO_FORMAT_PCM_16_BIT)
 {
     ALOGV("Constructor %p", this);
     int lStatus;
@@ -328,8 +330,8 @@ status_t AudioFlinger::EffectModule::configure()
         mConfig.inputCfg.channels = channelMask;
     }
     mConfig.outputCfg.channels = channelMask;
-    mConfig.inputCfg.format = AUDIO_FORMAT_PCM_16_BIT;
-    mConfig.outputCfg.format = AUDIO_FORMAT_PCM_16_BIT;
+    mConfig.inputCfg.format = mFormat;
+    mConfig.outputCfg.format = mFormat;
     mConfig.inputCfg.samplingRate = thread->sampleRate();
     mConfig.outputCfg.samplingRate = mConfig.inputCfg.samplingRate;
     mConfig.inputCfg.bufferProvider.cookie = NULL;
@@ -1202,7 +1204,8 @@ void AudioFlinger::EffectHandle::dump(char* buffer, size_t size)
 
 AudioFlinger::EffectChain::EffectChain(ThreadBase *thread,
                                         int sessionId)
-    : mThread(thread), mSessionId(sessionId), mActiveTrackCnt(0), mTrackCnt(0), mTailBufferCount(0),
+    : mThread(thread), mSessionId(sessionId), mBufferFormat(AUDIO_FORMAT_PCM_16_BIT),
+      mConvertBuffer(NULL), mActiveTrackCnt(0), mTrackCnt(0), mTailBufferCount(0),
       mOwnInBuffer(false), mVolumeCtrlIdx(-1), mLeftVolume(UINT_MAX), mRightVolume(UINT_MAX),
       mNewLeftVolume(UINT_MAX), mNewRightVolume(UINT_MAX)
 {
@@ -1217,9 +1220,13 @@ AudioFlinger::EffectChain::EffectChain(ThreadBase *thread,
 AudioFlinger::EffectChain::~EffectChain()
 {
     if (mOwnInBuffer) {
-        delete mInBuffer;
+        if (mBufferFormat == AUDIO_FORMAT_PCM_FLOAT) {
+            delete[] (float *) mInBuffer;
+        } else {
+            delete[] mInBuffer;
+        }
     }
-
+    delete[] mConvertBuffer;
 }
 
 // getEffectFromDesc_l() must be called with ThreadBase::mLock held
@@ -1278,7 +1285,11 @@ void AudioFlinger::EffectChain::clearInputBuffer()
 // Must be called with EffectChain::mLock locked
 void AudioFlinger::EffectChain::clearInputBuffer_l(sp<ThreadBase> thread)
 {
-    memset(mInBuffer, 0, thread->frameCount() * thread->frameSize());
+    if (mBufferFormat == AUDIO_FORMAT_PCM_FLOAT) {
+        memset(mInBuffer, 0, thread->frameCount() * thread->channelCount() * sizeof(float));
+    } else {
+        memset(mInBuffer, 0, thread->frameCount() * thread->frameSize());
+    }
 }
 
 // Must be called with EffectChain::mLock locked
@@ -1316,8 +1327,12 @@ void AudioFlinger::EffectChain::process_l()
 
     size_t size = mEffects.size();
     if (doProcess) {
-        for (size_t i = 0; i < size; i++) {
-            mEffects[i]->process();
+        if (mBufferFormat == AUDIO_FORMAT_PCM_FLOAT) {
+            processFloat_l();
+        } else {
+            for (size_t i = 0; i < size; i++) {
+                mEffects[i]->process();
+            }
         }
     }
     for (size_t i = 0; i < size; i++) {
@@ -1325,6 +1340,82 @@ void AudioFlinger::EffectChain::process_l()
     }
 }
 
+// Must be called with EffectChain::mLock locked
+void AudioFlinger::EffectChain::processFloat_l()
+{
+    sp<ThreadBase> thread = mThread.promote();
+    if (thread == 0) {
+        return;
+    }
+    // chain buffers are always stereo
+    const size_t numSamples = thread->frameCount() * FCC_2;
+    float *in = (float *) mInBuffer;
+    size_t size = mEffects.size();
+    size_t i = 0;
+
+    // auxiliary effects come first and accumulate into mConvertBuffer,
+    // which is then added to the chain input
+    bool auxProcessed = false;
+    for (; i < size; i++) {
+        const sp<EffectModule>& effect = mEffects[i];
+        if ((effect->desc().flags & EFFECT_FLAG_TYPE_MASK) != EFFECT_FLAG_TYPE_AUXILIARY) {
+            break;
+        }
+        if (!effect->isProcessEnabled()) {
+            continue;
+        }
+        if (!auxProcessed) {
+            memset(mConvertBuffer, 0, numSamples * sizeof(int16_t));
+            auxProcessed = true;
+        }
+        effect->process();
+    }
+    if (auxProcessed) {
+        for (size_t j = 0; j < numSamples; j++) {
+            in[j] += float_from_i16(mConvertBuffer[j]);
+        }
+    }
+
+    // insert effects process in place, the signal is in mConvertBuffer while 16-bit
+    // effects follow each other, and only converted where the format changes
+    bool inConvertBuffer = false;
+    bool processed = false;
+    for (; i < size; i++) {
+        const sp<EffectModule>& effect = mEffects[i];
+        if (!effect->isProcessEnabled()) {
+            continue;
+        }
+        const bool is16Bit = effect->format() == AUDIO_FORMAT_PCM_16_BIT;
+        if (is16Bit != inConvertBuffer) {
+            if (is16Bit) {
+                memcpy_to_mixer_format_from_float(mConvertBuffer, AUDIO_FORMAT_PCM_16_BIT,
+                        in, numSamples);
+            } else {
+                for (size_t j = 0; j < numSamples; j++) {
+                    in[j] = float_from_i16(mConvertBuffer[j]);
+                }
+            }
+            inConvertBuffer = is16Bit;
+        }
+        effect->process();
+        processed = true;
+    }
+    if (inConvertBuffer) {
+        for (size_t j = 0; j < numSamples; j++) {
+            in[j] = float_from_i16(mConvertBuffer[j]);
+        }
+    }
+
+    // In a 16-bit chain the last effect accumulates into the chain output, or passes its
+    // input through when idle and tracks are active.  Float chains do both here.
+    if (mInBuffer != mOutBuffer && (processed || activeTrackCnt() != 0)) {
+        float *out = (float *) mOutBuffer;
+        for (size_t j = 0; j < numSamples; j++) {
+            out[j] += in[j];
+        }
+    }
+}
+
 // addEffect_l() must be called with PlaybackThread::mLock held
 status_t AudioFlinger::EffectChain::addEffect_l(const sp<EffectModule>& effect)
 {
@@ -1338,6 +1429,9 @@ status_t AudioFlinger::EffectChain::addEffect_l(const sp<EffectModule>& effect)
         return NO_INIT;
     }
     effect->setThread(thread);
+    // an effect moved from a float chain must not keep its float format: only
+    // configureFloat_l() switches insert effects of a float chain to float
+    effect->setFormat(AUDIO_FORMAT_PCM_16_BIT);
 
     if ((desc.flags & EFFECT_FLAG_TYPE_MASK) == EFFECT_FLAG_TYPE_AUXILIARY) {
         // Auxiliary effects are inserted at the beginning of mEffects vector as
@@ -1353,8 +1447,13 @@ status_t AudioFlinger::EffectChain::addEffect_l(const sp<EffectModule>& effect)
         memset(buffer, 0, numSamples * sizeof(int32_t));
         effect->setInBuffer((int16_t *)buffer);
         // auxiliary effects output samples to chain input buffer for further processing
-        // by insert effects
-        effect->setOutBuffer(mInBuffer);
+        // by insert effects, or in a float chain to mConvertBuffer which process_l() then
+        // adds to the chain input buffer
+        if (mBufferFormat == AUDIO_FORMAT_PCM_FLOAT) {
+            effect->setOutBuffer(convertBuffer_l());
+        } else {
+            effect->setOutBuffer(mInBuffer);
+        }
     } else {
         // Insert effects are inserted at the end of mEffects vector as they are processed
         //  after track and auxiliary effects.
@@ -1418,6 +1517,15 @@ status_t AudioFlinger::EffectChain::addEffect_l(const sp<EffectModule>& effect)
             }
         }
 
+        if (mBufferFormat == AUDIO_FORMAT_PCM_FLOAT) {
+            // effects in a float chain all process in place, see processFloat_l()
+            mEffects.insertAt(effect, idx_insert);
+            ALOGV("addEffect_l() effect %p, added in float chain %p at rank %d", effect.get(),
+                    this, idx_insert);
+            configureFloat_l(effect);
+            return NO_ERROR;
+        }
+
         // always read samples from chain input buffer
         effect->setInBuffer(mInBuffer);
 
@@ -1459,7 +1567,7 @@ size_t AudioFlinger::EffectChain::removeEffect_l(const sp<EffectModule>& effect)
             }
             if (type == EFFECT_FLAG_TYPE_AUXILIARY) {
                 delete[] effect->inBuffer();
-            } else {
+            } else if (mBufferFormat != AUDIO_FORMAT_PCM_FLOAT) {
                 if (i == size - 1 && i != 0) {
                     mEffects[i - 1]->setOutBuffer(mOutBuffer);
                     mEffects[i - 1]->configure();
@@ -1475,6 +1583,41 @@ size_t AudioFlinger::EffectChain::removeEffect_l(const sp<EffectModule>& effect)
     return mEffects.size();
 }
 
+// configureFloat_l() must be called with PlaybackThread::mLock held
+status_t AudioFlinger::EffectChain::configureFloat_l(const sp<EffectModule>& effect)
+{
+    // There is no format capability in the effect descriptor: an effect accepts float if
+    // it accepts a float configuration.
+    effect->setFormat(AUDIO_FORMAT_PCM_FLOAT);
+    effect->setInBuffer(mInBuffer);
+    effect->setOutBuffer(mInBuffer);
+    status_t status = effect->configure();
+    if (status == NO_ERROR) {
+        return status;
+    }
+    ALOGV("configureFloat_l() effect %s does not accept float, processing in 16-bit",
+            effect->desc().name);
+    int16_t *buffer = convertBuffer_l();
+    effect->setFormat(AUDIO_FORMAT_PCM_16_BIT);
+    effect->setInBuffer(buffer);
+    effect->setOutBuffer(buffer);
+    return effect->configure();
+}
+
+// convertBuffer_l() must be called with PlaybackThread::mLock held
+int16_t *AudioFlinger::EffectChain::convertBuffer_l()
+{
+    if (mConvertBuffer == NULL) {
+        sp<ThreadBase> thread = mThread.promote();
+        if (thread != 0) {
+            size_t numSamples = thread->frameCount() * FCC_2;
+            mConvertBuffer = new int16_t[numSamples];
+            memset(mConvertBuffer, 0, numSamples * sizeof(int16_t));
+        }
+    }
+    return mConvertBuffer;
+}
+
 // setDevice_l() must be called with PlaybackThread::mLock held
 void AudioFlinger::EffectChain::setDevice_l(audio_devices_t device)
 {
@@ -1577,12 +1720,13 @@ void AudioFlinger::EffectChain::dump(int fd, const Vector<String16>& args)
         result.append("\tCould not lock mutex:\n");
     }
 
-    result.append("\tNum fx In buffer   Out buffer   Active tracks:\n");
-    snprintf(buffer, SIZE, "\t%02d     0x%08x  0x%08x   %d\n",
+    result.append("\tNum fx In buffer   Out buffer   Active tracks Format:\n");
+    snprintf(buffer, SIZE, "\t%02d     0x%08x  0x%08x   %-13d %s\n",
             mEffects.size(),
             (uint32_t)mInBuffer,
             (uint32_t)mOutBuffer,
-            mActiveTrackCnt);
+            mActiveTrackCnt,
+            mBufferFormat == AUDIO_FORMAT_PCM_FLOAT ? "float" : "16-bit");
     result.append(buffer);
     write(fd, result.string(), result.size());
 
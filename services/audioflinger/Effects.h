@@ -88,6 +88,9 @@ public:
     int16_t     *inBuffer() { return mConfig.inputCfg.buffer.s16; }
     void        setOutBuffer(int16_t *buffer) { mConfig.outputCfg.buffer.s16 = buffer; }
     int16_t     *outBuffer() { return mConfig.outputCfg.buffer.s16; }
+    // format of the input and output buffers, applied by the next configure()
+    void        setFormat(audio_format_t format) { mFormat = format; }
+    audio_format_t format() const { return mFormat; }
     void        setChain(const wp<EffectChain>& chain) { mChain = chain; }
     void        setThread(const wp<ThreadBase>& thread) { mThread = thread; }
     const wp<ThreadBase>& thread() { return mThread; }
@@ -153,6 +156,7 @@ mutable Mutex               mLock;      // mutex for process, commands and handl
     uint32_t mDisableWaitCnt;       // current process() calls count during disable period.
     bool     mSuspended;            // effect is suspended: temporarily disabled by framework
     bool     mOffloaded;            // effect is currently offloaded to the audio DSP
+    audio_format_t mFormat;         // input and output format: 16-bit, or float in a float chain
 };
 
 // The EffectHandle class implements the IEffect interface. It provides resources
@@ -287,6 +291,13 @@ public:
     int16_t *outBuffer() const {
         return mOutBuffer;
     }
+    // format of mInBuffer and mOutBuffer, set by the thread before effects are added
+    void setBufferFormat(audio_format_t format) {
+        mBufferFormat = format;
+    }
+    audio_format_t bufferFormat() const {
+        return mBufferFormat;
+    }
 
     void incTrackCnt() { android_atomic_inc(&mTrackCnt); }
     void decTrackCnt() { android_atomic_dec(&mTrackCnt); }
@@ -345,12 +356,23 @@ protected:
 
     void clearInputBuffer_l(sp<ThreadBase> thread);
 
+    // Float chains: insert effects process in place, in float if they accept it or else in
+    // 16-bit on mConvertBuffer, see configureFloat_l().  process_l() converts between the two
+    // only where consecutive enabled effects differ in format.
+    status_t configureFloat_l(const sp<EffectModule>& effect);
+    void processFloat_l();
+    int16_t *convertBuffer_l();
+
     wp<ThreadBase> mThread;     // parent mixer thread
     Mutex mLock;                // mutex protecting effect list
     Vector< sp<EffectModule> > mEffects; // list of effect modules
     int mSessionId;             // audio session ID
     int16_t *mInBuffer;         // chain input buffer
     int16_t *mOutBuffer;        // chain output buffer
+    audio_format_t mBufferFormat; // format of mInBuffer and mOutBuffer: 16-bit or float,
+                                // in which case they point to float samples
+    int16_t *mConvertBuffer;    // float chain only: 16-bit stereo buffer for the effects that
+                                // do not accept float, and for auxiliary effects output
 
     // 'volatile' here means these are accessed with atomic operations instead of mutex
     volatile int32_t mActiveTrackCnt;    // number of active tracks connected
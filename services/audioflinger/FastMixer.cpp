@@ -26,6 +26,7 @@
 #define ATRACE_TAG ATRACE_TAG_AUDIO
 
 #include "Configuration.h"
+#include <sched.h>
 #include <sys/atomics.h>
 #include <time.h>
 #include <utils/Log.h>
@@ -44,6 +45,8 @@
 #define FAST_DEFAULT_NS    999999999L   // ~1 sec: default time to sleep
 #define MIN_WARMUP_CYCLES          2    // minimum number of loop cycles to wait for warmup
 #define MAX_WARMUP_CYCLES         10    // maximum number of loop cycles to wait for warmup
+#define CYCLE_HISTOGRAM_BINS      32    // bins of the cycle time histogram, 1/8 period each
+#define CYCLE_HISTOGRAM_CYCLES  1024    // number of cycles logged per cycle time histogram
 
 #define FCC_2                       2   // fixed channel count assumption
 
@@ -80,7 +83,11 @@ bool FastMixer::threadLoop()
     long forceNs = 0;       // if overrun detected, force the write cycle to take this much time
     long warmupNs = 0;      // warmup complete when write cycle is greater than to this value
     FastMixerDumpState dummyDumpState, *dumpState = &dummyDumpState;
+    FastMixerHistograms dummyHistograms, *histograms = &dummyHistograms;
     bool ignoreNextOverrun = true;  // used to ignore initial overrun and first after an underrun
+    uint16_t cycleHistogram[CYCLE_HISTOGRAM_BINS];  // cycle times, logged as one event
+    uint32_t cycleHistogramCycles = 0;  // number of cycles in cycleHistogram
+    memset(cycleHistogram, 0, sizeof(cycleHistogram));
 #ifdef FAST_MIXER_STATISTICS
     struct timespec oldLoad = {0, 0};    // previous value of clock_gettime(CLOCK_THREAD_CPUTIME_ID)
     bool oldLoadValid = false;  // whether oldLoad is valid
@@ -118,6 +125,12 @@ bool FastMixer::threadLoop()
         // default to long sleep for next cycle
         sleepNs = FAST_DEFAULT_NS;
 
+        // samples of this cycle, added to the histograms at the end of the cycle
+        uint32_t cycleUs = 0, writeUs = 0;
+        bool cycleUsValid = false, writeUsValid = false;
+        unsigned framesReadyMask = 0;
+        size_t framesReadySamples[FastMixerState::kMaxFastTracks];
+
         // poll for state change
         const FastMixerState *next = mSQ.poll();
         if (next == NULL) {
@@ -131,6 +144,7 @@ bool FastMixer::threadLoop()
 
             // As soon as possible of learning of a new dump area, start using it
             dumpState = next->mDumpState != NULL ? next->mDumpState : &dummyDumpState;
+            histograms = next->mHistograms != NULL ? next->mHistograms : &dummyHistograms;
             teeSink = next->mTeeSink;
             logWriter = next->mNBLogWriter != NULL ? next->mNBLogWriter : &dummyLogWriter;
             if (mixer != NULL) {
@@ -263,6 +277,9 @@ bool FastMixer::threadLoop()
                     forceNs = 0;
                     warmupNs = 0;
                 }
+                // the bins depend on the period
+                memset(cycleHistogram, 0, sizeof(cycleHistogram));
+                cycleHistogramCycles = 0;
                 mixBufferState = UNDEFINED;
 #if !LOG_NDEBUG
                 for (i = 0; i < FastMixerState::kMaxFastTracks; ++i) {
@@ -320,6 +337,10 @@ bool FastMixer::threadLoop()
                         mixer->setBufferProvider(name, bufferProvider);
                         mixer->setParameter(name, AudioMixer::TRACK, AudioMixer::MAIN_BUFFER,
                                 (void *) mixBuffer);
+                        // unlike the underrun counters, the histogram describes only this track
+                        histograms->beginUpdate();
+                        histograms->mFramesReady[i].reset();
+                        histograms->endUpdate();
                         // newly allocated track names default to full scale volume
                         if (fastTrack->mSampleRate != 0 && fastTrack->mSampleRate != sampleRate) {
                             mixer->setParameter(name, AudioMixer::RESAMPLE,
@@ -456,6 +477,8 @@ bool FastMixer::threadLoop()
                 }
                 ftDump->mUnderruns = underruns;
                 ftDump->mFramesReady = framesReady;
+                framesReadySamples[i] = framesReady;
+                framesReadyMask |= 1 << i;
             }
 
             int64_t pts;
@@ -481,10 +504,20 @@ bool FastMixer::threadLoop()
             // FIXME write() is non-blocking and lock-free for a properly implemented NBAIO sink,
             //       but this code should be modified to handle both non-blocking and blocking sinks
             dumpState->mWriteSequence++;
+            struct timespec writeStartTs, writeEndTs;
+            bool writeStartValid = clock_gettime(CLOCK_MONOTONIC, &writeStartTs) == 0;
             ATRACE_BEGIN("write");
             ssize_t framesWritten = outputSink->write(mixBuffer, frameCount);
             ATRACE_END();
             dumpState->mWriteSequence++;
+            if (writeStartValid && clock_gettime(CLOCK_MONOTONIC, &writeEndTs) == 0) {
+                int64_t ns = (writeEndTs.tv_sec - writeStartTs.tv_sec) * 1000000000LL +
+                        (writeEndTs.tv_nsec - writeStartTs.tv_nsec);
+                if (ns >= 0) {
+                    writeUs = ns < 4000000000LL ? (uint32_t) (ns / 1000) : 4000000;
+                    writeUsValid = true;
+                }
+            }
             if (framesWritten >= 0) {
                 ALOG_ASSERT((size_t) framesWritten <= frameCount);
                 totalNativeFramesWritten += framesWritten;
@@ -577,6 +610,24 @@ bool FastMixer::threadLoop()
                     } else {
                         ignoreNextOverrun = false;
                     }
+                    cycleUs = sec < 4 ? sec * 1000000 + nsec / 1000 : 4000000;
+                    cycleUsValid = true;
+                    // Log cycle times as a binary histogram rather than per cycle, which is cheap
+                    // enough to leave enabled.
+                    if (periodNs > 0) {
+                        long binWidthNs = periodNs / 8;
+                        long bin = sec > 0 ? CYCLE_HISTOGRAM_BINS - 1 : nsec / binWidthNs;
+                        if (bin >= CYCLE_HISTOGRAM_BINS) {
+                            bin = CYCLE_HISTOGRAM_BINS - 1;
+                        }
+                        ++cycleHistogram[bin];
+                        if (++cycleHistogramCycles >= CYCLE_HISTOGRAM_CYCLES) {
+                            logWriter->logHistogram("cycle time", binWidthNs, cycleHistogram,
+                                    CYCLE_HISTOGRAM_BINS);
+                            memset(cycleHistogram, 0, sizeof(cycleHistogram));
+                            cycleHistogramCycles = 0;
+                        }
+                    }
                 }
 #ifdef FAST_MIXER_STATISTICS
                 if (isWarm) {
@@ -649,6 +700,22 @@ bool FastMixer::threadLoop()
             sleepNs = periodNs;
         }
 
+        // update the histograms once per cycle, which costs two atomic increments
+        if (cycleUsValid || writeUsValid || framesReadyMask != 0) {
+            histograms->beginUpdate();
+            if (cycleUsValid) {
+                histograms->mCycleUs.add(cycleUs);
+            }
+            if (writeUsValid) {
+                histograms->mWriteUs.add(writeUs);
+            }
+            while (framesReadyMask != 0) {
+                i = __builtin_ctz(framesReadyMask);
+                framesReadyMask &= ~(1 << i);
+                histograms->mFramesReady[i].add(framesReadySamples[i]);
+            }
+            histograms->endUpdate();
+        }
 
     }   // for (;;)
 
@@ -872,4 +939,50 @@ void FastMixerDumpState::dump(int fd) const
     }
 }
 
+bool FastMixerHistograms::snapshot(FastMixerHistograms *copy) const
+{
+    static const int kMaxTries = 10;
+    for (int tries = 0; tries < kMaxTries; ++tries) {
+        int32_t sequence = android_atomic_acquire_load(&mSequence);
+        if (sequence & 1) {
+            // the fast mixer is updating, which takes well under a microsecond
+            sched_yield();
+            continue;
+        }
+        memcpy(copy, this, sizeof(*copy));
+        android_memory_barrier();
+        if (mSequence == sequence) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FastMixerHistograms::dump(int fd) const
+{
+    if (mMagic != kMagic) {
+        fdprintf(fd, "FastMixer histograms not valid\n");
+        return;
+    }
+    fdprintf(fd, "FastMixer histograms since start, percentiles p50 / p99 / p99.9:\n");
+    fdprintf(fd, "  cycle time in ms:   %.3f / %.3f / %.3f over %u cycles\n",
+            mCycleUs.percentile(50) * 1e-3, mCycleUs.percentile(99) * 1e-3,
+            mCycleUs.percentile(99.9) * 1e-3, mCycleUs.total());
+    fdprintf(fd, "  write() time in ms: %.3f / %.3f / %.3f over %u writes\n",
+            mWriteUs.percentile(50) * 1e-3, mWriteUs.percentile(99) * 1e-3,
+            mWriteUs.percentile(99.9) * 1e-3, mWriteUs.total());
+    fdprintf(fd, "  frames ready per track since it was added:\n");
+    for (uint32_t i = 0; i < FastMixerState::kMaxFastTracks; ++i) {
+        const FramesHistogram& framesReady = mFramesReady[i];
+        uint32_t total = framesReady.total();
+        if (total == 0) {
+            continue;
+        }
+        // low percentiles are the ones close to an underrun
+        fdprintf(fd, "    track %u: p0.1=%u p1=%u p50=%u over %u cycles\n", i,
+                framesReady.percentile(0.1), framesReady.percentile(1),
+                framesReady.percentile(50), total);
+    }
+}
+
 }   // namespace android
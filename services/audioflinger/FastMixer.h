@@ -17,6 +17,8 @@
 #ifndef ANDROID_AUDIO_FAST_MIXER_H
 #define ANDROID_AUDIO_FAST_MIXER_H
 
+#include <string.h>
+#include <cutils/atomic.h>
 #include <utils/Debug.h>
 #include <utils/Thread.h>
 extern "C" {
@@ -135,6 +137,110 @@ struct FastMixerDumpState {
 #endif
 };
 
+// Log-linear histogram of uint32_t values, updated without allocation or locks.
+// Each value below 2^kSubBucketBits has its own bin, and each larger power of 2 is divided into
+// 2^kSubBucketBits bins, for a resolution of at least 1/2^kSubBucketBits of the value.
+// Values of kValueBits or more bits are counted in the last bin.  Only POD types are permitted.
+template <int kValueBits, int kSubBucketBits = 4>
+struct LogLinearHistogram {
+    static const uint32_t kNumBins = (kValueBits - kSubBucketBits + 1) << kSubBucketBits;
+
+    void reset() { memset(mCounts, 0, sizeof(mCounts)); }
+    void add(uint32_t value) { mCounts[bin(value)]++; }
+
+    static uint32_t bin(uint32_t value) {
+        if (value >= (1U << kValueBits)) {
+            value = (1U << kValueBits) - 1;
+        }
+        if (value < (1U << kSubBucketBits)) {
+            return value;
+        }
+        uint32_t shift = (31 - __builtin_clz(value)) - kSubBucketBits;
+        return ((shift + 1) << kSubBucketBits) + (value >> shift) - (1U << kSubBucketBits);
+    }
+
+    // smallest value counted in bin, and number of values counted in bin
+    static uint32_t lowerBound(uint32_t bin) {
+        if (bin < (1U << kSubBucketBits)) {
+            return bin;
+        }
+        uint32_t shift = (bin >> kSubBucketBits) - 1;
+        return ((1U << kSubBucketBits) + (bin & ((1U << kSubBucketBits) - 1))) << shift;
+    }
+    static uint32_t width(uint32_t bin) {
+        return bin < (1U << kSubBucketBits) ? 1 : 1U << ((bin >> kSubBucketBits) - 1);
+    }
+
+    uint32_t total() const {
+        uint32_t total = 0;
+        for (uint32_t i = 0; i < kNumBins; ++i) {
+            total += mCounts[i];
+        }
+        return total;
+    }
+
+    // Returns the middle of the bin holding the given percentile in (0, 100], or 0 if empty.
+    uint32_t percentile(double percentile) const {
+        uint32_t total = this->total();
+        if (total == 0) {
+            return 0;
+        }
+        // rank of the sample, starting at 1
+        uint32_t rank = (uint32_t) (total * percentile / 100.0 + 0.5);
+        if (rank < 1) {
+            rank = 1;
+        } else if (rank > total) {
+            rank = total;
+        }
+        uint32_t i = 0;
+        for (uint32_t count = 0; i < kNumBins - 1; ++i) {
+            count += mCounts[i];
+            if (count >= rank) {
+                break;
+            }
+        }
+        return lowerBound(i) + width(i) / 2;
+    }
+
+    uint32_t mCounts[kNumBins];
+};
+
+// Histograms of FastMixer timing and per-track buffer levels, updated on every cycle for the
+// lifetime of the fast mixer.  The structure is POD and owned by MixerThread, which reads it
+// with snapshot() for dumpsys; that is lock-free for both sides.
+struct FastMixerHistograms {
+    // cycle time and write() latency in microseconds, up to ~4 seconds
+    typedef LogLinearHistogram<22> TimeHistogram;
+    // frames ready per fast track, up to 65535 frames
+    typedef LogLinearHistogram<16> FramesHistogram;
+
+    static const uint32_t kMagic = 0x464d4831;  // 'FMH1', identifies the layout
+
+    FastMixerHistograms() : mMagic(kMagic), mSequence(0) {
+        mCycleUs.reset();
+        mWriteUs.reset();
+        for (uint32_t i = 0; i < FastMixerState::kMaxFastTracks; ++i) {
+            mFramesReady[i].reset();
+        }
+    }
+
+    // The fast mixer brackets its updates with these; mSequence is odd during an update.
+    void beginUpdate() { android_atomic_inc(&mSequence); }
+    void endUpdate()   { android_atomic_inc(&mSequence); }
+
+    // Copies a consistent snapshot, returns false if the fast mixer kept updating.
+    bool snapshot(FastMixerHistograms *copy) const;
+
+    // Prints the percentiles; should only be called on a snapshot, not the original.
+    void dump(int fd) const;
+
+    uint32_t            mMagic;
+    volatile int32_t    mSequence;
+    TimeHistogram       mCycleUs;
+    TimeHistogram       mWriteUs;
+    FramesHistogram     mFramesReady[FastMixerState::kMaxFastTracks];
+};
+
 }   // namespace android
 
 #endif  // ANDROID_AUDIO_FAST_MIXER_H
@@ -25,6 +25,7 @@
 namespace android {
 
 struct FastMixerDumpState;
+struct FastMixerHistograms;
 
 class VolumeProvider {
 public:
@@ -77,6 +78,7 @@ struct FastMixerState {
     unsigned    mColdGen;       // increment when COLD_IDLE is requested so it's only performed once
     // This might be a one-time configuration rather than per-state
     FastMixerDumpState* mDumpState; // if non-NULL, then update dump state periodically
+    FastMixerHistograms* mHistograms; // if non-NULL, then update histograms every cycle
     NBAIO_Sink* mTeeSink;       // if non-NULL, then duplicate write()s to this non-blocking sink
     NBLog::Writer* mNBLogWriter; // non-blocking logger
 };  // struct FastMixerState
@@ -47,8 +47,17 @@ public:
     static  void        appendDumpHeader(String8& result);
             void        dump(char* buffer, size_t size);
 
+            // (re)creates the resampler from the current sample rate and channel count of the
+            // thread's input, or deletes it if the track runs at the input sample rate
+            void        updateResampler(uint32_t inSampleRate, uint32_t inChannelCount);
+
+            void        clearSyncStartEvent();
+            void        handleSyncStartEvent(const sp<SyncEvent>& event);
+
 private:
     friend class AudioFlinger;  // for mState
+    friend class RecordThread;  // for the capture state below
+    friend class ResamplerBufferProvider;
 
                         RecordTrack(const RecordTrack&);
                         RecordTrack& operator = (const RecordTrack&);
@@ -60,4 +69,26 @@ private:
 
     bool                mOverflow;  // overflow on most recent attempt to fill client buffer
     AudioRecordServerProxy* mAudioRecordServerProxy;
+
+    // Capture state, only used by RecordThread::threadLoop() once the track is started.
+    // NULL if the track runs at the input sample rate
+    AudioResampler*         mResampler;
+    // used by mResampler to read the thread's input ring buffer
+    ResamplerBufferProvider* mResamplerBufferProvider;
+    // interleaved stereo pairs of fixed-point signed Q19.12
+    int32_t*                mRsmpOutBuffer;
+    // current allocated frame count for the above, which may be larger than needed
+    size_t                  mRsmpOutFrameCount;
+    // rolling counter that is never cleared
+    int32_t                 mRsmpInFront;   // next frame to read from the input ring buffer
+    size_t                  mRsmpInUnrel;   // frames obtained by mResampler, not yet released
+    AudioBufferProvider::Buffer mSink;      // references client's buffer sink in shared memory
+
+    // sync event triggering actual audio capture. Frames read before this event will
+    // be dropped and therefore not read by the application.
+    sp<SyncEvent>           mSyncStartEvent;
+    // number of captured frames to drop after the start sync event has been received.
+    // when < 0, maximum frames to drop before starting capture even if sync event is
+    // not received
+    ssize_t                 mFramesToDrop;
 };
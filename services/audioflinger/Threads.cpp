@@ -50,6 +50,7 @@
 
 #include "AudioFlinger.h"
 #include "AudioMixer.h"
+#include "AudioMixerOps.h"
 #include "FastMixer.h"
 #include "ServiceUtilities.h"
 #include "SchedulingPolicyService.h"
@@ -96,6 +97,9 @@ static const nsecs_t kWarningThrottleNs = seconds(5);
 // RecordThread loop sleep time upon application overrun or audio HAL read error
 static const int kRecordThreadSleepUs = 5000;
 
+// HAL buffers a RecordTrack may lag behind the input before it is overrun
+static const size_t kRecordThreadBufferPeriods = 8;
+
 // maximum time to wait for setParameters to complete
 static const nsecs_t kSetParametersTimeoutNs = seconds(2);
 
@@ -1002,7 +1006,9 @@ AudioFlinger::PlaybackThread::PlaybackThread(const sp<AudioFlinger>& audioFlinge
                                              type_t type)
     :   ThreadBase(audioFlinger, id, device, AUDIO_DEVICE_NONE, type),
         mNormalFrameCount(0), mMixBuffer(NULL),
-        mAllocMixBuffer(NULL), mSuspended(0), mBytesWritten(0),
+        mAllocMixBuffer(NULL),
+        mMixerBufferEnabled(false), mMixerBuffer(NULL), mMixerBufferValid(false),
+        mSuspended(0), mBytesWritten(0),
         mActiveTracksGeneration(0),
         // mStreamTypes[] initialized in constructor body
         mOutput(output),
@@ -1061,6 +1067,7 @@ AudioFlinger::PlaybackThread::~PlaybackThread()
 {
     mAudioFlinger->unregisterWriter(mNBLogWriter);
     delete [] mAllocMixBuffer;
+    delete[] mMixerBuffer;
 }
 
 void AudioFlinger::PlaybackThread::dump(int fd, const Vector<String16>& args)
@@ -1704,6 +1711,7 @@ void AudioFlinger::PlaybackThread::readOutputParameters()
     mAllocMixBuffer = new int8_t[mNormalFrameCount * mFrameSize + align - 1];
     mMixBuffer = (int16_t *) ((((size_t)mAllocMixBuffer + align - 1) / align) * align);
     memset(mMixBuffer, 0, mNormalFrameCount * mFrameSize);
+    allocMixerBuffer();
 
     // force reconfiguration of effect chains and engines to take new buffer size and audio
     // parameters into account
@@ -1717,6 +1725,35 @@ void AudioFlinger::PlaybackThread::readOutputParameters()
     }
 }
 
+void AudioFlinger::PlaybackThread::allocMixerBuffer()
+{
+    if (!mMixerBufferEnabled) {
+        return;
+    }
+    delete[] mMixerBuffer;
+    mMixerBuffer = new float[mNormalFrameCount * mChannelCount];
+    memset(mMixerBuffer, 0, mNormalFrameCount * mChannelCount * sizeof(float));
+    mMixerBufferValid = false;
+}
+
+void AudioFlinger::PlaybackThread::clearMixerBuffer()
+{
+    if (!mMixerBufferEnabled) {
+        return;
+    }
+    memset(mMixerBuffer, 0, mNormalFrameCount * mChannelCount * sizeof(float));
+    mMixerBufferValid = true;
+}
+
+void AudioFlinger::PlaybackThread::convertMixerBuffer()
+{
+    if (mMixerBufferValid) {
+        memcpy_to_mixer_format_from_float(mMixBuffer, mFormat, mMixerBuffer,
+                mNormalFrameCount * mChannelCount);
+        mMixerBufferValid = false;
+    }
+}
+
 
 status_t AudioFlinger::PlaybackThread::getRenderPosition(size_t *halFrames, size_t *dspFrames)
 {
@@ -2005,17 +2042,26 @@ void AudioFlinger::PlaybackThread::invalidateTracks(audio_stream_type_t streamTy
 status_t AudioFlinger::PlaybackThread::addEffectChain_l(const sp<EffectChain>& chain)
 {
     int session = chain->sessionId();
-    int16_t *buffer = mMixBuffer;
+    // with float mixing, the chain processes float buffers and accumulates into mMixerBuffer
+    int16_t *outBuffer = mMixerBufferEnabled ? (int16_t *) mMixerBuffer : mMixBuffer;
+    int16_t *buffer = outBuffer;
     bool ownsBuffer = false;
 
     ALOGV("addEffectChain_l() %p on thread %p for session %d", chain.get(), this, session);
+    chain->setBufferFormat(mMixerBufferEnabled ?
+            AUDIO_FORMAT_PCM_FLOAT : AUDIO_FORMAT_PCM_16_BIT);
     if (session > 0) {
         // Only one effect chain can be present in direct output thread and it uses
         // the mix buffer as input
         if (mType != DIRECT) {
             size_t numSamples = mNormalFrameCount * mChannelCount;
-            buffer = new int16_t[numSamples];
-            memset(buffer, 0, numSamples * sizeof(int16_t));
+            if (mMixerBufferEnabled) {
+                buffer = (int16_t *) new float[numSamples];
+                memset(buffer, 0, numSamples * sizeof(float));
+            } else {
+                buffer = new int16_t[numSamples];
+                memset(buffer, 0, numSamples * sizeof(int16_t));
+            }
             ALOGV("addEffectChain_l() creating new input buffer %p session %d", buffer, session);
             ownsBuffer = true;
         }
@@ -2045,7 +2091,7 @@ status_t AudioFlinger::PlaybackThread::addEffectChain_l(const sp<EffectChain>& c
     }
 
     chain->setInBuffer(buffer, ownsBuffer);
-    chain->setOutBuffer(mMixBuffer);
+    chain->setOutBuffer(outBuffer);
     // Effect chain for session AUDIO_SESSION_OUTPUT_STAGE is inserted at end of effect
     // chains list in order to be processed last as it contains output stage effects
     // Effect chain for session AUDIO_SESSION_OUTPUT_MIX is inserted before
@@ -2315,6 +2361,10 @@ bool AudioFlinger::PlaybackThread::threadLoop()
                     effectChains[i]->process_l();
                 }
             }
+            // with float mixing, effects accumulate into mMixerBuffer which is only now final
+            if (sleepTime == 0) {
+                convertMixerBuffer();
+            }
         }
         // Process effect chains for offloaded thread even if no audio
         // was read from audio track: process only updates effect state
@@ -2461,6 +2511,13 @@ AudioFlinger::MixerThread::MixerThread(const sp<AudioFlinger>& audioFlinger, Aud
             mNormalFrameCount);
     mAudioMixer = new AudioMixer(mNormalFrameCount, mSampleRate);
 
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("af.mixer.float", value, "0") > 0 && atoi(value) != 0) {
+        mMixerBufferEnabled = true;
+        allocMixerBuffer();
+    }
+    ALOGI_IF(mMixerBufferEnabled, "MixerThread() id=%d uses float mixing", id);
+
     // FIXME - Current mixer implementation only supports stereo output
     if (mChannelCount != FCC_2) {
         ALOGE("Invalid audio hardware channel count %d", mChannelCount);
@@ -2499,6 +2556,11 @@ AudioFlinger::MixerThread::MixerThread(const sp<AudioFlinger>& audioFlinger, Aud
         size_t numCounterOffers = 0;
         ssize_t index = monoPipe->negotiate(offers, 1, NULL, numCounterOffers);
         ALOG_ASSERT(index == 0);
+        // In adaptive mode the setpoints below are minimums, and the pipe deepens only as
+        // much as the jitter of the fast mixer requires.
+        if (property_get("af.pipe.adaptive", value, "0") > 0 && atoi(value) != 0) {
+            monoPipe->setAdaptive(true);
+        }
         monoPipe->setAvgFrames((mScreenState & 1) ?
                 (monoPipe->maxFrames() * 7) / 8 : mNormalFrameCount * 2);
         mPipeSink = monoPipe;
@@ -2544,6 +2606,7 @@ AudioFlinger::MixerThread::MixerThread(const sp<AudioFlinger>& audioFlinger, Aud
         state->mColdFutexAddr = &mFastMixerFutex;
         state->mColdGen++;
         state->mDumpState = &mFastMixerDumpState;
+        state->mHistograms = &mFastMixerHistograms;
 #ifdef TEE_SINK
         state->mTeeSink = mTeeSink.get();
 #endif
@@ -2764,6 +2827,9 @@ void AudioFlinger::MixerThread::threadLoop_mix()
 
     // mix buffers...
     mAudioMixer->process(pts);
+    if (!mMixerBufferValid) {
+        clearMixerBuffer();
+    }
     mCurrentWriteLength = mixBufferSize;
     // increase sleep time progressively when application underrun condition clears.
     // Only increase sleep time if the mixer is ready for two consecutive times to avoid
@@ -2799,6 +2865,7 @@ void AudioFlinger::MixerThread::threadLoop_sleepTime()
         }
     } else if (mBytesWritten != 0 || (mMixerStatus == MIXER_TRACKS_ENABLED)) {
         memset (mMixBuffer, 0, mixBufferSize);
+        clearMixerBuffer();
         sleepTime = 0;
         ALOGV_IF(mBytesWritten == 0 && (mMixerStatus == MIXER_TRACKS_ENABLED),
                 "anticipated start");
@@ -2816,6 +2883,7 @@ AudioFlinger::PlaybackThread::mixer_state AudioFlinger::MixerThread::prepareTrac
     size_t count = mActiveTracks.size();
     size_t mixedTracks = 0;
     size_t tracksWithEffect = 0;
+    mMixerBufferValid = false;
     // counts only _active_ fast tracks
     size_t fastTracks = 0;
     uint32_t resetMask = 0; // bit mask of fast tracks that need to be reset
@@ -3181,10 +3249,39 @@ AudioFlinger::PlaybackThread::mixer_state AudioFlinger::MixerThread::prepareTrac
                 AudioMixer::RESAMPLE,
                 AudioMixer::SAMPLE_RATE,
                 (void *)reqSampleRate);
+            // the mix buffer has the channel layout of the output, effect chain buffers are
+            // always stereo
             mAudioMixer->setParameter(
                 name,
                 AudioMixer::TRACK,
-                AudioMixer::MAIN_BUFFER, (void *)track->mainBuffer());
+                AudioMixer::MIXER_CHANNEL_MASK,
+                (void *)(track->mainBuffer() == mMixBuffer ?
+                        mChannelMask : AUDIO_CHANNEL_OUT_STEREO));
+            if (mMixerBufferEnabled) {
+                // effect chain input buffers are float as well, see addEffectChain_l()
+                void *mainBuffer = track->mainBuffer();
+                if (mainBuffer == mMixBuffer) {
+                    mainBuffer = mMixerBuffer;
+                    mMixerBufferValid = true;
+                }
+                mAudioMixer->setParameter(
+                    name,
+                    AudioMixer::TRACK,
+                    AudioMixer::MIXER_FORMAT, (void *)AUDIO_FORMAT_PCM_FLOAT);
+                mAudioMixer->setParameter(
+                    name,
+                    AudioMixer::TRACK,
+                    AudioMixer::MAIN_BUFFER, mainBuffer);
+            } else {
+                mAudioMixer->setParameter(
+                    name,
+                    AudioMixer::TRACK,
+                    AudioMixer::MIXER_FORMAT, (void *)AUDIO_FORMAT_PCM_16_BIT);
+                mAudioMixer->setParameter(
+                    name,
+                    AudioMixer::TRACK,
+                    AudioMixer::MAIN_BUFFER, (void *)track->mainBuffer());
+            }
             mAudioMixer->setParameter(
                 name,
                 AudioMixer::TRACK,
@@ -3474,12 +3571,32 @@ void AudioFlinger::MixerThread::dumpInternals(int fd, const Vector<String16>& ar
 
     snprintf(buffer, SIZE, "AudioMixer tracks: %08x\n", mAudioMixer->trackNames());
     result.append(buffer);
+    snprintf(buffer, SIZE, "Float mixing: %s, mixer buffer: %p\n",
+            mMixerBufferEnabled ? "enabled" : "disabled", mMixerBuffer);
+    result.append(buffer);
+    if (mPipeSink != 0) {
+        MonoPipe *pipe = (MonoPipe *)mPipeSink.get();
+        size_t latencyFrames, peakLatencyFrames;
+        pipe->getDepth(&latencyFrames, &peakLatencyFrames);
+        snprintf(buffer, SIZE, "Pipe to fast mixer: %s setpoint=%zu frames=%zu peak=%zu max=%zu\n",
+                pipe->isAdaptive() ? "adaptive" : "fixed", pipe->getAvgFrames(),
+                latencyFrames, peakLatencyFrames, pipe->maxFrames());
+        result.append(buffer);
+    }
     write(fd, result.string(), result.size());
 
     // Make a non-atomic copy of fast mixer dump state so it won't change underneath us
     const FastMixerDumpState copy(mFastMixerDumpState);
     copy.dump(fd);
 
+    if (mFastMixer != NULL) {
+        FastMixerHistograms *histograms = new FastMixerHistograms;
+        if (mFastMixerHistograms.snapshot(histograms)) {
+            histograms->dump(fd);
+        }
+        delete histograms;
+    }
+
 #ifdef STATE_QUEUE_DUMP
     // Similar for state queue
     StateQueueObserverDump observerCopy = mStateQueueObserverDump;
@@ -4222,8 +4339,12 @@ void AudioFlinger::DuplicatingThread::threadLoop_mix()
     // mix buffers...
     if (outputsReady(outputTracks)) {
         mAudioMixer->process(AudioBufferProvider::kInvalidPTS);
+        if (!mMixerBufferValid) {
+            clearMixerBuffer();
+        }
     } else {
         memset(mMixBuffer, 0, mixBufferSize);
+        clearMixerBuffer();
     }
     sleepTime = 0;
     writeFrames = mNormalFrameCount;
@@ -4243,6 +4364,7 @@ void AudioFlinger::DuplicatingThread::threadLoop_sleepTime()
         if (mMixerStatus == MIXER_TRACKS_ENABLED) {
             writeFrames = mNormalFrameCount;
             memset(mMixBuffer, 0, mixBufferSize);
+            clearMixerBuffer();
         } else {
             // flush remaining overflow buffers in output tracks
             writeFrames = 0;
@@ -4378,12 +4500,10 @@ AudioFlinger::RecordThread::RecordThread(const sp<AudioFlinger>& audioFlinger,
 #endif
                                          ) :
     ThreadBase(audioFlinger, id, outDevice, inDevice, RECORD),
-    mInput(input), mResampler(NULL), mRsmpOutBuffer(NULL), mRsmpInBuffer(NULL),
-    // mRsmpInIndex and mBufferSize set by readInputParameters()
+    mInput(input), mActiveTracksGen(0), mInputStarted(false), mRsmpInBuffer(NULL),
+    // mRsmpInFrames, mRsmpInFramesP2, mRsmpInRear and mBufferSize set by readInputParameters()
     mReqChannelCount(popcount(channelMask)),
     mReqSampleRate(sampleRate)
-    // mBytesRead is only meaningful while active, and so is cleared in start()
-    // (but might be better to also clear here for dump?)
 #ifdef TEE_SINK
     , mTeeSink(teeSink)
 #endif
@@ -4397,8 +4517,6 @@ AudioFlinger::RecordThread::RecordThread(const sp<AudioFlinger>& audioFlinger,
 AudioFlinger::RecordThread::~RecordThread()
 {
     delete[] mRsmpInBuffer;
-    delete mResampler;
-    delete[] mRsmpOutBuffer;
 }
 
 void AudioFlinger::RecordThread::onFirstRef()
@@ -4415,39 +4533,34 @@ status_t AudioFlinger::RecordThread::readyToRun()
 
 bool AudioFlinger::RecordThread::threadLoop()
 {
-    AudioBufferProvider::Buffer buffer;
-    sp<RecordTrack> activeTrack;
     Vector< sp<EffectChain> > effectChains;
 
     nsecs_t lastWarning = 0;
 
     inputStandBy();
+    int activeTracksGen;
     {
         Mutex::Autolock _l(mLock);
-        activeTrack = mActiveTrack;
-        acquireWakeLock_l(activeTrack != 0 ? activeTrack->uid() : -1);
+        activeTracksGen = mActiveTracksGen;
+        acquireWakeLock_l(mActiveTracks.size() > 0 ? mActiveTracks[0]->uid() : -1);
     }
 
-    // used to verify we've read at least once before evaluating how many bytes were read
-    bool readOnce = false;
-	
-	short tmpBuf[512];
-	
     // start recording
     while (!exitPending()) {
 
         processConfigEvents();
 
+        // the started part of mActiveTracks, served by this cycle
+        Vector< sp<RecordTrack> > activeTracks;
+        // some of them wait for the first read from the input to complete their start()
+        bool resuming = false;
+        // tracks are waiting in start() for AudioSystem::startInput()
+        bool starting = false;
+
         { // scope for mLock
             Mutex::Autolock _l(mLock);
             checkForNewParameters_l();
-            if (mActiveTrack != 0 && activeTrack != mActiveTrack) {
-                SortedVector<int> tmp;
-                tmp.add(mActiveTrack->uid());
-                updateWakeLockUids_l(tmp);
-            }
-            activeTrack = mActiveTrack;
-            if (mActiveTrack == 0 && mConfigEvents.isEmpty()) {
+            if (mActiveTracks.size() == 0 && mConfigEvents.isEmpty()) {
                 standby();
 
                 if (exitPending()) {
@@ -4459,174 +4572,123 @@ bool AudioFlinger::RecordThread::threadLoop()
                 // go to sleep
                 mWaitWorkCV.wait(mLock);
                 ALOGV("RecordThread: loop starting");
-                acquireWakeLock_l(mActiveTrack != 0 ? mActiveTrack->uid() : -1);
+                acquireWakeLock_l(mActiveTracks.size() > 0 ? mActiveTracks[0]->uid() : -1);
                 continue;
             }
-            if (mActiveTrack != 0) {
-                if (mActiveTrack->isTerminated()) {
-                    removeTrack_l(mActiveTrack);
-                    mActiveTrack.clear();
-                } else if (mActiveTrack->mState == TrackBase::PAUSING) {
-                    standby();
-                    mActiveTrack.clear();
-                    mStartStopCond.broadcast();
-                } else if (mActiveTrack->mState == TrackBase::RESUMING) {
-                    if (mReqChannelCount != mActiveTrack->channelCount()) {
-                        mActiveTrack.clear();
-                        mStartStopCond.broadcast();
-                    } else if (readOnce) {
-                        // record start succeeds only if first read from audio input
-                        // succeeds
-                        if (mBytesRead >= 0) {
-                            mActiveTrack->mState = TrackBase::ACTIVE;
-                        } else {
-                            mActiveTrack.clear();
-                        }
-                        mStartStopCond.broadcast();
-                    }
+
+            bool doBroadcast = false;
+            for (size_t i = 0; i < mActiveTracks.size(); ) {
+                sp<RecordTrack> activeTrack = mActiveTracks[i];
+                if (activeTrack->isTerminated()) {
+                    removeTrack_l(activeTrack);
+                    mActiveTracks.removeAt(i);
+                    mActiveTracksGen++;
+                    continue;
+                }
+                switch (activeTrack->mState) {
+                case TrackBase::PAUSING:
+                    mActiveTracks.removeAt(i);
+                    mActiveTracksGen++;
+                    doBroadcast = true;
+                    continue;
+                case TrackBase::RESUMING:
+                    resuming = true;
                     mStandby = false;
+                    break;
+                case TrackBase::ACTIVE:
+                    break;
+                default:
+                    starting = true;
+                    i++;
+                    continue;
                 }
+                activeTracks.add(activeTrack);
+                i++;
+            }
+            if (doBroadcast) {
+                mStartStopCond.broadcast();
             }
 
-            lockEffectChains_l(effectChains);
+            if (mActiveTracksGen != activeTracksGen) {
+                activeTracksGen = mActiveTracksGen;
+                if (mActiveTracks.size() > 0) {
+                    SortedVector<int> tmp;
+                    for (size_t i = 0; i < mActiveTracks.size(); i++) {
+                        tmp.add(mActiveTracks[i]->uid());
+                    }
+                    updateWakeLockUids_l(tmp);
+                }
+            }
+
+            if (activeTracks.size() > 0) {
+                lockEffectChains_l(effectChains);
+            }
         }
 
-        if (mActiveTrack != 0) {
-            if (mActiveTrack->mState != TrackBase::ACTIVE &&
-                mActiveTrack->mState != TrackBase::RESUMING) {
-                unlockEffectChains(effectChains);
+        if (activeTracks.size() == 0) {
+            if (starting) {
                 usleep(kRecordThreadSleepUs);
-                continue;
-            }
-            for (size_t i = 0; i < effectChains.size(); i ++) {
-                effectChains[i]->process_l();
             }
+            continue;
+        }
 
-            buffer.frameCount = mFrameCount;
-            status_t status = mActiveTrack->getNextBuffer(&buffer);
-            if (status == NO_ERROR) {
-                readOnce = true;
-                size_t framesOut = buffer.frameCount;
-                if (mResampler == NULL) {
-                    // no resampling
-                    while (framesOut) {
-                        size_t framesIn = mFrameCount - mRsmpInIndex;
-                        if (framesIn) {
-                            int8_t *src = (int8_t *)mRsmpInBuffer + mRsmpInIndex * mFrameSize;
-                            int8_t *dst = buffer.i8 + (buffer.frameCount - framesOut) *
-                                    mActiveTrack->mFrameSize;
-                            if (framesIn > framesOut)
-                                framesIn = framesOut;
-                            mRsmpInIndex += framesIn;
-                            framesOut -= framesIn;
-                            if (mChannelCount == mReqChannelCount) {
-                                memcpy(dst, src, framesIn * mFrameSize);
-                            } else {
-                                if (mChannelCount == 1) {
-                                    upmix_to_stereo_i16_from_mono_i16((int16_t *)dst,
-                                            (int16_t *)src, framesIn);
-                                } else {
-                                    downmix_to_mono_i16_from_stereo_i16((int16_t *)dst,
-                                            (int16_t *)src, framesIn);
-                                }
-                            }
-                        }
-                        if (framesOut && mFrameCount == mRsmpInIndex) {
-                            void *readInto;
-                            if (framesOut == mFrameCount && mChannelCount == mReqChannelCount) {
-                                readInto = buffer.raw;
-                                framesOut = 0;
-                            } else {
-                                readInto = mRsmpInBuffer;
-                                mRsmpInIndex = 0;
-                            }
-                            mBytesRead = mInput->stream->read(mInput->stream, readInto,
-                                    mBufferSize);
-                            if (mBytesRead <= 0) {
-                                if ((mBytesRead < 0) && (mActiveTrack->mState == TrackBase::ACTIVE))
-                                {
-                                    ALOGE("Error reading audio input");
-                                    // Force input into standby so that it tries to
-                                    // recover at next read attempt
-                                    inputStandBy();
-                                    usleep(kRecordThreadSleepUs);
-                                }
-                                mRsmpInIndex = mFrameCount;
-                                framesOut = 0;
-                                buffer.frameCount = 0;
-                            }
-#ifdef TEE_SINK
-                            else if (mTeeSink != 0) {
-                                (void) mTeeSink->write(readInto,
-                                        mBytesRead >> Format_frameBitShift(mTeeSink->format()));
-                            }
-#endif
-                        }
-                    }
-                } else {
-                    // resampling
+        for (size_t i = 0; i < effectChains.size(); i ++) {
+            effectChains[i]->process_l();
+        }
 
-                    // resampler accumulates, but we only have one source track
-                    memset(mRsmpOutBuffer, 0, framesOut * FCC_2 * sizeof(int32_t));
-                    // alter output frame count as if we were expecting stereo samples
-                    if (mChannelCount == 1 && mReqChannelCount == 1) {
-                        framesOut >>= 1;
-                    }
-                    mResampler->resample(mRsmpOutBuffer, framesOut,
-                            this /* AudioBufferProvider* */);
-                    // ditherAndClamp() works as long as all buffers returned by
-                    // mActiveTrack->getNextBuffer() are 32 bit aligned which should be always true.
-                    if (mChannelCount == 2 && mReqChannelCount == 1) {
-                        // temporarily type pun mRsmpOutBuffer from Q19.12 to int16_t
-                        ditherAndClamp(mRsmpOutBuffer, mRsmpOutBuffer, framesOut);
-                        // the resampler always outputs stereo samples:
-                        // do post stereo to mono conversion
-                        downmix_to_mono_i16_from_stereo_i16(buffer.i16, (int16_t *)mRsmpOutBuffer,
-                                framesOut);
-                    } else {
-                        ditherAndClamp((int32_t *)buffer.raw, mRsmpOutBuffer, framesOut);
-                    }
-                    // now done with mRsmpOutBuffer
+        // One HAL read per cycle for all the tracks, so that the input keeps up with the
+        // fastest client and only clients that are too slow overrun.  If the destination wraps,
+        // read past the end of the ring, which is over-allocated for this, then move the excess
+        // to its start.
+        const size_t rear = mRsmpInRear & (mRsmpInFramesP2 - 1);
+        const ssize_t bytesRead = mInput->stream->read(mInput->stream,
+                &mRsmpInBuffer[rear * mChannelCount], mBufferSize);
 
-                }
-                if (mFramestoDrop == 0) {
-                    mActiveTrack->releaseBuffer(&buffer);
-                } else {
-                    if (mFramestoDrop > 0) {
-                        mFramestoDrop -= buffer.frameCount;
-                        if (mFramestoDrop <= 0) {
-                            clearSyncStartEvent();
-                        }
+        if (resuming) {
+            // record start succeeds only if first read from audio input succeeds
+            Mutex::Autolock _l(mLock);
+            for (size_t i = 0; i < activeTracks.size(); i++) {
+                const sp<RecordTrack>& activeTrack = activeTracks[i];
+                if (activeTrack->mState == TrackBase::RESUMING) {
+                    if (bytesRead >= 0) {
+                        activeTrack->mState = TrackBase::ACTIVE;
                     } else {
-                        mFramestoDrop += buffer.frameCount;
-                        if (mFramestoDrop >= 0 || mSyncStartEvent == 0 ||
-                                mSyncStartEvent->isCancelled()) {
-                            ALOGW("Synced record %s, session %d, trigger session %d",
-                                  (mFramestoDrop >= 0) ? "timed out" : "cancelled",
-                                  mActiveTrack->sessionId(),
-                                  (mSyncStartEvent != 0) ? mSyncStartEvent->triggerSession() : 0);
-                            clearSyncStartEvent();
-                        }
+                        mActiveTracks.remove(activeTrack);
+                        mActiveTracksGen++;
                     }
                 }
-                mActiveTrack->clearOverflow();
             }
-            // client isn't retrieving buffers fast enough
-            else {
-                if (!mActiveTrack->setOverflow()) {
-                    nsecs_t now = systemTime();
-                    if ((now - lastWarning) > kWarningThrottleNs) {
-                        ALOGW("RecordThread: buffer overflow");
-                        lastWarning = now;
-                    }
-                }
-                // Release the processor for a while before asking for a new buffer.
-                // This will give the application more chance to read from the buffer and
-                // clear the overflow.
-                mInput->stream->read(mInput->stream, tmpBuf, 1024); 
-                //usleep(kRecordThreadSleepUs);
+            mStartStopCond.broadcast();
+        }
+
+        if (bytesRead <= 0) {
+            if (bytesRead < 0) {
+                ALOGE("Error reading audio input");
+                // Force input into standby so that it tries to
+                // recover at next read attempt
+                inputStandBy();
+                usleep(kRecordThreadSleepUs);
+            }
+        } else {
+#ifdef TEE_SINK
+            if (mTeeSink != 0) {
+                (void) mTeeSink->write(&mRsmpInBuffer[rear * mChannelCount],
+                        bytesRead >> Format_frameBitShift(mTeeSink->format()));
+            }
+#endif
+            const size_t framesRead = bytesRead / mFrameSize;
+            const size_t part1 = mRsmpInFramesP2 - rear;
+            if (framesRead > part1) {
+                memcpy(mRsmpInBuffer, &mRsmpInBuffer[mRsmpInFramesP2 * mChannelCount],
+                        (framesRead - part1) * mFrameSize);
+            }
+            mRsmpInRear += framesRead;
+
+            for (size_t i = 0; i < activeTracks.size(); i++) {
+                processTrack(activeTracks[i], lastWarning);
             }
         }
+
         // enable changes in effect chain
         unlockEffectChains(effectChains);
         effectChains.clear();
@@ -4640,7 +4702,8 @@ bool AudioFlinger::RecordThread::threadLoop()
             sp<RecordTrack> track = mTracks[i];
             track->invalidate();
         }
-        mActiveTrack.clear();
+        mActiveTracks.clear();
+        mActiveTracksGen++;
         mStartStopCond.broadcast();
     }
 
@@ -4650,6 +4713,179 @@ bool AudioFlinger::RecordThread::threadLoop()
     return false;
 }
 
+void AudioFlinger::RecordThread::processTrack(const sp<RecordTrack>& activeTrack,
+        nsecs_t& lastWarning)
+{
+    enum {
+        OVERRUN_UNKNOWN,
+        OVERRUN_TRUE,
+        OVERRUN_FALSE
+    } overrun = OVERRUN_UNKNOWN;
+    const int32_t rear = mRsmpInRear;
+
+    // loop over getNextBuffer to handle circular sink
+    for (;;) {
+
+        activeTrack->mSink.frameCount = ~0;
+        status_t status = activeTrack->getNextBuffer(&activeTrack->mSink);
+        size_t framesOut = status == NO_ERROR ? activeTrack->mSink.frameCount : 0;
+
+        int32_t front = activeTrack->mRsmpInFront;
+        ssize_t filled = rear - front;
+        size_t framesIn;
+        bool skipped = true;
+
+        if (filled < 0) {
+            // should not happen, but treat like a massive overrun and re-sync
+            framesIn = 0;
+            activeTrack->mRsmpInFront = rear;
+            overrun = OVERRUN_TRUE;
+        } else if ((size_t) filled <= mRsmpInFrames) {
+            framesIn = (size_t) filled;
+            skipped = false;
+        } else {
+            // client is not keeping up with server, but give it latest data
+            framesIn = mRsmpInFrames;
+            activeTrack->mRsmpInFront = front = rear - framesIn;
+            overrun = OVERRUN_TRUE;
+        }
+        if (skipped && activeTrack->mResampler != NULL) {
+            // the input the resampler holds was skipped as well
+            activeTrack->mResampler->reset();
+            activeTrack->mRsmpInUnrel = 0;
+        }
+
+        if (framesOut == 0 || framesIn == 0) {
+            break;
+        }
+
+        if (activeTrack->mResampler == NULL) {
+            // no resampling
+            if (framesIn > framesOut) {
+                framesIn = framesOut;
+            } else {
+                framesOut = framesIn;
+            }
+            int8_t *dst = activeTrack->mSink.i8;
+            while (framesIn > 0) {
+                front &= mRsmpInFramesP2 - 1;
+                size_t part1 = mRsmpInFramesP2 - front;
+                if (part1 > framesIn) {
+                    part1 = framesIn;
+                }
+                int8_t *src = (int8_t *)mRsmpInBuffer + front * mFrameSize;
+                if (mChannelCount == activeTrack->mChannelCount) {
+                    memcpy(dst, src, part1 * mFrameSize);
+                } else if (mChannelCount == 1) {
+                    upmix_to_stereo_i16_from_mono_i16((int16_t *)dst, (int16_t *)src, part1);
+                } else {
+                    downmix_to_mono_i16_from_stereo_i16((int16_t *)dst, (int16_t *)src, part1);
+                }
+                dst += part1 * activeTrack->mFrameSize;
+                front += part1;
+                framesIn -= part1;
+            }
+            activeTrack->mRsmpInFront += framesOut;
+
+        } else {
+            // resampling
+
+            // Do not precompute in/out because floating point is not associative
+            // e.g. a*b/c != a*(b/c).
+            const double in(mSampleRate);
+            const double out(activeTrack->mSampleRate);
+            size_t framesInNeeded = ceil(framesOut * in / out) + 1;
+            // frames obtained by the resampler but not released yet are spoken for
+            const size_t unreleased = activeTrack->mRsmpInUnrel;
+            framesIn = framesIn > unreleased ? framesIn - unreleased : 0;
+            if (framesIn < framesInNeeded) {
+                // only produce what the available input allows, the rest comes next cycle
+                size_t newFramesOut = framesIn > 0 ? floor((framesIn - 1) * out / in) : 0;
+                if (newFramesOut == 0) {
+                    break;
+                }
+                ALOGVV("not enough to resample %u frames, have %u in and produce %u out",
+                        framesOut, framesIn, newFramesOut);
+                framesOut = newFramesOut;
+            }
+
+            // reallocate mRsmpOutBuffer as needed; we will grow but never shrink
+            if (activeTrack->mRsmpOutFrameCount < framesOut) {
+                delete[] activeTrack->mRsmpOutBuffer;
+                // resampler always outputs stereo
+                activeTrack->mRsmpOutBuffer = new int32_t[framesOut * FCC_2];
+                activeTrack->mRsmpOutFrameCount = framesOut;
+            }
+
+            // resampler accumulates, but we only have one source track
+            memset(activeTrack->mRsmpOutBuffer, 0, framesOut * FCC_2 * sizeof(int32_t));
+            activeTrack->mResampler->resample(activeTrack->mRsmpOutBuffer, framesOut,
+                    activeTrack->mResamplerBufferProvider);
+            // ditherAndClamp() works as long as all buffers returned by
+            // activeTrack->getNextBuffer() are 32 bit aligned which should be always true.
+            if (activeTrack->mChannelCount == 1) {
+                // temporarily type pun mRsmpOutBuffer from Q19.12 to int16_t
+                ditherAndClamp(activeTrack->mRsmpOutBuffer, activeTrack->mRsmpOutBuffer,
+                        framesOut);
+                // the resampler always outputs stereo samples:
+                // do post stereo to mono conversion
+                downmix_to_mono_i16_from_stereo_i16(activeTrack->mSink.i16,
+                        (int16_t *)activeTrack->mRsmpOutBuffer, framesOut);
+            } else {
+                ditherAndClamp((int32_t *)activeTrack->mSink.raw,
+                        activeTrack->mRsmpOutBuffer, framesOut);
+            }
+            // now done with mRsmpOutBuffer
+
+        }
+
+        if (overrun == OVERRUN_UNKNOWN) {
+            overrun = OVERRUN_FALSE;
+        }
+
+        if (activeTrack->mFramesToDrop == 0) {
+            activeTrack->mSink.frameCount = framesOut;
+            activeTrack->releaseBuffer(&activeTrack->mSink);
+        } else {
+            if (activeTrack->mFramesToDrop > 0) {
+                activeTrack->mFramesToDrop -= framesOut;
+                if (activeTrack->mFramesToDrop <= 0) {
+                    activeTrack->clearSyncStartEvent();
+                }
+            } else {
+                activeTrack->mFramesToDrop += framesOut;
+                if (activeTrack->mFramesToDrop >= 0 || activeTrack->mSyncStartEvent == 0 ||
+                        activeTrack->mSyncStartEvent->isCancelled()) {
+                    ALOGW("Synced record %s, session %d, trigger session %d",
+                          (activeTrack->mFramesToDrop >= 0) ? "timed out" : "cancelled",
+                          activeTrack->sessionId(),
+                          (activeTrack->mSyncStartEvent != 0) ?
+                                  activeTrack->mSyncStartEvent->triggerSession() : 0);
+                    activeTrack->clearSyncStartEvent();
+                }
+            }
+        }
+    }
+
+    switch (overrun) {
+    case OVERRUN_TRUE:
+        // client isn't retrieving buffers fast enough
+        if (!activeTrack->setOverflow()) {
+            nsecs_t now = systemTime();
+            if ((now - lastWarning) > kWarningThrottleNs) {
+                ALOGW("RecordThread: buffer overflow");
+                lastWarning = now;
+            }
+        }
+        break;
+    case OVERRUN_FALSE:
+        activeTrack->clearOverflow();
+        break;
+    case OVERRUN_UNKNOWN:
+        break;
+    }
+}
+
 void AudioFlinger::RecordThread::standby()
 {
     if (!mStandby) {
@@ -4683,6 +4919,18 @@ sp<AudioFlinger::RecordThread::RecordTrack>  AudioFlinger::RecordThread::createR
         ALOGE("createRecordTrack_l() audio driver not initialized");
         goto Exit;
     }
+
+    // each track is converted from the shared input buffer with the 16-bit resampler and
+    // the mono/stereo channel mapping in processTrack(), which only handle up to stereo
+    if (popcount(channelMask) > 2 ||
+            (mChannelCount > 2 &&
+                    (popcount(channelMask) != mChannelCount || sampleRate != mSampleRate))) {
+        ALOGE("createRecordTrack_l() unsupported channelMask %#x sampleRate %u for input "
+                "with %u channels at %u Hz", channelMask, sampleRate, mChannelCount, mSampleRate);
+        lStatus = BAD_VALUE;
+        goto Exit;
+    }
+
     // client expresses a preference for FAST, but we get the final say
     if (*flags & IAudioFlinger::TRACK_FAST) {
       if (
@@ -4781,82 +5029,89 @@ status_t AudioFlinger::RecordThread::start(RecordThread::RecordTrack* recordTrac
     status_t status = NO_ERROR;
 
     if (event == AudioSystem::SYNC_EVENT_NONE) {
-        clearSyncStartEvent();
+        recordTrack->clearSyncStartEvent();
     } else if (event != AudioSystem::SYNC_EVENT_SAME) {
-        mSyncStartEvent = mAudioFlinger->createSyncEvent(event,
+        recordTrack->mSyncStartEvent = mAudioFlinger->createSyncEvent(event,
                                        triggerSession,
                                        recordTrack->sessionId(),
                                        syncStartEventCallback,
-                                       this);
+                                       recordTrack);
         // Sync event can be cancelled by the trigger session if the track is not in a
         // compatible state in which case we start record immediately
-        if (mSyncStartEvent->isCancelled()) {
-            clearSyncStartEvent();
+        if (recordTrack->mSyncStartEvent->isCancelled()) {
+            recordTrack->clearSyncStartEvent();
         } else {
             // do not wait for the event for more than AudioSystem::kSyncRecordStartTimeOutMs
-            mFramestoDrop = - ((AudioSystem::kSyncRecordStartTimeOutMs * mReqSampleRate) / 1000);
+            recordTrack->mFramesToDrop = - ((AudioSystem::kSyncRecordStartTimeOutMs *
+                    recordTrack->mSampleRate) / 1000);
         }
     }
 
+    bool stopInput = false;
     {
         AutoMutex lock(mLock);
-        if (mActiveTrack != 0) {
-            if (recordTrack != mActiveTrack.get()) {
-                status = -EBUSY;
-            } else if (mActiveTrack->mState == TrackBase::PAUSING) {
-                mActiveTrack->mState = TrackBase::ACTIVE;
+        if (mActiveTracks.indexOf(recordTrack) >= 0) {
+            if (recordTrack->mState == TrackBase::PAUSING) {
+                recordTrack->mState = TrackBase::ACTIVE;
             }
             return status;
         }
 
+        // the input is shared by all active tracks, and started with the first one
+        const bool startInput = !mInputStarted;
+        mInputStarted = true;
         recordTrack->mState = TrackBase::IDLE;
-        mActiveTrack = recordTrack;
-        mLock.unlock();
-        status_t status = AudioSystem::startInput(mId);
-        mLock.lock();
+        mActiveTracks.add(recordTrack);
+        mActiveTracksGen++;
+        if (startInput) {
+            mLock.unlock();
+            status = AudioSystem::startInput(mId);
+            mLock.lock();
+        }
         if (status != NO_ERROR) {
-            mActiveTrack.clear();
-            clearSyncStartEvent();
+            mActiveTracks.remove(recordTrack);
+            mActiveTracksGen++;
+            mInputStarted = false;
+            recordTrack->clearSyncStartEvent();
             return status;
         }
-        mRsmpInIndex = mFrameCount;
-        mBytesRead = 0;
-        if (mResampler != NULL) {
-            mResampler->reset();
+        // the track only sees input captured from now on
+        recordTrack->mRsmpInFront = mRsmpInRear;
+        recordTrack->mRsmpInUnrel = 0;
+        if (recordTrack->mResampler != NULL) {
+            recordTrack->mResampler->reset();
         }
-        mActiveTrack->mState = TrackBase::RESUMING;
+        recordTrack->mState = TrackBase::RESUMING;
         // signal thread to start
         ALOGV("Signal record thread");
         mWaitWorkCV.broadcast();
         // do not wait for mStartStopCond if exiting
         if (exitPending()) {
-            mActiveTrack.clear();
+            mActiveTracks.remove(recordTrack);
+            mActiveTracksGen++;
             status = INVALID_OPERATION;
-            goto startError;
-        }
-        mStartStopCond.wait(mLock);
-        if (mActiveTrack == 0) {
-            ALOGV("Record failed to start");
-            status = BAD_VALUE;
-            goto startError;
+        } else {
+            // other tracks starting and stopping broadcast as well
+            while (recordTrack->mState == TrackBase::RESUMING &&
+                    mActiveTracks.indexOf(recordTrack) >= 0) {
+                mStartStopCond.wait(mLock);
+            }
+            if (mActiveTracks.indexOf(recordTrack) < 0) {
+                ALOGV("Record failed to start");
+                status = BAD_VALUE;
+            } else {
+                ALOGV("Record started OK");
+                return status;
+            }
         }
-        ALOGV("Record started OK");
-        return status;
+        stopInput = shouldStopInput_l(recordTrack);
     }
 
-startError:
-    AudioSystem::stopInput(mId);
-    clearSyncStartEvent();
-    return status;
-}
-
-void AudioFlinger::RecordThread::clearSyncStartEvent()
-{
-    if (mSyncStartEvent != 0) {
-        mSyncStartEvent->cancel();
+    if (stopInput) {
+        AudioSystem::stopInput(mId);
     }
-    mSyncStartEvent.clear();
-    mFramestoDrop = 0;
+    recordTrack->clearSyncStartEvent();
+    return status;
 }
 
 void AudioFlinger::RecordThread::syncStartEventCallback(const wp<SyncEvent>& event)
@@ -4864,38 +5119,49 @@ void AudioFlinger::RecordThread::syncStartEventCallback(const wp<SyncEvent>& eve
     sp<SyncEvent> strongEvent = event.promote();
 
     if (strongEvent != 0) {
-        RecordThread *me = (RecordThread *)strongEvent->cookie();
-        me->handleSyncStartEvent(strongEvent);
-    }
-}
-
-void AudioFlinger::RecordThread::handleSyncStartEvent(const sp<SyncEvent>& event)
-{
-    if (event == mSyncStartEvent) {
-        // TODO: use actual buffer filling status instead of 2 buffers when info is available
-        // from audio HAL
-        mFramestoDrop = mFrameCount * 2;
+        // the track cancels the event before it goes away
+        RecordTrack *recordTrack = (RecordTrack *)strongEvent->cookie();
+        recordTrack->handleSyncStartEvent(strongEvent);
     }
 }
 
 bool AudioFlinger::RecordThread::stop(RecordThread::RecordTrack* recordTrack) {
     ALOGV("RecordThread::stop");
     AutoMutex _l(mLock);
-    if (recordTrack != mActiveTrack.get() || recordTrack->mState == TrackBase::PAUSING) {
+    if (mActiveTracks.indexOf(recordTrack) < 0 || recordTrack->mState == TrackBase::PAUSING) {
         return false;
     }
     recordTrack->mState = TrackBase::PAUSING;
     // do not wait for mStartStopCond if exiting
     if (exitPending()) {
-        return true;
+        return shouldStopInput_l(recordTrack);
     }
-    mStartStopCond.wait(mLock);
-    // if we have been restarted, recordTrack == mActiveTrack.get() here
-    if (exitPending() || recordTrack != mActiveTrack.get()) {
-        ALOGV("Record stopped OK");
-        return true;
+    while (recordTrack->mState == TrackBase::PAUSING &&
+            mActiveTracks.indexOf(recordTrack) >= 0 && !exitPending()) {
+        mStartStopCond.wait(mLock);
     }
-    return false;
+    // if we have been restarted, recordTrack is still in mActiveTracks here
+    if (!exitPending() && mActiveTracks.indexOf(recordTrack) >= 0) {
+        return false;
+    }
+    ALOGV("Record stopped OK");
+    return shouldStopInput_l(recordTrack);
+}
+
+bool AudioFlinger::RecordThread::shouldStopInput_l(const RecordTrack* track)
+{
+    if (!mInputStarted) {
+        return false;
+    }
+    for (size_t i = 0; i < mActiveTracks.size(); i++) {
+        const sp<RecordTrack>& activeTrack = mActiveTracks[i];
+        if (activeTrack.get() != track && !activeTrack->isTerminated() &&
+                activeTrack->mState != TrackBase::PAUSING) {
+            return false;
+        }
+    }
+    mInputStarted = false;
+    return true;
 }
 
 bool AudioFlinger::RecordThread::isValidSyncEvent(const sp<SyncEvent>& event) const
@@ -4934,7 +5200,7 @@ void AudioFlinger::RecordThread::destroyTrack_l(const sp<RecordTrack>& track)
     track->terminate();
     track->mState = TrackBase::STOPPED;
     // active tracks are removed by threadLoop()
-    if (mActiveTrack != track) {
+    if (mActiveTracks.indexOf(track) < 0) {
         removeTrack_l(track);
     }
 }
@@ -4961,12 +5227,12 @@ void AudioFlinger::RecordThread::dumpInternals(int fd, const Vector<String16>& a
     snprintf(buffer, SIZE, "\nInput thread %p internals\n", this);
     result.append(buffer);
 
-    if (mActiveTrack != 0) {
-        snprintf(buffer, SIZE, "In index: %d\n", mRsmpInIndex);
+    if (mActiveTracks.size() > 0) {
+        snprintf(buffer, SIZE, "Active tracks: %u\n", mActiveTracks.size());
         result.append(buffer);
-        snprintf(buffer, SIZE, "Buffer size: %u bytes\n", mBufferSize);
+        snprintf(buffer, SIZE, "Rear: %d, ring: %u frames\n", mRsmpInRear, mRsmpInFramesP2);
         result.append(buffer);
-        snprintf(buffer, SIZE, "Resampling: %d\n", (mResampler != NULL));
+        snprintf(buffer, SIZE, "Buffer size: %u bytes\n", mBufferSize);
         result.append(buffer);
         snprintf(buffer, SIZE, "Out channel count: %u\n", mReqChannelCount);
         result.append(buffer);
@@ -4998,60 +5264,73 @@ void AudioFlinger::RecordThread::dumpTracks(int fd, const Vector<String16>& args
         }
     }
 
-    if (mActiveTrack != 0) {
+    if (mActiveTracks.size() > 0) {
         snprintf(buffer, SIZE, "\nInput thread %p active tracks\n", this);
         result.append(buffer);
         RecordTrack::appendDumpHeader(result);
-        mActiveTrack->dump(buffer, SIZE);
-        result.append(buffer);
-
+        for (size_t i = 0; i < mActiveTracks.size(); ++i) {
+            mActiveTracks[i]->dump(buffer, SIZE);
+            result.append(buffer);
+        }
     }
     write(fd, result.string(), result.size());
 }
 
 // AudioBufferProvider interface
-status_t AudioFlinger::RecordThread::getNextBuffer(AudioBufferProvider::Buffer* buffer, int64_t pts)
-{
-    size_t framesReq = buffer->frameCount;
-    size_t framesReady = mFrameCount - mRsmpInIndex;
-    int channelCount;
-
-    if (framesReady == 0) {
-        mBytesRead = mInput->stream->read(mInput->stream, mRsmpInBuffer, mBufferSize);
-        if (mBytesRead <= 0) {
-            if ((mBytesRead < 0) && (mActiveTrack->mState == TrackBase::ACTIVE)) {
-                ALOGE("RecordThread::getNextBuffer() Error reading audio input");
-                // Force input into standby so that it tries to
-                // recover at next read attempt
-                inputStandBy();
-                usleep(kRecordThreadSleepUs);
-            }
-            buffer->raw = NULL;
-            buffer->frameCount = 0;
-            return NOT_ENOUGH_DATA;
-        }
-        mRsmpInIndex = 0;
-        framesReady = mFrameCount;
-    }
-
-    if (framesReq > framesReady) {
-        framesReq = framesReady;
-    }
-
-    if (mChannelCount == 1 && mReqChannelCount == 2) {
-        channelCount = 1;
-    } else {
-        channelCount = 2;
-    }
-    buffer->raw = mRsmpInBuffer + mRsmpInIndex * channelCount;
-    buffer->frameCount = framesReq;
+status_t AudioFlinger::RecordThread::ResamplerBufferProvider::getNextBuffer(
+        AudioBufferProvider::Buffer* buffer, int64_t pts)
+{
+    RecordTrack *activeTrack = mRecordTrack;
+    sp<ThreadBase> threadBase = activeTrack->mThread.promote();
+    if (threadBase == 0) {
+        buffer->frameCount = 0;
+        buffer->raw = NULL;
+        return NOT_ENOUGH_DATA;
+    }
+    RecordThread *recordThread = (RecordThread *) threadBase.get();
+    int32_t rear = recordThread->mRsmpInRear;
+    int32_t front = activeTrack->mRsmpInFront;
+    ssize_t filled = rear - front;
+    ALOG_ASSERT(0 <= filled && (size_t) filled <= recordThread->mRsmpInFrames);
+    // 'filled' may be non-contiguous, so return only the first contiguous chunk
+    front &= recordThread->mRsmpInFramesP2 - 1;
+    size_t part1 = recordThread->mRsmpInFramesP2 - front;
+    if (part1 > (size_t) filled) {
+        part1 = filled;
+    }
+    size_t ask = buffer->frameCount;
+    if (part1 > ask) {
+        part1 = ask;
+    }
+    if (part1 == 0) {
+        // threadLoop() only runs the resampler on enough input, but a resampler that reads
+        // ahead of its output may still ask for more
+        ALOGV("ResamplerBufferProvider::getNextBuffer() starved");
+        buffer->raw = NULL;
+        buffer->frameCount = 0;
+        activeTrack->mRsmpInUnrel = 0;
+        return NOT_ENOUGH_DATA;
+    }
+
+    buffer->raw = recordThread->mRsmpInBuffer + front * recordThread->mChannelCount;
+    buffer->frameCount = part1;
+    activeTrack->mRsmpInUnrel = part1;
     return NO_ERROR;
 }
 
 // AudioBufferProvider interface
-void AudioFlinger::RecordThread::releaseBuffer(AudioBufferProvider::Buffer* buffer)
+void AudioFlinger::RecordThread::ResamplerBufferProvider::releaseBuffer(
+        AudioBufferProvider::Buffer* buffer)
 {
-    mRsmpInIndex += buffer->frameCount;
+    RecordTrack *activeTrack = mRecordTrack;
+    size_t stepCount = buffer->frameCount;
+    if (stepCount == 0) {
+        return;
+    }
+    ALOG_ASSERT(stepCount <= activeTrack->mRsmpInUnrel);
+    activeTrack->mRsmpInUnrel -= stepCount;
+    activeTrack->mRsmpInFront += stepCount;
+    buffer->raw = NULL;
     buffer->frameCount = 0;
 }
 
@@ -5088,7 +5367,7 @@ bool AudioFlinger::RecordThread::checkForNewParameters_l()
             // do not accept frame count changes if tracks are open as the track buffer
             // size depends on frame count and correct behavior would not be guaranteed
             // if frame count is changed after track creation
-            if (mActiveTrack != 0) {
+            if (mActiveTracks.size() > 0) {
                 status = INVALID_OPERATION;
             } else {
                 reconfig = true;
@@ -5207,10 +5486,6 @@ void AudioFlinger::RecordThread::readInputParameters()
 {
     delete[] mRsmpInBuffer;
     // mRsmpInBuffer is always assigned a new[] below
-    delete[] mRsmpOutBuffer;
-    mRsmpOutBuffer = NULL;
-    delete mResampler;
-    mResampler = NULL;
 
     mSampleRate = mInput->stream->common.get_sample_rate(&mInput->stream->common);
     mChannelMask = mInput->stream->common.get_channels(&mInput->stream->common);
@@ -5222,31 +5497,22 @@ void AudioFlinger::RecordThread::readInputParameters()
     mFrameSize = audio_stream_frame_size(&mInput->stream->common);
     mBufferSize = mInput->stream->common.get_buffer_size(&mInput->stream->common);
     mFrameCount = mBufferSize / mFrameSize;
-    mRsmpInBuffer = new int16_t[mFrameCount * mChannelCount];
 
-    if (mSampleRate != mReqSampleRate && mChannelCount <= FCC_2 && mReqChannelCount <= FCC_2)
-    {
-        int channelCount;
-        // optimization: if mono to mono, use the resampler in stereo to stereo mode to avoid
-        // stereo to mono post process as the resampler always outputs stereo.
-        if (mChannelCount == 1 && mReqChannelCount == 2) {
-            channelCount = 1;
-        } else {
-            channelCount = 2;
-        }
-        mResampler = AudioResampler::create(16, channelCount, mReqSampleRate);
-        mResampler->setSampleRate(mSampleRate);
-        mResampler->setVolume(AudioMixer::UNITY_GAIN, AudioMixer::UNITY_GAIN);
-        mRsmpOutBuffer = new int32_t[mFrameCount * FCC_2];
-
-        // optmization: if mono to mono, alter input frame count as if we were inputing
-        // stereo samples
-        if (mChannelCount == 1 && mReqChannelCount == 1) {
-            mFrameCount >>= 1;
-        }
+    // A track may lag this many HAL buffers behind the fastest one before it is overrun.
+    // The ring is rounded up to a power of 2 so that indices wrap with a mask, and has room
+    // for a HAL read past its end.
+    mRsmpInFrames = mFrameCount * kRecordThreadBufferPeriods;
+    mRsmpInFramesP2 = roundup(mRsmpInFrames);
+    mRsmpInBuffer = new int16_t[(mRsmpInFramesP2 + mFrameCount) * mChannelCount];
+    mRsmpInRear = 0;
 
+    // each track converts from the input to its own sample rate and channel count
+    for (size_t i = 0; i < mTracks.size(); i++) {
+        const sp<RecordTrack>& track = mTracks[i];
+        track->updateResampler(mSampleRate, mChannelCount);
+        track->mRsmpInFront = mRsmpInRear;
+        track->mRsmpInUnrel = 0;
     }
-    mRsmpInIndex = mFrameCount;
 }
 
 unsigned int AudioFlinger::RecordThread::getInputFramesLost()
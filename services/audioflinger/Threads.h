@@ -481,6 +481,22 @@ protected:
     int16_t*                        mMixBuffer;         // frame size aligned mix buffer
     int8_t*                         mAllocMixBuffer;    // mixer buffer allocation address
 
+    // (Re)allocates mMixerBuffer for mNormalFrameCount, if float mixing is enabled
+    void                            allocMixerBuffer();
+    // Zeroes mMixerBuffer and marks it valid, for cycles where no track was mixed to it but
+    // effect chains may accumulate into it, or where silence is written
+    void                            clearMixerBuffer();
+    // Converts mMixerBuffer to mMixBuffer once the effects are done, if it is valid
+    void                            convertMixerBuffer();
+
+    // Float mixing, selected per MixerThread with property af.mixer.float at creation.
+    // Tracks that would mix to mMixBuffer mix to mMixerBuffer instead, and effect chains
+    // process in float and accumulate into it.  It is converted to the HAL format once per
+    // cycle after the effects, so that the headroom of the mix is only lost at the very end.
+    bool                            mMixerBufferEnabled;
+    float*                          mMixerBuffer;       // non-NULL iff mMixerBufferEnabled
+    bool                            mMixerBufferValid;  // holds this cycle's mix
+
     // suspend count, > 0 means suspended.  While suspended, the thread continues to pull from
     // tracks and mix, but doesn't write to HAL.  A2DP and SCO HAL implementations can't handle
     // concurrent use of both of them, so Audio Policy Service suspends one of the threads to
@@ -674,6 +690,7 @@ protected:
     virtual     uint32_t    correctLatency_l(uint32_t latency) const;
 
                 AudioMixer* mAudioMixer;    // normal mixer
+
 private:
                 // one-time initialization, no locks required
                 FastMixer*  mFastMixer;         // non-NULL if there is also a fast mixer
@@ -681,6 +698,8 @@ private:
 
                 // contents are not guaranteed to be consistent, no locks required
                 FastMixerDumpState mFastMixerDumpState;
+                // updated by the fast mixer, read with snapshot()
+                FastMixerHistograms mFastMixerHistograms;
 #ifdef STATE_QUEUE_DUMP
                 StateQueueObserverDump mStateQueueObserverDump;
                 StateQueueMutatorDump  mStateQueueMutatorDump;
@@ -838,13 +857,28 @@ public:
 
 
 // record thread
-class RecordThread : public ThreadBase, public AudioBufferProvider
-                        // derives from AudioBufferProvider interface for use by resampler
+class RecordThread : public ThreadBase
 {
 public:
 
+    class ResamplerBufferProvider;
+
 #include "RecordTracks.h"
 
+    // Feeds the resampler of one RecordTrack from the shared input ring buffer,
+    // starting at the track's own read position.
+    class ResamplerBufferProvider : public AudioBufferProvider
+    {
+    public:
+        ResamplerBufferProvider(RecordTrack* recordTrack) : mRecordTrack(recordTrack) { }
+        virtual ~ResamplerBufferProvider() { }
+        // AudioBufferProvider interface
+        virtual status_t    getNextBuffer(AudioBufferProvider::Buffer* buffer, int64_t pts);
+        virtual void        releaseBuffer(AudioBufferProvider::Buffer* buffer);
+    private:
+        RecordTrack * const mRecordTrack;
+    };
+
             RecordThread(const sp<AudioFlinger>& audioFlinger,
                     AudioStreamIn *input,
                     uint32_t sampleRate,
@@ -897,10 +931,6 @@ public:
             AudioStreamIn* clearInput();
             virtual audio_stream_t* stream() const;
 
-    // AudioBufferProvider interface
-    virtual status_t    getNextBuffer(AudioBufferProvider::Buffer* buffer, int64_t pts);
-    virtual void        releaseBuffer(AudioBufferProvider::Buffer* buffer);
-
     virtual bool        checkForNewParameters_l();
     virtual String8     getParameters(const String8& keys);
     virtual void        audioConfigChanged_l(int event, int param = 0);
@@ -920,44 +950,51 @@ public:
     virtual bool     isValidSyncEvent(const sp<SyncEvent>& event) const;
 
     static void syncStartEventCallback(const wp<SyncEvent>& event);
-           void handleSyncStartEvent(const sp<SyncEvent>& event);
 
     virtual size_t      frameCount() const { return mFrameCount; }
             bool        hasFastRecorder() const { return false; }
 
 private:
-            void clearSyncStartEvent();
-
             // Enter standby if not already in standby, and set mStandby flag
             void standby();
 
             // Call the HAL standby method unconditionally, and don't change mStandby flag
             void inputStandBy();
 
+            // Returns true if the input is started and no track other than 'track' needs it
+            // anymore, in which case mInputStarted is cleared and the caller must call
+            // AudioSystem::stopInput() once mLock is released.
+            bool shouldStopInput_l(const RecordTrack* track);
+
+            // converts the input frames between the track's read position and mRsmpInRear
+            // into its buffer, as far as the client has room
+            void processTrack(const sp<RecordTrack>& activeTrack, nsecs_t& lastWarning);
+
             AudioStreamIn                       *mInput;
             SortedVector < sp<RecordTrack> >    mTracks;
-            // mActiveTrack has dual roles:  it indicates the current active track, and
+            // mActiveTracks has dual roles:  it indicates the current active tracks, and
             // is used together with mStartStopCond to indicate start()/stop() progress
-            sp<RecordTrack>                     mActiveTrack;
+            SortedVector < sp<RecordTrack> >    mActiveTracks;
+            int                                 mActiveTracksGen; // incremented on changes
             Condition                           mStartStopCond;
-
-            // updated by RecordThread::readInputParameters()
-            AudioResampler                      *mResampler;
-            // interleaved stereo pairs of fixed-point signed Q19.12
-            int32_t                             *mRsmpOutBuffer;
-            int16_t                             *mRsmpInBuffer; // [mFrameCount * mChannelCount]
-            size_t                              mRsmpInIndex;
+            // AudioSystem::startInput() was called for the current active tracks
+            bool                                mInputStarted;
+
+            // Ring buffer of input frames shared by all active tracks, updated by
+            // RecordThread::readInputParameters().  Only threadLoop() writes it, one HAL read at
+            // a time, and each track reads it from its own mRsmpInFront.  A track that falls
+            // more than mRsmpInFrames behind is overrun and skips ahead, it never holds back
+            // the HAL read or the other tracks.
+            int16_t                             *mRsmpInBuffer; // [mRsmpInFramesP2 + mFrameCount]
+                                                                // * mChannelCount
+            size_t                              mRsmpInFrames;  // frames a track may lag behind
+            size_t                              mRsmpInFramesP2;// ring size, a power of 2
+            // rolling counter that is never cleared
+            int32_t                             mRsmpInRear;    // last filled frame + 1
             size_t                              mBufferSize;    // stream buffer size for read()
+            // requested configuration of the input, for parameter changes and dump
             const uint32_t                      mReqChannelCount;
             const uint32_t                      mReqSampleRate;
-            ssize_t                             mBytesRead;
-            // sync event triggering actual audio capture. Frames read before this event will
-            // be dropped and therefore not read by the application.
-            sp<SyncEvent>                       mSyncStartEvent;
-            // number of captured frames to drop after the start sync event has been received.
-            // when < 0, maximum frames to drop before starting capture even if sync event is
-            // not received
-            ssize_t                             mFramestoDrop;
 
             // For dumpsys
             const sp<NBAIO_Sink>                mTeeSink;
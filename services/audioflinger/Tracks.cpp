@@ -1760,7 +1760,11 @@ AudioFlinger::RecordThread::RecordTrack::RecordTrack(
             int uid)
     :   TrackBase(thread, client, sampleRate, format,
                   channelMask, frameCount, 0 /*sharedBuffer*/, sessionId, uid, false /*isOut*/),
-        mOverflow(false)
+        mOverflow(false), mResampler(NULL), mResamplerBufferProvider(NULL),
+        mRsmpOutBuffer(NULL), mRsmpOutFrameCount(0),
+        // mRsmpInFront and mRsmpInUnrel are set by RecordThread::start()
+        mRsmpInFront(0), mRsmpInUnrel(0),
+        mFramesToDrop(0)
 {
     ALOGV("RecordTrack constructor");
     if (mCblk != NULL) {
@@ -1768,11 +1772,34 @@ AudioFlinger::RecordThread::RecordTrack::RecordTrack(
                 mFrameSize);
         mServerProxy = mAudioRecordServerProxy;
     }
+    updateResampler(thread->mSampleRate, thread->mChannelCount);
 }
 
 AudioFlinger::RecordThread::RecordTrack::~RecordTrack()
 {
     ALOGV("%s", __func__);
+    clearSyncStartEvent();
+    delete mResampler;
+    delete mResamplerBufferProvider;
+    delete[] mRsmpOutBuffer;
+}
+
+void AudioFlinger::RecordThread::RecordTrack::updateResampler(uint32_t inSampleRate,
+        uint32_t inChannelCount)
+{
+    delete mResampler;
+    mResampler = NULL;
+    if (inSampleRate == mSampleRate) {
+        return;
+    }
+    // the resampler reads the input channels and always outputs stereo, threadLoop()
+    // downmixes it for mono tracks
+    mResampler = AudioResampler::create(16, inChannelCount, mSampleRate);
+    mResampler->setSampleRate(inSampleRate);
+    mResampler->setVolume(AudioMixer::UNITY_GAIN, AudioMixer::UNITY_GAIN);
+    if (mResamplerBufferProvider == NULL) {
+        mResamplerBufferProvider = new ResamplerBufferProvider(this);
+    }
 }
 
 // AudioBufferProvider interface
@@ -1821,13 +1848,19 @@ void AudioFlinger::RecordThread::RecordTrack::destroy()
     {
         sp<ThreadBase> thread = mThread.promote();
         if (thread != 0) {
-            if (mState == ACTIVE || mState == RESUMING) {
+            RecordThread *recordThread = (RecordThread *) thread.get();
+            bool stopInput;
+            {
+                Mutex::Autolock _l(thread->mLock);
+                // the input stays started for the other active tracks, if any
+                stopInput = (mState == ACTIVE || mState == RESUMING) &&
+                        recordThread->shouldStopInput_l(this);
+                recordThread->destroyTrack_l(this);
+            }
+            if (stopInput) {
                 AudioSystem::stopInput(thread->id());
             }
             AudioSystem::releaseInput(thread->id());
-            Mutex::Autolock _l(thread->mLock);
-            RecordThread *recordThread = (RecordThread *) thread.get();
-            recordThread->destroyTrack_l(this);
         }
     }
 }
@@ -1842,22 +1875,45 @@ void AudioFlinger::RecordThread::RecordTrack::invalidate()
     (void) __futex_syscall3(&cblk->mFutex, FUTEX_WAKE, INT_MAX);
 }
 
+void AudioFlinger::RecordThread::RecordTrack::clearSyncStartEvent()
+{
+    if (mSyncStartEvent != 0) {
+        mSyncStartEvent->cancel();
+    }
+    mSyncStartEvent.clear();
+    mFramesToDrop = 0;
+}
+
+void AudioFlinger::RecordThread::RecordTrack::handleSyncStartEvent(const sp<SyncEvent>& event)
+{
+    if (event == mSyncStartEvent) {
+        // TODO: use actual buffer filling status instead of 2 buffers when info is available
+        // from audio HAL
+        sp<ThreadBase> thread = mThread.promote();
+        if (thread != 0) {
+            mFramesToDrop = thread->frameCount() * 2;
+        }
+    }
+}
+
 
 /*static*/ void AudioFlinger::RecordThread::RecordTrack::appendDumpHeader(String8& result)
 {
-    result.append("Client Fmt Chn mask Session S   Server fCount\n");
+    result.append("Client Fmt Chn mask Session S   Server fCount  SRate Rsmp\n");
 }
 
 void AudioFlinger::RecordThread::RecordTrack::dump(char* buffer, size_t size)
 {
-    snprintf(buffer, size, "%6u %3u %08X %7u %1d %08X %6u\n",
+    snprintf(buffer, size, "%6u %3u %08X %7u %1d %08X %6u %6u %4s\n",
             (mClient == 0) ? getpid_cached : mClient->pid(),
             mFormat,
             mChannelMask,
             mSessionId,
             mState,
             mCblk->mServer,
-            mFrameCount);
+            mFrameCount,
+            mSampleRate,
+            mResampler != NULL ? "yes" : "no");
 }
 
 }; // namespace android
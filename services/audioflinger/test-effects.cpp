@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AudioMixerOps.h"
+#include <audio_effects/effect_bassboost.h>
+#include <audio_effects/effect_equalizer.h>
+#include <audio_effects/effect_presetreverb.h>
+#include <audio_effects/effect_virtualizer.h>
+#include <hardware/audio_effect.h>
+#include <media/EffectsFactoryApi.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+using namespace android;
+
+// Benchmarks an insert effect chain of the bundled effects per mix buffer: bass boost,
+// virtualizer and equalizer from the LVM bundle, then the LVM preset reverb.  The chain is
+// run the way EffectChain::process_l() runs it:
+//   int16       16-bit chain, every effect in place on the 16-bit mix
+//   float       float chain: effects that accept float process the float mix, the others are
+//               converted to 16-bit once per run of consecutive 16-bit effects
+//   float-each  float chain converting to and from 16-bit around every 16-bit effect,
+//               i.e. what each effect doing its own conversion would cost
+
+// the chain is always stereo, like effect chain buffers in AudioFlinger
+static const size_t kChannelCount = 2;
+
+struct ChainEffect {
+    const char* name;
+    const effect_uuid_t* type;
+    int32_t param;
+    int16_t value;      // all the parameters set below are 16-bit
+    effect_handle_t handle;
+    bool acceptsFloat;
+};
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int command(effect_handle_t handle, uint32_t cmdCode, uint32_t cmdSize, void* cmdData) {
+    int reply = 0;
+    uint32_t replySize = sizeof(reply);
+    int status = (*handle)->command(handle, cmdCode, cmdSize, cmdData, &replySize, &reply);
+    return status != 0 ? status : reply;
+}
+
+static int setParameter(effect_handle_t handle, int32_t param, int16_t value) {
+    uint32_t buf32[(sizeof(effect_param_t) + sizeof(int32_t) + sizeof(int32_t)) /
+            sizeof(uint32_t)];
+    effect_param_t* p = (effect_param_t*) buf32;
+    p->psize = sizeof(int32_t);
+    p->vsize = sizeof(int16_t);
+    *(int32_t*) p->data = param;
+    *(int16_t*) (p->data + sizeof(int32_t)) = value;
+    return command(handle, EFFECT_CMD_SET_PARAM,
+            sizeof(effect_param_t) + sizeof(int32_t) + sizeof(int16_t), p);
+}
+
+static int configure(effect_handle_t handle, audio_format_t format, void* buffer,
+        size_t frameCount, uint32_t sampleRate) {
+    effect_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.inputCfg.buffer.frameCount = frameCount;
+    config.inputCfg.buffer.raw = buffer;
+    config.inputCfg.samplingRate = sampleRate;
+    config.inputCfg.channels = AUDIO_CHANNEL_OUT_STEREO;
+    config.inputCfg.format = format;
+    config.inputCfg.accessMode = EFFECT_BUFFER_ACCESS_READ;
+    config.inputCfg.mask = EFFECT_CONFIG_ALL;
+    config.outputCfg = config.inputCfg;
+    // in place, as insert effects of a float chain always are
+    config.outputCfg.accessMode = EFFECT_BUFFER_ACCESS_WRITE;
+    return command(handle, EFFECT_CMD_SET_CONFIG, sizeof(config), &config);
+}
+
+// Creates the insert implementation of an effect type, as AudioFlinger would for session.
+static effect_handle_t createEffect(const effect_uuid_t* type, int session) {
+    uint32_t numEffects;
+    if (EffectQueryNumberEffects(&numEffects) != 0) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < numEffects; ++i) {
+        effect_descriptor_t desc;
+        if (EffectQueryEffect(i, &desc) != 0 ||
+                memcmp(&desc.type, type, sizeof(effect_uuid_t)) != 0 ||
+                (desc.flags & EFFECT_FLAG_TYPE_MASK) != EFFECT_FLAG_TYPE_INSERT) {
+            continue;
+        }
+        effect_handle_t handle;
+        if (EffectCreate(&desc.uuid, session, 0 /*ioId*/, &handle) != 0) {
+            continue;
+        }
+        if (command(handle, EFFECT_CMD_INIT, 0, NULL) != 0) {
+            EffectRelease(handle);
+            continue;
+        }
+        return handle;
+    }
+    return NULL;
+}
+
+static void processEffect(effect_handle_t handle, void* buffer, size_t frameCount) {
+    audio_buffer_t audioBuffer;
+    audioBuffer.frameCount = frameCount;
+    audioBuffer.raw = buffer;
+    (*handle)->process(handle, &audioBuffer, &audioBuffer);
+}
+
+enum Mode {
+    MODE_INT16,
+    MODE_FLOAT,
+    MODE_FLOAT_EACH,
+};
+
+static const char* const kModeNames[] = { "int16", "float", "float-each" };
+
+// Returns the average time to process a buffer through the first numEffects effects.
+static int64_t benchmark(Mode mode, ChainEffect* effects, size_t numEffects,
+        size_t frameCount, uint32_t sampleRate, size_t iterations) {
+    const size_t numSamples = frameCount * kChannelCount;
+
+    // half scale pink-ish test signal: a few harmonics of a low tone, which exercises both
+    // the bass boost and the equalizer
+    float* signal = new float[numSamples];
+    for (size_t i = 0; i < frameCount; ++i) {
+        float sample = 0;
+        for (int h = 1; h <= 8; ++h) {
+            sample += sin(2 * M_PI * 110.0 * h * i / sampleRate) / h;
+        }
+        signal[i * kChannelCount] = signal[i * kChannelCount + 1] = 0.25f * sample;
+    }
+    int16_t* signal16 = new int16_t[numSamples];
+    memcpy_to_mixer_format_from_float(signal16, AUDIO_FORMAT_PCM_16_BIT, signal, numSamples);
+
+    float* mix = new float[numSamples];
+    int16_t* convert = new int16_t[numSamples];
+
+    for (size_t e = 0; e < numEffects; ++e) {
+        audio_format_t format = AUDIO_FORMAT_PCM_16_BIT;
+        void* buffer = convert;
+        if (mode != MODE_INT16 && effects[e].acceptsFloat) {
+            format = AUDIO_FORMAT_PCM_FLOAT;
+            buffer = mix;
+        }
+        configure(effects[e].handle, format, buffer, frameCount, sampleRate);
+        command(effects[e].handle, EFFECT_CMD_RESET, 0, NULL);
+    }
+
+    int64_t totalNs = 0;
+    for (size_t n = 0; n < iterations; ++n) {
+        // a new mix every buffer, not part of the measurement
+        if (mode == MODE_INT16) {
+            memcpy(convert, signal16, numSamples * sizeof(int16_t));
+        } else {
+            memcpy(mix, signal, numSamples * sizeof(float));
+        }
+
+        const int64_t startNs = nowNs();
+        if (mode == MODE_INT16) {
+            for (size_t e = 0; e < numEffects; ++e) {
+                processEffect(effects[e].handle, convert, frameCount);
+            }
+        } else {
+            bool inConvert = false;
+            for (size_t e = 0; e < numEffects; ++e) {
+                const bool is16Bit = !effects[e].acceptsFloat;
+                if (is16Bit && !inConvert) {
+                    memcpy_to_mixer_format_from_float(convert, AUDIO_FORMAT_PCM_16_BIT, mix,
+                            numSamples);
+                    inConvert = true;
+                } else if (!is16Bit && inConvert) {
+                    for (size_t i = 0; i < numSamples; ++i) {
+                        mix[i] = float_from_i16(convert[i]);
+                    }
+                    inConvert = false;
+                }
+                processEffect(effects[e].handle, is16Bit ? (void*) convert : (void*) mix,
+                        frameCount);
+                if (mode == MODE_FLOAT_EACH && inConvert) {
+                    for (size_t i = 0; i < numSamples; ++i) {
+                        mix[i] = float_from_i16(convert[i]);
+                    }
+                    inConvert = false;
+                }
+            }
+            if (inConvert) {
+                for (size_t i = 0; i < numSamples; ++i) {
+                    mix[i] = float_from_i16(convert[i]);
+                }
+            }
+        }
+        totalNs += nowNs() - startNs;
+    }
+
+    delete[] convert;
+    delete[] mix;
+    delete[] signal16;
+    delete[] signal;
+
+    return totalNs / iterations;
+}
+
+static int usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-f frame-count] [-o sample-rate] [-n iterations]\n", name);
+    fprintf(stderr, "    -f    frames per mix buffer (default 1024)\n");
+    fprintf(stderr, "    -o    sample rate (default 48000)\n");
+    fprintf(stderr, "    -n    buffers per measurement (default 1000)\n");
+    return -1;
+}
+
+int main(int argc, char* argv[]) {
+    const char* const progname = argv[0];
+    size_t frameCount = 1024;
+    uint32_t sampleRate = 48000;
+    size_t iterations = 1000;
+
+    int ch;
+    while ((ch = getopt(argc, argv, "f:o:n:")) != -1) {
+        switch (ch) {
+        case 'f':
+            frameCount = atoi(optarg);
+            break;
+        case 'o':
+            sampleRate = atoi(optarg);
+            break;
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        default:
+            return usage(progname);
+        }
+    }
+    if (frameCount == 0 || sampleRate == 0 || iterations == 0) {
+        return usage(progname);
+    }
+
+    // the order of a typical music session chain: bundle effects first, reverb last
+    ChainEffect effects[] = {
+        { "bassboost",   SL_IID_BASSBOOST,   BASSBOOST_PARAM_STRENGTH,   1000, NULL, false },
+        { "virtualizer", SL_IID_VIRTUALIZER, VIRTUALIZER_PARAM_STRENGTH, 1000, NULL, false },
+        { "equalizer",   SL_IID_EQUALIZER,   EQ_PARAM_CUR_PRESET,        3,    NULL, false },
+        { "reverb",      SL_IID_PRESETREVERB, REVERB_PARAM_PRESET,
+                REVERB_PRESET_LARGEHALL, NULL, false },
+    };
+    const size_t maxEffects = sizeof(effects) / sizeof(effects[0]);
+
+    // a session other than the output mix, so the bundle effects share one LVM instance
+    const int session = 1;
+    void* probe = new float[frameCount * kChannelCount];
+    size_t numEffects = 0;
+    for (; numEffects < maxEffects; ++numEffects) {
+        ChainEffect& effect = effects[numEffects];
+        effect.handle = createEffect(effect.type, session);
+        if (effect.handle == NULL) {
+            fprintf(stderr, "no %s effect, stopping the chain there\n", effect.name);
+            break;
+        }
+        // an effect supports float if it accepts a float configuration,
+        // as EffectChain::configureFloat_l() finds out
+        effect.acceptsFloat = configure(effect.handle, AUDIO_FORMAT_PCM_FLOAT, probe,
+                frameCount, sampleRate) == 0;
+        configure(effect.handle, AUDIO_FORMAT_PCM_16_BIT, probe, frameCount, sampleRate);
+        setParameter(effect.handle, effect.param, effect.value);
+        command(effect.handle, EFFECT_CMD_ENABLE, 0, NULL);
+    }
+    delete[] (float*) probe;
+    if (numEffects == 0) {
+        fprintf(stderr, "no effects available\n");
+        return -1;
+    }
+
+    const double bufferNs = frameCount * 1e9 / sampleRate;
+    printf("%u Hz stereo, %zu frames per buffer\n", sampleRate, frameCount);
+    printf("%-12s %-6s", "chain", "float");
+    for (size_t m = 0; m < sizeof(kModeNames) / sizeof(kModeNames[0]); ++m) {
+        printf("  %10s us (%%cpu)", kModeNames[m]);
+    }
+    printf("\n");
+    for (size_t n = 1; n <= numEffects; ++n) {
+        printf("+%-11s %-6s", effects[n - 1].name, effects[n - 1].acceptsFloat ? "yes" : "no");
+        for (size_t m = 0; m < sizeof(kModeNames) / sizeof(kModeNames[0]); ++m) {
+            int64_t ns = benchmark((Mode) m, effects, n, frameCount, sampleRate, iterations);
+            printf("  %10.1f    (%5.2f)", ns / 1000.0, ns * 100.0 / bufferNs);
+        }
+        printf("\n");
+    }
+
+    for (size_t n = 0; n < numEffects; ++n) {
+        command(effects[n].handle, EFFECT_CMD_DISABLE, 0, NULL);
+        EffectRelease(effects[n].handle);
+    }
+    return 0;
+}
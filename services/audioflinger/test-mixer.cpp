@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AudioMixer.h"
+#include "AudioMixerOps.h"
+#include <media/AudioBufferProvider.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+using namespace android;
+
+// Benchmarks AudioMixer::process() for the 16-bit and the float mixing paths with an
+// increasing number of active tracks, each playing a sine wave.
+
+// Serves a looped, precomputed sine wave in the requested format.
+class SignalProvider : public AudioBufferProvider {
+public:
+    SignalProvider(audio_format_t format, uint32_t channelCount, uint32_t sampleRate,
+            double frequency, size_t frameCount)
+        : mFrameCount(frameCount),
+          mFrameSize(channelCount * mixer_bytes_per_sample(format)),
+          mOffset(0)
+    {
+        mData = new uint8_t[frameCount * mFrameSize];
+        for (size_t i = 0; i < frameCount; ++i) {
+            // half scale so that a few tracks can be summed before clipping
+            float sample = 0.5f * sin(2 * M_PI * frequency * i / sampleRate);
+            for (size_t c = 0; c < channelCount; ++c) {
+                const size_t index = i * channelCount + c;
+                if (format == AUDIO_FORMAT_PCM_FLOAT) {
+                    ((float *) mData)[index] = sample;
+                } else {
+                    ((int16_t *) mData)[index] = clamp16_from_float(sample);
+                }
+            }
+        }
+    }
+
+    virtual ~SignalProvider() {
+        delete [] mData;
+    }
+
+    virtual status_t getNextBuffer(Buffer* buffer, int64_t pts) {
+        size_t frames = mFrameCount - mOffset;
+        if (buffer->frameCount < frames) {
+            frames = buffer->frameCount;
+        }
+        buffer->frameCount = frames;
+        buffer->raw = mData + mOffset * mFrameSize;
+        return NO_ERROR;
+    }
+
+    virtual void releaseBuffer(Buffer* buffer) {
+        mOffset += buffer->frameCount;
+        if (mOffset >= mFrameCount) {
+            mOffset = 0;
+        }
+        buffer->raw = NULL;
+        buffer->frameCount = 0;
+    }
+
+private:
+    const size_t mFrameCount;
+    const size_t mFrameSize;
+    size_t mOffset;
+    uint8_t* mData;
+};
+
+struct Path {
+    const char* name;
+    audio_format_t trackFormat;
+    audio_format_t mixerFormat;
+};
+
+static const Path kPaths[] = {
+    { "int16",    AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_16_BIT },
+    { "float",    AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_FLOAT },
+    { "float-in", AUDIO_FORMAT_PCM_FLOAT,  AUDIO_FORMAT_PCM_FLOAT },
+};
+
+// Channel masks for the channel counts that AudioMixer mixes natively, or 0.
+static audio_channel_mask_t channelMaskFromCount(uint32_t channelCount) {
+    switch (channelCount) {
+    case 1:
+        return AUDIO_CHANNEL_OUT_MONO;
+    case 2:
+        return AUDIO_CHANNEL_OUT_STEREO;
+    case 4:
+        return AUDIO_CHANNEL_OUT_QUAD;
+    case 6:
+        return AUDIO_CHANNEL_OUT_5POINT1;
+    case 8:
+        return AUDIO_CHANNEL_OUT_7POINT1;
+    default:
+        return 0;
+    }
+}
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Returns the average time in ns to mix one buffer of frameCount frames.
+static int64_t benchmark(const Path& path, size_t numTracks, size_t frameCount,
+        uint32_t sampleRate, uint32_t trackSampleRate, uint32_t channelCount,
+        uint32_t mixerChannelCount, bool ramp, size_t iterations) {
+    AudioMixer* mixer = new AudioMixer(frameCount, sampleRate);
+    SignalProvider* providers[AudioMixer::MAX_NUM_TRACKS];
+
+    // large enough for any of the mix formats and channel counts
+    void* mainBuffer = new float[frameCount * AudioMixer::MAX_NUM_CHANNELS];
+    const audio_channel_mask_t channelMask = channelMaskFromCount(channelCount);
+
+    for (size_t i = 0; i < numTracks; ++i) {
+        providers[i] = new SignalProvider(path.trackFormat, channelCount, trackSampleRate,
+                220.0 * (i + 1), 4096);
+        int name = mixer->getTrackName(channelMask, 0 /*sessionId*/);
+        if (name < 0) {
+            fprintf(stderr, "out of track names\n");
+            exit(1);
+        }
+        mixer->setBufferProvider(name, providers[i]);
+        mixer->setParameter(name, AudioMixer::TRACK, AudioMixer::FORMAT,
+                (void *) path.trackFormat);
+        mixer->setParameter(name, AudioMixer::TRACK, AudioMixer::MIXER_FORMAT,
+                (void *) path.mixerFormat);
+        mixer->setParameter(name, AudioMixer::TRACK, AudioMixer::MIXER_CHANNEL_MASK,
+                (void *) channelMaskFromCount(mixerChannelCount));
+        mixer->setParameter(name, AudioMixer::TRACK, AudioMixer::MAIN_BUFFER, mainBuffer);
+        mixer->setParameter(name, AudioMixer::RESAMPLE, AudioMixer::SAMPLE_RATE,
+                (void *) trackSampleRate);
+        mixer->setParameter(name, AudioMixer::VOLUME, AudioMixer::VOLUME0,
+                (void *) (AudioMixer::UNITY_GAIN / 2));
+        mixer->setParameter(name, AudioMixer::VOLUME, AudioMixer::VOLUME1,
+                (void *) (AudioMixer::UNITY_GAIN / 2));
+        mixer->enable(name);
+    }
+
+    // warm up caches and let the mixer select its hooks
+    mixer->process(AudioBufferProvider::kInvalidPTS);
+
+    int64_t totalNs = 0;
+    for (size_t n = 0; n < iterations; ++n) {
+        if (ramp) {
+            // alternate between two volumes so that every buffer is ramped
+            int volume = (n & 1) ? AudioMixer::UNITY_GAIN / 2 : AudioMixer::UNITY_GAIN / 4;
+            for (size_t i = 0; i < numTracks; ++i) {
+                int name = AudioMixer::TRACK0 + i;
+                mixer->setParameter(name, AudioMixer::RAMP_VOLUME, AudioMixer::VOLUME0,
+                        (void *) volume);
+                mixer->setParameter(name, AudioMixer::RAMP_VOLUME, AudioMixer::VOLUME1,
+                        (void *) volume);
+            }
+        }
+        int64_t startNs = nowNs();
+        mixer->process(AudioBufferProvider::kInvalidPTS);
+        totalNs += nowNs() - startNs;
+    }
+
+    delete mixer;
+    for (size_t i = 0; i < numTracks; ++i) {
+        delete providers[i];
+    }
+    delete [] (float *) mainBuffer;
+
+    return totalNs / iterations;
+}
+
+static int usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-m] [-c track-channels] [-x mix-channels] [-v] [-t max-tracks]"
+                    " [-f frame-count] [-o output-sample-rate] [-i input-sample-rate]"
+                    " [-n iterations]\n", name);
+    fprintf(stderr, "    -m    mono tracks, same as -c 1\n");
+    fprintf(stderr, "    -c    channels per track: 1, 2, 4, 6 or 8 (default 2)\n");
+    fprintf(stderr, "    -x    channels of the mix: 2, 4, 6 or 8 (default 2), anything but 2\n"
+                    "          mixes in float on all paths\n");
+    fprintf(stderr, "    -v    ramp the volume of every buffer\n");
+    fprintf(stderr, "    -t    maximum number of active tracks, up to %u (default %u)\n",
+            AudioMixer::MAX_NUM_TRACKS, AudioMixer::MAX_NUM_TRACKS);
+    fprintf(stderr, "    -f    frames per mix buffer, multiple of 16 (default 1024)\n");
+    fprintf(stderr, "    -o    mixer sample rate (default 48000)\n");
+    fprintf(stderr, "    -i    track sample rate, resamples if different (default: -o)\n");
+    fprintf(stderr, "    -n    mix buffers per measurement (default 1000)\n");
+    return -1;
+}
+
+int main(int argc, char* argv[]) {
+    const char* const progname = argv[0];
+    uint32_t channelCount = 2;
+    uint32_t mixerChannelCount = 2;
+    bool ramp = false;
+    size_t maxTracks = AudioMixer::MAX_NUM_TRACKS;
+    size_t frameCount = 1024;
+    uint32_t sampleRate = 48000;
+    uint32_t trackSampleRate = 0;
+    size_t iterations = 1000;
+
+    int ch;
+    while ((ch = getopt(argc, argv, "mc:x:vt:f:o:i:n:")) != -1) {
+        switch (ch) {
+        case 'm':
+            channelCount = 1;
+            break;
+        case 'c':
+            channelCount = atoi(optarg);
+            break;
+        case 'x':
+            mixerChannelCount = atoi(optarg);
+            break;
+        case 'v':
+            ramp = true;
+            break;
+        case 't':
+            maxTracks = atoi(optarg);
+            break;
+        case 'f':
+            frameCount = atoi(optarg);
+            break;
+        case 'o':
+            sampleRate = atoi(optarg);
+            break;
+        case 'i':
+            trackSampleRate = atoi(optarg);
+            break;
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        default:
+            return usage(progname);
+        }
+    }
+    if (trackSampleRate == 0) {
+        trackSampleRate = sampleRate;
+    }
+    if (maxTracks < 1 || maxTracks > AudioMixer::MAX_NUM_TRACKS ||
+            frameCount == 0 || (frameCount & 15) || iterations == 0 || sampleRate == 0 ||
+            channelMaskFromCount(channelCount) == 0 || mixerChannelCount < 2 ||
+            channelMaskFromCount(mixerChannelCount) == 0) {
+        return usage(progname);
+    }
+
+    const double bufferNs = frameCount * 1e9 / sampleRate;
+    printf("%u Hz %u channel mix of %u channel %u Hz tracks, %u frames per buffer%s\n",
+            sampleRate, mixerChannelCount, channelCount, trackSampleRate, frameCount,
+            ramp ? ", volume ramps" : "");
+    printf("tracks");
+    for (size_t p = 0; p < sizeof(kPaths) / sizeof(kPaths[0]); ++p) {
+        printf("  %10s us (%%cpu)", kPaths[p].name);
+    }
+    printf("\n");
+
+    // 1, 2, 4, ... tracks, always ending with the requested maximum
+    for (size_t numTracks = 1; ;
+            numTracks = numTracks * 2 < maxTracks ? numTracks * 2 : maxTracks) {
+        printf("%6u", numTracks);
+        for (size_t p = 0; p < sizeof(kPaths) / sizeof(kPaths[0]); ++p) {
+            int64_t ns = benchmark(kPaths[p], numTracks, frameCount, sampleRate,
+                    trackSampleRate, channelCount, mixerChannelCount, ramp, iterations);
+            printf("  %10.1f    (%5.2f)", ns / 1000.0, ns * 100.0 / bufferNs);
+        }
+        printf("\n");
+        if (numTracks == maxTracks) {
+            break;
+        }
+    }
+
+    return 0;
+}
@@ -62,34 +62,106 @@ struct HeaderWav {
 };
 
 static int usage(const char* name) {
-    fprintf(stderr,"Usage: %s [-p] [-h] [-s] [-q {dq|lq|mq|hq|vhq}] [-i input-sample-rate] "
-                   "[-o output-sample-rate] [<input-file>] <output-file>\n", name);
+    fprintf(stderr,"Usage: %s [-p] [-h] [-s] [-F] [-q {dq|lq|mq|hq|vhq|pq}] "
+                   "[-i input-sample-rate] [-o output-sample-rate] [-f sine-frequency] "
+                   "[<input-file>] <output-file>\n", name);
     fprintf(stderr,"    -p    enable profiling\n");
     fprintf(stderr,"    -h    create wav file\n");
     fprintf(stderr,"    -s    stereo\n");
+    fprintf(stderr,"    -F    float input and output (polyphase quality only)\n");
     fprintf(stderr,"    -q    resampler quality\n");
     fprintf(stderr,"              dq  : default quality\n");
     fprintf(stderr,"              lq  : low quality\n");
     fprintf(stderr,"              mq  : medium quality\n");
     fprintf(stderr,"              hq  : high quality\n");
     fprintf(stderr,"              vhq : very high quality\n");
+    fprintf(stderr,"              pq  : polyphase quality\n");
     fprintf(stderr,"    -i    input file sample rate\n");
     fprintf(stderr,"    -o    output file sample rate\n");
+    fprintf(stderr,"    -f    generate a sine of this frequency instead of a chirp,\n");
+    fprintf(stderr,"          and report the SNR and THD of the output\n");
     return -1;
 }
 
+// Least squares fit of a sinusoid of frequency f, in cycles per sample, to x.
+// Returns the amplitudes of its cosine and sine terms.
+static void fitSine(const double* x, size_t n, double f, double* a, double* b) {
+    double cc = 0, ss = 0, cs = 0, xc = 0, xs = 0;
+    for (size_t i = 0; i < n; i++) {
+        double c = cos(2 * M_PI * f * i);
+        double s = sin(2 * M_PI * f * i);
+        cc += c * c;
+        ss += s * s;
+        cs += c * s;
+        xc += x[i] * c;
+        xs += x[i] * s;
+    }
+    double det = cc * ss - cs * cs;
+    *a = (xc * ss - xs * cs) / det;
+    *b = (xs * cc - xc * cs) / det;
+}
+
+// Fits the fundamental f and its harmonics below both Nyquist frequencies to x, then reports
+// the ratio of the fundamental to the residual (SNR) and of the harmonics to the fundamental
+// (THD).  x is modified.
+static void analyzeSine(double* x, size_t n, double f, double maxF) {
+    static const int kMaxHarmonic = 5;
+    double signal = 0;
+    double harmonics = 0;
+    for (int h = 1; h <= kMaxHarmonic && h * f < maxF; h++) {
+        double a, b;
+        fitSine(x, n, h * f, &a, &b);
+        double power = (a * a + b * b) / 2;
+        if (h == 1) {
+            signal = power;
+        } else {
+            harmonics += power;
+        }
+        for (size_t i = 0; i < n; i++) {
+            x[i] -= a * cos(2 * M_PI * h * f * i) + b * sin(2 * M_PI * h * f * i);
+        }
+    }
+    double noise = 0;
+    for (size_t i = 0; i < n; i++) {
+        noise += x[i] * x[i];
+    }
+    noise /= n;
+    printf("SNR %.1f dB", 10 * log10(signal / noise));
+    if (harmonics > 0) {
+        printf(", THD %.1f dB (%.5f%%)", 10 * log10(harmonics / signal),
+                100 * sqrt(harmonics / signal));
+    }
+    printf("\n");
+}
+
+// Maximum CPU frequency in Hz, or 0 if unknown.
+static double cpuFrequency() {
+    double hz = 0;
+    FILE* f = fopen("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq", "r");
+    if (f != NULL) {
+        unsigned long khz;
+        if (fscanf(f, "%lu", &khz) == 1) {
+            hz = khz * 1000.0;
+        }
+        fclose(f);
+    }
+    return hz;
+}
+
 int main(int argc, char* argv[]) {
 
     const char* const progname = argv[0];
     bool profiling = false;
     bool writeHeader = false;
+    bool useFloat = false;
     int channels = 1;
     int input_freq = 0;
     int output_freq = 0;
+    double sine_freq = 0;
     AudioResampler::src_quality quality = AudioResampler::DEFAULT_QUALITY;
 
     int ch;
-    while ((ch = getopt(argc, argv, "phsq:i:o:")) != -1) {
+    while ((ch = getopt(argc, argv, "phsFq:i:o:f:")) != -1) {
         switch (ch) {
         case 'p':
             profiling = true;
@@ -100,6 +172,9 @@ int main(int argc, char* argv[]) {
         case 's':
             channels = 2;
             break;
+        case 'F':
+            useFloat = true;
+            break;
         case 'q':
             if (!strcmp(optarg, "dq"))
                 quality = AudioResampler::DEFAULT_QUALITY;
@@ -111,6 +186,8 @@ int main(int argc, char* argv[]) {
                 quality = AudioResampler::HIGH_QUALITY;
             else if (!strcmp(optarg, "vhq"))
                 quality = AudioResampler::VERY_HIGH_QUALITY;
+            else if (!strcmp(optarg, "pq"))
+                quality = AudioResampler::POLYPHASE_QUALITY;
             else {
                 usage(progname);
                 return -1;
@@ -122,6 +199,9 @@ int main(int argc, char* argv[]) {
         case 'o':
             output_freq = atoi(optarg);
             break;
+        case 'f':
+            sine_freq = atof(optarg);
+            break;
         case '?':
         default:
             usage(progname);
@@ -135,13 +215,17 @@ int main(int argc, char* argv[]) {
     const char* file_out = NULL;
     if (argc == 1) {
         file_out = argv[0];
-    } else if (argc == 2) {
+    } else if (argc == 2 && sine_freq == 0) {
         file_in = argv[0];
         file_out = argv[1];
     } else {
         usage(progname);
         return -1;
     }
+    if (useFloat && quality != AudioResampler::POLYPHASE_QUALITY) {
+        fprintf(stderr, "float I/O requires -q pq\n");
+        return -1;
+    }
 
     // ----------------------------------------------------------
 
@@ -175,7 +259,8 @@ int main(int argc, char* argv[]) {
         int16_t* in = (int16_t*)input_vaddr;
         for (size_t i=0 ; i<input_frames ; i++) {
             double t = double(i) / input_freq;
-            double y = sin(M_PI * k * t * t);
+            double y = sine_freq != 0 ? 0.5 * sin(2 * M_PI * sine_freq * t) :
+                    sin(M_PI * k * t * t);
             int16_t yi = floor(y * 32767.0 + 0.5);
             for (size_t j=0 ; j<(size_t)channels ; j++) {
                 in[i*channels + j] = yi / (1+j);
@@ -183,71 +268,138 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    size_t input_frames = input_size / (channels * sizeof(int16_t));
+    if (useFloat) {
+        // a generated sine is recomputed in float, rather than converted from 16-bit,
+        // so that the analysis sees the resampler and not the input quantization
+        float* in = (float*) malloc(input_frames * channels * sizeof(float));
+        const int16_t* in16 = (const int16_t*) input_vaddr;
+        for (size_t i = 0; i < input_frames * channels; i++) {
+            in[i] = sine_freq != 0 ? 0.5 * sin(2 * M_PI * sine_freq * (i / channels) /
+                    input_freq) / (1 + i % channels) : in16[i] / 32768.0f;
+        }
+        input_vaddr = in;
+        input_size = input_frames * channels * sizeof(float);
+    }
+
     // ----------------------------------------------------------
 
+    // hands out the input in chunks of at most the requested size, like a track would
     class Provider: public AudioBufferProvider {
-        int16_t* mAddr;
+        uint8_t* mAddr;
+        size_t mFrameSize;
         size_t mNumFrames;
+        size_t mNextFrame;
     public:
-        Provider(const void* addr, size_t size, int channels) {
-            mAddr = (int16_t*) addr;
-            mNumFrames = size / (channels*sizeof(int16_t));
+        Provider(const void* addr, size_t size, size_t frameSize) {
+            mAddr = (uint8_t*) addr;
+            mFrameSize = frameSize;
+            mNumFrames = size / frameSize;
+            mNextFrame = 0;
+        }
+        void rewind() {
+            mNextFrame = 0;
         }
         virtual status_t getNextBuffer(Buffer* buffer,
                 int64_t pts = kInvalidPTS) {
-            buffer->frameCount = mNumFrames;
-            buffer->i16 = mAddr;
+            size_t frames = mNumFrames - mNextFrame;
+            if (frames == 0) {
+                buffer->frameCount = 0;
+                buffer->raw = NULL;
+                return NOT_ENOUGH_DATA;
+            }
+            if (buffer->frameCount < frames) {
+                frames = buffer->frameCount;
+            }
+            buffer->frameCount = frames;
+            buffer->raw = mAddr + mNextFrame * mFrameSize;
             return NO_ERROR;
         }
         virtual void releaseBuffer(Buffer* buffer) {
+            mNextFrame += buffer->frameCount;
+            buffer->frameCount = 0;
+            buffer->raw = NULL;
         }
-    } provider(input_vaddr, input_size, channels);
+    } provider(input_vaddr, input_size,
+            channels * (useFloat ? sizeof(float) : sizeof(int16_t)));
 
-    size_t input_frames = input_size / (channels * sizeof(int16_t));
+    const audio_format_t format = useFloat ? AUDIO_FORMAT_PCM_FLOAT : AUDIO_FORMAT_PCM_16_BIT;
     size_t output_size = 2 * 4 * ((int64_t) input_frames * output_freq) / input_freq;
     output_size &= ~7; // always stereo, 32-bits
 
     void* output_vaddr = malloc(output_size);
+    size_t out_frames = output_size/8;
 
     if (profiling) {
-        AudioResampler* resampler = AudioResampler::create(16, channels,
-                output_freq, quality);
+        static const int kRuns = 4;
+        int64_t time = 0;
+        for (int run = 0; run < kRuns; run++) {
+            AudioResampler* resampler = AudioResampler::create(format, channels,
+                    output_freq, quality);
+            resampler->setSampleRate(input_freq);
+            resampler->setVolume(0x1000, 0x1000);
+            provider.rewind();
 
-        size_t out_frames = output_size/8;
-        resampler->setSampleRate(input_freq);
-        resampler->setVolume(0x1000, 0x1000);
+            memset(output_vaddr, 0, output_size);
+            timespec start, end;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            if (useFloat) {
+                resampler->resampleFloat((float*) output_vaddr, out_frames, &provider);
+            } else {
+                resampler->resample((int*) output_vaddr, out_frames, &provider);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            int64_t start_ns = start.tv_sec * 1000000000LL + start.tv_nsec;
+            int64_t end_ns = end.tv_sec * 1000000000LL + end.tv_nsec;
+            time += end_ns - start_ns;
 
-        memset(output_vaddr, 0, output_size);
-        timespec start, end;
-        clock_gettime(CLOCK_MONOTONIC, &start);
-        resampler->resample((int*) output_vaddr, out_frames, &provider);
-        resampler->resample((int*) output_vaddr, out_frames, &provider);
-        resampler->resample((int*) output_vaddr, out_frames, &provider);
-        resampler->resample((int*) output_vaddr, out_frames, &provider);
-        clock_gettime(CLOCK_MONOTONIC, &end);
-        int64_t start_ns = start.tv_sec * 1000000000LL + start.tv_nsec;
-        int64_t end_ns = end.tv_sec * 1000000000LL + end.tv_nsec;
-        int64_t time = (end_ns - start_ns)/4;
+            delete resampler;
+        }
+        time /= kRuns;
         printf("%f Mspl/s\n", out_frames/(time/1e9)/1e6);
-
-        delete resampler;
+        double hz = cpuFrequency();
+        if (hz > 0) {
+            printf("%.1f cycles per output frame at %.0f MHz\n",
+                    time / 1e9 * hz / out_frames, hz / 1e6);
+        } else {
+            printf("%.1f ns per output frame\n", double(time) / out_frames);
+        }
     }
 
-    AudioResampler* resampler = AudioResampler::create(16, channels,
+    AudioResampler* resampler = AudioResampler::create(format, channels,
             output_freq, quality);
-    size_t out_frames = output_size/8;
     resampler->setSampleRate(input_freq);
     resampler->setVolume(0x1000, 0x1000);
+    provider.rewind();
 
     memset(output_vaddr, 0, output_size);
-    resampler->resample((int*) output_vaddr, out_frames, &provider);
+    if (useFloat) {
+        resampler->resampleFloat((float*) output_vaddr, out_frames, &provider);
+    } else {
+        resampler->resample((int*) output_vaddr, out_frames, &provider);
+    }
+
+    if (sine_freq != 0) {
+        // analyze the left channel at full precision, skipping the filter transients
+        const size_t skip = out_frames / 16;
+        const size_t n = out_frames - 2 * skip;
+        double* x = (double*) malloc(n * sizeof(double));
+        for (size_t i = 0; i < n; i++) {
+            x[i] = useFloat ? ((float*) output_vaddr)[(i + skip) * 2] :
+                    ((int32_t*) output_vaddr)[(i + skip) * 2] / double(1 << 27);
+        }
+        const int min_freq = input_freq < output_freq ? input_freq : output_freq;
+        analyzeSine(x, n, sine_freq / output_freq, 0.5 * min_freq / output_freq);
+        free(x);
+    }
 
     // down-mix (we just truncate and keep the left channel)
     int32_t* out = (int32_t*) output_vaddr;
     int16_t* convert = (int16_t*) malloc(out_frames * channels * sizeof(int16_t));
     for (size_t i = 0; i < out_frames; i++) {
         for (int j=0 ; j<channels ; j++) {
-            int32_t s = out[i * 2 + j] >> 12;
+            int32_t s = useFloat ? int32_t(lrintf(((float*) output_vaddr)[i * 2 + j] * 32768))
+                    : out[i * 2 + j] >> 12;
             if (s > 32767)       s =  32767;
             else if (s < -32768) s = -32768;
             convert[i * channels + j] = int16_t(s);
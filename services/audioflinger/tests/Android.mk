@@ -0,0 +1,32 @@
+# Build the unit tests.
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := AudioMixerKernels_test
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+    AudioMixerKernels_test.cpp \
+    ../AudioMixerKernels.cpp.arm
+
+LOCAL_SHARED_LIBRARIES := \
+	libaudioutils \
+	libcutils \
+	libstlport \
+	libutils \
+	liblog
+
+LOCAL_STATIC_LIBRARIES := \
+	libgtest \
+	libgtest_main \
+
+LOCAL_C_INCLUDES := \
+    bionic \
+    bionic/libstdc++/include \
+    external/gtest/include \
+    external/stlport/stlport \
+    $(call include-path-for, audio-utils) \
+	frameworks/av/services/audioflinger \
+
+include $(BUILD_EXECUTABLE)
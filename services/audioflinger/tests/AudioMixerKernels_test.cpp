@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "AudioMixerKernels_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "AudioMixerKernels.h"
+
+namespace android {
+
+// Runs every kernel table supported by this CPU on random input and checks that it matches
+// the scalar reference bit for bit, including the ramp state written back.
+
+static const size_t kMaxFrames = 1031;
+// odd sizes exercise the scalar tails after the last full vector
+static const size_t kFrameCounts[] = { 0, 1, 3, 4, 7, 8, 9, 15, 16, 17, 64, 257, kMaxFrames };
+static const int32_t kUnityGain = 0x1000;
+
+// random value in [lo, hi]
+static int32_t randomIn(int32_t lo, int32_t hi) {
+    return lo + (int32_t) (lrand48() % ((int64_t) hi - lo + 1));
+}
+
+class AudioMixerKernelsTest : public testing::Test {
+protected:
+    virtual void SetUp() {
+        srand48(0x5eed);
+        for (size_t i = 0; i < kMaxFrames * 2; ++i) {
+            mIn16[i] = randomIn(INT16_MIN, INT16_MAX);
+            // Q4.27 with headroom, so that the truncation to 16 bits of stereo32 is exercised
+            mIn32[i] = randomIn(-(1 << 29), (1 << 29) - 1);
+            mOutInit[i] = randomIn(-(1 << 28), 1 << 28);
+        }
+        for (size_t i = 0; i < kMaxFrames; ++i) {
+            mAuxInit[i] = randomIn(-(1 << 28), 1 << 28);
+        }
+    }
+
+    void reset() {
+        memcpy(mOutRef, mOutInit, sizeof(mOutInit));
+        memcpy(mOut, mOutInit, sizeof(mOutInit));
+        memcpy(mAuxRef, mAuxInit, sizeof(mAuxInit));
+        memcpy(mAux, mAuxInit, sizeof(mAuxInit));
+    }
+
+    void expectSame(const MixerKernels* k, const char* kernel, size_t frameCount, bool aux) {
+        SCOPED_TRACE(testing::Message() << k->name << " " << kernel << " frames "
+                << frameCount << (aux ? " aux" : ""));
+        EXPECT_EQ(0, memcmp(mOutRef, mOut, sizeof(mOut)));
+        EXPECT_EQ(0, memcmp(mAuxRef, mAux, sizeof(mAux)));
+    }
+
+    // a ramp from one random volume to another over frameCount frames, as
+    // AudioMixer::setParameter(RAMP_VOLUME) sets it up
+    static void randomRamp(int32_t* vol, int32_t* inc, size_t frameCount) {
+        int32_t from = randomIn(0, kUnityGain) << 16;
+        int32_t to = randomIn(0, kUnityGain) << 16;
+        *vol = from;
+        *inc = frameCount > 0 ? (to - from) / (int32_t) frameCount : 0;
+    }
+
+    typedef void (*Volume16)(int32_t*, const int16_t*, size_t, const int16_t*, int32_t*,
+            int16_t);
+    typedef void (*Ramp16)(int32_t*, const int16_t*, size_t, int32_t*, const int32_t*,
+            int32_t*, int32_t*, int32_t);
+    typedef void (*Volume32)(int32_t*, const int32_t*, size_t, const int16_t*, int32_t*,
+            int16_t);
+    typedef void (*Ramp32)(int32_t*, const int32_t*, size_t, int32_t*, const int32_t*,
+            int32_t*, int32_t*, int32_t);
+
+    template <typename TI, typename F>
+    void testVolume(const MixerKernels* k, F ref, F f, const TI* in, const char* kernel) {
+        for (size_t n = 0; n < sizeof(kFrameCounts) / sizeof(kFrameCounts[0]); ++n) {
+            const size_t frameCount = kFrameCounts[n];
+            for (int aux = 0; aux < 2; ++aux) {
+                const int16_t vol[2] = { (int16_t) randomIn(0, kUnityGain),
+                        (int16_t) randomIn(0, kUnityGain) };
+                const int16_t va = randomIn(0, kUnityGain);
+                reset();
+                ref(mOutRef, in, frameCount, vol, aux ? mAuxRef : NULL, va);
+                f(mOut, in, frameCount, vol, aux ? mAux : NULL, va);
+                expectSame(k, kernel, frameCount, aux);
+            }
+        }
+    }
+
+    template <typename TI, typename F>
+    void testRamp(const MixerKernels* k, F ref, F f, const TI* in, const char* kernel) {
+        for (size_t n = 0; n < sizeof(kFrameCounts) / sizeof(kFrameCounts[0]); ++n) {
+            const size_t frameCount = kFrameCounts[n];
+            for (int aux = 0; aux < 2; ++aux) {
+                int32_t volRef[2], inc[2], vaRef, vaInc;
+                randomRamp(&volRef[0], &inc[0], frameCount);
+                randomRamp(&volRef[1], &inc[1], frameCount);
+                randomRamp(&vaRef, &vaInc, frameCount);
+                int32_t vol[2] = { volRef[0], volRef[1] };
+                int32_t va = vaRef;
+                reset();
+                ref(mOutRef, in, frameCount, volRef, inc, aux ? mAuxRef : NULL, &vaRef, vaInc);
+                f(mOut, in, frameCount, vol, inc, aux ? mAux : NULL, &va, vaInc);
+                expectSame(k, kernel, frameCount, aux);
+                EXPECT_EQ(volRef[0], vol[0]);
+                EXPECT_EQ(volRef[1], vol[1]);
+                EXPECT_EQ(vaRef, va);
+            }
+        }
+    }
+
+    int16_t mIn16[kMaxFrames * 2];
+    int32_t mIn32[kMaxFrames * 2];
+    int32_t mOutInit[kMaxFrames * 2];
+    int32_t mAuxInit[kMaxFrames];
+    int32_t mOutRef[kMaxFrames * 2];
+    int32_t mOut[kMaxFrames * 2];
+    int32_t mAuxRef[kMaxFrames];
+    int32_t mAux[kMaxFrames];
+};
+
+TEST_F(AudioMixerKernelsTest, ScalarIsFirst) {
+    ASSERT_GE(MixerKernels::getNumKernels(), 1u);
+    EXPECT_STREQ("scalar", MixerKernels::getKernelsAt(0)->name);
+    EXPECT_TRUE(MixerKernels::getKernelsAt(MixerKernels::getNumKernels()) == NULL);
+    ALOGI("fastest mixer kernels: %s", MixerKernels::getKernels()->name);
+}
+
+TEST_F(AudioMixerKernelsTest, MatchScalar) {
+    const MixerKernels* ref = MixerKernels::getKernelsAt(0);
+    for (size_t i = 1; i < MixerKernels::getNumKernels(); ++i) {
+        const MixerKernels* k = MixerKernels::getKernelsAt(i);
+        testVolume<int16_t, Volume16>(k, ref->stereo16, k->stereo16, mIn16, "stereo16");
+        testVolume<int16_t, Volume16>(k, ref->mono16, k->mono16, mIn16, "mono16");
+        testRamp<int16_t, Ramp16>(k, ref->stereo16Ramp, k->stereo16Ramp, mIn16,
+                "stereo16Ramp");
+        testRamp<int16_t, Ramp16>(k, ref->mono16Ramp, k->mono16Ramp, mIn16, "mono16Ramp");
+        testVolume<int32_t, Volume32>(k, ref->stereo32, k->stereo32, mIn32, "stereo32");
+        testRamp<int32_t, Ramp32>(k, ref->stereo32Ramp, k->stereo32Ramp, mIn32,
+                "stereo32Ramp");
+
+        // include boosted volumes, which make the clamp kick in
+        for (size_t n = 0; n < sizeof(kFrameCounts) / sizeof(kFrameCounts[0]); ++n) {
+            const size_t frameCount = kFrameCounts[n];
+            const int16_t vol[2] = { (int16_t) randomIn(0, 4 * kUnityGain),
+                    (int16_t) randomIn(0, 4 * kUnityGain) };
+            int16_t outRef[kMaxFrames * 2];
+            int16_t out[kMaxFrames * 2];
+            memset(outRef, 0, sizeof(outRef));
+            memset(out, 0, sizeof(out));
+            ref->stereo16To16(outRef, mIn16, frameCount, vol);
+            k->stereo16To16(out, mIn16, frameCount, vol);
+            SCOPED_TRACE(testing::Message() << k->name << " stereo16To16 frames "
+                    << frameCount);
+            EXPECT_EQ(0, memcmp(outRef, out, sizeof(out)));
+        }
+    }
+}
+
+}  // namespace android
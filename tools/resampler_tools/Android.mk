@@ -10,6 +10,10 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES := \
 	fir.cpp
 
+# the filter design is shared with the audioflinger polyphase resampler
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/../../services/audioflinger
+
 LOCAL_MODULE := fir
 
 include $(BUILD_HOST_EXECUTABLE)
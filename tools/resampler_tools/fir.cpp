@@ -20,40 +20,9 @@
 #include <stdlib.h>
 #include <string.h>
 
-static double sinc(double x) {
-    if (fabs(x) == 0.0f) return 1.0f;
-    return sin(x) / x;
-}
-
-static double sqr(double x) {
-    return x*x;
-}
-
-static double I0(double x) {
-    // from the Numerical Recipes in C p. 237
-    double ax,ans,y;
-    ax=fabs(x);
-    if (ax < 3.75) {
-        y=x/3.75;
-        y*=y;
-        ans=1.0+y*(3.5156229+y*(3.0899424+y*(1.2067492
-                +y*(0.2659732+y*(0.360768e-1+y*0.45813e-2)))));
-    } else {
-        y=3.75/ax;
-        ans=(exp(ax)/sqrt(ax))*(0.39894228+y*(0.1328592e-1
-                +y*(0.225319e-2+y*(-0.157565e-2+y*(0.916281e-2
-                        +y*(-0.2057706e-1+y*(0.2635537e-1+y*(-0.1647633e-1
-                                +y*0.392377e-2))))))));
-    }
-    return ans;
-}
-
-static double kaiser(int k, int N, double beta) {
-    if (k < 0 || k > N)
-        return 0;
-    return I0(beta * sqrt(1.0 - sqr((2.0*k)/N - 1.0))) / I0(beta);
-}
+#include "AudioResamplerFirGen.h"
 
+using namespace android;
 
 static void usage(char* name) {
     fprintf(stderr,
@@ -225,7 +194,7 @@ int main(int argc, char** argv)
             for (int j=0 ; j<nzc ; j++) {
                 int ix = j*M + i;
                 double x = (2.0 * M_PI * ix * Fcr) / (1 << nz);
-                double y = kaiser(ix+N, 2*N, beta) * sinc(x) * 2.0 * Fcr;
+                double y = firKaiser(ix+N, 2*N, beta) * firSinc(x) * 2.0 * Fcr;
                 y *= atten;
 
                 if (!debug) {
@@ -251,7 +220,7 @@ int main(int argc, char** argv)
             // generate a FIR per phase
             for (int i=-nzc ; i<nzc ; i++) {
                 double x = 2.0 * M_PI * Fcr * (i + p);
-                double y = kaiser(i+N, 2*N, beta) * sinc(x) * 2.0 * Fcr;;
+                double y = firKaiser(i+N, 2*N, beta) * firSinc(x) * 2.0 * Fcr;;
                 y *= atten;
                 if (!format) {
                     int64_t yi = floor(y * ((1ULL<<(nc-1))) + 0.5);